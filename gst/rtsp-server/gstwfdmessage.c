@@ -828,7 +828,7 @@ gst_wfd_message_parse_buffer (const guint8 * data, guint size,
     GstWFDMessage * msg)
 {
   gchar *p;
-  gchar buffer[255] = { 0 };
+  gchar buffer[8192] = { 0 };
   guint idx = 0;
 
   g_return_val_if_fail (msg != NULL, GST_WFD_EINVAL);
@@ -2237,10 +2237,12 @@ gst_wfd_message_set_presentation_url (GstWFDMessage * msg, gchar * wfd_url0,
 
   if (!msg->presentation_url)
     msg->presentation_url = g_new0 (GstWFDPresentationUrl, 1);
-  if (wfd_url0)
-    msg->presentation_url->wfd_url0 = g_strdup (wfd_url0);
-  if (wfd_url1)
-    msg->presentation_url->wfd_url1 = g_strdup (wfd_url1);
+  if (wfd_url0) {
+    REPLACE_STRING (msg->presentation_url->wfd_url0, wfd_url0);
+  }
+  if (wfd_url1) {
+    REPLACE_STRING (msg->presentation_url->wfd_url1, wfd_url1);
+  }
   return GST_WFD_OK;
 }
 
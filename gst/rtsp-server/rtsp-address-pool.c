@@ -103,7 +103,7 @@ struct _GstRTSPAddressPoolPrivate
 {
   GMutex lock;                  /* protects everything in this struct */
   GList *addresses;
-  GList *allocated;
+  guint n_allocated;
 
   gboolean has_unicast_addresses;
 };
@@ -119,14 +119,42 @@ typedef struct
   guint16 port;
 } Addr;
 
+/* An address range keeps one port bitmap for each address that has ever had
+ * ports allocated. Addresses that were never touched are handed out from the
+ * @next cursor so that huge ranges don't need any memory up front. Maps with
+ * free ports are kept in the @partial queue, which makes acquiring and
+ * releasing ports amortized O(1). Each map remembers an upper bound of its
+ * longest run of free ports so that fragmented maps are only searched again
+ * for requests they might satisfy. */
 typedef struct
 {
   Addr min;
   Addr max;
   guint8 ttl;
+
+  guint n_ports;
+  guint n_words;
+
+  GHashTable *maps;
+  GQueue partial;
+  Addr next;
+  gboolean exhausted;
 } AddrRange;
 
-#define RANGE_IS_SINGLE(r) (memcmp ((r)->min.bytes, (r)->max.bytes, (r)->min.size) == 0)
+typedef struct
+{
+  Addr addr;
+  AddrRange *range;
+  GList link;                   /* in range->partial when not full */
+  gboolean queued;
+  guint n_used;
+  guint first_free;             /* no free ports below this index */
+  guint max_run;                /* no longer runs of free ports */
+  guint64 bits[1];
+} PortMap;
+
+#define MAP_BIT_IS_SET(m,i)  (((m)->bits[(i) >> 6] >> ((i) & 63)) & 1)
+#define MAP_WORD_IS_FULL(m,i) ((m)->bits[(i) >> 6] == G_MAXUINT64)
 
 #define gst_rtsp_address_pool_parent_class parent_class
 G_DEFINE_TYPE (GstRTSPAddressPool, gst_rtsp_address_pool, G_TYPE_OBJECT);
@@ -159,6 +187,7 @@ gst_rtsp_address_pool_init (GstRTSPAddressPool * pool)
 static void
 free_range (AddrRange * range)
 {
+  g_hash_table_destroy (range->maps);
   g_slice_free (AddrRange, range);
 }
 
@@ -170,7 +199,6 @@ gst_rtsp_address_pool_finalize (GObject * obj)
   pool = GST_RTSP_ADDRESS_POOL (obj);
 
   g_list_free_full (pool->priv->addresses, (GDestroyNotify) free_range);
-  g_list_free_full (pool->priv->allocated, (GDestroyNotify) free_range);
   g_mutex_clear (&pool->priv->lock);
 
   G_OBJECT_CLASS (parent_class)->finalize (obj);
@@ -206,7 +234,7 @@ gst_rtsp_address_pool_clear (GstRTSPAddressPool * pool)
   GstRTSPAddressPoolPrivate *priv;
 
   g_return_if_fail (GST_IS_RTSP_ADDRESS_POOL (pool));
-  g_return_if_fail (pool->priv->allocated == NULL);
+  g_return_if_fail (pool->priv->n_allocated == 0);
 
   priv = pool->priv;
 
@@ -253,6 +281,27 @@ get_address_string (Addr * addr)
   return res;
 }
 
+static guint
+addr_hash (gconstpointer key)
+{
+  const Addr *addr = key;
+  guint i, hash = 5381;
+
+  for (i = 0; i < addr->size; i++)
+    hash = (hash << 5) + hash + addr->bytes[i];
+
+  return hash;
+}
+
+static gboolean
+addr_equal (gconstpointer a, gconstpointer b)
+{
+  const Addr *addr1 = a, *addr2 = b;
+
+  return addr1->size == addr2->size &&
+      memcmp (addr1->bytes, addr2->bytes, addr1->size) == 0;
+}
+
 /**
  * gst_rtsp_address_pool_add_range:
  * @pool: a #GstRTSPAddressPool
@@ -304,6 +353,11 @@ gst_rtsp_address_pool_add_range (GstRTSPAddressPool * pool,
     goto invalid;
 
   range->ttl = ttl;
+  range->n_ports = max_port - min_port + 1;
+  range->n_words = (range->n_ports + 63) / 64;
+  range->maps = g_hash_table_new_full (addr_hash, addr_equal, NULL, g_free);
+  g_queue_init (&range->partial);
+  range->next = range->min;
 
   GST_DEBUG_OBJECT (pool, "adding %s-%s:%u-%u ttl %u", min_address, max_address,
       min_port, max_port, ttl);
@@ -341,76 +395,187 @@ inc_address (Addr * addr, guint count)
   }
 }
 
-/* tells us the number of addresses between min_addr and max_addr */
-static guint
-diff_address (Addr * max_addr, Addr * min_addr)
+static PortMap *
+map_new (AddrRange * range, Addr * addr)
 {
-  gint i;
-  guint result = 0;
+  PortMap *map;
 
-  g_return_val_if_fail (min_addr->size == max_addr->size, 0);
+  map = g_malloc0 (sizeof (PortMap) + (range->n_words - 1) * sizeof (guint64));
+  map->addr = *addr;
+  map->addr.port = 0;
+  map->range = range;
+  map->max_run = range->n_ports;
+  map->link.data = map;
+  g_hash_table_insert (range->maps, &map->addr, map);
 
-  for (i = 0; i < min_addr->size; i++) {
-    g_return_val_if_fail (result < (1 << 24), result);
+  return map;
+}
+
+/* find @n_ports free consecutive ports in @map, returns the index of the
+ * first port or -1 */
+static gint
+map_find (PortMap * map, guint n_ports, gboolean even)
+{
+  AddrRange *range = map->range;
+  guint i, j;
+
+  i = map->first_free;
+  while (TRUE) {
+    if (even && ((range->min.port + i) & 1))
+      i++;
+    if (i + n_ports > range->n_ports)
+      break;
+
+    /* skip full words in one go */
+    if (MAP_WORD_IS_FULL (map, i)) {
+      i = (i | 63) + 1;
+      continue;
+    }
+    for (j = 0; j < n_ports; j++) {
+      if (MAP_BIT_IS_SET (map, i + j))
+        break;
+    }
+    if (j == n_ports)
+      return i;
 
-    result <<= 8;
-    result += max_addr->bytes[i] - min_addr->bytes[i];
+    i += j + 1;
   }
+  return -1;
+}
 
-  return result;
+static gboolean
+map_is_free (PortMap * map, guint start, guint n_ports)
+{
+  guint i;
+
+  for (i = start; i < start + n_ports; i++) {
+    if (MAP_BIT_IS_SET (map, i))
+      return FALSE;
+  }
+  return TRUE;
 }
 
-static AddrRange *
-split_range (GstRTSPAddressPool * pool, AddrRange * range, guint skip_addr,
-    guint skip_port, gint n_ports)
+static void
+map_take (PortMap * map, guint start, guint n_ports)
 {
-  GstRTSPAddressPoolPrivate *priv = pool->priv;
-  AddrRange *temp;
+  AddrRange *range = map->range;
+  guint i;
 
-  if (skip_addr) {
-    temp = g_slice_dup (AddrRange, range);
-    memcpy (temp->max.bytes, temp->min.bytes, temp->min.size);
-    inc_address (&temp->max, skip_addr - 1);
-    priv->addresses = g_list_prepend (priv->addresses, temp);
+  for (i = start; i < start + n_ports; i++)
+    map->bits[i >> 6] |= G_GUINT64_CONSTANT (1) << (i & 63);
+  map->n_used += n_ports;
 
-    inc_address (&range->min, skip_addr);
+  if (start == map->first_free) {
+    while (map->first_free < range->n_ports
+        && MAP_BIT_IS_SET (map, map->first_free))
+      map->first_free++;
   }
 
-  if (!RANGE_IS_SINGLE (range)) {
-    /* min and max are not the same, we have more than one address. */
-    temp = g_slice_dup (AddrRange, range);
-    /* increment the range min address */
-    inc_address (&temp->min, 1);
-    /* and store back in pool */
-    priv->addresses = g_list_prepend (priv->addresses, temp);
+  if (map->n_used == range->n_ports) {
+    if (map->queued)
+      g_queue_unlink (&range->partial, &map->link);
+    map->queued = FALSE;
+  } else if (!map->queued) {
+    g_queue_push_tail_link (&range->partial, &map->link);
+    map->queued = TRUE;
+  }
+}
+
+static gboolean
+map_release (PortMap * map, guint start, guint n_ports)
+{
+  AddrRange *range = map->range;
+  guint i;
 
-    /* adjust range with only the first address */
-    memcpy (range->max.bytes, range->min.bytes, range->min.size);
+  for (i = start; i < start + n_ports; i++) {
+    if (!MAP_BIT_IS_SET (map, i))
+      return FALSE;
+  }
+  for (i = start; i < start + n_ports; i++)
+    map->bits[i >> 6] &= ~(G_GUINT64_CONSTANT (1) << (i & 63));
+  map->n_used -= n_ports;
+  map->first_free = MIN (map->first_free, start);
+  /* the released ports can join other free runs, search the map again */
+  map->max_run = range->n_ports;
+
+  /* reuse released ports first */
+  if (!map->queued) {
+    g_queue_push_head_link (&range->partial, &map->link);
+    map->queued = TRUE;
   }
+  return TRUE;
+}
+
+/* take @n_ports from @range, first from the addresses that already have
+ * allocations and then from the addresses that were never used */
+static PortMap *
+range_acquire (AddrRange * range, gint n_ports, gboolean even, guint * start)
+{
+  GList *walk;
+  PortMap *map;
+  gint idx;
+
+  /* quick check for enough ports */
+  if (range->n_ports < (guint) n_ports + (even && (range->min.port & 1)))
+    return NULL;
+
+  for (walk = range->partial.head; walk; walk = walk->next) {
+    map = walk->data;
 
-  /* range now contains only one single address */
-  if (skip_port > 0) {
-    /* make a range with the skipped ports */
-    temp = g_slice_dup (AddrRange, range);
-    temp->max.port = temp->min.port + skip_port - 1;
-    /* and store back in pool */
-    priv->addresses = g_list_prepend (priv->addresses, temp);
+    /* the free ports are too fragmented for this request */
+    if (map->max_run < (guint) n_ports)
+      continue;
+
+    if ((idx = map_find (map, n_ports, even)) != -1)
+      goto found;
 
-    /* increment range port */
-    range->min.port += skip_port;
+    /* remember that the map has no run this long, until some of its ports
+     * are released. A run of one more port always has an even aligned
+     * run. Smaller requests still find the leftovers. */
+    map->max_run = MIN (map->max_run, (guint) n_ports - (even ? 0 : 1));
   }
-  /* range now contains single address with desired port number */
-  if (range->max.port - range->min.port + 1 > n_ports) {
-    /* make a range with the remaining ports */
-    temp = g_slice_dup (AddrRange, range);
-    temp->min.port += n_ports;
-    /* and store back in pool */
-    priv->addresses = g_list_prepend (priv->addresses, temp);
-
-    /* and truncate port */
-    range->max.port = range->min.port + n_ports - 1;
+
+  while (!range->exhausted) {
+    Addr fresh = range->next;
+
+    if (memcmp (fresh.bytes, range->max.bytes, fresh.size) == 0)
+      range->exhausted = TRUE;
+    else
+      inc_address (&range->next, 1);
+
+    /* skip addresses with reservations, they are in the partial queue or
+     * full */
+    if (g_hash_table_lookup (range->maps, &fresh))
+      continue;
+
+    map = map_new (range, &fresh);
+    if ((idx = map_find (map, n_ports, even)) != -1)
+      goto found;
   }
-  return range;
+  return NULL;
+
+found:
+  map_take (map, idx, n_ports);
+  *start = idx;
+
+  return map;
+}
+
+static GstRTSPAddress *
+make_address (GstRTSPAddressPool * pool, PortMap * map, guint start,
+    gint n_ports)
+{
+  GstRTSPAddress *addr;
+
+  addr = g_slice_new0 (GstRTSPAddress);
+  addr->pool = g_object_ref (pool);
+  addr->address = get_address_string (&map->addr);
+  addr->n_ports = n_ports;
+  addr->port = map->range->min.port + start;
+  addr->ttl = map->range->ttl;
+  addr->priv = map;
+
+  return addr;
 }
 
 /**
@@ -431,25 +596,22 @@ gst_rtsp_address_pool_acquire_address (GstRTSPAddressPool * pool,
     GstRTSPAddressFlags flags, gint n_ports)
 {
   GstRTSPAddressPoolPrivate *priv;
-  GList *walk, *next;
-  AddrRange *result;
+  GList *walk;
+  PortMap *map;
+  guint start;
   GstRTSPAddress *addr;
 
   g_return_val_if_fail (GST_IS_RTSP_ADDRESS_POOL (pool), NULL);
   g_return_val_if_fail (n_ports > 0, NULL);
 
   priv = pool->priv;
-  result = NULL;
+  map = NULL;
   addr = NULL;
 
   g_mutex_lock (&priv->lock);
   /* go over available ranges */
-  for (walk = priv->addresses; walk; walk = next) {
-    AddrRange *range;
-    gint ports, skip;
-
-    range = walk->data;
-    next = walk->next;
+  for (walk = priv->addresses; walk; walk = walk->next) {
+    AddrRange *range = walk->data;
 
     /* check address type when given */
     if (flags & GST_RTSP_ADDRESS_FLAG_IPV4 && !ADDR_IS_IPV4 (&range->min))
@@ -461,34 +623,17 @@ gst_rtsp_address_pool_acquire_address (GstRTSPAddressPool * pool,
     if (flags & GST_RTSP_ADDRESS_FLAG_UNICAST && range->ttl != 0)
       continue;
 
-    /* check for enough ports */
-    ports = range->max.port - range->min.port + 1;
-    if (flags & GST_RTSP_ADDRESS_FLAG_EVEN_PORT
-        && !ADDR_IS_EVEN_PORT (&range->min))
-      skip = 1;
-    else
-      skip = 0;
-    if (ports - skip < n_ports)
-      continue;
-
-    /* we found a range, remove from the list */
-    priv->addresses = g_list_delete_link (priv->addresses, walk);
-    /* now split and exit our loop */
-    result = split_range (pool, range, 0, skip, n_ports);
-    priv->allocated = g_list_prepend (priv->allocated, result);
-    break;
+    map = range_acquire (range, n_ports,
+        (flags & GST_RTSP_ADDRESS_FLAG_EVEN_PORT) != 0, &start);
+    if (map) {
+      addr = make_address (pool, map, start, n_ports);
+      priv->n_allocated++;
+      break;
+    }
   }
   g_mutex_unlock (&priv->lock);
 
-  if (result) {
-    addr = g_slice_new0 (GstRTSPAddress);
-    addr->pool = g_object_ref (pool);
-    addr->address = get_address_string (&result->min);
-    addr->n_ports = n_ports;
-    addr->port = result->min.port;
-    addr->ttl = result->ttl;
-    addr->priv = result;
-
+  if (addr) {
     GST_DEBUG_OBJECT (pool, "got address %s:%u ttl %u", addr->address,
         addr->port, addr->ttl);
   }
@@ -509,29 +654,25 @@ gst_rtsp_address_pool_release_address (GstRTSPAddressPool * pool,
     GstRTSPAddress * addr)
 {
   GstRTSPAddressPoolPrivate *priv;
-  GList *find;
-  AddrRange *range;
+  PortMap *map;
 
   g_return_if_fail (GST_IS_RTSP_ADDRESS_POOL (pool));
   g_return_if_fail (addr != NULL);
   g_return_if_fail (addr->pool == pool);
 
   priv = pool->priv;
-  range = addr->priv;
+  map = addr->priv;
 
   /* we don't want to free twice */
   addr->priv = NULL;
   addr->pool = NULL;
 
   g_mutex_lock (&priv->lock);
-  find = g_list_find (priv->allocated, range);
-  if (find == NULL)
+  if (map == NULL || !map_release (map, addr->port - map->range->min.port,
+          addr->n_ports))
     goto not_found;
 
-  priv->allocated = g_list_delete_link (priv->allocated, find);
-
-  /* FIXME, merge and do something clever */
-  priv->addresses = g_list_prepend (priv->addresses, range);
+  priv->n_allocated--;
   g_mutex_unlock (&priv->lock);
 
   g_object_unref (pool);
@@ -547,6 +688,31 @@ not_found:
   }
 }
 
+static void
+dump_map (gpointer key, PortMap * map, GstRTSPAddressPool * pool)
+{
+  AddrRange *range = map->range;
+  gchar *addr;
+  guint i, j;
+
+  if (map->n_used == 0)
+    return;
+
+  addr = get_address_string (&map->addr);
+  for (i = 0; i < range->n_ports; i = j + 1) {
+    if (!MAP_BIT_IS_SET (map, i)) {
+      j = i;
+      continue;
+    }
+    /* print runs of allocated ports */
+    for (j = i; j + 1 < range->n_ports && MAP_BIT_IS_SET (map, j + 1); j++)
+      ;
+    g_print ("  address %s, port %u-%u, ttl %u\n", addr,
+        range->min.port + i, range->min.port + j, range->ttl);
+  }
+  g_free (addr);
+}
+
 static void
 dump_range (AddrRange * range, GstRTSPAddressPool * pool)
 {
@@ -560,6 +726,12 @@ dump_range (AddrRange * range, GstRTSPAddressPool * pool)
   g_free (addr2);
 }
 
+static void
+dump_allocated (AddrRange * range, GstRTSPAddressPool * pool)
+{
+  g_hash_table_foreach (range->maps, (GHFunc) dump_map, pool);
+}
+
 /**
  * gst_rtsp_address_pool_dump:
  * @pool: a #GstRTSPAddressPool
@@ -576,25 +748,22 @@ gst_rtsp_address_pool_dump (GstRTSPAddressPool * pool)
   priv = pool->priv;
 
   g_mutex_lock (&priv->lock);
-  g_print ("free:\n");
+  g_print ("ranges:\n");
   g_list_foreach (priv->addresses, (GFunc) dump_range, pool);
   g_print ("allocated:\n");
-  g_list_foreach (priv->allocated, (GFunc) dump_range, pool);
+  g_list_foreach (priv->addresses, (GFunc) dump_allocated, pool);
   g_mutex_unlock (&priv->lock);
 }
 
-static GList *
+static AddrRange *
 find_address_in_ranges (GList * addresses, Addr * addr, guint port,
     guint n_ports, guint ttl)
 {
-  GList *walk, *next;
-
-  /* go over available ranges */
-  for (walk = addresses; walk; walk = next) {
-    AddrRange *range;
+  GList *walk;
 
-    range = walk->data;
-    next = walk->next;
+  /* go over the ranges */
+  for (walk = addresses; walk; walk = walk->next) {
+    AddrRange *range = walk->data;
 
     /* Not the right type of address */
     if (range->min.size != addr->size)
@@ -612,10 +781,9 @@ find_address_in_ranges (GList * addresses, Addr * addr, guint port,
     if (ttl != range->ttl)
       continue;
 
-    break;
+    return range;
   }
-
-  return walk;
+  return NULL;
 }
 
 /**
@@ -645,8 +813,7 @@ gst_rtsp_address_pool_reserve_address (GstRTSPAddressPool * pool,
 {
   GstRTSPAddressPoolPrivate *priv;
   Addr input_addr;
-  GList *list;
-  AddrRange *addr_range;
+  AddrRange *range;
   GstRTSPAddress *addr;
   gboolean is_multicast;
   GstRTSPAddressPoolResult result;
@@ -659,7 +826,6 @@ gst_rtsp_address_pool_reserve_address (GstRTSPAddressPool * pool,
   g_return_val_if_fail (address != NULL, GST_RTSP_ADDRESS_POOL_EINVAL);
 
   priv = pool->priv;
-  addr_range = NULL;
   addr = NULL;
   is_multicast = ttl != 0;
 
@@ -667,46 +833,32 @@ gst_rtsp_address_pool_reserve_address (GstRTSPAddressPool * pool,
     goto invalid;
 
   g_mutex_lock (&priv->lock);
-  list = find_address_in_ranges (priv->addresses, &input_addr, port, n_ports,
+  range = find_address_in_ranges (priv->addresses, &input_addr, port, n_ports,
       ttl);
-  if (list != NULL) {
-    AddrRange *range = list->data;
-    guint skip_port, skip_addr;
+  if (range != NULL) {
+    PortMap *map;
+    guint start;
 
-    skip_addr = diff_address (&input_addr, &range->min);
-    skip_port = port - range->min.port;
+    start = port - range->min.port;
 
-    GST_DEBUG_OBJECT (pool, "diff 0x%08x/%u", skip_addr, skip_port);
+    map = g_hash_table_lookup (range->maps, &input_addr);
+    if (map == NULL)
+      map = map_new (range, &input_addr);
 
-    /* we found a range, remove from the list */
-    priv->addresses = g_list_delete_link (priv->addresses, list);
-    /* now split and exit our loop */
-    addr_range = split_range (pool, range, skip_addr, skip_port, n_ports);
-    priv->allocated = g_list_prepend (priv->allocated, addr_range);
-  }
+    if (map_is_free (map, start, n_ports)) {
+      map_take (map, start, n_ports);
+      addr = make_address (pool, map, start, n_ports);
+      priv->n_allocated++;
 
-  if (addr_range) {
-    addr = g_slice_new0 (GstRTSPAddress);
-    addr->pool = g_object_ref (pool);
-    addr->address = get_address_string (&addr_range->min);
-    addr->n_ports = n_ports;
-    addr->port = addr_range->min.port;
-    addr->ttl = addr_range->ttl;
-    addr->priv = addr_range;
-
-    result = GST_RTSP_ADDRESS_POOL_OK;
-    GST_DEBUG_OBJECT (pool, "reserved address %s:%u ttl %u", addr->address,
-        addr->port, addr->ttl);
-  } else {
-    /* We failed to reserve the address. Check if it was because the address
-     * was already in use or if it wasn't in the pool to begin with */
-    list = find_address_in_ranges (priv->allocated, &input_addr, port, n_ports,
-        ttl);
-    if (list != NULL) {
-      result = GST_RTSP_ADDRESS_POOL_ERESERVED;
+      result = GST_RTSP_ADDRESS_POOL_OK;
+      GST_DEBUG_OBJECT (pool, "reserved address %s:%u ttl %u", addr->address,
+          addr->port, addr->ttl);
     } else {
-      result = GST_RTSP_ADDRESS_POOL_ERANGE;
+      /* the address is in the pool but (some of) the ports are in use */
+      result = GST_RTSP_ADDRESS_POOL_ERESERVED;
     }
+  } else {
+    result = GST_RTSP_ADDRESS_POOL_ERANGE;
   }
   g_mutex_unlock (&priv->lock);
 
@@ -141,7 +141,9 @@ gchar *             gst_rtsp_auth_make_basic        (const gchar * user, const g
  *
  * The default #GstRTSPAuth object uses this string in the token to find the
  * role of the media factory. It will then retrieve the #GstRTSPPermissions of
- * the media factory and retrieve the role with the same name.
+ * the media factory and retrieve the role with the same name. The default
+ * #GstRTSPClient also uses the role as the QoS policy of the transports, see
+ * gst_rtsp_stream_transport_set_qos_policy().
  */
 #define GST_RTSP_TOKEN_MEDIA_FACTORY_ROLE      "media.factory.role"
 /**
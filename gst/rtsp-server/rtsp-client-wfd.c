@@ -40,6 +40,7 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "rtsp-client-wfd.h"
@@ -54,8 +55,51 @@
  * send_lock, lock, tunnels_lock
  */
 
+/* capabilities and negotiation results of a sink. They are cached by the
+ * address of the sink and confirmed with the hash of its EDID so that a
+ * reconnecting sink can skip the full capability exchange */
+typedef struct
+{
+  gchar *edid_hash;
+  gchar *m4_body;
+  gchar *negotiated_format;
+
+  guint caCodec;
+  guint cFreq;
+  guint cChanels;
+  guint cBitwidth;
+  guint caLatency;
+  guint cvCodec;
+  guint cNative;
+  guint64 cNativeResolution;
+  gint video_native_resolution;
+  guint cCEAResolution;
+  guint cVESAResolution;
+  guint cHHResolution;
+  guint cProfile;
+  guint cLevel;
+  guint32 cMaxHeight;
+  guint32 cMaxWidth;
+  guint32 cFramerate;
+  guint32 cInterleaved;
+  guint32 cmin_slice_size;
+  guint32 cslice_enc_params;
+  guint cframe_rate_control;
+  guint cvLatency;
+  gboolean edid_supported;
+  guint32 edid_hres;
+  guint32 edid_vres;
+} WFDSinkCache;
+
+#define SINK_CACHE_MAX  32
+
+static GMutex sink_cache_lock;
+static GHashTable *sink_cache;  /* protected by sink_cache_lock */
+
 struct _GstRTSPWFDClientPrivate
 {
+  GMutex lock;                  /* protects IDR, keepalive and format state */
+
   GstRTSPWFDClientSendFunc send_func;   /* protected by send_lock */
   gpointer send_data;           /* protected by send_lock */
   GDestroyNotify send_notify;   /* protected by send_lock */
@@ -109,9 +153,34 @@ struct _GstRTSPWFDClientPrivate
   gboolean edid_supported;
   guint32 edid_hres;
   guint32 edid_vres;
+  gchar *edid_hash;
+
+  /* cache entry of the sink that is being confirmed */
+  WFDSinkCache *cached;
+
+  /* format chosen for this sink in M4, protected by lock */
+  gchar *negotiated_format;
+
+  /* IDR requests from the sink */
+  guint idr_request_window;
+  gint64 last_idr_request;
+
+  /* M16 keepalives, protected by lock. The negotiation is pending from M1
+   * until M4 is answered */
+  guint keepalive_cseq;
+  gint64 keepalive_sent;        /* monotonic time, 0 when none is pending */
+  GstClockTime rtt;
 };
 
 #define DEFAULT_WFD_TIMEOUT 60
+#define DEFAULT_IDR_REQUEST_WINDOW 100
+
+enum
+{
+  PROP_0,
+  PROP_IDR_REQUEST_WINDOW,
+  PROP_LAST
+};
 
 enum
 {
@@ -160,6 +229,8 @@ GstRTSPResult
 prepare_response (GstRTSPWFDClient * client, GstRTSPMessage * request,
     GstRTSPMessage * response, GstRTSPMethod method);
 
+static void sink_cache_free (WFDSinkCache * cache);
+
 static GstRTSPResult handle_M1_message (GstRTSPWFDClient * client);
 static GstRTSPResult handle_M3_message (GstRTSPWFDClient * client);
 static GstRTSPResult handle_M4_message (GstRTSPWFDClient * client);
@@ -194,6 +265,13 @@ gst_rtsp_wfd_client_class_init (GstRTSPWFDClientClass * klass)
 
   rtsp_client_class->handle_response = handle_wfd_response;
 
+  g_object_class_install_property (gobject_class, PROP_IDR_REQUEST_WINDOW,
+      g_param_spec_uint ("idr-request-window", "IDR Request Window",
+          "Merge IDR requests from the sink that arrive within this many "
+          "milliseconds of the previous one (0 = disable)", 0, G_MAXUINT,
+          DEFAULT_IDR_REQUEST_WINDOW,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_rtsp_client_wfd_signals[SIGNAL_WFD_OPTIONS_REQUEST] =
       g_signal_new ("wfd-options-request", G_TYPE_FROM_CLASS (klass),
       G_SIGNAL_RUN_LAST, G_STRUCT_OFFSET (GstRTSPWFDClientClass,
@@ -209,6 +287,9 @@ gst_rtsp_wfd_client_class_init (GstRTSPWFDClientClass * klass)
   klass->wfd_options_request = wfd_options_request_done;
   klass->wfd_get_param_request = wfd_get_param_request_done;
 
+  sink_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) sink_cache_free);
+
   GST_DEBUG_CATEGORY_INIT (rtsp_wfd_client_debug, "rtspwfdclient", 0,
       "GstRTSPWFDClient");
 }
@@ -219,6 +300,9 @@ gst_rtsp_wfd_client_init (GstRTSPWFDClient * client)
   GstRTSPWFDClientPrivate *priv = GST_RTSP_WFD_CLIENT_GET_PRIVATE (client);
 
   client->priv = priv;
+  g_mutex_init (&priv->lock);
+  priv->idr_request_window = DEFAULT_IDR_REQUEST_WINDOW;
+  priv->rtt = GST_CLOCK_TIME_NONE;
   priv->protection_enabled = FALSE;
   priv->video_native_resolution = GST_WFD_VIDEO_CEA_RESOLUTION;
   priv->video_resolution_supported = GST_WFD_CEA_640x480P60;
@@ -230,10 +314,16 @@ static void
 gst_rtsp_wfd_client_finalize (GObject * obj)
 {
   GstRTSPWFDClient *client = GST_RTSP_WFD_CLIENT (obj);
-  //GstRTSPWFDClientPrivate *priv = client->priv;
+  GstRTSPWFDClientPrivate *priv = client->priv;
 
   GST_INFO ("finalize client %p", client);
 
+  g_free (priv->negotiated_format);
+  g_free (priv->edid_hash);
+  if (priv->cached)
+    sink_cache_free (priv->cached);
+  g_mutex_clear (&priv->lock);
+
   G_OBJECT_CLASS (gst_rtsp_wfd_client_parent_class)->finalize (obj);
 }
 
@@ -241,9 +331,13 @@ static void
 gst_rtsp_wfd_client_get_property (GObject * object, guint propid,
     GValue * value, GParamSpec * pspec)
 {
-  //GstRTSPWFDClient *client = GST_RTSP_WFD_CLIENT (object);
+  GstRTSPWFDClient *client = GST_RTSP_WFD_CLIENT (object);
 
   switch (propid) {
+    case PROP_IDR_REQUEST_WINDOW:
+      g_value_set_uint (value,
+          gst_rtsp_wfd_client_get_idr_request_window (client));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -253,9 +347,13 @@ static void
 gst_rtsp_wfd_client_set_property (GObject * object, guint propid,
     const GValue * value, GParamSpec * pspec)
 {
-  //GstRTSPWFDClient *client = GST_RTSP_WFD_CLIENT (object);
+  GstRTSPWFDClient *client = GST_RTSP_WFD_CLIENT (object);
 
   switch (propid) {
+    case PROP_IDR_REQUEST_WINDOW:
+      gst_rtsp_wfd_client_set_idr_request_window (client,
+          g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -292,6 +390,182 @@ gst_rtsp_wfd_client_start_wfd (GstRTSPWFDClient * client)
   return;
 }
 
+static void
+sink_cache_free (WFDSinkCache * cache)
+{
+  g_free (cache->edid_hash);
+  g_free (cache->m4_body);
+  g_free (cache->negotiated_format);
+  g_slice_free (WFDSinkCache, cache);
+}
+
+static WFDSinkCache *
+sink_cache_copy (WFDSinkCache * cache)
+{
+  WFDSinkCache *copy;
+
+  copy = g_slice_dup (WFDSinkCache, cache);
+  copy->edid_hash = g_strdup (cache->edid_hash);
+  copy->m4_body = g_strdup (cache->m4_body);
+  copy->negotiated_format = g_strdup (cache->negotiated_format);
+
+  return copy;
+}
+
+static const gchar *
+get_sink_address (GstRTSPWFDClient * client)
+{
+  GstRTSPConnection *connection;
+
+  connection = gst_rtsp_client_get_connection (GST_RTSP_CLIENT_CAST (client));
+  if (connection == NULL)
+    return NULL;
+
+  return gst_rtsp_connection_get_ip (connection);
+}
+
+/* look up the sink of @client in the capability cache, a hit still needs to
+ * be confirmed with the EDID of the sink */
+static void
+sink_cache_lookup (GstRTSPWFDClient * client)
+{
+  GstRTSPWFDClientPrivate *priv = client->priv;
+  const gchar *address;
+  WFDSinkCache *cache;
+
+  if (priv->cached || !(address = get_sink_address (client)))
+    return;
+
+  g_mutex_lock (&sink_cache_lock);
+  if ((cache = g_hash_table_lookup (sink_cache, address)))
+    priv->cached = sink_cache_copy (cache);
+  g_mutex_unlock (&sink_cache_lock);
+
+  if (priv->cached)
+    GST_INFO_OBJECT (client, "sink %s is in the capability cache", address);
+}
+
+static void
+sink_cache_remove (GstRTSPWFDClient * client)
+{
+  const gchar *address;
+
+  if (!(address = get_sink_address (client)))
+    return;
+
+  g_mutex_lock (&sink_cache_lock);
+  g_hash_table_remove (sink_cache, address);
+  g_mutex_unlock (&sink_cache_lock);
+}
+
+static void
+sink_cache_store (GstRTSPWFDClient * client, const gchar * m4_body)
+{
+  GstRTSPWFDClientPrivate *priv = client->priv;
+  const gchar *address;
+  WFDSinkCache *cache;
+
+  /* we could never confirm the identity of a sink without EDID */
+  if (priv->edid_hash == NULL || !(address = get_sink_address (client)))
+    return;
+
+  cache = g_slice_new0 (WFDSinkCache);
+  cache->edid_hash = g_strdup (priv->edid_hash);
+  cache->m4_body = g_strdup (m4_body);
+  g_mutex_lock (&priv->lock);
+  cache->negotiated_format = g_strdup (priv->negotiated_format);
+  g_mutex_unlock (&priv->lock);
+
+  cache->caCodec = priv->caCodec;
+  cache->cFreq = priv->cFreq;
+  cache->cChanels = priv->cChanels;
+  cache->cBitwidth = priv->cBitwidth;
+  cache->caLatency = priv->caLatency;
+  cache->cvCodec = priv->cvCodec;
+  cache->cNative = priv->cNative;
+  cache->cNativeResolution = priv->cNativeResolution;
+  cache->video_native_resolution = priv->video_native_resolution;
+  cache->cCEAResolution = priv->cCEAResolution;
+  cache->cVESAResolution = priv->cVESAResolution;
+  cache->cHHResolution = priv->cHHResolution;
+  cache->cProfile = priv->cProfile;
+  cache->cLevel = priv->cLevel;
+  cache->cMaxHeight = priv->cMaxHeight;
+  cache->cMaxWidth = priv->cMaxWidth;
+  cache->cFramerate = priv->cFramerate;
+  cache->cInterleaved = priv->cInterleaved;
+  cache->cmin_slice_size = priv->cmin_slice_size;
+  cache->cslice_enc_params = priv->cslice_enc_params;
+  cache->cframe_rate_control = priv->cframe_rate_control;
+  cache->cvLatency = priv->cvLatency;
+  cache->edid_supported = priv->edid_supported;
+  cache->edid_hres = priv->edid_hres;
+  cache->edid_vres = priv->edid_vres;
+
+  g_mutex_lock (&sink_cache_lock);
+  /* keep the cache bounded, sinks that come back are negotiated again */
+  if (g_hash_table_size (sink_cache) >= SINK_CACHE_MAX &&
+      !g_hash_table_contains (sink_cache, address))
+    g_hash_table_remove_all (sink_cache);
+  g_hash_table_replace (sink_cache, g_strdup (address), cache);
+  g_mutex_unlock (&sink_cache_lock);
+}
+
+/* the sink confirmed its identity, take the negotiation results from the
+ * cache instead of the full M3 capabilities */
+static void
+sink_cache_restore (GstRTSPWFDClient * client)
+{
+  GstRTSPWFDClientPrivate *priv = client->priv;
+  WFDSinkCache *cache = priv->cached;
+
+  priv->caCodec = cache->caCodec;
+  priv->cFreq = cache->cFreq;
+  priv->cChanels = cache->cChanels;
+  priv->cBitwidth = cache->cBitwidth;
+  priv->caLatency = cache->caLatency;
+  priv->cvCodec = cache->cvCodec;
+  priv->cNative = cache->cNative;
+  priv->cNativeResolution = cache->cNativeResolution;
+  priv->video_native_resolution = cache->video_native_resolution;
+  priv->cCEAResolution = cache->cCEAResolution;
+  priv->cVESAResolution = cache->cVESAResolution;
+  priv->cHHResolution = cache->cHHResolution;
+  priv->cProfile = cache->cProfile;
+  priv->cLevel = cache->cLevel;
+  priv->cMaxHeight = cache->cMaxHeight;
+  priv->cMaxWidth = cache->cMaxWidth;
+  priv->cFramerate = cache->cFramerate;
+  priv->cInterleaved = cache->cInterleaved;
+  priv->cmin_slice_size = cache->cmin_slice_size;
+  priv->cslice_enc_params = cache->cslice_enc_params;
+  priv->cframe_rate_control = cache->cframe_rate_control;
+  priv->cvLatency = cache->cvLatency;
+  priv->edid_supported = cache->edid_supported;
+  priv->edid_hres = cache->edid_hres;
+  priv->edid_vres = cache->edid_vres;
+
+  g_mutex_lock (&priv->lock);
+  g_free (priv->negotiated_format);
+  priv->negotiated_format = g_strdup (cache->negotiated_format);
+  g_mutex_unlock (&priv->lock);
+}
+
+/* the url of the stream that the sink should SETUP, it is made from the
+ * current connection, the cached M4 of the sink can have a stale one */
+static gchar *
+make_presentation_url (GstRTSPWFDClient * client)
+{
+  GstRTSPConnection *connection;
+  GstRTSPUrl *url;
+
+  connection = gst_rtsp_client_get_connection (GST_RTSP_CLIENT_CAST (client));
+  if (connection == NULL || !(url = gst_rtsp_connection_get_url (connection)))
+    return NULL;
+
+  return g_strdup_printf ("rtsp://%s/wfd1.0/streamid=0", url->host);
+}
+
 static void
 wfd_options_request_done (GstRTSPWFDClient * client)
 {
@@ -738,6 +1012,43 @@ wfd_make_path_from_uri (GstRTSPClient * client, const GstRTSPUrl * uri)
   return path;
 }
 
+/* check if @response answers the pending M16 keepalive and update the
+ * round-trip time of the sink */
+static gboolean
+handle_keepalive_response (GstRTSPWFDClient * client,
+    GstRTSPMessage * response)
+{
+  GstRTSPWFDClientPrivate *priv = client->priv;
+  gchar *str;
+  guint cseq;
+  GstClockTime rtt;
+
+  if (gst_rtsp_message_get_header (response, GST_RTSP_HDR_CSEQ, &str,
+          0) != GST_RTSP_OK)
+    return FALSE;
+
+  cseq = (guint) atoi (str);
+
+  g_mutex_lock (&priv->lock);
+  if (priv->keepalive_sent == 0 || cseq != priv->keepalive_cseq) {
+    g_mutex_unlock (&priv->lock);
+    return FALSE;
+  }
+
+  rtt = (g_get_monotonic_time () - priv->keepalive_sent) * GST_USECOND;
+  if (priv->rtt == GST_CLOCK_TIME_NONE)
+    priv->rtt = rtt;
+  else
+    priv->rtt = (7 * priv->rtt + rtt) / 8;
+  priv->keepalive_sent = 0;
+  g_mutex_unlock (&priv->lock);
+
+  GST_LOG_OBJECT (client, "M16 response, rtt %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (rtt));
+
+  return TRUE;
+}
+
 static void
 handle_wfd_response (GstRTSPClient * client, GstRTSPContext * ctx)
 {
@@ -755,6 +1066,9 @@ handle_wfd_response (GstRTSPClient * client, GstRTSPContext * ctx)
   if (!ctx->response)
     GST_ERROR_OBJECT (_client, "Response is NULL");
 
+  if (handle_keepalive_response (_client, ctx->response))
+    return;
+
   /* parsing the GET_PARAMTER response */
   res = gst_rtsp_message_get_body (ctx->response, (guint8 **) & data, &size);
   if (res != GST_RTSP_OK) {
@@ -797,20 +1111,23 @@ handle_wfd_response (GstRTSPClient * client, GstRTSPContext * ctx)
         }
       }
 
-      /* Get the Video formats supported by WFDSink */
-      wfd_res =
-          gst_wfd_message_get_supported_video_format (msg, &priv->cvCodec,
-          &priv->cNative, &priv->cNativeResolution,
-          (guint64 *) & priv->cCEAResolution,
-          (guint64 *) & priv->cVESAResolution,
-          (guint64 *) & priv->cHHResolution, &priv->cProfile, &priv->cLevel,
-          &priv->cvLatency, &priv->cMaxHeight, &priv->cMaxWidth,
-          &priv->cmin_slice_size, &priv->cslice_enc_params,
-          &priv->cframe_rate_control);
-      if (wfd_res != GST_WFD_OK) {
-        GST_WARNING_OBJECT (client,
-            "Failed to get wfd supported video formats...");
-        goto error;
+      /* Get the Video formats supported by WFDSink, a sink that confirms
+       * its cached capabilities doesn't send them */
+      if (priv->cached == NULL) {
+        wfd_res =
+            gst_wfd_message_get_supported_video_format (msg,
+            &priv->cvCodec, &priv->cNative, &priv->cNativeResolution,
+            (guint64 *) & priv->cCEAResolution,
+            (guint64 *) & priv->cVESAResolution,
+            (guint64 *) & priv->cHHResolution, &priv->cProfile,
+            &priv->cLevel, &priv->cvLatency, &priv->cMaxHeight,
+            &priv->cMaxWidth, &priv->cmin_slice_size,
+            &priv->cslice_enc_params, &priv->cframe_rate_control);
+        if (wfd_res != GST_WFD_OK) {
+          GST_WARNING_OBJECT (client,
+              "Failed to get wfd supported video formats...");
+          goto error;
+        }
       }
 
       if (msg->client_rtp_ports) {
@@ -841,6 +1158,12 @@ handle_wfd_response (GstRTSPClient * client, GstRTSPContext * ctx)
         }
         GST_DEBUG_OBJECT (client, " edid supported: %d edid_block_count: %d",
             priv->edid_supported, edid_block_count);
+        g_free (priv->edid_hash);
+        priv->edid_hash = NULL;
+        if (priv->edid_supported && edid_block_count > 0)
+          priv->edid_hash =
+              g_compute_checksum_for_data (G_CHECKSUM_SHA1,
+              (const guchar *) edid_payload, 128 * edid_block_count);
         if (priv->edid_supported) {
           priv->edid_hres = 0;
           priv->edid_vres = 0;
@@ -860,6 +1183,7 @@ handle_wfd_response (GstRTSPClient * client, GstRTSPContext * ctx)
             GST_WARNING_OBJECT (client, " edid invalid resolutions");
           }
         }
+        g_free (edid_payload);
       }
 
       if (msg->content_protection) {
@@ -883,6 +1207,24 @@ handle_wfd_response (GstRTSPClient * client, GstRTSPContext * ctx)
 #endif
       }
 
+      if (priv->cached) {
+        /* a sink without EDID can't be told apart from another display
+         * behind the same address, only trust the cache on a match */
+        if (priv->edid_hash == NULL || priv->cached->edid_hash == NULL ||
+            strcmp (priv->cached->edid_hash, priv->edid_hash) != 0) {
+          GST_INFO_OBJECT (client, "EDID changed, sending full M3");
+          sink_cache_remove (_client);
+          sink_cache_free (priv->cached);
+          priv->cached = NULL;
+
+          if (handle_M3_message (_client) < GST_RTSP_OK)
+            GST_ERROR_OBJECT (client, "handle_M3_message failed");
+          goto error;
+        }
+        GST_INFO_OBJECT (client, "sink confirmed cached capabilities");
+        sink_cache_restore (_client);
+      }
+
       g_signal_emit (_client,
           gst_rtsp_client_wfd_signals[SIGNAL_WFD_GET_PARAMETER_REQUEST], 0,
           ctx);
@@ -897,6 +1239,10 @@ handle_wfd_response (GstRTSPClient * client, GstRTSPContext * ctx)
       GST_INFO_OBJECT (_client, "M4 response is done");
       priv->m4_done = TRUE;
 
+      g_mutex_lock (&priv->lock);
+      priv->keepalive_sent = 0;
+      g_mutex_unlock (&priv->lock);
+
       gst_rtsp_wfd_client_trigger_request (_client, WFD_TRIGGER_SETUP);
     }
   }
@@ -984,10 +1330,111 @@ handle_wfd_get_param_request (GstRTSPClient * client, GstRTSPContext * ctx)
   return TRUE;
 }
 
+static GstRTSPFilterResult
+idr_media_filter (GstRTSPSession * sess, GstRTSPSessionMedia * sessmedia,
+    gpointer user_data)
+{
+  GstRTSPMedia *media;
+  guint i, n_streams;
+
+  media = gst_rtsp_session_media_get_media (sessmedia);
+  n_streams = gst_rtsp_media_n_streams (media);
+
+  for (i = 0; i < n_streams; i++)
+    gst_rtsp_stream_request_key_unit (gst_rtsp_media_get_stream (media, i));
+
+  return GST_RTSP_FILTER_KEEP;
+}
+
+static GstRTSPFilterResult
+idr_session_filter (GstRTSPClient * client, GstRTSPSession * sess,
+    gpointer user_data)
+{
+  gst_rtsp_session_filter (sess, idr_media_filter, user_data);
+
+  return GST_RTSP_FILTER_KEEP;
+}
+
+static void
+handle_wfd_idr_request (GstRTSPWFDClient * client)
+{
+  GstRTSPWFDClientPrivate *priv = GST_RTSP_WFD_CLIENT_GET_PRIVATE (client);
+  gint64 now;
+
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&priv->lock);
+  if (priv->last_idr_request != 0 &&
+      now - priv->last_idr_request < (gint64) priv->idr_request_window * 1000)
+    goto merged;
+  priv->last_idr_request = now;
+  g_mutex_unlock (&priv->lock);
+
+  GST_INFO_OBJECT (client, "requesting IDR from the encoder");
+
+  gst_rtsp_client_session_filter (GST_RTSP_CLIENT_CAST (client),
+      idr_session_filter, NULL);
+
+  return;
+
+merged:
+  {
+    g_mutex_unlock (&priv->lock);
+    GST_DEBUG_OBJECT (client, "IDR request merged with the previous one");
+    return;
+  }
+}
+
 static gboolean
 handle_wfd_set_param_request (GstRTSPClient * client, GstRTSPContext * ctx)
 {
+  GstRTSPResult res = GST_RTSP_OK;
+  GstWFDMessage *msg = NULL;
+  guint8 *data = NULL;
+  guint size = 0;
+
+  GstRTSPWFDClient *_client = GST_RTSP_WFD_CLIENT (client);
+
+  /* parsing the SET_PARAMETER request */
+  res = gst_rtsp_message_get_body (ctx->request, (guint8 **) & data, &size);
+  if (res != GST_RTSP_OK) {
+    GST_ERROR_OBJECT (_client, "Failed to get body of request...");
+    goto bad_request;
+  }
+
+  if (size == 0) {
+    send_generic_wfd_response (_client, GST_RTSP_STS_OK, ctx);
+    return TRUE;
+  }
+
+  if (gst_wfd_message_new (&msg) != GST_WFD_OK ||
+      gst_wfd_message_init (msg) != GST_WFD_OK) {
+    GST_ERROR_OBJECT (_client, "Failed to create wfd message...");
+    goto bad_request;
+  }
+  gst_wfd_message_parse_buffer (data, size, msg);
+
+  /* reply first, the sink should not wait for the encoder. The IDR request
+   * is the only parameter a sink sets on us. */
+  if (msg->idr_request) {
+    send_generic_wfd_response (_client, GST_RTSP_STS_OK, ctx);
+    handle_wfd_idr_request (_client);
+  } else {
+    GST_INFO_OBJECT (_client, "unknown SET_PARAMETER from sink");
+    send_generic_wfd_response (_client,
+        GST_RTSP_STS_PARAMETER_NOT_UNDERSTOOD, ctx);
+  }
+  gst_wfd_message_free (msg);
+
   return TRUE;
+
+bad_request:
+  {
+    if (msg)
+      gst_wfd_message_free (msg);
+    send_generic_wfd_response (_client, GST_RTSP_STS_BAD_REQUEST, ctx);
+    return FALSE;
+  }
 }
 
 static gboolean
@@ -1118,26 +1565,32 @@ _set_wfd_message_body (GstRTSPWFDClient * client, GstWFDMessageType msg_type,
       goto error;
     }
 
-    /* set the supported audio formats by the WFD server */
-    wfd_res =
-        gst_wfd_message_set_supported_audio_format (msg, GST_WFD_AUDIO_UNKNOWN,
-        GST_WFD_FREQ_UNKNOWN, GST_WFD_CHANNEL_UNKNOWN, 0, 0);
-    if (wfd_res != GST_WFD_OK) {
-      GST_ERROR_OBJECT (client,
-          "Failed to set supported audio formats on wfd message...");
-      goto error;
-    }
+    /* a sink from the capability cache only has to confirm its EDID, the
+     * formats it supports are known already */
+    if (priv->cached == NULL) {
+      /* set the supported audio formats by the WFD server */
+      wfd_res =
+          gst_wfd_message_set_supported_audio_format (msg,
+          GST_WFD_AUDIO_UNKNOWN, GST_WFD_FREQ_UNKNOWN, GST_WFD_CHANNEL_UNKNOWN,
+          0, 0);
+      if (wfd_res != GST_WFD_OK) {
+        GST_ERROR_OBJECT (client,
+            "Failed to set supported audio formats on wfd message...");
+        goto error;
+      }
 
-    /* set the supported Video formats by the WFD server */
-    wfd_res =
-        gst_wfd_message_set_supported_video_format (msg, GST_WFD_VIDEO_UNKNOWN,
-        GST_WFD_VIDEO_CEA_RESOLUTION, GST_WFD_CEA_UNKNOWN, GST_WFD_CEA_UNKNOWN,
-        GST_WFD_VESA_UNKNOWN, GST_WFD_HH_UNKNOWN, GST_WFD_H264_UNKNOWN_PROFILE,
-        GST_WFD_H264_LEVEL_UNKNOWN, 0, 0, 0, 0, 0, 0);
-    if (wfd_res != GST_WFD_OK) {
-      GST_ERROR_OBJECT (client,
-          "Failed to set supported video formats on wfd message...");
-      goto error;
+      /* set the supported Video formats by the WFD server */
+      wfd_res =
+          gst_wfd_message_set_supported_video_format (msg,
+          GST_WFD_VIDEO_UNKNOWN, GST_WFD_VIDEO_CEA_RESOLUTION,
+          GST_WFD_CEA_UNKNOWN, GST_WFD_CEA_UNKNOWN, GST_WFD_VESA_UNKNOWN,
+          GST_WFD_HH_UNKNOWN, GST_WFD_H264_UNKNOWN_PROFILE,
+          GST_WFD_H264_LEVEL_UNKNOWN, 0, 0, 0, 0, 0, 0);
+      if (wfd_res != GST_WFD_OK) {
+        GST_ERROR_OBJECT (client,
+            "Failed to set supported video formats on wfd message...");
+        goto error;
+      }
     }
 
     wfd_res = gst_wfd_message_set_display_edid (msg, 0, 0, NULL);
@@ -1176,13 +1629,8 @@ _set_wfd_message_body (GstRTSPWFDClient * client, GstWFDMessageType msg_type,
       *len = strlen (*data);
     }
   } else if (msg_type == M4_REQ_MSG) {
-    GstRTSPUrl *url = NULL;
     gchar *url_str = NULL;
 
-    GstRTSPClient *parent_client = GST_RTSP_CLIENT_CAST (client);
-    GstRTSPConnection *connection =
-        gst_rtsp_client_get_connection (parent_client);
-
     /* Parameters for the preffered audio formats */
     GstWFDAudioFormats taudiocodec = GST_WFD_AUDIO_UNKNOWN;
     GstWFDAudioFreq taudiofreq = GST_WFD_FREQ_UNKNOWN;
@@ -1196,12 +1644,6 @@ _set_wfd_message_body (GstRTSPWFDClient * client, GstWFDMessageType msg_type,
     GstWFDVideoH264Level tcLevel;
     guint64 resolution_supported = 0;
 
-    url = gst_rtsp_connection_get_url (connection);
-    if (url == NULL) {
-      GST_ERROR_OBJECT (client, "Failed to get connection URL");
-      return;
-    }
-
     /* Logic to negotiate with information of M3 response */
     /* create M4 request to be sent */
     wfd_res = gst_wfd_message_new (&msg);
@@ -1216,13 +1658,33 @@ _set_wfd_message_body (GstRTSPWFDClient * client, GstWFDMessageType msg_type,
       goto error;
     }
 
-    buf = g_string_new ("");
-    g_string_append_printf (buf, "rtsp://");
-    g_string_append (buf, url->host);
-    g_string_append_printf (buf, "/wfd1.0/streamid=0");
-    wfd_res =
-        gst_wfd_message_set_presentation_url (msg, g_string_free (buf, FALSE),
-        NULL);
+    url_str = make_presentation_url (client);
+    if (url_str == NULL) {
+      GST_ERROR_OBJECT (client, "Failed to get connection URL");
+      goto error;
+    }
+
+    /* the format of a sink from the capability cache was negotiated before,
+     * only the presentation url has to be updated */
+    if (priv->cached && priv->cached->m4_body) {
+      gst_wfd_message_parse_buffer ((const guint8 *) priv->cached->m4_body,
+          strlen (priv->cached->m4_body), msg);
+      gst_wfd_message_set_presentation_url (msg, url_str, NULL);
+      g_free (url_str);
+
+      *data = gst_wfd_message_as_text (msg);
+      gst_wfd_message_free (msg);
+      if (*data == NULL) {
+        GST_ERROR_OBJECT (client, "Failed to get wfd message as text...");
+        goto error;
+      }
+      *len = strlen (*data);
+      g_string_free (buf, TRUE);
+      return;
+    }
+
+    wfd_res = gst_wfd_message_set_presentation_url (msg, url_str, NULL);
+    g_free (url_str);
     if (wfd_res != GST_WFD_OK) {
       GST_ERROR_OBJECT (client, "Failed to set presentation url");
       goto error;
@@ -1321,6 +1783,17 @@ _set_wfd_message_body (GstRTSPWFDClient * client, GstWFDMessageType msg_type,
       goto error;
     }
 
+    /* remember the format we picked for this sink, sinks that end up with
+     * the same format can share one encoding pipeline */
+    g_mutex_lock (&priv->lock);
+    g_free (priv->negotiated_format);
+    priv->negotiated_format =
+        g_strdup_printf ("v%u-%u-%u-%ux%u@%u%s-a%u-%u-%u", priv->cvCodec,
+        priv->cProfile, priv->cLevel, priv->cMaxWidth, priv->cMaxHeight,
+        priv->cFramerate, priv->cInterleaved ? "i" : "p", priv->caCodec,
+        priv->cFreq, priv->cChanels);
+    g_mutex_unlock (&priv->lock);
+
     *data = gst_wfd_message_as_text (msg);
     if (*data == NULL) {
       GST_ERROR_OBJECT (client, "Failed to get wfd message as text...");
@@ -1328,6 +1801,8 @@ _set_wfd_message_body (GstRTSPWFDClient * client, GstWFDMessageType msg_type,
     } else {
       *len = strlen (*data);
     }
+
+    sink_cache_store (client, *data);
   } else if (msg_type == M5_REQ_MSG) {
     g_string_append (buf, "wfd_trigger_method: SETUP");
     g_string_append (buf, "\r\n");
@@ -1722,6 +2197,11 @@ handle_M1_message (GstRTSPWFDClient * client)
 
   GST_DEBUG_OBJECT (client, "Sending M1 request.. (OPTIONS request)");
 
+  /* the sink has to finish the negotiation like it answers a keepalive */
+  g_mutex_lock (&client->priv->lock);
+  client->priv->keepalive_sent = g_get_monotonic_time ();
+  g_mutex_unlock (&client->priv->lock);
+
   send_request (client, NULL, &request);
 
   return res;
@@ -1763,6 +2243,9 @@ handle_M3_message (GstRTSPWFDClient * client)
     goto error;
   }
 
+  /* a known sink only needs a minimal M3 */
+  sink_cache_lookup (client);
+
   res = prepare_request (client, &request, GST_RTSP_GET_PARAMETER, url_str);
   if (GST_RTSP_OK != res) {
     GST_ERROR_OBJECT (client, "Failed to prepare M3 request....\n");
@@ -1863,3 +2346,226 @@ gst_rtsp_wfd_client_trigger_request (GstRTSPWFDClient * client,
 error:
   return res;
 }
+
+/**
+ * gst_rtsp_wfd_client_set_idr_request_window:
+ * @client: a #GstRTSPWFDClient
+ * @window: the window in milliseconds
+ *
+ * IDR requests that the sink sends within @window milliseconds of the
+ * previous one are merged with it and don't cause a new key unit. A
+ * @window of 0 forwards every request to the encoder.
+ */
+void
+gst_rtsp_wfd_client_set_idr_request_window (GstRTSPWFDClient * client,
+    guint window)
+{
+  GstRTSPWFDClientPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_WFD_CLIENT (client));
+
+  priv = client->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->idr_request_window = window;
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_wfd_client_get_idr_request_window:
+ * @client: a #GstRTSPWFDClient
+ *
+ * Get the window in which IDR requests from the sink are merged.
+ *
+ * Returns: the IDR request window in milliseconds.
+ */
+guint
+gst_rtsp_wfd_client_get_idr_request_window (GstRTSPWFDClient * client)
+{
+  GstRTSPWFDClientPrivate *priv;
+  guint result;
+
+  g_return_val_if_fail (GST_IS_RTSP_WFD_CLIENT (client), 0);
+
+  priv = client->priv;
+
+  g_mutex_lock (&priv->lock);
+  result = priv->idr_request_window;
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_wfd_client_get_negotiated_format:
+ * @client: a #GstRTSPWFDClient
+ *
+ * Get a string that identifies the audio and video format that was
+ * negotiated with the sink of @client. Sinks with the same negotiated
+ * format can be served from the same media.
+ *
+ * Returns: (transfer full) (nullable): the negotiated format or %NULL when
+ * the capability negotiation did not complete yet. g_free() after usage.
+ */
+gchar *
+gst_rtsp_wfd_client_get_negotiated_format (GstRTSPWFDClient * client)
+{
+  GstRTSPWFDClientPrivate *priv;
+  gchar *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_WFD_CLIENT (client), NULL);
+
+  priv = client->priv;
+
+  g_mutex_lock (&priv->lock);
+  result = g_strdup (priv->negotiated_format);
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_wfd_client_get_negotiated_resolution:
+ * @client: a #GstRTSPWFDClient
+ * @width: (out) (allow-none): the negotiated width
+ * @height: (out) (allow-none): the negotiated height
+ * @framerate: (out) (allow-none): the negotiated framerate
+ *
+ * Get the video resolution that was negotiated with the sink of @client.
+ *
+ * Returns: %TRUE when the capability negotiation completed.
+ */
+gboolean
+gst_rtsp_wfd_client_get_negotiated_resolution (GstRTSPWFDClient * client,
+    guint * width, guint * height, guint * framerate)
+{
+  GstRTSPWFDClientPrivate *priv;
+  gboolean result;
+
+  g_return_val_if_fail (GST_IS_RTSP_WFD_CLIENT (client), FALSE);
+
+  priv = client->priv;
+
+  g_mutex_lock (&priv->lock);
+  result = priv->negotiated_format != NULL;
+  if (result) {
+    if (width)
+      *width = priv->cMaxWidth;
+    if (height)
+      *height = priv->cMaxHeight;
+    if (framerate)
+      *framerate = priv->cFramerate;
+  }
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_wfd_client_send_keepalive:
+ * @client: a #GstRTSPWFDClient
+ *
+ * Send an M16 keepalive (an empty GET_PARAMETER request) to the sink of
+ * @client. The answer of the sink updates the round-trip time, see
+ * gst_rtsp_wfd_client_get_rtt(). Nothing is sent while the capability
+ * negotiation with the sink is still in progress, the negotiation itself is
+ * pending instead, see gst_rtsp_wfd_client_get_keepalive_pending().
+ *
+ * Returns: a #GstRTSPResult.
+ */
+GstRTSPResult
+gst_rtsp_wfd_client_send_keepalive (GstRTSPWFDClient * client)
+{
+  GstRTSPWFDClientPrivate *priv;
+  GstRTSPResult res = GST_RTSP_OK;
+  GstRTSPMessage request = { 0 };
+  GList *sessions;
+  guint cseq;
+
+  g_return_val_if_fail (GST_IS_RTSP_WFD_CLIENT (client), GST_RTSP_EINVAL);
+
+  priv = client->priv;
+
+  if (!priv->m4_done)
+    return GST_RTSP_OK;
+
+  res = gst_rtsp_message_init_request (&request, GST_RTSP_GET_PARAMETER,
+      "rtsp://localhost/wfd1.0");
+  if (res < 0) {
+    GST_ERROR_OBJECT (client, "Failed to prepare M16 request");
+    return res;
+  }
+
+  g_mutex_lock (&priv->lock);
+  cseq = ++priv->keepalive_cseq;
+  priv->keepalive_sent = g_get_monotonic_time ();
+  g_mutex_unlock (&priv->lock);
+
+  gst_rtsp_message_take_header (&request, GST_RTSP_HDR_CSEQ,
+      g_strdup_printf ("%u", cseq));
+
+  GST_LOG_OBJECT (client, "Sending M16 request (keepalive) %u", cseq);
+
+  sessions = gst_rtsp_client_session_filter (GST_RTSP_CLIENT_CAST (client),
+      NULL, NULL);
+  send_request (client, sessions ? sessions->data : NULL, &request);
+  g_list_free_full (sessions, g_object_unref);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_wfd_client_get_keepalive_pending:
+ * @client: a #GstRTSPWFDClient
+ *
+ * Get for how long the last M16 keepalive sent to the sink of @client has
+ * been waiting for an answer. Until the sink answered M4 this is the time
+ * since M1 was sent.
+ *
+ * Returns: the time since the unanswered keepalive was sent or
+ * #GST_CLOCK_TIME_NONE when no keepalive is pending.
+ */
+GstClockTime
+gst_rtsp_wfd_client_get_keepalive_pending (GstRTSPWFDClient * client)
+{
+  GstRTSPWFDClientPrivate *priv;
+  GstClockTime result = GST_CLOCK_TIME_NONE;
+
+  g_return_val_if_fail (GST_IS_RTSP_WFD_CLIENT (client), GST_CLOCK_TIME_NONE);
+
+  priv = client->priv;
+
+  g_mutex_lock (&priv->lock);
+  if (priv->keepalive_sent != 0)
+    result = (g_get_monotonic_time () - priv->keepalive_sent) * GST_USECOND;
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_wfd_client_get_rtt:
+ * @client: a #GstRTSPWFDClient
+ *
+ * Get the smoothed round-trip time of the M16 keepalives with the sink of
+ * @client.
+ *
+ * Returns: the round-trip time or #GST_CLOCK_TIME_NONE when the sink did not
+ * answer a keepalive yet.
+ */
+GstClockTime
+gst_rtsp_wfd_client_get_rtt (GstRTSPWFDClient * client)
+{
+  GstRTSPWFDClientPrivate *priv;
+  GstClockTime result;
+
+  g_return_val_if_fail (GST_IS_RTSP_WFD_CLIENT (client), GST_CLOCK_TIME_NONE);
+
+  priv = client->priv;
+
+  g_mutex_lock (&priv->lock);
+  result = priv->rtt;
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
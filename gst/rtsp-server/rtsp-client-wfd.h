@@ -120,6 +120,23 @@ void                  gst_rtsp_wfd_client_start_wfd(GstRTSPWFDClient *client);
 GstRTSPResult         gst_rtsp_wfd_client_trigger_request (
                           GstRTSPWFDClient * client, GstWFDTriggerType type);
 
+void                  gst_rtsp_wfd_client_set_idr_request_window (
+                          GstRTSPWFDClient * client, guint window);
+guint                 gst_rtsp_wfd_client_get_idr_request_window (
+                          GstRTSPWFDClient * client);
+
+gchar *               gst_rtsp_wfd_client_get_negotiated_format (
+                          GstRTSPWFDClient * client);
+gboolean              gst_rtsp_wfd_client_get_negotiated_resolution (
+                          GstRTSPWFDClient * client, guint * width,
+                          guint * height, guint * framerate);
+
+GstRTSPResult         gst_rtsp_wfd_client_send_keepalive (
+                          GstRTSPWFDClient * client);
+GstClockTime          gst_rtsp_wfd_client_get_keepalive_pending (
+                          GstRTSPWFDClient * client);
+GstClockTime          gst_rtsp_wfd_client_get_rtt (GstRTSPWFDClient * client);
+
 /**
  * GstRTSPWFDClientSessionFilterFunc:
  * @client: a #GstRTSPWFDClient object
@@ -76,8 +76,16 @@ struct _GstRTSPClientPrivate
    * we can pick it up in the next SETUP immediately */
   gchar *path;
   GstRTSPMedia *media;
+  /* closes a publisher that does not RECORD the announced media */
+  GSource *record_source;
+  gchar *record_path;
+  GstRTSPMedia *record_media;
+
+  /* the linked TCP transports by interleaved channel */
+  GstRTSPStreamTransport *channels[256];
+  /* buffers for the received interleaved data */
+  GstBufferPool *data_pool;
 
-  GList *transports;
   GList *sessions;
 };
 
@@ -87,6 +95,13 @@ static GHashTable *tunnels;     /* protected by tunnels_lock */
 #define DEFAULT_SESSION_POOL            NULL
 #define DEFAULT_MOUNT_POINTS            NULL
 
+/* interleaved data up to this size is copied into pooled buffers */
+#define DATA_BUFFER_SIZE                2048
+#define DATA_BUFFER_MIN                 16
+
+/* seconds between ANNOUNCE and RECORD */
+#define RECORD_TIMEOUT                  20
+
 enum
 {
   PROP_0,
@@ -108,6 +123,8 @@ enum
   SIGNAL_SET_PARAMETER_REQUEST,
   SIGNAL_GET_PARAMETER_REQUEST,
   SIGNAL_HANDLE_RESPONSE,
+  SIGNAL_ANNOUNCE_REQUEST,
+  SIGNAL_RECORD_REQUEST,
   SIGNAL_LAST
 };
 
@@ -127,6 +144,7 @@ static void client_session_finalized (GstRTSPClient * client,
     GstRTSPSession * session);
 static void unlink_session_transports (GstRTSPClient * client,
     GstRTSPSession * session, GstRTSPSessionMedia * sessmedia);
+static void stop_record_timeout (GstRTSPClient * client);
 static gboolean default_configure_client_media (GstRTSPClient * client,
     GstRTSPMedia * media, GstRTSPStream * stream, GstRTSPContext * ctx);
 static gboolean default_configure_client_transport (GstRTSPClient * client,
@@ -245,6 +263,18 @@ gst_rtsp_client_class_init (GstRTSPClientClass * klass)
           handle_response), NULL, NULL, g_cclosure_marshal_VOID__POINTER,
       G_TYPE_NONE, 1, G_TYPE_POINTER);
 
+  gst_rtsp_client_signals[SIGNAL_ANNOUNCE_REQUEST] =
+      g_signal_new ("announce-request", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, G_STRUCT_OFFSET (GstRTSPClientClass,
+          announce_request), NULL, NULL, g_cclosure_marshal_VOID__POINTER,
+      G_TYPE_NONE, 1, G_TYPE_POINTER);
+
+  gst_rtsp_client_signals[SIGNAL_RECORD_REQUEST] =
+      g_signal_new ("record-request", G_TYPE_FROM_CLASS (klass),
+      G_SIGNAL_RUN_LAST, G_STRUCT_OFFSET (GstRTSPClientClass,
+          record_request), NULL, NULL, g_cclosure_marshal_VOID__POINTER,
+      G_TYPE_NONE, 1, G_TYPE_POINTER);
+
   tunnels =
       g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_object_unref);
   g_mutex_init (&tunnels_lock);
@@ -353,6 +383,8 @@ gst_rtsp_client_finalize (GObject * obj)
   if (priv->watch)
     g_source_destroy ((GSource *) priv->watch);
 
+  stop_record_timeout (client);
+
   client_cleanup_sessions (client);
 
   if (priv->connection)
@@ -365,6 +397,10 @@ gst_rtsp_client_finalize (GObject * obj)
     g_object_unref (priv->auth);
   if (priv->thread_pool)
     g_object_unref (priv->thread_pool);
+  if (priv->data_pool) {
+    gst_buffer_pool_set_active (priv->data_pool, FALSE);
+    gst_object_unref (priv->data_pool);
+  }
 
   if (priv->path)
     g_free (priv->path);
@@ -653,6 +689,7 @@ link_transport (GstRTSPClient * client, GstRTSPSession * session,
     GstRTSPStreamTransport * trans)
 {
   GstRTSPClientPrivate *priv = client->priv;
+  const GstRTSPTransport *tr;
 
   GST_DEBUG ("client %p: linking transport %p", client, trans);
 
@@ -660,7 +697,11 @@ link_transport (GstRTSPClient * client, GstRTSPSession * session,
       (GstRTSPSendFunc) do_send_data,
       (GstRTSPSendFunc) do_send_data, client, NULL);
 
-  priv->transports = g_list_prepend (priv->transports, trans);
+  tr = gst_rtsp_stream_transport_get_transport (trans);
+  if (tr->interleaved.min >= 0 && tr->interleaved.min < 256)
+    priv->channels[tr->interleaved.min] = trans;
+  if (tr->interleaved.max >= 0 && tr->interleaved.max < 256)
+    priv->channels[tr->interleaved.max] = trans;
 
   /* make sure our session can't expire */
   gst_rtsp_session_prevent_expire (session);
@@ -697,12 +738,16 @@ unlink_transport (GstRTSPClient * client, GstRTSPSession * session,
     GstRTSPStreamTransport * trans)
 {
   GstRTSPClientPrivate *priv = client->priv;
+  gint i;
 
   GST_DEBUG ("client %p: unlinking transport %p", client, trans);
 
   gst_rtsp_stream_transport_set_callbacks (trans, NULL, NULL, NULL, NULL);
 
-  priv->transports = g_list_remove (priv->transports, trans);
+  for (i = 0; i < G_N_ELEMENTS (priv->channels); i++) {
+    if (priv->channels[i] == trans)
+      priv->channels[i] = NULL;
+  }
 
   /* our session can now expire */
   gst_rtsp_session_allow_expire (session);
@@ -1202,6 +1247,114 @@ unsuspend_failed:
   }
 }
 
+static gboolean
+handle_record_request (GstRTSPClient * client, GstRTSPContext * ctx)
+{
+  GstRTSPSession *session;
+  GstRTSPClientClass *klass;
+  GstRTSPSessionMedia *sessmedia;
+  GstRTSPMedia *media;
+  GstRTSPStatusCode code;
+  GstRTSPState rtspstate;
+  gchar *path;
+  gint matched;
+
+  if (!(session = ctx->session))
+    goto no_session;
+
+  if (!ctx->uri)
+    goto no_uri;
+
+  klass = GST_RTSP_CLIENT_GET_CLASS (client);
+  path = klass->make_path_from_uri (client, ctx->uri);
+
+  /* get a handle to the configuration of the media in the session */
+  sessmedia = gst_rtsp_session_get_media (session, path, &matched);
+  if (!sessmedia)
+    goto not_found;
+
+  if (path[matched] != '\0')
+    goto no_aggregate;
+
+  g_free (path);
+
+  ctx->sessmedia = sessmedia;
+  ctx->media = media = gst_rtsp_session_media_get_media (sessmedia);
+
+  if (!gst_rtsp_media_is_record (media))
+    goto not_record;
+
+  /* the session state must be recording or ready */
+  rtspstate = gst_rtsp_session_media_get_rtsp_state (sessmedia);
+  if (rtspstate != GST_RTSP_STATE_RECORDING &&
+      rtspstate != GST_RTSP_STATE_READY)
+    goto invalid_state;
+
+  /* the publisher keeps the announced media */
+  if (media == client->priv->record_media)
+    stop_record_timeout (client);
+
+  /* the interleaved data of the publisher arrives on the TCP channels */
+  link_session_transports (client, session, sessmedia);
+
+  code = GST_RTSP_STS_OK;
+  gst_rtsp_message_init_response (ctx->response, code,
+      gst_rtsp_status_as_text (code), ctx->request);
+
+  send_message (client, session, ctx->response, FALSE);
+
+  /* start receiving after sending the response */
+  gst_rtsp_session_media_set_state (sessmedia, GST_STATE_PLAYING);
+
+  gst_rtsp_session_media_set_rtsp_state (sessmedia, GST_RTSP_STATE_RECORDING);
+
+  g_signal_emit (client, gst_rtsp_client_signals[SIGNAL_RECORD_REQUEST], 0,
+      ctx);
+
+  return TRUE;
+
+  /* ERRORS */
+no_session:
+  {
+    GST_ERROR ("client %p: no session", client);
+    send_generic_response (client, GST_RTSP_STS_SESSION_NOT_FOUND, ctx);
+    return FALSE;
+  }
+no_uri:
+  {
+    GST_ERROR ("client %p: no uri supplied", client);
+    send_generic_response (client, GST_RTSP_STS_BAD_REQUEST, ctx);
+    return FALSE;
+  }
+not_found:
+  {
+    GST_ERROR ("client %p: media not found", client);
+    send_generic_response (client, GST_RTSP_STS_NOT_FOUND, ctx);
+    return FALSE;
+  }
+no_aggregate:
+  {
+    GST_ERROR ("client %p: no aggregate path %s", client, path);
+    send_generic_response (client,
+        GST_RTSP_STS_ONLY_AGGREGATE_OPERATION_ALLOWED, ctx);
+    g_free (path);
+    return FALSE;
+  }
+not_record:
+  {
+    GST_ERROR ("client %p: media does not accept RECORD", client);
+    send_generic_response (client, GST_RTSP_STS_METHOD_NOT_ALLOWED, ctx);
+    return FALSE;
+  }
+invalid_state:
+  {
+    GST_ERROR ("client %p: not RECORDING or READY", client);
+    send_generic_response (client, GST_RTSP_STS_METHOD_NOT_VALID_IN_THIS_STATE,
+        ctx);
+    return FALSE;
+  }
+}
+
 static void
 do_keepalive (GstRTSPSession * session)
 {
@@ -1359,6 +1512,32 @@ no_address:
   }
 }
 
+/* the role of the session selects the QoS policy of the transport, the
+ * policy is in the permissions of the role in the media */
+static void
+configure_qos_policy (GstRTSPClient * client, GstRTSPContext * ctx,
+    GstRTSPStreamTransport * trans)
+{
+  GstRTSPPermissions *perms;
+  const GstStructure *policy = NULL;
+  const gchar *role = NULL;
+
+  if (ctx->token)
+    role = gst_rtsp_token_get_string (ctx->token,
+        GST_RTSP_TOKEN_MEDIA_FACTORY_ROLE);
+
+  perms = gst_rtsp_media_get_permissions (ctx->media);
+  if (role && perms)
+    policy = gst_rtsp_permissions_get_role (perms, role);
+
+  GST_DEBUG_OBJECT (client, "role %s has %sQoS policy", GST_STR_NULL (role),
+      policy ? "a " : "no ");
+  gst_rtsp_stream_transport_set_qos_policy (trans, policy);
+
+  if (perms)
+    gst_rtsp_permissions_unref (perms);
+}
+
 static GstRTSPTransport *
 make_server_transport (GstRTSPClient * client, GstRTSPContext * ctx,
     GstRTSPTransport * ct)
@@ -1545,6 +1724,8 @@ handle_setup_request (GstRTSPClient * client, GstRTSPContext * ctx)
   gst_rtsp_stream_transport_set_keepalive (trans,
       (GstRTSPKeepAliveFunc) do_keepalive, session, NULL);
 
+  configure_qos_policy (client, ctx, trans);
+
   /* create and serialize the server transport */
   st = make_server_transport (client, ctx, ct);
   trans_str = gst_rtsp_transport_as_text (st);
@@ -1837,6 +2018,299 @@ no_sdp:
   }
 }
 
+static void
+stop_record_timeout (GstRTSPClient * client)
+{
+  GstRTSPClientPrivate *priv = client->priv;
+
+  if (priv->record_source) {
+    g_source_destroy (priv->record_source);
+    g_source_unref (priv->record_source);
+    priv->record_source = NULL;
+  }
+  g_free (priv->record_path);
+  priv->record_path = NULL;
+  if (priv->record_media)
+    g_object_unref (priv->record_media);
+  priv->record_media = NULL;
+}
+
+/* the announced media and the sessions that set it up are torn down, the
+ * streams were never announced to the relay */
+static gboolean
+record_timeout (GstRTSPClient * client)
+{
+  GstRTSPClientPrivate *priv = client->priv;
+  GList *sessions, *walk;
+  gint matched;
+
+  GST_WARNING ("client %p: no RECORD after ANNOUNCE of %s", client,
+      priv->record_path);
+
+  sessions = g_list_copy (priv->sessions);
+  for (walk = sessions; walk; walk = g_list_next (walk)) {
+    GstRTSPSession *session = walk->data;
+    GstRTSPSessionMedia *sessmedia;
+
+    sessmedia = gst_rtsp_session_get_media (session, priv->record_path,
+        &matched);
+    if (sessmedia == NULL ||
+        gst_rtsp_session_media_get_media (sessmedia) != priv->record_media)
+      continue;
+
+    unlink_session_transports (client, session, sessmedia);
+    client_unwatch_session (client, session);
+    gst_rtsp_session_media_set_state (sessmedia, GST_STATE_NULL);
+    if (!gst_rtsp_session_release_media (session, sessmedia))
+      gst_rtsp_session_pool_remove (priv->session_pool, session);
+  }
+  g_list_free (sessions);
+
+  if (priv->media == priv->record_media) {
+    g_free (priv->path);
+    priv->path = NULL;
+    g_object_unref (priv->media);
+    priv->media = NULL;
+  }
+  gst_rtsp_media_unprepare (priv->record_media);
+
+  /* the source is destroyed after this callback */
+  g_source_unref (priv->record_source);
+  priv->record_source = NULL;
+  stop_record_timeout (client);
+
+  gst_rtsp_client_close (client);
+
+  return FALSE;
+}
+
+static void
+start_record_timeout (GstRTSPClient * client)
+{
+  GstRTSPClientPrivate *priv = client->priv;
+  GMainContext *context = NULL;
+
+  stop_record_timeout (client);
+  priv->record_path = g_strdup (priv->path);
+  priv->record_media = g_object_ref (priv->media);
+
+  if (priv->watch)
+    context = g_source_get_context ((GSource *) priv->watch);
+
+  priv->record_source = g_timeout_source_new_seconds (RECORD_TIMEOUT);
+  g_source_set_callback (priv->record_source, (GSourceFunc) record_timeout,
+      client, NULL);
+  g_source_attach (priv->record_source, context);
+}
+
+/* a publisher describes the streams it will RECORD, the streams are kept in
+ * the media of the client until it records */
+static gboolean
+handle_announce_request (GstRTSPClient * client, GstRTSPContext * ctx)
+{
+  GstRTSPClientPrivate *priv = client->priv;
+  GstRTSPMediaFactory *factory;
+  GstRTSPMedia *media;
+  GstRTSPThread *thread;
+  GstSDPMessage *sdp;
+  GstRTSPResult res;
+  gchar *path, *ingest;
+  guint8 *data;
+  guint size;
+  gint matched;
+
+  if (!ctx->uri)
+    goto no_uri;
+
+  if (!priv->mount_points)
+    goto no_mount_points;
+
+  if (!(path = gst_rtsp_mount_points_make_path (priv->mount_points, ctx->uri)))
+    goto no_path;
+
+  if (!(factory = gst_rtsp_mount_points_match (priv->mount_points, path,
+              &matched)))
+    goto no_factory;
+
+  if (!(ingest = gst_rtsp_media_factory_get_ingest (factory)))
+    goto not_ingest;
+  g_free (ingest);
+
+  /* only clients that can construct the media can publish */
+  ctx->factory = factory;
+  if (!gst_rtsp_auth_check (GST_RTSP_AUTH_CHECK_MEDIA_FACTORY_ACCESS) ||
+      !gst_rtsp_auth_check (GST_RTSP_AUTH_CHECK_MEDIA_FACTORY_CONSTRUCT))
+    goto not_authorized;
+  ctx->factory = NULL;
+
+  res = gst_rtsp_message_get_body (ctx->request, &data, &size);
+  if (res != GST_RTSP_OK || size == 0)
+    goto no_sdp;
+
+  gst_sdp_message_new (&sdp);
+  if (gst_sdp_message_parse_buffer (data, size, sdp) != GST_SDP_OK)
+    goto bad_sdp;
+
+  if (!(media = gst_rtsp_media_factory_announce (factory, ctx->uri, sdp)))
+    goto not_accepted;
+
+  gst_sdp_message_free (sdp);
+  g_object_unref (factory);
+
+  /* the media of an earlier announcement can't be reused */
+  stop_record_timeout (client);
+  g_free (priv->path);
+  priv->path = NULL;
+  if (priv->media) {
+    gst_rtsp_media_unprepare (priv->media);
+    g_object_unref (priv->media);
+  }
+  priv->media = NULL;
+
+  ctx->media = media;
+
+  thread = gst_rtsp_thread_pool_get_thread (priv->thread_pool,
+      GST_RTSP_THREAD_TYPE_MEDIA, ctx);
+  if (thread == NULL)
+    goto no_thread;
+
+  if (!gst_rtsp_media_prepare (media, thread))
+    goto no_prepare;
+
+  /* the next SETUP picks up the media */
+  priv->path = g_strndup (path, matched);
+  priv->media = media;
+  g_free (path);
+
+  start_record_timeout (client);
+
+  gst_rtsp_message_init_response (ctx->response, GST_RTSP_STS_OK,
+      gst_rtsp_status_as_text (GST_RTSP_STS_OK), ctx->request);
+
+  send_message (client, ctx->session, ctx->response, FALSE);
+
+  g_signal_emit (client, gst_rtsp_client_signals[SIGNAL_ANNOUNCE_REQUEST],
+      0, ctx);
+
+  return TRUE;
+
+  /* ERRORS */
+no_uri:
+  {
+    GST_ERROR ("client %p: no uri", client);
+    send_generic_response (client, GST_RTSP_STS_BAD_REQUEST, ctx);
+    return FALSE;
+  }
+no_mount_points:
+  {
+    GST_ERROR ("client %p: no mount points configured", client);
+    send_generic_response (client, GST_RTSP_STS_NOT_FOUND, ctx);
+    return FALSE;
+  }
+no_path:
+  {
+    GST_ERROR ("client %p: can't find path for url", client);
+    send_generic_response (client, GST_RTSP_STS_NOT_FOUND, ctx);
+    return FALSE;
+  }
+no_factory:
+  {
+    GST_ERROR ("client %p: no factory for path %s", client, path);
+    send_generic_response (client, GST_RTSP_STS_NOT_FOUND, ctx);
+    g_free (path);
+    return FALSE;
+  }
+not_ingest:
+  {
+    GST_ERROR ("client %p: factory for path %s does not accept publishers",
+        client, path);
+    send_generic_response (client, GST_RTSP_STS_METHOD_NOT_ALLOWED, ctx);
+    g_object_unref (factory);
+    g_free (path);
+    return FALSE;
+  }
+not_authorized:
+  {
+    GST_ERROR ("client %p: not authorized to publish to %s", client, path);
+    /* error reply is already sent */
+    ctx->factory = NULL;
+    g_object_unref (factory);
+    g_free (path);
+    return FALSE;
+  }
+no_sdp:
+  {
+    GST_ERROR ("client %p: no SDP in ANNOUNCE", client);
+    send_generic_response (client, GST_RTSP_STS_BAD_REQUEST, ctx);
+    g_object_unref (factory);
+    g_free (path);
+    return FALSE;
+  }
+bad_sdp:
+  {
+    GST_ERROR ("client %p: can't parse SDP", client);
+    send_generic_response (client, GST_RTSP_STS_BAD_REQUEST, ctx);
+    gst_sdp_message_free (sdp);
+    g_object_unref (factory);
+    g_free (path);
+    return FALSE;
+  }
+not_accepted:
+  {
+    GST_ERROR ("client %p: announcement for %s not accepted", client, path);
+    send_generic_response (client, GST_RTSP_STS_NOT_ACCEPTABLE, ctx);
+    gst_sdp_message_free (sdp);
+    g_object_unref (factory);
+    g_free (path);
+    return FALSE;
+  }
+no_thread:
+  {
+    GST_ERROR ("client %p: can't create thread", client);
+    send_generic_response (client, GST_RTSP_STS_SERVICE_UNAVAILABLE, ctx);
+    g_object_unref (media);
+    ctx->media = NULL;
+    g_free (path);
+    return FALSE;
+  }
+no_prepare:
+  {
+    GST_ERROR ("client %p: can't prepare media", client);
+    send_generic_response (client, GST_RTSP_STS_SERVICE_UNAVAILABLE, ctx);
+    g_object_unref (media);
+    ctx->media = NULL;
+    g_free (path);
+    return FALSE;
+  }
+}
+
+/* if clients can publish to the factory of @uri */
+static gboolean
+is_ingest_uri (GstRTSPClient * client, const GstRTSPUrl * uri)
+{
+  GstRTSPClientPrivate *priv = client->priv;
+  GstRTSPMediaFactory *factory;
+  gboolean res = FALSE;
+  gchar *path, *ingest;
+
+  if (uri == NULL || priv->mount_points == NULL)
+    return FALSE;
+
+  if (!(path = gst_rtsp_mount_points_make_path (priv->mount_points, uri)))
+    return FALSE;
+
+  factory = gst_rtsp_mount_points_match (priv->mount_points, path, NULL);
+  g_free (path);
+
+  if (factory) {
+    ingest = gst_rtsp_media_factory_get_ingest (factory);
+    res = ingest != NULL;
+    g_free (ingest);
+    g_object_unref (factory);
+  }
+  return res;
+}
+
 static gboolean
 default_handle_options_request (GstRTSPClient * client, GstRTSPContext * ctx)
 {
@@ -1850,6 +2324,10 @@ default_handle_options_request (GstRTSPClient * client, GstRTSPContext * ctx)
       GST_RTSP_SETUP |
       GST_RTSP_GET_PARAMETER | GST_RTSP_SET_PARAMETER | GST_RTSP_TEARDOWN;
 
+  /* publishing is only offered on the mount points of ingest factories */
+  if (is_ingest_uri (client, ctx->uri))
+    options |= GST_RTSP_ANNOUNCE | GST_RTSP_RECORD;
+
   str = gst_rtsp_options_as_text (options);
 
   gst_rtsp_message_init_response (ctx->response, GST_RTSP_STS_OK,
@@ -2040,7 +2518,11 @@ handle_request (GstRTSPClient * client, GstRTSPMessage * request)
       klass->handle_get_param_request (client, ctx);
       break;
     case GST_RTSP_ANNOUNCE:
+      handle_announce_request (client, ctx);
+      break;
     case GST_RTSP_RECORD:
+      handle_record_request (client, ctx);
+      break;
     case GST_RTSP_REDIRECT:
       goto not_implemented;
     case GST_RTSP_INVALID:
@@ -2167,54 +2649,73 @@ session_not_found:
   }
 }
 
+/* make a buffer with the body of @message, small packets are copied into a
+ * buffer from a pool so that we don't allocate for each of them */
+static GstBuffer *
+make_data_buffer (GstRTSPClient * client, GstRTSPMessage * message)
+{
+  GstRTSPClientPrivate *priv = client->priv;
+  GstBuffer *buffer;
+  guint8 *data;
+  guint size;
+
+  gst_rtsp_message_get_body (message, &data, &size);
+
+  if (size <= DATA_BUFFER_SIZE) {
+    if (priv->data_pool == NULL) {
+      GstStructure *config;
+
+      priv->data_pool = gst_buffer_pool_new ();
+      config = gst_buffer_pool_get_config (priv->data_pool);
+      gst_buffer_pool_config_set_params (config, NULL, DATA_BUFFER_SIZE,
+          DATA_BUFFER_MIN, 0);
+      gst_buffer_pool_set_config (priv->data_pool, config);
+      gst_buffer_pool_set_active (priv->data_pool, TRUE);
+    }
+    if (gst_buffer_pool_acquire_buffer (priv->data_pool, &buffer,
+            NULL) == GST_FLOW_OK) {
+      /* the previous user might have changed the size */
+      gst_buffer_set_size (buffer, size);
+      gst_buffer_fill (buffer, 0, data, size);
+      return buffer;
+    }
+  }
+
+  gst_rtsp_message_steal_body (message, &data, &size);
+
+  return gst_buffer_new_wrapped (data, size);
+}
+
 static void
 handle_data (GstRTSPClient * client, GstRTSPMessage * message)
 {
   GstRTSPClientPrivate *priv = client->priv;
   GstRTSPResult res;
   guint8 channel;
-  GList *walk;
-  guint8 *data;
-  guint size;
+  GstRTSPStreamTransport *trans;
+  GstRTSPStream *stream;
+  const GstRTSPTransport *tr;
   GstBuffer *buffer;
-  gboolean handled;
 
   /* find the stream for this message */
   res = gst_rtsp_message_parse_data (message, &channel);
   if (res != GST_RTSP_OK)
     return;
 
-  gst_rtsp_message_steal_body (message, &data, &size);
-
-  buffer = gst_buffer_new_wrapped (data, size);
+  trans = priv->channels[channel];
+  if (trans == NULL)
+    return;
 
-  handled = FALSE;
-  for (walk = priv->transports; walk; walk = g_list_next (walk)) {
-    GstRTSPStreamTransport *trans;
-    GstRTSPStream *stream;
-    const GstRTSPTransport *tr;
+  tr = gst_rtsp_stream_transport_get_transport (trans);
+  stream = gst_rtsp_stream_transport_get_stream (trans);
 
-    trans = walk->data;
+  buffer = make_data_buffer (client, message);
 
-    tr = gst_rtsp_stream_transport_get_transport (trans);
-    stream = gst_rtsp_stream_transport_get_stream (trans);
-
-    /* check for TCP transport */
-    if (tr->lower_transport == GST_RTSP_LOWER_TRANS_TCP) {
-      /* dispatch to the stream based on the channel number */
-      if (tr->interleaved.min == channel) {
-        gst_rtsp_stream_recv_rtp (stream, buffer);
-        handled = TRUE;
-        break;
-      } else if (tr->interleaved.max == channel) {
-        gst_rtsp_stream_recv_rtcp (stream, buffer);
-        handled = TRUE;
-        break;
-      }
-    }
-  }
-  if (!handled)
-    gst_buffer_unref (buffer);
+  /* dispatch to the stream based on the channel number */
+  if (tr->interleaved.min == channel)
+    gst_rtsp_stream_recv_rtp (stream, buffer);
+  else
+    gst_rtsp_stream_recv_rtcp (stream, buffer);
 }
 
 /**
@@ -2905,6 +3406,32 @@ gst_rtsp_client_attach (GstRTSPClient * client, GMainContext * context)
   return res;
 }
 
+/**
+ * gst_rtsp_client_close:
+ * @client: a #GstRTSPClient
+ *
+ * Close the connection of @client and destroy its watch. The #GstRTSPClient
+ * will emit the closed signal when the watch is gone.
+ */
+void
+gst_rtsp_client_close (GstRTSPClient * client)
+{
+  GstRTSPClientPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_CLIENT (client));
+
+  priv = client->priv;
+
+  if (priv->connection)
+    close_connection (client);
+
+  if (priv->watch) {
+    GST_DEBUG ("client %p: destroying watch", client);
+    g_source_destroy ((GSource *) priv->watch);
+    gst_rtsp_client_set_send_func (client, NULL, NULL, NULL);
+  }
+}
+
 /**
  * gst_rtsp_client_session_filter:
  * @client: a #GstRTSPClient
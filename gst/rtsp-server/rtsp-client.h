@@ -118,9 +118,11 @@ struct _GstRTSPClientClass {
   void     (*set_parameter_request)   (GstRTSPClient *client, GstRTSPContext *ctx);
   void     (*get_parameter_request)   (GstRTSPClient *client, GstRTSPContext *ctx);
   void     (*handle_response)         (GstRTSPClient *client, GstRTSPContext *ctx);
+  void     (*announce_request)        (GstRTSPClient *client, GstRTSPContext *ctx);
+  void     (*record_request)          (GstRTSPClient *client, GstRTSPContext *ctx);
 
   /*< private >*/
-  gpointer _gst_reserved[GST_PADDING_LARGE];
+  gpointer _gst_reserved[GST_PADDING_LARGE - 2];
 };
 
 GType                 gst_rtsp_client_get_type          (void);
@@ -146,6 +148,7 @@ GstRTSPConnection *   gst_rtsp_client_get_connection    (GstRTSPClient *client);
 
 guint                 gst_rtsp_client_attach            (GstRTSPClient *client,
                                                          GMainContext *context);
+void                  gst_rtsp_client_close             (GstRTSPClient *client);
 
 void                  gst_rtsp_client_set_send_func     (GstRTSPClient *client,
                                                          GstRTSPClientSendFunc func,
@@ -0,0 +1,904 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+/**
+ * SECTION:rtsp-media-factory-proxy
+ * @short_description: A factory that relays a remote RTSP server
+ * @see_also: #GstRTSPMediaFactory, #GstRTSPMediaFactoryURI
+ *
+ * This specialized #GstRTSPMediaFactory serves the streams of the RTSP url
+ * given with gst_rtsp_media_factory_proxy_set_url().
+ *
+ * All factories of the same url share one upstream session. The session is
+ * opened when the first media is constructed and the RTP packets it receives
+ * are relayed as they are, without depayloading, to the media of all
+ * clients. Only the SSRC, the sequence numbers and the timestamps are
+ * rewritten for each client.
+ *
+ * When the upstream session fails, it is opened again after a delay that
+ * grows up to 30 seconds. The clients keep their streams while the upstream
+ * server is reconnected, as long as it serves the same streams again. The
+ * upstream session is closed when it had no clients for the time configured
+ * with gst_rtsp_media_factory_proxy_set_idle_timeout().
+ */
+
+#include <gst/app/gstappsink.h>
+
+#include "rtsp-media-factory-proxy.h"
+#include "rtsp-relay.h"
+
+#define GST_RTSP_MEDIA_FACTORY_PROXY_GET_PRIVATE(obj)  \
+    (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_RTSP_MEDIA_FACTORY_PROXY, GstRTSPMediaFactoryProxyPrivate))
+
+struct _GstRTSPMediaFactoryProxyPrivate
+{
+  GMutex lock;
+  gchar *url;                   /* protected by lock */
+  guint idle_timeout;
+  guint latency;
+};
+
+#define DEFAULT_URL             NULL
+#define DEFAULT_IDLE_TIMEOUT    30
+#define DEFAULT_LATENCY         200
+
+enum
+{
+  PROP_0,
+  PROP_URL,
+  PROP_IDLE_TIMEOUT,
+  PROP_LATENCY,
+  PROP_LAST
+};
+
+/* seconds we wait for the upstream streams before failing a media */
+#define PROXY_CONNECT_TIMEOUT   10
+/* max seconds between two connection attempts */
+#define PROXY_MAX_BACKOFF       30
+
+/* the upstream session of one url, shared by all factories of the url */
+typedef struct
+{
+  gchar *url;
+  GstRTSPRelay *relay;
+  guint idle_timeout;
+  guint latency;
+
+  GstElement *pipeline;
+  GSource *bus_source;
+  GPtrArray *caps;              /* GstCaps of the pads, NULL when unknown */
+  gboolean no_more_pads;
+  gboolean connected;
+
+  gboolean ready;               /* the relay was announced */
+  GCond cond;
+  guint pending;                /* media waiting for the relay */
+  guint idle;                   /* seconds without clients */
+  guint backoff;
+  guint retry;                  /* seconds until the next attempt */
+} ProxyUpstream;
+
+typedef struct
+{
+  ProxyUpstream *upstream;
+  guint idx;
+  gboolean have_caps;
+} ProxySink;
+
+static GMutex proxy_lock;
+static GHashTable *proxy_upstreams;     /* protected by proxy_lock */
+static GMainContext *proxy_context;
+
+GST_DEBUG_CATEGORY_STATIC (rtsp_media_factory_proxy_debug);
+#define GST_CAT_DEFAULT rtsp_media_factory_proxy_debug
+
+static void gst_rtsp_media_factory_proxy_get_property (GObject * object,
+    guint propid, GValue * value, GParamSpec * pspec);
+static void gst_rtsp_media_factory_proxy_set_property (GObject * object,
+    guint propid, const GValue * value, GParamSpec * pspec);
+static void gst_rtsp_media_factory_proxy_finalize (GObject * obj);
+
+static GstElement *rtsp_media_factory_proxy_create_element (GstRTSPMediaFactory
+    * factory, const GstRTSPUrl * url);
+
+G_DEFINE_TYPE (GstRTSPMediaFactoryProxy, gst_rtsp_media_factory_proxy,
+    GST_TYPE_RTSP_MEDIA_FACTORY);
+
+static void
+gst_rtsp_media_factory_proxy_class_init (GstRTSPMediaFactoryProxyClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstRTSPMediaFactoryClass *mediafactory_class;
+
+  g_type_class_add_private (klass, sizeof (GstRTSPMediaFactoryProxyPrivate));
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  mediafactory_class = GST_RTSP_MEDIA_FACTORY_CLASS (klass);
+
+  gobject_class->get_property = gst_rtsp_media_factory_proxy_get_property;
+  gobject_class->set_property = gst_rtsp_media_factory_proxy_set_property;
+  gobject_class->finalize = gst_rtsp_media_factory_proxy_finalize;
+
+  /**
+   * GstRTSPMediaFactoryProxy::url:
+   *
+   * The RTSP url of the upstream server that will be relayed by this
+   * factory.
+   */
+  g_object_class_install_property (gobject_class, PROP_URL,
+      g_param_spec_string ("url", "URL",
+          "The RTSP url of the upstream server", DEFAULT_URL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstRTSPMediaFactoryProxy::idle-timeout:
+   *
+   * The number of seconds the upstream session stays open without clients.
+   */
+  g_object_class_install_property (gobject_class, PROP_IDLE_TIMEOUT,
+      g_param_spec_uint ("idle-timeout", "Idle Timeout",
+          "Seconds the upstream session stays open without clients "
+          "(0 = forever)", 0, G_MAXUINT, DEFAULT_IDLE_TIMEOUT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstRTSPMediaFactoryProxy::latency:
+   *
+   * The latency of the jitterbuffer of the upstream session in milliseconds.
+   */
+  g_object_class_install_property (gobject_class, PROP_LATENCY,
+      g_param_spec_uint ("latency", "Latency",
+          "Latency of the upstream jitterbuffer in ms", 0, G_MAXUINT,
+          DEFAULT_LATENCY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  mediafactory_class->create_element = rtsp_media_factory_proxy_create_element;
+
+  GST_DEBUG_CATEGORY_INIT (rtsp_media_factory_proxy_debug,
+      "rtspmediafactoryproxy", 0, "GstRTSPMediaFactoryProxy");
+}
+
+static void
+gst_rtsp_media_factory_proxy_init (GstRTSPMediaFactoryProxy * factory)
+{
+  GstRTSPMediaFactoryProxyPrivate *priv =
+      GST_RTSP_MEDIA_FACTORY_PROXY_GET_PRIVATE (factory);
+
+  GST_DEBUG_OBJECT (factory, "new");
+
+  factory->priv = priv;
+
+  priv->url = g_strdup (DEFAULT_URL);
+  priv->idle_timeout = DEFAULT_IDLE_TIMEOUT;
+  priv->latency = DEFAULT_LATENCY;
+  g_mutex_init (&priv->lock);
+}
+
+static void
+gst_rtsp_media_factory_proxy_finalize (GObject * obj)
+{
+  GstRTSPMediaFactoryProxy *factory = GST_RTSP_MEDIA_FACTORY_PROXY (obj);
+  GstRTSPMediaFactoryProxyPrivate *priv = factory->priv;
+
+  GST_DEBUG_OBJECT (factory, "finalize");
+
+  g_free (priv->url);
+  g_mutex_clear (&priv->lock);
+
+  G_OBJECT_CLASS (gst_rtsp_media_factory_proxy_parent_class)->finalize (obj);
+}
+
+static void
+gst_rtsp_media_factory_proxy_get_property (GObject * object, guint propid,
+    GValue * value, GParamSpec * pspec)
+{
+  GstRTSPMediaFactoryProxy *factory = GST_RTSP_MEDIA_FACTORY_PROXY (object);
+
+  switch (propid) {
+    case PROP_URL:
+      g_value_take_string (value,
+          gst_rtsp_media_factory_proxy_get_url (factory));
+      break;
+    case PROP_IDLE_TIMEOUT:
+      g_value_set_uint (value,
+          gst_rtsp_media_factory_proxy_get_idle_timeout (factory));
+      break;
+    case PROP_LATENCY:
+      g_value_set_uint (value,
+          gst_rtsp_media_factory_proxy_get_latency (factory));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+  }
+}
+
+static void
+gst_rtsp_media_factory_proxy_set_property (GObject * object, guint propid,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstRTSPMediaFactoryProxy *factory = GST_RTSP_MEDIA_FACTORY_PROXY (object);
+
+  switch (propid) {
+    case PROP_URL:
+      gst_rtsp_media_factory_proxy_set_url (factory,
+          g_value_get_string (value));
+      break;
+    case PROP_IDLE_TIMEOUT:
+      gst_rtsp_media_factory_proxy_set_idle_timeout (factory,
+          g_value_get_uint (value));
+      break;
+    case PROP_LATENCY:
+      gst_rtsp_media_factory_proxy_set_latency (factory,
+          g_value_get_uint (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+  }
+}
+
+/**
+ * gst_rtsp_media_factory_proxy_new:
+ *
+ * Create a new #GstRTSPMediaFactoryProxy instance.
+ *
+ * Returns: a new #GstRTSPMediaFactoryProxy object.
+ */
+GstRTSPMediaFactoryProxy *
+gst_rtsp_media_factory_proxy_new (void)
+{
+  GstRTSPMediaFactoryProxy *result;
+
+  result = g_object_new (GST_TYPE_RTSP_MEDIA_FACTORY_PROXY, NULL);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_media_factory_proxy_set_url:
+ * @factory: a #GstRTSPMediaFactoryProxy
+ * @url: the RTSP url to relay
+ *
+ * Set the RTSP url of the upstream server that will be relayed by this
+ * factory.
+ */
+void
+gst_rtsp_media_factory_proxy_set_url (GstRTSPMediaFactoryProxy * factory,
+    const gchar * url)
+{
+  GstRTSPMediaFactoryProxyPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY_PROXY (factory));
+  g_return_if_fail (url != NULL);
+
+  priv = factory->priv;
+
+  g_mutex_lock (&priv->lock);
+  g_free (priv->url);
+  priv->url = g_strdup (url);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_media_factory_proxy_get_url:
+ * @factory: a #GstRTSPMediaFactoryProxy
+ *
+ * Get the RTSP url of the upstream server that will be relayed by this
+ * factory.
+ *
+ * Returns: the configured url. g_free() after usage.
+ */
+gchar *
+gst_rtsp_media_factory_proxy_get_url (GstRTSPMediaFactoryProxy * factory)
+{
+  GstRTSPMediaFactoryProxyPrivate *priv;
+  gchar *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY_PROXY (factory), NULL);
+
+  priv = factory->priv;
+
+  g_mutex_lock (&priv->lock);
+  result = g_strdup (priv->url);
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_media_factory_proxy_set_idle_timeout:
+ * @factory: a #GstRTSPMediaFactoryProxy
+ * @timeout: a timeout in seconds
+ *
+ * Close the upstream session when it had no clients for @timeout seconds.
+ * A @timeout of 0 keeps the upstream session open.
+ */
+void
+gst_rtsp_media_factory_proxy_set_idle_timeout (GstRTSPMediaFactoryProxy *
+    factory, guint timeout)
+{
+  GstRTSPMediaFactoryProxyPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY_PROXY (factory));
+
+  priv = factory->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->idle_timeout = timeout;
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_media_factory_proxy_get_idle_timeout:
+ * @factory: a #GstRTSPMediaFactoryProxy
+ *
+ * Get the seconds the upstream session stays open without clients.
+ *
+ * Returns: the idle timeout in seconds.
+ */
+guint
+gst_rtsp_media_factory_proxy_get_idle_timeout (GstRTSPMediaFactoryProxy *
+    factory)
+{
+  GstRTSPMediaFactoryProxyPrivate *priv;
+  guint result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY_PROXY (factory), 0);
+
+  priv = factory->priv;
+
+  g_mutex_lock (&priv->lock);
+  result = priv->idle_timeout;
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_media_factory_proxy_set_latency:
+ * @factory: a #GstRTSPMediaFactoryProxy
+ * @latency: latency in milliseconds
+ *
+ * Configure the latency of the jitterbuffer of the upstream session. This
+ * is used when the upstream session is opened.
+ */
+void
+gst_rtsp_media_factory_proxy_set_latency (GstRTSPMediaFactoryProxy * factory,
+    guint latency)
+{
+  GstRTSPMediaFactoryProxyPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY_PROXY (factory));
+
+  priv = factory->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->latency = latency;
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_media_factory_proxy_get_latency:
+ * @factory: a #GstRTSPMediaFactoryProxy
+ *
+ * Get the latency of the jitterbuffer of the upstream session.
+ *
+ * Returns: latency in milliseconds
+ */
+guint
+gst_rtsp_media_factory_proxy_get_latency (GstRTSPMediaFactoryProxy * factory)
+{
+  GstRTSPMediaFactoryProxyPrivate *priv;
+  guint result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY_PROXY (factory), 0);
+
+  priv = factory->priv;
+
+  g_mutex_lock (&priv->lock);
+  result = priv->latency;
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
+
+static void
+upstream_clear_caps (ProxyUpstream * upstream)
+{
+  guint i;
+
+  for (i = 0; i < upstream->caps->len; i++) {
+    GstCaps *caps = g_ptr_array_index (upstream->caps, i);
+
+    if (caps)
+      gst_caps_unref (caps);
+  }
+  g_ptr_array_set_size (upstream->caps, 0);
+  upstream->no_more_pads = FALSE;
+}
+
+/* called with proxy_lock, announces the relay when all pads have caps */
+static void
+upstream_check_ready (ProxyUpstream * upstream)
+{
+  GPtrArray *caps;
+  guint i;
+
+  if (upstream->connected || !upstream->no_more_pads ||
+      upstream->caps->len == 0)
+    return;
+
+  for (i = 0; i < upstream->caps->len; i++) {
+    if (g_ptr_array_index (upstream->caps, i) == NULL)
+      return;
+  }
+
+  caps = g_ptr_array_new_with_free_func ((GDestroyNotify) gst_caps_unref);
+  for (i = 0; i < upstream->caps->len; i++)
+    g_ptr_array_add (caps, gst_caps_ref (g_ptr_array_index (upstream->caps,
+                i)));
+
+  /* the clients keep their streams when the caps did not change */
+  if (!gst_rtsp_relay_announce (upstream->relay, upstream, caps))
+    goto busy;
+
+  GST_INFO ("upstream %s connected with %u streams", upstream->url,
+      upstream->caps->len);
+
+  upstream->connected = TRUE;
+  upstream->ready = TRUE;
+  upstream->backoff = 1;
+  g_cond_broadcast (&upstream->cond);
+
+  return;
+
+  /* ERRORS */
+busy:
+  {
+    GError *error;
+
+    /* the bus watch stops the pipeline and tries again later */
+    error = g_error_new (GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_BUSY,
+        "relay of %s has another publisher", upstream->url);
+    if (upstream->pipeline)
+      gst_element_post_message (upstream->pipeline,
+          gst_message_new_error (GST_OBJECT_CAST (upstream->pipeline), error,
+              NULL));
+    g_error_free (error);
+    return;
+  }
+}
+
+/* the fields that describe one upstream session, the relay makes its own */
+static GstCaps *
+strip_caps (GstCaps * caps)
+{
+  GstStructure *s;
+
+  caps = gst_caps_copy (caps);
+  s = gst_caps_get_structure (caps, 0);
+  gst_structure_remove_fields (s, "ssrc", "clock-base", "seqnum-base",
+      "npt-start", "npt-stop", "play-speed", "play-scale", NULL);
+
+  return caps;
+}
+
+static GstFlowReturn
+sink_new_sample (GstAppSink * appsink, ProxySink * sink)
+{
+  ProxyUpstream *upstream = sink->upstream;
+  GstSample *sample;
+  GstBuffer *buffer;
+
+  sample = gst_app_sink_pull_sample (appsink);
+  if (sample == NULL)
+    return GST_FLOW_EOS;
+
+  if (!sink->have_caps) {
+    GstCaps *caps = gst_sample_get_caps (sample);
+
+    if (caps && gst_caps_get_size (caps) > 0) {
+      g_mutex_lock (&proxy_lock);
+      g_ptr_array_index (upstream->caps, sink->idx) = strip_caps (caps);
+      upstream_check_ready (upstream);
+      g_mutex_unlock (&proxy_lock);
+      sink->have_caps = TRUE;
+    }
+  }
+
+  buffer = gst_sample_get_buffer (sample);
+  if (buffer)
+    gst_rtsp_relay_push (upstream->relay, upstream, sink->idx, buffer);
+  gst_sample_unref (sample);
+
+  return GST_FLOW_OK;
+}
+
+static void
+sink_free (ProxySink * sink)
+{
+  g_slice_free (ProxySink, sink);
+}
+
+static GstAppSinkCallbacks sink_callbacks = {
+  NULL,
+  NULL,
+  (GstFlowReturn (*)(GstAppSink *, gpointer)) sink_new_sample
+};
+
+static void
+pad_added_cb (GstElement * rtspsrc, GstPad * pad, ProxyUpstream * upstream)
+{
+  GstElement *pipeline, *appsink;
+  GstPad *sinkpad;
+  ProxySink *sink;
+
+  if (GST_PAD_DIRECTION (pad) != GST_PAD_SRC)
+    return;
+
+  sink = g_slice_new0 (ProxySink);
+  sink->upstream = upstream;
+
+  g_mutex_lock (&proxy_lock);
+  sink->idx = upstream->caps->len;
+  g_ptr_array_add (upstream->caps, NULL);
+  g_mutex_unlock (&proxy_lock);
+
+  GST_DEBUG ("upstream %s pad %s is stream %u", upstream->url,
+      GST_PAD_NAME (pad), sink->idx);
+
+  appsink = gst_element_factory_make ("appsink", NULL);
+  if (appsink == NULL)
+    goto no_appsink;
+
+  g_object_set (appsink, "sync", FALSE, "async", FALSE,
+      "enable-last-sample", FALSE, NULL);
+  gst_app_sink_set_callbacks (GST_APP_SINK_CAST (appsink), &sink_callbacks,
+      sink, (GDestroyNotify) sink_free);
+
+  pipeline = GST_ELEMENT_CAST (gst_element_get_parent (rtspsrc));
+  gst_bin_add (GST_BIN_CAST (pipeline), appsink);
+  gst_element_sync_state_with_parent (appsink);
+  gst_object_unref (pipeline);
+
+  sinkpad = gst_element_get_static_pad (appsink, "sink");
+  gst_pad_link (pad, sinkpad);
+  gst_object_unref (sinkpad);
+
+  return;
+
+  /* ERRORS */
+no_appsink:
+  {
+    g_critical ("can't create appsink element");
+    sink_free (sink);
+    return;
+  }
+}
+
+static void
+no_more_pads_cb (GstElement * rtspsrc, ProxyUpstream * upstream)
+{
+  g_mutex_lock (&proxy_lock);
+  upstream->no_more_pads = TRUE;
+  upstream_check_ready (upstream);
+  g_mutex_unlock (&proxy_lock);
+}
+
+static void upstream_stop (ProxyUpstream * upstream);
+
+/* the proxy thread starts the stopped upstream again when the retry runs
+ * out, the delay doubles with every failed attempt */
+static void
+upstream_schedule_retry (ProxyUpstream * upstream)
+{
+  guint retry;
+
+  g_mutex_lock (&proxy_lock);
+  /* the bus handler can already have scheduled it */
+  if (upstream->pipeline != NULL || upstream->retry > 0) {
+    g_mutex_unlock (&proxy_lock);
+    return;
+  }
+  retry = upstream->retry = upstream->backoff;
+  upstream->backoff = MIN (upstream->backoff * 2, PROXY_MAX_BACKOFF);
+  g_mutex_unlock (&proxy_lock);
+
+  GST_INFO ("reconnecting upstream %s in %u seconds", upstream->url, retry);
+}
+
+/* runs in the proxy thread */
+static gboolean
+bus_message (GstBus * bus, GstMessage * message, ProxyUpstream * upstream)
+{
+  switch (GST_MESSAGE_TYPE (message)) {
+    case GST_MESSAGE_ERROR:
+    {
+      GError *gerror;
+      gchar *debug;
+
+      gst_message_parse_error (message, &gerror, &debug);
+      GST_WARNING ("upstream %s failed: %s (%s)", upstream->url,
+          gerror->message, debug);
+      g_error_free (gerror);
+      g_free (debug);
+      break;
+    }
+    case GST_MESSAGE_EOS:
+      GST_INFO ("upstream %s ended", upstream->url);
+      break;
+    default:
+      return TRUE;
+  }
+
+  upstream_stop (upstream);
+  upstream_schedule_retry (upstream);
+
+  /* the watch was removed in upstream_stop */
+  return FALSE;
+}
+
+/* not called with proxy_lock, the streaming threads take it */
+static void
+upstream_start (ProxyUpstream * upstream)
+{
+  GstElement *pipeline, *rtspsrc;
+  GstBus *bus;
+  GSource *source;
+
+  GST_INFO ("connecting upstream %s", upstream->url);
+
+  pipeline = gst_pipeline_new (NULL);
+  rtspsrc = gst_element_factory_make ("rtspsrc", NULL);
+  if (rtspsrc == NULL)
+    goto no_rtspsrc;
+
+  g_object_set (rtspsrc, "location", upstream->url, "latency",
+      upstream->latency, NULL);
+  g_signal_connect (rtspsrc, "pad-added", (GCallback) pad_added_cb, upstream);
+  g_signal_connect (rtspsrc, "no-more-pads", (GCallback) no_more_pads_cb,
+      upstream);
+  gst_bin_add (GST_BIN_CAST (pipeline), rtspsrc);
+
+  bus = gst_pipeline_get_bus (GST_PIPELINE_CAST (pipeline));
+  source = gst_bus_create_watch (bus);
+  g_source_set_callback (source, (GSourceFunc) bus_message, upstream, NULL);
+  g_source_attach (source, proxy_context);
+  gst_object_unref (bus);
+
+  g_mutex_lock (&proxy_lock);
+  upstream_clear_caps (upstream);
+  upstream->pipeline = pipeline;
+  upstream->bus_source = source;
+  g_mutex_unlock (&proxy_lock);
+
+  if (gst_element_set_state (pipeline,
+          GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE)
+    goto start_failed;
+
+  return;
+
+  /* ERRORS */
+no_rtspsrc:
+  {
+    g_critical ("can't create rtspsrc element");
+    gst_object_unref (pipeline);
+    upstream_schedule_retry (upstream);
+    return;
+  }
+start_failed:
+  {
+    GST_WARNING ("upstream %s failed to start", upstream->url);
+    upstream_stop (upstream);
+    upstream_schedule_retry (upstream);
+    return;
+  }
+}
+
+static void
+upstream_stop (ProxyUpstream * upstream)
+{
+  GstElement *pipeline;
+  GSource *source;
+
+  g_mutex_lock (&proxy_lock);
+  pipeline = upstream->pipeline;
+  upstream->pipeline = NULL;
+  source = upstream->bus_source;
+  upstream->bus_source = NULL;
+  if (upstream->connected) {
+    gst_rtsp_relay_unpublish (upstream->relay, upstream);
+    upstream->connected = FALSE;
+  }
+  g_mutex_unlock (&proxy_lock);
+
+  if (source) {
+    g_source_destroy (source);
+    g_source_unref (source);
+  }
+  if (pipeline) {
+    gst_element_set_state (pipeline, GST_STATE_NULL);
+    gst_object_unref (pipeline);
+  }
+}
+
+static void
+upstream_free (ProxyUpstream * upstream)
+{
+  GST_INFO ("closing upstream %s", upstream->url);
+
+  upstream_stop (upstream);
+
+  gst_rtsp_relay_unref (upstream->relay);
+  upstream_clear_caps (upstream);
+  g_ptr_array_free (upstream->caps, TRUE);
+  g_cond_clear (&upstream->cond);
+  g_free (upstream->url);
+  g_slice_free (ProxyUpstream, upstream);
+}
+
+/* runs in the proxy thread every second */
+static gboolean
+proxy_tick (gpointer user_data)
+{
+  GHashTableIter iter;
+  ProxyUpstream *upstream;
+  GList *start = NULL, *evict = NULL, *walk;
+
+  g_mutex_lock (&proxy_lock);
+  g_hash_table_iter_init (&iter, proxy_upstreams);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & upstream)) {
+    if (upstream->pending == 0 && upstream->idle_timeout > 0 &&
+        gst_rtsp_relay_n_users (upstream->relay) == 0) {
+      if (++upstream->idle >= upstream->idle_timeout) {
+        g_hash_table_iter_steal (&iter);
+        evict = g_list_prepend (evict, upstream);
+        continue;
+      }
+    } else {
+      upstream->idle = 0;
+    }
+
+    if (upstream->pipeline == NULL && upstream->retry > 0 &&
+        --upstream->retry == 0)
+      start = g_list_prepend (start, upstream);
+  }
+  g_mutex_unlock (&proxy_lock);
+
+  /* only this thread removes upstreams */
+  for (walk = start; walk; walk = g_list_next (walk))
+    upstream_start (walk->data);
+  g_list_free (start);
+  g_list_free_full (evict, (GDestroyNotify) upstream_free);
+
+  return TRUE;
+}
+
+static gpointer
+proxy_thread (GMainLoop * loop)
+{
+  g_main_loop_run (loop);
+
+  return NULL;
+}
+
+/* called with proxy_lock. The upstreams are handled in one thread that
+ * stays around, like the relays */
+static void
+ensure_proxy_thread (void)
+{
+  GMainLoop *loop;
+  GSource *source;
+
+  if (proxy_context != NULL)
+    return;
+
+  proxy_upstreams = g_hash_table_new (g_str_hash, g_str_equal);
+  proxy_context = g_main_context_new ();
+
+  source = g_timeout_source_new_seconds (1);
+  g_source_set_callback (source, proxy_tick, NULL, NULL);
+  g_source_attach (source, proxy_context);
+  g_source_unref (source);
+
+  loop = g_main_loop_new (proxy_context, FALSE);
+  g_thread_unref (g_thread_new ("rtsp-proxy", (GThreadFunc) proxy_thread,
+          loop));
+}
+
+static GstElement *
+rtsp_media_factory_proxy_create_element (GstRTSPMediaFactory * factory,
+    const GstRTSPUrl * url)
+{
+  GstRTSPMediaFactoryProxy *proxyfact;
+  GstRTSPMediaFactoryProxyPrivate *priv;
+  ProxyUpstream *upstream;
+  GstElement *element;
+  gboolean start = FALSE;
+  gint64 end_time;
+  gchar *location, *name;
+
+  proxyfact = GST_RTSP_MEDIA_FACTORY_PROXY_CAST (factory);
+  priv = proxyfact->priv;
+
+  location = gst_rtsp_media_factory_proxy_get_url (proxyfact);
+  if (location == NULL)
+    goto no_url;
+
+  g_mutex_lock (&proxy_lock);
+  ensure_proxy_thread ();
+
+  upstream = g_hash_table_lookup (proxy_upstreams, location);
+  if (upstream == NULL) {
+    upstream = g_slice_new0 (ProxyUpstream);
+    upstream->url = location;
+    name = g_strdup_printf ("proxy:%s", location);
+    upstream->relay = gst_rtsp_relay_get (name);
+    g_free (name);
+    upstream->caps = g_ptr_array_new ();
+    upstream->backoff = 1;
+    g_cond_init (&upstream->cond);
+    g_hash_table_insert (proxy_upstreams, upstream->url, upstream);
+    start = TRUE;
+  } else {
+    g_free (location);
+  }
+  /* the last factory configures the shared upstream */
+  g_mutex_lock (&priv->lock);
+  upstream->idle_timeout = priv->idle_timeout;
+  upstream->latency = priv->latency;
+  g_mutex_unlock (&priv->lock);
+  upstream->pending++;
+  g_mutex_unlock (&proxy_lock);
+
+  if (start)
+    upstream_start (upstream);
+
+  end_time = g_get_monotonic_time () + PROXY_CONNECT_TIMEOUT *
+      G_TIME_SPAN_SECOND;
+
+  g_mutex_lock (&proxy_lock);
+  while (!upstream->ready) {
+    if (!g_cond_wait_until (&upstream->cond, &proxy_lock, end_time))
+      break;
+  }
+  if (!upstream->ready)
+    goto not_connected;
+  g_mutex_unlock (&proxy_lock);
+
+  element = gst_rtsp_relay_create_element (upstream->relay);
+
+  /* the appsrcs of the element are now users of the relay */
+  g_mutex_lock (&proxy_lock);
+  upstream->pending--;
+  g_mutex_unlock (&proxy_lock);
+
+  return element;
+
+  /* ERRORS */
+no_url:
+  {
+    GST_ERROR ("no url configured");
+    return NULL;
+  }
+not_connected:
+  {
+    GST_ERROR ("upstream %s did not connect", upstream->url);
+    upstream->pending--;
+    g_mutex_unlock (&proxy_lock);
+    return NULL;
+  }
+}
@@ -0,0 +1,88 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/gst.h>
+
+#include "rtsp-media-factory.h"
+
+#ifndef __GST_RTSP_MEDIA_FACTORY_PROXY_H__
+#define __GST_RTSP_MEDIA_FACTORY_PROXY_H__
+
+G_BEGIN_DECLS
+
+/* types for the media factory */
+#define GST_TYPE_RTSP_MEDIA_FACTORY_PROXY              (gst_rtsp_media_factory_proxy_get_type ())
+#define GST_IS_RTSP_MEDIA_FACTORY_PROXY(obj)           (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_RTSP_MEDIA_FACTORY_PROXY))
+#define GST_IS_RTSP_MEDIA_FACTORY_PROXY_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_RTSP_MEDIA_FACTORY_PROXY))
+#define GST_RTSP_MEDIA_FACTORY_PROXY_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_RTSP_MEDIA_FACTORY_PROXY, GstRTSPMediaFactoryProxyClass))
+#define GST_RTSP_MEDIA_FACTORY_PROXY(obj)              (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_RTSP_MEDIA_FACTORY_PROXY, GstRTSPMediaFactoryProxy))
+#define GST_RTSP_MEDIA_FACTORY_PROXY_CLASS(klass)      (G_TYPE_CHECK_CLASS_CAST ((klass), GST_TYPE_RTSP_MEDIA_FACTORY_PROXY, GstRTSPMediaFactoryProxyClass))
+#define GST_RTSP_MEDIA_FACTORY_PROXY_CAST(obj)         ((GstRTSPMediaFactoryProxy*)(obj))
+#define GST_RTSP_MEDIA_FACTORY_PROXY_CLASS_CAST(klass) ((GstRTSPMediaFactoryProxyClass*)(klass))
+
+typedef struct _GstRTSPMediaFactoryProxy GstRTSPMediaFactoryProxy;
+typedef struct _GstRTSPMediaFactoryProxyClass GstRTSPMediaFactoryProxyClass;
+typedef struct _GstRTSPMediaFactoryProxyPrivate GstRTSPMediaFactoryProxyPrivate;
+
+/**
+ * GstRTSPMediaFactoryProxy:
+ *
+ * A media factory that relays the streams of a remote RTSP server.
+ */
+struct _GstRTSPMediaFactoryProxy {
+  GstRTSPMediaFactory   parent;
+
+  /*< private >*/
+  GstRTSPMediaFactoryProxyPrivate *priv;
+  gpointer _gst_reserved[GST_PADDING];
+};
+
+/**
+ * GstRTSPMediaFactoryProxyClass:
+ *
+ * The #GstRTSPMediaFactoryProxy class structure.
+ */
+struct _GstRTSPMediaFactoryProxyClass {
+  GstRTSPMediaFactoryClass  parent_class;
+
+  /*< private >*/
+  gpointer _gst_reserved[GST_PADDING];
+};
+
+GType                 gst_rtsp_media_factory_proxy_get_type   (void);
+
+/* creating the factory */
+GstRTSPMediaFactoryProxy * gst_rtsp_media_factory_proxy_new     (void);
+
+/* configuring the factory */
+void                  gst_rtsp_media_factory_proxy_set_url    (GstRTSPMediaFactoryProxy *factory,
+                                                               const gchar *url);
+gchar *               gst_rtsp_media_factory_proxy_get_url    (GstRTSPMediaFactoryProxy *factory);
+
+void                  gst_rtsp_media_factory_proxy_set_idle_timeout (GstRTSPMediaFactoryProxy *factory,
+                                                                     guint timeout);
+guint                 gst_rtsp_media_factory_proxy_get_idle_timeout (GstRTSPMediaFactoryProxy *factory);
+
+void                  gst_rtsp_media_factory_proxy_set_latency (GstRTSPMediaFactoryProxy *factory,
+                                                                guint latency);
+guint                 gst_rtsp_media_factory_proxy_get_latency (GstRTSPMediaFactoryProxy *factory);
+
+G_END_DECLS
+
+#endif /* __GST_RTSP_MEDIA_FACTORY_PROXY_H__ */
@@ -42,22 +42,22 @@ struct _GstRTSPMediaFactoryURIPrivate
   GMutex lock;
   gchar *uri;                   /* protected by lock */
   gboolean use_gstpay;
+  gboolean passthrough;
 
   GstCaps *raw_vcaps;
   GstCaps *raw_acaps;
-  GList *demuxers;
-  GList *payloaders;
-  GList *decoders;
 };
 
 #define DEFAULT_URI         NULL
 #define DEFAULT_USE_GSTPAY  FALSE
+#define DEFAULT_PASSTHROUGH FALSE
 
 enum
 {
   PROP_0,
   PROP_URI,
   PROP_USE_GSTPAY,
+  PROP_PASSTHROUGH,
   PROP_LAST
 };
 
@@ -71,6 +71,16 @@ enum
 static GstStaticCaps raw_video_caps = GST_STATIC_CAPS (RAW_VIDEO_CAPS);
 static GstStaticCaps raw_audio_caps = GST_STATIC_CAPS (RAW_AUDIO_CAPS);
 
+/* from gst-plugins-base/gst/playback/gstplay-enum.h, the header is not
+ * installed. The values are part of the signal API of uridecodebin and
+ * don't change. */
+typedef enum
+{
+  GST_AUTOPLUG_SELECT_TRY,
+  GST_AUTOPLUG_SELECT_EXPOSE,
+  GST_AUTOPLUG_SELECT_SKIP
+} GstAutoplugSelectResult;
+
 typedef struct
 {
   GstRTSPMediaFactoryURI *factory;
@@ -86,6 +96,29 @@ free_data (FactoryData * data)
 
 static const gchar *factory_key = "GstRTSPMediaFactoryURI";
 
+/* what to do with a stream of some caps */
+typedef struct
+{
+  gboolean demux;               /* plug a demuxer or parser first */
+  GstElementFactory *payloader; /* the payloader or NULL */
+} AutoplugResult;
+
+/* the demuxers, parsers and payloaders of the registry, shared by
+ * all factories and rebuilt when the registry changes. The lookups are
+ * cached by caps. */
+typedef struct
+{
+  guint32 cookie;
+  GList *demuxers;
+  GList *payloaders;
+  GHashTable *results;
+} AutoplugRegistry;
+
+#define AUTOPLUG_RESULTS_MAX 1024
+
+static GMutex autoplug_lock;
+static AutoplugRegistry *autoplug_registry;     /* protected by autoplug_lock */
+
 GST_DEBUG_CATEGORY_STATIC (rtsp_media_factory_uri_debug);
 #define GST_CAT_DEFAULT rtsp_media_factory_uri_debug
 
@@ -135,6 +168,17 @@ gst_rtsp_media_factory_uri_class_init (GstRTSPMediaFactoryURIClass * klass)
       g_param_spec_boolean ("use-gstpay", "Use gstpay",
           "Use the gstpay payloader to avoid decoding", DEFAULT_USE_GSTPAY,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  /**
+   * GstRTSPMediaFactoryURI::passthrough:
+   *
+   * Only build demuxer, parser and payloader chains and never decode. Streams
+   * that would need a decoder are not exposed and a warning is posted on the
+   * bus of the media.
+   */
+  g_object_class_install_property (gobject_class, PROP_PASSTHROUGH,
+      g_param_spec_boolean ("passthrough", "Passthrough",
+          "Never decode, only demux, parse and payload the streams",
+          DEFAULT_PASSTHROUGH, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   mediafactory_class->create_element = rtsp_media_factory_uri_create_element;
 
@@ -146,7 +190,6 @@ typedef struct
 {
   GList *demux;
   GList *payload;
-  GList *decode;
 } FilterData;
 
 static gboolean
@@ -168,7 +211,8 @@ payloader_filter (GstPluginFeature * feature, FilterData * data)
   klass = gst_element_factory_get_metadata (fact, GST_ELEMENT_METADATA_KLASS);
 
   if (strstr (klass, "Decoder"))
-    list = &data->decode;
+    /* decoders are plugged by uridecodebin when there is no payloader */
+    return FALSE;
   else if (strstr (klass, "Demux"))
     list = &data->demux;
   else if (strstr (klass, "Parser") && strstr (klass, "Codec"))
@@ -184,12 +228,62 @@ payloader_filter (GstPluginFeature * feature, FilterData * data)
   return FALSE;
 }
 
+static void
+autoplug_result_free (AutoplugResult * result)
+{
+  if (result->payloader)
+    gst_object_unref (result->payloader);
+  g_slice_free (AutoplugResult, result);
+}
+
+static void
+autoplug_registry_free (AutoplugRegistry * registry)
+{
+  gst_plugin_feature_list_free (registry->demuxers);
+  gst_plugin_feature_list_free (registry->payloaders);
+  g_hash_table_unref (registry->results);
+  g_slice_free (AutoplugRegistry, registry);
+}
+
+/* call with autoplug_lock */
+static AutoplugRegistry *
+autoplug_registry_get (void)
+{
+  GstRegistry *registry = gst_registry_get ();
+  FilterData data = { NULL, NULL };
+  guint32 cookie;
+
+  cookie = gst_registry_get_feature_list_cookie (registry);
+  if (autoplug_registry && autoplug_registry->cookie == cookie)
+    return autoplug_registry;
+
+  GST_DEBUG ("building autoplug registry, cookie %u", cookie);
+
+  if (autoplug_registry)
+    autoplug_registry_free (autoplug_registry);
+
+  /* get the feature list using the filter */
+  gst_registry_feature_filter (registry, (GstPluginFeatureFilter)
+      payloader_filter, FALSE, &data);
+
+  autoplug_registry = g_slice_new0 (AutoplugRegistry);
+  autoplug_registry->cookie = cookie;
+  /* sort */
+  autoplug_registry->demuxers =
+      g_list_sort (data.demux, gst_plugin_feature_rank_compare_func);
+  autoplug_registry->payloaders =
+      g_list_sort (data.payload, gst_plugin_feature_rank_compare_func);
+  autoplug_registry->results = g_hash_table_new_full (g_str_hash,
+      g_str_equal, g_free, (GDestroyNotify) autoplug_result_free);
+
+  return autoplug_registry;
+}
+
 static void
 gst_rtsp_media_factory_uri_init (GstRTSPMediaFactoryURI * factory)
 {
   GstRTSPMediaFactoryURIPrivate *priv =
       GST_RTSP_MEDIA_FACTORY_URI_GET_PRIVATE (factory);
-  FilterData data = { NULL, NULL, NULL };
 
   GST_DEBUG_OBJECT (factory, "new");
 
@@ -197,19 +291,9 @@ gst_rtsp_media_factory_uri_init (GstRTSPMediaFactoryURI * factory)
 
   priv->uri = g_strdup (DEFAULT_URI);
   priv->use_gstpay = DEFAULT_USE_GSTPAY;
+  priv->passthrough = DEFAULT_PASSTHROUGH;
   g_mutex_init (&priv->lock);
 
-  /* get the feature list using the filter */
-  gst_registry_feature_filter (gst_registry_get (), (GstPluginFeatureFilter)
-      payloader_filter, FALSE, &data);
-  /* sort */
-  priv->demuxers =
-      g_list_sort (data.demux, gst_plugin_feature_rank_compare_func);
-  priv->payloaders =
-      g_list_sort (data.payload, gst_plugin_feature_rank_compare_func);
-  priv->decoders =
-      g_list_sort (data.decode, gst_plugin_feature_rank_compare_func);
-
   priv->raw_vcaps = gst_static_caps_get (&raw_video_caps);
   priv->raw_acaps = gst_static_caps_get (&raw_audio_caps);
 }
@@ -223,9 +307,6 @@ gst_rtsp_media_factory_uri_finalize (GObject * obj)
   GST_DEBUG_OBJECT (factory, "finalize");
 
   g_free (priv->uri);
-  gst_plugin_feature_list_free (priv->demuxers);
-  gst_plugin_feature_list_free (priv->payloaders);
-  gst_plugin_feature_list_free (priv->decoders);
   gst_caps_unref (priv->raw_vcaps);
   gst_caps_unref (priv->raw_acaps);
   g_mutex_clear (&priv->lock);
@@ -247,6 +328,9 @@ gst_rtsp_media_factory_uri_get_property (GObject * object, guint propid,
     case PROP_USE_GSTPAY:
       g_value_set_boolean (value, priv->use_gstpay);
       break;
+    case PROP_PASSTHROUGH:
+      g_value_set_boolean (value, priv->passthrough);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -266,6 +350,9 @@ gst_rtsp_media_factory_uri_set_property (GObject * object, guint propid,
     case PROP_USE_GSTPAY:
       priv->use_gstpay = g_value_get_boolean (value);
       break;
+    case PROP_PASSTHROUGH:
+      priv->passthrough = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -337,16 +424,17 @@ gst_rtsp_media_factory_uri_get_uri (GstRTSPMediaFactoryURI * factory)
   return result;
 }
 
-static GstElementFactory *
-find_payloader (GstRTSPMediaFactoryURI * urifact, GstCaps * caps)
+/* classify @caps against the factories in @registry */
+static AutoplugResult *
+autoplug_result_new (AutoplugRegistry * registry, GstCaps * caps)
 {
-  GstRTSPMediaFactoryURIPrivate *priv = urifact->priv;
+  AutoplugResult *result;
   GList *list;
-  GstElementFactory *factory = NULL;
-  gboolean autoplug_more = FALSE;
+
+  result = g_slice_new0 (AutoplugResult);
 
   /* first find a demuxer that can link */
-  list = gst_element_factory_list_filter (priv->demuxers, caps,
+  list = gst_element_factory_list_filter (registry->demuxers, caps,
       GST_PAD_SINK, FALSE);
 
   if (list) {
@@ -372,55 +460,81 @@ find_payloader (GstRTSPMediaFactoryURI * urifact, GstCaps * caps)
       const gchar *klass;
 
       for (walk = list; walk; walk = walk->next) {
-        factory = GST_ELEMENT_FACTORY (walk->data);
+        GstElementFactory *factory = GST_ELEMENT_FACTORY (walk->data);
+
         klass = gst_element_factory_get_metadata (factory,
             GST_ELEMENT_METADATA_KLASS);
         if (strstr (klass, "Parser"))
           /* caps have parsed=true, so skip this parser to avoid loops */
           continue;
 
-        autoplug_more = TRUE;
+        result->demux = TRUE;
         break;
       }
     } else {
       /* caps don't have parsed=true set and we have a demuxer/parser */
-      autoplug_more = TRUE;
+      result->demux = TRUE;
     }
 
     gst_plugin_feature_list_free (list);
   }
 
-  if (autoplug_more)
+  if (result->demux)
     /* we have a demuxer, try that one first */
-    return NULL;
+    return result;
 
   /* no demuxer try a depayloader */
-  list = gst_element_factory_list_filter (priv->payloaders, caps,
+  list = gst_element_factory_list_filter (registry->payloaders, caps,
       GST_PAD_SINK, FALSE);
 
-  if (list == NULL) {
-    if (priv->use_gstpay) {
-      /* no depayloader or parser/demuxer, use gstpay when allowed */
-      factory = gst_element_factory_find ("rtpgstpay");
-    } else {
-      /* no depayloader, try a decoder, we'll get to a payloader for a decoded
-       * video or audio format, worst case. */
-      list = gst_element_factory_list_filter (priv->decoders, caps,
-          GST_PAD_SINK, FALSE);
-
-      if (list != NULL) {
-        /* we have a decoder, try that one first */
-        gst_plugin_feature_list_free (list);
-        return NULL;
-      }
-    }
-  }
-
   if (list != NULL) {
-    factory = GST_ELEMENT_FACTORY_CAST (list->data);
-    g_object_ref (factory);
+    result->payloader = gst_object_ref (list->data);
     gst_plugin_feature_list_free (list);
   }
+
+  /* without a payloader we need a decoder, we'll get to a payloader for a
+   * decoded video or audio format, worst case. */
+  return result;
+}
+
+static GstElementFactory *
+find_payloader (GstRTSPMediaFactoryURI * urifact, GstCaps * caps)
+{
+  GstRTSPMediaFactoryURIPrivate *priv = urifact->priv;
+  AutoplugRegistry *registry;
+  AutoplugResult *result;
+  GstElementFactory *factory = NULL;
+  gboolean demux;
+  gchar *key;
+
+  key = gst_caps_to_string (caps);
+
+  g_mutex_lock (&autoplug_lock);
+  registry = autoplug_registry_get ();
+  result = g_hash_table_lookup (registry->results, key);
+  if (result == NULL) {
+    result = autoplug_result_new (registry, caps);
+
+    if (g_hash_table_size (registry->results) >= AUTOPLUG_RESULTS_MAX)
+      g_hash_table_remove_all (registry->results);
+    g_hash_table_insert (registry->results, key, result);
+    key = NULL;
+  }
+  demux = result->demux;
+  if (result->payloader)
+    factory = gst_object_ref (result->payloader);
+  g_mutex_unlock (&autoplug_lock);
+
+  g_free (key);
+
+  if (demux)
+    return NULL;
+
+  if (factory == NULL && priv->use_gstpay) {
+    /* no depayloader or parser/demuxer, use gstpay when allowed */
+    factory = gst_element_factory_find ("rtpgstpay");
+  }
+
   return factory;
 }
 
@@ -456,6 +570,57 @@ no_factory:
   }
 }
 
+static gboolean
+caps_are_parsed (GstCaps * caps)
+{
+  GstStructure *structure = gst_caps_get_structure (caps, 0);
+  gboolean parsed = FALSE;
+
+  if (!gst_structure_get_boolean (structure, "parsed", &parsed))
+    gst_structure_get_boolean (structure, "framed", &parsed);
+
+  return parsed;
+}
+
+/* in passthrough mode, only let uridecodebin plug demuxers and parsers */
+static GstAutoplugSelectResult
+autoplug_select_cb (GstElement * uribin, GstPad * pad, GstCaps * caps,
+    GstElementFactory * factory, GstElement * element)
+{
+  const gchar *klass;
+
+  klass = gst_element_factory_get_metadata (factory,
+      GST_ELEMENT_METADATA_KLASS);
+
+  if (strstr (klass, "Decoder")) {
+    GST_DEBUG ("passthrough, skipping decoder %s",
+        gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory)));
+    return GST_AUTOPLUG_SELECT_SKIP;
+  }
+
+  /* the stream was parsed already, don't plug another parser */
+  if (strstr (klass, "Parser") && caps_are_parsed (caps)) {
+    GST_DEBUG ("passthrough, skipping parser %s for parsed caps",
+        gst_plugin_feature_get_name (GST_PLUGIN_FEATURE (factory)));
+    return GST_AUTOPLUG_SELECT_SKIP;
+  }
+
+  return GST_AUTOPLUG_SELECT_TRY;
+}
+
+static void
+unknown_type_cb (GstElement * uribin, GstPad * pad, GstCaps * caps,
+    GstElement * element)
+{
+  gchar *str;
+
+  str = gst_caps_to_string (caps);
+  GST_ELEMENT_WARNING (element, STREAM, CODEC_NOT_FOUND,
+      ("Stream needs transcoding, not streaming it in passthrough mode"),
+      ("no payloader for caps %s", str));
+  g_free (str);
+}
+
 static void
 pad_added_cb (GstElement * uribin, GstPad * pad, GstElement * element)
 {
@@ -567,6 +732,8 @@ no_caps:
 no_factory:
   {
     GST_DEBUG ("no payloader found");
+    if (priv->passthrough)
+      unknown_type_cb (uribin, pad, caps, element);
     g_free (padname);
     gst_caps_unref (caps);
     gst_object_unref (pad);
@@ -631,6 +798,13 @@ rtsp_media_factory_uri_create_element (GstRTSPMediaFactory * factory,
   g_signal_connect (uribin, "no-more-pads", (GCallback) no_more_pads_cb,
       element);
 
+  if (priv->passthrough) {
+    g_signal_connect (uribin, "autoplug-select",
+        (GCallback) autoplug_select_cb, element);
+    g_signal_connect (uribin, "unknown-type", (GCallback) unknown_type_cb,
+        element);
+  }
+
   gst_bin_add (GST_BIN_CAST (element), uribin);
   gst_bin_add (GST_BIN_CAST (topbin), element);
 
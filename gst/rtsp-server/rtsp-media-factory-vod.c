@@ -0,0 +1,1084 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+/**
+ * SECTION:rtsp-media-factory-vod
+ * @short_description: A factory for indexed MP4 files
+ * @see_also: #GstRTSPMediaFactory, #GstRTSPMediaFactoryURI
+ *
+ * This specialized #GstRTSPMediaFactory serves the H.264, H.265 and AAC
+ * tracks of the MP4 file given with gst_rtsp_media_factory_vod_set_location()
+ * without a demuxer.
+ *
+ * The sample table of the file is read once into a compact index of offsets,
+ * sizes, timestamps and keyframe flags that is shared by all media of the
+ * file. Samples are pushed straight from the memory mapped file into the
+ * payloaders and a seek is a binary search in the keyframes of the index,
+ * which makes this factory a good fit for seek-heavy VOD.
+ *
+ * Edit lists and fragmented files are not supported.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <glib/gstdio.h>
+#include <gst/base/gstbytereader.h>
+#include <gst/app/gstappsrc.h>
+
+#include "rtsp-media-factory-vod.h"
+
+#define GST_RTSP_MEDIA_FACTORY_VOD_GET_PRIVATE(obj)  \
+    (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_RTSP_MEDIA_FACTORY_VOD, GstRTSPMediaFactoryVODPrivate))
+
+struct _GstRTSPMediaFactoryVODPrivate
+{
+  GMutex lock;
+  gchar *location;              /* protected by lock */
+};
+
+#define DEFAULT_LOCATION    NULL
+
+enum
+{
+  PROP_0,
+  PROP_LOCATION,
+  PROP_LAST
+};
+
+/* one entry of the sample table, timestamps are in the track timescale */
+typedef struct
+{
+  guint64 offset;
+  guint64 dts;
+  gint32 cts;
+  guint32 size;
+  guint32 duration:31;
+  guint32 keyframe:1;
+} VODSample;
+
+typedef struct
+{
+  guint32 id;
+  guint32 timescale;
+  guint64 duration;
+  GstCaps *caps;
+  const gchar *payloader;
+
+  VODSample *samples;
+  guint n_samples;
+  guint32 *keyframes;           /* sample numbers of the keyframes */
+  guint n_keyframes;
+} VODTrack;
+
+/* the index of a file, shared by all media of the file */
+typedef struct
+{
+  gint refcount;
+  gchar *location;
+  gint64 mtime;
+  gsize size;
+  GMappedFile *file;
+  GPtrArray *tracks;
+} VODIndex;
+
+/* state of one appsrc */
+typedef struct
+{
+  VODIndex *index;
+  VODTrack *track;
+  guint cursor;
+} VODStream;
+
+/* number of indexes we keep around */
+#define VOD_INDEX_MAX       64
+/* number of samples we push for each need-data */
+#define VOD_PUSH_SAMPLES    16
+
+static GMutex vod_lock;
+static GHashTable *vod_indexes; /* protected by vod_lock */
+
+GST_DEBUG_CATEGORY_STATIC (rtsp_media_factory_vod_debug);
+#define GST_CAT_DEFAULT rtsp_media_factory_vod_debug
+
+static void gst_rtsp_media_factory_vod_get_property (GObject * object,
+    guint propid, GValue * value, GParamSpec * pspec);
+static void gst_rtsp_media_factory_vod_set_property (GObject * object,
+    guint propid, const GValue * value, GParamSpec * pspec);
+static void gst_rtsp_media_factory_vod_finalize (GObject * obj);
+
+static GstElement *rtsp_media_factory_vod_create_element (GstRTSPMediaFactory *
+    factory, const GstRTSPUrl * url);
+
+G_DEFINE_TYPE (GstRTSPMediaFactoryVOD, gst_rtsp_media_factory_vod,
+    GST_TYPE_RTSP_MEDIA_FACTORY);
+
+static void
+gst_rtsp_media_factory_vod_class_init (GstRTSPMediaFactoryVODClass * klass)
+{
+  GObjectClass *gobject_class;
+  GstRTSPMediaFactoryClass *mediafactory_class;
+
+  g_type_class_add_private (klass, sizeof (GstRTSPMediaFactoryVODPrivate));
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  mediafactory_class = GST_RTSP_MEDIA_FACTORY_CLASS (klass);
+
+  gobject_class->get_property = gst_rtsp_media_factory_vod_get_property;
+  gobject_class->set_property = gst_rtsp_media_factory_vod_set_property;
+  gobject_class->finalize = gst_rtsp_media_factory_vod_finalize;
+
+  /**
+   * GstRTSPMediaFactoryVOD::location:
+   *
+   * The MP4 file that will be served by this factory.
+   */
+  g_object_class_install_property (gobject_class, PROP_LOCATION,
+      g_param_spec_string ("location", "Location",
+          "The MP4 file to stream", DEFAULT_LOCATION,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  mediafactory_class->create_element = rtsp_media_factory_vod_create_element;
+
+  GST_DEBUG_CATEGORY_INIT (rtsp_media_factory_vod_debug, "rtspmediafactoryvod",
+      0, "GstRTSPMediaFactoryVOD");
+}
+
+static void
+gst_rtsp_media_factory_vod_init (GstRTSPMediaFactoryVOD * factory)
+{
+  GstRTSPMediaFactoryVODPrivate *priv =
+      GST_RTSP_MEDIA_FACTORY_VOD_GET_PRIVATE (factory);
+
+  GST_DEBUG_OBJECT (factory, "new");
+
+  factory->priv = priv;
+
+  priv->location = g_strdup (DEFAULT_LOCATION);
+  g_mutex_init (&priv->lock);
+}
+
+static void
+gst_rtsp_media_factory_vod_finalize (GObject * obj)
+{
+  GstRTSPMediaFactoryVOD *factory = GST_RTSP_MEDIA_FACTORY_VOD (obj);
+  GstRTSPMediaFactoryVODPrivate *priv = factory->priv;
+
+  GST_DEBUG_OBJECT (factory, "finalize");
+
+  g_free (priv->location);
+  g_mutex_clear (&priv->lock);
+
+  G_OBJECT_CLASS (gst_rtsp_media_factory_vod_parent_class)->finalize (obj);
+}
+
+static void
+gst_rtsp_media_factory_vod_get_property (GObject * object, guint propid,
+    GValue * value, GParamSpec * pspec)
+{
+  GstRTSPMediaFactoryVOD *factory = GST_RTSP_MEDIA_FACTORY_VOD (object);
+
+  switch (propid) {
+    case PROP_LOCATION:
+      g_value_take_string (value,
+          gst_rtsp_media_factory_vod_get_location (factory));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+  }
+}
+
+static void
+gst_rtsp_media_factory_vod_set_property (GObject * object, guint propid,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstRTSPMediaFactoryVOD *factory = GST_RTSP_MEDIA_FACTORY_VOD (object);
+
+  switch (propid) {
+    case PROP_LOCATION:
+      gst_rtsp_media_factory_vod_set_location (factory,
+          g_value_get_string (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+  }
+}
+
+static void
+vod_track_free (VODTrack * track)
+{
+  if (track->caps)
+    gst_caps_unref (track->caps);
+  g_free (track->samples);
+  g_free (track->keyframes);
+  g_slice_free (VODTrack, track);
+}
+
+static VODIndex *
+vod_index_ref (VODIndex * index)
+{
+  g_atomic_int_inc (&index->refcount);
+  return index;
+}
+
+static void
+vod_index_unref (VODIndex * index)
+{
+  if (!g_atomic_int_dec_and_test (&index->refcount))
+    return;
+
+  GST_DEBUG ("free index of %s", index->location);
+
+  g_ptr_array_unref (index->tracks);
+  g_mapped_file_unref (index->file);
+  g_free (index->location);
+  g_slice_free (VODIndex, index);
+}
+
+/* read the next box of @reader and point @box to its contents */
+static gboolean
+next_box (GstByteReader * reader, guint32 * type, GstByteReader * box)
+{
+  const guint8 *data;
+  guint32 size32;
+  guint64 size;
+  guint header = 8;
+
+  if (!gst_byte_reader_get_uint32_be (reader, &size32) ||
+      !gst_byte_reader_get_uint32_le (reader, type))
+    return FALSE;
+
+  if (size32 == 1) {
+    if (!gst_byte_reader_get_uint64_be (reader, &size))
+      return FALSE;
+    header = 16;
+  } else if (size32 == 0) {
+    /* box extends to the end of the file */
+    size = header + gst_byte_reader_get_remaining (reader);
+  } else {
+    size = size32;
+  }
+  if (size < header || size - header > gst_byte_reader_get_remaining (reader))
+    return FALSE;
+
+  if (!gst_byte_reader_get_data (reader, size - header, &data))
+    return FALSE;
+  gst_byte_reader_init (box, data, size - header);
+
+  return TRUE;
+}
+
+static gboolean
+find_box (const GstByteReader * reader, guint32 type, GstByteReader * box)
+{
+  GstByteReader r = *reader;
+  guint32 t;
+
+  while (next_box (&r, &t, box)) {
+    if (t == type)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+/* skip the version and flags of a full box */
+static gboolean
+skip_full_box (GstByteReader * reader, guint8 * version)
+{
+  guint8 v;
+
+  if (!gst_byte_reader_get_uint8 (reader, &v) ||
+      !gst_byte_reader_skip (reader, 3))
+    return FALSE;
+  if (version)
+    *version = v;
+  return TRUE;
+}
+
+static gboolean
+read_descriptor (GstByteReader * reader, guint8 * tag, GstByteReader * desc)
+{
+  const guint8 *data;
+  guint len = 0, i;
+  guint8 b;
+
+  if (!gst_byte_reader_get_uint8 (reader, tag))
+    return FALSE;
+  for (i = 0; i < 4; i++) {
+    if (!gst_byte_reader_get_uint8 (reader, &b))
+      return FALSE;
+    len = (len << 7) | (b & 0x7f);
+    if (!(b & 0x80))
+      break;
+  }
+  if (!gst_byte_reader_get_data (reader, len, &data))
+    return FALSE;
+  gst_byte_reader_init (desc, data, len);
+
+  return TRUE;
+}
+
+/* find the decoder specific info in an esds box */
+static gboolean
+parse_esds (GstByteReader * esds, GstByteReader * dsi)
+{
+  GstByteReader es, dec;
+  guint8 tag, flags, len;
+
+  if (!skip_full_box (esds, NULL) ||
+      !read_descriptor (esds, &tag, &es) || tag != 0x03)
+    return FALSE;
+
+  /* ES_ID and the optional fields of the ES descriptor */
+  if (!gst_byte_reader_skip (&es, 2) ||
+      !gst_byte_reader_get_uint8 (&es, &flags))
+    return FALSE;
+  if ((flags & 0x80) && !gst_byte_reader_skip (&es, 2))
+    return FALSE;
+  if ((flags & 0x40) && (!gst_byte_reader_get_uint8 (&es, &len) ||
+          !gst_byte_reader_skip (&es, len)))
+    return FALSE;
+  if ((flags & 0x20) && !gst_byte_reader_skip (&es, 2))
+    return FALSE;
+
+  /* decoder config, we skip the object type, stream type and bitrates */
+  if (!read_descriptor (&es, &tag, &dec) || tag != 0x04 ||
+      !gst_byte_reader_skip (&dec, 13))
+    return FALSE;
+
+  return read_descriptor (&dec, &tag, dsi) && tag == 0x05;
+}
+
+static GstBuffer *
+make_codec_data (GstByteReader * reader)
+{
+  const guint8 *data;
+  guint size;
+
+  size = gst_byte_reader_get_remaining (reader);
+  if (size == 0 || !gst_byte_reader_get_data (reader, size, &data))
+    return NULL;
+
+  return gst_buffer_new_wrapped (g_memdup (data, size), size);
+}
+
+/* make caps and pick a payloader for the first sample description */
+static gboolean
+parse_sample_entry (VODTrack * track, GstByteReader * stsd)
+{
+  GstByteReader entry, config, esds;
+  GstBuffer *codec_data;
+  guint32 count, type;
+
+  if (!skip_full_box (stsd, NULL) ||
+      !gst_byte_reader_get_uint32_be (stsd, &count) || count == 0 ||
+      !next_box (stsd, &type, &entry))
+    return FALSE;
+
+  /* reserved and data reference index */
+  if (!gst_byte_reader_skip (&entry, 8))
+    return FALSE;
+
+  switch (type) {
+    case GST_MAKE_FOURCC ('a', 'v', 'c', '1'):
+    case GST_MAKE_FOURCC ('a', 'v', 'c', '3'):
+    case GST_MAKE_FOURCC ('h', 'v', 'c', '1'):
+    case GST_MAKE_FOURCC ('h', 'e', 'v', '1'):
+    {
+      gboolean h264;
+      guint16 width, height;
+
+      h264 = type == GST_MAKE_FOURCC ('a', 'v', 'c', '1') ||
+          type == GST_MAKE_FOURCC ('a', 'v', 'c', '3');
+
+      if (!gst_byte_reader_skip (&entry, 16) ||
+          !gst_byte_reader_get_uint16_be (&entry, &width) ||
+          !gst_byte_reader_get_uint16_be (&entry, &height) ||
+          !gst_byte_reader_skip (&entry, 50))
+        return FALSE;
+
+      if (!find_box (&entry, h264 ? GST_MAKE_FOURCC ('a', 'v', 'c', 'C') :
+              GST_MAKE_FOURCC ('h', 'v', 'c', 'C'), &config))
+        return FALSE;
+      if (!(codec_data = make_codec_data (&config)))
+        return FALSE;
+
+      if (h264) {
+        track->caps = gst_caps_new_simple ("video/x-h264",
+            "stream-format", G_TYPE_STRING, "avc",
+            "alignment", G_TYPE_STRING, "au", NULL);
+        track->payloader = "rtph264pay";
+      } else {
+        track->caps = gst_caps_new_simple ("video/x-h265",
+            "stream-format", G_TYPE_STRING,
+            type == GST_MAKE_FOURCC ('h', 'v', 'c', '1') ? "hvc1" : "hev1",
+            "alignment", G_TYPE_STRING, "au", NULL);
+        track->payloader = "rtph265pay";
+      }
+      gst_caps_set_simple (track->caps, "width", G_TYPE_INT, (gint) width,
+          "height", G_TYPE_INT, (gint) height,
+          "codec_data", GST_TYPE_BUFFER, codec_data, NULL);
+      gst_buffer_unref (codec_data);
+      break;
+    }
+    case GST_MAKE_FOURCC ('m', 'p', '4', 'a'):
+    {
+      guint16 version, channels;
+      guint32 rate;
+
+      if (!gst_byte_reader_get_uint16_be (&entry, &version) ||
+          !gst_byte_reader_skip (&entry, 6) ||
+          !gst_byte_reader_get_uint16_be (&entry, &channels) ||
+          !gst_byte_reader_skip (&entry, 6) ||
+          !gst_byte_reader_get_uint32_be (&entry, &rate))
+        return FALSE;
+      /* QuickTime sound description version 1 has 16 more bytes */
+      if (version == 1 && !gst_byte_reader_skip (&entry, 16))
+        return FALSE;
+
+      if (!find_box (&entry, GST_MAKE_FOURCC ('e', 's', 'd', 's'), &esds) ||
+          !parse_esds (&esds, &config))
+        return FALSE;
+      if (!(codec_data = make_codec_data (&config)))
+        return FALSE;
+
+      track->caps = gst_caps_new_simple ("audio/mpeg",
+          "mpegversion", G_TYPE_INT, 4,
+          "stream-format", G_TYPE_STRING, "raw",
+          "rate", G_TYPE_INT, (gint) (rate >> 16),
+          "channels", G_TYPE_INT, (gint) channels,
+          "codec_data", GST_TYPE_BUFFER, codec_data, NULL);
+      track->payloader = "rtpmp4gpay";
+      gst_buffer_unref (codec_data);
+      break;
+    }
+    default:
+      GST_DEBUG ("unsupported sample entry %" GST_FOURCC_FORMAT,
+          GST_FOURCC_ARGS (type));
+      return FALSE;
+  }
+  return TRUE;
+}
+
+/* build the sample table of @track from the boxes in @stbl */
+static gboolean
+parse_sample_table (VODTrack * track, GstByteReader * stbl, gsize file_size)
+{
+  GstByteReader stsz, stsc, stco, stts, ctts, stss;
+  gboolean co64;
+  guint32 sample_size, n, n_entries, n_chunks, chunk, per_chunk = 0;
+  guint32 next_first, e, i, s;
+  guint64 dts;
+
+  if (!find_box (stbl, GST_MAKE_FOURCC ('s', 't', 's', 'z'), &stsz) ||
+      !find_box (stbl, GST_MAKE_FOURCC ('s', 't', 's', 'c'), &stsc) ||
+      !find_box (stbl, GST_MAKE_FOURCC ('s', 't', 't', 's'), &stts))
+    return FALSE;
+
+  if (find_box (stbl, GST_MAKE_FOURCC ('s', 't', 'c', 'o'), &stco))
+    co64 = FALSE;
+  else if (find_box (stbl, GST_MAKE_FOURCC ('c', 'o', '6', '4'), &stco))
+    co64 = TRUE;
+  else
+    return FALSE;
+
+  /* sample sizes */
+  if (!skip_full_box (&stsz, NULL) ||
+      !gst_byte_reader_get_uint32_be (&stsz, &sample_size) ||
+      !gst_byte_reader_get_uint32_be (&stsz, &n) || n == 0)
+    return FALSE;
+  if (sample_size == 0 && gst_byte_reader_get_remaining (&stsz) / 4 < n)
+    return FALSE;
+  if (sample_size != 0 && n > file_size / sample_size)
+    return FALSE;
+
+  track->samples = g_new0 (VODSample, n);
+  track->n_samples = n;
+  for (s = 0; s < n; s++) {
+    track->samples[s].size = sample_size ? sample_size :
+        gst_byte_reader_get_uint32_be_unchecked (&stsz);
+  }
+
+  /* offsets, from the chunk offsets and the samples per chunk */
+  if (!skip_full_box (&stco, NULL) ||
+      !gst_byte_reader_get_uint32_be (&stco, &n_chunks) ||
+      gst_byte_reader_get_remaining (&stco) / (co64 ? 8 : 4) < n_chunks)
+    return FALSE;
+  if (!skip_full_box (&stsc, NULL) ||
+      !gst_byte_reader_get_uint32_be (&stsc, &n_entries) || n_entries == 0 ||
+      gst_byte_reader_get_remaining (&stsc) / 12 < n_entries)
+    return FALSE;
+
+  s = 0;
+  e = 0;
+  next_first = gst_byte_reader_get_uint32_be_unchecked (&stsc);
+  for (chunk = 1; chunk <= n_chunks && s < n; chunk++) {
+    guint64 offset;
+
+    while (e < n_entries && chunk >= next_first) {
+      per_chunk = gst_byte_reader_get_uint32_be_unchecked (&stsc);
+      gst_byte_reader_skip_unchecked (&stsc, 4);
+      e++;
+      next_first = e < n_entries ?
+          gst_byte_reader_get_uint32_be_unchecked (&stsc) : G_MAXUINT32;
+    }
+
+    if (co64)
+      offset = gst_byte_reader_get_uint64_be_unchecked (&stco);
+    else
+      offset = gst_byte_reader_get_uint32_be_unchecked (&stco);
+
+    for (i = 0; i < per_chunk && s < n; i++, s++) {
+      VODSample *sample = &track->samples[s];
+
+      if (offset > file_size || sample->size > file_size - offset)
+        return FALSE;
+      sample->offset = offset;
+      offset += sample->size;
+    }
+  }
+  if (s < n)
+    return FALSE;
+
+  /* decoding timestamps and durations */
+  if (!skip_full_box (&stts, NULL) ||
+      !gst_byte_reader_get_uint32_be (&stts, &n_entries) ||
+      gst_byte_reader_get_remaining (&stts) / 8 < n_entries)
+    return FALSE;
+
+  s = 0;
+  dts = 0;
+  for (e = 0; e < n_entries && s < n; e++) {
+    guint32 count, delta;
+
+    count = gst_byte_reader_get_uint32_be_unchecked (&stts);
+    delta = gst_byte_reader_get_uint32_be_unchecked (&stts);
+    for (i = 0; i < count && s < n; i++, s++) {
+      track->samples[s].dts = dts;
+      track->samples[s].duration = delta & 0x7fffffff;
+      dts += delta;
+    }
+  }
+  for (; s < n; s++)
+    track->samples[s].dts = dts;
+
+  if (track->duration == 0)
+    track->duration = dts;
+
+  /* composition offsets */
+  if (find_box (stbl, GST_MAKE_FOURCC ('c', 't', 't', 's'), &ctts) &&
+      skip_full_box (&ctts, NULL) &&
+      gst_byte_reader_get_uint32_be (&ctts, &n_entries) &&
+      gst_byte_reader_get_remaining (&ctts) / 8 >= n_entries) {
+    s = 0;
+    for (e = 0; e < n_entries && s < n; e++) {
+      guint32 count;
+      gint32 cts;
+
+      count = gst_byte_reader_get_uint32_be_unchecked (&ctts);
+      cts = (gint32) gst_byte_reader_get_uint32_be_unchecked (&ctts);
+      for (i = 0; i < count && s < n; i++, s++)
+        track->samples[s].cts = cts;
+    }
+  }
+
+  /* keyframes, all samples are keyframes without stss */
+  if (find_box (stbl, GST_MAKE_FOURCC ('s', 't', 's', 's'), &stss) &&
+      skip_full_box (&stss, NULL) &&
+      gst_byte_reader_get_uint32_be (&stss, &n_entries) &&
+      gst_byte_reader_get_remaining (&stss) / 4 >= n_entries) {
+    track->keyframes = g_new (guint32, MAX (n_entries, 1));
+    for (e = 0; e < n_entries; e++) {
+      guint32 num = gst_byte_reader_get_uint32_be_unchecked (&stss);
+
+      /* keep the table sorted for the binary search */
+      if (num == 0 || num > n || (track->n_keyframes > 0 &&
+              num - 1 <= track->keyframes[track->n_keyframes - 1]))
+        continue;
+      track->samples[num - 1].keyframe = 1;
+      track->keyframes[track->n_keyframes++] = num - 1;
+    }
+    if (track->n_keyframes == 0) {
+      /* always be able to seek to the start */
+      track->keyframes[0] = 0;
+      track->n_keyframes = 1;
+    }
+  } else {
+    track->keyframes = g_new (guint32, n);
+    for (s = 0; s < n; s++) {
+      track->samples[s].keyframe = 1;
+      track->keyframes[s] = s;
+    }
+    track->n_keyframes = n;
+  }
+
+  return TRUE;
+}
+
+static VODTrack *
+parse_track (GstByteReader * trak, gsize file_size)
+{
+  GstByteReader tkhd, mdia, mdhd, minf, stbl, stsd;
+  VODTrack *track;
+  guint8 version;
+
+  if (!find_box (trak, GST_MAKE_FOURCC ('t', 'k', 'h', 'd'), &tkhd) ||
+      !find_box (trak, GST_MAKE_FOURCC ('m', 'd', 'i', 'a'), &mdia) ||
+      !find_box (&mdia, GST_MAKE_FOURCC ('m', 'd', 'h', 'd'), &mdhd) ||
+      !find_box (&mdia, GST_MAKE_FOURCC ('m', 'i', 'n', 'f'), &minf) ||
+      !find_box (&minf, GST_MAKE_FOURCC ('s', 't', 'b', 'l'), &stbl) ||
+      !find_box (&stbl, GST_MAKE_FOURCC ('s', 't', 's', 'd'), &stsd))
+    return NULL;
+
+  track = g_slice_new0 (VODTrack);
+
+  /* track id, after the creation and modification times */
+  if (!skip_full_box (&tkhd, &version) ||
+      !gst_byte_reader_skip (&tkhd, version == 1 ? 16 : 8) ||
+      !gst_byte_reader_get_uint32_be (&tkhd, &track->id))
+    goto invalid;
+
+  /* timescale and duration */
+  if (!skip_full_box (&mdhd, &version) ||
+      !gst_byte_reader_skip (&mdhd, version == 1 ? 16 : 8) ||
+      !gst_byte_reader_get_uint32_be (&mdhd, &track->timescale) ||
+      track->timescale == 0)
+    goto invalid;
+  if (version == 1) {
+    if (!gst_byte_reader_get_uint64_be (&mdhd, &track->duration) ||
+        track->duration == G_MAXUINT64)
+      track->duration = 0;
+  } else {
+    guint32 duration;
+
+    if (gst_byte_reader_get_uint32_be (&mdhd, &duration) &&
+        duration != G_MAXUINT32)
+      track->duration = duration;
+  }
+
+  if (!parse_sample_entry (track, &stsd))
+    goto unsupported;
+  if (!parse_sample_table (track, &stbl, file_size))
+    goto invalid;
+
+  GST_DEBUG ("track %u: %u samples, %u keyframes, %" GST_PTR_FORMAT,
+      track->id, track->n_samples, track->n_keyframes, track->caps);
+
+  return track;
+
+  /* ERRORS */
+invalid:
+  {
+    GST_WARNING ("invalid track %u", track->id);
+    vod_track_free (track);
+    return NULL;
+  }
+unsupported:
+  {
+    GST_INFO ("ignoring unsupported track %u", track->id);
+    vod_track_free (track);
+    return NULL;
+  }
+}
+
+static VODIndex *
+vod_index_new (const gchar * location)
+{
+  GstByteReader reader, moov, trak;
+  GMappedFile *file;
+  GError *error = NULL;
+  VODIndex *index;
+  guint32 type;
+
+  file = g_mapped_file_new (location, FALSE, &error);
+  if (file == NULL)
+    goto map_failed;
+
+  index = g_slice_new0 (VODIndex);
+  index->refcount = 1;
+  index->location = g_strdup (location);
+  index->file = file;
+  index->size = g_mapped_file_get_length (file);
+  index->tracks =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) vod_track_free);
+
+  gst_byte_reader_init (&reader,
+      (const guint8 *) g_mapped_file_get_contents (file), index->size);
+  if (!find_box (&reader, GST_MAKE_FOURCC ('m', 'o', 'o', 'v'), &moov))
+    goto no_moov;
+
+  while (next_box (&moov, &type, &trak)) {
+    VODTrack *track;
+
+    if (type != GST_MAKE_FOURCC ('t', 'r', 'a', 'k'))
+      continue;
+    if ((track = parse_track (&trak, index->size)))
+      g_ptr_array_add (index->tracks, track);
+  }
+  if (index->tracks->len == 0)
+    goto no_tracks;
+
+  GST_INFO ("indexed %u tracks of %s", index->tracks->len, location);
+
+  return index;
+
+  /* ERRORS */
+map_failed:
+  {
+    GST_WARNING ("failed to map %s: %s", location, error->message);
+    g_error_free (error);
+    return NULL;
+  }
+no_moov:
+  {
+    GST_WARNING ("no moov box in %s", location);
+    vod_index_unref (index);
+    return NULL;
+  }
+no_tracks:
+  {
+    GST_WARNING ("no supported tracks in %s", location);
+    vod_index_unref (index);
+    return NULL;
+  }
+}
+
+/* get the index of @location, the cached one is used when the file did not
+ * change since it was indexed */
+static VODIndex *
+vod_index_get (const gchar * location)
+{
+  GStatBuf st;
+  VODIndex *index;
+
+  if (g_stat (location, &st) < 0)
+    goto stat_failed;
+
+  g_mutex_lock (&vod_lock);
+  if (vod_indexes == NULL)
+    vod_indexes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+        (GDestroyNotify) vod_index_unref);
+
+  index = g_hash_table_lookup (vod_indexes, location);
+  if (index && (index->mtime != (gint64) st.st_mtime ||
+          index->size != (gsize) st.st_size)) {
+    GST_DEBUG ("%s changed, reindexing", location);
+    g_hash_table_remove (vod_indexes, location);
+    index = NULL;
+  }
+  if (index == NULL && (index = vod_index_new (location))) {
+    index->mtime = st.st_mtime;
+    if (g_hash_table_size (vod_indexes) >= VOD_INDEX_MAX)
+      g_hash_table_remove_all (vod_indexes);
+    g_hash_table_insert (vod_indexes, index->location, index);
+  }
+  if (index)
+    vod_index_ref (index);
+  g_mutex_unlock (&vod_lock);
+
+  return index;
+
+  /* ERRORS */
+stat_failed:
+  {
+    GST_WARNING ("can't stat %s: %s", location, g_strerror (errno));
+    return NULL;
+  }
+}
+
+static void
+vod_stream_free (VODStream * stream)
+{
+  vod_index_unref (stream->index);
+  g_slice_free (VODStream, stream);
+}
+
+static void
+vod_stream_need_data (GstAppSrc * src, guint length, gpointer user_data)
+{
+  VODStream *stream = user_data;
+  VODTrack *track = stream->track;
+  const guint8 *data;
+  guint i;
+
+  data = (const guint8 *) g_mapped_file_get_contents (stream->index->file);
+
+  for (i = 0; i < VOD_PUSH_SAMPLES; i++) {
+    VODSample *sample;
+    GstBuffer *buffer;
+    gint64 pts;
+
+    if (stream->cursor >= track->n_samples) {
+      GST_DEBUG ("track %u done", track->id);
+      gst_app_src_end_of_stream (src);
+      return;
+    }
+    sample = &track->samples[stream->cursor++];
+    if (sample->size == 0)
+      continue;
+
+    /* the buffer points into the mapped file and keeps the index alive */
+    buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+        (gpointer) (data + sample->offset), sample->size, 0, sample->size,
+        vod_index_ref (stream->index), (GDestroyNotify) vod_index_unref);
+
+    pts = (gint64) sample->dts + sample->cts;
+    GST_BUFFER_DTS (buffer) = gst_util_uint64_scale (sample->dts, GST_SECOND,
+        track->timescale);
+    GST_BUFFER_PTS (buffer) = pts > 0 ?
+        gst_util_uint64_scale (pts, GST_SECOND, track->timescale) : 0;
+    GST_BUFFER_DURATION (buffer) = gst_util_uint64_scale (sample->duration,
+        GST_SECOND, track->timescale);
+    if (!sample->keyframe)
+      GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+    if (gst_app_src_push_buffer (src, buffer) != GST_FLOW_OK)
+      return;
+  }
+}
+
+static gboolean
+vod_stream_seek_data (GstAppSrc * src, guint64 offset, gpointer user_data)
+{
+  VODStream *stream = user_data;
+  VODTrack *track = stream->track;
+  guint64 ts;
+  guint lo, hi;
+
+  ts = gst_util_uint64_scale (offset, track->timescale, GST_SECOND);
+
+  /* last keyframe at or before the seek position */
+  lo = 0;
+  hi = track->n_keyframes;
+  while (hi - lo > 1) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (track->samples[track->keyframes[mid]].dts <= ts)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  stream->cursor = track->keyframes[lo];
+
+  GST_DEBUG ("track %u seek to %" GST_TIME_FORMAT ", sample %u", track->id,
+      GST_TIME_ARGS (offset), stream->cursor);
+
+  return TRUE;
+}
+
+static GstAppSrcCallbacks vod_stream_callbacks = {
+  vod_stream_need_data,
+  NULL,
+  vod_stream_seek_data
+};
+
+/**
+ * gst_rtsp_media_factory_vod_new:
+ *
+ * Create a new #GstRTSPMediaFactoryVOD instance.
+ *
+ * Returns: a new #GstRTSPMediaFactoryVOD object.
+ */
+GstRTSPMediaFactoryVOD *
+gst_rtsp_media_factory_vod_new (void)
+{
+  GstRTSPMediaFactoryVOD *result;
+
+  result = g_object_new (GST_TYPE_RTSP_MEDIA_FACTORY_VOD, NULL);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_media_factory_vod_set_location:
+ * @factory: a #GstRTSPMediaFactoryVOD
+ * @location: the MP4 file to stream
+ *
+ * Set the MP4 file that will be streamed by this factory.
+ */
+void
+gst_rtsp_media_factory_vod_set_location (GstRTSPMediaFactoryVOD * factory,
+    const gchar * location)
+{
+  GstRTSPMediaFactoryVODPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY_VOD (factory));
+  g_return_if_fail (location != NULL);
+
+  priv = factory->priv;
+
+  g_mutex_lock (&priv->lock);
+  g_free (priv->location);
+  priv->location = g_strdup (location);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_media_factory_vod_get_location:
+ * @factory: a #GstRTSPMediaFactoryVOD
+ *
+ * Get the MP4 file that will be streamed by this factory.
+ *
+ * Returns: the configured location. g_free() after usage.
+ */
+gchar *
+gst_rtsp_media_factory_vod_get_location (GstRTSPMediaFactoryVOD * factory)
+{
+  GstRTSPMediaFactoryVODPrivate *priv;
+  gchar *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY_VOD (factory), NULL);
+
+  priv = factory->priv;
+
+  g_mutex_lock (&priv->lock);
+  result = g_strdup (priv->location);
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_media_factory_vod_preload:
+ * @factory: a #GstRTSPMediaFactoryVOD
+ *
+ * Index the file of @factory now instead of when the first media is
+ * constructed. The index is shared with all factories of the same file and
+ * rebuilt when the file changes.
+ *
+ * Returns: %TRUE when the file has tracks that can be streamed.
+ */
+gboolean
+gst_rtsp_media_factory_vod_preload (GstRTSPMediaFactoryVOD * factory)
+{
+  VODIndex *index;
+  gchar *location;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY_VOD (factory), FALSE);
+
+  location = gst_rtsp_media_factory_vod_get_location (factory);
+  if (location == NULL)
+    return FALSE;
+
+  index = vod_index_get (location);
+  g_free (location);
+
+  if (index == NULL)
+    return FALSE;
+
+  vod_index_unref (index);
+
+  return TRUE;
+}
+
+static GstElement *
+rtsp_media_factory_vod_create_element (GstRTSPMediaFactory * factory,
+    const GstRTSPUrl * url)
+{
+  GstRTSPMediaFactoryVOD *vodfact;
+  GstElement *topbin;
+  VODIndex *index;
+  gchar *location;
+  guint i, n_pay = 0;
+
+  vodfact = GST_RTSP_MEDIA_FACTORY_VOD_CAST (factory);
+
+  location = gst_rtsp_media_factory_vod_get_location (vodfact);
+  if (location == NULL)
+    goto no_location;
+
+  index = vod_index_get (location);
+  g_free (location);
+  if (index == NULL)
+    goto no_index;
+
+  GST_LOG ("creating element");
+
+  topbin = gst_bin_new ("GstRTSPMediaFactoryVOD");
+  g_assert (topbin != NULL);
+
+  for (i = 0; i < index->tracks->len; i++) {
+    VODTrack *track = g_ptr_array_index (index->tracks, i);
+    GstElement *src, *pay;
+    VODStream *stream;
+    gchar *name;
+
+    name = g_strdup_printf ("pay%u", n_pay);
+    pay = gst_element_factory_make (track->payloader, name);
+    g_free (name);
+    if (pay == NULL) {
+      GST_WARNING ("no %s for track %u", track->payloader, track->id);
+      continue;
+    }
+
+    src = gst_element_factory_make ("appsrc", NULL);
+    if (src == NULL) {
+      gst_object_unref (pay);
+      goto no_appsrc;
+    }
+
+    g_object_set (pay, "pt", 96 + n_pay, NULL);
+    g_object_set (src, "format", GST_FORMAT_TIME, NULL);
+    gst_app_src_set_stream_type (GST_APP_SRC_CAST (src),
+        GST_APP_STREAM_TYPE_SEEKABLE);
+    gst_app_src_set_caps (GST_APP_SRC_CAST (src), track->caps);
+    gst_app_src_set_duration (GST_APP_SRC_CAST (src),
+        gst_util_uint64_scale (track->duration, GST_SECOND, track->timescale));
+
+    stream = g_slice_new0 (VODStream);
+    stream->index = vod_index_ref (index);
+    stream->track = track;
+    gst_app_src_set_callbacks (GST_APP_SRC_CAST (src), &vod_stream_callbacks,
+        stream, (GDestroyNotify) vod_stream_free);
+
+    gst_bin_add_many (GST_BIN_CAST (topbin), src, pay, NULL);
+    gst_element_link (src, pay);
+    n_pay++;
+  }
+  vod_index_unref (index);
+
+  if (n_pay == 0)
+    goto no_streams;
+
+  return topbin;
+
+  /* ERRORS */
+no_location:
+  {
+    GST_ERROR ("no location configured");
+    return NULL;
+  }
+no_index:
+  {
+    GST_ERROR ("failed to index file");
+    return NULL;
+  }
+no_appsrc:
+  {
+    g_critical ("can't create appsrc element");
+    vod_index_unref (index);
+    gst_object_unref (topbin);
+    return NULL;
+  }
+no_streams:
+  {
+    GST_ERROR ("no payloaders for the tracks of the file");
+    gst_object_unref (topbin);
+    return NULL;
+  }
+}
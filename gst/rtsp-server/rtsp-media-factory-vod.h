@@ -0,0 +1,82 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/gst.h>
+
+#include "rtsp-media-factory.h"
+
+#ifndef __GST_RTSP_MEDIA_FACTORY_VOD_H__
+#define __GST_RTSP_MEDIA_FACTORY_VOD_H__
+
+G_BEGIN_DECLS
+
+/* types for the media factory */
+#define GST_TYPE_RTSP_MEDIA_FACTORY_VOD              (gst_rtsp_media_factory_vod_get_type ())
+#define GST_IS_RTSP_MEDIA_FACTORY_VOD(obj)           (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_RTSP_MEDIA_FACTORY_VOD))
+#define GST_IS_RTSP_MEDIA_FACTORY_VOD_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_RTSP_MEDIA_FACTORY_VOD))
+#define GST_RTSP_MEDIA_FACTORY_VOD_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_RTSP_MEDIA_FACTORY_VOD, GstRTSPMediaFactoryVODClass))
+#define GST_RTSP_MEDIA_FACTORY_VOD(obj)              (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_RTSP_MEDIA_FACTORY_VOD, GstRTSPMediaFactoryVOD))
+#define GST_RTSP_MEDIA_FACTORY_VOD_CLASS(klass)      (G_TYPE_CHECK_CLASS_CAST ((klass), GST_TYPE_RTSP_MEDIA_FACTORY_VOD, GstRTSPMediaFactoryVODClass))
+#define GST_RTSP_MEDIA_FACTORY_VOD_CAST(obj)         ((GstRTSPMediaFactoryVOD*)(obj))
+#define GST_RTSP_MEDIA_FACTORY_VOD_CLASS_CAST(klass) ((GstRTSPMediaFactoryVODClass*)(klass))
+
+typedef struct _GstRTSPMediaFactoryVOD GstRTSPMediaFactoryVOD;
+typedef struct _GstRTSPMediaFactoryVODClass GstRTSPMediaFactoryVODClass;
+typedef struct _GstRTSPMediaFactoryVODPrivate GstRTSPMediaFactoryVODPrivate;
+
+/**
+ * GstRTSPMediaFactoryVOD:
+ *
+ * A media factory that serves an indexed MP4 file.
+ */
+struct _GstRTSPMediaFactoryVOD {
+  GstRTSPMediaFactory   parent;
+
+  /*< private >*/
+  GstRTSPMediaFactoryVODPrivate *priv;
+  gpointer _gst_reserved[GST_PADDING];
+};
+
+/**
+ * GstRTSPMediaFactoryVODClass:
+ *
+ * The #GstRTSPMediaFactoryVOD class structure.
+ */
+struct _GstRTSPMediaFactoryVODClass {
+  GstRTSPMediaFactoryClass  parent_class;
+
+  /*< private >*/
+  gpointer _gst_reserved[GST_PADDING];
+};
+
+GType                 gst_rtsp_media_factory_vod_get_type   (void);
+
+/* creating the factory */
+GstRTSPMediaFactoryVOD * gst_rtsp_media_factory_vod_new     (void);
+
+/* configuring the factory */
+void                  gst_rtsp_media_factory_vod_set_location  (GstRTSPMediaFactoryVOD *factory,
+                                                                const gchar *location);
+gchar *               gst_rtsp_media_factory_vod_get_location  (GstRTSPMediaFactoryVOD *factory);
+
+gboolean              gst_rtsp_media_factory_vod_preload       (GstRTSPMediaFactoryVOD *factory);
+
+G_END_DECLS
+
+#endif /* __GST_RTSP_MEDIA_FACTORY_VOD_H__ */
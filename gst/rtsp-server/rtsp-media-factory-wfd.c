@@ -28,15 +28,16 @@
  * containing a pipeline created from a launch description set with
  * gst_rtsp_media_factory_wfd_set_launch().
  *
- * Media from a factory can be shared by setting the shared flag with
- * gst_rtsp_media_factory_wfd_set_shared(). When a factory is shared,
- * gst_rtsp_media_factory_wfd_construct() will return the same #GstRTSPMedia when
- * the url matches.
+ * Media from a factory is shared between the sinks that negotiated the same
+ * audio and video format, so that the media is encoded once for every
+ * distinct format. A capsfilter named "wfdvideocaps" in the launch line is
+ * configured with the resolution and framerate negotiated with the sink.
  *
  * Last reviewed on 2013-07-11 (1.0.0)
  */
 
 #include "rtsp-media-factory-wfd.h"
+#include "rtsp-client-wfd.h"
 
 #define GST_RTSP_MEDIA_FACTORY_WFD_GET_PRIVATE(obj)  \
        (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_RTSP_MEDIA_FACTORY_WFD, GstRTSPMediaFactoryWFDPrivate))
@@ -55,6 +56,7 @@ struct _GstRTSPMediaFactoryWFDPrivate
   gboolean eos_shutdown;
   GstRTSPLowerTrans protocols;
   guint buffer_size;
+  gboolean low_latency;
   GstRTSPAddressPool *pool;
 
   GMutex medias_lock;
@@ -68,6 +70,11 @@ struct _GstRTSPMediaFactoryWFDPrivate
 #define DEFAULT_PROTOCOLS       GST_RTSP_LOWER_TRANS_UDP | GST_RTSP_LOWER_TRANS_UDP_MCAST | \
                                         GST_RTSP_LOWER_TRANS_TCP
 #define DEFAULT_BUFFER_SIZE     0x80000
+#define DEFAULT_LOW_LATENCY     TRUE
+
+/* name of the optional capsfilter in the launch line that is configured with
+ * the resolution negotiated with the sink */
+#define WFD_VIDEO_CAPS_NAME     "wfdvideocaps"
 
 enum
 {
@@ -78,6 +85,7 @@ enum
   PROP_EOS_SHUTDOWN,
   PROP_PROTOCOLS,
   PROP_BUFFER_SIZE,
+  PROP_LOW_LATENCY,
   PROP_LAST
 };
 
@@ -98,21 +106,34 @@ static void gst_rtsp_media_factory_wfd_set_property (GObject * object, guint pro
 
 static void gst_rtsp_media_factory_wfd_finalize (GObject * obj);
 
+static gchar *wfd_gen_key (GstRTSPMediaFactory * factory,
+    const GstRTSPUrl * url);
+static void wfd_configure (GstRTSPMediaFactory * factory, GstRTSPMedia * media);
+
 G_DEFINE_TYPE (GstRTSPMediaFactoryWFD, gst_rtsp_media_factory_wfd, GST_TYPE_RTSP_MEDIA_FACTORY);
 
 static void
 gst_rtsp_media_factory_wfd_class_init (GstRTSPMediaFactoryWFDClass * klass)
 {
   GObjectClass *gobject_class;
+  GstRTSPMediaFactoryClass *factory_class;
 
   g_type_class_add_private (klass, sizeof (GstRTSPMediaFactoryWFDPrivate));
 
   gobject_class = G_OBJECT_CLASS (klass);
+  factory_class = GST_RTSP_MEDIA_FACTORY_CLASS (klass);
 
   gobject_class->get_property = gst_rtsp_media_factory_wfd_get_property;
   gobject_class->set_property = gst_rtsp_media_factory_wfd_set_property;
   gobject_class->finalize = gst_rtsp_media_factory_wfd_finalize;
 
+  g_object_class_install_property (gobject_class, PROP_LOW_LATENCY,
+      g_param_spec_boolean ("low-latency", "Low Latency",
+          "Configure the media for low-latency streaming",
+          DEFAULT_LOW_LATENCY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  factory_class->gen_key = wfd_gen_key;
+  factory_class->configure = wfd_configure;
 
   //klass->gen_key = default_gen_key;
   //klass->create_element = default_create_element;
@@ -137,6 +158,11 @@ gst_rtsp_media_factory_wfd_init (GstRTSPMediaFactoryWFD * factory)
   priv->eos_shutdown = DEFAULT_EOS_SHUTDOWN;
   priv->protocols = DEFAULT_PROTOCOLS;
   priv->buffer_size = DEFAULT_BUFFER_SIZE;
+  priv->low_latency = DEFAULT_LOW_LATENCY;
+
+  /* sinks that negotiated the same format share one media, see
+   * wfd_gen_key() */
+  gst_rtsp_media_factory_set_shared (GST_RTSP_MEDIA_FACTORY (factory), TRUE);
 
   g_mutex_init (&priv->lock);
   g_mutex_init (&priv->medias_lock);
@@ -176,9 +202,13 @@ static void
 gst_rtsp_media_factory_wfd_get_property (GObject * object,
              guint propid, GValue * value, GParamSpec * pspec)
 {
-  //GstRTSPMediaFactoryWFD *factory = GST_RTSP_MEDIA_FACTORY_WFD (object);
+  GstRTSPMediaFactoryWFD *factory = GST_RTSP_MEDIA_FACTORY_WFD (object);
 
   switch (propid) {
+    case PROP_LOW_LATENCY:
+      g_value_set_boolean (value,
+          gst_rtsp_media_factory_wfd_is_low_latency (factory));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -188,14 +218,155 @@ static void
 gst_rtsp_media_factory_wfd_set_property (GObject * object,
              guint propid, const GValue * value, GParamSpec * pspec)
 {
-  //GstRTSPMediaFactoryWFD *factory = GST_RTSP_MEDIA_FACTORY_WFD (object);
+  GstRTSPMediaFactoryWFD *factory = GST_RTSP_MEDIA_FACTORY_WFD (object);
 
   switch (propid) {
+    case PROP_LOW_LATENCY:
+      gst_rtsp_media_factory_wfd_set_low_latency (factory,
+          g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
 }
 
+static GstRTSPWFDClient *
+get_current_wfd_client (void)
+{
+  GstRTSPContext *ctx;
+
+  if (!(ctx = gst_rtsp_context_get_current ()))
+    return NULL;
+
+  if (ctx->client == NULL || !GST_IS_RTSP_WFD_CLIENT (ctx->client))
+    return NULL;
+
+  return GST_RTSP_WFD_CLIENT (ctx->client);
+}
+
+/* all sinks request the same presentation URL, add the format that was
+ * negotiated with the sink so that only sinks with the same format end up
+ * with the same shared media. The payloaders of a shared media send to all
+ * of its sinks so the encoding is done once per format. */
+static gchar *
+wfd_gen_key (GstRTSPMediaFactory * factory, const GstRTSPUrl * url)
+{
+  GstRTSPWFDClient *client;
+  gchar *key, *format, *result;
+
+  key = GST_RTSP_MEDIA_FACTORY_CLASS
+      (gst_rtsp_media_factory_wfd_parent_class)->gen_key (factory, url);
+
+  client = get_current_wfd_client ();
+  if (client == NULL || key == NULL)
+    return key;
+
+  format = gst_rtsp_wfd_client_get_negotiated_format (client);
+  if (format == NULL)
+    return key;
+
+  result = g_strdup_printf ("%s#%s", key, format);
+  g_free (format);
+  g_free (key);
+
+  GST_DEBUG_OBJECT (factory, "media key %s", result);
+
+  return result;
+}
+
+static void
+configure_video_caps (GstRTSPMediaFactory * factory, GstRTSPMedia * media)
+{
+  GstRTSPWFDClient *client;
+  GstElement *element, *capsfilter;
+  guint width, height, framerate;
+  GstCaps *caps;
+
+  client = get_current_wfd_client ();
+  if (client == NULL)
+    return;
+
+  if (!gst_rtsp_wfd_client_get_negotiated_resolution (client, &width, &height,
+          &framerate))
+    return;
+
+  element = gst_rtsp_media_get_element (media);
+  capsfilter = gst_bin_get_by_name (GST_BIN (element), WFD_VIDEO_CAPS_NAME);
+  gst_object_unref (element);
+
+  if (capsfilter == NULL)
+    return;
+
+  caps = gst_caps_new_simple ("video/x-raw",
+      "width", G_TYPE_INT, (gint) width,
+      "height", G_TYPE_INT, (gint) height,
+      "framerate", GST_TYPE_FRACTION, (gint) framerate, 1, NULL);
+  GST_DEBUG_OBJECT (factory, "configure negotiated caps %" GST_PTR_FORMAT,
+      caps);
+  g_object_set (capsfilter, "caps", caps, NULL);
+  gst_caps_unref (caps);
+  gst_object_unref (capsfilter);
+}
+
+static void
+wfd_configure (GstRTSPMediaFactory * factory, GstRTSPMedia * media)
+{
+  GstRTSPMediaFactoryWFD *wfd = GST_RTSP_MEDIA_FACTORY_WFD (factory);
+  gboolean low_latency;
+
+  GST_RTSP_MEDIA_FACTORY_CLASS
+      (gst_rtsp_media_factory_wfd_parent_class)->configure (factory, media);
+
+  GST_RTSP_MEDIA_FACTORY_WFD_LOCK (wfd);
+  low_latency = wfd->priv->low_latency;
+  GST_RTSP_MEDIA_FACTORY_WFD_UNLOCK (wfd);
+
+  gst_rtsp_media_set_low_latency (media, low_latency);
+
+  configure_video_caps (factory, media);
+}
+
+/**
+ * gst_rtsp_media_factory_wfd_set_low_latency:
+ * @factory: a #GstRTSPMediaFactoryWFD
+ * @low_latency: the new value
+ *
+ * Configure if media created from this factory should be streamed with the
+ * low-latency profile. See gst_rtsp_media_set_low_latency().
+ */
+void
+gst_rtsp_media_factory_wfd_set_low_latency (GstRTSPMediaFactoryWFD * factory,
+    gboolean low_latency)
+{
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY_WFD (factory));
+
+  GST_RTSP_MEDIA_FACTORY_WFD_LOCK (factory);
+  factory->priv->low_latency = low_latency;
+  GST_RTSP_MEDIA_FACTORY_WFD_UNLOCK (factory);
+}
+
+/**
+ * gst_rtsp_media_factory_wfd_is_low_latency:
+ * @factory: a #GstRTSPMediaFactoryWFD
+ *
+ * Check if media created from this factory use the low-latency profile.
+ *
+ * Returns: %TRUE if the media will be configured for low-latency streaming.
+ */
+gboolean
+gst_rtsp_media_factory_wfd_is_low_latency (GstRTSPMediaFactoryWFD * factory)
+{
+  gboolean result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY_WFD (factory), FALSE);
+
+  GST_RTSP_MEDIA_FACTORY_WFD_LOCK (factory);
+  result = factory->priv->low_latency;
+  GST_RTSP_MEDIA_FACTORY_WFD_UNLOCK (factory);
+
+  return result;
+}
+
 /**
  * gst_rtsp_media_factory_wfd_create_element:
  * @factory: a #GstRTSPMediaFactoryWFD
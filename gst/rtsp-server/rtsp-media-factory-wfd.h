@@ -47,7 +47,7 @@ typedef struct _GstRTSPMediaFactoryWFDPrivate GstRTSPMediaFactoryWFDPrivate;
  * can contain multiple streams like audio and video.
  */
 struct _GstRTSPMediaFactoryWFD {
-  GObject            parent;
+  GstRTSPMediaFactory parent;
 
   /*< private >*/
   GstRTSPMediaFactoryWFDPrivate *priv;
@@ -77,7 +77,7 @@ struct _GstRTSPMediaFactoryWFD {
  * The #GstRTSPMediaFactoryWFD class structure.
  */
 struct _GstRTSPMediaFactoryWFDClass {
-  GObjectClass  parent_class;
+  GstRTSPMediaFactoryClass  parent_class;
 
   gchar *         (*gen_key)            (GstRTSPMediaFactoryWFD *factory, const GstRTSPUrl *url);
 
@@ -101,6 +101,10 @@ GstRTSPMediaFactoryWFD * gst_rtsp_media_factory_wfd_new          (void);
 GstElement * gst_rtsp_media_factory_wfd_create_element (GstRTSPMediaFactoryWFD * factory,
     const GstRTSPUrl * url);
 
+void          gst_rtsp_media_factory_wfd_set_low_latency (GstRTSPMediaFactoryWFD * factory,
+    gboolean low_latency);
+gboolean      gst_rtsp_media_factory_wfd_is_low_latency  (GstRTSPMediaFactoryWFD * factory);
+
 G_END_DECLS
 
 #endif /* __GST_RTSP_MEDIA_FACTORY_WFD_H__ */
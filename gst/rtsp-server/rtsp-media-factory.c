@@ -33,10 +33,29 @@
  * gst_rtsp_media_factory_construct() will return the same #GstRTSPMedia when
  * the url matches.
  *
+ * With gst_rtsp_media_factory_add_shared_source() an appsrc in the launch line
+ * can be fed from a capture or encode branch that is shared with the media of
+ * other factories, so that one camera can be served on several mount points
+ * while it is only captured and encoded once.
+ *
+ * A factory configured with gst_rtsp_media_factory_set_ingest() accepts
+ * clients that publish a stream with ANNOUNCE and RECORD. The RTP they send
+ * is relayed as it is, without depayloading, to the clients of the factories
+ * that serve the same relay name with gst_rtsp_media_factory_set_relay().
+ *
  * Last reviewed on 2013-07-11 (1.0.0)
  */
 
+#include <string.h>
+#include <stdlib.h>
+
+#include <gst/app/gstappsrc.h>
+#include <gst/app/gstappsink.h>
+#include <gst/rtp/gstrtppayloads.h>
+
 #include "rtsp-media-factory.h"
+#include "rtsp-relay.h"
+#include "rtsp-server-internal.h"
 
 #define GST_RTSP_MEDIA_FACTORY_GET_PRIVATE(obj)  \
        (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_RTSP_MEDIA_FACTORY, GstRTSPMediaFactoryPrivate))
@@ -56,6 +75,10 @@ struct _GstRTSPMediaFactoryPrivate
   GstRTSPLowerTrans protocols;
   guint buffer_size;
   GstRTSPAddressPool *pool;
+  GstRTSPSocketPool *socket_pool;
+  GHashTable *shared_sources;   /* name -> launch line */
+  gchar *ingest;
+  gchar *relay;
 
   GMutex medias_lock;
   GHashTable *medias;           /* protected by medias_lock */
@@ -68,6 +91,8 @@ struct _GstRTSPMediaFactoryPrivate
 #define DEFAULT_PROTOCOLS       GST_RTSP_LOWER_TRANS_UDP | GST_RTSP_LOWER_TRANS_UDP_MCAST | \
                                         GST_RTSP_LOWER_TRANS_TCP
 #define DEFAULT_BUFFER_SIZE     0x80000
+#define DEFAULT_INGEST          NULL
+#define DEFAULT_RELAY           NULL
 
 enum
 {
@@ -78,6 +103,8 @@ enum
   PROP_EOS_SHUTDOWN,
   PROP_PROTOCOLS,
   PROP_BUFFER_SIZE,
+  PROP_INGEST,
+  PROP_RELAY,
   PROP_LAST
 };
 
@@ -93,6 +120,28 @@ GST_DEBUG_CATEGORY_STATIC (rtsp_media_debug);
 
 static guint gst_rtsp_media_factory_signals[SIGNAL_LAST] = { 0 };
 
+/* a capture or encode branch that feeds the appsrcs of several media */
+typedef struct
+{
+  gchar *name;
+  gchar *launch;
+  GstElement *pipeline;
+  GstElement *appsink;
+  GstCaps *caps;
+  GList *users;                 /* GstAppSrc, not reffed */
+} SharedSource;
+
+static GMutex shared_lock;
+static GHashTable *shared_source_table; /* protected by shared_lock */
+
+/* the record media that feeds a relay */
+typedef struct
+{
+  GstRTSPRelay *relay;
+  GstRTSPMedia *media;          /* not reffed */
+  GPtrArray *caps;              /* the announced GstCaps */
+} RelayPublisher;
+
 static void gst_rtsp_media_factory_get_property (GObject * object, guint propid,
     GValue * value, GParamSpec * pspec);
 static void gst_rtsp_media_factory_set_property (GObject * object, guint propid,
@@ -171,6 +220,16 @@ gst_rtsp_media_factory_class_init (GstRTSPMediaFactoryClass * klass)
           "The kernel UDP buffer size to use", 0, G_MAXUINT,
           DEFAULT_BUFFER_SIZE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_INGEST,
+      g_param_spec_string ("ingest", "Ingest",
+          "The relay that clients publish to with ANNOUNCE and RECORD",
+          DEFAULT_INGEST, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RELAY,
+      g_param_spec_string ("relay", "Relay",
+          "The relay that is served to clients", DEFAULT_RELAY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_rtsp_media_factory_signals[SIGNAL_MEDIA_CONSTRUCTED] =
       g_signal_new ("media-constructed", G_TYPE_FROM_CLASS (klass),
       G_SIGNAL_RUN_LAST, G_STRUCT_OFFSET (GstRTSPMediaFactoryClass,
@@ -206,11 +265,15 @@ gst_rtsp_media_factory_init (GstRTSPMediaFactory * factory)
   priv->eos_shutdown = DEFAULT_EOS_SHUTDOWN;
   priv->protocols = DEFAULT_PROTOCOLS;
   priv->buffer_size = DEFAULT_BUFFER_SIZE;
+  priv->ingest = g_strdup (DEFAULT_INGEST);
+  priv->relay = g_strdup (DEFAULT_RELAY);
 
   g_mutex_init (&priv->lock);
   g_mutex_init (&priv->medias_lock);
   priv->medias = g_hash_table_new_full (g_str_hash, g_str_equal,
       g_free, g_object_unref);
+  priv->shared_sources = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, g_free);
 }
 
 static void
@@ -224,9 +287,14 @@ gst_rtsp_media_factory_finalize (GObject * obj)
   g_hash_table_unref (priv->medias);
   g_mutex_clear (&priv->medias_lock);
   g_free (priv->launch);
+  g_hash_table_unref (priv->shared_sources);
+  g_free (priv->ingest);
+  g_free (priv->relay);
   g_mutex_clear (&priv->lock);
   if (priv->pool)
     g_object_unref (priv->pool);
+  if (priv->socket_pool)
+    g_object_unref (priv->socket_pool);
 
   G_OBJECT_CLASS (gst_rtsp_media_factory_parent_class)->finalize (obj);
 }
@@ -259,6 +327,12 @@ gst_rtsp_media_factory_get_property (GObject * object, guint propid,
       g_value_set_uint (value,
           gst_rtsp_media_factory_get_buffer_size (factory));
       break;
+    case PROP_INGEST:
+      g_value_take_string (value, gst_rtsp_media_factory_get_ingest (factory));
+      break;
+    case PROP_RELAY:
+      g_value_take_string (value, gst_rtsp_media_factory_get_relay (factory));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -292,6 +366,12 @@ gst_rtsp_media_factory_set_property (GObject * object, guint propid,
       gst_rtsp_media_factory_set_buffer_size (factory,
           g_value_get_uint (value));
       break;
+    case PROP_INGEST:
+      gst_rtsp_media_factory_set_ingest (factory, g_value_get_string (value));
+      break;
+    case PROP_RELAY:
+      gst_rtsp_media_factory_set_relay (factory, g_value_get_string (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -706,6 +786,209 @@ gst_rtsp_media_factory_get_address_pool (GstRTSPMediaFactory * factory)
   return result;
 }
 
+/**
+ * gst_rtsp_media_factory_set_socket_pool:
+ * @factory: a #GstRTSPMediaFactory
+ * @pool: (allow-none): a #GstRTSPSocketPool
+ *
+ * configure @pool to provide the bound server sockets of the media made by
+ * @factory. The same pool can be shared between all factories of a server.
+ */
+void
+gst_rtsp_media_factory_set_socket_pool (GstRTSPMediaFactory * factory,
+    GstRTSPSocketPool * pool)
+{
+  GstRTSPMediaFactoryPrivate *priv;
+  GstRTSPSocketPool *old;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory));
+
+  priv = factory->priv;
+
+  GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  if ((old = priv->socket_pool) != pool)
+    priv->socket_pool = pool ? g_object_ref (pool) : NULL;
+  else
+    old = NULL;
+  GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+
+  if (old)
+    g_object_unref (old);
+}
+
+/**
+ * gst_rtsp_media_factory_get_socket_pool:
+ * @factory: a #GstRTSPMediaFactory
+ *
+ * Get the #GstRTSPSocketPool used for the server sockets of the media made by
+ * @factory.
+ *
+ * Returns: (transfer full): the #GstRTSPSocketPool of @factory.
+ * g_object_unref() after usage.
+ */
+GstRTSPSocketPool *
+gst_rtsp_media_factory_get_socket_pool (GstRTSPMediaFactory * factory)
+{
+  GstRTSPMediaFactoryPrivate *priv;
+  GstRTSPSocketPool *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory), NULL);
+
+  priv = factory->priv;
+
+  GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  if ((result = priv->socket_pool))
+    g_object_ref (result);
+  GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_media_factory_add_shared_source:
+ * @factory: a #GstRTSPMediaFactory
+ * @name: the name of the appsrc to feed
+ * @launch: the launch line of the shared branch
+ *
+ * Feed the appsrc named @name in the launch line of @factory from a branch
+ * that is shared by all media, of any factory, that use a shared source
+ * called @name. The branch is created from @launch, for example a capture and
+ * encode chain, when the first of these media is constructed and it is
+ * stopped when the last of them is destroyed.
+ *
+ * The shared branch runs live on the system clock and every new user requests
+ * a key unit from it, so the media can use their own payloader, protocol and
+ * RTP settings.
+ */
+void
+gst_rtsp_media_factory_add_shared_source (GstRTSPMediaFactory * factory,
+    const gchar * name, const gchar * launch)
+{
+  GstRTSPMediaFactoryPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory));
+  g_return_if_fail (name != NULL);
+  g_return_if_fail (launch != NULL);
+
+  priv = factory->priv;
+
+  GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  g_hash_table_insert (priv->shared_sources, g_strdup (name),
+      g_strdup (launch));
+  GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+}
+
+/**
+ * gst_rtsp_media_factory_set_ingest:
+ * @factory: a #GstRTSPMediaFactory
+ * @relay: (allow-none): the name of a relay
+ *
+ * Let clients publish to the relay @relay with ANNOUNCE and RECORD on the
+ * mount points of @factory. The streams of the media are made from the SDP
+ * of the ANNOUNCE, see gst_rtsp_media_factory_announce(), the launch line
+ * is not used. gst_rtsp_media_factory_construct() makes no media for an
+ * ingest factory.
+ *
+ * The media of an ingest factory are not shared.
+ */
+void
+gst_rtsp_media_factory_set_ingest (GstRTSPMediaFactory * factory,
+    const gchar * relay)
+{
+  GstRTSPMediaFactoryPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory));
+
+  priv = factory->priv;
+
+  GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  g_free (priv->ingest);
+  priv->ingest = g_strdup (relay);
+  GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+}
+
+/**
+ * gst_rtsp_media_factory_get_ingest:
+ * @factory: a #GstRTSPMediaFactory
+ *
+ * Get the name of the relay that clients publish to on @factory.
+ *
+ * Returns: (transfer full): the name of the relay or %NULL. g_free() after
+ * usage.
+ */
+gchar *
+gst_rtsp_media_factory_get_ingest (GstRTSPMediaFactory * factory)
+{
+  GstRTSPMediaFactoryPrivate *priv;
+  gchar *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory), NULL);
+
+  priv = factory->priv;
+
+  GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  result = g_strdup (priv->ingest);
+  GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_media_factory_set_relay:
+ * @factory: a #GstRTSPMediaFactory
+ * @relay: (allow-none): the name of a relay
+ *
+ * Serve the RTP that is published to the relay @relay when @factory has no
+ * launch line. The packets are sent as they were received from the
+ * publisher, only the SSRC, the sequence numbers and the timestamps are
+ * rewritten for each media.
+ *
+ * Media can only be constructed after a client recorded to @relay, while its
+ * record media or other media of @relay exist. Sharing the media of @factory
+ * saves a copy of the packets for each client.
+ */
+void
+gst_rtsp_media_factory_set_relay (GstRTSPMediaFactory * factory,
+    const gchar * relay)
+{
+  GstRTSPMediaFactoryPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory));
+
+  priv = factory->priv;
+
+  GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  g_free (priv->relay);
+  priv->relay = g_strdup (relay);
+  GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+}
+
+/**
+ * gst_rtsp_media_factory_get_relay:
+ * @factory: a #GstRTSPMediaFactory
+ *
+ * Get the name of the relay that is served by @factory.
+ *
+ * Returns: (transfer full): the name of the relay or %NULL. g_free() after
+ * usage.
+ */
+gchar *
+gst_rtsp_media_factory_get_relay (GstRTSPMediaFactory * factory)
+{
+  GstRTSPMediaFactoryPrivate *priv;
+  gchar *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory), NULL);
+
+  priv = factory->priv;
+
+  GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  result = g_strdup (priv->relay);
+  GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+
+  return result;
+}
+
 /**
  * gst_rtsp_media_factory_set_protocols:
  * @factory: a #GstRTSPMediaFactory
@@ -904,6 +1187,486 @@ default_gen_key (GstRTSPMediaFactory * factory, const GstRTSPUrl * url)
   return result;
 }
 
+static void
+shared_source_free (SharedSource * source)
+{
+  gst_object_unref (source->appsink);
+  gst_object_unref (source->pipeline);
+  if (source->caps)
+    gst_caps_unref (source->caps);
+  g_free (source->name);
+  g_free (source->launch);
+  g_slice_free (SharedSource, source);
+}
+
+static GstFlowReturn
+shared_source_new_sample (GstAppSink * appsink, gpointer user_data)
+{
+  SharedSource *source = user_data;
+  GstSample *sample;
+  GstBuffer *buffer;
+  GstCaps *caps;
+  GstClockTime base_time;
+  GList *walk;
+
+  sample = gst_app_sink_pull_sample (appsink);
+  if (sample == NULL)
+    return GST_FLOW_OK;
+
+  buffer = gst_sample_get_buffer (sample);
+  caps = gst_sample_get_caps (sample);
+  base_time = gst_element_get_base_time (source->pipeline);
+
+  g_mutex_lock (&shared_lock);
+  if (caps && (source->caps == NULL || !gst_caps_is_equal (caps,
+              source->caps))) {
+    gst_caps_replace (&source->caps, caps);
+    for (walk = source->users; walk; walk = g_list_next (walk))
+      gst_app_src_set_caps (walk->data, caps);
+  }
+
+  for (walk = source->users; walk; walk = g_list_next (walk)) {
+    GstAppSrc *appsrc = walk->data;
+    GstClockTimeDiff offset;
+    GstPad *pad;
+
+    /* live source, nothing is consumed before PLAYING */
+    if (GST_STATE (appsrc) != GST_STATE_PLAYING)
+      continue;
+    if (gst_app_src_get_current_level_bytes (appsrc) >
+        gst_app_src_get_max_bytes (appsrc)) {
+      GST_LOG ("user %p of shared source %s is too slow", appsrc,
+          source->name);
+      continue;
+    }
+
+    /* both pipelines use the system clock, the pad offset moves the
+     * timestamps to the running-time of the user so that all users can
+     * share the buffer */
+    offset = GST_CLOCK_DIFF (gst_element_get_base_time (GST_ELEMENT (appsrc)),
+        base_time);
+    pad = GST_BASE_SRC_PAD (appsrc);
+    if (gst_pad_get_offset (pad) != offset)
+      gst_pad_set_offset (pad, offset);
+
+    gst_app_src_push_buffer (appsrc, gst_buffer_ref (buffer));
+  }
+  g_mutex_unlock (&shared_lock);
+
+  gst_sample_unref (sample);
+
+  return GST_FLOW_OK;
+}
+
+static GstAppSinkCallbacks shared_source_callbacks = {
+  NULL,
+  NULL,
+  shared_source_new_sample
+};
+
+/* called with shared_lock */
+static SharedSource *
+shared_source_new (const gchar * name, const gchar * launch)
+{
+  SharedSource *source;
+  GstElement *pipeline;
+  GstClock *clock;
+  GError *error = NULL;
+  gchar *desc;
+
+  desc = g_strdup_printf ("%s ! appsink name=sink sync=false async=false",
+      launch);
+  pipeline = gst_parse_launch (desc, &error);
+  g_free (desc);
+  if (pipeline == NULL || !GST_IS_PIPELINE (pipeline))
+    goto parse_error;
+
+  if (error != NULL) {
+    GST_WARNING ("recoverable parsing error: %s", error->message);
+    g_clear_error (&error);
+  }
+
+  source = g_slice_new0 (SharedSource);
+  source->name = g_strdup (name);
+  source->launch = g_strdup (launch);
+  source->pipeline = pipeline;
+  source->appsink = gst_bin_get_by_name (GST_BIN (pipeline), "sink");
+  gst_app_sink_set_callbacks (GST_APP_SINK (source->appsink),
+      &shared_source_callbacks, source, NULL);
+
+  /* the users are in other pipelines, use the same clock as they do */
+  clock = gst_system_clock_obtain ();
+  gst_pipeline_use_clock (GST_PIPELINE (pipeline), clock);
+  gst_object_unref (clock);
+
+  GST_INFO ("created shared source %s: %s", name, launch);
+
+  return source;
+
+  /* ERRORS */
+parse_error:
+  {
+    g_critical ("could not parse shared source %s (%s): %s", name, launch,
+        (error ? error->message : "not a pipeline"));
+    if (pipeline)
+      gst_object_unref (pipeline);
+    g_clear_error (&error);
+    return NULL;
+  }
+}
+
+static void
+shared_source_detach (SharedSource * source, GObject * appsrc)
+{
+  gboolean last;
+
+  g_mutex_lock (&shared_lock);
+  source->users = g_list_remove (source->users, appsrc);
+  if ((last = (source->users == NULL)))
+    g_hash_table_remove (shared_source_table, source->name);
+  g_mutex_unlock (&shared_lock);
+
+  if (last) {
+    GST_INFO ("last user of shared source %s is gone", source->name);
+    gst_element_set_state (source->pipeline, GST_STATE_NULL);
+    shared_source_free (source);
+  }
+}
+
+static void
+shared_source_attach (const gchar * name, const gchar * launch,
+    GstAppSrc * appsrc)
+{
+  SharedSource *source;
+  gboolean created = FALSE;
+  GstPad *pad;
+
+  g_mutex_lock (&shared_lock);
+  if (shared_source_table == NULL)
+    shared_source_table = g_hash_table_new (g_str_hash, g_str_equal);
+
+  source = g_hash_table_lookup (shared_source_table, name);
+  if (source == NULL) {
+    if (!(source = shared_source_new (name, launch)))
+      goto no_source;
+    g_hash_table_insert (shared_source_table, source->name, source);
+    created = TRUE;
+  } else if (strcmp (source->launch, launch) != 0) {
+    GST_WARNING ("shared source %s is already running as '%s'", name,
+        source->launch);
+  }
+
+  g_object_set (appsrc, "is-live", TRUE, "format", GST_FORMAT_TIME, NULL);
+  if (source->caps)
+    gst_app_src_set_caps (appsrc, source->caps);
+  source->users = g_list_prepend (source->users, appsrc);
+  g_object_weak_ref (G_OBJECT (appsrc), (GWeakNotify) shared_source_detach,
+      source);
+
+  GST_DEBUG ("shared source %s has %u users", name,
+      g_list_length (source->users));
+  g_mutex_unlock (&shared_lock);
+
+  /* @appsrc keeps the source alive here */
+  if (created) {
+    if (gst_element_set_state (source->pipeline, GST_STATE_PLAYING) ==
+        GST_STATE_CHANGE_FAILURE)
+      GST_WARNING ("shared source %s failed to start", name);
+  } else {
+    /* the new user needs a key unit to start decoding */
+    pad = gst_element_get_static_pad (source->appsink, "sink");
+    gst_pad_send_event (pad, gst_rtsp_force_key_unit_event_new ());
+    gst_object_unref (pad);
+  }
+  return;
+
+  /* ERRORS */
+no_source:
+  {
+    g_mutex_unlock (&shared_lock);
+    return;
+  }
+}
+
+/* called with the factory lock */
+static void
+attach_shared_source (const gchar * name, const gchar * launch,
+    GstElement * element)
+{
+  GstElement *appsrc;
+
+  appsrc = gst_bin_get_by_name (GST_BIN (element), name);
+  if (appsrc == NULL) {
+    GST_DEBUG ("no element %s for shared source", name);
+    return;
+  }
+  if (GST_IS_APP_SRC (appsrc))
+    shared_source_attach (name, launch, GST_APP_SRC (appsrc));
+  else
+    GST_WARNING ("element %s for shared source is not an appsrc", name);
+
+  gst_object_unref (appsrc);
+}
+
+/* called from the streaming thread of the publisher */
+static void
+relay_record (GstRTSPMedia * media, guint idx, GstBuffer * buffer,
+    RelayPublisher * pub)
+{
+  gst_rtsp_relay_push (pub->relay, media, idx, buffer);
+}
+
+/* the announced streams only replace the streams of the relay when the
+ * publisher starts to RECORD */
+static void
+relay_new_state (GstRTSPMedia * media, gint state, RelayPublisher * pub)
+{
+  if (state == GST_STATE_PLAYING) {
+    if (!gst_rtsp_relay_announce (pub->relay, media,
+            g_ptr_array_ref (pub->caps)))
+      GST_WARNING ("media %p can't publish, relay is busy", media);
+  } else {
+    gst_rtsp_relay_unpublish (pub->relay, media);
+  }
+}
+
+static void
+relay_unpublish (RelayPublisher * pub)
+{
+  g_signal_handlers_disconnect_by_func (pub->media, relay_new_state, pub);
+  gst_rtsp_relay_unpublish (pub->relay, pub->media);
+  gst_rtsp_relay_unref (pub->relay);
+  g_ptr_array_unref (pub->caps);
+  g_slice_free (RelayPublisher, pub);
+}
+
+/* takes ownership of @caps */
+static void
+relay_publish (const gchar * name, GstRTSPMedia * media, GPtrArray * caps)
+{
+  RelayPublisher *pub;
+
+  pub = g_slice_new (RelayPublisher);
+  pub->relay = gst_rtsp_relay_get (name);
+  pub->media = media;
+  pub->caps = caps;
+
+  g_signal_connect (media, "new-state", (GCallback) relay_new_state, pub);
+  gst_rtsp_media_set_record_func (media, (GstRTSPMediaRecordFunc) relay_record,
+      pub, (GDestroyNotify) relay_unpublish);
+}
+
+/* the caps of the RTP of the first format in @media */
+static GstCaps *
+caps_from_sdp_media (const GstSDPMedia * media)
+{
+  const GstRTPPayloadInfo *info;
+  const gchar *fmt, *val, *params;
+  GstStructure *s;
+  gchar **tokens;
+  gint pt, clock_rate = 0;
+  guint i, j;
+
+  if ((fmt = gst_sdp_media_get_format (media, 0)) == NULL)
+    return NULL;
+  pt = atoi (fmt);
+
+  s = gst_structure_new ("application/x-rtp", "media", G_TYPE_STRING,
+      gst_sdp_media_get_media (media), "payload", G_TYPE_INT, pt, NULL);
+
+  /* static payload types don't need a rtpmap */
+  if ((info = gst_rtp_payload_info_for_pt (pt))) {
+    clock_rate = info->clock_rate;
+    if (info->encoding_name)
+      gst_structure_set (s, "encoding-name", G_TYPE_STRING,
+          info->encoding_name, NULL);
+  }
+
+  /* a=rtpmap:<pt> <encoding name>/<clock rate>[/<encoding parameters>] */
+  for (i = 0; (val = gst_sdp_media_get_attribute_val_n (media, "rtpmap", i));
+      i++) {
+    gchar *name;
+
+    if (atoi (val) != pt || (params = strchr (val, ' ')) == NULL)
+      continue;
+
+    tokens = g_strsplit (params + 1, "/", 3);
+    if (tokens[0] && tokens[1]) {
+      name = g_ascii_strup (g_strstrip (tokens[0]), -1);
+      gst_structure_set (s, "encoding-name", G_TYPE_STRING, name, NULL);
+      g_free (name);
+      clock_rate = atoi (tokens[1]);
+      if (tokens[2])
+        gst_structure_set (s, "encoding-params", G_TYPE_STRING,
+            g_strstrip (tokens[2]), NULL);
+    }
+    g_strfreev (tokens);
+    break;
+  }
+  if (clock_rate <= 0)
+    goto no_clock_rate;
+  gst_structure_set (s, "clock-rate", G_TYPE_INT, clock_rate, NULL);
+
+  /* a=fmtp:<pt> <key>=<value>;... */
+  for (i = 0; (val = gst_sdp_media_get_attribute_val_n (media, "fmtp", i));
+      i++) {
+    if (atoi (val) != pt || (params = strchr (val, ' ')) == NULL)
+      continue;
+
+    tokens = g_strsplit (params + 1, ";", -1);
+    for (j = 0; tokens[j]; j++) {
+      gchar *key, *value;
+
+      if ((value = strchr (tokens[j], '=')) == NULL)
+        continue;
+      *value++ = '\0';
+
+      key = g_ascii_strdown (g_strstrip (tokens[j]), -1);
+      if (g_ascii_isalpha (key[0]) && !gst_structure_has_field (s, key))
+        gst_structure_set (s, key, G_TYPE_STRING, g_strstrip (value), NULL);
+      g_free (key);
+    }
+    g_strfreev (tokens);
+    break;
+  }
+
+  return gst_caps_new_full (s, NULL);
+
+  /* ERRORS */
+no_clock_rate:
+  {
+    GST_WARNING ("no clock-rate for payload type %d", pt);
+    gst_structure_free (s);
+    return NULL;
+  }
+}
+
+/**
+ * gst_rtsp_media_factory_announce:
+ * @factory: a #GstRTSPMediaFactory
+ * @url: the url used
+ * @sdp: the #GstSDPMessage of an ANNOUNCE
+ *
+ * Construct the record media of a client that publishes to @factory with a
+ * stream for each media in @sdp. The streams are only announced to the relay
+ * when the media goes to PLAYING after RECORD, the media that serve the
+ * relay are then constructed with the same streams. Media that were
+ * constructed for an earlier announcement only get the new packets when
+ * the streams did not change.
+ *
+ * The media is configured like the media of
+ * gst_rtsp_media_factory_construct() but it is never shared.
+ *
+ * Returns: (transfer full): a new #GstRTSPMedia or %NULL when @factory is
+ * not an ingest factory, @sdp describes no usable RTP or when a client is
+ * still publishing to the relay.
+ */
+GstRTSPMedia *
+gst_rtsp_media_factory_announce (GstRTSPMediaFactory * factory,
+    const GstRTSPUrl * url, const GstSDPMessage * sdp)
+{
+  GstRTSPMediaFactoryClass *klass;
+  GstRTSPMedia *media;
+  GstRTSPRelay *relay;
+  GstElement *element;
+  GPtrArray *caps;
+  gboolean busy;
+  gchar *name;
+  guint i;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA_FACTORY (factory), NULL);
+  g_return_val_if_fail (url != NULL, NULL);
+  g_return_val_if_fail (sdp != NULL, NULL);
+
+  klass = GST_RTSP_MEDIA_FACTORY_GET_CLASS (factory);
+
+  if ((name = gst_rtsp_media_factory_get_ingest (factory)) == NULL)
+    goto no_ingest;
+
+  /* fail early, the relay is only taken when the client records */
+  relay = gst_rtsp_relay_get (name);
+  busy = gst_rtsp_relay_has_publisher (relay);
+  gst_rtsp_relay_unref (relay);
+  if (busy)
+    goto busy;
+
+  caps = g_ptr_array_new_with_free_func ((GDestroyNotify) gst_caps_unref);
+  for (i = 0; i < gst_sdp_message_medias_len (sdp); i++) {
+    GstCaps *media_caps;
+
+    media_caps = caps_from_sdp_media (gst_sdp_message_get_media (sdp, i));
+    if (media_caps == NULL)
+      goto invalid_sdp;
+    g_ptr_array_add (caps, media_caps);
+  }
+  if (caps->len == 0)
+    goto invalid_sdp;
+
+  if (!klass->create_pipeline)
+    goto no_create;
+
+  element = gst_rtsp_relay_create_publisher (caps);
+  media = gst_rtsp_media_new (element);
+  gst_rtsp_media_collect_streams (media);
+
+  if (klass->create_pipeline (factory, media) == NULL)
+    goto no_pipeline;
+
+  g_signal_emit (factory,
+      gst_rtsp_media_factory_signals[SIGNAL_MEDIA_CONSTRUCTED], 0, media, NULL);
+
+  if (klass->configure)
+    klass->configure (factory, media);
+
+  g_signal_emit (factory,
+      gst_rtsp_media_factory_signals[SIGNAL_MEDIA_CONFIGURE], 0, media, NULL);
+
+  /* the streams stay with the media until it records, takes ownership of
+   * the caps */
+  gst_rtsp_media_set_shared (media, FALSE);
+  relay_publish (name, media, caps);
+  g_free (name);
+
+  GST_INFO ("announced media %p for url %s", media, url->abspath);
+
+  return media;
+
+  /* ERRORS */
+no_ingest:
+  {
+    GST_WARNING ("factory %p does not accept publishers", factory);
+    return NULL;
+  }
+busy:
+  {
+    GST_WARNING ("relay %s already has a publisher", name);
+    g_free (name);
+    return NULL;
+  }
+invalid_sdp:
+  {
+    GST_WARNING ("no usable RTP announced for relay %s", name);
+    g_ptr_array_unref (caps);
+    g_free (name);
+    return NULL;
+  }
+no_create:
+  {
+    g_critical ("no create_pipeline function");
+    g_ptr_array_unref (caps);
+    g_free (name);
+    return NULL;
+  }
+no_pipeline:
+  {
+    g_critical ("can't create pipeline");
+    g_object_unref (media);
+    g_ptr_array_unref (caps);
+    g_free (name);
+    return NULL;
+  }
+}
+
 static GstElement *
 default_create_element (GstRTSPMediaFactory * factory, const GstRTSPUrl * url)
 {
@@ -912,6 +1675,22 @@ default_create_element (GstRTSPMediaFactory * factory, const GstRTSPUrl * url)
   GError *error = NULL;
 
   GST_RTSP_MEDIA_FACTORY_LOCK (factory);
+  /* the media of publishers are made by gst_rtsp_media_factory_announce() */
+  if (priv->ingest != NULL)
+    goto not_announced;
+
+  /* relays are made from the announced streams */
+  if (priv->launch == NULL && priv->relay != NULL) {
+    GstRTSPRelay *relay;
+
+    /* the appsrcs of the element keep the relay */
+    relay = gst_rtsp_relay_get (priv->relay);
+    element = gst_rtsp_relay_create_element (relay);
+    gst_rtsp_relay_unref (relay);
+    GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+    return element;
+  }
+
   /* we need a parse syntax */
   if (priv->launch == NULL)
     goto no_launch;
@@ -921,6 +1700,10 @@ default_create_element (GstRTSPMediaFactory * factory, const GstRTSPUrl * url)
   if (element == NULL)
     goto parse_error;
 
+  if (GST_IS_BIN (element))
+    g_hash_table_foreach (priv->shared_sources, (GHFunc) attach_shared_source,
+        element);
+
   GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
 
   if (error != NULL) {
@@ -931,6 +1714,13 @@ default_create_element (GstRTSPMediaFactory * factory, const GstRTSPUrl * url)
   return element;
 
   /* ERRORS */
+not_announced:
+  {
+    GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
+    GST_WARNING ("publishers need to ANNOUNCE the streams of %s",
+        priv->ingest);
+    return NULL;
+  }
 no_launch:
   {
     GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
@@ -1014,7 +1804,9 @@ default_configure (GstRTSPMediaFactory * factory, GstRTSPMedia * media)
   GstRTSPSuspendMode suspend_mode;
   GstRTSPLowerTrans protocols;
   GstRTSPAddressPool *pool;
+  GstRTSPSocketPool *socket_pool;
   GstRTSPPermissions *perms;
+  gboolean ingest;
 
   /* configure the sharedness */
   GST_RTSP_MEDIA_FACTORY_LOCK (factory);
@@ -1023,8 +1815,13 @@ default_configure (GstRTSPMediaFactory * factory, GstRTSPMedia * media)
   eos_shutdown = priv->eos_shutdown;
   size = priv->buffer_size;
   protocols = priv->protocols;
+  ingest = priv->ingest != NULL;
   GST_RTSP_MEDIA_FACTORY_UNLOCK (factory);
 
+  /* every publisher gets its own media */
+  if (ingest)
+    shared = FALSE;
+
   gst_rtsp_media_set_suspend_mode (media, suspend_mode);
   gst_rtsp_media_set_shared (media, shared);
   gst_rtsp_media_set_eos_shutdown (media, eos_shutdown);
@@ -1035,6 +1832,10 @@ default_configure (GstRTSPMediaFactory * factory, GstRTSPMedia * media)
     gst_rtsp_media_set_address_pool (media, pool);
     g_object_unref (pool);
   }
+  if ((socket_pool = gst_rtsp_media_factory_get_socket_pool (factory))) {
+    gst_rtsp_media_set_socket_pool (media, socket_pool);
+    g_object_unref (socket_pool);
+  }
   if ((perms = gst_rtsp_media_factory_get_permissions (factory))) {
     gst_rtsp_media_set_permissions (media, perms);
     gst_rtsp_permissions_unref (perms);
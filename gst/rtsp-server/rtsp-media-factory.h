@@ -134,6 +134,24 @@ void                  gst_rtsp_media_factory_set_address_pool (GstRTSPMediaFacto
                                                                GstRTSPAddressPool * pool);
 GstRTSPAddressPool *  gst_rtsp_media_factory_get_address_pool (GstRTSPMediaFactory * factory);
 
+void                  gst_rtsp_media_factory_set_socket_pool  (GstRTSPMediaFactory * factory,
+                                                               GstRTSPSocketPool * pool);
+GstRTSPSocketPool *   gst_rtsp_media_factory_get_socket_pool  (GstRTSPMediaFactory * factory);
+
+void                  gst_rtsp_media_factory_add_shared_source (GstRTSPMediaFactory * factory,
+                                                                const gchar * name,
+                                                                const gchar * launch);
+
+void                  gst_rtsp_media_factory_set_ingest       (GstRTSPMediaFactory * factory,
+                                                               const gchar * relay);
+gchar *               gst_rtsp_media_factory_get_ingest       (GstRTSPMediaFactory * factory);
+void                  gst_rtsp_media_factory_set_relay        (GstRTSPMediaFactory * factory,
+                                                               const gchar * relay);
+gchar *               gst_rtsp_media_factory_get_relay        (GstRTSPMediaFactory * factory);
+GstRTSPMedia *        gst_rtsp_media_factory_announce         (GstRTSPMediaFactory * factory,
+                                                               const GstRTSPUrl * url,
+                                                               const GstSDPMessage * sdp);
+
 void                  gst_rtsp_media_factory_set_buffer_size  (GstRTSPMediaFactory * factory,
                                                                guint size);
 guint                 gst_rtsp_media_factory_get_buffer_size  (GstRTSPMediaFactory * factory);
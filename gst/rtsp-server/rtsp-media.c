@@ -61,6 +61,7 @@
  * Last reviewed on 2013-07-11 (1.0.0)
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -87,8 +88,19 @@ struct _GstRTSPMediaPrivate
   gboolean reused;
   gboolean eos_shutdown;
   guint buffer_size;
+  gboolean low_latency;
+  gboolean gop_cache;
+  gboolean adaptive_bitrate;
+  GstClockTime rtx_time;
+  guint fec_percentage;
+  gboolean pacing;
   GstRTSPAddressPool *pool;
+  GstRTSPSocketPool *socket_pool;
   gboolean blocked;
+  GstRTSPMediaRecordFunc record_func;
+  gpointer record_data;
+  GDestroyNotify record_notify;
+  GList *record_sinks;          /* fakesinks of the received streams */
 
   GstElement *element;
   GRecMutex state_lock;         /* locking order: state lock, lock */
@@ -132,6 +144,16 @@ struct _GstRTSPMediaPrivate
 #define DEFAULT_EOS_SHUTDOWN    FALSE
 #define DEFAULT_BUFFER_SIZE     0x80000
 #define DEFAULT_TIME_PROVIDER   FALSE
+#define DEFAULT_LOW_LATENCY     FALSE
+#define DEFAULT_GOP_CACHE       FALSE
+#define DEFAULT_ADAPTIVE_BITRATE FALSE
+#define DEFAULT_RETRANSMISSION_TIME 0
+#define DEFAULT_FEC_PERCENTAGE  0
+#define DEFAULT_PACING          FALSE
+
+/* glass-to-glass target for low-latency media, we warn when the latency
+ * reported by the pipeline exceeds this */
+#define LOW_LATENCY_BUDGET      (100 * GST_MSECOND)
 
 /* define to dump received RTCP packets */
 #undef DUMP_STATS
@@ -148,6 +170,12 @@ enum
   PROP_BUFFER_SIZE,
   PROP_ELEMENT,
   PROP_TIME_PROVIDER,
+  PROP_LOW_LATENCY,
+  PROP_GOP_CACHE,
+  PROP_ADAPTIVE_BITRATE,
+  PROP_RETRANSMISSION_TIME,
+  PROP_FEC_PERCENTAGE,
+  PROP_PACING,
   PROP_LAST
 };
 
@@ -185,6 +213,7 @@ static gboolean default_setup_sdp (GstRTSPMedia * media, GstSDPMessage * sdp,
     GstSDPInfo * info);
 
 static gboolean wait_preroll (GstRTSPMedia * media);
+static void update_adaptive_bitrate (GstRTSPMedia * media);
 
 static guint gst_rtsp_media_signals[SIGNAL_LAST] = { 0 };
 
@@ -201,6 +230,8 @@ gst_rtsp_suspend_mode_get_type (void)
         "pause"},
     {C_ENUM (GST_RTSP_SUSPEND_MODE_RESET), "GST_RTSP_SUSPEND_MODE_RESET",
         "reset"},
+    {C_ENUM (GST_RTSP_SUSPEND_MODE_STANDBY), "GST_RTSP_SUSPEND_MODE_STANDBY",
+        "standby"},
     {0, NULL, NULL}
   };
 
@@ -271,6 +302,39 @@ gst_rtsp_media_class_init (GstRTSPMediaClass * klass)
           "Use a NetTimeProvider for clients",
           DEFAULT_TIME_PROVIDER, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  g_object_class_install_property (gobject_class, PROP_LOW_LATENCY,
+      g_param_spec_boolean ("low-latency", "Low Latency",
+          "Configure the media for low-latency streaming",
+          DEFAULT_LOW_LATENCY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_GOP_CACHE,
+      g_param_spec_boolean ("gop-cache", "GOP Cache",
+          "Send the packets since the last key unit to new clients",
+          DEFAULT_GOP_CACHE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_ADAPTIVE_BITRATE,
+      g_param_spec_boolean ("adaptive-bitrate", "Adaptive Bitrate",
+          "Control the encoder bitrate with the receiver reports of the client",
+          DEFAULT_ADAPTIVE_BITRATE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_RETRANSMISSION_TIME,
+      g_param_spec_uint64 ("retransmission-time", "Retransmission Time",
+          "How long to keep packets for retransmission, 0 disables "
+          "retransmission", 0, G_MAXUINT64, DEFAULT_RETRANSMISSION_TIME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FEC_PERCENTAGE,
+      g_param_spec_uint ("fec-percentage", "FEC Percentage",
+          "The FEC overhead in percent of the media packets, 0 disables FEC",
+          0, 100, DEFAULT_FEC_PERCENTAGE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_PACING,
+      g_param_spec_boolean ("pacing", "Pacing",
+          "Spread the packets of a video frame over the frame interval",
+          DEFAULT_PACING, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_rtsp_media_signals[SIGNAL_NEW_STREAM] =
       g_signal_new ("new-stream", G_TYPE_FROM_CLASS (klass), G_SIGNAL_RUN_LAST,
       G_STRUCT_OFFSET (GstRTSPMediaClass, new_stream), NULL, NULL,
@@ -333,6 +397,12 @@ gst_rtsp_media_init (GstRTSPMedia * media)
   priv->eos_shutdown = DEFAULT_EOS_SHUTDOWN;
   priv->buffer_size = DEFAULT_BUFFER_SIZE;
   priv->time_provider = DEFAULT_TIME_PROVIDER;
+  priv->low_latency = DEFAULT_LOW_LATENCY;
+  priv->gop_cache = DEFAULT_GOP_CACHE;
+  priv->adaptive_bitrate = DEFAULT_ADAPTIVE_BITRATE;
+  priv->rtx_time = DEFAULT_RETRANSMISSION_TIME;
+  priv->fec_percentage = DEFAULT_FEC_PERCENTAGE;
+  priv->pacing = DEFAULT_PACING;
 }
 
 static void
@@ -360,6 +430,10 @@ gst_rtsp_media_finalize (GObject * obj)
   gst_object_unref (priv->element);
   if (priv->pool)
     g_object_unref (priv->pool);
+  if (priv->socket_pool)
+    g_object_unref (priv->socket_pool);
+  if (priv->record_notify)
+    priv->record_notify (priv->record_data);
   g_mutex_clear (&priv->lock);
   g_cond_clear (&priv->cond);
   g_rec_mutex_clear (&priv->state_lock);
@@ -401,6 +475,25 @@ gst_rtsp_media_get_property (GObject * object, guint propid,
     case PROP_TIME_PROVIDER:
       g_value_set_boolean (value, gst_rtsp_media_is_time_provider (media));
       break;
+    case PROP_LOW_LATENCY:
+      g_value_set_boolean (value, gst_rtsp_media_is_low_latency (media));
+      break;
+    case PROP_GOP_CACHE:
+      g_value_set_boolean (value, gst_rtsp_media_has_gop_cache (media));
+      break;
+    case PROP_ADAPTIVE_BITRATE:
+      g_value_set_boolean (value, gst_rtsp_media_is_adaptive_bitrate (media));
+      break;
+    case PROP_RETRANSMISSION_TIME:
+      g_value_set_uint64 (value,
+          gst_rtsp_media_get_retransmission_time (media));
+      break;
+    case PROP_FEC_PERCENTAGE:
+      g_value_set_uint (value, gst_rtsp_media_get_fec_percentage (media));
+      break;
+    case PROP_PACING:
+      g_value_set_boolean (value, gst_rtsp_media_is_pacing (media));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -441,6 +534,25 @@ gst_rtsp_media_set_property (GObject * object, guint propid,
     case PROP_TIME_PROVIDER:
       gst_rtsp_media_use_time_provider (media, g_value_get_boolean (value));
       break;
+    case PROP_LOW_LATENCY:
+      gst_rtsp_media_set_low_latency (media, g_value_get_boolean (value));
+      break;
+    case PROP_GOP_CACHE:
+      gst_rtsp_media_set_gop_cache (media, g_value_get_boolean (value));
+      break;
+    case PROP_ADAPTIVE_BITRATE:
+      gst_rtsp_media_set_adaptive_bitrate (media, g_value_get_boolean (value));
+      break;
+    case PROP_RETRANSMISSION_TIME:
+      gst_rtsp_media_set_retransmission_time (media,
+          g_value_get_uint64 (value));
+      break;
+    case PROP_FEC_PERCENTAGE:
+      gst_rtsp_media_set_fec_percentage (media, g_value_get_uint (value));
+      break;
+    case PROP_PACING:
+      gst_rtsp_media_set_pacing (media, g_value_get_boolean (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -760,6 +872,7 @@ gst_rtsp_media_set_shared (GstRTSPMedia * media, gboolean shared)
 
   g_mutex_lock (&priv->lock);
   priv->shared = shared;
+  update_adaptive_bitrate (media);
   g_mutex_unlock (&priv->lock);
 }
 
@@ -928,149 +1041,681 @@ GstRTSPLowerTrans
 gst_rtsp_media_get_protocols (GstRTSPMedia * media)
 {
   GstRTSPMediaPrivate *priv;
-  GstRTSPLowerTrans res;
+  GstRTSPLowerTrans res;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media),
+      GST_RTSP_LOWER_TRANS_UNKNOWN);
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  res = priv->protocols;
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_media_set_eos_shutdown:
+ * @media: a #GstRTSPMedia
+ * @eos_shutdown: the new value
+ *
+ * Set or unset if an EOS event will be sent to the pipeline for @media before
+ * it is unprepared.
+ */
+void
+gst_rtsp_media_set_eos_shutdown (GstRTSPMedia * media, gboolean eos_shutdown)
+{
+  GstRTSPMediaPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->eos_shutdown = eos_shutdown;
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_media_is_eos_shutdown:
+ * @media: a #GstRTSPMedia
+ *
+ * Check if the pipeline for @media will send an EOS down the pipeline before
+ * unpreparing.
+ *
+ * Returns: %TRUE if the media will send EOS before unpreparing.
+ */
+gboolean
+gst_rtsp_media_is_eos_shutdown (GstRTSPMedia * media)
+{
+  GstRTSPMediaPrivate *priv;
+  gboolean res;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  res = priv->eos_shutdown;
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+static void
+do_set_buffer_size (GstRTSPStream * stream, guint * size)
+{
+  gst_rtsp_stream_set_buffer_size (stream, *size);
+}
+
+/**
+ * gst_rtsp_media_set_buffer_size:
+ * @media: a #GstRTSPMedia
+ * @size: the new value
+ *
+ * Set the kernel UDP buffer size.
+ */
+void
+gst_rtsp_media_set_buffer_size (GstRTSPMedia * media, guint size)
+{
+  GstRTSPMediaPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  GST_LOG_OBJECT (media, "set buffer size %u", size);
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->buffer_size = size;
+  g_ptr_array_foreach (priv->streams, (GFunc) do_set_buffer_size, &size);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_media_get_buffer_size:
+ * @media: a #GstRTSPMedia
+ *
+ * Get the kernel UDP buffer size.
+ *
+ * Returns: the kernel UDP buffer size.
+ */
+guint
+gst_rtsp_media_get_buffer_size (GstRTSPMedia * media)
+{
+  GstRTSPMediaPrivate *priv;
+  guint res;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  res = priv->buffer_size;
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_media_use_time_provider:
+ * @media: a #GstRTSPMedia
+ * @time_provider: if a #GstNetTimeProvider should be used
+ *
+ * Set @media to provide a #GstNetTimeProvider.
+ */
+void
+gst_rtsp_media_use_time_provider (GstRTSPMedia * media, gboolean time_provider)
+{
+  GstRTSPMediaPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->time_provider = time_provider;
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_media_is_time_provider:
+ * @media: a #GstRTSPMedia
+ *
+ * Check if @media can provide a #GstNetTimeProvider for its pipeline clock.
+ *
+ * Use gst_rtsp_media_get_time_provider() to get the network clock.
+ *
+ * Returns: %TRUE if @media can provide a #GstNetTimeProvider.
+ */
+gboolean
+gst_rtsp_media_is_time_provider (GstRTSPMedia * media)
+{
+  GstRTSPMediaPrivate *priv;
+  gboolean res;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  res = priv->time_provider;
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+static void
+do_set_low_latency (GstRTSPStream * stream, gboolean * low_latency)
+{
+  gst_rtsp_stream_set_low_latency (stream, *low_latency);
+}
+
+/**
+ * gst_rtsp_media_set_low_latency:
+ * @media: a #GstRTSPMedia
+ * @low_latency: the new value
+ *
+ * Configure @media for low-latency streaming. A low-latency media uses a
+ * zero-latency rtpbin and configures its streams with small socket buffers
+ * and a pacing policy that drops late packets. See
+ * gst_rtsp_stream_set_low_latency().
+ *
+ * This does not change how @media prerolls: live media never preroll and
+ * go to PLAYING right away, other media still preroll so that they can
+ * seek.
+ *
+ * This should be configured before @media is prepared.
+ */
+void
+gst_rtsp_media_set_low_latency (GstRTSPMedia * media, gboolean low_latency)
+{
+  GstRTSPMediaPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  GST_LOG_OBJECT (media, "set low latency %d", low_latency);
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->low_latency = low_latency;
+  g_ptr_array_foreach (priv->streams, (GFunc) do_set_low_latency,
+      &low_latency);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_media_is_low_latency:
+ * @media: a #GstRTSPMedia
+ *
+ * Check if @media is configured for low-latency streaming.
+ *
+ * Returns: %TRUE if @media is configured for low-latency streaming.
+ */
+gboolean
+gst_rtsp_media_is_low_latency (GstRTSPMedia * media)
+{
+  GstRTSPMediaPrivate *priv;
+  gboolean res;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  res = priv->low_latency;
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+static void
+do_set_gop_cache (GstRTSPStream * stream, gboolean * gop_cache)
+{
+  gst_rtsp_stream_set_gop_cache (stream, *gop_cache);
+}
+
+/**
+ * gst_rtsp_media_set_gop_cache:
+ * @media: a #GstRTSPMedia
+ * @gop_cache: the new value
+ *
+ * Keep the packets since the last key unit in the streams of @media and send
+ * them to clients when they start playing, so that late joiners of a shared
+ * live media don't have to wait for the next key unit. See
+ * gst_rtsp_stream_set_gop_cache().
+ *
+ * This should be configured before @media is prepared.
+ */
+void
+gst_rtsp_media_set_gop_cache (GstRTSPMedia * media, gboolean gop_cache)
+{
+  GstRTSPMediaPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  GST_LOG_OBJECT (media, "set gop cache %d", gop_cache);
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->gop_cache = gop_cache;
+  g_ptr_array_foreach (priv->streams, (GFunc) do_set_gop_cache, &gop_cache);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_media_has_gop_cache:
+ * @media: a #GstRTSPMedia
+ *
+ * Check if the streams of @media cache the packets since the last key unit.
+ *
+ * Returns: %TRUE if @media has a GOP cache.
+ */
+gboolean
+gst_rtsp_media_has_gop_cache (GstRTSPMedia * media)
+{
+  GstRTSPMediaPrivate *priv;
+  gboolean res;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  res = priv->gop_cache;
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+static void
+do_set_adaptive_bitrate (GstRTSPStream * stream, gboolean * adaptive_bitrate)
+{
+  gst_rtsp_stream_set_adaptive_bitrate (stream, *adaptive_bitrate);
+}
+
+/* must be called with lock. The encoder of a shared media serves all
+ * clients, it can't follow the reports of one of them. */
+static void
+update_adaptive_bitrate (GstRTSPMedia * media)
+{
+  GstRTSPMediaPrivate *priv = media->priv;
+  gboolean adaptive_bitrate;
+
+  adaptive_bitrate = priv->adaptive_bitrate && !priv->shared;
+  g_ptr_array_foreach (priv->streams, (GFunc) do_set_adaptive_bitrate,
+      &adaptive_bitrate);
+}
+
+/**
+ * gst_rtsp_media_set_adaptive_bitrate:
+ * @media: a #GstRTSPMedia
+ * @adaptive_bitrate: the new value
+ *
+ * Let the RTCP receiver reports of the client control the bitrate of the
+ * encoders in @media. See gst_rtsp_stream_set_adaptive_bitrate().
+ *
+ * This only has effect when @media is not shared.
+ */
+void
+gst_rtsp_media_set_adaptive_bitrate (GstRTSPMedia * media,
+    gboolean adaptive_bitrate)
+{
+  GstRTSPMediaPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  GST_LOG_OBJECT (media, "set adaptive bitrate %d", adaptive_bitrate);
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->adaptive_bitrate = adaptive_bitrate;
+  update_adaptive_bitrate (media);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_media_is_adaptive_bitrate:
+ * @media: a #GstRTSPMedia
+ *
+ * Check if the receiver reports control the encoders of @media.
+ *
+ * Returns: %TRUE if @media adapts the encoder bitrate.
+ */
+gboolean
+gst_rtsp_media_is_adaptive_bitrate (GstRTSPMedia * media)
+{
+  GstRTSPMediaPrivate *priv;
+  gboolean res;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  res = priv->adaptive_bitrate;
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+#define PT_BIT(pt) (G_GUINT64_CONSTANT (1) << ((pt) - 96))
+
+/* returns 0 when all dynamic payload types are used */
+static guint
+take_free_pt (guint64 * used)
+{
+  guint pt;
+
+  for (pt = 96; pt <= 127; pt++) {
+    if (!(*used & PT_BIT (pt))) {
+      *used |= PT_BIT (pt);
+      return pt;
+    }
+  }
+  return 0;
+}
+
+/* must be called with lock. Give the streams that retransmit or send FEC
+ * payload types for it that are not used in @media. This is done when the
+ * media is prepared, after all payloaders are known, and for the streams of
+ * dynamic payloaders when they appear. */
+static void
+assign_payload_types (GstRTSPMedia * media)
+{
+  GstRTSPMediaPrivate *priv = media->priv;
+  guint64 used, stream_pts = 0;
+  guint i, pt;
+
+  /* dynamic payload types are 96-127 */
+  for (i = 0; i < priv->streams->len; i++) {
+    GstRTSPStream *stream = g_ptr_array_index (priv->streams, i);
+
+    if ((pt = gst_rtsp_stream_get_pt (stream)) >= 96 && pt <= 127)
+      stream_pts |= PT_BIT (pt);
+  }
+  used = stream_pts;
+
+  for (i = 0; i < priv->streams->len; i++) {
+    GstRTSPStream *stream = g_ptr_array_index (priv->streams, i);
+
+    if ((pt = gst_rtsp_stream_get_retransmission_pt (stream)) >= 96) {
+      if (stream_pts & PT_BIT (pt))
+        GST_WARNING_OBJECT (media, "retransmission pt %u is used by a stream",
+            pt);
+      used |= PT_BIT (pt);
+    }
+    if ((pt = gst_rtsp_stream_get_fec_pt (stream)) >= 96) {
+      if (stream_pts & PT_BIT (pt))
+        GST_WARNING_OBJECT (media, "FEC pt %u is used by a stream", pt);
+      used |= PT_BIT (pt);
+    }
+  }
+
+  for (i = 0; i < priv->streams->len; i++) {
+    GstRTSPStream *stream = g_ptr_array_index (priv->streams, i);
+
+    if (priv->rtx_time > 0 &&
+        gst_rtsp_stream_get_retransmission_pt (stream) == 0) {
+      if (!(pt = take_free_pt (&used)))
+        goto no_pt;
+      gst_rtsp_stream_set_retransmission_pt (stream, pt);
+    }
+    if (priv->fec_percentage > 0 && gst_rtsp_stream_get_fec_pt (stream) == 0) {
+      if (!(pt = take_free_pt (&used)))
+        goto no_pt;
+      gst_rtsp_stream_set_fec_pt (stream, pt);
+    }
+  }
+  return;
+
+  /* ERRORS */
+no_pt:
+  {
+    GST_WARNING_OBJECT (media, "no free dynamic payload types left");
+    return;
+  }
+}
+
+static void
+do_set_retransmission_time (GstRTSPStream * stream, GstClockTime * rtx_time)
+{
+  gst_rtsp_stream_set_retransmission_time (stream, *rtx_time);
+}
+
+/**
+ * gst_rtsp_media_set_retransmission_time:
+ * @media: a #GstRTSPMedia
+ * @time: the new value
+ *
+ * Keep the packets of the streams of @media for @time and retransmit them
+ * when the clients report them as lost, see
+ * gst_rtsp_stream_set_retransmission_time(). When @media is prepared, the
+ * streams get a dynamic payload type for the retransmitted packets that none
+ * of the streams use. 0 disables retransmission.
+ *
+ * This should be configured before @media is prepared.
+ */
+void
+gst_rtsp_media_set_retransmission_time (GstRTSPMedia * media,
+    GstClockTime time)
+{
+  GstRTSPMediaPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  GST_LOG_OBJECT (media, "set retransmission time %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (time));
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->rtx_time = time;
+  g_ptr_array_foreach (priv->streams, (GFunc) do_set_retransmission_time,
+      &time);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_media_get_retransmission_time:
+ * @media: a #GstRTSPMedia
+ *
+ * Get how long the packets of @media are kept for retransmission.
+ *
+ * Returns: the retransmission time, 0 when retransmission is disabled.
+ */
+GstClockTime
+gst_rtsp_media_get_retransmission_time (GstRTSPMedia * media)
+{
+  GstRTSPMediaPrivate *priv;
+  GstClockTime res;
 
-  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media),
-      GST_RTSP_LOWER_TRANS_UNKNOWN);
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), 0);
 
   priv = media->priv;
 
   g_mutex_lock (&priv->lock);
-  res = priv->protocols;
+  res = priv->rtx_time;
   g_mutex_unlock (&priv->lock);
 
   return res;
 }
 
+static void
+do_set_fec_percentage (GstRTSPStream * stream, guint * percentage)
+{
+  gst_rtsp_stream_set_fec_percentage (stream, *percentage);
+}
+
 /**
- * gst_rtsp_media_set_eos_shutdown:
+ * gst_rtsp_media_set_fec_percentage:
  * @media: a #GstRTSPMedia
- * @eos_shutdown: the new value
+ * @percentage: the FEC overhead in percent
  *
- * Set or unset if an EOS event will be sent to the pipeline for @media before
- * it is unprepared.
+ * Send FEC packets for the streams of @media, see
+ * gst_rtsp_stream_set_fec_percentage(). This lets multicast receivers recover
+ * lost packets, they can't ask for retransmissions. When @media is prepared,
+ * the streams get a dynamic payload type for the FEC packets that none of the
+ * streams use. 0 disables FEC.
+ *
+ * This should be configured before @media is prepared.
  */
 void
-gst_rtsp_media_set_eos_shutdown (GstRTSPMedia * media, gboolean eos_shutdown)
+gst_rtsp_media_set_fec_percentage (GstRTSPMedia * media, guint percentage)
 {
   GstRTSPMediaPrivate *priv;
 
   g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+  g_return_if_fail (percentage <= 100);
+
+  GST_LOG_OBJECT (media, "set FEC percentage %u", percentage);
 
   priv = media->priv;
 
   g_mutex_lock (&priv->lock);
-  priv->eos_shutdown = eos_shutdown;
+  priv->fec_percentage = percentage;
+  g_ptr_array_foreach (priv->streams, (GFunc) do_set_fec_percentage,
+      &percentage);
   g_mutex_unlock (&priv->lock);
 }
 
 /**
- * gst_rtsp_media_is_eos_shutdown:
+ * gst_rtsp_media_get_fec_percentage:
  * @media: a #GstRTSPMedia
  *
- * Check if the pipeline for @media will send an EOS down the pipeline before
- * unpreparing.
+ * Get the FEC overhead of the streams of @media.
  *
- * Returns: %TRUE if the media will send EOS before unpreparing.
+ * Returns: the FEC overhead in percent, 0 when FEC is disabled.
  */
-gboolean
-gst_rtsp_media_is_eos_shutdown (GstRTSPMedia * media)
+guint
+gst_rtsp_media_get_fec_percentage (GstRTSPMedia * media)
 {
   GstRTSPMediaPrivate *priv;
-  gboolean res;
+  guint res;
 
-  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), 0);
 
   priv = media->priv;
 
   g_mutex_lock (&priv->lock);
-  res = priv->eos_shutdown;
+  res = priv->fec_percentage;
   g_mutex_unlock (&priv->lock);
 
   return res;
 }
 
+static void
+do_set_pacing (GstRTSPStream * stream, gboolean * pacing)
+{
+  gst_rtsp_stream_set_pacing (stream, *pacing);
+}
+
 /**
- * gst_rtsp_media_set_buffer_size:
+ * gst_rtsp_media_set_pacing:
  * @media: a #GstRTSPMedia
- * @size: the new value
+ * @pacing: the new value
  *
- * Set the kernel UDP buffer size.
+ * Pace the video packets that the streams of @media send to unicast UDP
+ * clients, see gst_rtsp_stream_set_pacing(). The packets of a keyframe then
+ * don't leave in one burst that overruns the queues of the network.
+ *
+ * This should be configured before @media is prepared.
  */
 void
-gst_rtsp_media_set_buffer_size (GstRTSPMedia * media, guint size)
+gst_rtsp_media_set_pacing (GstRTSPMedia * media, gboolean pacing)
 {
   GstRTSPMediaPrivate *priv;
 
   g_return_if_fail (GST_IS_RTSP_MEDIA (media));
 
-  GST_LOG_OBJECT (media, "set buffer size %u", size);
+  GST_LOG_OBJECT (media, "set pacing %d", pacing);
 
   priv = media->priv;
 
   g_mutex_lock (&priv->lock);
-  priv->buffer_size = size;
+  priv->pacing = pacing;
+  g_ptr_array_foreach (priv->streams, (GFunc) do_set_pacing, &pacing);
   g_mutex_unlock (&priv->lock);
 }
 
 /**
- * gst_rtsp_media_get_buffer_size:
+ * gst_rtsp_media_is_pacing:
  * @media: a #GstRTSPMedia
  *
- * Get the kernel UDP buffer size.
+ * Check if the packets of the streams of @media are paced.
  *
- * Returns: the kernel UDP buffer size.
+ * Returns: %TRUE if the packets of @media are paced.
  */
-guint
-gst_rtsp_media_get_buffer_size (GstRTSPMedia * media)
+gboolean
+gst_rtsp_media_is_pacing (GstRTSPMedia * media)
 {
   GstRTSPMediaPrivate *priv;
-  guint res;
+  gboolean res;
 
   g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), FALSE);
 
   priv = media->priv;
 
-  g_mutex_unlock (&priv->lock);
-  res = priv->buffer_size;
+  g_mutex_lock (&priv->lock);
+  res = priv->pacing;
   g_mutex_unlock (&priv->lock);
 
   return res;
 }
 
 /**
- * gst_rtsp_media_use_time_provider:
+ * gst_rtsp_media_set_record_func:
  * @media: a #GstRTSPMedia
- * @time_provider: if a #GstNetTimeProvider should be used
+ * @func: (allow-none): a #GstRTSPMediaRecordFunc
+ * @user_data: (closure): user data passed to @func
+ * @notify: (allow-none): called when @user_data is no longer in use
  *
- * Set @media to provide a #GstNetTimeProvider.
+ * Make @media a record media. The RTP that clients send to the streams of a
+ * record media after RECORD is not depayloaded, each packet is passed to
+ * @func as it leaves the jitterbuffer. The payloaders pay\%d of a record
+ * media only describe the streams, a record media is prepared without waiting
+ * for them to produce data.
+ *
+ * This should be configured before @media is prepared.
  */
 void
-gst_rtsp_media_use_time_provider (GstRTSPMedia * media, gboolean time_provider)
+gst_rtsp_media_set_record_func (GstRTSPMedia * media,
+    GstRTSPMediaRecordFunc func, gpointer user_data, GDestroyNotify notify)
 {
   GstRTSPMediaPrivate *priv;
+  GDestroyNotify old_notify;
+  gpointer old_data;
 
   g_return_if_fail (GST_IS_RTSP_MEDIA (media));
 
   priv = media->priv;
 
   g_mutex_lock (&priv->lock);
-  priv->time_provider = time_provider;
+  old_notify = priv->record_notify;
+  old_data = priv->record_data;
+  priv->record_func = func;
+  priv->record_data = user_data;
+  priv->record_notify = notify;
   g_mutex_unlock (&priv->lock);
+
+  if (old_notify)
+    old_notify (old_data);
 }
 
 /**
- * gst_rtsp_media_is_time_provider:
+ * gst_rtsp_media_is_record:
  * @media: a #GstRTSPMedia
  *
- * Check if @media can provide a #GstNetTimeProvider for its pipeline clock.
- *
- * Use gst_rtsp_media_get_time_provider() to get the network clock.
+ * Check if @media receives RTP from clients with RECORD.
  *
- * Returns: %TRUE if @media can provide a #GstNetTimeProvider.
+ * Returns: %TRUE if @media is a record media.
  */
 gboolean
-gst_rtsp_media_is_time_provider (GstRTSPMedia * media)
+gst_rtsp_media_is_record (GstRTSPMedia * media)
 {
   GstRTSPMediaPrivate *priv;
   gboolean res;
@@ -1079,8 +1724,8 @@ gst_rtsp_media_is_time_provider (GstRTSPMedia * media)
 
   priv = media->priv;
 
-  g_mutex_unlock (&priv->lock);
-  res = priv->time_provider;
+  g_mutex_lock (&priv->lock);
+  res = priv->record_func != NULL;
   g_mutex_unlock (&priv->lock);
 
   return res;
@@ -1146,6 +1791,66 @@ gst_rtsp_media_get_address_pool (GstRTSPMedia * media)
   return result;
 }
 
+/**
+ * gst_rtsp_media_set_socket_pool:
+ * @media: a #GstRTSPMedia
+ * @pool: (allow-none): a #GstRTSPSocketPool
+ *
+ * configure @pool to provide the bound server sockets of the streams of
+ * @media.
+ */
+void
+gst_rtsp_media_set_socket_pool (GstRTSPMedia * media, GstRTSPSocketPool * pool)
+{
+  GstRTSPMediaPrivate *priv;
+  GstRTSPSocketPool *old;
+
+  g_return_if_fail (GST_IS_RTSP_MEDIA (media));
+
+  priv = media->priv;
+
+  GST_LOG_OBJECT (media, "set socket pool %p", pool);
+
+  g_mutex_lock (&priv->lock);
+  if ((old = priv->socket_pool) != pool)
+    priv->socket_pool = pool ? g_object_ref (pool) : NULL;
+  else
+    old = NULL;
+  g_ptr_array_foreach (priv->streams, (GFunc) gst_rtsp_stream_set_socket_pool,
+      pool);
+  g_mutex_unlock (&priv->lock);
+
+  if (old)
+    g_object_unref (old);
+}
+
+/**
+ * gst_rtsp_media_get_socket_pool:
+ * @media: a #GstRTSPMedia
+ *
+ * Get the #GstRTSPSocketPool used for the server sockets of @media.
+ *
+ * Returns: (transfer full): the #GstRTSPSocketPool of @media. g_object_unref()
+ * after usage.
+ */
+GstRTSPSocketPool *
+gst_rtsp_media_get_socket_pool (GstRTSPMedia * media)
+{
+  GstRTSPMediaPrivate *priv;
+  GstRTSPSocketPool *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), NULL);
+
+  priv = media->priv;
+
+  g_mutex_lock (&priv->lock);
+  if ((result = priv->socket_pool))
+    g_object_ref (result);
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
+
 /**
  * gst_rtsp_media_collect_streams:
  * @media: a #GstRTSPMedia
@@ -1153,6 +1858,10 @@ gst_rtsp_media_get_address_pool (GstRTSPMedia * media)
  * Find all payloader elements, they should be named pay\%d in the
  * element of @media, and create #GstRTSPStreams for them.
  *
+ * Payloaders named pay\%d_\%d are added as layers 1, 2, ... of the stream
+ * with the same first number, see gst_rtsp_stream_add_layer(). They should
+ * encode the same source at lower bitrates.
+ *
  * Collect all dynamic elements, named dynpay\%d, and add them to
  * the list of dynamic elements.
  */
@@ -1161,8 +1870,9 @@ gst_rtsp_media_collect_streams (GstRTSPMedia * media)
 {
   GstRTSPMediaPrivate *priv;
   GstElement *element, *elem;
-  GstPad *pad;
-  gint i;
+  GstRTSPStream *stream;
+  GstPad *pad, *srcpad;
+  gint i, j;
   gboolean have_elem;
 
   g_return_if_fail (GST_IS_RTSP_MEDIA (media));
@@ -1183,10 +1893,31 @@ gst_rtsp_media_collect_streams (GstRTSPMedia * media)
       /* take the pad of the payloader */
       pad = gst_element_get_static_pad (elem, "src");
       /* create the stream */
-      gst_rtsp_media_create_stream (media, elem, pad);
+      stream = gst_rtsp_media_create_stream (media, elem, pad);
       gst_object_unref (pad);
       gst_object_unref (elem);
 
+      /* and the other encodings of the stream */
+      for (j = 1;; j++) {
+        g_free (name);
+        name = g_strdup_printf ("pay%d_%d", i, j);
+        if (!(elem = gst_bin_get_by_name (GST_BIN (element), name)))
+          break;
+
+        GST_INFO ("found layer %d of stream %d with payloader %p", j, i, elem);
+
+        /* the layer is linked outside of the element, like the stream */
+        pad = gst_element_get_static_pad (elem, "src");
+        g_free (name);
+        name = g_strdup_printf ("src_%d_%d", i, j);
+        srcpad = gst_ghost_pad_new (name, pad);
+        gst_pad_set_active (srcpad, TRUE);
+        gst_element_add_pad (element, srcpad);
+        gst_rtsp_stream_add_layer (stream, elem, srcpad);
+        gst_object_unref (pad);
+        gst_object_unref (elem);
+      }
+
       have_elem = TRUE;
     }
     g_free (name);
@@ -1250,7 +1981,17 @@ gst_rtsp_media_create_stream (GstRTSPMedia * media, GstElement * payloader,
   stream = gst_rtsp_stream_new (idx, payloader, srcpad);
   if (priv->pool)
     gst_rtsp_stream_set_address_pool (stream, priv->pool);
+  if (priv->socket_pool)
+    gst_rtsp_stream_set_socket_pool (stream, priv->socket_pool);
   gst_rtsp_stream_set_protocols (stream, priv->protocols);
+  gst_rtsp_stream_set_buffer_size (stream, priv->buffer_size);
+  gst_rtsp_stream_set_low_latency (stream, priv->low_latency);
+  gst_rtsp_stream_set_gop_cache (stream, priv->gop_cache);
+  gst_rtsp_stream_set_adaptive_bitrate (stream, priv->adaptive_bitrate &&
+      !priv->shared);
+  gst_rtsp_stream_set_retransmission_time (stream, priv->rtx_time);
+  gst_rtsp_stream_set_fec_percentage (stream, priv->fec_percentage);
+  gst_rtsp_stream_set_pacing (stream, priv->pacing);
 
   g_ptr_array_add (priv->streams, stream);
   g_mutex_unlock (&priv->lock);
@@ -1460,6 +2201,20 @@ stream_update_blocked (GstRTSPStream * stream, GstRTSPMedia * media)
   gst_rtsp_stream_set_blocked (stream, media->priv->blocked);
 }
 
+static void
+stream_set_standby (GstRTSPStream * stream, gboolean * standby)
+{
+  gst_rtsp_stream_set_standby (stream, *standby);
+}
+
+static void
+media_streams_set_standby (GstRTSPMedia * media, gboolean standby)
+{
+  GST_DEBUG ("media %p set standby %d", media, standby);
+  g_ptr_array_foreach (media->priv->streams, (GFunc) stream_set_standby,
+      &standby);
+}
+
 static void
 media_streams_set_blocked (GstRTSPMedia * media, gboolean blocked)
 {
@@ -1720,6 +2475,111 @@ set_target_state (GstRTSPMedia * media, GstState state, gboolean do_state)
   return ret;
 }
 
+/**
+ * gst_rtsp_media_get_latency_report:
+ * @media: a #GstRTSPMedia
+ *
+ * Collect the latency budget of @media per stage. All values are in
+ * nanoseconds. The "stream-N" fields contain the latency of the capture,
+ * encoding and payloading stages of stream N, "rtpbin" contains the latency
+ * configured on the RTP session manager and "total" the latency of the
+ * complete pipeline. The "budget" field contains the glass-to-glass target
+ * for low-latency media.
+ *
+ * Returns: (transfer full) (nullable): a #GstStructure with the latency report
+ * or %NULL when @media is not prepared. gst_structure_free() after usage.
+ */
+GstStructure *
+gst_rtsp_media_get_latency_report (GstRTSPMedia * media)
+{
+  GstRTSPMediaPrivate *priv;
+  GstStructure *report;
+  GstQuery *query;
+  GPtrArray *pads;
+  GstClockTime min;
+  gboolean live;
+  guint i, latency;
+
+  g_return_val_if_fail (GST_IS_RTSP_MEDIA (media), NULL);
+
+  priv = media->priv;
+
+  g_rec_mutex_lock (&priv->state_lock);
+  if (priv->status != GST_RTSP_MEDIA_STATUS_PREPARED &&
+      priv->status != GST_RTSP_MEDIA_STATUS_PREPARING)
+    goto not_prepared;
+
+  report = gst_structure_new ("GstRTSPLatencyReport",
+      "budget", G_TYPE_UINT64, (guint64) LOW_LATENCY_BUDGET, NULL);
+
+  /* don't query the pads with the lock, the query travels upstream */
+  pads = g_ptr_array_new_with_free_func (gst_object_unref);
+  g_mutex_lock (&priv->lock);
+  for (i = 0; i < priv->streams->len; i++) {
+    GstRTSPStream *stream = g_ptr_array_index (priv->streams, i);
+
+    g_ptr_array_add (pads, gst_rtsp_stream_get_srcpad (stream));
+  }
+  g_mutex_unlock (&priv->lock);
+
+  for (i = 0; i < pads->len; i++) {
+    gchar *name;
+
+    query = gst_query_new_latency ();
+    if (gst_pad_query (g_ptr_array_index (pads, i), query)) {
+      gst_query_parse_latency (query, &live, &min, NULL);
+      name = g_strdup_printf ("stream-%u", i);
+      gst_structure_set (report, name, G_TYPE_UINT64, (guint64) min, NULL);
+      g_free (name);
+    }
+    gst_query_unref (query);
+  }
+  g_ptr_array_unref (pads);
+
+  g_object_get (priv->rtpbin, "latency", &latency, NULL);
+  gst_structure_set (report, "rtpbin", G_TYPE_UINT64,
+      (guint64) latency * GST_MSECOND, NULL);
+
+  query = gst_query_new_latency ();
+  if (gst_element_query (priv->pipeline, query)) {
+    gst_query_parse_latency (query, &live, &min, NULL);
+    gst_structure_set (report, "total", G_TYPE_UINT64, (guint64) min, NULL);
+  }
+  gst_query_unref (query);
+  g_rec_mutex_unlock (&priv->state_lock);
+
+  return report;
+
+  /* ERRORS */
+not_prepared:
+  {
+    GST_DEBUG_OBJECT (media, "media %p was not prepared", media);
+    g_rec_mutex_unlock (&priv->state_lock);
+    return NULL;
+  }
+}
+
+/* called with state-lock */
+static void
+check_latency_budget (GstRTSPMedia * media)
+{
+  GstStructure *report;
+  GstClockTime total;
+
+  if (!(report = gst_rtsp_media_get_latency_report (media)))
+    return;
+
+  GST_INFO ("media %p latency report %" GST_PTR_FORMAT, media, report);
+
+  if (gst_structure_get_clock_time (report, "total", &total) &&
+      total > LOW_LATENCY_BUDGET) {
+    GST_WARNING ("media %p latency %" GST_TIME_FORMAT " exceeds budget %"
+        GST_TIME_FORMAT, media, GST_TIME_ARGS (total),
+        GST_TIME_ARGS (LOW_LATENCY_BUDGET));
+  }
+  gst_structure_free (report);
+}
+
 /* called with state-lock */
 static gboolean
 default_handle_message (GstRTSPMedia * media, GstMessage * message)
@@ -1770,6 +2630,8 @@ default_handle_message (GstRTSPMedia * media, GstMessage * message)
     case GST_MESSAGE_LATENCY:
     {
       gst_bin_recalculate_latency (GST_BIN_CAST (priv->pipeline));
+      if (priv->low_latency)
+        check_latency_budget (media);
       break;
     }
     case GST_MESSAGE_ERROR:
@@ -1919,6 +2781,12 @@ pad_added_cb (GstElement * element, GstPad * pad, GstRTSPMedia * media)
   stream = gst_rtsp_media_create_stream (media, pay, pad);
   gst_object_unref (pay);
 
+  /* the other streams already have their payload types, give the new stream
+   * the ones that are still free */
+  g_mutex_lock (&priv->lock);
+  assign_payload_types (media);
+  g_mutex_unlock (&priv->lock);
+
   g_object_set_data (G_OBJECT (pad), "gst-rtsp-dynpad-stream", stream);
 
   GST_INFO ("pad added %s:%s, stream %p", GST_DEBUG_PAD_NAME (pad), stream);
@@ -1985,6 +2853,125 @@ no_more_pads_cb (GstElement * element, GstRTSPMedia * media)
   remove_fakesink (priv);
 }
 
+typedef struct
+{
+  GstRTSPMedia *media;          /* not reffed, outlives the sink */
+  guint idx;
+} RecordPad;
+
+static void
+record_pad_free (RecordPad * rpad)
+{
+  g_slice_free (RecordPad, rpad);
+}
+
+/* called from the streaming thread */
+static GstPadProbeReturn
+record_probe (GstPad * pad, GstPadProbeInfo * info, RecordPad * rpad)
+{
+  GstRTSPMediaPrivate *priv = rpad->media->priv;
+  GstRTSPMediaRecordFunc func;
+  gpointer user_data;
+
+  /* the func is only replaced before prepare or in finalize, after the
+   * streaming threads are stopped */
+  g_mutex_lock (&priv->lock);
+  func = priv->record_func;
+  user_data = priv->record_data;
+  g_mutex_unlock (&priv->lock);
+
+  if (func)
+    func (rpad->media, rpad->idx, GST_PAD_PROBE_INFO_BUFFER (info), user_data);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* called from streaming threads */
+static void
+record_pad_added_cb (GstElement * rtpbin, GstPad * pad, GstRTSPMedia * media)
+{
+  GstRTSPMediaPrivate *priv = media->priv;
+  GstElement *sink;
+  GstPad *sinkpad;
+  RecordPad *rpad;
+  guint idx, ssrc, pt;
+
+  if (sscanf (GST_PAD_NAME (pad), "recv_rtp_src_%u_%u_%u", &idx, &ssrc,
+          &pt) != 3)
+    return;
+
+  GST_INFO ("recording stream %u from SSRC %08x with pt %u", idx, ssrc, pt);
+
+  /* the packets don't go anywhere, they are handed to the record func in
+   * a probe on a sink that just consumes them */
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (sink, "sync", FALSE, "async", FALSE, "enable-last-sample",
+      FALSE, NULL);
+
+  rpad = g_slice_new (RecordPad);
+  rpad->media = media;
+  rpad->idx = idx;
+
+  sinkpad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_add_probe (sinkpad, GST_PAD_PROBE_TYPE_BUFFER,
+      (GstPadProbeCallback) record_probe, rpad,
+      (GDestroyNotify) record_pad_free);
+
+  g_mutex_lock (&priv->lock);
+  priv->record_sinks = g_list_prepend (priv->record_sinks,
+      gst_object_ref (sink));
+  g_mutex_unlock (&priv->lock);
+
+  gst_bin_add (GST_BIN (priv->pipeline), sink);
+  gst_element_sync_state_with_parent (sink);
+  gst_pad_link (pad, sinkpad);
+  gst_object_unref (sinkpad);
+}
+
+/* the caps of the RTP that the recording clients send are the caps of the
+ * payloaders */
+static GstCaps *
+record_request_pt_map_cb (GstElement * rtpbin, guint session, guint pt,
+    GstRTSPMedia * media)
+{
+  GstRTSPStream *stream;
+  GstCaps *caps = NULL;
+  GstPad *srcpad;
+
+  if (!(stream = gst_rtsp_media_get_stream (media, session)))
+    return NULL;
+
+  srcpad = gst_rtsp_stream_get_srcpad (stream);
+  caps = gst_pad_query_caps (srcpad, NULL);
+  gst_object_unref (srcpad);
+
+  if (!gst_caps_is_fixed (caps)) {
+    GST_WARNING ("stream %u has no fixed caps for pt %u", session, pt);
+    gst_caps_unref (caps);
+    return NULL;
+  }
+  return caps;
+}
+
+static void
+remove_record_sinks (GstRTSPMediaPrivate * priv)
+{
+  GList *sinks, *walk;
+
+  g_mutex_lock (&priv->lock);
+  sinks = priv->record_sinks;
+  priv->record_sinks = NULL;
+  g_mutex_unlock (&priv->lock);
+
+  for (walk = sinks; walk; walk = g_list_next (walk)) {
+    GstElement *sink = walk->data;
+
+    gst_bin_remove (GST_BIN (priv->pipeline), sink);
+    gst_element_set_state (sink, GST_STATE_NULL);
+  }
+  g_list_free_full (sinks, gst_object_unref);
+}
+
 typedef struct _DynPaySignalHandlers DynPaySignalHandlers;
 
 struct _DynPaySignalHandlers
@@ -2000,6 +2987,23 @@ start_preroll (GstRTSPMedia * media)
   GstRTSPMediaPrivate *priv = media->priv;
   GstStateChangeReturn ret;
 
+  if (priv->record_func) {
+    /* a record media only receives, the payloaders describe the streams but
+     * don't produce the data that a preroll would wait for */
+    GST_INFO ("record media %p, skipping preroll", media);
+    priv->seekable = FALSE;
+    priv->is_live = TRUE;
+    set_target_state (media, GST_STATE_PAUSED, FALSE);
+    ret = set_state (media, GST_STATE_PLAYING);
+    if (ret == GST_STATE_CHANGE_FAILURE)
+      goto state_failed;
+
+    collect_media_stats (media);
+    gst_rtsp_media_set_status (media, GST_RTSP_MEDIA_STATUS_PREPARED);
+
+    return TRUE;
+  }
+
   GST_INFO ("setting pipeline to PAUSED for media %p", media);
   /* first go to PAUSED */
   ret = set_target_state (media, GST_STATE_PAUSED, TRUE);
@@ -2175,8 +3179,25 @@ gst_rtsp_media_prepare (GstRTSPMedia * media, GstRTSPThread * thread)
   if (priv->rtpbin == NULL)
     goto no_rtpbin;
 
+  if (priv->low_latency) {
+    /* no jitterbuffer latency for low-latency media */
+    g_object_set (priv->rtpbin, "latency", 0, NULL);
+  }
+
+  if (priv->record_func) {
+    g_signal_connect (priv->rtpbin, "pad-added",
+        (GCallback) record_pad_added_cb, media);
+    g_signal_connect (priv->rtpbin, "request-pt-map",
+        (GCallback) record_request_pt_map_cb, media);
+  }
+
   GST_INFO ("preparing media %p", media);
 
+  /* all payloaders are known now */
+  g_mutex_lock (&priv->lock);
+  assign_payload_types (media);
+  g_mutex_unlock (&priv->lock);
+
   /* reset some variables */
   priv->is_live = FALSE;
   priv->seekable = FALSE;
@@ -2279,6 +3300,7 @@ finish_unprepare (GstRTSPMedia * media)
 
   set_state (media, GST_STATE_NULL);
   remove_fakesink (priv);
+  remove_record_sinks (priv);
 
   for (i = 0; i < priv->streams->len; i++) {
     GstRTSPStream *stream;
@@ -2632,6 +3654,22 @@ gst_rtsp_media_suspend (GstRTSPMedia * media)
       if (ret == GST_STATE_CHANGE_FAILURE)
         goto state_failed;
       break;
+    case GST_RTSP_SUSPEND_MODE_STANDBY:
+      /* drop the data before the streams are unblocked below */
+      media_streams_set_standby (media, TRUE);
+      if (priv->is_live) {
+        /* keep the live sources and encoders running, the target state
+         * remains PAUSED */
+        GST_DEBUG ("media %p suspend to standby", media);
+        ret = set_state (media, GST_STATE_PLAYING);
+      } else {
+        /* a non-live media would run to the end, pause it instead */
+        GST_DEBUG ("media %p suspend to PAUSED", media);
+        ret = set_target_state (media, GST_STATE_PAUSED, TRUE);
+      }
+      if (ret == GST_STATE_CHANGE_FAILURE)
+        goto state_failed;
+      break;
     default:
       break;
   }
@@ -2686,6 +3724,11 @@ gst_rtsp_media_unsuspend (GstRTSPMedia * media)
     case GST_RTSP_SUSPEND_MODE_PAUSE:
       priv->status = GST_RTSP_MEDIA_STATUS_PREPARED;
       break;
+    case GST_RTSP_SUSPEND_MODE_STANDBY:
+      /* the pipeline is still running, only let the data through again */
+      media_streams_set_standby (media, FALSE);
+      priv->status = GST_RTSP_MEDIA_STATUS_PREPARED;
+      break;
     case GST_RTSP_SUSPEND_MODE_RESET:
     {
       priv->status = GST_RTSP_MEDIA_STATUS_PREPARING;
@@ -2741,7 +3784,10 @@ media_set_pipeline_state_locked (GstRTSPMedia * media, GstState state)
         /* make sure pads are not blocking anymore when going to PLAYING */
         media_streams_set_blocked (media, FALSE);
 
-      set_state (media, state);
+      /* in standby a live pipeline keeps running when paused */
+      if (state != GST_STATE_PAUSED || !priv->is_live ||
+          priv->suspend_mode != GST_RTSP_SUSPEND_MODE_STANDBY)
+        set_state (media, state);
 
       /* and suspend after pause */
       if (state == GST_STATE_PAUSED)
@@ -67,6 +67,8 @@ typedef enum {
  * @GST_RTSP_SUSPEND_MODE_NONE: Media is not suspended
  * @GST_RTSP_SUSPEND_MODE_PAUSE: Media is PAUSED in suspend
  * @GST_RTSP_SUSPEND_MODE_RESET: The media is set to NULL when suspended
+ * @GST_RTSP_SUSPEND_MODE_STANDBY: A live media keeps PLAYING when suspended
+ *   but the data of the payloaders is dropped
  *
  * The suspend mode of the media pipeline. A media pipeline is suspended right
  * after creating the SDP and when the client preforms a PAUSED request.
@@ -74,7 +76,8 @@ typedef enum {
 typedef enum {
   GST_RTSP_SUSPEND_MODE_NONE   = 0,
   GST_RTSP_SUSPEND_MODE_PAUSE  = 1,
-  GST_RTSP_SUSPEND_MODE_RESET  = 2
+  GST_RTSP_SUSPEND_MODE_RESET  = 2,
+  GST_RTSP_SUSPEND_MODE_STANDBY = 3
 } GstRTSPSuspendMode;
 
 #define GST_TYPE_RTSP_SUSPEND_MODE (gst_rtsp_suspend_mode_get_type())
@@ -86,6 +89,19 @@ GType gst_rtsp_suspend_mode_get_type (void);
 #include "rtsp-address-pool.h"
 #include "rtsp-sdp.h"
 
+/**
+ * GstRTSPMediaRecordFunc:
+ * @media: a #GstRTSPMedia
+ * @idx: the index of the stream that received @buffer
+ * @buffer: (transfer none): an RTP packet
+ * @user_data: user data when registering the callback
+ *
+ * Called from the streaming thread for each RTP packet that a recording
+ * client sent for stream @idx of @media, after it left the jitterbuffer.
+ */
+typedef void (*GstRTSPMediaRecordFunc) (GstRTSPMedia *media, guint idx,
+                                        GstBuffer *buffer, gpointer user_data);
+
 /**
  * GstRTSPMedia:
  *
@@ -173,6 +189,9 @@ gboolean              gst_rtsp_media_is_eos_shutdown  (GstRTSPMedia *media);
 void                  gst_rtsp_media_set_address_pool (GstRTSPMedia *media, GstRTSPAddressPool *pool);
 GstRTSPAddressPool *  gst_rtsp_media_get_address_pool (GstRTSPMedia *media);
 
+void                  gst_rtsp_media_set_socket_pool  (GstRTSPMedia *media, GstRTSPSocketPool *pool);
+GstRTSPSocketPool *   gst_rtsp_media_get_socket_pool  (GstRTSPMedia *media);
+
 void                  gst_rtsp_media_set_buffer_size  (GstRTSPMedia *media, guint size);
 guint                 gst_rtsp_media_get_buffer_size  (GstRTSPMedia *media);
 
@@ -181,6 +200,26 @@ gboolean              gst_rtsp_media_is_time_provider  (GstRTSPMedia *media);
 GstNetTimeProvider *  gst_rtsp_media_get_time_provider (GstRTSPMedia *media,
                                                         const gchar *address, guint16 port);
 
+void                  gst_rtsp_media_set_low_latency  (GstRTSPMedia *media, gboolean low_latency);
+gboolean              gst_rtsp_media_is_low_latency   (GstRTSPMedia *media);
+void                  gst_rtsp_media_set_gop_cache    (GstRTSPMedia *media, gboolean gop_cache);
+gboolean              gst_rtsp_media_has_gop_cache    (GstRTSPMedia *media);
+void                  gst_rtsp_media_set_adaptive_bitrate (GstRTSPMedia *media, gboolean adaptive_bitrate);
+gboolean              gst_rtsp_media_is_adaptive_bitrate  (GstRTSPMedia *media);
+void                  gst_rtsp_media_set_retransmission_time (GstRTSPMedia *media, GstClockTime time);
+GstClockTime          gst_rtsp_media_get_retransmission_time (GstRTSPMedia *media);
+void                  gst_rtsp_media_set_fec_percentage (GstRTSPMedia *media, guint percentage);
+guint                 gst_rtsp_media_get_fec_percentage (GstRTSPMedia *media);
+void                  gst_rtsp_media_set_pacing       (GstRTSPMedia *media, gboolean pacing);
+gboolean              gst_rtsp_media_is_pacing        (GstRTSPMedia *media);
+GstStructure *        gst_rtsp_media_get_latency_report (GstRTSPMedia *media);
+
+void                  gst_rtsp_media_set_record_func  (GstRTSPMedia *media,
+                                                       GstRTSPMediaRecordFunc func,
+                                                       gpointer user_data,
+                                                       GDestroyNotify notify);
+gboolean              gst_rtsp_media_is_record        (GstRTSPMedia *media);
+
 /* prepare the media for playback */
 gboolean              gst_rtsp_media_prepare          (GstRTSPMedia *media, GstRTSPThread *thread);
 gboolean              gst_rtsp_media_unprepare        (GstRTSPMedia *media);
@@ -0,0 +1,422 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* The relays connect the publishers of RTP, like the record media of an
+ * ingest factory or the upstream session of a proxy factory, with the appsrcs
+ * in the media that serve the RTP to clients. The packets are not
+ * depayloaded, only the SSRC, the sequence numbers and the timestamps are
+ * rewritten for each appsrc. A relay is freed when the last publisher,
+ * factory or appsrc that uses it is gone. */
+
+#include <gst/app/gstappsrc.h>
+
+#include "rtsp-relay.h"
+
+struct _GstRTSPRelay
+{
+  gint refcount;                /* protected by relay_lock */
+  gchar *name;
+
+  GMutex lock;                  /* protects the fields below */
+  GPtrArray *caps;              /* GstCaps of the streams */
+  guint serial;                 /* changes with the caps */
+  gpointer publisher;           /* not reffed */
+  GList *users;                 /* RelayUser */
+};
+
+typedef struct
+{
+  GstRTSPRelay *relay;
+  GstAppSrc *appsrc;            /* not reffed */
+  guint idx;
+  guint serial;
+  guint32 ssrc;
+  gint clock_rate;
+  gboolean have_offset;
+  guint32 in_ssrc;
+  guint16 seq_offset;
+  guint16 next_seq;
+  guint32 ts_offset;
+  guint32 last_ts;
+  gint64 last_time;             /* monotonic time of last_ts */
+} RelayUser;
+
+GST_DEBUG_CATEGORY_STATIC (rtsp_relay_debug);
+#define GST_CAT_DEFAULT rtsp_relay_debug
+
+static GMutex relay_lock;
+static GHashTable *relay_table; /* protected by relay_lock */
+
+#define RELAY_LOCK(r)   (g_mutex_lock (&(r)->lock))
+#define RELAY_UNLOCK(r) (g_mutex_unlock (&(r)->lock))
+
+/* a new ref to the relay @name, gst_rtsp_relay_unref() after usage */
+GstRTSPRelay *
+gst_rtsp_relay_get (const gchar * name)
+{
+  GstRTSPRelay *relay;
+
+  g_return_val_if_fail (name != NULL, NULL);
+
+  g_mutex_lock (&relay_lock);
+  if (relay_table == NULL) {
+    relay_table = g_hash_table_new (g_str_hash, g_str_equal);
+    GST_DEBUG_CATEGORY_INIT (rtsp_relay_debug, "rtsprelay", 0,
+        "GstRTSPRelay");
+  }
+
+  relay = g_hash_table_lookup (relay_table, name);
+  if (relay == NULL) {
+    relay = g_slice_new0 (GstRTSPRelay);
+    relay->name = g_strdup (name);
+    g_mutex_init (&relay->lock);
+    g_hash_table_insert (relay_table, relay->name, relay);
+  }
+  relay->refcount++;
+  g_mutex_unlock (&relay_lock);
+
+  return relay;
+}
+
+static GstRTSPRelay *
+relay_ref (GstRTSPRelay * relay)
+{
+  g_mutex_lock (&relay_lock);
+  relay->refcount++;
+  g_mutex_unlock (&relay_lock);
+
+  return relay;
+}
+
+void
+gst_rtsp_relay_unref (GstRTSPRelay * relay)
+{
+  g_return_if_fail (relay != NULL);
+
+  g_mutex_lock (&relay_lock);
+  if (--relay->refcount > 0) {
+    g_mutex_unlock (&relay_lock);
+    return;
+  }
+  g_hash_table_remove (relay_table, relay->name);
+  g_mutex_unlock (&relay_lock);
+
+  GST_INFO ("relay %s is no longer used", relay->name);
+
+  if (relay->caps)
+    g_ptr_array_unref (relay->caps);
+  g_mutex_clear (&relay->lock);
+  g_free (relay->name);
+  g_slice_free (GstRTSPRelay, relay);
+}
+
+static gboolean
+caps_are_equal (GPtrArray * caps1, GPtrArray * caps2)
+{
+  guint i;
+
+  if (caps1 == NULL || caps2 == NULL || caps1->len != caps2->len)
+    return FALSE;
+
+  for (i = 0; i < caps1->len; i++) {
+    if (!gst_caps_is_equal (g_ptr_array_index (caps1, i),
+            g_ptr_array_index (caps2, i)))
+      return FALSE;
+  }
+  return TRUE;
+}
+
+/* makes @publisher the publisher of @relay with the streams in @caps, takes
+ * ownership of @caps. The users of earlier announcements keep receiving when
+ * the streams did not change. */
+gboolean
+gst_rtsp_relay_announce (GstRTSPRelay * relay, gpointer publisher,
+    GPtrArray * caps)
+{
+  g_return_val_if_fail (relay != NULL, FALSE);
+  g_return_val_if_fail (publisher != NULL, FALSE);
+  g_return_val_if_fail (caps != NULL, FALSE);
+
+  RELAY_LOCK (relay);
+  if (relay->publisher != NULL && relay->publisher != publisher)
+    goto busy;
+
+  if (caps_are_equal (relay->caps, caps)) {
+    g_ptr_array_unref (caps);
+  } else {
+    if (relay->caps)
+      g_ptr_array_unref (relay->caps);
+    relay->caps = caps;
+    relay->serial++;
+  }
+  relay->publisher = publisher;
+  GST_INFO ("relay %s announced with %u streams", relay->name,
+      relay->caps->len);
+  RELAY_UNLOCK (relay);
+
+  return TRUE;
+
+  /* ERRORS */
+busy:
+  {
+    RELAY_UNLOCK (relay);
+    GST_WARNING ("relay %s already has a publisher", relay->name);
+    g_ptr_array_unref (caps);
+    return FALSE;
+  }
+}
+
+void
+gst_rtsp_relay_unpublish (GstRTSPRelay * relay, gpointer publisher)
+{
+  g_return_if_fail (relay != NULL);
+
+  RELAY_LOCK (relay);
+  if (relay->publisher == publisher)
+    relay->publisher = NULL;
+  RELAY_UNLOCK (relay);
+
+  GST_INFO ("publisher of relay %s is gone", relay->name);
+}
+
+gboolean
+gst_rtsp_relay_has_publisher (GstRTSPRelay * relay)
+{
+  gboolean res;
+
+  g_return_val_if_fail (relay != NULL, FALSE);
+
+  RELAY_LOCK (relay);
+  res = relay->publisher != NULL;
+  RELAY_UNLOCK (relay);
+
+  return res;
+}
+
+static void
+relay_detach (RelayUser * user, GObject * appsrc)
+{
+  RELAY_LOCK (user->relay);
+  user->relay->users = g_list_remove (user->relay->users, user);
+  RELAY_UNLOCK (user->relay);
+
+  gst_rtsp_relay_unref (user->relay);
+  g_slice_free (RelayUser, user);
+}
+
+/* called with the relay lock */
+static void
+relay_attach (GstRTSPRelay * relay, GstAppSrc * appsrc, guint idx,
+    GstCaps * caps)
+{
+  RelayUser *user;
+
+  user = g_slice_new0 (RelayUser);
+  user->relay = relay_ref (relay);
+  user->appsrc = appsrc;
+  user->idx = idx;
+  user->serial = relay->serial;
+  user->ssrc = g_random_int ();
+  if (!gst_structure_get_int (gst_caps_get_structure (caps, 0), "clock-rate",
+          &user->clock_rate))
+    user->clock_rate = 0;
+
+  relay->users = g_list_prepend (relay->users, user);
+  g_object_weak_ref (G_OBJECT (appsrc), (GWeakNotify) relay_detach, user);
+}
+
+/* only the SSRC, the sequence number and the timestamp change. The sequence
+ * numbers continue when the publisher restarts with another SSRC, the
+ * timestamps continue from the last timestamp plus the time that passed
+ * since then. The header goes in a new memory, the payload is shared by all
+ * users. */
+static GstBuffer *
+relay_rewrite (RelayUser * user, GstBuffer * buffer)
+{
+  GstBuffer *out;
+  guint8 header[12];
+  guint32 ssrc, ts;
+  guint16 seq;
+  gint64 now;
+
+  if (gst_buffer_extract (buffer, 0, header, 12) != 12)
+    return NULL;
+
+  seq = GST_READ_UINT16_BE (header + 2);
+  ts = GST_READ_UINT32_BE (header + 4);
+  ssrc = GST_READ_UINT32_BE (header + 8);
+  now = g_get_monotonic_time ();
+  if (!user->have_offset || ssrc != user->in_ssrc) {
+    guint32 next_ts;
+
+    if (!user->have_offset) {
+      user->next_seq = g_random_int ();
+      next_ts = g_random_int ();
+    } else {
+      next_ts = user->last_ts + gst_util_uint64_scale_int (now -
+          user->last_time, user->clock_rate, G_USEC_PER_SEC);
+    }
+    user->seq_offset = user->next_seq - seq;
+    user->ts_offset = next_ts - ts;
+    user->in_ssrc = ssrc;
+    user->have_offset = TRUE;
+  }
+  seq += user->seq_offset;
+  user->next_seq = seq + 1;
+  ts += user->ts_offset;
+  if (ts != user->last_ts) {
+    user->last_ts = ts;
+    user->last_time = now;
+  }
+
+  GST_WRITE_UINT16_BE (header + 2, seq);
+  GST_WRITE_UINT32_BE (header + 4, ts);
+  GST_WRITE_UINT32_BE (header + 8, user->ssrc);
+
+  /* the appsrc timestamps the packet in the pipeline of the user */
+  out = gst_buffer_new_allocate (NULL, 12, NULL);
+  gst_buffer_fill (out, 0, header, 12);
+  gst_buffer_copy_into (out, buffer, GST_BUFFER_COPY_FLAGS |
+      GST_BUFFER_COPY_MEMORY, 12, -1);
+
+  return out;
+}
+
+/* called from the streaming thread of the publisher, the packets of a
+ * publisher that is not or no longer announced are dropped */
+void
+gst_rtsp_relay_push (GstRTSPRelay * relay, gpointer publisher, guint idx,
+    GstBuffer * buffer)
+{
+  GList *walk;
+
+  g_return_if_fail (relay != NULL);
+  g_return_if_fail (GST_IS_BUFFER (buffer));
+
+  RELAY_LOCK (relay);
+  if (relay->publisher != publisher)
+    goto not_published;
+
+  for (walk = relay->users; walk; walk = g_list_next (walk)) {
+    RelayUser *user = walk->data;
+    GstBuffer *out;
+
+    if (user->idx != idx || user->serial != relay->serial)
+      continue;
+    /* live source, nothing is consumed before PLAYING */
+    if (GST_STATE (user->appsrc) != GST_STATE_PLAYING)
+      continue;
+    if (gst_app_src_get_current_level_bytes (user->appsrc) >
+        gst_app_src_get_max_bytes (user->appsrc)) {
+      GST_LOG ("user %p of relay %s is too slow", user->appsrc, relay->name);
+      continue;
+    }
+
+    if ((out = relay_rewrite (user, buffer)))
+      gst_app_src_push_buffer (user->appsrc, out);
+  }
+  RELAY_UNLOCK (relay);
+
+  return;
+
+  /* ERRORS */
+not_published:
+  {
+    RELAY_UNLOCK (relay);
+    GST_LOG ("dropping packet of publisher %p of relay %s", publisher,
+        relay->name);
+    return;
+  }
+}
+
+/* a bin with an appsrc pay%d for each stream in @caps, the appsrcs are
+ * attached to @relay when it is not %NULL */
+static GstElement *
+create_bin (GPtrArray * caps, GstRTSPRelay * relay)
+{
+  GstElement *bin, *appsrc;
+  gchar *elname;
+  guint i;
+
+  bin = gst_bin_new (NULL);
+  for (i = 0; i < caps->len; i++) {
+    elname = g_strdup_printf ("pay%u", i);
+    appsrc = gst_element_factory_make ("appsrc", elname);
+    g_free (elname);
+
+    g_object_set (appsrc, "is-live", TRUE, "format", GST_FORMAT_TIME,
+        "do-timestamp", TRUE, "caps", g_ptr_array_index (caps, i), NULL);
+    gst_bin_add (GST_BIN (bin), appsrc);
+
+    if (relay)
+      relay_attach (relay, GST_APP_SRC (appsrc), i,
+          g_ptr_array_index (caps, i));
+  }
+  return bin;
+}
+
+/* the element of the media that serve @relay */
+GstElement *
+gst_rtsp_relay_create_element (GstRTSPRelay * relay)
+{
+  GstElement *bin;
+
+  g_return_val_if_fail (relay != NULL, NULL);
+
+  RELAY_LOCK (relay);
+  if (relay->caps == NULL)
+    goto not_announced;
+
+  bin = create_bin (relay->caps, relay);
+  RELAY_UNLOCK (relay);
+
+  return bin;
+
+  /* ERRORS */
+not_announced:
+  {
+    RELAY_UNLOCK (relay);
+    GST_WARNING ("relay %s was not announced", relay->name);
+    return NULL;
+  }
+}
+
+/* the element of a record media that will publish the streams in @caps, the
+ * appsrcs stay idle and only describe the streams */
+GstElement *
+gst_rtsp_relay_create_publisher (GPtrArray * caps)
+{
+  g_return_val_if_fail (caps != NULL, NULL);
+
+  return create_bin (caps, NULL);
+}
+
+guint
+gst_rtsp_relay_n_users (GstRTSPRelay * relay)
+{
+  guint res;
+
+  g_return_val_if_fail (relay != NULL, 0);
+
+  RELAY_LOCK (relay);
+  res = g_list_length (relay->users);
+  RELAY_UNLOCK (relay);
+
+  return res;
+}
@@ -0,0 +1,58 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/gst.h>
+
+#ifndef __GST_RTSP_RELAY_H__
+#define __GST_RTSP_RELAY_H__
+
+G_BEGIN_DECLS
+
+/* a named set of RTP streams that one publisher feeds and that is served
+ * by the appsrcs of any number of media, this is not public API */
+typedef struct _GstRTSPRelay GstRTSPRelay;
+
+G_GNUC_INTERNAL
+GstRTSPRelay *        gst_rtsp_relay_get              (const gchar *name);
+G_GNUC_INTERNAL
+void                  gst_rtsp_relay_unref            (GstRTSPRelay *relay);
+
+G_GNUC_INTERNAL
+gboolean              gst_rtsp_relay_announce         (GstRTSPRelay *relay, gpointer publisher,
+                                                       GPtrArray *caps);
+G_GNUC_INTERNAL
+void                  gst_rtsp_relay_unpublish        (GstRTSPRelay *relay, gpointer publisher);
+G_GNUC_INTERNAL
+gboolean              gst_rtsp_relay_has_publisher    (GstRTSPRelay *relay);
+
+G_GNUC_INTERNAL
+void                  gst_rtsp_relay_push             (GstRTSPRelay *relay, gpointer publisher,
+                                                       guint idx, GstBuffer *buffer);
+
+G_GNUC_INTERNAL
+GstElement *          gst_rtsp_relay_create_element   (GstRTSPRelay *relay);
+G_GNUC_INTERNAL
+GstElement *          gst_rtsp_relay_create_publisher (GPtrArray *caps);
+
+G_GNUC_INTERNAL
+guint                 gst_rtsp_relay_n_users          (GstRTSPRelay *relay);
+
+G_END_DECLS
+
+#endif /* __GST_RTSP_RELAY_H__ */
@@ -104,8 +104,9 @@ gst_rtsp_sdp_from_media (GstSDPMessage * sdp, GstSDPInfo * info,
     const gchar *caps_str, *caps_enc, *caps_params;
     gchar *tmp;
     gint caps_pt, caps_rate;
-    guint n_fields, j;
-    gboolean first;
+    guint n_fields, j, rtx_pt, fec_pt;
+    GstClockTime rtx_time;
+    gboolean first, rtx;
     GString *fmtp;
     GstCaps *caps;
 
@@ -138,6 +139,14 @@ gst_rtsp_sdp_from_media (GstSDPMessage * sdp, GstSDPInfo * info,
     gst_sdp_media_set_port_info (smedia, 0, 1);
     gst_sdp_media_set_proto (smedia, "RTP/AVP");
 
+    /* the NACKs that request retransmissions are feedback messages of the
+     * AVPF profile, RFC 4585. We keep offering AVP so that clients without
+     * feedback support can still use the stream, they ignore the rtcp-fb
+     * attribute. Clients that do support it set up with RTP/AVPF. */
+    rtx_time = gst_rtsp_stream_get_retransmission_time (stream);
+    rtx_pt = gst_rtsp_stream_get_retransmission_pt (stream);
+    rtx = rtx_time > 0 && rtx_pt != 0;
+
     /* for the c= line */
     if (info->is_ipv6) {
       gst_sdp_media_add_connection (smedia, "IN", "IP6", "::", 16, 0);
@@ -220,6 +229,38 @@ gst_rtsp_sdp_from_media (GstSDPMessage * sdp, GstSDPInfo * info,
       g_string_free (fmtp, TRUE);
     }
 
+    /* the retransmission stream, RFC 4588 */
+    if (rtx) {
+      tmp = g_strdup_printf ("%u", rtx_pt);
+      gst_sdp_media_add_format (smedia, tmp);
+      g_free (tmp);
+
+      tmp = g_strdup_printf ("%u rtx/%d", rtx_pt, caps_rate);
+      gst_sdp_media_add_attribute (smedia, "rtpmap", tmp);
+      g_free (tmp);
+
+      tmp = g_strdup_printf ("%u apt=%d;rtx-time=%" G_GUINT64_FORMAT, rtx_pt,
+          caps_pt, rtx_time / GST_MSECOND);
+      gst_sdp_media_add_attribute (smedia, "fmtp", tmp);
+      g_free (tmp);
+
+      tmp = g_strdup_printf ("%d nack", caps_pt);
+      gst_sdp_media_add_attribute (smedia, "rtcp-fb", tmp);
+      g_free (tmp);
+    }
+
+    /* the FEC packets, RFC 5109 */
+    fec_pt = gst_rtsp_stream_get_fec_pt (stream);
+    if (gst_rtsp_stream_get_fec_percentage (stream) > 0 && fec_pt != 0) {
+      tmp = g_strdup_printf ("%u", fec_pt);
+      gst_sdp_media_add_format (smedia, tmp);
+      g_free (tmp);
+
+      tmp = g_strdup_printf ("%u ulpfec/%d", fec_pt, caps_rate);
+      gst_sdp_media_add_attribute (smedia, "rtpmap", tmp);
+      g_free (tmp);
+    }
+
     update_sdp_from_tags (stream, smedia);
 
     gst_sdp_message_add_media (sdp, smedia);
@@ -0,0 +1,41 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/gst.h>
+
+#include "rtsp-stream.h"
+
+#ifndef __GST_RTSP_SERVER_INTERNAL_H__
+#define __GST_RTSP_SERVER_INTERNAL_H__
+
+G_BEGIN_DECLS
+
+/* helpers shared by the objects of the library, this is not public API */
+
+G_GNUC_INTERNAL
+GstEvent *            gst_rtsp_force_key_unit_event_new (void);
+
+G_GNUC_INTERNAL
+gboolean              gst_rtsp_stream_get_gop_rtpinfo   (GstRTSPStream *stream,
+                                                         const GstRTSPTransport *tr,
+                                                         guint *rtptime, guint *seq);
+
+G_END_DECLS
+
+#endif /* __GST_RTSP_SERVER_INTERNAL_H__ */
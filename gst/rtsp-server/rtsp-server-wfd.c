@@ -65,12 +65,45 @@
 #define GST_RTSP_WFD_SERVER_LOCK(server)      (g_mutex_lock(GST_RTSP_WFD_SERVER_GET_LOCK(server)))
 #define GST_RTSP_WFD_SERVER_UNLOCK(server)    (g_mutex_unlock(GST_RTSP_WFD_SERVER_GET_LOCK(server)))
 
+/* M16 keepalives of all sinks are driven from one timer wheel that turns
+ * every KEEPALIVE_TICK milliseconds */
+#define KEEPALIVE_TICK          250
+#define KEEPALIVE_WHEEL_SLOTS   64
+
+typedef struct
+{
+  GstRTSPWFDClient *client;
+  guint rounds;                 /* full turns before the entry is due */
+  gint64 last_sent;             /* monotonic time of the last keepalive */
+  gboolean closed;
+} KeepaliveEntry;
+
 struct _GstRTSPWFDServerPrivate
 {
   GMutex lock;                  /* protects everything in this struct */
 
   /* the clients that are connected */
   GList *clients;
+
+  guint keepalive_interval;
+  guint keepalive_timeout;
+
+  /* GstRTSPWFDClient -> KeepaliveEntry */
+  GHashTable *keepalives;
+  GList *wheel[KEEPALIVE_WHEEL_SLOTS];
+  guint wheel_pos;
+  GSource *keepalive_source;
+};
+
+#define DEFAULT_KEEPALIVE_INTERVAL      5
+#define DEFAULT_KEEPALIVE_TIMEOUT       3000
+
+enum
+{
+  PROP_0,
+  PROP_KEEPALIVE_INTERVAL,
+  PROP_KEEPALIVE_TIMEOUT,
+  PROP_LAST
 };
 
 G_DEFINE_TYPE (GstRTSPWFDServer, gst_rtsp_wfd_server, GST_TYPE_RTSP_SERVER);
@@ -87,6 +120,7 @@ static void gst_rtsp_wfd_server_finalize (GObject * object);
 static GstRTSPClient *create_client_wfd (GstRTSPServer * server);
 static void client_connected_wfd (GstRTSPServer * server,
     GstRTSPClient * client);
+static void keepalive_entry_free (KeepaliveEntry * entry);
 
 static void
 gst_rtsp_wfd_server_class_init (GstRTSPWFDServerClass * klass)
@@ -106,6 +140,17 @@ gst_rtsp_wfd_server_class_init (GstRTSPWFDServerClass * klass)
   rtsp_server_class->create_client = create_client_wfd;
   rtsp_server_class->client_connected = client_connected_wfd;
 
+  g_object_class_install_property (gobject_class, PROP_KEEPALIVE_INTERVAL,
+      g_param_spec_uint ("keepalive-interval", "Keepalive Interval",
+          "Seconds between M16 keepalives sent to every sink (0 = disable)",
+          0, G_MAXUINT, DEFAULT_KEEPALIVE_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_KEEPALIVE_TIMEOUT,
+      g_param_spec_uint ("keepalive-timeout", "Keepalive Timeout",
+          "Milliseconds to wait for the answer to a keepalive before the "
+          "sink is considered dead", 1, G_MAXUINT, DEFAULT_KEEPALIVE_TIMEOUT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
   GST_DEBUG_CATEGORY_INIT (rtsp_wfd_server_debug, "rtspwfdserver", 0,
       "GstRTSPWFDServer");
@@ -117,6 +162,13 @@ gst_rtsp_wfd_server_init (GstRTSPWFDServer * server)
   GstRTSPWFDServerPrivate *priv = GST_RTSP_WFD_SERVER_GET_PRIVATE (server);
 
   server->priv = priv;
+
+  g_mutex_init (&priv->lock);
+  priv->keepalive_interval = DEFAULT_KEEPALIVE_INTERVAL;
+  priv->keepalive_timeout = DEFAULT_KEEPALIVE_TIMEOUT;
+  priv->keepalives = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) keepalive_entry_free);
+
   GST_INFO_OBJECT (server, "New server is initialized");
 }
 
@@ -124,10 +176,20 @@ static void
 gst_rtsp_wfd_server_finalize (GObject * object)
 {
   GstRTSPWFDServer *server = GST_RTSP_WFD_SERVER (object);
-  //GstRTSPWFDServerPrivate *priv = server->priv;
+  GstRTSPWFDServerPrivate *priv = server->priv;
+  guint i;
 
   GST_DEBUG_OBJECT (server, "finalize server");
 
+  if (priv->keepalive_source) {
+    g_source_destroy (priv->keepalive_source);
+    g_source_unref (priv->keepalive_source);
+  }
+  for (i = 0; i < KEEPALIVE_WHEEL_SLOTS; i++)
+    g_list_free (priv->wheel[i]);
+  g_hash_table_unref (priv->keepalives);
+  g_mutex_clear (&priv->lock);
+
   G_OBJECT_CLASS (gst_rtsp_wfd_server_parent_class)->finalize (object);
 }
 
@@ -150,9 +212,17 @@ static void
 gst_rtsp_wfd_server_get_property (GObject * object, guint propid,
     GValue * value, GParamSpec * pspec)
 {
-  //GstRTSPWFDServer *server = GST_RTSP_WFD_SERVER (object);
+  GstRTSPWFDServer *server = GST_RTSP_WFD_SERVER (object);
 
   switch (propid) {
+    case PROP_KEEPALIVE_INTERVAL:
+      g_value_set_uint (value,
+          gst_rtsp_wfd_server_get_keepalive_interval (server));
+      break;
+    case PROP_KEEPALIVE_TIMEOUT:
+      g_value_set_uint (value,
+          gst_rtsp_wfd_server_get_keepalive_timeout (server));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -162,9 +232,17 @@ static void
 gst_rtsp_wfd_server_set_property (GObject * object, guint propid,
     const GValue * value, GParamSpec * pspec)
 {
-  //GstRTSPWFDServer *server = GST_RTSP_WFD_SERVER (object);
+  GstRTSPWFDServer *server = GST_RTSP_WFD_SERVER (object);
 
   switch (propid) {
+    case PROP_KEEPALIVE_INTERVAL:
+      gst_rtsp_wfd_server_set_keepalive_interval (server,
+          g_value_get_uint (value));
+      break;
+    case PROP_KEEPALIVE_TIMEOUT:
+      gst_rtsp_wfd_server_set_keepalive_timeout (server,
+          g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
   }
@@ -181,12 +259,191 @@ _start_wfd (gpointer data)
   return FALSE;
 }
 
+static void
+keepalive_entry_free (KeepaliveEntry * entry)
+{
+  g_object_unref (entry->client);
+  g_slice_free (KeepaliveEntry, entry);
+}
+
+/* call with the lock */
+static void
+wheel_insert (GstRTSPWFDServerPrivate * priv, KeepaliveEntry * entry,
+    guint delay)
+{
+  guint ticks, slot;
+
+  ticks = MAX (1, (delay + KEEPALIVE_TICK - 1) / KEEPALIVE_TICK);
+  slot = (priv->wheel_pos + ticks) % KEEPALIVE_WHEEL_SLOTS;
+  entry->rounds = (ticks - 1) / KEEPALIVE_WHEEL_SLOTS;
+
+  priv->wheel[slot] = g_list_prepend (priv->wheel[slot], entry);
+}
+
+/* the sink did not answer in time, release its media and drop the
+ * connection */
+static void
+expire_client (GstRTSPWFDServer * server, GstRTSPClient * client)
+{
+  GstRTSPSessionPool *pool;
+  GList *sessions, *walk;
+
+  GST_WARNING_OBJECT (server, "sink %p did not answer keepalive or "
+      "negotiation, expiring", client);
+
+  pool = gst_rtsp_client_get_session_pool (client);
+  sessions = gst_rtsp_client_session_filter (client, NULL, NULL);
+  for (walk = sessions; walk; walk = g_list_next (walk)) {
+    GstRTSPSession *session = walk->data;
+
+    if (pool)
+      gst_rtsp_session_pool_remove (pool, session);
+  }
+  g_list_free_full (sessions, g_object_unref);
+  if (pool)
+    g_object_unref (pool);
+
+  gst_rtsp_client_close (client);
+}
+
+/* returns the delay in milliseconds until the entry needs to be looked at
+ * again or 0 when the entry can be removed */
+static guint
+process_keepalive (GstRTSPWFDServer * server, KeepaliveEntry * entry,
+    guint interval, guint timeout)
+{
+  GstClockTime pending;
+  gint64 now, elapsed;
+
+  pending = gst_rtsp_wfd_client_get_keepalive_pending (entry->client);
+  if (pending != GST_CLOCK_TIME_NONE) {
+    if (pending >= timeout * GST_MSECOND) {
+      expire_client (server, GST_RTSP_CLIENT_CAST (entry->client));
+      return 0;
+    }
+    return timeout - pending / GST_MSECOND;
+  }
+
+  now = g_get_monotonic_time ();
+  elapsed = (now - entry->last_sent) / 1000;
+  if (entry->last_sent != 0 && elapsed < interval * 1000)
+    return interval * 1000 - elapsed;
+
+  if (gst_rtsp_wfd_client_send_keepalive (entry->client) != GST_RTSP_OK)
+    GST_WARNING_OBJECT (server, "failed to send keepalive to %p",
+        entry->client);
+  entry->last_sent = now;
+
+  return MIN (timeout, interval * 1000);
+}
+
+static gboolean
+keepalive_tick (GstRTSPWFDServer * server)
+{
+  GstRTSPWFDServerPrivate *priv = server->priv;
+  GList *slot, *walk, *due = NULL;
+  guint interval, timeout;
+  gboolean result;
+
+  GST_RTSP_WFD_SERVER_LOCK (server);
+  priv->wheel_pos = (priv->wheel_pos + 1) % KEEPALIVE_WHEEL_SLOTS;
+  slot = priv->wheel[priv->wheel_pos];
+  priv->wheel[priv->wheel_pos] = NULL;
+
+  for (walk = slot; walk; walk = g_list_next (walk)) {
+    KeepaliveEntry *entry = walk->data;
+
+    if (entry->closed) {
+      g_hash_table_remove (priv->keepalives, entry->client);
+    } else if (entry->rounds > 0) {
+      entry->rounds--;
+      priv->wheel[priv->wheel_pos] =
+          g_list_prepend (priv->wheel[priv->wheel_pos], entry);
+    } else {
+      due = g_list_prepend (due, entry);
+    }
+  }
+  g_list_free (slot);
+  interval = priv->keepalive_interval;
+  timeout = priv->keepalive_timeout;
+  GST_RTSP_WFD_SERVER_UNLOCK (server);
+
+  /* entries can only be freed from here, it's safe to use them without the
+   * lock */
+  for (walk = due; walk; walk = g_list_next (walk)) {
+    KeepaliveEntry *entry = walk->data;
+    guint delay = 0;
+
+    if (interval > 0)
+      delay = process_keepalive (server, entry, interval, timeout);
+
+    GST_RTSP_WFD_SERVER_LOCK (server);
+    if (delay == 0 || entry->closed)
+      g_hash_table_remove (priv->keepalives, entry->client);
+    else
+      wheel_insert (priv, entry, delay);
+    GST_RTSP_WFD_SERVER_UNLOCK (server);
+  }
+  g_list_free (due);
+
+  GST_RTSP_WFD_SERVER_LOCK (server);
+  result = g_hash_table_size (priv->keepalives) > 0;
+  if (!result) {
+    g_source_unref (priv->keepalive_source);
+    priv->keepalive_source = NULL;
+  }
+  GST_RTSP_WFD_SERVER_UNLOCK (server);
+
+  return result;
+}
+
+static void
+client_closed_wfd (GstRTSPClient * client, GstRTSPWFDServer * server)
+{
+  GstRTSPWFDServerPrivate *priv = server->priv;
+  KeepaliveEntry *entry;
+
+  GST_RTSP_WFD_SERVER_LOCK (server);
+  entry = g_hash_table_lookup (priv->keepalives, client);
+  if (entry)
+    entry->closed = TRUE;
+  GST_RTSP_WFD_SERVER_UNLOCK (server);
+}
+
 static void
 client_connected_wfd (GstRTSPServer * server, GstRTSPClient * client)
 {
+  GstRTSPWFDServer *wfd = GST_RTSP_WFD_SERVER (server);
+  GstRTSPWFDServerPrivate *priv = wfd->priv;
+  KeepaliveEntry *entry;
+
   GST_INFO_OBJECT (server, "Client is connected");
 
   g_idle_add (_start_wfd, client);
+
+  GST_RTSP_WFD_SERVER_LOCK (server);
+  if (priv->keepalive_interval > 0) {
+    entry = g_slice_new0 (KeepaliveEntry);
+    entry->client = g_object_ref (client);
+    g_hash_table_insert (priv->keepalives, client, entry);
+    wheel_insert (priv, entry, priv->keepalive_interval * 1000);
+
+    g_signal_connect_object (client, "closed",
+        G_CALLBACK (client_closed_wfd), server, 0);
+
+    if (priv->keepalive_source == NULL) {
+      GSource *current = g_main_current_source ();
+
+      /* we're called from the server source, run the keepalives from the
+       * same context */
+      priv->keepalive_source = g_timeout_source_new (KEEPALIVE_TICK);
+      g_source_set_callback (priv->keepalive_source,
+          (GSourceFunc) keepalive_tick, server, NULL);
+      g_source_attach (priv->keepalive_source,
+          current ? g_source_get_context (current) : NULL);
+    }
+  }
+  GST_RTSP_WFD_SERVER_UNLOCK (server);
   return;
 }
 
@@ -256,3 +513,158 @@ gst_rtsp_wfd_server_trigger_request (GstRTSPServer * server,
   return res;
 
 }
+
+static GstRTSPFilterResult
+sink_filter (GstRTSPServer * server, GstRTSPClient * client, gpointer user_data)
+{
+  const gchar *address = user_data;
+  GstRTSPConnection *conn;
+  const gchar *ip;
+
+  if (!GST_IS_RTSP_WFD_CLIENT (client))
+    return GST_RTSP_FILTER_KEEP;
+
+  conn = gst_rtsp_client_get_connection (client);
+  if (conn == NULL)
+    return GST_RTSP_FILTER_KEEP;
+
+  ip = gst_rtsp_connection_get_ip (conn);
+  if (ip == NULL || g_strcmp0 (ip, address) != 0)
+    return GST_RTSP_FILTER_KEEP;
+
+  return GST_RTSP_FILTER_REF;
+}
+
+/**
+ * gst_rtsp_wfd_server_trigger_request_for_sink:
+ * @server: a #GstRTSPServer
+ * @address: the IP address of the sink
+ * @type: the trigger to send
+ *
+ * Send the trigger @type only to the sinks that are connected from
+ * @address, leaving the other sinks of @server untouched.
+ *
+ * Returns: a #GstRTSPResult. %GST_RTSP_ERROR when no sink is connected
+ * from @address.
+ */
+GstRTSPResult
+gst_rtsp_wfd_server_trigger_request_for_sink (GstRTSPServer * server,
+    const gchar * address, GstWFDTriggerType type)
+{
+  GstRTSPResult res = GST_RTSP_ERROR;
+  GList *clients, *walk;
+
+  g_return_val_if_fail (GST_IS_RTSP_SERVER (server), GST_RTSP_EINVAL);
+  g_return_val_if_fail (address != NULL, GST_RTSP_EINVAL);
+
+  clients = gst_rtsp_server_client_filter (server, sink_filter,
+      (gpointer) address);
+  if (clients == NULL) {
+    GST_WARNING_OBJECT (server, "no sink connected from %s", address);
+  }
+
+  for (walk = clients; walk; walk = g_list_next (walk)) {
+    GstRTSPClient *client = walk->data;
+
+    res =
+        gst_rtsp_wfd_client_trigger_request (GST_RTSP_WFD_CLIENT (client),
+        type);
+    if (res != GST_RTSP_OK) {
+      GST_ERROR_OBJECT (server, "Failed to send trigger request %d to %s",
+          type, address);
+    }
+    g_object_unref (client);
+  }
+  g_list_free (clients);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_wfd_server_set_keepalive_interval:
+ * @server: a #GstRTSPWFDServer
+ * @interval: the interval in seconds
+ *
+ * Configure the interval between the M16 keepalives that are sent to every
+ * connected sink. Sinks that connect after this call use the new interval,
+ * an @interval of 0 disables keepalives for them.
+ */
+void
+gst_rtsp_wfd_server_set_keepalive_interval (GstRTSPWFDServer * server,
+    guint interval)
+{
+  g_return_if_fail (GST_IS_RTSP_WFD_SERVER (server));
+
+  GST_RTSP_WFD_SERVER_LOCK (server);
+  server->priv->keepalive_interval = interval;
+  GST_RTSP_WFD_SERVER_UNLOCK (server);
+}
+
+/**
+ * gst_rtsp_wfd_server_get_keepalive_interval:
+ * @server: a #GstRTSPWFDServer
+ *
+ * Get the interval between M16 keepalives.
+ *
+ * Returns: the keepalive interval in seconds.
+ */
+guint
+gst_rtsp_wfd_server_get_keepalive_interval (GstRTSPWFDServer * server)
+{
+  guint result;
+
+  g_return_val_if_fail (GST_IS_RTSP_WFD_SERVER (server), 0);
+
+  GST_RTSP_WFD_SERVER_LOCK (server);
+  result = server->priv->keepalive_interval;
+  GST_RTSP_WFD_SERVER_UNLOCK (server);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_wfd_server_set_keepalive_timeout:
+ * @server: a #GstRTSPWFDServer
+ * @timeout: the timeout in milliseconds
+ *
+ * Configure how long to wait for the answer to an M16 keepalive. A sink that
+ * does not answer within @timeout is considered dead, its media is released
+ * and its connection is closed.
+ *
+ * The capability negotiation (M1 to M4) is timed like a keepalive. A sink
+ * that has not answered M4 when its first keepalive is due and more than
+ * @timeout after M1 was sent is dropped the same way.
+ */
+void
+gst_rtsp_wfd_server_set_keepalive_timeout (GstRTSPWFDServer * server,
+    guint timeout)
+{
+  g_return_if_fail (GST_IS_RTSP_WFD_SERVER (server));
+  g_return_if_fail (timeout > 0);
+
+  GST_RTSP_WFD_SERVER_LOCK (server);
+  server->priv->keepalive_timeout = timeout;
+  GST_RTSP_WFD_SERVER_UNLOCK (server);
+}
+
+/**
+ * gst_rtsp_wfd_server_get_keepalive_timeout:
+ * @server: a #GstRTSPWFDServer
+ *
+ * Get how long to wait for the answer to an M16 keepalive.
+ *
+ * Returns: the keepalive timeout in milliseconds.
+ */
+guint
+gst_rtsp_wfd_server_get_keepalive_timeout (GstRTSPWFDServer * server)
+{
+  guint result;
+
+  g_return_val_if_fail (GST_IS_RTSP_WFD_SERVER (server), 0);
+
+  GST_RTSP_WFD_SERVER_LOCK (server);
+  result = server->priv->keepalive_timeout;
+  GST_RTSP_WFD_SERVER_UNLOCK (server);
+
+  return result;
+}
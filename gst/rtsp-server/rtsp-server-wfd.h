@@ -77,6 +77,17 @@ struct _GstRTSPWFDServerClass {
 GType                 gst_rtsp_wfd_server_get_type             (void);
 GstRTSPWFDServer *    gst_rtsp_wfd_server_new                  (void);
 GstRTSPResult         gst_rtsp_wfd_server_trigger_request      (GstRTSPServer *server, GstWFDTriggerType type);
+GstRTSPResult         gst_rtsp_wfd_server_trigger_request_for_sink (GstRTSPServer *server,
+                                                                const gchar *address,
+                                                                GstWFDTriggerType type);
+
+void                  gst_rtsp_wfd_server_set_keepalive_interval (GstRTSPWFDServer *server,
+                                                                guint interval);
+guint                 gst_rtsp_wfd_server_get_keepalive_interval (GstRTSPWFDServer *server);
+
+void                  gst_rtsp_wfd_server_set_keepalive_timeout  (GstRTSPWFDServer *server,
+                                                                guint timeout);
+guint                 gst_rtsp_wfd_server_get_keepalive_timeout  (GstRTSPWFDServer *server);
 
 #if 0
 void                  gst_rtsp_server_set_address          (GstRTSPServer *server, const gchar *address);
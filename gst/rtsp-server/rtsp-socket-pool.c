@@ -0,0 +1,1652 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+/**
+ * SECTION:rtsp-socket-pool
+ * @short_description: A pool of bound RTP/RTCP sockets
+ * @see_also: #GstRTSPStream, #GstRTSPAddressPool
+ *
+ * The #GstRTSPSocketPool keeps a number of UDP socket pairs ready that are
+ * already bound to an even RTP port and the next RTCP port. A #GstRTSPStream
+ * that is configured with a socket pool takes its server ports from the pool
+ * instead of creating and binding the sockets while preparing, which keeps
+ * bind retries out of the SETUP path when many sessions start at the same
+ * time.
+ *
+ * The pool is refilled from a background thread up to the number of pairs
+ * configured with gst_rtsp_socket_pool_set_size(). Setting the size starts
+ * filling the pool with IPv4 pairs, IPv6 pairs are made after the first
+ * request for them. When the pool is empty, gst_rtsp_socket_pool_acquire()
+ * returns %FALSE and the stream binds its own sockets like before.
+ *
+ * When a #GstRTSPAddressPool with unicast addresses is configured with
+ * gst_rtsp_socket_pool_set_address_pool(), the sockets are bound to addresses
+ * and ports from that pool. One pool is usually shared between all the media
+ * factories of a server. Without an address pool, the pairs are bound from
+ * port 29000 on, away from the ports that a #GstRTSPStream binds itself.
+ *
+ * In mux mode, enabled with gst_rtsp_socket_pool_set_mux(), all streams share
+ * one socket pair for each family that is obtained with
+ * gst_rtsp_socket_pool_acquire_mux(). The pool then receives on the shared
+ * sockets from a single thread and hands each packet to the object that was
+ * registered for its source address with
+ * gst_rtsp_socket_pool_add_mux_source(). RTCP packets from unknown addresses
+ * are routed by the SSRC in their first report block, see
+ * gst_rtsp_socket_pool_add_mux_ssrc(). This keeps the amount of sockets and
+ * receive threads constant with many streams. Where available, the packets
+ * are read in batches with recvmmsg() into buffers from a #GstBufferPool.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_RECVMMSG
+/* for recvmmsg() */
+#define _GNU_SOURCE
+#endif
+
+#include <string.h>
+
+#ifndef G_OS_WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#else
+#include <winsock2.h>
+#endif
+
+#include "rtsp-socket-pool.h"
+
+#define GST_RTSP_SOCKET_POOL_GET_PRIVATE(obj)  \
+     (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_RTSP_SOCKET_POOL, GstRTSPSocketPoolPrivate))
+
+/* index in the arrays below for the families we handle */
+#define FAMILY_IPV4 0
+#define FAMILY_IPV6 1
+#define FAMILY_INDEX(f) \
+    ((f) == G_SOCKET_FAMILY_IPV6 ? FAMILY_IPV6 : FAMILY_IPV4)
+#define INDEX_FAMILY(i) \
+    ((i) == FAMILY_IPV6 ? G_SOCKET_FAMILY_IPV6 : G_SOCKET_FAMILY_IPV4)
+
+typedef struct _MuxLoop MuxLoop;
+
+struct _GstRTSPSocketPoolPrivate
+{
+  GMutex lock;                  /* protects everything in this struct */
+  guint size;
+  gint buffer_size;
+  GstRTSPAddressPool *address_pool;
+
+  /* idle SocketPair for each family */
+  GQueue pairs[2];
+  gboolean wanted[2];
+  guint16 next_port[2];
+  gboolean refilling;
+
+  gboolean mux;
+  MuxLoop *mux_loop;
+};
+
+#define DEFAULT_SIZE            8
+#define DEFAULT_BUFFER_SIZE     0
+#define DEFAULT_MUX             FALSE
+
+/* ports to use without address pool. GstRTSPStream binds its own pairs from
+ * 19000 on when the pool is empty, stay clear of those */
+#define MIN_PORT                29000
+#define MAX_BIND_ATTEMPTS       100
+
+/* packets to read from a mux socket before going back to the main loop */
+#define MUX_MAX_BATCH           32
+/* larger packets are dropped */
+#define MUX_SLOT_SIZE           4096
+
+enum
+{
+  PROP_0,
+  PROP_SIZE,
+  PROP_BUFFER_SIZE,
+  PROP_MUX,
+  PROP_LAST
+};
+
+typedef struct
+{
+  GSocket *rtp_socket;
+  GSocket *rtcp_socket;
+  GstRTSPAddress *addr;
+} SocketPair;
+
+/* where the packets of a source address or SSRC go */
+typedef struct
+{
+  gint refcount;
+  GWeakRef object;
+  GstRTSPSocketPoolReceiveFunc func;
+} MuxRoute;
+
+typedef struct
+{
+  guint8 bytes[16];
+  gsize size;
+  guint16 port;
+} MuxKey;
+
+typedef struct
+{
+  MuxLoop *mux_loop;
+  GSource *source;
+  gboolean rtcp;
+} MuxSocket;
+
+/* a received packet */
+typedef struct
+{
+  GstBuffer *buffer;
+  GstMapInfo map;
+  gsize size;
+  gboolean have_key;
+  MuxKey key;
+  MuxRoute *route;
+} MuxSlot;
+
+/* the receive thread of the shared sockets. It has its own refcount because
+ * the last ref to the pool can be dropped from the thread. */
+struct _MuxLoop
+{
+  gint refcount;
+
+  GMutex lock;                  /* protects the routes */
+  GHashTable *sources;          /* MuxKey -> MuxRoute */
+  GHashTable *ssrcs;            /* ssrc -> MuxRoute */
+
+  GMainContext *context;
+  GMainLoop *loop;
+  GThread *thread;
+
+  /* protected by the pool lock */
+  SocketPair *pairs[2];
+  MuxSocket sockets[2][2];
+
+  /* only used from the thread */
+  GstBufferPool *buffer_pool;
+  MuxSlot slots[MUX_MAX_BATCH];
+#ifdef HAVE_RECVMMSG
+  struct mmsghdr msgs[MUX_MAX_BATCH];
+  struct iovec iov[MUX_MAX_BATCH];
+  struct sockaddr_storage addrs[MUX_MAX_BATCH];
+#endif
+};
+
+GST_DEBUG_CATEGORY_STATIC (rtsp_socket_pool_debug);
+#define GST_CAT_DEFAULT rtsp_socket_pool_debug
+
+static void gst_rtsp_socket_pool_get_property (GObject * object, guint propid,
+    GValue * value, GParamSpec * pspec);
+static void gst_rtsp_socket_pool_set_property (GObject * object, guint propid,
+    const GValue * value, GParamSpec * pspec);
+static void gst_rtsp_socket_pool_finalize (GObject * obj);
+
+G_DEFINE_TYPE (GstRTSPSocketPool, gst_rtsp_socket_pool, G_TYPE_OBJECT);
+
+static void
+gst_rtsp_socket_pool_class_init (GstRTSPSocketPoolClass * klass)
+{
+  GObjectClass *gobject_class;
+
+  g_type_class_add_private (klass, sizeof (GstRTSPSocketPoolPrivate));
+
+  gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->get_property = gst_rtsp_socket_pool_get_property;
+  gobject_class->set_property = gst_rtsp_socket_pool_set_property;
+  gobject_class->finalize = gst_rtsp_socket_pool_finalize;
+
+  /**
+   * GstRTSPSocketPool::size:
+   *
+   * The amount of bound socket pairs to keep ready for each address family.
+   */
+  g_object_class_install_property (gobject_class, PROP_SIZE,
+      g_param_spec_uint ("size", "Size",
+          "The amount of socket pairs to keep ready for each family",
+          0, G_MAXUINT, DEFAULT_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstRTSPSocketPool::buffer-size:
+   *
+   * The kernel send and receive buffer size of the sockets or 0 to use the
+   * system default.
+   */
+  g_object_class_install_property (gobject_class, PROP_BUFFER_SIZE,
+      g_param_spec_int ("buffer-size", "Buffer Size",
+          "The kernel buffer size of the sockets (0 = default)",
+          0, G_MAXINT, DEFAULT_BUFFER_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstRTSPSocketPool::mux:
+   *
+   * Share one socket pair for each family between all the streams.
+   */
+  g_object_class_install_property (gobject_class, PROP_MUX,
+      g_param_spec_boolean ("mux", "Mux",
+          "Share one socket pair between all the streams",
+          DEFAULT_MUX, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  GST_DEBUG_CATEGORY_INIT (rtsp_socket_pool_debug, "rtspsocketpool", 0,
+      "GstRTSPSocketPool");
+}
+
+static void
+gst_rtsp_socket_pool_init (GstRTSPSocketPool * pool)
+{
+  GstRTSPSocketPoolPrivate *priv;
+  gint i;
+
+  pool->priv = priv = GST_RTSP_SOCKET_POOL_GET_PRIVATE (pool);
+
+  g_mutex_init (&priv->lock);
+  priv->size = DEFAULT_SIZE;
+  priv->buffer_size = DEFAULT_BUFFER_SIZE;
+  priv->mux = DEFAULT_MUX;
+  for (i = 0; i < 2; i++) {
+    g_queue_init (&priv->pairs[i]);
+    priv->next_port[i] = MIN_PORT;
+  }
+}
+
+static void
+socket_pair_free (SocketPair * pair)
+{
+  g_object_unref (pair->rtp_socket);
+  g_object_unref (pair->rtcp_socket);
+  if (pair->addr)
+    gst_rtsp_address_free (pair->addr);
+  g_slice_free (SocketPair, pair);
+}
+
+static void mux_loop_stop (MuxLoop * mux_loop);
+
+static void
+gst_rtsp_socket_pool_finalize (GObject * obj)
+{
+  GstRTSPSocketPool *pool = GST_RTSP_SOCKET_POOL (obj);
+  GstRTSPSocketPoolPrivate *priv = pool->priv;
+  gint i;
+
+  GST_INFO ("finalize pool %p", pool);
+
+  if (priv->mux_loop)
+    mux_loop_stop (priv->mux_loop);
+  for (i = 0; i < 2; i++) {
+    g_queue_foreach (&priv->pairs[i], (GFunc) socket_pair_free, NULL);
+    g_queue_clear (&priv->pairs[i]);
+  }
+  if (priv->address_pool)
+    g_object_unref (priv->address_pool);
+  g_mutex_clear (&priv->lock);
+
+  G_OBJECT_CLASS (gst_rtsp_socket_pool_parent_class)->finalize (obj);
+}
+
+static void
+gst_rtsp_socket_pool_get_property (GObject * object, guint propid,
+    GValue * value, GParamSpec * pspec)
+{
+  GstRTSPSocketPool *pool = GST_RTSP_SOCKET_POOL (object);
+
+  switch (propid) {
+    case PROP_SIZE:
+      g_value_set_uint (value, gst_rtsp_socket_pool_get_size (pool));
+      break;
+    case PROP_BUFFER_SIZE:
+      g_value_set_int (value, gst_rtsp_socket_pool_get_buffer_size (pool));
+      break;
+    case PROP_MUX:
+      g_value_set_boolean (value, gst_rtsp_socket_pool_get_mux (pool));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+  }
+}
+
+static void
+gst_rtsp_socket_pool_set_property (GObject * object, guint propid,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstRTSPSocketPool *pool = GST_RTSP_SOCKET_POOL (object);
+
+  switch (propid) {
+    case PROP_SIZE:
+      gst_rtsp_socket_pool_set_size (pool, g_value_get_uint (value));
+      break;
+    case PROP_BUFFER_SIZE:
+      gst_rtsp_socket_pool_set_buffer_size (pool, g_value_get_int (value));
+      break;
+    case PROP_MUX:
+      gst_rtsp_socket_pool_set_mux (pool, g_value_get_boolean (value));
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, propid, pspec);
+  }
+}
+
+/**
+ * gst_rtsp_socket_pool_new:
+ *
+ * Make a new #GstRTSPSocketPool.
+ *
+ * Returns: a new #GstRTSPSocketPool
+ */
+GstRTSPSocketPool *
+gst_rtsp_socket_pool_new (void)
+{
+  GstRTSPSocketPool *pool;
+
+  pool = g_object_new (GST_TYPE_RTSP_SOCKET_POOL, NULL);
+
+  return pool;
+}
+
+static GSocket *
+make_socket (GSocketFamily family, gint buffer_size)
+{
+  GSocket *socket;
+
+  socket = g_socket_new (family, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  if (socket == NULL)
+    return NULL;
+
+  if (buffer_size > 0) {
+    gint fd = g_socket_get_fd (socket);
+
+    /* not fatal, the udp elements try again later */
+    if (setsockopt (fd, SOL_SOCKET, SO_SNDBUF, (void *) &buffer_size,
+            sizeof (buffer_size)) < 0)
+      GST_WARNING ("could not set send buffer size to %d", buffer_size);
+    if (setsockopt (fd, SOL_SOCKET, SO_RCVBUF, (void *) &buffer_size,
+            sizeof (buffer_size)) < 0)
+      GST_WARNING ("could not set receive buffer size to %d", buffer_size);
+  }
+  return socket;
+}
+
+static gboolean
+bind_socket (GSocket * socket, GInetAddress * inetaddr, guint16 port)
+{
+  GSocketAddress *sockaddr;
+  gboolean res;
+
+  sockaddr = g_inet_socket_address_new (inetaddr, port);
+  res = g_socket_bind (socket, sockaddr, FALSE, NULL);
+  g_object_unref (sockaddr);
+
+  return res;
+}
+
+/* make a new pair of sockets bound to an even RTP port and the next RTCP
+ * port. Called without the lock. */
+static SocketPair *
+make_socket_pair (GstRTSPSocketPool * pool, gint idx)
+{
+  GstRTSPSocketPoolPrivate *priv = pool->priv;
+  GSocketFamily family = INDEX_FAMILY (idx);
+  GstRTSPAddressPool *address_pool;
+  GSocket *rtp_socket, *rtcp_socket = NULL;
+  GstRTSPAddress *addr = NULL;
+  GList *rejected_addresses = NULL;
+  GInetAddress *inetaddr = NULL;
+  SocketPair *pair;
+  gint buffer_size;
+  guint16 port;
+  guint count;
+
+  g_mutex_lock (&priv->lock);
+  buffer_size = priv->buffer_size;
+  address_pool = priv->address_pool;
+  if (address_pool && gst_rtsp_address_pool_has_unicast_addresses
+      (address_pool))
+    g_object_ref (address_pool);
+  else
+    address_pool = NULL;
+  g_mutex_unlock (&priv->lock);
+
+  rtp_socket = make_socket (family, buffer_size);
+  if (rtp_socket == NULL)
+    goto no_socket;
+  rtcp_socket = make_socket (family, buffer_size);
+  if (rtcp_socket == NULL)
+    goto no_socket;
+
+  for (count = 0; count < MAX_BIND_ATTEMPTS; count++) {
+    if (address_pool) {
+      GstRTSPAddressFlags flags;
+
+      if (addr)
+        rejected_addresses = g_list_prepend (rejected_addresses, addr);
+
+      flags = GST_RTSP_ADDRESS_FLAG_EVEN_PORT | GST_RTSP_ADDRESS_FLAG_UNICAST;
+      if (family == G_SOCKET_FAMILY_IPV6)
+        flags |= GST_RTSP_ADDRESS_FLAG_IPV6;
+      else
+        flags |= GST_RTSP_ADDRESS_FLAG_IPV4;
+
+      addr = gst_rtsp_address_pool_acquire_address (address_pool, flags, 2);
+      if (addr == NULL)
+        goto no_ports;
+
+      port = addr->port;
+
+      g_clear_object (&inetaddr);
+      inetaddr = g_inet_address_new_from_string (addr->address);
+    } else {
+      /* continue where the previous pair left off */
+      g_mutex_lock (&priv->lock);
+      port = priv->next_port[idx];
+      if (port < MIN_PORT || port >= G_MAXUINT16 - 1)
+        port = MIN_PORT;
+      priv->next_port[idx] = port + 2;
+      g_mutex_unlock (&priv->lock);
+
+      if (inetaddr == NULL)
+        inetaddr = g_inet_address_new_any (family);
+    }
+
+    if (!bind_socket (rtp_socket, inetaddr, port))
+      continue;
+
+    if (!bind_socket (rtcp_socket, inetaddr, port + 1)) {
+      /* the RTP socket is bound now, we need a new one */
+      g_object_unref (rtp_socket);
+      rtp_socket = make_socket (family, buffer_size);
+      if (rtp_socket == NULL)
+        goto no_socket;
+      continue;
+    }
+    goto done;
+  }
+  goto no_ports;
+
+done:
+  GST_DEBUG_OBJECT (pool, "bound pair %u-%u", port, port + 1);
+
+  pair = g_slice_new (SocketPair);
+  pair->rtp_socket = rtp_socket;
+  pair->rtcp_socket = rtcp_socket;
+  pair->addr = addr;
+
+  g_clear_object (&inetaddr);
+  g_list_free_full (rejected_addresses, (GDestroyNotify) gst_rtsp_address_free);
+  if (address_pool)
+    g_object_unref (address_pool);
+
+  return pair;
+
+  /* ERRORS */
+no_socket:
+  {
+    GST_WARNING_OBJECT (pool, "failed to create socket");
+    goto cleanup;
+  }
+no_ports:
+  {
+    GST_WARNING_OBJECT (pool, "failed to bind a pair of ports");
+    goto cleanup;
+  }
+cleanup:
+  {
+    if (rtp_socket)
+      g_object_unref (rtp_socket);
+    if (rtcp_socket)
+      g_object_unref (rtcp_socket);
+    if (addr)
+      gst_rtsp_address_free (addr);
+    g_clear_object (&inetaddr);
+    g_list_free_full (rejected_addresses,
+        (GDestroyNotify) gst_rtsp_address_free);
+    if (address_pool)
+      g_object_unref (address_pool);
+    return NULL;
+  }
+}
+
+static gpointer
+refill_thread (GstRTSPSocketPool * pool)
+{
+  GstRTSPSocketPoolPrivate *priv = pool->priv;
+
+  GST_DEBUG_OBJECT (pool, "refill started");
+
+  g_mutex_lock (&priv->lock);
+  while (TRUE) {
+    SocketPair *pair;
+    gint i, idx = -1;
+
+    for (i = 0; i < 2; i++) {
+      if (priv->wanted[i]
+          && g_queue_get_length (&priv->pairs[i]) < priv->size) {
+        idx = i;
+        break;
+      }
+    }
+    if (idx == -1)
+      break;
+
+    g_mutex_unlock (&priv->lock);
+    pair = make_socket_pair (pool, idx);
+    g_mutex_lock (&priv->lock);
+
+    if (pair == NULL) {
+      /* don't keep on trying, the next request for this family will start
+       * a new attempt */
+      priv->wanted[idx] = FALSE;
+      continue;
+    }
+    g_queue_push_tail (&priv->pairs[idx], pair);
+  }
+  priv->refilling = FALSE;
+  g_mutex_unlock (&priv->lock);
+
+  GST_DEBUG_OBJECT (pool, "refill done");
+
+  g_object_unref (pool);
+
+  return NULL;
+}
+
+/* must be called with the lock */
+static void
+start_refill (GstRTSPSocketPool * pool)
+{
+  GstRTSPSocketPoolPrivate *priv = pool->priv;
+  GThread *thread;
+  GError *error = NULL;
+
+  if (priv->refilling || priv->size == 0)
+    return;
+
+  priv->refilling = TRUE;
+  thread = g_thread_try_new ("rtsp-socket-pool",
+      (GThreadFunc) refill_thread, g_object_ref (pool), &error);
+  if (thread == NULL)
+    goto thread_error;
+
+  g_thread_unref (thread);
+
+  return;
+
+  /* ERRORS */
+thread_error:
+  {
+    GST_ERROR_OBJECT (pool, "failed to start refill thread: %s",
+        error->message);
+    g_clear_error (&error);
+    priv->refilling = FALSE;
+    /* can't be the last ref, the caller has one */
+    g_object_unref (pool);
+    return;
+  }
+}
+
+/**
+ * gst_rtsp_socket_pool_set_size:
+ * @pool: a #GstRTSPSocketPool
+ * @size: the amount of socket pairs
+ *
+ * Keep @size bound socket pairs ready for each address family. This starts
+ * filling @pool with IPv4 socket pairs in the background.
+ */
+void
+gst_rtsp_socket_pool_set_size (GstRTSPSocketPool * pool, guint size)
+{
+  GstRTSPSocketPoolPrivate *priv;
+  GList *old = NULL;
+  gint i;
+
+  g_return_if_fail (GST_IS_RTSP_SOCKET_POOL (pool));
+
+  priv = pool->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->size = size;
+  /* drop what we don't need anymore */
+  for (i = 0; i < 2; i++) {
+    while (g_queue_get_length (&priv->pairs[i]) > size)
+      old = g_list_prepend (old, g_queue_pop_tail (&priv->pairs[i]));
+  }
+  priv->wanted[FAMILY_IPV4] = TRUE;
+  start_refill (pool);
+  g_mutex_unlock (&priv->lock);
+
+  g_list_free_full (old, (GDestroyNotify) socket_pair_free);
+}
+
+/**
+ * gst_rtsp_socket_pool_get_size:
+ * @pool: a #GstRTSPSocketPool
+ *
+ * Get the amount of socket pairs that are kept ready for each address family.
+ *
+ * Returns: the size of @pool
+ */
+guint
+gst_rtsp_socket_pool_get_size (GstRTSPSocketPool * pool)
+{
+  GstRTSPSocketPoolPrivate *priv;
+  guint res;
+
+  g_return_val_if_fail (GST_IS_RTSP_SOCKET_POOL (pool), 0);
+
+  priv = pool->priv;
+
+  g_mutex_lock (&priv->lock);
+  res = priv->size;
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_socket_pool_set_buffer_size:
+ * @pool: a #GstRTSPSocketPool
+ * @size: the buffer size or 0
+ *
+ * Set the kernel send and receive buffer size of the sockets made by @pool.
+ * Sockets that are already in @pool are not changed.
+ */
+void
+gst_rtsp_socket_pool_set_buffer_size (GstRTSPSocketPool * pool, gint size)
+{
+  GstRTSPSocketPoolPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_SOCKET_POOL (pool));
+
+  priv = pool->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->buffer_size = size;
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_socket_pool_get_buffer_size:
+ * @pool: a #GstRTSPSocketPool
+ *
+ * Get the kernel buffer size of the sockets made by @pool.
+ *
+ * Returns: the buffer size or 0 when the system default is used
+ */
+gint
+gst_rtsp_socket_pool_get_buffer_size (GstRTSPSocketPool * pool)
+{
+  GstRTSPSocketPoolPrivate *priv;
+  gint res;
+
+  g_return_val_if_fail (GST_IS_RTSP_SOCKET_POOL (pool), 0);
+
+  priv = pool->priv;
+
+  g_mutex_lock (&priv->lock);
+  res = priv->buffer_size;
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_socket_pool_set_address_pool:
+ * @pool: a #GstRTSPSocketPool
+ * @address_pool: (allow-none): a #GstRTSPAddressPool
+ *
+ * Bind the sockets of @pool to the unicast addresses and ports of
+ * @address_pool. Socket pairs that are already in @pool are released.
+ */
+void
+gst_rtsp_socket_pool_set_address_pool (GstRTSPSocketPool * pool,
+    GstRTSPAddressPool * address_pool)
+{
+  GstRTSPSocketPoolPrivate *priv;
+  GstRTSPAddressPool *old;
+  GList *pairs = NULL;
+  gint i;
+
+  g_return_if_fail (GST_IS_RTSP_SOCKET_POOL (pool));
+
+  priv = pool->priv;
+
+  g_mutex_lock (&priv->lock);
+  if ((old = priv->address_pool) != address_pool) {
+    priv->address_pool = address_pool ? g_object_ref (address_pool) : NULL;
+    /* the idle pairs are bound to the wrong ports now */
+    for (i = 0; i < 2; i++) {
+      while (!g_queue_is_empty (&priv->pairs[i]))
+        pairs = g_list_prepend (pairs, g_queue_pop_head (&priv->pairs[i]));
+    }
+    start_refill (pool);
+  } else
+    old = NULL;
+  g_mutex_unlock (&priv->lock);
+
+  g_list_free_full (pairs, (GDestroyNotify) socket_pair_free);
+  if (old)
+    g_object_unref (old);
+}
+
+/**
+ * gst_rtsp_socket_pool_get_address_pool:
+ * @pool: a #GstRTSPSocketPool
+ *
+ * Get the #GstRTSPAddressPool used by @pool.
+ *
+ * Returns: (transfer full): the #GstRTSPAddressPool of @pool. g_object_unref()
+ * after usage.
+ */
+GstRTSPAddressPool *
+gst_rtsp_socket_pool_get_address_pool (GstRTSPSocketPool * pool)
+{
+  GstRTSPSocketPoolPrivate *priv;
+  GstRTSPAddressPool *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_SOCKET_POOL (pool), NULL);
+
+  priv = pool->priv;
+
+  g_mutex_lock (&priv->lock);
+  if ((result = priv->address_pool))
+    g_object_ref (result);
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_socket_pool_get_n_idle:
+ * @pool: a #GstRTSPSocketPool
+ * @family: a #GSocketFamily
+ *
+ * Get the amount of socket pairs of @family that are ready in @pool.
+ *
+ * Returns: the amount of idle socket pairs
+ */
+guint
+gst_rtsp_socket_pool_get_n_idle (GstRTSPSocketPool * pool,
+    GSocketFamily family)
+{
+  GstRTSPSocketPoolPrivate *priv;
+  guint res;
+
+  g_return_val_if_fail (GST_IS_RTSP_SOCKET_POOL (pool), 0);
+
+  priv = pool->priv;
+
+  g_mutex_lock (&priv->lock);
+  res = g_queue_get_length (&priv->pairs[FAMILY_INDEX (family)]);
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_socket_pool_acquire:
+ * @pool: a #GstRTSPSocketPool
+ * @family: a #GSocketFamily
+ * @rtp_socket: (out) (transfer full): the RTP socket
+ * @rtcp_socket: (out) (transfer full): the RTCP socket
+ * @address: (out) (transfer full) (allow-none): the #GstRTSPAddress
+ *
+ * Take a pair of bound sockets of @family from @pool. The RTP socket is bound
+ * to an even port and the RTCP socket to the next port. This function never
+ * blocks, when @pool is empty it is refilled in the background.
+ *
+ * When the sockets were bound to an address from the #GstRTSPAddressPool of
+ * @pool, @address contains the address. It should be freed with
+ * gst_rtsp_address_free() when the sockets are no longer used.
+ *
+ * Returns: %TRUE when a pair of sockets was taken from @pool
+ */
+gboolean
+gst_rtsp_socket_pool_acquire (GstRTSPSocketPool * pool, GSocketFamily family,
+    GSocket ** rtp_socket, GSocket ** rtcp_socket, GstRTSPAddress ** address)
+{
+  GstRTSPSocketPoolPrivate *priv;
+  SocketPair *pair;
+  gint idx;
+
+  g_return_val_if_fail (GST_IS_RTSP_SOCKET_POOL (pool), FALSE);
+  g_return_val_if_fail (rtp_socket != NULL, FALSE);
+  g_return_val_if_fail (rtcp_socket != NULL, FALSE);
+  g_return_val_if_fail (address != NULL, FALSE);
+
+  priv = pool->priv;
+  idx = FAMILY_INDEX (family);
+
+  g_mutex_lock (&priv->lock);
+  pair = g_queue_pop_head (&priv->pairs[idx]);
+  priv->wanted[idx] = TRUE;
+  start_refill (pool);
+  g_mutex_unlock (&priv->lock);
+
+  if (pair == NULL)
+    goto empty;
+
+  *rtp_socket = pair->rtp_socket;
+  *rtcp_socket = pair->rtcp_socket;
+  *address = pair->addr;
+  g_slice_free (SocketPair, pair);
+
+  return TRUE;
+
+  /* ERRORS */
+empty:
+  {
+    GST_DEBUG_OBJECT (pool, "no socket pair available");
+    return FALSE;
+  }
+}
+
+static MuxRoute *
+mux_route_new (GstRTSPSocketPoolReceiveFunc func, GObject * object)
+{
+  MuxRoute *route;
+
+  route = g_slice_new (MuxRoute);
+  route->refcount = 1;
+  g_weak_ref_init (&route->object, object);
+  route->func = func;
+
+  return route;
+}
+
+static void
+mux_route_unref (MuxRoute * route)
+{
+  if (g_atomic_int_dec_and_test (&route->refcount)) {
+    g_weak_ref_clear (&route->object);
+    g_slice_free (MuxRoute, route);
+  }
+}
+
+static guint
+mux_key_hash (const MuxKey * key)
+{
+  guint hash = key->port;
+  gsize i;
+
+  for (i = 0; i < key->size; i++)
+    hash = (hash << 5) - hash + key->bytes[i];
+
+  return hash;
+}
+
+static gboolean
+mux_key_equal (const MuxKey * a, const MuxKey * b)
+{
+  return a->port == b->port && a->size == b->size &&
+      memcmp (a->bytes, b->bytes, a->size) == 0;
+}
+
+static gboolean
+mux_key_init (MuxKey * key, GInetAddress * inetaddr, guint16 port)
+{
+  key->size = g_inet_address_get_native_size (inetaddr);
+  if (key->size > sizeof (key->bytes))
+    return FALSE;
+
+  memcpy (key->bytes, g_inet_address_to_bytes (inetaddr), key->size);
+  key->port = port;
+
+  return TRUE;
+}
+
+#ifdef HAVE_RECVMMSG
+static gboolean
+mux_key_init_native (MuxKey * key, const struct sockaddr_storage *addr)
+{
+  switch (addr->ss_family) {
+    case AF_INET:
+    {
+      const struct sockaddr_in *sin = (const struct sockaddr_in *) addr;
+
+      key->size = sizeof (sin->sin_addr);
+      memcpy (key->bytes, &sin->sin_addr, key->size);
+      key->port = g_ntohs (sin->sin_port);
+      return TRUE;
+    }
+    case AF_INET6:
+    {
+      const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *) addr;
+
+      key->size = sizeof (sin6->sin6_addr);
+      memcpy (key->bytes, &sin6->sin6_addr, key->size);
+      key->port = g_ntohs (sin6->sin6_port);
+      return TRUE;
+    }
+    default:
+      return FALSE;
+  }
+}
+#endif
+
+static MuxLoop *
+mux_loop_ref (MuxLoop * mux_loop)
+{
+  g_atomic_int_inc (&mux_loop->refcount);
+  return mux_loop;
+}
+
+static void
+mux_loop_unref (MuxLoop * mux_loop)
+{
+  gint i, j;
+
+  if (!g_atomic_int_dec_and_test (&mux_loop->refcount))
+    return;
+
+  for (i = 0; i < MUX_MAX_BATCH; i++) {
+    MuxSlot *slot = &mux_loop->slots[i];
+
+    if (slot->buffer) {
+      gst_buffer_unmap (slot->buffer, &slot->map);
+      gst_buffer_unref (slot->buffer);
+    }
+  }
+  gst_buffer_pool_set_active (mux_loop->buffer_pool, FALSE);
+  gst_object_unref (mux_loop->buffer_pool);
+
+  for (i = 0; i < 2; i++) {
+    for (j = 0; j < 2; j++) {
+      GSource *source = mux_loop->sockets[i][j].source;
+
+      if (source) {
+        g_source_destroy (source);
+        g_source_unref (source);
+      }
+    }
+    if (mux_loop->pairs[i])
+      socket_pair_free (mux_loop->pairs[i]);
+  }
+  g_hash_table_unref (mux_loop->sources);
+  g_hash_table_unref (mux_loop->ssrcs);
+  g_main_loop_unref (mux_loop->loop);
+  g_main_context_unref (mux_loop->context);
+  g_mutex_clear (&mux_loop->lock);
+  g_slice_free (MuxLoop, mux_loop);
+}
+
+/* find the route for an RTCP packet from an unknown address by the SSRCs in
+ * the report blocks of the SR and RR packets. Called with the mux lock. */
+static MuxRoute *
+mux_loop_find_ssrc (MuxLoop * mux_loop, const guint8 * data, gsize size)
+{
+  while (size >= 4) {
+    gsize length, offset;
+    guint i, count;
+
+    /* version 2 */
+    if ((data[0] & 0xc0) != 0x80)
+      break;
+
+    length = (GST_READ_UINT16_BE (data + 2) + 1) * 4;
+    if (length > size)
+      break;
+
+    count = data[0] & 0x1f;
+    switch (data[1]) {
+      case 200:
+        /* SR, the report blocks are after the sender info */
+        offset = 28;
+        break;
+      case 201:
+        /* RR */
+        offset = 8;
+        break;
+      default:
+        offset = length;
+        count = 0;
+        break;
+    }
+    for (i = 0; i < count && offset + 4 <= length; i++, offset += 24) {
+      MuxRoute *route;
+      guint32 ssrc;
+
+      ssrc = GST_READ_UINT32_BE (data + offset);
+      route = g_hash_table_lookup (mux_loop->ssrcs, GUINT_TO_POINTER (ssrc));
+      if (route)
+        return route;
+    }
+    data += length;
+    size -= length;
+  }
+  return NULL;
+}
+
+/* get buffers for the slots that were handed out in the previous batch */
+static gboolean
+mux_loop_fill_slots (MuxLoop * mux_loop)
+{
+  gint i;
+
+  for (i = 0; i < MUX_MAX_BATCH; i++) {
+    MuxSlot *slot = &mux_loop->slots[i];
+
+    if (slot->buffer == NULL) {
+      if (gst_buffer_pool_acquire_buffer (mux_loop->buffer_pool,
+              &slot->buffer, NULL) != GST_FLOW_OK)
+        return FALSE;
+      /* the previous user might have made it smaller */
+      gst_buffer_set_size (slot->buffer, MUX_SLOT_SIZE);
+      gst_buffer_map (slot->buffer, &slot->map, GST_MAP_WRITE);
+    }
+#ifdef HAVE_RECVMMSG
+    mux_loop->iov[i].iov_base = slot->map.data;
+    mux_loop->iov[i].iov_len = MUX_SLOT_SIZE;
+#endif
+  }
+  return TRUE;
+}
+
+#ifdef HAVE_RECVMMSG
+static gint
+mux_loop_receive (MuxLoop * mux_loop, GSocket * socket)
+{
+  gint i, n, res;
+
+  for (i = 0; i < MUX_MAX_BATCH; i++) {
+    struct msghdr *hdr = &mux_loop->msgs[i].msg_hdr;
+
+    memset (hdr, 0, sizeof (struct msghdr));
+    hdr->msg_name = &mux_loop->addrs[i];
+    hdr->msg_namelen = sizeof (struct sockaddr_storage);
+    hdr->msg_iov = &mux_loop->iov[i];
+    hdr->msg_iovlen = 1;
+  }
+
+  n = recvmmsg (g_socket_get_fd (socket), mux_loop->msgs, MUX_MAX_BATCH,
+      MSG_DONTWAIT, NULL);
+
+  for (i = 0, res = 0; i < n; i++) {
+    MuxSlot *slot = &mux_loop->slots[res];
+
+    if (mux_loop->msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+      GST_LOG ("dropping packet larger than %d bytes", MUX_SLOT_SIZE);
+      continue;
+    }
+    /* keep the received packets together at the start of the slots */
+    if (res != i) {
+      MuxSlot tmp = *slot;
+
+      *slot = mux_loop->slots[i];
+      mux_loop->slots[i] = tmp;
+    }
+    slot->size = mux_loop->msgs[i].msg_len;
+    slot->have_key = mux_key_init_native (&slot->key, &mux_loop->addrs[i]);
+    res++;
+  }
+  return res;
+}
+#else
+static gint
+mux_loop_receive (MuxLoop * mux_loop, GSocket * socket)
+{
+  gint i;
+
+  for (i = 0; i < MUX_MAX_BATCH; i++) {
+    MuxSlot *slot = &mux_loop->slots[i];
+    GSocketAddress *from = NULL;
+    gssize size;
+
+    /* we were woken up for the first packet, don't block for the others */
+    if (i > 0 && !(g_socket_condition_check (socket, G_IO_IN) & G_IO_IN))
+      break;
+
+    size = g_socket_receive_from (socket, &from, (gchar *) slot->map.data,
+        MUX_SLOT_SIZE, NULL, NULL);
+    if (size < 0)
+      break;
+
+    slot->size = size;
+    slot->have_key = FALSE;
+    if (G_IS_INET_SOCKET_ADDRESS (from)) {
+      GInetSocketAddress *inetsockaddr = G_INET_SOCKET_ADDRESS (from);
+
+      slot->have_key = mux_key_init (&slot->key,
+          g_inet_socket_address_get_address (inetsockaddr),
+          g_inet_socket_address_get_port (inetsockaddr));
+    }
+    if (from)
+      g_object_unref (from);
+  }
+  return i;
+}
+#endif
+
+/* get a ref to the route of each received packet with one lock */
+static void
+mux_loop_find_routes (MuxLoop * mux_loop, gint n_slots, gboolean rtcp)
+{
+  gint i;
+
+  g_mutex_lock (&mux_loop->lock);
+  for (i = 0; i < n_slots; i++) {
+    MuxSlot *slot = &mux_loop->slots[i];
+    MuxRoute *route = NULL;
+
+    if (slot->have_key)
+      route = g_hash_table_lookup (mux_loop->sources, &slot->key);
+    if (route == NULL && rtcp)
+      route = mux_loop_find_ssrc (mux_loop, slot->map.data, slot->size);
+    if (route)
+      g_atomic_int_inc (&route->refcount);
+    slot->route = route;
+  }
+  g_mutex_unlock (&mux_loop->lock);
+}
+
+static gboolean
+mux_socket_receive (GSocket * socket, GIOCondition condition,
+    MuxSocket * msocket)
+{
+  MuxLoop *mux_loop = msocket->mux_loop;
+  gint i, n_slots;
+
+  if (!mux_loop_fill_slots (mux_loop))
+    goto no_buffers;
+
+  n_slots = mux_loop_receive (mux_loop, socket);
+  if (n_slots <= 0)
+    return TRUE;
+
+  mux_loop_find_routes (mux_loop, n_slots, msocket->rtcp);
+
+  /* call without the lock, the object can take its own locks and
+   * add or remove routes */
+  for (i = 0; i < n_slots; i++) {
+    MuxSlot *slot = &mux_loop->slots[i];
+    MuxRoute *route = slot->route;
+    GObject *object;
+
+    if (route == NULL) {
+      GST_LOG ("dropping packet of %" G_GSIZE_FORMAT " bytes", slot->size);
+      continue;
+    }
+    if ((object = g_weak_ref_get (&route->object))) {
+      GstBuffer *buffer = slot->buffer;
+
+      /* the buffer goes back to the pool when the object is done with it */
+      gst_buffer_unmap (buffer, &slot->map);
+      gst_buffer_set_size (buffer, slot->size);
+      slot->buffer = NULL;
+
+      route->func (object, buffer, msocket->rtcp);
+      g_object_unref (object);
+    }
+    slot->route = NULL;
+    mux_route_unref (route);
+  }
+  return TRUE;
+
+  /* ERRORS */
+no_buffers:
+  {
+    GST_WARNING ("could not get receive buffers");
+    return TRUE;
+  }
+}
+
+static gpointer
+mux_loop_thread (MuxLoop * mux_loop)
+{
+  GST_DEBUG ("mux loop %p started", mux_loop);
+
+  g_main_context_push_thread_default (mux_loop->context);
+  g_main_loop_run (mux_loop->loop);
+  g_main_context_pop_thread_default (mux_loop->context);
+
+  GST_DEBUG ("mux loop %p stopped", mux_loop);
+
+  mux_loop_unref (mux_loop);
+
+  return NULL;
+}
+
+static MuxLoop *
+mux_loop_new (GstRTSPSocketPool * pool)
+{
+  MuxLoop *mux_loop;
+  GstStructure *config;
+  GError *error = NULL;
+
+  mux_loop = g_slice_new0 (MuxLoop);
+  /* one for the pool and one for the thread */
+  mux_loop->refcount = 2;
+  g_mutex_init (&mux_loop->lock);
+  mux_loop->sources = g_hash_table_new_full ((GHashFunc) mux_key_hash,
+      (GEqualFunc) mux_key_equal, g_free, (GDestroyNotify) mux_route_unref);
+  mux_loop->ssrcs = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) mux_route_unref);
+  mux_loop->context = g_main_context_new ();
+  mux_loop->loop = g_main_loop_new (mux_loop->context, FALSE);
+
+  /* enough for one batch, more are made while the objects hold on to the
+   * buffers */
+  mux_loop->buffer_pool = gst_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (mux_loop->buffer_pool);
+  gst_buffer_pool_config_set_params (config, NULL, MUX_SLOT_SIZE,
+      MUX_MAX_BATCH, 0);
+  gst_buffer_pool_set_config (mux_loop->buffer_pool, config);
+  gst_buffer_pool_set_active (mux_loop->buffer_pool, TRUE);
+
+  mux_loop->thread = g_thread_try_new ("rtsp-socket-mux",
+      (GThreadFunc) mux_loop_thread, mux_loop, &error);
+  if (mux_loop->thread == NULL)
+    goto thread_error;
+
+  return mux_loop;
+
+  /* ERRORS */
+thread_error:
+  {
+    GST_ERROR_OBJECT (pool, "failed to start mux thread: %s", error->message);
+    g_clear_error (&error);
+    mux_loop->refcount = 1;
+    mux_loop_unref (mux_loop);
+    return NULL;
+  }
+}
+
+static gboolean
+mux_loop_quit (MuxLoop * mux_loop)
+{
+  g_main_loop_quit (mux_loop->loop);
+  return FALSE;
+}
+
+/* stop the thread and drop the ref of the pool */
+static void
+mux_loop_stop (MuxLoop * mux_loop)
+{
+  GSource *source;
+
+  /* from a source so that it also works when the loop is not running yet */
+  source = g_idle_source_new ();
+  g_source_set_callback (source, (GSourceFunc) mux_loop_quit, mux_loop, NULL);
+  g_source_attach (source, mux_loop->context);
+  g_source_unref (source);
+
+  /* when the last object unref happened from a receive callback, the thread
+   * finishes by itself after the callback */
+  if (mux_loop->thread != g_thread_self ())
+    g_thread_join (mux_loop->thread);
+  else
+    g_thread_unref (mux_loop->thread);
+
+  mux_loop_unref (mux_loop);
+}
+
+/* must be called with the pool lock */
+static void
+mux_loop_add_pair (MuxLoop * mux_loop, gint idx, SocketPair * pair)
+{
+  gint i;
+
+  mux_loop->pairs[idx] = pair;
+
+  for (i = 0; i < 2; i++) {
+    MuxSocket *msocket = &mux_loop->sockets[idx][i];
+    GSocket *socket = i == 0 ? pair->rtp_socket : pair->rtcp_socket;
+
+    msocket->mux_loop = mux_loop;
+    msocket->rtcp = i == 1;
+    msocket->source = g_socket_create_source (socket, G_IO_IN, NULL);
+    g_source_set_callback (msocket->source, (GSourceFunc) mux_socket_receive,
+        msocket, NULL);
+    g_source_attach (msocket->source, mux_loop->context);
+  }
+}
+
+/**
+ * gst_rtsp_socket_pool_set_mux:
+ * @pool: a #GstRTSPSocketPool
+ * @mux: the new value
+ *
+ * Enable or disable mux mode in @pool. In mux mode, streams take the shared
+ * socket pair with gst_rtsp_socket_pool_acquire_mux() and register their
+ * clients with gst_rtsp_socket_pool_add_mux_source().
+ *
+ * Streams that already use the shared sockets keep on using them when mux
+ * mode is disabled again.
+ */
+void
+gst_rtsp_socket_pool_set_mux (GstRTSPSocketPool * pool, gboolean mux)
+{
+  GstRTSPSocketPoolPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_SOCKET_POOL (pool));
+
+  priv = pool->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->mux = mux;
+  if (mux && priv->mux_loop == NULL)
+    priv->mux_loop = mux_loop_new (pool);
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_socket_pool_get_mux:
+ * @pool: a #GstRTSPSocketPool
+ *
+ * Check if @pool is in mux mode.
+ *
+ * Returns: %TRUE if all streams share the same socket pair
+ */
+gboolean
+gst_rtsp_socket_pool_get_mux (GstRTSPSocketPool * pool)
+{
+  GstRTSPSocketPoolPrivate *priv;
+  gboolean res;
+
+  g_return_val_if_fail (GST_IS_RTSP_SOCKET_POOL (pool), FALSE);
+
+  priv = pool->priv;
+
+  g_mutex_lock (&priv->lock);
+  res = priv->mux && priv->mux_loop != NULL;
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_socket_pool_acquire_mux:
+ * @pool: a #GstRTSPSocketPool
+ * @family: a #GSocketFamily
+ * @rtp_socket: (out) (transfer full): the shared RTP socket
+ * @rtcp_socket: (out) (transfer full): the shared RTCP socket
+ * @address: (out) (transfer full) (allow-none): the #GstRTSPAddress
+ *
+ * Get the socket pair of @family that is shared between all the streams
+ * of @pool. The pair is bound on the first call. The sockets should only be
+ * used for sending, @pool receives on them.
+ *
+ * @address contains a copy of the address of the sockets when they were bound
+ * to an address from the #GstRTSPAddressPool of @pool. Freeing it with
+ * gst_rtsp_address_free() does not release the address.
+ *
+ * Returns: %TRUE when @pool is in mux mode and the sockets could be bound
+ */
+gboolean
+gst_rtsp_socket_pool_acquire_mux (GstRTSPSocketPool * pool,
+    GSocketFamily family, GSocket ** rtp_socket, GSocket ** rtcp_socket,
+    GstRTSPAddress ** address)
+{
+  GstRTSPSocketPoolPrivate *priv;
+  SocketPair *pair;
+  gint idx;
+
+  g_return_val_if_fail (GST_IS_RTSP_SOCKET_POOL (pool), FALSE);
+  g_return_val_if_fail (rtp_socket != NULL, FALSE);
+  g_return_val_if_fail (rtcp_socket != NULL, FALSE);
+  g_return_val_if_fail (address != NULL, FALSE);
+
+  priv = pool->priv;
+  idx = FAMILY_INDEX (family);
+
+  g_mutex_lock (&priv->lock);
+  if (!priv->mux || priv->mux_loop == NULL)
+    goto no_mux;
+
+  if ((pair = priv->mux_loop->pairs[idx]) == NULL) {
+    SocketPair *new_pair;
+
+    /* bind without the lock, we might race with another stream */
+    g_mutex_unlock (&priv->lock);
+    new_pair = make_socket_pair (pool, idx);
+    g_mutex_lock (&priv->lock);
+
+    if (priv->mux_loop->pairs[idx] == NULL) {
+      if (new_pair == NULL)
+        goto no_pair;
+      mux_loop_add_pair (priv->mux_loop, idx, new_pair);
+    } else if (new_pair) {
+      socket_pair_free (new_pair);
+    }
+    pair = priv->mux_loop->pairs[idx];
+  }
+  *rtp_socket = g_object_ref (pair->rtp_socket);
+  *rtcp_socket = g_object_ref (pair->rtcp_socket);
+  *address = pair->addr ? gst_rtsp_address_copy (pair->addr) : NULL;
+  g_mutex_unlock (&priv->lock);
+
+  return TRUE;
+
+  /* ERRORS */
+no_mux:
+  {
+    GST_DEBUG_OBJECT (pool, "not in mux mode");
+    g_mutex_unlock (&priv->lock);
+    return FALSE;
+  }
+no_pair:
+  {
+    GST_WARNING_OBJECT (pool, "could not make the shared socket pair");
+    g_mutex_unlock (&priv->lock);
+    return FALSE;
+  }
+}
+
+/* get a ref to the mux loop of @pool */
+static MuxLoop *
+get_mux_loop (GstRTSPSocketPool * pool)
+{
+  GstRTSPSocketPoolPrivate *priv = pool->priv;
+  MuxLoop *mux_loop;
+
+  g_mutex_lock (&priv->lock);
+  if ((mux_loop = priv->mux_loop))
+    mux_loop_ref (mux_loop);
+  g_mutex_unlock (&priv->lock);
+
+  return mux_loop;
+}
+
+static MuxKey *
+make_mux_key (const gchar * address, guint16 port)
+{
+  GInetAddress *inetaddr;
+  MuxKey *key;
+
+  inetaddr = g_inet_address_new_from_string (address);
+  if (inetaddr == NULL)
+    return NULL;
+
+  key = g_new0 (MuxKey, 1);
+  if (!mux_key_init (key, inetaddr, port)) {
+    g_free (key);
+    key = NULL;
+  }
+  g_object_unref (inetaddr);
+
+  return key;
+}
+
+/**
+ * gst_rtsp_socket_pool_add_mux_source:
+ * @pool: a #GstRTSPSocketPool
+ * @address: the source address
+ * @port: the source port
+ * @func: function to call for each packet
+ * @object: the object to pass to @func
+ *
+ * Call @func with @object for all packets that are received on the shared
+ * sockets of @pool from @address and @port. @func is called from the
+ * receive thread of @pool and should not block.
+ *
+ * @pool only keeps a weak reference to @object, packets for @object are
+ * dropped after it is finalized.
+ */
+void
+gst_rtsp_socket_pool_add_mux_source (GstRTSPSocketPool * pool,
+    const gchar * address, guint16 port, GstRTSPSocketPoolReceiveFunc func,
+    GObject * object)
+{
+  MuxLoop *mux_loop;
+  MuxKey *key;
+
+  g_return_if_fail (GST_IS_RTSP_SOCKET_POOL (pool));
+  g_return_if_fail (address != NULL);
+  g_return_if_fail (func != NULL);
+  g_return_if_fail (G_IS_OBJECT (object));
+
+  if ((mux_loop = get_mux_loop (pool)) == NULL)
+    goto no_mux;
+
+  if ((key = make_mux_key (address, port)) == NULL)
+    goto invalid_address;
+
+  GST_DEBUG_OBJECT (pool, "route %s:%u to %p", address, port, object);
+
+  g_mutex_lock (&mux_loop->lock);
+  g_hash_table_replace (mux_loop->sources, key, mux_route_new (func, object));
+  g_mutex_unlock (&mux_loop->lock);
+
+  mux_loop_unref (mux_loop);
+
+  return;
+
+  /* ERRORS */
+no_mux:
+  {
+    GST_WARNING_OBJECT (pool, "not in mux mode");
+    return;
+  }
+invalid_address:
+  {
+    GST_WARNING_OBJECT (pool, "invalid address %s", address);
+    mux_loop_unref (mux_loop);
+    return;
+  }
+}
+
+/**
+ * gst_rtsp_socket_pool_remove_mux_source:
+ * @pool: a #GstRTSPSocketPool
+ * @address: the source address
+ * @port: the source port
+ *
+ * Stop routing the packets from @address and @port.
+ */
+void
+gst_rtsp_socket_pool_remove_mux_source (GstRTSPSocketPool * pool,
+    const gchar * address, guint16 port)
+{
+  MuxLoop *mux_loop;
+  MuxKey *key;
+
+  g_return_if_fail (GST_IS_RTSP_SOCKET_POOL (pool));
+  g_return_if_fail (address != NULL);
+
+  if ((mux_loop = get_mux_loop (pool)) == NULL)
+    return;
+
+  if ((key = make_mux_key (address, port))) {
+    GST_DEBUG_OBJECT (pool, "remove route %s:%u", address, port);
+
+    g_mutex_lock (&mux_loop->lock);
+    g_hash_table_remove (mux_loop->sources, key);
+    g_mutex_unlock (&mux_loop->lock);
+    g_free (key);
+  }
+  mux_loop_unref (mux_loop);
+}
+
+/**
+ * gst_rtsp_socket_pool_add_mux_ssrc:
+ * @pool: a #GstRTSPSocketPool
+ * @ssrc: the SSRC of a sender
+ * @func: function to call for each packet
+ * @object: the object to pass to @func
+ *
+ * Call @func with @object for the RTCP packets that are received on the
+ * shared sockets of @pool from an unknown address and that contain a report
+ * about @ssrc. This handles clients that change their address, for example
+ * after a NAT rebinding.
+ *
+ * @pool only keeps a weak reference to @object.
+ */
+void
+gst_rtsp_socket_pool_add_mux_ssrc (GstRTSPSocketPool * pool, guint32 ssrc,
+    GstRTSPSocketPoolReceiveFunc func, GObject * object)
+{
+  MuxLoop *mux_loop;
+
+  g_return_if_fail (GST_IS_RTSP_SOCKET_POOL (pool));
+  g_return_if_fail (func != NULL);
+  g_return_if_fail (G_IS_OBJECT (object));
+
+  if ((mux_loop = get_mux_loop (pool)) == NULL)
+    goto no_mux;
+
+  GST_DEBUG_OBJECT (pool, "route SSRC %08x to %p", ssrc, object);
+
+  g_mutex_lock (&mux_loop->lock);
+  g_hash_table_replace (mux_loop->ssrcs, GUINT_TO_POINTER (ssrc),
+      mux_route_new (func, object));
+  g_mutex_unlock (&mux_loop->lock);
+
+  mux_loop_unref (mux_loop);
+
+  return;
+
+  /* ERRORS */
+no_mux:
+  {
+    GST_WARNING_OBJECT (pool, "not in mux mode");
+    return;
+  }
+}
+
+/**
+ * gst_rtsp_socket_pool_remove_mux_ssrc:
+ * @pool: a #GstRTSPSocketPool
+ * @ssrc: the SSRC of a sender
+ *
+ * Stop routing the RTCP packets about @ssrc.
+ */
+void
+gst_rtsp_socket_pool_remove_mux_ssrc (GstRTSPSocketPool * pool, guint32 ssrc)
+{
+  MuxLoop *mux_loop;
+
+  g_return_if_fail (GST_IS_RTSP_SOCKET_POOL (pool));
+
+  if ((mux_loop = get_mux_loop (pool)) == NULL)
+    return;
+
+  GST_DEBUG_OBJECT (pool, "remove route SSRC %08x", ssrc);
+
+  g_mutex_lock (&mux_loop->lock);
+  g_hash_table_remove (mux_loop->ssrcs, GUINT_TO_POINTER (ssrc));
+  g_mutex_unlock (&mux_loop->lock);
+
+  mux_loop_unref (mux_loop);
+}
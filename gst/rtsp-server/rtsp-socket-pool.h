@@ -0,0 +1,131 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+
+#include "rtsp-address-pool.h"
+
+#ifndef __GST_RTSP_SOCKET_POOL_H__
+#define __GST_RTSP_SOCKET_POOL_H__
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_RTSP_SOCKET_POOL              (gst_rtsp_socket_pool_get_type ())
+#define GST_IS_RTSP_SOCKET_POOL(obj)           (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_RTSP_SOCKET_POOL))
+#define GST_IS_RTSP_SOCKET_POOL_CLASS(klass)   (G_TYPE_CHECK_CLASS_TYPE ((klass), GST_TYPE_RTSP_SOCKET_POOL))
+#define GST_RTSP_SOCKET_POOL_GET_CLASS(obj)    (G_TYPE_INSTANCE_GET_CLASS ((obj), GST_TYPE_RTSP_SOCKET_POOL, GstRTSPSocketPoolClass))
+#define GST_RTSP_SOCKET_POOL(obj)              (G_TYPE_CHECK_INSTANCE_CAST ((obj), GST_TYPE_RTSP_SOCKET_POOL, GstRTSPSocketPool))
+#define GST_RTSP_SOCKET_POOL_CLASS(klass)      (G_TYPE_CHECK_CLASS_CAST ((klass), GST_TYPE_RTSP_SOCKET_POOL, GstRTSPSocketPoolClass))
+#define GST_RTSP_SOCKET_POOL_CAST(obj)         ((GstRTSPSocketPool*)(obj))
+#define GST_RTSP_SOCKET_POOL_CLASS_CAST(klass) ((GstRTSPSocketPoolClass*)(klass))
+
+typedef struct _GstRTSPSocketPool GstRTSPSocketPool;
+typedef struct _GstRTSPSocketPoolClass GstRTSPSocketPoolClass;
+typedef struct _GstRTSPSocketPoolPrivate GstRTSPSocketPoolPrivate;
+
+/**
+ * GstRTSPSocketPoolReceiveFunc:
+ * @object: the object that was registered for the packet
+ * @buffer: (transfer full): the received packet
+ * @rtcp: %TRUE when @buffer was received on the RTCP socket
+ *
+ * Called from the receive thread of a #GstRTSPSocketPool in mux mode for
+ * each packet that was routed to @object.
+ */
+typedef void (*GstRTSPSocketPoolReceiveFunc) (GObject *object, GstBuffer *buffer,
+                                              gboolean rtcp);
+
+/**
+ * GstRTSPSocketPool:
+ * @parent: the parent GObject
+ *
+ * A pool of bound RTP/RTCP socket pairs, all members are private
+ */
+struct _GstRTSPSocketPool {
+  GObject       parent;
+
+  /*< private >*/
+  GstRTSPSocketPoolPrivate *priv;
+  gpointer _gst_reserved[GST_PADDING];
+};
+
+/**
+ * GstRTSPSocketPoolClass:
+ *
+ * Opaque Socket pool class.
+ */
+struct _GstRTSPSocketPoolClass {
+  GObjectClass  parent_class;
+
+  /*< private >*/
+  gpointer _gst_reserved[GST_PADDING];
+};
+
+GType                 gst_rtsp_socket_pool_get_type        (void);
+
+GstRTSPSocketPool *   gst_rtsp_socket_pool_new             (void);
+
+void                  gst_rtsp_socket_pool_set_size        (GstRTSPSocketPool *pool, guint size);
+guint                 gst_rtsp_socket_pool_get_size        (GstRTSPSocketPool *pool);
+
+void                  gst_rtsp_socket_pool_set_buffer_size (GstRTSPSocketPool *pool, gint size);
+gint                  gst_rtsp_socket_pool_get_buffer_size (GstRTSPSocketPool *pool);
+
+void                  gst_rtsp_socket_pool_set_address_pool (GstRTSPSocketPool *pool,
+                                                            GstRTSPAddressPool *address_pool);
+GstRTSPAddressPool *  gst_rtsp_socket_pool_get_address_pool (GstRTSPSocketPool *pool);
+
+guint                 gst_rtsp_socket_pool_get_n_idle      (GstRTSPSocketPool *pool,
+                                                            GSocketFamily family);
+
+gboolean              gst_rtsp_socket_pool_acquire         (GstRTSPSocketPool *pool,
+                                                            GSocketFamily family,
+                                                            GSocket **rtp_socket,
+                                                            GSocket **rtcp_socket,
+                                                            GstRTSPAddress **address);
+
+/* sharing one socket pair between all streams */
+void                  gst_rtsp_socket_pool_set_mux         (GstRTSPSocketPool *pool, gboolean mux);
+gboolean              gst_rtsp_socket_pool_get_mux         (GstRTSPSocketPool *pool);
+
+gboolean              gst_rtsp_socket_pool_acquire_mux     (GstRTSPSocketPool *pool,
+                                                            GSocketFamily family,
+                                                            GSocket **rtp_socket,
+                                                            GSocket **rtcp_socket,
+                                                            GstRTSPAddress **address);
+
+void                  gst_rtsp_socket_pool_add_mux_source  (GstRTSPSocketPool *pool,
+                                                            const gchar *address,
+                                                            guint16 port,
+                                                            GstRTSPSocketPoolReceiveFunc func,
+                                                            GObject *object);
+void                  gst_rtsp_socket_pool_remove_mux_source (GstRTSPSocketPool *pool,
+                                                            const gchar *address,
+                                                            guint16 port);
+void                  gst_rtsp_socket_pool_add_mux_ssrc    (GstRTSPSocketPool *pool,
+                                                            guint32 ssrc,
+                                                            GstRTSPSocketPoolReceiveFunc func,
+                                                            GObject *object);
+void                  gst_rtsp_socket_pool_remove_mux_ssrc (GstRTSPSocketPool *pool,
+                                                            guint32 ssrc);
+
+G_END_DECLS
+
+#endif /* __GST_RTSP_SOCKET_POOL_H__ */
@@ -35,17 +35,36 @@
  * is received from the client. It will also call
  * gst_rtsp_stream_transport_set_timed_out() when a receiver has timed out.
  *
+ * With gst_rtsp_stream_transport_set_rtp_rewrite() the SSRC, sequence numbers
+ * and RTP timestamps of the packets can be changed for one transport. Only
+ * the 12 byte RTP header is written for each transport, the payload stays
+ * shared with the other transports of the stream. The sender reports, SDES
+ * and BYE packets in the RTCP of the transport get the same SSRC and RTP
+ * time.
+ *
+ * With gst_rtsp_stream_transport_set_qos_policy() the packets to a unicast
+ * UDP transport are marked with their own DSCP and socket priority for each
+ * #GstRTSPPacketClass, so that the routers and the queues of the host let the
+ * key frames of important receivers through first. The default #GstRTSPClient
+ * takes the policy from the role of the session.
+ *
  * Last reviewed on 2013-07-16 (1.0.0)
  */
 
 #include <string.h>
 #include <stdlib.h>
 
+#include <gst/rtp/gstrtcpbuffer.h>
+
 #include "rtsp-stream-transport.h"
+#include "rtsp-server-internal.h"
 
 #define GST_RTSP_STREAM_TRANSPORT_GET_PRIVATE(obj)  \
        (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_RTSP_STREAM_TRANSPORT, GstRTSPStreamTransportPrivate))
 
+#define N_PACKET_CLASSES        (GST_RTSP_PACKET_CLASS_RTCP + 1)
+#define MAX_QOS_PRIORITY        6
+
 struct _GstRTSPStreamTransportPrivate
 {
   GstRTSPStream *stream;
@@ -65,6 +84,20 @@ struct _GstRTSPStreamTransportPrivate
   GstRTSPUrl *url;
 
   GObject *rtpsource;
+
+  GMutex lock;
+  gboolean rewrite;             /* protected by lock */
+  guint32 rewrite_ssrc;
+  guint16 seq_offset;
+  guint32 rtptime_offset;
+  GstStructure *qos_policy;
+  gint qos_dscp[N_PACKET_CLASSES];
+  gint qos_priority[N_PACKET_CLASSES];
+  gboolean qos_pacing;
+};
+
+static const gchar *packet_class_names[N_PACKET_CLASSES] = {
+  "key-frame", "delta-frame", "audio", "rtcp"
 };
 
 enum
@@ -101,8 +134,16 @@ gst_rtsp_stream_transport_init (GstRTSPStreamTransport * trans)
 {
   GstRTSPStreamTransportPrivate *priv =
       GST_RTSP_STREAM_TRANSPORT_GET_PRIVATE (trans);
+  guint i;
 
   trans->priv = priv;
+
+  g_mutex_init (&priv->lock);
+  for (i = 0; i < N_PACKET_CLASSES; i++) {
+    priv->qos_dscp[i] = -1;
+    priv->qos_priority[i] = -1;
+  }
+  priv->qos_pacing = TRUE;
 }
 
 static void
@@ -124,6 +165,11 @@ gst_rtsp_stream_transport_finalize (GObject * obj)
   if (priv->url)
     gst_rtsp_url_free (priv->url);
 
+  if (priv->qos_policy)
+    gst_structure_free (priv->qos_policy);
+
+  g_mutex_clear (&priv->lock);
+
   G_OBJECT_CLASS (gst_rtsp_stream_transport_parent_class)->finalize (obj);
 }
 
@@ -338,6 +384,11 @@ gst_rtsp_stream_transport_get_rtpinfo (GstRTSPStreamTransport * trans,
           &running_time))
     return NULL;
 
+  /* the transport starts with the cached packets of the stream */
+  if (gst_rtsp_stream_get_gop_rtpinfo (priv->stream, priv->transport,
+          &rtptime, &seq))
+    running_time = GST_CLOCK_TIME_NONE;
+
   GST_DEBUG ("RTP time %u, seq %u, rate %u, running-time %" GST_TIME_FORMAT,
       rtptime, seq, clock_rate, GST_TIME_ARGS (running_time));
 
@@ -356,6 +407,14 @@ gst_rtsp_stream_transport_get_rtpinfo (GstRTSPStreamTransport * trans,
   GST_DEBUG ("RTP time %u, for start-time %" GST_TIME_FORMAT,
       rtptime, GST_TIME_ARGS (start_time));
 
+  /* the client sees the rewritten values */
+  g_mutex_lock (&priv->lock);
+  if (priv->rewrite) {
+    seq = (guint16) (seq + priv->seq_offset);
+    rtptime += priv->rtptime_offset;
+  }
+  g_mutex_unlock (&priv->lock);
+
   rtpinfo = g_string_new ("");
 
   url_str = gst_rtsp_url_get_request_uri (trans->priv->url);
@@ -432,6 +491,393 @@ gst_rtsp_stream_transport_is_timed_out (GstRTSPStreamTransport * trans)
   return trans->priv->timed_out;
 }
 
+/**
+ * gst_rtsp_stream_transport_set_rtp_rewrite:
+ * @trans: a #GstRTSPStreamTransport
+ * @rewrite: if the RTP headers should be rewritten
+ * @ssrc: the SSRC for the packets of @trans
+ * @seq_offset: added to the sequence numbers
+ * @rtptime_offset: added to the RTP timestamps
+ *
+ * Rewrite the RTP header of the packets sent to @trans. Use this for a
+ * receiver that needs its own SSRC, sequence numbers or timestamps, for
+ * example when it joins a stream late or when the stream is relayed.
+ *
+ * The RTCP of the sender is rewritten with
+ * gst_rtsp_stream_transport_rewrite_rtcp(). A UDP transport needs to be
+ * configured before it is activated, the values can be changed at any time.
+ */
+void
+gst_rtsp_stream_transport_set_rtp_rewrite (GstRTSPStreamTransport * trans,
+    gboolean rewrite, guint32 ssrc, guint16 seq_offset, guint32 rtptime_offset)
+{
+  GstRTSPStreamTransportPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans));
+
+  priv = trans->priv;
+
+  g_mutex_lock (&priv->lock);
+  priv->rewrite = rewrite;
+  priv->rewrite_ssrc = ssrc;
+  priv->seq_offset = seq_offset;
+  priv->rtptime_offset = rtptime_offset;
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_stream_transport_get_rtp_rewrite:
+ * @trans: a #GstRTSPStreamTransport
+ * @ssrc: (out) (allow-none): the SSRC for the packets of @trans
+ * @seq_offset: (out) (allow-none): added to the sequence numbers
+ * @rtptime_offset: (out) (allow-none): added to the RTP timestamps
+ *
+ * Get the RTP header rewrite of @trans.
+ *
+ * Returns: %TRUE when the RTP headers of @trans are rewritten.
+ */
+gboolean
+gst_rtsp_stream_transport_get_rtp_rewrite (GstRTSPStreamTransport * trans,
+    guint32 * ssrc, guint16 * seq_offset, guint32 * rtptime_offset)
+{
+  GstRTSPStreamTransportPrivate *priv;
+  gboolean res;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans), FALSE);
+
+  priv = trans->priv;
+
+  g_mutex_lock (&priv->lock);
+  res = priv->rewrite;
+  if (ssrc)
+    *ssrc = priv->rewrite_ssrc;
+  if (seq_offset)
+    *seq_offset = priv->seq_offset;
+  if (rtptime_offset)
+    *rtptime_offset = priv->rtptime_offset;
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_stream_transport_rewrite_rtp:
+ * @trans: a #GstRTSPStreamTransport
+ * @buffer: an RTP packet
+ *
+ * Apply the RTP header rewrite of @trans to @buffer. The result has a new
+ * memory with the 12 byte RTP header followed by the memory of @buffer
+ * after the header, the payload is not copied.
+ *
+ * Returns: (transfer full): the packet for @trans, @buffer with an extra
+ * ref when there is nothing to rewrite.
+ */
+GstBuffer *
+gst_rtsp_stream_transport_rewrite_rtp (GstRTSPStreamTransport * trans,
+    GstBuffer * buffer)
+{
+  GstRTSPStreamTransportPrivate *priv;
+  GstBuffer *out;
+  guint8 header[12];
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans), NULL);
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+
+  priv = trans->priv;
+
+  g_mutex_lock (&priv->lock);
+  if (!priv->rewrite || gst_buffer_extract (buffer, 0, header, 12) != 12) {
+    g_mutex_unlock (&priv->lock);
+    return gst_buffer_ref (buffer);
+  }
+
+  GST_WRITE_UINT16_BE (header + 2,
+      GST_READ_UINT16_BE (header + 2) + priv->seq_offset);
+  GST_WRITE_UINT32_BE (header + 4,
+      GST_READ_UINT32_BE (header + 4) + priv->rtptime_offset);
+  GST_WRITE_UINT32_BE (header + 8, priv->rewrite_ssrc);
+  g_mutex_unlock (&priv->lock);
+
+  out = gst_buffer_new_allocate (NULL, 12, NULL);
+  gst_buffer_fill (out, 0, header, 12);
+  gst_buffer_copy_into (out, buffer, GST_BUFFER_COPY_FLAGS |
+      GST_BUFFER_COPY_MEMORY, 12, -1);
+  GST_BUFFER_PTS (out) = GST_BUFFER_PTS (buffer);
+  GST_BUFFER_DTS (out) = GST_BUFFER_DTS (buffer);
+
+  return out;
+}
+
+/* replace the SSRC of the SDES chunks of @sender in the SDES packet at @data
+ * of @len bytes */
+static void
+rewrite_sdes (guint8 * data, guint len, guint32 sender, guint32 ssrc)
+{
+  guint count, i, offset;
+
+  count = data[0] & 0x1f;
+  offset = 4;
+  for (i = 0; i < count && offset + 4 <= len; i++) {
+    if (GST_READ_UINT32_BE (data + offset) == sender)
+      GST_WRITE_UINT32_BE (data + offset, ssrc);
+    offset += 4;
+
+    /* the items end with a null octet, the next chunk is 32 bit aligned */
+    while (offset + 1 < len && data[offset] != 0)
+      offset += 2 + data[offset + 1];
+    offset = (offset & ~3) + 4;
+  }
+}
+
+/**
+ * gst_rtsp_stream_transport_rewrite_rtcp:
+ * @trans: a #GstRTSPStreamTransport
+ * @buffer: an RTCP packet
+ *
+ * Apply the RTP header rewrite of @trans to the RTCP of the sender in
+ * @buffer. The sender SSRC of the sender and receiver reports and the SSRC
+ * of its SDES chunks and BYE packets are replaced. The RTP time of the sender
+ * reports gets the timestamp offset, so that the receiver can still
+ * synchronize the rewritten stream.
+ *
+ * Returns: (transfer full): the RTCP packet for @trans, @buffer with an extra
+ * ref when there is nothing to rewrite.
+ */
+GstBuffer *
+gst_rtsp_stream_transport_rewrite_rtcp (GstRTSPStreamTransport * trans,
+    GstBuffer * buffer)
+{
+  GstRTSPStreamTransportPrivate *priv;
+  GstBuffer *out;
+  GstMapInfo map;
+  guint32 ssrc, rtptime_offset, sender = 0;
+  gboolean have_sender = FALSE;
+  guint offset, len, count, i;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans), NULL);
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+
+  priv = trans->priv;
+
+  g_mutex_lock (&priv->lock);
+  if (!priv->rewrite) {
+    g_mutex_unlock (&priv->lock);
+    return gst_buffer_ref (buffer);
+  }
+  ssrc = priv->rewrite_ssrc;
+  rtptime_offset = priv->rtptime_offset;
+  g_mutex_unlock (&priv->lock);
+
+  /* RTCP packets are small, a copy is cheaper than a header memory for each
+   * packet of the compound */
+  out = gst_buffer_new_allocate (NULL, gst_buffer_get_size (buffer), NULL);
+  gst_buffer_copy_into (out, buffer, GST_BUFFER_COPY_FLAGS |
+      GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+  gst_buffer_map (out, &map, GST_MAP_WRITE);
+  gst_buffer_extract (buffer, 0, map.data, map.size);
+
+  for (offset = 0; offset + 8 <= map.size; offset += len) {
+    guint8 *data = map.data + offset;
+
+    len = (GST_READ_UINT16_BE (data + 2) + 1) * 4;
+    if (offset + len > map.size)
+      break;
+
+    switch (data[1]) {
+      case GST_RTCP_TYPE_SR:
+        if (len >= 28)
+          GST_WRITE_UINT32_BE (data + 16,
+              GST_READ_UINT32_BE (data + 16) + rtptime_offset);
+        /* fallthrough */
+      case GST_RTCP_TYPE_RR:
+        if (!have_sender) {
+          sender = GST_READ_UINT32_BE (data + 4);
+          have_sender = TRUE;
+        }
+        if (GST_READ_UINT32_BE (data + 4) == sender)
+          GST_WRITE_UINT32_BE (data + 4, ssrc);
+        break;
+      case GST_RTCP_TYPE_SDES:
+        if (have_sender)
+          rewrite_sdes (data, len, sender, ssrc);
+        break;
+      case GST_RTCP_TYPE_BYE:
+        count = data[0] & 0x1f;
+        for (i = 0; have_sender && i < count && 8 + i * 4 <= len; i++) {
+          if (GST_READ_UINT32_BE (data + 4 + i * 4) == sender)
+            GST_WRITE_UINT32_BE (data + 4 + i * 4, ssrc);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  gst_buffer_unmap (out, &map);
+
+  return out;
+}
+
+/* a mark of the policy, -1 when the field is missing or out of range */
+static gint
+get_qos_field (const GstStructure * policy, const gchar * klass,
+    const gchar * kind, gint max)
+{
+  gchar *name;
+  gint val = -1;
+
+  name = g_strdup_printf ("qos.%s-%s", klass, kind);
+  if (gst_structure_get_int (policy, name, &val) && (val < 0 || val > max)) {
+    GST_WARNING ("ignoring illegal %s %d", name, val);
+    val = -1;
+  }
+  g_free (name);
+
+  return val;
+}
+
+/**
+ * gst_rtsp_stream_transport_set_qos_policy:
+ * @trans: a #GstRTSPStreamTransport
+ * @policy: (allow-none): a #GstStructure with the policy
+ *
+ * Configure the QoS policy of @trans. For each #GstRTSPPacketClass, the
+ * policy can have a G_TYPE_INT "qos.&lt;class&gt;-dscp" field with the DSCP
+ * (0-63) and a G_TYPE_INT "qos.&lt;class&gt;-priority" field with the socket
+ * priority (0-6) of the packets, with "key-frame", "delta-frame", "audio" or
+ * "rtcp" as the class. A G_TYPE_BOOLEAN "qos.pacing" field set to %FALSE
+ * sends the packets as soon as they are made when the stream is paced.
+ * Other fields are ignored, so the policy can be the structure of a role in
+ * #GstRTSPPermissions.
+ *
+ * The packets are marked when they are sent, the socket priority needs a
+ * kernel that accepts it for each packet and is left out otherwise. Only
+ * unicast UDP transports are marked and only when the policy is configured
+ * before the transport is activated.
+ */
+void
+gst_rtsp_stream_transport_set_qos_policy (GstRTSPStreamTransport * trans,
+    const GstStructure * policy)
+{
+  GstRTSPStreamTransportPrivate *priv;
+  gboolean pacing = TRUE;
+  guint i;
+
+  g_return_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans));
+
+  priv = trans->priv;
+
+  g_mutex_lock (&priv->lock);
+  if (priv->qos_policy)
+    gst_structure_free (priv->qos_policy);
+  priv->qos_policy = policy ? gst_structure_copy (policy) : NULL;
+
+  for (i = 0; i < N_PACKET_CLASSES; i++) {
+    if (policy) {
+      priv->qos_dscp[i] = get_qos_field (policy, packet_class_names[i],
+          "dscp", 63);
+      priv->qos_priority[i] = get_qos_field (policy, packet_class_names[i],
+          "priority", MAX_QOS_PRIORITY);
+    } else {
+      priv->qos_dscp[i] = -1;
+      priv->qos_priority[i] = -1;
+    }
+  }
+  if (policy)
+    gst_structure_get_boolean (policy, "qos.pacing", &pacing);
+  priv->qos_pacing = pacing;
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_stream_transport_get_qos_policy:
+ * @trans: a #GstRTSPStreamTransport
+ *
+ * Get the QoS policy of @trans.
+ *
+ * Returns: (transfer full): a copy of the policy of @trans or %NULL when
+ * @trans has no policy. Free with gst_structure_free().
+ */
+GstStructure *
+gst_rtsp_stream_transport_get_qos_policy (GstRTSPStreamTransport * trans)
+{
+  GstRTSPStreamTransportPrivate *priv;
+  GstStructure *result = NULL;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans), NULL);
+
+  priv = trans->priv;
+
+  g_mutex_lock (&priv->lock);
+  if (priv->qos_policy)
+    result = gst_structure_copy (priv->qos_policy);
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_stream_transport_get_qos_marking:
+ * @trans: a #GstRTSPStreamTransport
+ * @klass: a #GstRTSPPacketClass
+ * @dscp: (out) (allow-none): the DSCP of the packets, -1 when not marked
+ * @priority: (out) (allow-none): the socket priority of the packets, -1
+ *     when not marked
+ *
+ * Get how the QoS policy of @trans marks the packets of @klass.
+ *
+ * Returns: %TRUE when the packets of @klass are marked.
+ */
+gboolean
+gst_rtsp_stream_transport_get_qos_marking (GstRTSPStreamTransport * trans,
+    GstRTSPPacketClass klass, gint * dscp, gint * priority)
+{
+  GstRTSPStreamTransportPrivate *priv;
+  gint d, p;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans), FALSE);
+  g_return_val_if_fail (klass < N_PACKET_CLASSES, FALSE);
+
+  priv = trans->priv;
+
+  g_mutex_lock (&priv->lock);
+  d = priv->qos_dscp[klass];
+  p = priv->qos_priority[klass];
+  g_mutex_unlock (&priv->lock);
+
+  if (dscp)
+    *dscp = d;
+  if (priority)
+    *priority = p;
+
+  return d != -1 || p != -1;
+}
+
+/**
+ * gst_rtsp_stream_transport_get_qos_pacing:
+ * @trans: a #GstRTSPStreamTransport
+ *
+ * Check if the QoS policy of @trans lets a paced stream pace the packets
+ * to @trans.
+ *
+ * Returns: %FALSE when the packets to @trans are never paced.
+ */
+gboolean
+gst_rtsp_stream_transport_get_qos_pacing (GstRTSPStreamTransport * trans)
+{
+  GstRTSPStreamTransportPrivate *priv;
+  gboolean res;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans), TRUE);
+
+  priv = trans->priv;
+
+  g_mutex_lock (&priv->lock);
+  res = priv->qos_pacing;
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
 /**
  * gst_rtsp_stream_transport_send_rtp:
  * @trans: a #GstRTSPStreamTransport
@@ -450,10 +896,13 @@ gst_rtsp_stream_transport_send_rtp (GstRTSPStreamTransport * trans,
 
   priv = trans->priv;
 
-  if (priv->send_rtp)
+  if (priv->send_rtp) {
+    buffer = gst_rtsp_stream_transport_rewrite_rtp (trans, buffer);
     res =
         priv->send_rtp (buffer, priv->transport->interleaved.min,
         priv->user_data);
+    gst_buffer_unref (buffer);
+  }
 
   return res;
 }
@@ -476,10 +925,13 @@ gst_rtsp_stream_transport_send_rtcp (GstRTSPStreamTransport * trans,
 
   priv = trans->priv;
 
-  if (priv->send_rtcp)
+  if (priv->send_rtcp) {
+    buffer = gst_rtsp_stream_transport_rewrite_rtcp (trans, buffer);
     res =
         priv->send_rtcp (buffer, priv->transport->interleaved.max,
         priv->user_data);
+    gst_buffer_unref (buffer);
+  }
 
   return res;
 }
@@ -63,6 +63,22 @@ typedef gboolean (*GstRTSPSendFunc)      (GstBuffer *buffer, guint8 channel, gpo
  */
 typedef void     (*GstRTSPKeepAliveFunc) (gpointer user_data);
 
+/**
+ * GstRTSPPacketClass:
+ * @GST_RTSP_PACKET_CLASS_KEY_FRAME: the RTP packets of a key frame
+ * @GST_RTSP_PACKET_CLASS_DELTA_FRAME: the RTP packets of the other frames
+ * @GST_RTSP_PACKET_CLASS_AUDIO: the RTP packets of an audio stream
+ * @GST_RTSP_PACKET_CLASS_RTCP: the RTCP packets
+ *
+ * The packets that a QoS policy can mark differently.
+ */
+typedef enum {
+  GST_RTSP_PACKET_CLASS_KEY_FRAME,
+  GST_RTSP_PACKET_CLASS_DELTA_FRAME,
+  GST_RTSP_PACKET_CLASS_AUDIO,
+  GST_RTSP_PACKET_CLASS_RTCP
+} GstRTSPPacketClass;
+
 /**
  * GstRTSPStreamTransport:
  * @parent: parent instance
@@ -123,6 +139,28 @@ gboolean                 gst_rtsp_stream_transport_is_timed_out  (GstRTSPStreamT
 
 
 
+void                     gst_rtsp_stream_transport_set_rtp_rewrite (GstRTSPStreamTransport *trans,
+                                                                  gboolean rewrite,
+                                                                  guint32 ssrc,
+                                                                  guint16 seq_offset,
+                                                                  guint32 rtptime_offset);
+gboolean                 gst_rtsp_stream_transport_get_rtp_rewrite (GstRTSPStreamTransport *trans,
+                                                                  guint32 *ssrc,
+                                                                  guint16 *seq_offset,
+                                                                  guint32 *rtptime_offset);
+GstBuffer *              gst_rtsp_stream_transport_rewrite_rtp   (GstRTSPStreamTransport *trans,
+                                                                  GstBuffer *buffer);
+GstBuffer *              gst_rtsp_stream_transport_rewrite_rtcp  (GstRTSPStreamTransport *trans,
+                                                                  GstBuffer *buffer);
+
+void                     gst_rtsp_stream_transport_set_qos_policy (GstRTSPStreamTransport *trans,
+                                                                  const GstStructure *policy);
+GstStructure *           gst_rtsp_stream_transport_get_qos_policy (GstRTSPStreamTransport *trans);
+gboolean                 gst_rtsp_stream_transport_get_qos_marking (GstRTSPStreamTransport *trans,
+                                                                  GstRTSPPacketClass klass,
+                                                                  gint *dscp, gint *priority);
+gboolean                 gst_rtsp_stream_transport_get_qos_pacing (GstRTSPStreamTransport *trans);
+
 gboolean                 gst_rtsp_stream_transport_send_rtp      (GstRTSPStreamTransport *trans,
                                                                   GstBuffer *buffer);
 gboolean                 gst_rtsp_stream_transport_send_rtcp     (GstRTSPStreamTransport *trans,
@@ -41,6 +41,18 @@
  * stream should be sent to. Use gst_rtsp_stream_remove_transport() to remove
  * the destination again.
  *
+ * With gst_rtsp_stream_set_retransmission_time() the stream keeps a history of
+ * the sent packets and retransmits them, as described in RFC 4588, when a
+ * client reports them as lost.
+ *
+ * With gst_rtsp_stream_set_fec_percentage() the stream sends ULPFEC packets,
+ * RFC 5109, that let receivers recover lost packets without asking for them,
+ * which is what multicast receivers need.
+ *
+ * With gst_rtsp_stream_add_layer() other encodings of the same media, for
+ * example at lower bitrates, can be added to the stream. Each unicast client
+ * then receives one of the layers.
+ *
  * Last reviewed on 2013-07-16 (1.0.0)
  */
 
@@ -50,10 +62,18 @@
 
 #include <gio/gio.h>
 
+#ifndef G_OS_WIN32
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
 #include <gst/app/gstappsrc.h>
 #include <gst/app/gstappsink.h>
+#include <gst/rtp/gstrtpbuffer.h>
 
 #include "rtsp-stream.h"
+#include "rtsp-server-internal.h"
 
 #define GST_RTSP_STREAM_GET_PRIVATE(obj)  \
      (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_RTSP_STREAM, GstRTSPStreamPrivate))
@@ -65,6 +85,7 @@ struct _GstRTSPStreamPrivate
   GstPad *srcpad;
   GstElement *payloader;
   guint buffer_size;
+  gboolean low_latency;
   gboolean is_joined;
   gchar *control;
 
@@ -107,6 +128,13 @@ struct _GstRTSPStreamPrivate
   GstRTSPAddress *server_addr_v6;
   gboolean have_ipv6;
 
+  /* pre-bound server sockets */
+  GstRTSPSocketPool *socket_pool;
+  /* the pool we share our sockets with in mux mode */
+  GstRTSPSocketPool *mux_pool;
+  gboolean have_mux_ssrc;
+  guint mux_ssrc;
+
   /* multicast addresses */
   GstRTSPAddressPool *pool;
   GstRTSPAddress *addr_v4;
@@ -125,12 +153,188 @@ struct _GstRTSPStreamPrivate
   /* stream blocking */
   gulong blocked_id;
   gboolean blocking;
+
+  /* dropping all data in standby */
+  gulong standby_id;
+
+  /* key unit requests */
+  gulong key_unit_id;
+  gint64 key_unit_start;
+  gboolean key_unit_forced;
+  GstClockTime key_unit_latency;
+
+  /* RTP packets since the last key unit, sent to new transports */
+  gboolean gop_cache;
+  gulong gop_key_id;
+  gulong gop_cache_id;
+  gboolean gop_key_pending;
+  gboolean gop_valid;
+  GQueue gop_packets;
+  gsize gop_bytes;
+  guint64 gop_head;             /* serial of the first cached packet */
+  guint64 gop_next;             /* serial of the next cached packet */
+
+  /* simulcast layers, layer 0 is the payloader of the stream */
+  GPtrArray *layers;
+  GHashTable *layer_clients;    /* GstRTSPStreamTransport -> LayerClient */
+  guint32 layer_ssrc;
+  gboolean have_layer_ssrc;
+
+  /* unicast transports with their own RTP headers or QoS marks */
+  GHashTable *direct_clients;   /* GstRTSPStreamTransport -> UdpClient */
+  GHashTable *rtcp_clients;     /* GstRTSPStreamTransport -> UdpClient */
+  gulong qos_key_id;
+  gulong qos_flag_id;
+  gint qos_key_unit;            /* atomic */
+
+  /* pacing of the unicast UDP transports */
+  gboolean pacing;
+  gulong pace_probe_id;
+  GThread *pace_thread;
+  GMutex pace_lock;
+  GCond pace_cond;
+  gboolean pace_stop;           /* protected by pace_lock */
+  GHashTable *paced_clients;    /* GstRTSPStreamTransport -> UdpClient */
+  GQueue pace_frame;            /* PacedPacket of the current frame */
+  GQueue pace_queue;            /* PacedPacket to send */
+  guint32 pace_rtptime;
+  gboolean have_pace_rtptime;
+  guint pace_clock_rate;
+  gint pace_pt;                 /* payload type of the media, -1 unknown */
+  gint64 pace_interval;         /* in microseconds */
+  gint64 pace_next;
+  guint64 paced_packets;
+  gint64 pace_delay_sum;
+  gint64 pace_delay_max;
+
+  /* congestion control, the bitrates are in the units of the encoder */
+  gboolean adaptive_bitrate;
+  GstElement *encoder;
+  const gchar *encoder_prop;
+  guint bitrate;
+  guint max_bitrate;
+  GstClockTime min_rtt;
+
+  /* retransmission */
+  GstClockTime rtx_time;
+  guint rtx_pt;
+  GstElement *rtxsend;
+
+  /* forward error correction */
+  guint fec_percentage;
+  guint fec_pt;
+  GstElement *fecenc;
+  gulong fec_probe_id;
+  /* the payload type the encoder was configured with, the counting probe
+   * doesn't take the stream lock */
+  guint fec_probe_pt;
+  GMutex fec_lock;
+  guint64 fec_packets;          /* protected by fec_lock */
+  guint64 media_packets;        /* protected by fec_lock */
 };
 
+/* an encoding of the stream */
+typedef struct
+{
+  GstRTSPStream *stream;
+  guint idx;
+  GstElement *payloader;
+  GstPad *srcpad;
+  GstElement *fakesink;
+  gulong key_id;
+  gulong send_id;
+  gboolean key_pending;
+} StreamLayer;
+
+/* a unicast transport that receives one of the layers */
+typedef struct
+{
+  GstRTSPStreamTransport *trans;
+  guint layer;
+  guint target;
+  guint good_reports;
+  guint16 seq_offset;
+  guint16 last_seq;
+  gboolean have_seq;
+  /* for UDP */
+  GSocket *socket;
+  GSocketAddress *addr;
+} LayerClient;
+
+/* a packet of a layer for a UDP client, sent without the lock */
+typedef struct
+{
+  GSocket *socket;
+  GSocketAddress *addr;
+  guint8 header[12];
+} LayerPacket;
+
+#define N_PACKET_CLASSES        (GST_RTSP_PACKET_CLASS_RTCP + 1)
+
+/* a unicast UDP transport that the stream sends to itself instead of the
+ * udpsink */
+typedef struct
+{
+  GSocket *socket;
+  GSocketAddress *addr;
+  /* the marks of each GstRTSPPacketClass, NULL when not marked */
+  GSocketControlMessage *dscp[N_PACKET_CLASSES];
+  GSocketControlMessage *priority[N_PACKET_CLASSES];
+} UdpClient;
+
+/* a packet in the pacer, the times are monotonic microseconds */
+typedef struct
+{
+  GstBuffer *buffer;
+  gint64 arrival;
+  gint64 send_time;
+} PacedPacket;
+
+/* max memories of a packet we send without merging them */
+#define MAX_SEND_VECTORS        16
+
 #define DEFAULT_CONTROL         NULL
 #define DEFAULT_PROFILES        GST_RTSP_PROFILE_AVP
 #define DEFAULT_PROTOCOLS       GST_RTSP_LOWER_TRANS_UDP | GST_RTSP_LOWER_TRANS_UDP_MCAST | \
                                         GST_RTSP_LOWER_TRANS_TCP
+#define DEFAULT_BUFFER_SIZE     0x80000
+#define DEFAULT_LOW_LATENCY     FALSE
+#define DEFAULT_PACING          FALSE
+
+/* frame interval of the pacer until it is known from the RTP timestamps */
+#define DEFAULT_PACE_INTERVAL   (40 * G_TIME_SPAN_MILLISECOND)
+#define MIN_PACE_INTERVAL       (1 * G_TIME_SPAN_MILLISECOND)
+#define MAX_PACE_INTERVAL       (100 * G_TIME_SPAN_MILLISECOND)
+
+/* we stop waiting for the key unit of a request when the encoder does not
+ * announce it within this time */
+#define KEY_UNIT_TIMEOUT        (2 * G_TIME_SPAN_SECOND)
+
+/* in low-latency mode we cap the kernel send buffer so that packets can not
+ * pile up in the socket (128KB is about 50ms of 20Mbit/s video), late RTP
+ * packets are dropped in the udpsink instead of being sent in a burst and the
+ * TCP branch keeps at most this much data queued */
+#define LOW_LATENCY_BUFFER_SIZE   0x20000
+#define LOW_LATENCY_MAX_LATENESS  (20 * GST_MSECOND)
+#define LOW_LATENCY_QUEUE_TIME    (40 * GST_MSECOND)
+/* when a GOP grows bigger than this we stop caching until the next key unit */
+#define GOP_CACHE_MAX_BYTES       (4 * 1024 * 1024)
+/* a client moves to the next layer when a receiver report shows more than 5%
+ * loss or more than 100ms jitter, it moves back after 4 clean reports */
+#define LAYER_DOWN_FRACTION_LOST  13
+#define LAYER_DOWN_JITTER         (100 * GST_MSECOND)
+#define LAYER_UP_REPORTS          4
+/* loss based rate control as in GCC: back off when more than 10% of the
+ * packets are lost, grow by 5% when less than 2% are lost and neither the
+ * round-trip time nor the TCP queue grow. We don't go below 1/10th of the
+ * configured bitrate of the encoder, or above it. */
+#define RATE_DECREASE_FRACTION_LOST  26
+#define RATE_INCREASE_FRACTION_LOST  5
+#define RATE_MAX_QUEUING_DELAY       (100 * GST_MSECOND)
+#define RATE_MAX_TCP_QUEUE           (200 * GST_MSECOND)
+#define RATE_MIN_DIVIDER             10
+/* how far upstream of the payloader we look for the encoder */
+#define RATE_MAX_ENCODER_DEPTH       8
 
 enum
 {
@@ -153,6 +357,27 @@ static void gst_rtsp_stream_set_property (GObject * object, guint propid,
 
 static void gst_rtsp_stream_finalize (GObject * obj);
 
+static void udp_client_free (UdpClient * client);
+static gboolean get_udp_destination (GstRTSPStream * stream,
+    const GstRTSPTransport * tr, guint idx, GSocket ** socket,
+    GSocketAddress ** addr);
+static gboolean probe_is_key_unit (GstPadProbeInfo * info);
+static void layers_join (GstRTSPStream * stream, GstBin * bin,
+    GstState state);
+static void layers_leave (GstRTSPStream * stream, GstBin * bin);
+static gboolean layer_client_add (GstRTSPStream * stream,
+    GstRTSPStreamTransport * trans);
+static void layers_check_report (GstRTSPStream * stream,
+    GstRTSPStreamTransport * trans, const GstStructure * stats);
+static void rate_control_join (GstRTSPStream * stream);
+static GstElement *rate_control_leave (GstRTSPStream * stream,
+    const gchar ** prop, guint * bitrate);
+static void rate_control_restore (GstElement * encoder, const gchar * prop,
+    guint bitrate);
+static void rate_control_check_report (GstRTSPStream * stream,
+    GstRTSPStreamTransport * trans, const GstStructure * stats);
+static void mux_update_ssrc (GstRTSPStream * stream);
+
 G_DEFINE_TYPE (GstRTSPStream, gst_rtsp_stream, G_TYPE_OBJECT);
 
 static void
@@ -198,9 +423,26 @@ gst_rtsp_stream_init (GstRTSPStream * stream)
   stream->priv = priv;
 
   priv->dscp_qos = -1;
+  priv->buffer_size = DEFAULT_BUFFER_SIZE;
+  priv->low_latency = DEFAULT_LOW_LATENCY;
+  priv->key_unit_latency = GST_CLOCK_TIME_NONE;
+  priv->min_rtt = GST_CLOCK_TIME_NONE;
   priv->control = g_strdup (DEFAULT_CONTROL);
   priv->profiles = DEFAULT_PROFILES;
   priv->protocols = DEFAULT_PROTOCOLS;
+  g_queue_init (&priv->gop_packets);
+  priv->direct_clients = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) udp_client_free);
+  priv->rtcp_clients = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) udp_client_free);
+  priv->pacing = DEFAULT_PACING;
+  priv->paced_clients = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) udp_client_free);
+  g_queue_init (&priv->pace_frame);
+  g_queue_init (&priv->pace_queue);
+  g_mutex_init (&priv->pace_lock);
+  g_cond_init (&priv->pace_cond);
+  g_mutex_init (&priv->fec_lock);
 
   g_mutex_init (&priv->lock);
 }
@@ -229,9 +471,23 @@ gst_rtsp_stream_finalize (GObject * obj)
     gst_rtsp_address_free (priv->server_addr_v6);
   if (priv->pool)
     g_object_unref (priv->pool);
+  if (priv->socket_pool)
+    g_object_unref (priv->socket_pool);
+  if (priv->mux_pool)
+    g_object_unref (priv->mux_pool);
   gst_object_unref (priv->payloader);
   gst_object_unref (priv->srcpad);
   g_free (priv->control);
+  g_queue_foreach (&priv->gop_packets, (GFunc) gst_buffer_unref, NULL);
+  g_queue_clear (&priv->gop_packets);
+  if (priv->layers)
+    g_ptr_array_unref (priv->layers);
+  g_hash_table_unref (priv->direct_clients);
+  g_hash_table_unref (priv->rtcp_clients);
+  g_hash_table_unref (priv->paced_clients);
+  g_mutex_clear (&priv->pace_lock);
+  g_cond_clear (&priv->pace_cond);
+  g_mutex_clear (&priv->fec_lock);
   g_mutex_clear (&priv->lock);
 
   G_OBJECT_CLASS (gst_rtsp_stream_parent_class)->finalize (obj);
@@ -343,7 +599,24 @@ gst_rtsp_stream_get_pt (GstRTSPStream * stream)
 
   priv = stream->priv;
 
-  g_object_get (G_OBJECT (priv->payloader), "pt", &pt, NULL);
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (priv->payloader),
+          "pt")) {
+    g_object_get (G_OBJECT (priv->payloader), "pt", &pt, NULL);
+  } else {
+    GstStructure *s;
+    GstCaps *caps;
+    gint payload = -1;
+
+    /* not a payloader, like the appsrc of a relayed stream, the caps of
+     * the RTP have the payload type */
+    caps = gst_pad_query_caps (priv->srcpad, NULL);
+    if (!gst_caps_is_empty (caps)) {
+      s = gst_caps_get_structure (caps, 0);
+      gst_structure_get_int (s, "payload", &payload);
+    }
+    gst_caps_unref (caps);
+    pt = payload;
+  }
 
   return pt;
 }
@@ -465,7 +738,9 @@ gst_rtsp_stream_set_mtu (GstRTSPStream * stream, guint mtu)
 
   GST_LOG_OBJECT (stream, "set MTU %u", mtu);
 
-  g_object_set (G_OBJECT (priv->payloader), "mtu", mtu, NULL);
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (priv->payloader),
+          "mtu"))
+    g_object_set (G_OBJECT (priv->payloader), "mtu", mtu, NULL);
 }
 
 /**
@@ -486,14 +761,24 @@ gst_rtsp_stream_get_mtu (GstRTSPStream * stream)
 
   priv = stream->priv;
 
-  g_object_get (G_OBJECT (priv->payloader), "mtu", &mtu, NULL);
+  mtu = 0;
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (priv->payloader),
+          "mtu"))
+    g_object_get (G_OBJECT (priv->payloader), "mtu", &mtu, NULL);
 
   return mtu;
 }
 
-/* Update the dscp qos property on the udp sinks */
-static void
-update_dscp_qos (GstRTSPStream * stream)
+/**
+ * gst_rtsp_stream_set_buffer_size:
+ * @stream: a #GstRTSPStream
+ * @size: the new value
+ *
+ * Set the kernel UDP buffer size used for the sockets of @stream. This
+ * only has effect before @stream is joined.
+ */
+void
+gst_rtsp_stream_set_buffer_size (GstRTSPStream * stream, guint size)
 {
   GstRTSPStreamPrivate *priv;
 
@@ -501,125 +786,108 @@ update_dscp_qos (GstRTSPStream * stream)
 
   priv = stream->priv;
 
-  if (priv->udpsink[0]) {
-    g_object_set (G_OBJECT (priv->udpsink[0]), "qos-dscp", priv->dscp_qos,
-        NULL);
-  }
+  GST_LOG_OBJECT (stream, "set buffer size %u", size);
 
-  if (priv->udpsink[1]) {
-    g_object_set (G_OBJECT (priv->udpsink[1]), "qos-dscp", priv->dscp_qos,
-        NULL);
-  }
+  g_mutex_lock (&priv->lock);
+  priv->buffer_size = size;
+  g_mutex_unlock (&priv->lock);
 }
 
 /**
- * gst_rtsp_stream_set_dscp_qos:
+ * gst_rtsp_stream_get_buffer_size:
  * @stream: a #GstRTSPStream
- * @dscp_qos: a new dscp qos value (0-63, or -1 to disable)
  *
- * Configure the dscp qos of the outgoing sockets to @dscp_qos.
+ * Get the kernel UDP buffer size of @stream.
+ *
+ * Returns: the kernel UDP buffer size.
  */
-void
-gst_rtsp_stream_set_dscp_qos (GstRTSPStream * stream, gint dscp_qos)
+guint
+gst_rtsp_stream_get_buffer_size (GstRTSPStream * stream)
 {
   GstRTSPStreamPrivate *priv;
+  guint res;
 
-  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), 0);
 
   priv = stream->priv;
 
-  GST_LOG_OBJECT (stream, "set DSCP QoS %d", dscp_qos);
-
-  if (dscp_qos < -1 || dscp_qos > 63) {
-    GST_WARNING_OBJECT (stream, "trying to set illegal dscp qos %d", dscp_qos);
-    return;
-  }
-
-  priv->dscp_qos = dscp_qos;
+  g_mutex_lock (&priv->lock);
+  res = priv->buffer_size;
+  g_mutex_unlock (&priv->lock);
 
-  update_dscp_qos (stream);
+  return res;
 }
 
 /**
- * gst_rtsp_stream_get_dscp_qos:
+ * gst_rtsp_stream_set_low_latency:
  * @stream: a #GstRTSPStream
+ * @low_latency: the new value
  *
- * Get the configured DSCP QoS in of the outgoing sockets.
- *
- * Returns: the DSCP QoS value of the outgoing sockets, or -1 if disbled.
+ * Configure @stream for low-latency streaming. When enabled, the socket
+ * buffers are capped, the udpsinks drop packets that are too late instead of
+ * bursting them out and the TCP branch uses a short leaky queue. This only
+ * has effect before @stream is joined.
  */
-gint
-gst_rtsp_stream_get_dscp_qos (GstRTSPStream * stream)
+void
+gst_rtsp_stream_set_low_latency (GstRTSPStream * stream, gboolean low_latency)
 {
   GstRTSPStreamPrivate *priv;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), -1);
+  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
 
   priv = stream->priv;
 
-  return priv->dscp_qos;
+  GST_LOG_OBJECT (stream, "set low latency %d", low_latency);
+
+  g_mutex_lock (&priv->lock);
+  priv->low_latency = low_latency;
+  g_mutex_unlock (&priv->lock);
 }
 
 /**
- * gst_rtsp_stream_is_transport_supported:
+ * gst_rtsp_stream_is_low_latency:
  * @stream: a #GstRTSPStream
- * @transport: a #GstRTSPTransport
  *
- * Check if @transport can be handled by stream
+ * Check if @stream is configured for low-latency streaming.
  *
- * Returns: %TRUE if @transport can be handled by @stream.
+ * Returns: %TRUE if @stream is configured for low-latency streaming.
  */
 gboolean
-gst_rtsp_stream_is_transport_supported (GstRTSPStream * stream,
-    GstRTSPTransport * transport)
+gst_rtsp_stream_is_low_latency (GstRTSPStream * stream)
 {
   GstRTSPStreamPrivate *priv;
+  gboolean res;
 
   g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
 
   priv = stream->priv;
 
   g_mutex_lock (&priv->lock);
-  if (transport->trans != GST_RTSP_TRANS_RTP)
-    goto unsupported_transmode;
-
-  if (!(transport->profile & priv->profiles))
-    goto unsupported_profile;
-
-  if (!(transport->lower_transport & priv->protocols))
-    goto unsupported_ltrans;
-
+  res = priv->low_latency;
   g_mutex_unlock (&priv->lock);
 
-  return TRUE;
-
-  /* ERRORS */
-unsupported_transmode:
-  {
-    GST_DEBUG ("unsupported transport mode %d", transport->trans);
-    return FALSE;
-  }
-unsupported_profile:
-  {
-    GST_DEBUG ("unsupported profile %d", transport->profile);
-    return FALSE;
-  }
-unsupported_ltrans:
-  {
-    GST_DEBUG ("unsupported lower transport %d", transport->lower_transport);
-    return FALSE;
-  }
+  return res;
 }
 
 /**
- * gst_rtsp_stream_set_profiles:
+ * gst_rtsp_stream_set_gop_cache:
  * @stream: a #GstRTSPStream
- * @profiles: the new profiles
+ * @gop_cache: the new value
  *
- * Configure the allowed profiles for @stream.
+ * Keep the RTP packets of @stream since the last key unit and send them to
+ * new transports when they are added, so that clients joining a shared live
+ * stream can start decoding immediately instead of waiting for the next key
+ * unit. This only has effect before @stream is joined.
+ *
+ * Only unicast transports get the cached packets. They keep their sequence
+ * numbers and timestamps, they are contiguous with the live packets and
+ * gst_rtsp_stream_transport_get_rtpinfo() reports the first of them for those
+ * transports. The packets for a transport with
+ * gst_rtsp_stream_transport_set_rtp_rewrite() are rewritten like its live
+ * packets.
  */
 void
-gst_rtsp_stream_set_profiles (GstRTSPStream * stream, GstRTSPProfile profiles)
+gst_rtsp_stream_set_gop_cache (GstRTSPStream * stream, gboolean gop_cache)
 {
   GstRTSPStreamPrivate *priv;
 
@@ -627,1784 +895,5014 @@ gst_rtsp_stream_set_profiles (GstRTSPStream * stream, GstRTSPProfile profiles)
 
   priv = stream->priv;
 
+  GST_LOG_OBJECT (stream, "set gop cache %d", gop_cache);
+
   g_mutex_lock (&priv->lock);
-  priv->profiles = profiles;
+  priv->gop_cache = gop_cache;
   g_mutex_unlock (&priv->lock);
 }
 
 /**
- * gst_rtsp_stream_get_profiles:
+ * gst_rtsp_stream_has_gop_cache:
  * @stream: a #GstRTSPStream
  *
- * Get the allowed profiles of @stream.
+ * Check if @stream keeps the packets since the last key unit for new
+ * transports.
  *
- * Returns: a #GstRTSPProfile
+ * Returns: %TRUE if @stream has a GOP cache.
  */
-GstRTSPProfile
-gst_rtsp_stream_get_profiles (GstRTSPStream * stream)
+gboolean
+gst_rtsp_stream_has_gop_cache (GstRTSPStream * stream)
 {
   GstRTSPStreamPrivate *priv;
-  GstRTSPProfile res;
+  gboolean res;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), GST_RTSP_PROFILE_UNKNOWN);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
 
   priv = stream->priv;
 
   g_mutex_lock (&priv->lock);
-  res = priv->profiles;
+  res = priv->gop_cache;
   g_mutex_unlock (&priv->lock);
 
   return res;
 }
 
 /**
- * gst_rtsp_stream_set_protocols:
+ * gst_rtsp_stream_set_adaptive_bitrate:
  * @stream: a #GstRTSPStream
- * @protocols: the new flags
+ * @adaptive_bitrate: the new value
  *
- * Configure the allowed lower transport for @stream.
+ * Let the RTCP receiver reports of the clients of @stream control the bitrate
+ * of the encoder. The encoder is the first element upstream of the payloader
+ * with a "bitrate" or "target-bitrate" property, its configured bitrate is
+ * used as the upper limit.
+ *
+ * The bitrate is lowered on packet loss, when the round-trip time grows or
+ * when data piles up for the TCP clients, and raised again slowly when the
+ * reports are clean. Disabling restores the configured bitrate.
  */
 void
-gst_rtsp_stream_set_protocols (GstRTSPStream * stream,
-    GstRTSPLowerTrans protocols)
+gst_rtsp_stream_set_adaptive_bitrate (GstRTSPStream * stream,
+    gboolean adaptive_bitrate)
 {
   GstRTSPStreamPrivate *priv;
+  GstElement *encoder = NULL;
+  const gchar *prop = NULL;
+  guint bitrate = 0;
 
   g_return_if_fail (GST_IS_RTSP_STREAM (stream));
 
   priv = stream->priv;
 
+  GST_LOG_OBJECT (stream, "set adaptive bitrate %d", adaptive_bitrate);
+
   g_mutex_lock (&priv->lock);
-  priv->protocols = protocols;
+  if (priv->adaptive_bitrate != adaptive_bitrate) {
+    priv->adaptive_bitrate = adaptive_bitrate;
+    if (priv->is_joined) {
+      if (adaptive_bitrate)
+        rate_control_join (stream);
+      else
+        encoder = rate_control_leave (stream, &prop, &bitrate);
+    }
+  }
   g_mutex_unlock (&priv->lock);
+
+  if (encoder)
+    rate_control_restore (encoder, prop, bitrate);
 }
 
 /**
- * gst_rtsp_stream_get_protocols:
+ * gst_rtsp_stream_is_adaptive_bitrate:
  * @stream: a #GstRTSPStream
  *
- * Get the allowed protocols of @stream.
+ * Check if the receiver reports control the encoder bitrate of @stream.
  *
- * Returns: a #GstRTSPLowerTrans
+ * Returns: %TRUE if @stream adapts the encoder bitrate.
  */
-GstRTSPLowerTrans
-gst_rtsp_stream_get_protocols (GstRTSPStream * stream)
+gboolean
+gst_rtsp_stream_is_adaptive_bitrate (GstRTSPStream * stream)
 {
   GstRTSPStreamPrivate *priv;
-  GstRTSPLowerTrans res;
+  gboolean res;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream),
-      GST_RTSP_LOWER_TRANS_UNKNOWN);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
 
   priv = stream->priv;
 
   g_mutex_lock (&priv->lock);
-  res = priv->protocols;
+  res = priv->adaptive_bitrate;
   g_mutex_unlock (&priv->lock);
 
   return res;
 }
 
+/* Update the dscp qos property on the udp sinks */
+static void
+update_dscp_qos (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
+
+  priv = stream->priv;
+
+  if (priv->udpsink[0]) {
+    g_object_set (G_OBJECT (priv->udpsink[0]), "qos-dscp", priv->dscp_qos,
+        NULL);
+  }
+
+  if (priv->udpsink[1]) {
+    g_object_set (G_OBJECT (priv->udpsink[1]), "qos-dscp", priv->dscp_qos,
+        NULL);
+  }
+}
+
 /**
- * gst_rtsp_stream_set_address_pool:
+ * gst_rtsp_stream_set_retransmission_time:
  * @stream: a #GstRTSPStream
- * @pool: a #GstRTSPAddressPool
+ * @time: a #GstClockTime
  *
- * configure @pool to be used as the address pool of @stream.
+ * Keep the sent RTP packets of @stream for @time and retransmit them when a
+ * client reports them as lost with a NACK, see RFC 4588. The retransmitted
+ * packets use the payload type set with
+ * gst_rtsp_stream_set_retransmission_pt(). 0 disables retransmission.
+ *
+ * The SDP then offers @stream with the NACK feedback of RFC 4585 and
+ * transports with the RTP/AVPF profile are accepted next to the configured
+ * profiles.
+ *
+ * This only has effect before @stream is joined.
  */
 void
-gst_rtsp_stream_set_address_pool (GstRTSPStream * stream,
-    GstRTSPAddressPool * pool)
+gst_rtsp_stream_set_retransmission_time (GstRTSPStream * stream,
+    GstClockTime time)
 {
   GstRTSPStreamPrivate *priv;
-  GstRTSPAddressPool *old;
 
   g_return_if_fail (GST_IS_RTSP_STREAM (stream));
 
   priv = stream->priv;
 
-  GST_LOG_OBJECT (stream, "set address pool %p", pool);
+  GST_LOG_OBJECT (stream, "set retransmission time %" GST_TIME_FORMAT,
+      GST_TIME_ARGS (time));
 
   g_mutex_lock (&priv->lock);
-  if ((old = priv->pool) != pool)
-    priv->pool = pool ? g_object_ref (pool) : NULL;
-  else
-    old = NULL;
+  priv->rtx_time = time;
   g_mutex_unlock (&priv->lock);
-
-  if (old)
-    g_object_unref (old);
 }
 
 /**
- * gst_rtsp_stream_get_address_pool:
+ * gst_rtsp_stream_get_retransmission_time:
  * @stream: a #GstRTSPStream
  *
- * Get the #GstRTSPAddressPool used as the address pool of @stream.
+ * Get how long the packets of @stream are kept for retransmission.
  *
- * Returns: (transfer full): the #GstRTSPAddressPool of @stream. g_object_unref() after
- * usage.
+ * Returns: the retransmission time, 0 when retransmission is disabled.
  */
-GstRTSPAddressPool *
-gst_rtsp_stream_get_address_pool (GstRTSPStream * stream)
+GstClockTime
+gst_rtsp_stream_get_retransmission_time (GstRTSPStream * stream)
 {
   GstRTSPStreamPrivate *priv;
-  GstRTSPAddressPool *result;
+  GstClockTime res;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), 0);
 
   priv = stream->priv;
 
   g_mutex_lock (&priv->lock);
-  if ((result = priv->pool))
-    g_object_ref (result);
+  res = priv->rtx_time;
   g_mutex_unlock (&priv->lock);
 
-  return result;
+  return res;
 }
 
 /**
- * gst_rtsp_stream_get_multicast_address:
+ * gst_rtsp_stream_set_retransmission_pt:
  * @stream: a #GstRTSPStream
- * @family: the #GSocketFamily
+ * @rtx_pt: a payload type
  *
- * Get the multicast address of @stream for @family.
+ * Set the payload type of the retransmitted packets of @stream. It must not be
+ * used by any other stream of the media.
  *
- * Returns: the #GstRTSPAddress of @stream or %NULL when no address could be
- * allocated. gst_rtsp_address_free() after usage.
+ * This only has effect before @stream is joined.
  */
-GstRTSPAddress *
-gst_rtsp_stream_get_multicast_address (GstRTSPStream * stream,
-    GSocketFamily family)
+void
+gst_rtsp_stream_set_retransmission_pt (GstRTSPStream * stream, guint rtx_pt)
 {
   GstRTSPStreamPrivate *priv;
-  GstRTSPAddress *result;
-  GstRTSPAddress **addrp;
-  GstRTSPAddressFlags flags;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
+  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
+  g_return_if_fail (rtx_pt <= 127);
 
   priv = stream->priv;
 
-  if (family == G_SOCKET_FAMILY_IPV6) {
-    flags = GST_RTSP_ADDRESS_FLAG_IPV6;
-    addrp = &priv->addr_v4;
-  } else {
-    flags = GST_RTSP_ADDRESS_FLAG_IPV4;
-    addrp = &priv->addr_v6;
-  }
+  GST_LOG_OBJECT (stream, "set retransmission pt %u", rtx_pt);
 
   g_mutex_lock (&priv->lock);
-  if (*addrp == NULL) {
-    if (priv->pool == NULL)
-      goto no_pool;
-
-    flags |= GST_RTSP_ADDRESS_FLAG_EVEN_PORT | GST_RTSP_ADDRESS_FLAG_MULTICAST;
-
-    *addrp = gst_rtsp_address_pool_acquire_address (priv->pool, flags, 2);
-    if (*addrp == NULL)
-      goto no_address;
-  }
-  result = gst_rtsp_address_copy (*addrp);
+  priv->rtx_pt = rtx_pt;
   g_mutex_unlock (&priv->lock);
-
-  return result;
-
-  /* ERRORS */
-no_pool:
-  {
-    GST_ERROR_OBJECT (stream, "no address pool specified");
-    g_mutex_unlock (&priv->lock);
-    return NULL;
-  }
-no_address:
-  {
-    GST_ERROR_OBJECT (stream, "failed to acquire address from pool");
-    g_mutex_unlock (&priv->lock);
-    return NULL;
-  }
 }
 
 /**
- * gst_rtsp_stream_reserve_address:
+ * gst_rtsp_stream_get_retransmission_pt:
  * @stream: a #GstRTSPStream
- * @address: an address
- * @port: a port
- * @n_ports: n_ports
- * @ttl: a TTL
  *
- * Reserve @address and @port as the address and port of @stream.
+ * Get the payload type of the retransmitted packets of @stream.
  *
- * Returns: the #GstRTSPAddress of @stream or %NULL when the address could be
- * reserved. gst_rtsp_address_free() after usage.
+ * Returns: the retransmission payload type, 0 when none is set.
  */
-GstRTSPAddress *
-gst_rtsp_stream_reserve_address (GstRTSPStream * stream,
-    const gchar * address, guint port, guint n_ports, guint ttl)
+guint
+gst_rtsp_stream_get_retransmission_pt (GstRTSPStream * stream)
 {
   GstRTSPStreamPrivate *priv;
-  GstRTSPAddress *result;
-  GInetAddress *addr;
-  GSocketFamily family;
-  GstRTSPAddress **addrp;
+  guint res;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
-  g_return_val_if_fail (address != NULL, NULL);
-  g_return_val_if_fail (port > 0, NULL);
-  g_return_val_if_fail (n_ports > 0, NULL);
-  g_return_val_if_fail (ttl > 0, NULL);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), 0);
 
   priv = stream->priv;
 
-  addr = g_inet_address_new_from_string (address);
-  if (!addr) {
-    GST_ERROR ("failed to get inet addr from %s", address);
-    family = G_SOCKET_FAMILY_IPV4;
-  } else {
-    family = g_inet_address_get_family (addr);
-    g_object_unref (addr);
-  }
+  g_mutex_lock (&priv->lock);
+  res = priv->rtx_pt;
+  g_mutex_unlock (&priv->lock);
 
-  if (family == G_SOCKET_FAMILY_IPV6)
-    addrp = &priv->addr_v4;
-  else
-    addrp = &priv->addr_v6;
+  return res;
+}
 
-  g_mutex_lock (&priv->lock);
-  if (*addrp == NULL) {
-    GstRTSPAddressPoolResult res;
+/**
+ * gst_rtsp_stream_get_retransmission_stats:
+ * @stream: a #GstRTSPStream
+ *
+ * Get the retransmission statistics of @stream. The "rtx-requests" field
+ * contains the number of packets that the clients asked for with NACKs and
+ * "rtx-packets" the number of packets that were retransmitted. Requests for
+ * packets that are no longer in the history are not answered.
+ *
+ * Returns: (transfer full) (nullable): a #GstStructure with the statistics or
+ * %NULL when @stream does not retransmit. gst_structure_free() after usage.
+ */
+GstStructure *
+gst_rtsp_stream_get_retransmission_stats (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv;
+  GstElement *rtxsend = NULL;
+  GstStructure *stats;
+  guint requests = 0, packets = 0;
 
-    if (priv->pool == NULL)
-      goto no_pool;
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
 
-    res = gst_rtsp_address_pool_reserve_address (priv->pool, address,
-        port, n_ports, ttl, addrp);
-    if (res != GST_RTSP_ADDRESS_POOL_OK)
-      goto no_address;
-  } else {
-    if (strcmp ((*addrp)->address, address) ||
-        (*addrp)->port != port || (*addrp)->n_ports != n_ports ||
-        (*addrp)->ttl != ttl)
-      goto different_address;
-  }
-  result = gst_rtsp_address_copy (*addrp);
-  g_mutex_unlock (&priv->lock);
+  priv = stream->priv;
 
-  return result;
+  g_mutex_lock (&priv->lock);
+  if (priv->rtxsend)
+    rtxsend = gst_object_ref (priv->rtxsend);
+  g_mutex_unlock (&priv->lock);
 
-  /* ERRORS */
-no_pool:
-  {
-    GST_ERROR_OBJECT (stream, "no address pool specified");
-    g_mutex_unlock (&priv->lock);
-    return NULL;
-  }
-no_address:
-  {
-    GST_ERROR_OBJECT (stream, "failed to acquire address %s from pool",
-        address);
-    g_mutex_unlock (&priv->lock);
-    return NULL;
-  }
-different_address:
-  {
-    GST_ERROR_OBJECT (stream, "address %s is not the same that was already"
-        " reserved", address);
-    g_mutex_unlock (&priv->lock);
+  if (rtxsend == NULL)
     return NULL;
-  }
+
+  g_object_get (rtxsend, "num-rtx-requests", &requests,
+      "num-rtx-packets", &packets, NULL);
+  gst_object_unref (rtxsend);
+
+  stats = gst_structure_new ("application/x-rtsp-stream-rtx-stats",
+      "rtx-requests", G_TYPE_UINT, requests,
+      "rtx-packets", G_TYPE_UINT, packets, NULL);
+
+  return stats;
 }
 
-static gboolean
-alloc_ports_one_family (GstRTSPAddressPool * pool, gint buffer_size,
-    GSocketFamily family, GstElement * udpsrc_out[2],
-    GstElement * udpsink_out[2], GstRTSPRange * server_port_out,
-    GstRTSPAddress ** server_addr_out)
+/**
+ * gst_rtsp_stream_set_fec_percentage:
+ * @stream: a #GstRTSPStream
+ * @percentage: the FEC overhead in percent
+ *
+ * Send ULPFEC packets, see RFC 5109, for @stream so that receivers can
+ * recover lost packets without a return channel. @percentage is the number
+ * of FEC packets per 100 media packets. The FEC packets use the payload type
+ * set with gst_rtsp_stream_set_fec_pt(). 0 disables FEC.
+ *
+ * This only has effect before @stream is joined.
+ */
+void
+gst_rtsp_stream_set_fec_percentage (GstRTSPStream * stream, guint percentage)
 {
-  GstStateChangeReturn ret;
-  GstElement *udpsrc0, *udpsrc1;
-  GstElement *udpsink0, *udpsink1;
-  GSocket *rtp_socket = NULL;
-  GSocket *rtcp_socket;
-  gint tmp_rtp, tmp_rtcp;
-  guint count;
-  gint rtpport, rtcpport;
-  GList *rejected_addresses = NULL;
-  GstRTSPAddress *addr = NULL;
-  GInetAddress *inetaddr = NULL;
-  GSocketAddress *rtp_sockaddr = NULL;
-  GSocketAddress *rtcp_sockaddr = NULL;
-  const gchar *multisink_socket;
-
-  if (family == G_SOCKET_FAMILY_IPV6)
-    multisink_socket = "socket-v6";
-  else
-    multisink_socket = "socket";
+  GstRTSPStreamPrivate *priv;
 
-  udpsrc0 = NULL;
-  udpsrc1 = NULL;
-  udpsink0 = NULL;
-  udpsink1 = NULL;
-  count = 0;
+  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
+  g_return_if_fail (percentage <= 100);
 
-  /* Start with random port */
-  tmp_rtp = 0;
+  priv = stream->priv;
 
-  rtcp_socket = g_socket_new (family, G_SOCKET_TYPE_DATAGRAM,
-      G_SOCKET_PROTOCOL_UDP, NULL);
-  if (!rtcp_socket)
-    goto no_udp_protocol;
+  GST_LOG_OBJECT (stream, "set FEC percentage %u", percentage);
 
-  if (*server_addr_out)
-    gst_rtsp_address_free (*server_addr_out);
+  g_mutex_lock (&priv->lock);
+  priv->fec_percentage = percentage;
+  g_mutex_unlock (&priv->lock);
+}
 
-  /* try to allocate 2 UDP ports, the RTP port should be an even
-   * number and the RTCP port should be the next (uneven) port */
-again:
+/**
+ * gst_rtsp_stream_get_fec_percentage:
+ * @stream: a #GstRTSPStream
+ *
+ * Get the FEC overhead of @stream.
+ *
+ * Returns: the FEC overhead in percent, 0 when FEC is disabled.
+ */
+guint
+gst_rtsp_stream_get_fec_percentage (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv;
+  guint res;
 
-  if (rtp_socket == NULL) {
-    rtp_socket = g_socket_new (family, G_SOCKET_TYPE_DATAGRAM,
-        G_SOCKET_PROTOCOL_UDP, NULL);
-    if (!rtp_socket)
-      goto no_udp_protocol;
-  }
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), 0);
 
-  if (pool && gst_rtsp_address_pool_has_unicast_addresses (pool)) {
-    GstRTSPAddressFlags flags;
+  priv = stream->priv;
 
-    if (addr)
-      rejected_addresses = g_list_prepend (rejected_addresses, addr);
+  g_mutex_lock (&priv->lock);
+  res = priv->fec_percentage;
+  g_mutex_unlock (&priv->lock);
 
-    flags = GST_RTSP_ADDRESS_FLAG_EVEN_PORT | GST_RTSP_ADDRESS_FLAG_UNICAST;
-    if (family == G_SOCKET_FAMILY_IPV6)
-      flags |= GST_RTSP_ADDRESS_FLAG_IPV6;
-    else
-      flags |= GST_RTSP_ADDRESS_FLAG_IPV4;
+  return res;
+}
 
-    addr = gst_rtsp_address_pool_acquire_address (pool, flags, 2);
+/**
+ * gst_rtsp_stream_set_fec_pt:
+ * @stream: a #GstRTSPStream
+ * @fec_pt: a payload type
+ *
+ * Set the payload type of the FEC packets of @stream. It must not be used by
+ * any other stream of the media.
+ *
+ * This only has effect before @stream is joined.
+ */
+void
+gst_rtsp_stream_set_fec_pt (GstRTSPStream * stream, guint fec_pt)
+{
+  GstRTSPStreamPrivate *priv;
 
-    if (addr == NULL)
-      goto no_ports;
+  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
+  g_return_if_fail (fec_pt <= 127);
 
-    tmp_rtp = addr->port;
+  priv = stream->priv;
 
-    g_clear_object (&inetaddr);
-    inetaddr = g_inet_address_new_from_string (addr->address);
-  } else {
-    if (tmp_rtp != 0) {
-      tmp_rtp += 2;
-      if (++count > 20)
-        goto no_ports;
-    }
+  GST_LOG_OBJECT (stream, "set FEC pt %u", fec_pt);
 
-    if (inetaddr == NULL)
-      inetaddr = g_inet_address_new_any (family);
-  }
+  g_mutex_lock (&priv->lock);
+  priv->fec_pt = fec_pt;
+  g_mutex_unlock (&priv->lock);
+}
 
-  /* FIXME-WFD : Force to set 19000 as port number */
-  tmp_rtp = 19000;
+/**
+ * gst_rtsp_stream_get_fec_pt:
+ * @stream: a #GstRTSPStream
+ *
+ * Get the payload type of the FEC packets of @stream.
+ *
+ * Returns: the FEC payload type, 0 when none is set.
+ */
+guint
+gst_rtsp_stream_get_fec_pt (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv;
+  guint res;
 
-  rtp_sockaddr = g_inet_socket_address_new (inetaddr, tmp_rtp);
-  if (!g_socket_bind (rtp_socket, rtp_sockaddr, FALSE, NULL)) {
-    g_object_unref (rtp_sockaddr);
-    goto again;
-  }
-  g_object_unref (rtp_sockaddr);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), 0);
 
-  rtp_sockaddr = g_socket_get_local_address (rtp_socket, NULL);
-  if (rtp_sockaddr == NULL || !G_IS_INET_SOCKET_ADDRESS (rtp_sockaddr)) {
-    g_clear_object (&rtp_sockaddr);
-    goto socket_error;
-  }
+  priv = stream->priv;
 
-  tmp_rtp =
-      g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (rtp_sockaddr));
-  g_object_unref (rtp_sockaddr);
+  g_mutex_lock (&priv->lock);
+  res = priv->fec_pt;
+  g_mutex_unlock (&priv->lock);
 
-  /* check if port is even */
-  if ((tmp_rtp & 1) != 0) {
-    /* port not even, close and allocate another */
-    tmp_rtp++;
-    g_clear_object (&rtp_socket);
-    goto again;
-  }
+  return res;
+}
 
-  /* set port */
-  tmp_rtcp = tmp_rtp + 1;
+/**
+ * gst_rtsp_stream_get_fec_stats:
+ * @stream: a #GstRTSPStream
+ *
+ * Get the FEC statistics of @stream. The "media-packets" and "fec-packets"
+ * fields contain the number of sent media and FEC packets, "overhead" the
+ * measured FEC overhead in percent.
+ *
+ * Returns: (transfer full) (nullable): a #GstStructure with the statistics or
+ * %NULL when @stream does not send FEC. gst_structure_free() after usage.
+ */
+GstStructure *
+gst_rtsp_stream_get_fec_stats (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv;
+  GstStructure *stats = NULL;
+  guint64 media_packets, fec_packets;
 
-  rtcp_sockaddr = g_inet_socket_address_new (inetaddr, tmp_rtcp);
-  if (!g_socket_bind (rtcp_socket, rtcp_sockaddr, FALSE, NULL)) {
-    g_object_unref (rtcp_sockaddr);
-    g_clear_object (&rtp_socket);
-    goto again;
-  }
-  g_object_unref (rtcp_sockaddr);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
 
-  g_clear_object (&inetaddr);
+  priv = stream->priv;
 
-  udpsrc0 = gst_element_factory_make ("udpsrc", NULL);
-  udpsrc1 = gst_element_factory_make ("udpsrc", NULL);
+  g_mutex_lock (&priv->lock);
+  if (priv->fecenc) {
+    g_mutex_lock (&priv->fec_lock);
+    media_packets = priv->media_packets;
+    fec_packets = priv->fec_packets;
+    g_mutex_unlock (&priv->fec_lock);
+    stats = gst_structure_new ("application/x-rtsp-stream-fec-stats",
+        "media-packets", G_TYPE_UINT64, media_packets,
+        "fec-packets", G_TYPE_UINT64, fec_packets,
+        "overhead", G_TYPE_DOUBLE, media_packets ?
+        100.0 * fec_packets / media_packets : 0.0, NULL);
+  }
+  g_mutex_unlock (&priv->lock);
 
-  if (udpsrc0 == NULL || udpsrc1 == NULL)
-    goto no_udp_protocol;
+  return stats;
+}
 
-  g_object_set (G_OBJECT (udpsrc0), "socket", rtp_socket, NULL);
-  g_object_set (G_OBJECT (udpsrc1), "socket", rtcp_socket, NULL);
-
-  ret = gst_element_set_state (udpsrc0, GST_STATE_PAUSED);
-  if (ret == GST_STATE_CHANGE_FAILURE)
-    goto element_error;
-  ret = gst_element_set_state (udpsrc1, GST_STATE_PAUSED);
-  if (ret == GST_STATE_CHANGE_FAILURE)
-    goto element_error;
-
-  /* all fine, do port check */
-  g_object_get (G_OBJECT (udpsrc0), "port", &rtpport, NULL);
-  g_object_get (G_OBJECT (udpsrc1), "port", &rtcpport, NULL);
-
-  /* this should not happen... */
-  if (rtpport != tmp_rtp || rtcpport != tmp_rtcp)
-    goto port_error;
-
-  if (udpsink_out[0])
-    udpsink0 = udpsink_out[0];
-  else
-    udpsink0 = gst_element_factory_make ("multiudpsink", NULL);
-
-  if (!udpsink0)
-    goto no_udp_protocol;
-
-  g_object_set (G_OBJECT (udpsink0), "close-socket", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink0), multisink_socket, rtp_socket, NULL);
+/**
+ * gst_rtsp_stream_set_pacing:
+ * @stream: a #GstRTSPStream
+ * @pacing: the new value
+ *
+ * Pace the RTP packets of @stream to its unicast UDP transports. The
+ * packets of a video frame are spread evenly over the frame interval, which
+ * is measured from the RTP timestamps, instead of leaving in one burst.
+ * This avoids the loss of keyframe packets in switch and Wi-Fi queues at the
+ * cost of up to one frame interval of latency.
+ *
+ * This only has effect before @stream is joined.
+ */
+void
+gst_rtsp_stream_set_pacing (GstRTSPStream * stream, gboolean pacing)
+{
+  GstRTSPStreamPrivate *priv;
 
-  if (udpsink_out[1])
-    udpsink1 = udpsink_out[1];
-  else
-    udpsink1 = gst_element_factory_make ("multiudpsink", NULL);
+  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
 
-  if (!udpsink1)
-    goto no_udp_protocol;
+  priv = stream->priv;
 
-  g_object_set (G_OBJECT (udpsink0), "send-duplicates", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink1), "send-duplicates", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink0), "buffer-size", buffer_size, NULL);
+  GST_LOG_OBJECT (stream, "set pacing %d", pacing);
 
-  g_object_set (G_OBJECT (udpsink1), "close-socket", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink1), multisink_socket, rtcp_socket, NULL);
-  g_object_set (G_OBJECT (udpsink1), "sync", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink1), "async", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink0), "auto-multicast", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink0), "loop", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink1), "auto-multicast", FALSE, NULL);
-  g_object_set (G_OBJECT (udpsink1), "loop", FALSE, NULL);
+  g_mutex_lock (&priv->lock);
+  priv->pacing = pacing;
+  g_mutex_unlock (&priv->lock);
+}
 
-  /* we keep these elements, we will further configure them when the
-   * client told us to really use the UDP ports. */
-  udpsrc_out[0] = udpsrc0;
-  udpsrc_out[1] = udpsrc1;
-  udpsink_out[0] = udpsink0;
-  udpsink_out[1] = udpsink1;
-  server_port_out->min = rtpport;
-  server_port_out->max = rtcpport;
+/**
+ * gst_rtsp_stream_is_pacing:
+ * @stream: a #GstRTSPStream
+ *
+ * Check if the packets of @stream are paced.
+ *
+ * Returns: %TRUE if the packets of @stream are paced.
+ */
+gboolean
+gst_rtsp_stream_is_pacing (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv;
+  gboolean res;
 
-  *server_addr_out = addr;
-  g_list_free_full (rejected_addresses, (GDestroyNotify) gst_rtsp_address_free);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
 
-  g_object_unref (rtp_socket);
-  g_object_unref (rtcp_socket);
+  priv = stream->priv;
 
-  return TRUE;
+  g_mutex_lock (&priv->lock);
+  res = priv->pacing;
+  g_mutex_unlock (&priv->lock);
 
-  /* ERRORS */
-no_udp_protocol:
-  {
-    goto cleanup;
-  }
-no_ports:
-  {
-    goto cleanup;
-  }
-port_error:
-  {
-    goto cleanup;
-  }
-socket_error:
-  {
-    goto cleanup;
-  }
-element_error:
-  {
-    goto cleanup;
-  }
-cleanup:
-  {
-    if (udpsrc0) {
-      gst_element_set_state (udpsrc0, GST_STATE_NULL);
-      gst_object_unref (udpsrc0);
-    }
-    if (udpsrc1) {
-      gst_element_set_state (udpsrc1, GST_STATE_NULL);
-      gst_object_unref (udpsrc1);
-    }
-    if (udpsink0) {
-      gst_element_set_state (udpsink0, GST_STATE_NULL);
-      gst_object_unref (udpsink0);
-    }
-    if (inetaddr)
-      g_object_unref (inetaddr);
-    g_list_free_full (rejected_addresses,
-        (GDestroyNotify) gst_rtsp_address_free);
-    if (addr)
-      gst_rtsp_address_free (addr);
-    if (rtp_socket)
-      g_object_unref (rtp_socket);
-    if (rtcp_socket)
-      g_object_unref (rtcp_socket);
-    return FALSE;
-  }
+  return res;
 }
 
-/* must be called with lock */
-static gboolean
-alloc_ports (GstRTSPStream * stream)
+/**
+ * gst_rtsp_stream_get_pacing_stats:
+ * @stream: a #GstRTSPStream
+ *
+ * Get the pacing statistics of @stream. The "packets" field contains the
+ * number of paced packets, "mean-delay" and "max-delay" the time the packets
+ * were held back by the pacer as a #GstClockTime.
+ *
+ * Returns: (transfer full) (nullable): a #GstStructure with the statistics or
+ * %NULL when @stream is not paced. gst_structure_free() after usage.
+ */
+GstStructure *
+gst_rtsp_stream_get_pacing_stats (GstRTSPStream * stream)
 {
-  GstRTSPStreamPrivate *priv = stream->priv;
+  GstRTSPStreamPrivate *priv;
+  GstStructure *stats = NULL;
 
-  priv->have_ipv4 = alloc_ports_one_family (priv->pool, priv->buffer_size,
-      G_SOCKET_FAMILY_IPV4, priv->udpsrc_v4, priv->udpsink,
-      &priv->server_port_v4, &priv->server_addr_v4);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
 
-  /* FIXME-WFD : force to disable ipv6 mode in WFD mode */
-#if 0
-  priv->have_ipv6 = alloc_ports_one_family (priv->pool, priv->buffer_size,
-      G_SOCKET_FAMILY_IPV6, priv->udpsrc_v6, priv->udpsink,
-      &priv->server_port_v6, &priv->server_addr_v6);
-#else
-  priv->have_ipv6 = FALSE;
-#endif
+  priv = stream->priv;
 
-  return priv->have_ipv4 || priv->have_ipv6;
+  g_mutex_lock (&priv->lock);
+  if (priv->pace_thread) {
+    g_mutex_lock (&priv->pace_lock);
+    stats = gst_structure_new ("application/x-rtsp-stream-pacing-stats",
+        "packets", G_TYPE_UINT64, priv->paced_packets,
+        "mean-delay", G_TYPE_UINT64, priv->paced_packets ?
+        (guint64) priv->pace_delay_sum * GST_USECOND / priv->paced_packets :
+        (guint64) 0,
+        "max-delay", G_TYPE_UINT64,
+        (guint64) priv->pace_delay_max * GST_USECOND, NULL);
+    g_mutex_unlock (&priv->pace_lock);
+  }
+  g_mutex_unlock (&priv->lock);
+
+  return stats;
 }
 
 /**
- * gst_rtsp_stream_get_server_port:
+ * gst_rtsp_stream_set_dscp_qos:
  * @stream: a #GstRTSPStream
- * @server_port: (out): result server port
- * @family: the port family to get
+ * @dscp_qos: a new dscp qos value (0-63, or -1 to disable)
  *
- * Fill @server_port with the port pair used by the server. This function can
- * only be called when @stream has been joined.
+ * Configure the dscp qos of the outgoing sockets to @dscp_qos. The QoS
+ * policy of a #GstRTSPStreamTransport overrides this for its packets.
  */
 void
-gst_rtsp_stream_get_server_port (GstRTSPStream * stream,
-    GstRTSPRange * server_port, GSocketFamily family)
+gst_rtsp_stream_set_dscp_qos (GstRTSPStream * stream, gint dscp_qos)
 {
   GstRTSPStreamPrivate *priv;
 
   g_return_if_fail (GST_IS_RTSP_STREAM (stream));
+
   priv = stream->priv;
-  g_return_if_fail (priv->is_joined);
 
-  g_mutex_lock (&priv->lock);
-  if (family == G_SOCKET_FAMILY_IPV4) {
-    if (server_port)
-      *server_port = priv->server_port_v4;
-  } else {
-    if (server_port)
-      *server_port = priv->server_port_v6;
+  GST_LOG_OBJECT (stream, "set DSCP QoS %d", dscp_qos);
+
+  if (dscp_qos < -1 || dscp_qos > 63) {
+    GST_WARNING_OBJECT (stream, "trying to set illegal dscp qos %d", dscp_qos);
+    return;
   }
-  g_mutex_unlock (&priv->lock);
+
+  priv->dscp_qos = dscp_qos;
+
+  update_dscp_qos (stream);
 }
 
 /**
- * gst_rtsp_stream_get_rtpsession:
+ * gst_rtsp_stream_get_dscp_qos:
  * @stream: a #GstRTSPStream
  *
- * Get the RTP session of this stream.
+ * Get the configured DSCP QoS in of the outgoing sockets.
  *
- * Returns: (transfer full): The RTP session of this stream. Unref after usage.
+ * Returns: the DSCP QoS value of the outgoing sockets, or -1 if disbled.
  */
-GObject *
-gst_rtsp_stream_get_rtpsession (GstRTSPStream * stream)
+gint
+gst_rtsp_stream_get_dscp_qos (GstRTSPStream * stream)
 {
   GstRTSPStreamPrivate *priv;
-  GObject *session;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), -1);
 
   priv = stream->priv;
 
-  g_mutex_lock (&priv->lock);
-  if ((session = priv->session))
-    g_object_ref (session);
-  g_mutex_unlock (&priv->lock);
-
-  return session;
+  return priv->dscp_qos;
 }
 
 /**
- * gst_rtsp_stream_get_ssrc:
+ * gst_rtsp_stream_is_transport_supported:
  * @stream: a #GstRTSPStream
- * @ssrc: (out): result ssrc
+ * @transport: a #GstRTSPTransport
  *
- * Get the SSRC used by the RTP session of this stream. This function can only
- * be called when @stream has been joined.
+ * Check if @transport can be handled by stream
+ *
+ * Returns: %TRUE if @transport can be handled by @stream.
  */
-void
-gst_rtsp_stream_get_ssrc (GstRTSPStream * stream, guint * ssrc)
+gboolean
+gst_rtsp_stream_is_transport_supported (GstRTSPStream * stream,
+    GstRTSPTransport * transport)
 {
   GstRTSPStreamPrivate *priv;
+  GstRTSPProfile profiles;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
 
-  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
   priv = stream->priv;
-  g_return_if_fail (priv->is_joined);
 
   g_mutex_lock (&priv->lock);
-  if (ssrc && priv->session)
-    g_object_get (priv->session, "internal-ssrc", ssrc, NULL);
-  g_mutex_unlock (&priv->lock);
-}
+  if (transport->trans != GST_RTSP_TRANS_RTP)
+    goto unsupported_transmode;
 
-/* executed from streaming thread */
-static void
-caps_notify (GstPad * pad, GParamSpec * unused, GstRTSPStream * stream)
-{
-  GstRTSPStreamPrivate *priv = stream->priv;
-  GstCaps *newcaps, *oldcaps;
+  /* retransmission is advertised with the feedback profile */
+  profiles = priv->profiles;
+  if (priv->rtx_time > 0 && priv->rtx_pt != 0)
+    profiles |= GST_RTSP_PROFILE_AVPF;
 
-  newcaps = gst_pad_get_current_caps (pad);
+  if (!(transport->profile & profiles))
+    goto unsupported_profile;
 
-  GST_INFO ("stream %p received caps %p, %" GST_PTR_FORMAT, stream, newcaps,
-      newcaps);
+  if (!(transport->lower_transport & priv->protocols))
+    goto unsupported_ltrans;
 
-  g_mutex_lock (&priv->lock);
-  oldcaps = priv->caps;
-  priv->caps = newcaps;
   g_mutex_unlock (&priv->lock);
 
-  if (oldcaps)
-    gst_caps_unref (oldcaps);
-}
-
-static void
-dump_structure (const GstStructure * s)
-{
-  gchar *sstr;
-
-  sstr = gst_structure_to_string (s);
-  GST_INFO ("structure: %s", sstr);
-  g_free (sstr);
-}
+  return TRUE;
 
-static GstRTSPStreamTransport *
-find_transport (GstRTSPStream * stream, const gchar * rtcp_from)
-{
-  GstRTSPStreamPrivate *priv = stream->priv;
-  GList *walk;
-  GstRTSPStreamTransport *result = NULL;
-  const gchar *tmp;
-  gchar *dest;
-  guint port;
+  /* ERRORS */
+unsupported_transmode:
+  {
+    GST_DEBUG ("unsupported transport mode %d", transport->trans);
+    g_mutex_unlock (&priv->lock);
+    return FALSE;
+  }
+unsupported_profile:
+  {
+    GST_DEBUG ("unsupported profile %d", transport->profile);
+    g_mutex_unlock (&priv->lock);
+    return FALSE;
+  }
+unsupported_ltrans:
+  {
+    GST_DEBUG ("unsupported lower transport %d", transport->lower_transport);
+    g_mutex_unlock (&priv->lock);
+    return FALSE;
+  }
+}
 
-  if (rtcp_from == NULL)
-    return NULL;
+/**
+ * gst_rtsp_stream_set_profiles:
+ * @stream: a #GstRTSPStream
+ * @profiles: the new profiles
+ *
+ * Configure the allowed profiles for @stream.
+ */
+void
+gst_rtsp_stream_set_profiles (GstRTSPStream * stream, GstRTSPProfile profiles)
+{
+  GstRTSPStreamPrivate *priv;
 
-  tmp = g_strrstr (rtcp_from, ":");
-  if (tmp == NULL)
-    return NULL;
+  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
 
-  port = atoi (tmp + 1);
-  dest = g_strndup (rtcp_from, tmp - rtcp_from);
+  priv = stream->priv;
 
   g_mutex_lock (&priv->lock);
-  GST_INFO ("finding %s:%d in %d transports", dest, port,
-      g_list_length (priv->transports));
-
-  for (walk = priv->transports; walk; walk = g_list_next (walk)) {
-    GstRTSPStreamTransport *trans = walk->data;
-    const GstRTSPTransport *tr;
-    gint min, max;
-
-    tr = gst_rtsp_stream_transport_get_transport (trans);
-
-    min = tr->client_port.min;
-    max = tr->client_port.max;
-
-    if ((strcmp (tr->destination, dest) == 0) && (min == port || max == port)) {
-      result = trans;
-      break;
-    }
-  }
-  if (result)
-    g_object_ref (result);
+  priv->profiles = profiles;
   g_mutex_unlock (&priv->lock);
-
-  g_free (dest);
-
-  return result;
 }
 
-static GstRTSPStreamTransport *
-check_transport (GObject * source, GstRTSPStream * stream)
+/**
+ * gst_rtsp_stream_get_profiles:
+ * @stream: a #GstRTSPStream
+ *
+ * Get the allowed profiles of @stream.
+ *
+ * Returns: a #GstRTSPProfile
+ */
+GstRTSPProfile
+gst_rtsp_stream_get_profiles (GstRTSPStream * stream)
 {
-  GstStructure *stats;
-  GstRTSPStreamTransport *trans;
+  GstRTSPStreamPrivate *priv;
+  GstRTSPProfile res;
 
-  /* see if we have a stream to match with the origin of the RTCP packet */
-  trans = g_object_get_qdata (source, ssrc_stream_map_key);
-  if (trans == NULL) {
-    g_object_get (source, "stats", &stats, NULL);
-    if (stats) {
-      const gchar *rtcp_from;
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), GST_RTSP_PROFILE_UNKNOWN);
 
-      dump_structure (stats);
+  priv = stream->priv;
 
-      rtcp_from = gst_structure_get_string (stats, "rtcp-from");
-      if ((trans = find_transport (stream, rtcp_from))) {
-        GST_INFO ("%p: found transport %p for source  %p", stream, trans,
-            source);
-        g_object_set_qdata_full (source, ssrc_stream_map_key, trans,
-            g_object_unref);
-      }
-      gst_structure_free (stats);
-    }
-  }
-  return trans;
-}
+  g_mutex_lock (&priv->lock);
+  res = priv->profiles;
+  g_mutex_unlock (&priv->lock);
 
+  return res;
+}
 
-static void
-on_new_ssrc (GObject * session, GObject * source, GstRTSPStream * stream)
+/**
+ * gst_rtsp_stream_set_protocols:
+ * @stream: a #GstRTSPStream
+ * @protocols: the new flags
+ *
+ * Configure the allowed lower transport for @stream.
+ */
+void
+gst_rtsp_stream_set_protocols (GstRTSPStream * stream,
+    GstRTSPLowerTrans protocols)
 {
-  GstRTSPStreamTransport *trans;
+  GstRTSPStreamPrivate *priv;
 
-  GST_INFO ("%p: new source %p", stream, source);
+  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
 
-  trans = check_transport (source, stream);
+  priv = stream->priv;
 
-  if (trans)
-    GST_INFO ("%p: source %p for transport %p", stream, source, trans);
+  g_mutex_lock (&priv->lock);
+  priv->protocols = protocols;
+  g_mutex_unlock (&priv->lock);
 }
 
-static void
-on_ssrc_sdes (GObject * session, GObject * source, GstRTSPStream * stream)
+/**
+ * gst_rtsp_stream_get_protocols:
+ * @stream: a #GstRTSPStream
+ *
+ * Get the allowed protocols of @stream.
+ *
+ * Returns: a #GstRTSPLowerTrans
+ */
+GstRTSPLowerTrans
+gst_rtsp_stream_get_protocols (GstRTSPStream * stream)
 {
-  GST_INFO ("%p: new SDES %p", stream, source);
-}
+  GstRTSPStreamPrivate *priv;
+  GstRTSPLowerTrans res;
 
-static void
-on_ssrc_active (GObject * session, GObject * source, GstRTSPStream * stream)
-{
-  GstRTSPStreamTransport *trans;
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream),
+      GST_RTSP_LOWER_TRANS_UNKNOWN);
 
-  trans = check_transport (source, stream);
+  priv = stream->priv;
 
-  if (trans) {
-    GST_INFO ("%p: source %p in transport %p is active", stream, source, trans);
-    gst_rtsp_stream_transport_keep_alive (trans);
-  }
-#ifdef DUMP_STATS
-  {
-    GstStructure *stats;
-    g_object_get (source, "stats", &stats, NULL);
-    if (stats) {
-      dump_structure (stats);
-      gst_structure_free (stats);
-    }
-  }
-#endif
-}
+  g_mutex_lock (&priv->lock);
+  res = priv->protocols;
+  g_mutex_unlock (&priv->lock);
 
-static void
-on_bye_ssrc (GObject * session, GObject * source, GstRTSPStream * stream)
-{
-  GST_INFO ("%p: source %p bye", stream, source);
+  return res;
 }
 
-static void
-on_bye_timeout (GObject * session, GObject * source, GstRTSPStream * stream)
+/**
+ * gst_rtsp_stream_set_address_pool:
+ * @stream: a #GstRTSPStream
+ * @pool: a #GstRTSPAddressPool
+ *
+ * configure @pool to be used as the address pool of @stream.
+ */
+void
+gst_rtsp_stream_set_address_pool (GstRTSPStream * stream,
+    GstRTSPAddressPool * pool)
 {
-  GstRTSPStreamTransport *trans;
+  GstRTSPStreamPrivate *priv;
+  GstRTSPAddressPool *old;
 
-  GST_INFO ("%p: source %p bye timeout", stream, source);
+  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
 
-  if ((trans = g_object_get_qdata (source, ssrc_stream_map_key))) {
-    gst_rtsp_stream_transport_set_timed_out (trans, TRUE);
-    g_object_set_qdata (source, ssrc_stream_map_key, NULL);
-  }
-}
+  priv = stream->priv;
 
-static void
-on_timeout (GObject * session, GObject * source, GstRTSPStream * stream)
-{
-  GstRTSPStreamTransport *trans;
+  GST_LOG_OBJECT (stream, "set address pool %p", pool);
 
-  GST_INFO ("%p: source %p timeout", stream, source);
+  g_mutex_lock (&priv->lock);
+  if ((old = priv->pool) != pool)
+    priv->pool = pool ? g_object_ref (pool) : NULL;
+  else
+    old = NULL;
+  g_mutex_unlock (&priv->lock);
 
-  if ((trans = g_object_get_qdata (source, ssrc_stream_map_key))) {
-    gst_rtsp_stream_transport_set_timed_out (trans, TRUE);
-    g_object_set_qdata (source, ssrc_stream_map_key, NULL);
-  }
+  if (old)
+    g_object_unref (old);
 }
 
-static GstFlowReturn
-handle_new_sample (GstAppSink * sink, gpointer user_data)
+/**
+ * gst_rtsp_stream_get_address_pool:
+ * @stream: a #GstRTSPStream
+ *
+ * Get the #GstRTSPAddressPool used as the address pool of @stream.
+ *
+ * Returns: (transfer full): the #GstRTSPAddressPool of @stream. g_object_unref() after
+ * usage.
+ */
+GstRTSPAddressPool *
+gst_rtsp_stream_get_address_pool (GstRTSPStream * stream)
 {
   GstRTSPStreamPrivate *priv;
-  GList *walk;
-  GstSample *sample;
-  GstBuffer *buffer;
-  GstRTSPStream *stream;
+  GstRTSPAddressPool *result;
 
-  sample = gst_app_sink_pull_sample (sink);
-  if (!sample)
-    return GST_FLOW_OK;
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
 
-  stream = (GstRTSPStream *) user_data;
   priv = stream->priv;
-  buffer = gst_sample_get_buffer (sample);
 
   g_mutex_lock (&priv->lock);
-  for (walk = priv->transports; walk; walk = g_list_next (walk)) {
-    GstRTSPStreamTransport *tr = (GstRTSPStreamTransport *) walk->data;
+  if ((result = priv->pool))
+    g_object_ref (result);
+  g_mutex_unlock (&priv->lock);
 
-    if (GST_ELEMENT_CAST (sink) == priv->appsink[0]) {
-      gst_rtsp_stream_transport_send_rtp (tr, buffer);
-    } else {
-      gst_rtsp_stream_transport_send_rtcp (tr, buffer);
-    }
-  }
-  g_mutex_unlock (&priv->lock);
-
-  gst_sample_unref (sample);
-
-  return GST_FLOW_OK;
+  return result;
 }
 
-static GstAppSinkCallbacks sink_cb = {
-  NULL,                         /* not interested in EOS */
-  NULL,                         /* not interested in preroll samples */
-  handle_new_sample,
-};
-
 /**
- * gst_rtsp_stream_join_bin:
+ * gst_rtsp_stream_set_socket_pool:
  * @stream: a #GstRTSPStream
- * @bin: a #GstBin to join
- * @rtpbin: a rtpbin element in @bin
- * @state: the target state of the new elements
- *
- * Join the #GstBin @bin that contains the element @rtpbin.
+ * @pool: (allow-none): a #GstRTSPSocketPool
  *
- * @stream will link to @rtpbin, which must be inside @bin. The elements
- * added to @bin will be set to the state given in @state.
+ * configure @pool to provide the bound server sockets of @stream. When @pool
+ * has no sockets available, @stream binds new sockets itself.
  *
- * Returns: %TRUE on success.
+ * When @pool is in mux mode, @stream sends on the sockets that are shared
+ * between all streams and receives its packets from @pool.
  */
-gboolean
-gst_rtsp_stream_join_bin (GstRTSPStream * stream, GstBin * bin,
-    GstElement * rtpbin, GstState state)
+void
+gst_rtsp_stream_set_socket_pool (GstRTSPStream * stream,
+    GstRTSPSocketPool * pool)
 {
   GstRTSPStreamPrivate *priv;
-  gint i;
-  guint idx;
-  gchar *name;
-  GstPad *pad, *sinkpad, *selpad;
-  GstPadLinkReturn ret;
+  GstRTSPSocketPool *old;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
-  g_return_val_if_fail (GST_IS_BIN (bin), FALSE);
-  g_return_val_if_fail (GST_IS_ELEMENT (rtpbin), FALSE);
+  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
 
   priv = stream->priv;
 
-  g_mutex_lock (&priv->lock);
-  if (priv->is_joined)
-    goto was_joined;
-
-  /* create a session with the same index as the stream */
-  idx = priv->idx;
+  GST_LOG_OBJECT (stream, "set socket pool %p", pool);
 
-  GST_INFO ("stream %p joining bin as session %u", stream, idx);
+  g_mutex_lock (&priv->lock);
+  if ((old = priv->socket_pool) != pool)
+    priv->socket_pool = pool ? g_object_ref (pool) : NULL;
+  else
+    old = NULL;
+  g_mutex_unlock (&priv->lock);
 
-  if (!alloc_ports (stream))
-    goto no_ports;
+  if (old)
+    g_object_unref (old);
+}
 
-  /* update the dscp qos field in the sinks */
-  update_dscp_qos (stream);
+/**
+ * gst_rtsp_stream_get_socket_pool:
+ * @stream: a #GstRTSPStream
+ *
+ * Get the #GstRTSPSocketPool used for the server sockets of @stream.
+ *
+ * Returns: (transfer full): the #GstRTSPSocketPool of @stream. g_object_unref()
+ * after usage.
+ */
+GstRTSPSocketPool *
+gst_rtsp_stream_get_socket_pool (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv;
+  GstRTSPSocketPool *result;
 
-  /* get a pad for sending RTP */
-  name = g_strdup_printf ("send_rtp_sink_%u", idx);
-  priv->send_rtp_sink = gst_element_get_request_pad (rtpbin, name);
-  g_free (name);
-  /* link the RTP pad to the session manager, it should not really fail unless
-   * this is not really an RTP pad */
-  ret = gst_pad_link (priv->srcpad, priv->send_rtp_sink);
-  if (ret != GST_PAD_LINK_OK)
-    goto link_failed;
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
 
-  /* get pads from the RTP session element for sending and receiving
-   * RTP/RTCP*/
-  name = g_strdup_printf ("send_rtp_src_%u", idx);
-  priv->send_src[0] = gst_element_get_static_pad (rtpbin, name);
-  g_free (name);
-  name = g_strdup_printf ("send_rtcp_src_%u", idx);
-  priv->send_src[1] = gst_element_get_request_pad (rtpbin, name);
-  g_free (name);
-  name = g_strdup_printf ("recv_rtp_sink_%u", idx);
-  priv->recv_sink[0] = gst_element_get_request_pad (rtpbin, name);
-  g_free (name);
-  name = g_strdup_printf ("recv_rtcp_sink_%u", idx);
-  priv->recv_sink[1] = gst_element_get_request_pad (rtpbin, name);
-  g_free (name);
+  priv = stream->priv;
 
-  /* get the session */
-  g_signal_emit_by_name (rtpbin, "get-internal-session", idx, &priv->session);
-  GST_DEBUG("zzoon unref internal session");
-  g_object_unref(priv->session);
+  g_mutex_lock (&priv->lock);
+  if ((result = priv->socket_pool))
+    g_object_ref (result);
+  g_mutex_unlock (&priv->lock);
 
-  g_signal_connect (priv->session, "on-new-ssrc", (GCallback) on_new_ssrc,
-      stream);
-  g_signal_connect (priv->session, "on-ssrc-sdes", (GCallback) on_ssrc_sdes,
-      stream);
-  g_signal_connect (priv->session, "on-ssrc-active",
-      (GCallback) on_ssrc_active, stream);
-  g_signal_connect (priv->session, "on-bye-ssrc", (GCallback) on_bye_ssrc,
-      stream);
-  g_signal_connect (priv->session, "on-bye-timeout",
-      (GCallback) on_bye_timeout, stream);
-  g_signal_connect (priv->session, "on-timeout", (GCallback) on_timeout,
-      stream);
+  return result;
+}
 
-  for (i = 0; i < 2; i++) {
-    GstPad *teepad, *queuepad;
-    /* For the sender we create this bit of pipeline for both
-     * RTP and RTCP. Sync and preroll are enabled on udpsink so
-     * we need to add a queue before appsink to make the pipeline
-     * not block. For the TCP case, we want to pump data to the
-     * client as fast as possible anyway.
-     *
-     * .--------.      .-----.    .---------.
-     * | rtpbin |      | tee |    | udpsink |
-     * |       send->sink   src->sink       |
-     * '--------'      |     |    '---------'
-     *                 |     |    .---------.    .---------.
-     *                 |     |    |  queue  |    | appsink |
-     *                 |    src->sink      src->sink       |
-     *                 '-----'    '---------'    '---------'
-     *
-     * When only UDP is allowed, we skip the tee, queue and appsink and link the
-     * udpsink directly to the session.
-     */
-    /* add udpsink */
-    gst_bin_add (bin, priv->udpsink[i]);
-    sinkpad = gst_element_get_static_pad (priv->udpsink[i], "sink");
+/**
+ * gst_rtsp_stream_get_multicast_address:
+ * @stream: a #GstRTSPStream
+ * @family: the #GSocketFamily
+ *
+ * Get the multicast address of @stream for @family.
+ *
+ * Returns: the #GstRTSPAddress of @stream or %NULL when no address could be
+ * allocated. gst_rtsp_address_free() after usage.
+ */
+GstRTSPAddress *
+gst_rtsp_stream_get_multicast_address (GstRTSPStream * stream,
+    GSocketFamily family)
+{
+  GstRTSPStreamPrivate *priv;
+  GstRTSPAddress *result;
+  GstRTSPAddress **addrp;
+  GstRTSPAddressFlags flags;
 
-    if (priv->protocols & GST_RTSP_LOWER_TRANS_TCP) {
-      /* make tee for RTP/RTCP */
-      priv->tee[i] = gst_element_factory_make ("tee", NULL);
-      gst_bin_add (bin, priv->tee[i]);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
 
-      /* and link to rtpbin send pad */
-      pad = gst_element_get_static_pad (priv->tee[i], "sink");
-      gst_pad_link (priv->send_src[i], pad);
-      gst_object_unref (pad);
+  priv = stream->priv;
 
-      /* link tee to udpsink */
-      teepad = gst_element_get_request_pad (priv->tee[i], "src_%u");
-      gst_pad_link (teepad, sinkpad);
-      gst_object_unref (teepad);
+  if (family == G_SOCKET_FAMILY_IPV6) {
+    flags = GST_RTSP_ADDRESS_FLAG_IPV6;
+    addrp = &priv->addr_v4;
+  } else {
+    flags = GST_RTSP_ADDRESS_FLAG_IPV4;
+    addrp = &priv->addr_v6;
+  }
 
-      /* make queue */
-      priv->appqueue[i] = gst_element_factory_make ("queue", NULL);
-      gst_bin_add (bin, priv->appqueue[i]);
-      /* and link to tee */
-      teepad = gst_element_get_request_pad (priv->tee[i], "src_%u");
-      pad = gst_element_get_static_pad (priv->appqueue[i], "sink");
-      gst_pad_link (teepad, pad);
-      gst_object_unref (pad);
-      gst_object_unref (teepad);
+  g_mutex_lock (&priv->lock);
+  if (*addrp == NULL) {
+    if (priv->pool == NULL)
+      goto no_pool;
 
-      /* make appsink */
-      priv->appsink[i] = gst_element_factory_make ("appsink", NULL);
-      g_object_set (priv->appsink[i], "async", FALSE, "sync", FALSE, NULL);
-      g_object_set (priv->appsink[i], "emit-signals", FALSE, NULL);
-      gst_bin_add (bin, priv->appsink[i]);
-      gst_app_sink_set_callbacks (GST_APP_SINK_CAST (priv->appsink[i]),
-          &sink_cb, stream, NULL);
-      /* and link to queue */
-      queuepad = gst_element_get_static_pad (priv->appqueue[i], "src");
-      pad = gst_element_get_static_pad (priv->appsink[i], "sink");
-      gst_pad_link (queuepad, pad);
-      gst_object_unref (pad);
-      gst_object_unref (queuepad);
-    } else {
-      /* else only udpsink needed, link it to the session */
-      gst_pad_link (priv->send_src[i], sinkpad);
-    }
-    gst_object_unref (sinkpad);
+    flags |= GST_RTSP_ADDRESS_FLAG_EVEN_PORT | GST_RTSP_ADDRESS_FLAG_MULTICAST;
 
-    /* For the receiver we create this bit of pipeline for both
-     * RTP and RTCP. We receive RTP/RTCP on appsrc and udpsrc
-     * and it is all funneled into the rtpbin receive pad.
-     *
-     * .--------.     .--------.    .--------.
-     * | udpsrc |     | funnel |    | rtpbin |
-     * |       src->sink      src->sink      |
-     * '--------'     |        |    '--------'
-     * .--------.     |        |
-     * | appsrc |     |        |
-     * |       src->sink       |
-     * '--------'     '--------'
-     */
-    /* make funnel for the RTP/RTCP receivers */
-    priv->funnel[i] = gst_element_factory_make ("funnel", NULL);
-    gst_bin_add (bin, priv->funnel[i]);
+    *addrp = gst_rtsp_address_pool_acquire_address (priv->pool, flags, 2);
+    if (*addrp == NULL)
+      goto no_address;
+  }
+  result = gst_rtsp_address_copy (*addrp);
+  g_mutex_unlock (&priv->lock);
 
-    pad = gst_element_get_static_pad (priv->funnel[i], "src");
-    gst_pad_link (pad, priv->recv_sink[i]);
-    gst_object_unref (pad);
+  return result;
 
-    if (priv->udpsrc_v4[i]) {
-      /* we set and keep these to playing so that they don't cause NO_PREROLL return
-       * values */
-      gst_element_set_state (priv->udpsrc_v4[i], GST_STATE_PLAYING);
-      gst_element_set_locked_state (priv->udpsrc_v4[i], TRUE);
-      /* add udpsrc */
-      gst_bin_add (bin, priv->udpsrc_v4[i]);
+  /* ERRORS */
+no_pool:
+  {
+    GST_ERROR_OBJECT (stream, "no address pool specified");
+    g_mutex_unlock (&priv->lock);
+    return NULL;
+  }
+no_address:
+  {
+    GST_ERROR_OBJECT (stream, "failed to acquire address from pool");
+    g_mutex_unlock (&priv->lock);
+    return NULL;
+  }
+}
 
-      /* and link to the funnel v4 */
-      selpad = gst_element_get_request_pad (priv->funnel[i], "sink_%u");
-      pad = gst_element_get_static_pad (priv->udpsrc_v4[i], "src");
-      gst_pad_link (pad, selpad);
-      gst_object_unref (pad);
-      gst_object_unref (selpad);
-    }
+/**
+ * gst_rtsp_stream_reserve_address:
+ * @stream: a #GstRTSPStream
+ * @address: an address
+ * @port: a port
+ * @n_ports: n_ports
+ * @ttl: a TTL
+ *
+ * Reserve @address and @port as the address and port of @stream.
+ *
+ * Returns: the #GstRTSPAddress of @stream or %NULL when the address could be
+ * reserved. gst_rtsp_address_free() after usage.
+ */
+GstRTSPAddress *
+gst_rtsp_stream_reserve_address (GstRTSPStream * stream,
+    const gchar * address, guint port, guint n_ports, guint ttl)
+{
+  GstRTSPStreamPrivate *priv;
+  GstRTSPAddress *result;
+  GInetAddress *addr;
+  GSocketFamily family;
+  GstRTSPAddress **addrp;
 
-    if (priv->udpsrc_v6[i]) {
-      gst_element_set_state (priv->udpsrc_v6[i], GST_STATE_PLAYING);
-      gst_element_set_locked_state (priv->udpsrc_v6[i], TRUE);
-      gst_bin_add (bin, priv->udpsrc_v6[i]);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
+  g_return_val_if_fail (address != NULL, NULL);
+  g_return_val_if_fail (port > 0, NULL);
+  g_return_val_if_fail (n_ports > 0, NULL);
+  g_return_val_if_fail (ttl > 0, NULL);
 
-      /* and link to the funnel v6 */
-      selpad = gst_element_get_request_pad (priv->funnel[i], "sink_%u");
-      pad = gst_element_get_static_pad (priv->udpsrc_v6[i], "src");
-      gst_pad_link (pad, selpad);
-      gst_object_unref (pad);
-      gst_object_unref (selpad);
+  priv = stream->priv;
+
+  addr = g_inet_address_new_from_string (address);
+  if (!addr) {
+    GST_ERROR ("failed to get inet addr from %s", address);
+    family = G_SOCKET_FAMILY_IPV4;
+  } else {
+    family = g_inet_address_get_family (addr);
+    g_object_unref (addr);
+  }
+
+  if (family == G_SOCKET_FAMILY_IPV6)
+    addrp = &priv->addr_v4;
+  else
+    addrp = &priv->addr_v6;
+
+  g_mutex_lock (&priv->lock);
+  if (*addrp == NULL) {
+    GstRTSPAddressPoolResult res;
+
+    if (priv->pool == NULL)
+      goto no_pool;
+
+    res = gst_rtsp_address_pool_reserve_address (priv->pool, address,
+        port, n_ports, ttl, addrp);
+    if (res != GST_RTSP_ADDRESS_POOL_OK)
+      goto no_address;
+  } else {
+    if (strcmp ((*addrp)->address, address) ||
+        (*addrp)->port != port || (*addrp)->n_ports != n_ports ||
+        (*addrp)->ttl != ttl)
+      goto different_address;
+  }
+  result = gst_rtsp_address_copy (*addrp);
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+
+  /* ERRORS */
+no_pool:
+  {
+    GST_ERROR_OBJECT (stream, "no address pool specified");
+    g_mutex_unlock (&priv->lock);
+    return NULL;
+  }
+no_address:
+  {
+    GST_ERROR_OBJECT (stream, "failed to acquire address %s from pool",
+        address);
+    g_mutex_unlock (&priv->lock);
+    return NULL;
+  }
+different_address:
+  {
+    GST_ERROR_OBJECT (stream, "address %s is not the same that was already"
+        " reserved", address);
+    g_mutex_unlock (&priv->lock);
+    return NULL;
+  }
+}
+
+static gboolean
+alloc_ports_one_family (GstRTSPAddressPool * pool,
+    GstRTSPSocketPool * socket_pool, gint buffer_size,
+    gboolean low_latency, GSocketFamily family, GstElement * udpsrc_out[2],
+    GstElement * udpsink_out[2], GstRTSPRange * server_port_out,
+    GstRTSPAddress ** server_addr_out, gboolean * mux)
+{
+  GstStateChangeReturn ret;
+  GstElement *udpsrc0, *udpsrc1;
+  GstElement *udpsink0, *udpsink1;
+  GSocket *rtp_socket = NULL;
+  GSocket *rtcp_socket = NULL;
+  gint tmp_rtp, tmp_rtcp;
+  guint count;
+  gint rtpport, rtcpport;
+  GList *rejected_addresses = NULL;
+  GstRTSPAddress *addr = NULL;
+  GInetAddress *inetaddr = NULL;
+  GSocketAddress *rtp_sockaddr = NULL;
+  GSocketAddress *rtcp_sockaddr = NULL;
+  const gchar *multisink_socket;
+
+  if (family == G_SOCKET_FAMILY_IPV6)
+    multisink_socket = "socket-v6";
+  else
+    multisink_socket = "socket";
+
+  udpsrc0 = NULL;
+  udpsrc1 = NULL;
+  udpsink0 = NULL;
+  udpsink1 = NULL;
+  count = 0;
+
+  /* in mux mode all streams use the same sockets, else take an already bound
+   * pair when we can */
+  *mux = socket_pool && gst_rtsp_socket_pool_acquire_mux (socket_pool,
+      family, &rtp_socket, &rtcp_socket, &addr);
+
+  if (*mux || (socket_pool && gst_rtsp_socket_pool_acquire (socket_pool,
+              family, &rtp_socket, &rtcp_socket, &addr))) {
+    if (*server_addr_out)
+      gst_rtsp_address_free (*server_addr_out);
+
+    rtp_sockaddr = g_socket_get_local_address (rtp_socket, NULL);
+    if (rtp_sockaddr == NULL || !G_IS_INET_SOCKET_ADDRESS (rtp_sockaddr)) {
+      g_clear_object (&rtp_sockaddr);
+      goto socket_error;
     }
+    tmp_rtp =
+        g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (rtp_sockaddr));
+    g_object_unref (rtp_sockaddr);
+    tmp_rtcp = tmp_rtp + 1;
 
-    if (priv->protocols & GST_RTSP_LOWER_TRANS_TCP) {
-      /* make and add appsrc */
-      priv->appsrc[i] = gst_element_factory_make ("appsrc", NULL);
-      gst_bin_add (bin, priv->appsrc[i]);
-      /* and link to the funnel */
-      selpad = gst_element_get_request_pad (priv->funnel[i], "sink_%u");
-      pad = gst_element_get_static_pad (priv->appsrc[i], "src");
-      gst_pad_link (pad, selpad);
-      gst_object_unref (pad);
-      gst_object_unref (selpad);
+    GST_DEBUG ("using pooled ports %d-%d", tmp_rtp, tmp_rtcp);
+    goto have_sockets;
+  }
+
+  /* Start with random port */
+  tmp_rtp = 0;
+
+  rtcp_socket = g_socket_new (family, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  if (!rtcp_socket)
+    goto no_udp_protocol;
+
+  if (*server_addr_out)
+    gst_rtsp_address_free (*server_addr_out);
+
+  /* try to allocate 2 UDP ports, the RTP port should be an even
+   * number and the RTCP port should be the next (uneven) port */
+again:
+
+  if (rtp_socket == NULL) {
+    rtp_socket = g_socket_new (family, G_SOCKET_TYPE_DATAGRAM,
+        G_SOCKET_PROTOCOL_UDP, NULL);
+    if (!rtp_socket)
+      goto no_udp_protocol;
+  }
+
+  if (pool && gst_rtsp_address_pool_has_unicast_addresses (pool)) {
+    GstRTSPAddressFlags flags;
+
+    if (addr)
+      rejected_addresses = g_list_prepend (rejected_addresses, addr);
+
+    flags = GST_RTSP_ADDRESS_FLAG_EVEN_PORT | GST_RTSP_ADDRESS_FLAG_UNICAST;
+    if (family == G_SOCKET_FAMILY_IPV6)
+      flags |= GST_RTSP_ADDRESS_FLAG_IPV6;
+    else
+      flags |= GST_RTSP_ADDRESS_FLAG_IPV4;
+
+    addr = gst_rtsp_address_pool_acquire_address (pool, flags, 2);
+
+    if (addr == NULL)
+      goto no_ports;
+
+    tmp_rtp = addr->port;
+
+    g_clear_object (&inetaddr);
+    inetaddr = g_inet_address_new_from_string (addr->address);
+  } else {
+    if (tmp_rtp != 0) {
+      tmp_rtp += 2;
+      if (++count > 20)
+        goto no_ports;
     }
 
-    /* check if we need to set to a special state */
-    if (state != GST_STATE_NULL) {
-      if (priv->udpsink[i])
-        gst_element_set_state (priv->udpsink[i], state);
-      if (priv->appsink[i])
-        gst_element_set_state (priv->appsink[i], state);
-      if (priv->appqueue[i])
-        gst_element_set_state (priv->appqueue[i], state);
-      if (priv->tee[i])
-        gst_element_set_state (priv->tee[i], state);
-      if (priv->funnel[i])
-        gst_element_set_state (priv->funnel[i], state);
-      if (priv->appsrc[i])
-        gst_element_set_state (priv->appsrc[i], state);
+    if (inetaddr == NULL)
+      inetaddr = g_inet_address_new_any (family);
+  }
+
+  /* FIXME-WFD : Start at 19000 as port number, the media of other sinks
+   * continue with the next free port pair */
+  if (tmp_rtp == 0)
+    tmp_rtp = 19000;
+
+  rtp_sockaddr = g_inet_socket_address_new (inetaddr, tmp_rtp);
+  if (!g_socket_bind (rtp_socket, rtp_sockaddr, FALSE, NULL)) {
+    g_object_unref (rtp_sockaddr);
+    goto again;
+  }
+  g_object_unref (rtp_sockaddr);
+
+  rtp_sockaddr = g_socket_get_local_address (rtp_socket, NULL);
+  if (rtp_sockaddr == NULL || !G_IS_INET_SOCKET_ADDRESS (rtp_sockaddr)) {
+    g_clear_object (&rtp_sockaddr);
+    goto socket_error;
+  }
+
+  tmp_rtp =
+      g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (rtp_sockaddr));
+  g_object_unref (rtp_sockaddr);
+
+  /* check if port is even */
+  if ((tmp_rtp & 1) != 0) {
+    /* port not even, close and allocate another */
+    tmp_rtp++;
+    g_clear_object (&rtp_socket);
+    goto again;
+  }
+
+  /* set port */
+  tmp_rtcp = tmp_rtp + 1;
+
+  rtcp_sockaddr = g_inet_socket_address_new (inetaddr, tmp_rtcp);
+  if (!g_socket_bind (rtcp_socket, rtcp_sockaddr, FALSE, NULL)) {
+    g_object_unref (rtcp_sockaddr);
+    g_clear_object (&rtp_socket);
+    goto again;
+  }
+  g_object_unref (rtcp_sockaddr);
+
+  g_clear_object (&inetaddr);
+
+have_sockets:
+  /* the socket pool receives on the shared sockets */
+  if (*mux) {
+    rtpport = tmp_rtp;
+    rtcpport = tmp_rtcp;
+    goto have_ports;
+  }
+
+  udpsrc0 = gst_element_factory_make ("udpsrc", NULL);
+  udpsrc1 = gst_element_factory_make ("udpsrc", NULL);
+
+  if (udpsrc0 == NULL || udpsrc1 == NULL)
+    goto no_udp_protocol;
+
+  g_object_set (G_OBJECT (udpsrc0), "socket", rtp_socket, NULL);
+  g_object_set (G_OBJECT (udpsrc1), "socket", rtcp_socket, NULL);
+
+  ret = gst_element_set_state (udpsrc0, GST_STATE_PAUSED);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    goto element_error;
+  ret = gst_element_set_state (udpsrc1, GST_STATE_PAUSED);
+  if (ret == GST_STATE_CHANGE_FAILURE)
+    goto element_error;
+
+  /* all fine, do port check */
+  g_object_get (G_OBJECT (udpsrc0), "port", &rtpport, NULL);
+  g_object_get (G_OBJECT (udpsrc1), "port", &rtcpport, NULL);
+
+  /* this should not happen... */
+  if (rtpport != tmp_rtp || rtcpport != tmp_rtcp)
+    goto port_error;
+
+have_ports:
+  if (udpsink_out[0])
+    udpsink0 = udpsink_out[0];
+  else
+    udpsink0 = gst_element_factory_make ("multiudpsink", NULL);
+
+  if (!udpsink0)
+    goto no_udp_protocol;
+
+  g_object_set (G_OBJECT (udpsink0), "close-socket", FALSE, NULL);
+  g_object_set (G_OBJECT (udpsink0), multisink_socket, rtp_socket, NULL);
+
+  if (udpsink_out[1])
+    udpsink1 = udpsink_out[1];
+  else
+    udpsink1 = gst_element_factory_make ("multiudpsink", NULL);
+
+  if (!udpsink1)
+    goto no_udp_protocol;
+
+  g_object_set (G_OBJECT (udpsink0), "send-duplicates", FALSE, NULL);
+  g_object_set (G_OBJECT (udpsink1), "send-duplicates", FALSE, NULL);
+
+  if (low_latency) {
+    /* don't let packets queue up in the kernel and drop what is too late
+     * instead of sending it out in a burst */
+    if (buffer_size == 0 || buffer_size > LOW_LATENCY_BUFFER_SIZE)
+      buffer_size = LOW_LATENCY_BUFFER_SIZE;
+    g_object_set (G_OBJECT (udpsink0), "max-lateness",
+        (gint64) LOW_LATENCY_MAX_LATENESS, "qos", TRUE, NULL);
+  }
+  /* the buffer size of shared sockets is configured on the pool */
+  if (!*mux)
+    g_object_set (G_OBJECT (udpsink0), "buffer-size", buffer_size, NULL);
+
+  g_object_set (G_OBJECT (udpsink1), "close-socket", FALSE, NULL);
+  g_object_set (G_OBJECT (udpsink1), multisink_socket, rtcp_socket, NULL);
+  g_object_set (G_OBJECT (udpsink1), "sync", FALSE, NULL);
+  g_object_set (G_OBJECT (udpsink1), "async", FALSE, NULL);
+  g_object_set (G_OBJECT (udpsink0), "auto-multicast", FALSE, NULL);
+  g_object_set (G_OBJECT (udpsink0), "loop", FALSE, NULL);
+  g_object_set (G_OBJECT (udpsink1), "auto-multicast", FALSE, NULL);
+  g_object_set (G_OBJECT (udpsink1), "loop", FALSE, NULL);
+
+  /* we keep these elements, we will further configure them when the
+   * client told us to really use the UDP ports. */
+  udpsrc_out[0] = udpsrc0;
+  udpsrc_out[1] = udpsrc1;
+  udpsink_out[0] = udpsink0;
+  udpsink_out[1] = udpsink1;
+  server_port_out->min = rtpport;
+  server_port_out->max = rtcpport;
+
+  *server_addr_out = addr;
+  g_list_free_full (rejected_addresses, (GDestroyNotify) gst_rtsp_address_free);
+
+  g_object_unref (rtp_socket);
+  g_object_unref (rtcp_socket);
+
+  return TRUE;
+
+  /* ERRORS */
+no_udp_protocol:
+  {
+    goto cleanup;
+  }
+no_ports:
+  {
+    goto cleanup;
+  }
+port_error:
+  {
+    goto cleanup;
+  }
+socket_error:
+  {
+    goto cleanup;
+  }
+element_error:
+  {
+    goto cleanup;
+  }
+cleanup:
+  {
+    if (udpsrc0) {
+      gst_element_set_state (udpsrc0, GST_STATE_NULL);
+      gst_object_unref (udpsrc0);
+    }
+    if (udpsrc1) {
+      gst_element_set_state (udpsrc1, GST_STATE_NULL);
+      gst_object_unref (udpsrc1);
+    }
+    if (udpsink0) {
+      gst_element_set_state (udpsink0, GST_STATE_NULL);
+      gst_object_unref (udpsink0);
+    }
+    if (inetaddr)
+      g_object_unref (inetaddr);
+    g_list_free_full (rejected_addresses,
+        (GDestroyNotify) gst_rtsp_address_free);
+    if (addr)
+      gst_rtsp_address_free (addr);
+    if (rtp_socket)
+      g_object_unref (rtp_socket);
+    if (rtcp_socket)
+      g_object_unref (rtcp_socket);
+    return FALSE;
+  }
+}
+
+/* must be called with lock */
+static gboolean
+alloc_ports (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  gboolean mux_v4, mux_v6 = FALSE;
+
+  priv->have_ipv4 = alloc_ports_one_family (priv->pool, priv->socket_pool,
+      priv->buffer_size, priv->low_latency, G_SOCKET_FAMILY_IPV4,
+      priv->udpsrc_v4, priv->udpsink, &priv->server_port_v4,
+      &priv->server_addr_v4, &mux_v4);
+
+  /* FIXME-WFD : force to disable ipv6 mode in WFD mode */
+#if 0
+  priv->have_ipv6 = alloc_ports_one_family (priv->pool, priv->socket_pool,
+      priv->buffer_size, priv->low_latency, G_SOCKET_FAMILY_IPV6,
+      priv->udpsrc_v6, priv->udpsink, &priv->server_port_v6,
+      &priv->server_addr_v6, &mux_v6);
+#else
+  priv->have_ipv6 = FALSE;
+#endif
+
+  if ((mux_v4 || mux_v6) && priv->mux_pool == NULL)
+    priv->mux_pool = g_object_ref (priv->socket_pool);
+
+  return priv->have_ipv4 || priv->have_ipv6;
+}
+
+/**
+ * gst_rtsp_stream_get_server_port:
+ * @stream: a #GstRTSPStream
+ * @server_port: (out): result server port
+ * @family: the port family to get
+ *
+ * Fill @server_port with the port pair used by the server. This function can
+ * only be called when @stream has been joined.
+ */
+void
+gst_rtsp_stream_get_server_port (GstRTSPStream * stream,
+    GstRTSPRange * server_port, GSocketFamily family)
+{
+  GstRTSPStreamPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
+  priv = stream->priv;
+  g_return_if_fail (priv->is_joined);
+
+  g_mutex_lock (&priv->lock);
+  if (family == G_SOCKET_FAMILY_IPV4) {
+    if (server_port)
+      *server_port = priv->server_port_v4;
+  } else {
+    if (server_port)
+      *server_port = priv->server_port_v6;
+  }
+  g_mutex_unlock (&priv->lock);
+}
+
+/**
+ * gst_rtsp_stream_get_rtpsession:
+ * @stream: a #GstRTSPStream
+ *
+ * Get the RTP session of this stream.
+ *
+ * Returns: (transfer full): The RTP session of this stream. Unref after usage.
+ */
+GObject *
+gst_rtsp_stream_get_rtpsession (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv;
+  GObject *session;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
+
+  priv = stream->priv;
+
+  g_mutex_lock (&priv->lock);
+  if ((session = priv->session))
+    g_object_ref (session);
+  g_mutex_unlock (&priv->lock);
+
+  return session;
+}
+
+/**
+ * gst_rtsp_stream_get_ssrc:
+ * @stream: a #GstRTSPStream
+ * @ssrc: (out): result ssrc
+ *
+ * Get the SSRC used by the RTP session of this stream. This function can only
+ * be called when @stream has been joined.
+ */
+void
+gst_rtsp_stream_get_ssrc (GstRTSPStream * stream, guint * ssrc)
+{
+  GstRTSPStreamPrivate *priv;
+
+  g_return_if_fail (GST_IS_RTSP_STREAM (stream));
+  priv = stream->priv;
+  g_return_if_fail (priv->is_joined);
+
+  g_mutex_lock (&priv->lock);
+  if (ssrc && priv->session)
+    g_object_get (priv->session, "internal-ssrc", ssrc, NULL);
+  g_mutex_unlock (&priv->lock);
+}
+
+/* executed from streaming thread */
+static void
+caps_notify (GstPad * pad, GParamSpec * unused, GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GstCaps *newcaps, *oldcaps;
+
+  newcaps = gst_pad_get_current_caps (pad);
+
+  GST_INFO ("stream %p received caps %p, %" GST_PTR_FORMAT, stream, newcaps,
+      newcaps);
+
+  g_mutex_lock (&priv->lock);
+  oldcaps = priv->caps;
+  priv->caps = newcaps;
+  mux_update_ssrc (stream);
+  g_mutex_unlock (&priv->lock);
+
+  if (oldcaps)
+    gst_caps_unref (oldcaps);
+}
+
+static void
+dump_structure (const GstStructure * s)
+{
+  gchar *sstr;
+
+  sstr = gst_structure_to_string (s);
+  GST_INFO ("structure: %s", sstr);
+  g_free (sstr);
+}
+
+static GstRTSPStreamTransport *
+find_transport (GstRTSPStream * stream, const gchar * rtcp_from)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GList *walk;
+  GstRTSPStreamTransport *result = NULL;
+  const gchar *tmp;
+  gchar *dest;
+  guint port;
+
+  if (rtcp_from == NULL)
+    return NULL;
+
+  tmp = g_strrstr (rtcp_from, ":");
+  if (tmp == NULL)
+    return NULL;
+
+  port = atoi (tmp + 1);
+  dest = g_strndup (rtcp_from, tmp - rtcp_from);
+
+  g_mutex_lock (&priv->lock);
+  GST_INFO ("finding %s:%d in %d transports", dest, port,
+      g_list_length (priv->transports));
+
+  for (walk = priv->transports; walk; walk = g_list_next (walk)) {
+    GstRTSPStreamTransport *trans = walk->data;
+    const GstRTSPTransport *tr;
+    gint min, max;
+
+    tr = gst_rtsp_stream_transport_get_transport (trans);
+
+    min = tr->client_port.min;
+    max = tr->client_port.max;
+
+    if ((strcmp (tr->destination, dest) == 0) && (min == port || max == port)) {
+      result = trans;
+      break;
+    }
+  }
+  if (result)
+    g_object_ref (result);
+  g_mutex_unlock (&priv->lock);
+
+  g_free (dest);
+
+  return result;
+}
+
+static GstRTSPStreamTransport *
+check_transport (GObject * source, GstRTSPStream * stream)
+{
+  GstStructure *stats;
+  GstRTSPStreamTransport *trans;
+
+  /* see if we have a stream to match with the origin of the RTCP packet */
+  trans = g_object_get_qdata (source, ssrc_stream_map_key);
+  if (trans == NULL) {
+    g_object_get (source, "stats", &stats, NULL);
+    if (stats) {
+      const gchar *rtcp_from;
+
+      dump_structure (stats);
+
+      rtcp_from = gst_structure_get_string (stats, "rtcp-from");
+      if ((trans = find_transport (stream, rtcp_from))) {
+        GST_INFO ("%p: found transport %p for source  %p", stream, trans,
+            source);
+        g_object_set_qdata_full (source, ssrc_stream_map_key, trans,
+            g_object_unref);
+      }
+      gst_structure_free (stats);
+    }
+  }
+  return trans;
+}
+
+
+static void
+on_new_ssrc (GObject * session, GObject * source, GstRTSPStream * stream)
+{
+  GstRTSPStreamTransport *trans;
+
+  GST_INFO ("%p: new source %p", stream, source);
+
+  trans = check_transport (source, stream);
+
+  if (trans)
+    GST_INFO ("%p: source %p for transport %p", stream, source, trans);
+}
+
+static void
+on_ssrc_sdes (GObject * session, GObject * source, GstRTSPStream * stream)
+{
+  GST_INFO ("%p: new SDES %p", stream, source);
+}
+
+static void
+on_ssrc_active (GObject * session, GObject * source, GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GstRTSPStreamTransport *trans;
+
+  trans = check_transport (source, stream);
+
+  if (trans) {
+    gboolean check_report;
+
+    GST_INFO ("%p: source %p in transport %p is active", stream, source, trans);
+    gst_rtsp_stream_transport_keep_alive (trans);
+
+    g_mutex_lock (&priv->lock);
+    check_report = priv->layers != NULL || priv->adaptive_bitrate;
+    g_mutex_unlock (&priv->lock);
+
+    if (check_report) {
+      GstStructure *stats;
+      gboolean have_rb = FALSE;
+
+      g_object_get (source, "stats", &stats, NULL);
+      if (stats) {
+        /* act on the receiver reports of the client */
+        gst_structure_get_boolean (stats, "have-rb", &have_rb);
+        if (have_rb) {
+          layers_check_report (stream, trans, stats);
+          rate_control_check_report (stream, trans, stats);
+        }
+        gst_structure_free (stats);
+      }
+    }
+  }
+#ifdef DUMP_STATS
+  {
+    GstStructure *stats;
+    g_object_get (source, "stats", &stats, NULL);
+    if (stats) {
+      dump_structure (stats);
+      gst_structure_free (stats);
+    }
+  }
+#endif
+}
+
+static void
+on_bye_ssrc (GObject * session, GObject * source, GstRTSPStream * stream)
+{
+  GST_INFO ("%p: source %p bye", stream, source);
+}
+
+static void
+on_bye_timeout (GObject * session, GObject * source, GstRTSPStream * stream)
+{
+  GstRTSPStreamTransport *trans;
+
+  GST_INFO ("%p: source %p bye timeout", stream, source);
+
+  if ((trans = g_object_get_qdata (source, ssrc_stream_map_key))) {
+    gst_rtsp_stream_transport_set_timed_out (trans, TRUE);
+    g_object_set_qdata (source, ssrc_stream_map_key, NULL);
+  }
+}
+
+static void
+on_timeout (GObject * session, GObject * source, GstRTSPStream * stream)
+{
+  GstRTSPStreamTransport *trans;
+
+  GST_INFO ("%p: source %p timeout", stream, source);
+
+  if ((trans = g_object_get_qdata (source, ssrc_stream_map_key))) {
+    gst_rtsp_stream_transport_set_timed_out (trans, TRUE);
+    g_object_set_qdata (source, ssrc_stream_map_key, NULL);
+  }
+}
+
+#ifndef G_OS_WIN32
+/* a control message that marks one packet with an int socket option, like
+ * IP_TOS, IPV6_TCLASS or SO_PRIORITY */
+typedef struct
+{
+  GSocketControlMessage parent;
+  gint level;
+  gint type;
+  gint value;
+} GstRTSPSocketMark;
+
+typedef GSocketControlMessageClass GstRTSPSocketMarkClass;
+
+static GType gst_rtsp_socket_mark_get_type (void);
+
+G_DEFINE_TYPE (GstRTSPSocketMark, gst_rtsp_socket_mark,
+    G_TYPE_SOCKET_CONTROL_MESSAGE);
+
+static gsize
+socket_mark_get_size (GSocketControlMessage * message)
+{
+  return sizeof (gint);
+}
+
+static int
+socket_mark_get_level (GSocketControlMessage * message)
+{
+  return ((GstRTSPSocketMark *) message)->level;
+}
+
+static int
+socket_mark_get_msg_type (GSocketControlMessage * message)
+{
+  return ((GstRTSPSocketMark *) message)->type;
+}
+
+static void
+socket_mark_serialize (GSocketControlMessage * message, gpointer data)
+{
+  memcpy (data, &((GstRTSPSocketMark *) message)->value, sizeof (gint));
+}
+
+/* GIO tries all the control message types on received messages, the marks
+ * are only sent */
+static GSocketControlMessage *
+socket_mark_deserialize (int level, int type, gsize size, gpointer data)
+{
+  return NULL;
+}
+
+static void
+gst_rtsp_socket_mark_class_init (GstRTSPSocketMarkClass * klass)
+{
+  klass->get_size = socket_mark_get_size;
+  klass->get_level = socket_mark_get_level;
+  klass->get_type = socket_mark_get_msg_type;
+  klass->serialize = socket_mark_serialize;
+  klass->deserialize = socket_mark_deserialize;
+}
+
+static void
+gst_rtsp_socket_mark_init (GstRTSPSocketMark * mark)
+{
+}
+
+static GSocketControlMessage *
+socket_mark_new (gint level, gint type, gint value)
+{
+  GstRTSPSocketMark *mark;
+
+  mark = g_object_new (gst_rtsp_socket_mark_get_type (), NULL);
+  mark->level = level;
+  mark->type = type;
+  mark->value = value;
+
+  return G_SOCKET_CONTROL_MESSAGE (mark);
+}
+#endif
+
+/* the frames of audio streams are marked as audio by the clients */
+static GstRTSPPacketClass
+rtp_packet_class (GstBuffer * buffer)
+{
+  if (GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT))
+    return GST_RTSP_PACKET_CLASS_DELTA_FRAME;
+  else
+    return GST_RTSP_PACKET_CLASS_KEY_FRAME;
+}
+
+/* send the memories of @buffer as one datagram without merging them */
+static gboolean
+send_buffer_to (GSocket * socket, GSocketAddress * addr, GstBuffer * buffer,
+    GSocketControlMessage ** messages, gint n_messages, GError ** error)
+{
+  GOutputVector vec[MAX_SEND_VECTORS];
+  GstMapInfo map[MAX_SEND_VECTORS];
+  guint i, n_mem;
+  gssize res = -1;
+
+  n_mem = gst_buffer_n_memory (buffer);
+  if (n_mem > MAX_SEND_VECTORS) {
+    gst_buffer_map (buffer, &map[0], GST_MAP_READ);
+    vec[0].buffer = map[0].data;
+    vec[0].size = map[0].size;
+    res = g_socket_send_message (socket, addr, vec, 1, messages, n_messages,
+        0, NULL, error);
+    gst_buffer_unmap (buffer, &map[0]);
+    return res >= 0;
+  }
+
+  for (i = 0; i < n_mem; i++) {
+    GstMemory *mem = gst_buffer_peek_memory (buffer, i);
+
+    if (!gst_memory_map (mem, &map[i], GST_MAP_READ))
+      break;
+    vec[i].buffer = map[i].data;
+    vec[i].size = map[i].size;
+  }
+  if (i == n_mem)
+    res = g_socket_send_message (socket, addr, vec, n_mem, messages,
+        n_messages, 0, NULL, error);
+
+  while (i-- > 0)
+    gst_memory_unmap (gst_buffer_peek_memory (buffer, i), &map[i]);
+
+  return res >= 0;
+}
+
+/* must be called with lock */
+static gboolean
+stream_has_media (GstRTSPStream * stream, const gchar * media)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+
+  if (priv->caps == NULL)
+    return FALSE;
+
+  return g_strcmp0 (gst_structure_get_string (gst_caps_get_structure
+          (priv->caps, 0), "media"), media) == 0;
+}
+
+static GstPadProbeReturn
+qos_key_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstRTSPStream *stream = user_data;
+
+  g_atomic_int_set (&stream->priv->qos_key_unit, probe_is_key_unit (info));
+
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+qos_flag_func (GstBuffer ** buffer, guint idx, gpointer user_data)
+{
+  gboolean key_unit = GPOINTER_TO_INT (user_data);
+
+  if (key_unit == !GST_BUFFER_FLAG_IS_SET (*buffer,
+          GST_BUFFER_FLAG_DELTA_UNIT))
+    return TRUE;
+
+  *buffer = gst_buffer_make_writable (*buffer);
+  if (key_unit)
+    GST_BUFFER_FLAG_UNSET (*buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  else
+    GST_BUFFER_FLAG_SET (*buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  return TRUE;
+}
+
+/* the payloader does not flag the RTP packets, we give them the flags of
+ * the frame they are made from */
+static GstPadProbeReturn
+qos_flag_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstRTSPStream *stream = user_data;
+  gpointer key_unit;
+
+  key_unit = GINT_TO_POINTER (g_atomic_int_get (&stream->priv->qos_key_unit));
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+
+    list = gst_buffer_list_make_writable (list);
+    gst_buffer_list_foreach (list, qos_flag_func, key_unit);
+    info->data = list;
+  } else {
+    GstBuffer *buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+
+    qos_flag_func (&buffer, 0, key_unit);
+    info->data = buffer;
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+/* must be called with lock */
+static void
+qos_flags_start (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GstPad *paysink;
+
+  if (priv->qos_flag_id != 0)
+    return;
+
+  paysink = gst_element_get_static_pad (priv->payloader, "sink");
+  if (paysink == NULL)
+    goto no_sinkpad;
+
+  priv->qos_key_unit = TRUE;
+  priv->qos_key_id = gst_pad_add_probe (paysink,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      qos_key_probe, stream, NULL);
+  priv->qos_flag_id = gst_pad_add_probe (priv->srcpad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      qos_flag_probe, stream, NULL);
+  gst_object_unref (paysink);
+
+  return;
+
+  /* ERRORS */
+no_sinkpad:
+  {
+    GST_WARNING ("payloader of stream %p has no sinkpad, all packets are "
+        "marked as key frames", stream);
+    return;
+  }
+}
+
+/* must be called with lock */
+static void
+qos_flags_stop (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GstPad *paysink;
+
+  if (priv->qos_flag_id == 0)
+    return;
+
+  paysink = gst_element_get_static_pad (priv->payloader, "sink");
+  gst_pad_remove_probe (paysink, priv->qos_key_id);
+  gst_object_unref (paysink);
+  gst_pad_remove_probe (priv->srcpad, priv->qos_flag_id);
+  priv->qos_key_id = 0;
+  priv->qos_flag_id = 0;
+}
+
+/* check that one of @clients marks its RTP packets */
+static gboolean
+udp_clients_marked (GHashTable * clients)
+{
+  GHashTableIter iter;
+  UdpClient *client;
+  guint i;
+
+  g_hash_table_iter_init (&iter, clients);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & client)) {
+    for (i = 0; i < GST_RTSP_PACKET_CLASS_RTCP; i++) {
+      if (client->dscp[i] || client->priority[i])
+        return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/* must be called with lock. The packets are only flagged while a client
+ * marks them */
+static void
+qos_flags_update (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  gboolean marked;
+
+  if (priv->qos_flag_id == 0)
+    return;
+
+  g_mutex_lock (&priv->pace_lock);
+  marked = udp_clients_marked (priv->direct_clients) ||
+      udp_clients_marked (priv->paced_clients);
+  g_mutex_unlock (&priv->pace_lock);
+
+  if (!marked)
+    qos_flags_stop (stream);
+}
+
+static gboolean
+udp_client_clear_marks (GSocketControlMessage ** marks)
+{
+  gboolean res = FALSE;
+  guint i;
+
+  for (i = 0; i < N_PACKET_CLASSES; i++) {
+    if (marks[i]) {
+      g_object_unref (marks[i]);
+      marks[i] = NULL;
+      res = TRUE;
+    }
+  }
+  return res;
+}
+
+static void
+udp_client_free (UdpClient * client)
+{
+  udp_client_clear_marks (client->dscp);
+  udp_client_clear_marks (client->priority);
+  g_object_unref (client->socket);
+  g_object_unref (client->addr);
+  g_slice_free (UdpClient, client);
+}
+
+/* must be called with lock. Mark the packets of @client with the QoS policy
+ * of @trans, only the RTCP packets for the RTCP socket */
+static void
+udp_client_set_marks (GstRTSPStream * stream, UdpClient * client,
+    GstRTSPStreamTransport * trans, guint idx)
+{
+  gboolean audio, marked = FALSE;
+#ifndef G_OS_WIN32
+  gint level = -1, type = -1;
+  guint i;
+#endif
+
+  audio = stream_has_media (stream, "audio");
+
+#ifndef G_OS_WIN32
+  if (g_socket_address_get_family (client->addr) == G_SOCKET_FAMILY_IPV6) {
+#ifdef IPV6_TCLASS
+    level = IPPROTO_IPV6;
+    type = IPV6_TCLASS;
+#endif
+  } else {
+    level = IPPROTO_IP;
+    type = IP_TOS;
+  }
+
+  for (i = 0; i < N_PACKET_CLASSES; i++) {
+    GstRTSPPacketClass klass = i;
+    gint dscp, priority;
+
+    if ((idx == 1) != (klass == GST_RTSP_PACKET_CLASS_RTCP))
+      continue;
+    if (audio && klass != GST_RTSP_PACKET_CLASS_RTCP)
+      klass = GST_RTSP_PACKET_CLASS_AUDIO;
+
+    gst_rtsp_stream_transport_get_qos_marking (trans, klass, &dscp,
+        &priority);
+    /* the DSCP is in the upper 6 bits of the traffic class */
+    if (dscp != -1 && level != -1) {
+      client->dscp[i] = socket_mark_new (level, type, dscp << 2);
+      marked = TRUE;
+    }
+#ifdef SO_PRIORITY
+    if (priority != -1) {
+      client->priority[i] = socket_mark_new (SOL_SOCKET, SO_PRIORITY,
+          priority);
+      marked = TRUE;
+    }
+#endif
+  }
+#endif
+
+  /* we need to know the packets of the key frames */
+  if (marked && idx == 0 && !audio)
+    qos_flags_start (stream);
+}
+
+/* must be called with lock */
+static UdpClient *
+udp_client_new (GstRTSPStream * stream, GstRTSPStreamTransport * trans,
+    guint idx)
+{
+  UdpClient *client;
+  GSocket *socket;
+  GSocketAddress *addr;
+
+  if (!get_udp_destination (stream,
+          gst_rtsp_stream_transport_get_transport (trans), idx, &socket,
+          &addr))
+    return NULL;
+
+  client = g_slice_new0 (UdpClient);
+  client->socket = socket;
+  client->addr = addr;
+  udp_client_set_marks (stream, client, trans, idx);
+
+  return client;
+}
+
+/* must be called with the lock that protects @client. When the kernel does
+ * not take the marks, we leave out the priorities and then the DSCP */
+static void
+udp_client_send (UdpClient * client, GstBuffer * buffer,
+    GstRTSPPacketClass klass)
+{
+  GSocketControlMessage *messages[2];
+  GError *error = NULL;
+  gint n_messages;
+
+  while (TRUE) {
+    n_messages = 0;
+    if (client->dscp[klass])
+      messages[n_messages++] = client->dscp[klass];
+    if (client->priority[klass])
+      messages[n_messages++] = client->priority[klass];
+
+    if (send_buffer_to (client->socket, client->addr, buffer, messages,
+            n_messages, &error))
+      break;
+
+    if (n_messages == 0 ||
+        !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT))
+      goto send_failed;
+    if (!udp_client_clear_marks (client->priority) &&
+        !udp_client_clear_marks (client->dscp))
+      goto send_failed;
+
+    GST_WARNING ("packets can't be marked: %s", error->message);
+    g_clear_error (&error);
+  }
+  return;
+
+  /* ERRORS */
+send_failed:
+  {
+    if (error) {
+      GST_LOG ("failed to send packet: %s", error->message);
+      g_error_free (error);
+    }
+    return;
+  }
+}
+
+/* must be called with lock. Check that the transport needs its RTP packets
+ * sent by us */
+static gboolean
+rtp_is_marked (GstRTSPStreamTransport * trans)
+{
+  return gst_rtsp_stream_transport_get_qos_marking (trans,
+      GST_RTSP_PACKET_CLASS_KEY_FRAME, NULL, NULL) ||
+      gst_rtsp_stream_transport_get_qos_marking (trans,
+      GST_RTSP_PACKET_CLASS_DELTA_FRAME, NULL, NULL) ||
+      gst_rtsp_stream_transport_get_qos_marking (trans,
+      GST_RTSP_PACKET_CLASS_AUDIO, NULL, NULL);
+}
+
+/* must be called with lock. UDP transports with a rewritten RTP header or
+ * marked packets are sent from the appsink instead of the udpsink */
+static gboolean
+direct_client_add (GstRTSPStream * stream, GstRTSPStreamTransport * trans)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  UdpClient *client;
+
+  if (!gst_rtsp_stream_transport_get_rtp_rewrite (trans, NULL, NULL, NULL) &&
+      !rtp_is_marked (trans))
+    return FALSE;
+
+  if (priv->appsink[0] == NULL)
+    goto no_appsink;
+
+  if (!(client = udp_client_new (stream, trans, 0)))
+    return FALSE;
+  g_hash_table_insert (priv->direct_clients, trans, client);
+
+  return TRUE;
+
+  /* ERRORS */
+no_appsink:
+  {
+    GST_WARNING ("stream %p has no TCP branch, RTP of transport %p is not "
+        "rewritten or marked", stream, trans);
+    return FALSE;
+  }
+}
+
+/* must be called with lock */
+static gboolean
+direct_client_send (GstRTSPStream * stream, GstRTSPStreamTransport * trans,
+    GstBuffer * buffer)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  UdpClient *client;
+
+  client = g_hash_table_lookup (priv->direct_clients, trans);
+  if (client == NULL)
+    return FALSE;
+
+  buffer = gst_rtsp_stream_transport_rewrite_rtp (trans, buffer);
+  udp_client_send (client, buffer, rtp_packet_class (buffer));
+  gst_buffer_unref (buffer);
+
+  return TRUE;
+}
+
+/* must be called with lock. The RTCP of UDP transports with a rewritten RTP
+ * header or marked RTCP packets is sent from the appsink instead of the
+ * udpsink */
+static gboolean
+rtcp_client_add (GstRTSPStream * stream, GstRTSPStreamTransport * trans)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  UdpClient *client;
+
+  if (!gst_rtsp_stream_transport_get_rtp_rewrite (trans, NULL, NULL, NULL) &&
+      !gst_rtsp_stream_transport_get_qos_marking (trans,
+          GST_RTSP_PACKET_CLASS_RTCP, NULL, NULL))
+    return FALSE;
+
+  if (priv->appsink[1] == NULL)
+    goto no_appsink;
+
+  if (!(client = udp_client_new (stream, trans, 1)))
+    return FALSE;
+  g_hash_table_insert (priv->rtcp_clients, trans, client);
+
+  return TRUE;
+
+  /* ERRORS */
+no_appsink:
+  {
+    GST_WARNING ("stream %p has no TCP branch, RTCP of transport %p is not "
+        "rewritten or marked", stream, trans);
+    return FALSE;
+  }
+}
+
+/* must be called with lock */
+static gboolean
+rtcp_client_send (GstRTSPStream * stream, GstRTSPStreamTransport * trans,
+    GstBuffer * buffer)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  UdpClient *client;
+
+  client = g_hash_table_lookup (priv->rtcp_clients, trans);
+  if (client == NULL)
+    return FALSE;
+
+  buffer = gst_rtsp_stream_transport_rewrite_rtcp (trans, buffer);
+  udp_client_send (client, buffer, GST_RTSP_PACKET_CLASS_RTCP);
+  gst_buffer_unref (buffer);
+
+  return TRUE;
+}
+
+static void
+paced_packet_free (PacedPacket * packet)
+{
+  gst_buffer_unref (packet->buffer);
+  g_slice_free (PacedPacket, packet);
+}
+
+/* called with pace_lock. Spread the packets of the current frame over the
+ * frame interval, after the packets of the previous frame */
+static void
+pace_schedule_frame (GstRTSPStream * stream, gint64 now)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  PacedPacket *packet;
+  gint64 start, spacing;
+  guint i, n_packets;
+
+  n_packets = priv->pace_frame.length;
+  if (n_packets == 0)
+    return;
+
+  /* never fall more than a frame behind when the interval is too long */
+  start = CLAMP (priv->pace_next, now, now + priv->pace_interval);
+  spacing = priv->pace_interval / n_packets;
+
+  for (i = 0; (packet = g_queue_pop_head (&priv->pace_frame)); i++) {
+    packet->send_time = start + i * spacing;
+    g_queue_push_tail (&priv->pace_queue, packet);
+  }
+  priv->pace_next = start + priv->pace_interval;
+
+  g_cond_signal (&priv->pace_cond);
+}
+
+static gint
+paced_packet_compare (PacedPacket * a, PacedPacket * b, gpointer user_data)
+{
+  return a->send_time < b->send_time ? -1 : a->send_time > b->send_time;
+}
+
+/* called with pace_lock from the streaming thread. A frame ends with the
+ * marker bit or when the RTP timestamp changes */
+static void
+pace_packet (GstRTSPStream * stream, GstBuffer * buffer, gint64 now)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  PacedPacket *packet;
+  guint8 header[12];
+  guint32 rtptime;
+  gboolean marker;
+
+  if (gst_buffer_extract (buffer, 0, header, 12) != 12)
+    return;
+
+  packet = g_slice_new (PacedPacket);
+  packet->buffer = gst_buffer_ref (buffer);
+  packet->arrival = now;
+
+  /* retransmissions and FEC have their own payload type and timestamps, they
+   * are not part of the frames and are sent before the packets that are not
+   * due yet */
+  if (priv->pace_pt >= 0 && (header[1] & 0x7f) != priv->pace_pt) {
+    packet->send_time = now;
+    g_queue_insert_sorted (&priv->pace_queue, packet,
+        (GCompareDataFunc) paced_packet_compare, NULL);
+    g_cond_signal (&priv->pace_cond);
+    return;
+  }
+
+  marker = (header[1] & 0x80) != 0;
+  rtptime = GST_READ_UINT32_BE (header + 4);
+
+  if (priv->have_pace_rtptime && rtptime != priv->pace_rtptime) {
+    guint32 diff = rtptime - priv->pace_rtptime;
+
+    pace_schedule_frame (stream, now);
+
+    /* the frame interval follows the RTP timestamps */
+    if (priv->pace_clock_rate > 0 && diff < priv->pace_clock_rate)
+      priv->pace_interval = CLAMP (gst_util_uint64_scale_int (diff,
+              G_USEC_PER_SEC, priv->pace_clock_rate), MIN_PACE_INTERVAL,
+          MAX_PACE_INTERVAL);
+  }
+  priv->pace_rtptime = rtptime;
+  priv->have_pace_rtptime = TRUE;
+
+  g_queue_push_tail (&priv->pace_frame, packet);
+
+  if (marker)
+    pace_schedule_frame (stream, now);
+}
+
+static gboolean
+pace_list_func (GstBuffer ** buffer, guint idx, GstRTSPStream * stream)
+{
+  pace_packet (stream, *buffer, g_get_monotonic_time ());
+
+  return TRUE;
+}
+
+static GstPadProbeReturn
+pace_probe (GstPad * pad, GstPadProbeInfo * info, GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+
+  g_mutex_lock (&priv->pace_lock);
+  if (priv->pace_stop || g_hash_table_size (priv->paced_clients) == 0)
+    goto done;
+
+  if (priv->pace_clock_rate == 0) {
+    GstCaps *caps = gst_pad_get_current_caps (pad);
+    gint clock_rate = 0, pt = -1;
+
+    if (caps) {
+      GstStructure *s = gst_caps_get_structure (caps, 0);
+
+      gst_structure_get_int (s, "clock-rate", &clock_rate);
+      gst_structure_get_int (s, "payload", &pt);
+      gst_caps_unref (caps);
+    }
+    priv->pace_clock_rate = MAX (clock_rate, 0);
+    priv->pace_pt = pt;
+  }
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER)
+    pace_packet (stream, GST_PAD_PROBE_INFO_BUFFER (info),
+        g_get_monotonic_time ());
+  else if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST)
+    gst_buffer_list_foreach (GST_PAD_PROBE_INFO_BUFFER_LIST (info),
+        (GstBufferListFunc) pace_list_func, stream);
+
+done:
+  g_mutex_unlock (&priv->pace_lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* sends the packets to the paced transports when they are due */
+static gpointer
+pace_thread (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+
+  g_mutex_lock (&priv->pace_lock);
+  while (!priv->pace_stop) {
+    PacedPacket *packet;
+    GHashTableIter iter;
+    GstRTSPStreamTransport *trans;
+    UdpClient *client;
+    gint64 now, delay;
+
+    packet = g_queue_peek_head (&priv->pace_queue);
+    if (packet == NULL) {
+      g_cond_wait (&priv->pace_cond, &priv->pace_lock);
+      continue;
+    }
+    now = g_get_monotonic_time ();
+    if (packet->send_time > now) {
+      g_cond_wait_until (&priv->pace_cond, &priv->pace_lock,
+          packet->send_time);
+      continue;
+    }
+    g_queue_pop_head (&priv->pace_queue);
+
+    g_hash_table_iter_init (&iter, priv->paced_clients);
+    while (g_hash_table_iter_next (&iter, (gpointer *) & trans,
+            (gpointer *) & client)) {
+      GstBuffer *buffer;
+
+      buffer = gst_rtsp_stream_transport_rewrite_rtp (trans, packet->buffer);
+      udp_client_send (client, buffer, rtp_packet_class (buffer));
+      gst_buffer_unref (buffer);
+    }
+
+    delay = now - packet->arrival;
+    priv->paced_packets++;
+    priv->pace_delay_sum += delay;
+    priv->pace_delay_max = MAX (priv->pace_delay_max, delay);
+
+    paced_packet_free (packet);
+  }
+  g_mutex_unlock (&priv->pace_lock);
+
+  return NULL;
+}
+
+/* must be called with lock */
+static void
+pacing_start (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GError *error = NULL;
+
+  priv->pace_stop = FALSE;
+  priv->pace_interval = DEFAULT_PACE_INTERVAL;
+  priv->pace_next = 0;
+  priv->pace_clock_rate = 0;
+  priv->pace_pt = -1;
+  priv->have_pace_rtptime = FALSE;
+  priv->paced_packets = 0;
+  priv->pace_delay_sum = 0;
+  priv->pace_delay_max = 0;
+
+  priv->pace_thread = g_thread_try_new ("rtsp-pacer",
+      (GThreadFunc) pace_thread, stream, &error);
+  if (priv->pace_thread == NULL)
+    goto thread_error;
+
+  priv->pace_probe_id = gst_pad_add_probe (priv->send_src[0],
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      (GstPadProbeCallback) pace_probe, stream, NULL);
+
+  return;
+
+  /* ERRORS */
+thread_error:
+  {
+    GST_ERROR ("stream %p failed to start pacer thread: %s", stream,
+        error->message);
+    g_error_free (error);
+    return;
+  }
+}
+
+/* must be called with lock */
+static void
+pacing_stop (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+
+  if (priv->pace_thread == NULL)
+    return;
+
+  gst_pad_remove_probe (priv->send_src[0], priv->pace_probe_id);
+  priv->pace_probe_id = 0;
+
+  g_mutex_lock (&priv->pace_lock);
+  priv->pace_stop = TRUE;
+  g_cond_signal (&priv->pace_cond);
+  g_mutex_unlock (&priv->pace_lock);
+
+  /* the pacer thread never takes the stream lock */
+  g_thread_join (priv->pace_thread);
+  priv->pace_thread = NULL;
+
+  /* a streaming thread can still be in the probe */
+  g_mutex_lock (&priv->pace_lock);
+  g_queue_foreach (&priv->pace_frame, (GFunc) paced_packet_free, NULL);
+  g_queue_clear (&priv->pace_frame);
+  g_queue_foreach (&priv->pace_queue, (GFunc) paced_packet_free, NULL);
+  g_queue_clear (&priv->pace_queue);
+  g_mutex_unlock (&priv->pace_lock);
+}
+
+/* must be called with lock. Only video is paced, the packets of other
+ * streams don't come in bursts */
+static gboolean
+paced_client_add (GstRTSPStream * stream, GstRTSPStreamTransport * trans)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  UdpClient *client;
+
+  if (priv->pace_thread == NULL || !stream_has_media (stream, "video"))
+    return FALSE;
+
+  /* the policy can let the packets through without delay */
+  if (!gst_rtsp_stream_transport_get_qos_pacing (trans))
+    return FALSE;
+
+  if (!(client = udp_client_new (stream, trans, 0)))
+    return FALSE;
+
+  g_mutex_lock (&priv->pace_lock);
+  g_hash_table_insert (priv->paced_clients, trans, client);
+  g_mutex_unlock (&priv->pace_lock);
+
+  return TRUE;
+}
+
+/* must be called with lock */
+static gboolean
+paced_client_remove (GstRTSPStream * stream, GstRTSPStreamTransport * trans)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  gboolean res;
+
+  g_mutex_lock (&priv->pace_lock);
+  res = g_hash_table_remove (priv->paced_clients, trans);
+  g_mutex_unlock (&priv->pace_lock);
+
+  return res;
+}
+
+static GstFlowReturn
+handle_new_sample (GstAppSink * sink, gpointer user_data)
+{
+  GstRTSPStreamPrivate *priv;
+  GList *walk;
+  GstSample *sample;
+  GstBuffer *buffer;
+  GstRTSPStream *stream;
+
+  sample = gst_app_sink_pull_sample (sink);
+  if (!sample)
+    return GST_FLOW_OK;
+
+  stream = (GstRTSPStream *) user_data;
+  priv = stream->priv;
+  buffer = gst_sample_get_buffer (sample);
+
+  g_mutex_lock (&priv->lock);
+  for (walk = priv->transports; walk; walk = g_list_next (walk)) {
+    GstRTSPStreamTransport *tr = (GstRTSPStreamTransport *) walk->data;
+
+    if (GST_ELEMENT_CAST (sink) == priv->appsink[0]) {
+      /* layered transports get their RTP packets from the layers */
+      if (priv->layer_clients && g_hash_table_contains (priv->layer_clients,
+              tr))
+        continue;
+      if (!direct_client_send (stream, tr, buffer))
+        gst_rtsp_stream_transport_send_rtp (tr, buffer);
+    } else if (!rtcp_client_send (stream, tr, buffer)) {
+      gst_rtsp_stream_transport_send_rtcp (tr, buffer);
+    }
+  }
+  g_mutex_unlock (&priv->lock);
+
+  gst_sample_unref (sample);
+
+  return GST_FLOW_OK;
+}
+
+static GstAppSinkCallbacks sink_cb = {
+  NULL,                         /* not interested in EOS */
+  NULL,                         /* not interested in preroll samples */
+  handle_new_sample,
+};
+
+/* must be called with lock. Place a rtprtxsend between the payloader and
+ * rtpbin, it keeps the history of sent packets and answers the retransmission
+ * requests that the session makes from the NACKs of the clients */
+static void
+rtx_join (GstRTSPStream * stream, GstBin * bin, GstState state)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GObjectClass *klass;
+  guint pt;
+
+  priv->rtxsend = gst_element_factory_make ("rtprtxsend", NULL);
+  if (priv->rtxsend == NULL)
+    goto no_rtxsend;
+
+  klass = G_OBJECT_GET_CLASS (priv->rtxsend);
+  g_object_get (priv->payloader, "pt", &pt, NULL);
+
+  /* older versions take one payload type, newer ones a map */
+  if (g_object_class_find_property (klass, "payload-type-map")) {
+    GstStructure *pt_map;
+    gchar *name;
+
+    name = g_strdup_printf ("%u", pt);
+    pt_map = gst_structure_new ("application/x-rtp-pt-map",
+        name, G_TYPE_UINT, priv->rtx_pt, NULL);
+    g_object_set (priv->rtxsend, "payload-type-map", pt_map, NULL);
+    gst_structure_free (pt_map);
+    g_free (name);
+  } else {
+    g_object_set (priv->rtxsend, "rtx-payload-type", priv->rtx_pt, NULL);
+  }
+  /* the history is bounded by the retransmission time */
+  g_object_set (priv->rtxsend, "max-size-time",
+      (guint) (priv->rtx_time / GST_MSECOND), NULL);
+
+  gst_bin_add (bin, priv->rtxsend);
+  if (state != GST_STATE_NULL)
+    gst_element_set_state (priv->rtxsend, state);
+
+  GST_INFO ("stream %p retransmits pt %u as pt %u for %" GST_TIME_FORMAT,
+      stream, pt, priv->rtx_pt, GST_TIME_ARGS (priv->rtx_time));
+  return;
+
+  /* ERRORS */
+no_rtxsend:
+  {
+    GST_WARNING ("no rtprtxsend element, stream %p can't retransmit", stream);
+    priv->rtx_time = 0;
+    return;
+  }
+}
+
+static GstPadProbeReturn
+fec_count_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstRTSPStream *stream = user_data;
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GstBufferList *list = NULL;
+  GstBuffer *buffer;
+  guint i, len = 1, n_fec = 0, n_media = 0;
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    len = gst_buffer_list_length (list);
+  }
+
+  for (i = 0; i < len; i++) {
+    GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+    buffer = list ? gst_buffer_list_get (list, i) :
+        GST_PAD_PROBE_INFO_BUFFER (info);
+    if (!gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp))
+      continue;
+    if (gst_rtp_buffer_get_payload_type (&rtp) == priv->fec_probe_pt)
+      n_fec++;
+    else
+      n_media++;
+    gst_rtp_buffer_unmap (&rtp);
+  }
+
+  g_mutex_lock (&priv->fec_lock);
+  priv->fec_packets += n_fec;
+  priv->media_packets += n_media;
+  g_mutex_unlock (&priv->fec_lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* must be called with lock. Place a rtpulpfecenc after the payloader, it adds
+ * FEC packets with their own payload type to the stream */
+static void
+fec_join (GstRTSPStream * stream, GstBin * bin, GstState state)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GstPad *pad;
+
+  priv->fecenc = gst_element_factory_make ("rtpulpfecenc", NULL);
+  if (priv->fecenc == NULL)
+    goto no_fecenc;
+
+  g_object_set (priv->fecenc, "pt", priv->fec_pt, "percentage",
+      priv->fec_percentage, NULL);
+
+  priv->fec_probe_pt = priv->fec_pt;
+  g_mutex_lock (&priv->fec_lock);
+  priv->fec_packets = 0;
+  priv->media_packets = 0;
+  g_mutex_unlock (&priv->fec_lock);
+  pad = gst_element_get_static_pad (priv->fecenc, "src");
+  priv->fec_probe_id = gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      fec_count_probe, stream, NULL);
+  gst_object_unref (pad);
+
+  gst_bin_add (bin, priv->fecenc);
+  if (state != GST_STATE_NULL)
+    gst_element_set_state (priv->fecenc, state);
+
+  GST_INFO ("stream %p sends %u%% FEC with pt %u", stream,
+      priv->fec_percentage, priv->fec_pt);
+  return;
+
+  /* ERRORS */
+no_fecenc:
+  {
+    GST_WARNING ("no rtpulpfecenc element, stream %p can't send FEC", stream);
+    priv->fec_percentage = 0;
+    return;
+  }
+}
+
+/* must be called with lock. Link the payloader through the FEC encoder and
+ * the retransmission element to the session manager */
+static GstPadLinkReturn
+link_send_rtp (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GstElement *stages[2];
+  GstPadLinkReturn ret;
+  GstPad *pad, *sinkpad;
+  guint i;
+
+  stages[0] = priv->fecenc;
+  stages[1] = priv->rtxsend;
+
+  pad = gst_object_ref (priv->srcpad);
+  for (i = 0; i < G_N_ELEMENTS (stages); i++) {
+    if (stages[i] == NULL)
+      continue;
+
+    sinkpad = gst_element_get_static_pad (stages[i], "sink");
+    ret = gst_pad_link (pad, sinkpad);
+    gst_object_unref (sinkpad);
+    gst_object_unref (pad);
+    if (ret != GST_PAD_LINK_OK)
+      return ret;
+
+    pad = gst_element_get_static_pad (stages[i], "src");
+  }
+  ret = gst_pad_link (pad, priv->send_rtp_sink);
+  gst_object_unref (pad);
+
+  return ret;
+}
+
+/* must be called with lock */
+static void
+remove_send_stages (GstRTSPStream * stream, GstBin * bin)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+
+  if (priv->fecenc) {
+    gst_element_set_state (priv->fecenc, GST_STATE_NULL);
+    gst_bin_remove (bin, priv->fecenc);
+    priv->fecenc = NULL;
+    priv->fec_probe_id = 0;
+  }
+  if (priv->rtxsend) {
+    gst_element_set_state (priv->rtxsend, GST_STATE_NULL);
+    gst_bin_remove (bin, priv->rtxsend);
+    priv->rtxsend = NULL;
+  }
+}
+
+/* called from the receive thread of the socket pool in mux mode */
+static void
+mux_receive (GObject * object, GstBuffer * buffer, gboolean rtcp)
+{
+  GstRTSPStream *stream = GST_RTSP_STREAM (object);
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GstElement *appsrc = NULL;
+
+  /* packets can still arrive while the routes are being removed */
+  g_mutex_lock (&priv->lock);
+  if (priv->is_joined && priv->appsrc[rtcp ? 1 : 0])
+    appsrc = gst_object_ref (priv->appsrc[rtcp ? 1 : 0]);
+  g_mutex_unlock (&priv->lock);
+
+  if (appsrc) {
+    gst_app_src_push_buffer (GST_APP_SRC_CAST (appsrc), buffer);
+    gst_object_unref (appsrc);
+  } else {
+    gst_buffer_unref (buffer);
+  }
+}
+
+/* must be called with lock. Route the RTCP of clients that changed their
+ * address by the SSRC that we send with. That is the SSRC in the caps of the
+ * payloader or, before it negotiated, its configured "ssrc". */
+static void
+mux_update_ssrc (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  gboolean have_ssrc = FALSE;
+  guint ssrc = 0;
+
+  if (priv->mux_pool == NULL)
+    return;
+
+  if (priv->caps) {
+    GstStructure *s = gst_caps_get_structure (priv->caps, 0);
+
+    have_ssrc = gst_structure_get_uint (s, "ssrc", &ssrc);
+  }
+  if (!have_ssrc && g_object_class_find_property (G_OBJECT_GET_CLASS
+          (priv->payloader), "ssrc")) {
+    g_object_get (priv->payloader, "ssrc", &ssrc, NULL);
+    /* -1 picks a random SSRC, we know it when the caps are set */
+    have_ssrc = ssrc != G_MAXUINT;
+  }
+
+  if (!have_ssrc || (priv->have_mux_ssrc && ssrc == priv->mux_ssrc))
+    return;
+
+  if (priv->have_mux_ssrc)
+    gst_rtsp_socket_pool_remove_mux_ssrc (priv->mux_pool, priv->mux_ssrc);
+
+  GST_INFO ("stream %p routes the RTCP about SSRC %08x", stream, ssrc);
+
+  priv->mux_ssrc = ssrc;
+  priv->have_mux_ssrc = TRUE;
+  gst_rtsp_socket_pool_add_mux_ssrc (priv->mux_pool, ssrc, mux_receive,
+      G_OBJECT (stream));
+}
+
+/**
+ * gst_rtsp_stream_join_bin:
+ * @stream: a #GstRTSPStream
+ * @bin: a #GstBin to join
+ * @rtpbin: a rtpbin element in @bin
+ * @state: the target state of the new elements
+ *
+ * Join the #GstBin @bin that contains the element @rtpbin.
+ *
+ * @stream will link to @rtpbin, which must be inside @bin. The elements
+ * added to @bin will be set to the state given in @state.
+ *
+ * Returns: %TRUE on success.
+ */
+gboolean
+gst_rtsp_stream_join_bin (GstRTSPStream * stream, GstBin * bin,
+    GstElement * rtpbin, GstState state)
+{
+  GstRTSPStreamPrivate *priv;
+  gint i;
+  guint idx;
+  gchar *name;
+  GstPad *pad, *sinkpad, *selpad;
+  GstPadLinkReturn ret;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
+  g_return_val_if_fail (GST_IS_BIN (bin), FALSE);
+  g_return_val_if_fail (GST_IS_ELEMENT (rtpbin), FALSE);
+
+  priv = stream->priv;
+
+  g_mutex_lock (&priv->lock);
+  if (priv->is_joined)
+    goto was_joined;
+
+  /* create a session with the same index as the stream */
+  idx = priv->idx;
+
+  GST_INFO ("stream %p joining bin as session %u", stream, idx);
+
+  if (!alloc_ports (stream))
+    goto no_ports;
+
+  /* update the dscp qos field in the sinks */
+  update_dscp_qos (stream);
+
+  /* get a pad for sending RTP */
+  name = g_strdup_printf ("send_rtp_sink_%u", idx);
+  priv->send_rtp_sink = gst_element_get_request_pad (rtpbin, name);
+  g_free (name);
+  if (priv->fec_percentage > 0 && priv->fec_pt != 0)
+    fec_join (stream, bin, state);
+  if (priv->rtx_time > 0 && priv->rtx_pt != 0)
+    rtx_join (stream, bin, state);
+
+  /* link the RTP pad to the session manager, it should not really fail unless
+   * this is not really an RTP pad */
+  ret = link_send_rtp (stream);
+  if (ret != GST_PAD_LINK_OK)
+    goto link_failed;
+
+  if (priv->gop_cache) {
+    GstPad *paysink;
+
+    paysink = gst_element_get_static_pad (priv->payloader, "sink");
+    if (paysink) {
+      /* start caching at the next key unit */
+      priv->gop_valid = FALSE;
+      priv->gop_key_id = gst_pad_add_probe (paysink,
+          GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+          gop_key_probe, stream, NULL);
+      priv->gop_cache_id = gst_pad_add_probe (priv->srcpad,
+          GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+          gop_cache_probe, stream, NULL);
+      gst_object_unref (paysink);
+    } else {
+      GST_WARNING ("payloader of stream %u has no sinkpad, no GOP cache", idx);
+    }
+  }
+
+  if (priv->layers)
+    layers_join (stream, bin, state);
+
+  if (priv->adaptive_bitrate)
+    rate_control_join (stream);
+
+  /* get pads from the RTP session element for sending and receiving
+   * RTP/RTCP*/
+  name = g_strdup_printf ("send_rtp_src_%u", idx);
+  priv->send_src[0] = gst_element_get_static_pad (rtpbin, name);
+  g_free (name);
+  if (priv->pacing)
+    pacing_start (stream);
+  name = g_strdup_printf ("send_rtcp_src_%u", idx);
+  priv->send_src[1] = gst_element_get_request_pad (rtpbin, name);
+  g_free (name);
+  name = g_strdup_printf ("recv_rtp_sink_%u", idx);
+  priv->recv_sink[0] = gst_element_get_request_pad (rtpbin, name);
+  g_free (name);
+  name = g_strdup_printf ("recv_rtcp_sink_%u", idx);
+  priv->recv_sink[1] = gst_element_get_request_pad (rtpbin, name);
+  g_free (name);
+
+  /* get the session */
+  g_signal_emit_by_name (rtpbin, "get-internal-session", idx, &priv->session);
+  GST_DEBUG("zzoon unref internal session");
+  g_object_unref(priv->session);
+
+  g_signal_connect (priv->session, "on-new-ssrc", (GCallback) on_new_ssrc,
+      stream);
+  g_signal_connect (priv->session, "on-ssrc-sdes", (GCallback) on_ssrc_sdes,
+      stream);
+  g_signal_connect (priv->session, "on-ssrc-active",
+      (GCallback) on_ssrc_active, stream);
+  g_signal_connect (priv->session, "on-bye-ssrc", (GCallback) on_bye_ssrc,
+      stream);
+  g_signal_connect (priv->session, "on-bye-timeout",
+      (GCallback) on_bye_timeout, stream);
+  g_signal_connect (priv->session, "on-timeout", (GCallback) on_timeout,
+      stream);
+
+  /* route the RTCP of clients that changed their address */
+  mux_update_ssrc (stream);
+
+  for (i = 0; i < 2; i++) {
+    GstPad *teepad, *queuepad;
+    /* For the sender we create this bit of pipeline for both
+     * RTP and RTCP. Sync and preroll are enabled on udpsink so
+     * we need to add a queue before appsink to make the pipeline
+     * not block. For the TCP case, we want to pump data to the
+     * client as fast as possible anyway.
+     *
+     * .--------.      .-----.    .---------.
+     * | rtpbin |      | tee |    | udpsink |
+     * |       send->sink   src->sink       |
+     * '--------'      |     |    '---------'
+     *                 |     |    .---------.    .---------.
+     *                 |     |    |  queue  |    | appsink |
+     *                 |    src->sink      src->sink       |
+     *                 '-----'    '---------'    '---------'
+     *
+     * When only UDP is allowed, we skip the tee, queue and appsink and link the
+     * udpsink directly to the session.
+     */
+    /* add udpsink */
+    gst_bin_add (bin, priv->udpsink[i]);
+    sinkpad = gst_element_get_static_pad (priv->udpsink[i], "sink");
+
+    if (priv->protocols & GST_RTSP_LOWER_TRANS_TCP) {
+      /* make tee for RTP/RTCP */
+      priv->tee[i] = gst_element_factory_make ("tee", NULL);
+      gst_bin_add (bin, priv->tee[i]);
+
+      /* and link to rtpbin send pad */
+      pad = gst_element_get_static_pad (priv->tee[i], "sink");
+      gst_pad_link (priv->send_src[i], pad);
+      gst_object_unref (pad);
+
+      /* link tee to udpsink */
+      teepad = gst_element_get_request_pad (priv->tee[i], "src_%u");
+      gst_pad_link (teepad, sinkpad);
+      gst_object_unref (teepad);
+
+      /* make queue */
+      priv->appqueue[i] = gst_element_factory_make ("queue", NULL);
+      if (priv->low_latency) {
+        /* keep only a short amount of data for TCP clients and drop the
+         * oldest packets when they can't keep up */
+        g_object_set (priv->appqueue[i], "max-size-buffers", 0,
+            "max-size-bytes", 0, "max-size-time",
+            (guint64) LOW_LATENCY_QUEUE_TIME, "leaky", 2, NULL);
+      }
+      gst_bin_add (bin, priv->appqueue[i]);
+      /* and link to tee */
+      teepad = gst_element_get_request_pad (priv->tee[i], "src_%u");
+      pad = gst_element_get_static_pad (priv->appqueue[i], "sink");
+      gst_pad_link (teepad, pad);
+      gst_object_unref (pad);
+      gst_object_unref (teepad);
+
+      /* make appsink */
+      priv->appsink[i] = gst_element_factory_make ("appsink", NULL);
+      g_object_set (priv->appsink[i], "async", FALSE, "sync", FALSE, NULL);
+      g_object_set (priv->appsink[i], "emit-signals", FALSE, NULL);
+      gst_bin_add (bin, priv->appsink[i]);
+      gst_app_sink_set_callbacks (GST_APP_SINK_CAST (priv->appsink[i]),
+          &sink_cb, stream, NULL);
+      /* and link to queue */
+      queuepad = gst_element_get_static_pad (priv->appqueue[i], "src");
+      pad = gst_element_get_static_pad (priv->appsink[i], "sink");
+      gst_pad_link (queuepad, pad);
+      gst_object_unref (pad);
+      gst_object_unref (queuepad);
+    } else {
+      /* else only udpsink needed, link it to the session */
+      gst_pad_link (priv->send_src[i], sinkpad);
+    }
+    gst_object_unref (sinkpad);
+
+    /* For the receiver we create this bit of pipeline for both
+     * RTP and RTCP. We receive RTP/RTCP on appsrc and udpsrc
+     * and it is all funneled into the rtpbin receive pad.
+     *
+     * .--------.     .--------.    .--------.
+     * | udpsrc |     | funnel |    | rtpbin |
+     * |       src->sink      src->sink      |
+     * '--------'     |        |    '--------'
+     * .--------.     |        |
+     * | appsrc |     |        |
+     * |       src->sink       |
+     * '--------'     '--------'
+     */
+    /* make funnel for the RTP/RTCP receivers */
+    priv->funnel[i] = gst_element_factory_make ("funnel", NULL);
+    gst_bin_add (bin, priv->funnel[i]);
+
+    pad = gst_element_get_static_pad (priv->funnel[i], "src");
+    gst_pad_link (pad, priv->recv_sink[i]);
+    gst_object_unref (pad);
+
+    if (priv->udpsrc_v4[i]) {
+      /* we set and keep these to playing so that they don't cause NO_PREROLL return
+       * values */
+      gst_element_set_state (priv->udpsrc_v4[i], GST_STATE_PLAYING);
+      gst_element_set_locked_state (priv->udpsrc_v4[i], TRUE);
+      /* add udpsrc */
+      gst_bin_add (bin, priv->udpsrc_v4[i]);
+
+      /* and link to the funnel v4 */
+      selpad = gst_element_get_request_pad (priv->funnel[i], "sink_%u");
+      pad = gst_element_get_static_pad (priv->udpsrc_v4[i], "src");
+      gst_pad_link (pad, selpad);
+      gst_object_unref (pad);
+      gst_object_unref (selpad);
+    }
+
+    if (priv->udpsrc_v6[i]) {
+      gst_element_set_state (priv->udpsrc_v6[i], GST_STATE_PLAYING);
+      gst_element_set_locked_state (priv->udpsrc_v6[i], TRUE);
+      gst_bin_add (bin, priv->udpsrc_v6[i]);
+
+      /* and link to the funnel v6 */
+      selpad = gst_element_get_request_pad (priv->funnel[i], "sink_%u");
+      pad = gst_element_get_static_pad (priv->udpsrc_v6[i], "src");
+      gst_pad_link (pad, selpad);
+      gst_object_unref (pad);
+      gst_object_unref (selpad);
+    }
+
+    /* in mux mode, the packets from the shared sockets also go to appsrc */
+    if (priv->protocols & GST_RTSP_LOWER_TRANS_TCP || priv->mux_pool) {
+      /* make and add appsrc */
+      priv->appsrc[i] = gst_element_factory_make ("appsrc", NULL);
+      gst_bin_add (bin, priv->appsrc[i]);
+      /* and link to the funnel */
+      selpad = gst_element_get_request_pad (priv->funnel[i], "sink_%u");
+      pad = gst_element_get_static_pad (priv->appsrc[i], "src");
+      gst_pad_link (pad, selpad);
+      gst_object_unref (pad);
+      gst_object_unref (selpad);
+    }
+
+    /* check if we need to set to a special state */
+    if (state != GST_STATE_NULL) {
+      if (priv->udpsink[i])
+        gst_element_set_state (priv->udpsink[i], state);
+      if (priv->appsink[i])
+        gst_element_set_state (priv->appsink[i], state);
+      if (priv->appqueue[i])
+        gst_element_set_state (priv->appqueue[i], state);
+      if (priv->tee[i])
+        gst_element_set_state (priv->tee[i], state);
+      if (priv->funnel[i])
+        gst_element_set_state (priv->funnel[i], state);
+      if (priv->appsrc[i])
+        gst_element_set_state (priv->appsrc[i], state);
+    }
+  }
+
+  /* be notified of caps changes */
+  priv->caps_sig = g_signal_connect (priv->send_rtp_sink, "notify::caps",
+      (GCallback) caps_notify, stream);
+
+  priv->is_joined = TRUE;
+  g_mutex_unlock (&priv->lock);
+
+  return TRUE;
+
+  /* ERRORS */
+was_joined:
+  {
+    g_mutex_unlock (&priv->lock);
+    return TRUE;
+  }
+no_ports:
+  {
+    g_mutex_unlock (&priv->lock);
+    GST_WARNING ("failed to allocate ports %u", idx);
+    return FALSE;
+  }
+link_failed:
+  {
+    GST_WARNING ("failed to link stream %u", idx);
+    remove_send_stages (stream, bin);
+    gst_object_unref (priv->send_rtp_sink);
+    priv->send_rtp_sink = NULL;
+    g_mutex_unlock (&priv->lock);
+    return FALSE;
+  }
+}
+
+/**
+ * gst_rtsp_stream_leave_bin:
+ * @stream: a #GstRTSPStream
+ * @bin: a #GstBin
+ * @rtpbin: a rtpbin #GstElement
+ *
+ * Remove the elements of @stream from @bin.
+ *
+ * Return: %TRUE on success.
+ */
+gboolean
+gst_rtsp_stream_leave_bin (GstRTSPStream * stream, GstBin * bin,
+    GstElement * rtpbin)
+{
+  GstRTSPStreamPrivate *priv;
+  GstElement *encoder;
+  const gchar *prop = NULL;
+  guint bitrate = 0;
+  gint i;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
+  g_return_val_if_fail (GST_IS_BIN (bin), FALSE);
+  g_return_val_if_fail (GST_IS_ELEMENT (rtpbin), FALSE);
+
+  priv = stream->priv;
+
+  g_mutex_lock (&priv->lock);
+  if (!priv->is_joined)
+    goto was_not_joined;
+
+  /* all transports must be removed by now */
+  g_return_val_if_fail (priv->transports == NULL, FALSE);
+
+  GST_INFO ("stream %p leaving bin", stream);
+
+  if (priv->key_unit_id != 0) {
+    gst_pad_remove_probe (priv->srcpad, priv->key_unit_id);
+    priv->key_unit_id = 0;
+  }
+
+  if (priv->gop_cache_id != 0) {
+    GstPad *paysink;
+
+    paysink = gst_element_get_static_pad (priv->payloader, "sink");
+    gst_pad_remove_probe (paysink, priv->gop_key_id);
+    gst_object_unref (paysink);
+    gst_pad_remove_probe (priv->srcpad, priv->gop_cache_id);
+    priv->gop_key_id = 0;
+    priv->gop_cache_id = 0;
+  }
+  gop_cache_clear (stream);
+  qos_flags_stop (stream);
+
+  if (priv->standby_id != 0) {
+    gst_pad_remove_probe (priv->srcpad, priv->standby_id);
+    priv->standby_id = 0;
+  }
+
+  if (priv->layers)
+    layers_leave (stream, bin);
+
+  encoder = rate_control_leave (stream, &prop, &bitrate);
+  pacing_stop (stream);
+
+  if (priv->mux_pool) {
+    if (priv->have_mux_ssrc)
+      gst_rtsp_socket_pool_remove_mux_ssrc (priv->mux_pool, priv->mux_ssrc);
+    priv->have_mux_ssrc = FALSE;
+    g_object_unref (priv->mux_pool);
+    priv->mux_pool = NULL;
+  }
+
+  if (priv->fecenc || priv->rtxsend)
+    remove_send_stages (stream, bin);
+  else
+    gst_pad_unlink (priv->srcpad, priv->send_rtp_sink);
+  g_signal_handler_disconnect (priv->send_rtp_sink, priv->caps_sig);
+  gst_element_release_request_pad (rtpbin, priv->send_rtp_sink);
+  gst_object_unref (priv->send_rtp_sink);
+  priv->send_rtp_sink = NULL;
+
+  for (i = 0; i < 2; i++) {
+    if (priv->udpsink[i])
+      gst_element_set_state (priv->udpsink[i], GST_STATE_NULL);
+    if (priv->appsink[i])
+      gst_element_set_state (priv->appsink[i], GST_STATE_NULL);
+    if (priv->appqueue[i])
+      gst_element_set_state (priv->appqueue[i], GST_STATE_NULL);
+    if (priv->tee[i])
+      gst_element_set_state (priv->tee[i], GST_STATE_NULL);
+    if (priv->funnel[i])
+      gst_element_set_state (priv->funnel[i], GST_STATE_NULL);
+    if (priv->appsrc[i])
+      gst_element_set_state (priv->appsrc[i], GST_STATE_NULL);
+    if (priv->udpsrc_v4[i]) {
+      /* and set udpsrc to NULL now before removing */
+      gst_element_set_locked_state (priv->udpsrc_v4[i], FALSE);
+      gst_element_set_state (priv->udpsrc_v4[i], GST_STATE_NULL);
+      /* removing them should also nicely release the request
+       * pads when they finalize */
+      gst_bin_remove (bin, priv->udpsrc_v4[i]);
+    }
+    if (priv->udpsrc_v6[i]) {
+      gst_element_set_locked_state (priv->udpsrc_v6[i], FALSE);
+      gst_element_set_state (priv->udpsrc_v6[i], GST_STATE_NULL);
+      gst_bin_remove (bin, priv->udpsrc_v6[i]);
+    }
+    if (priv->udpsink[i])
+      gst_bin_remove (bin, priv->udpsink[i]);
+    if (priv->appsrc[i])
+      gst_bin_remove (bin, priv->appsrc[i]);
+    if (priv->appsink[i])
+      gst_bin_remove (bin, priv->appsink[i]);
+    if (priv->appqueue[i])
+      gst_bin_remove (bin, priv->appqueue[i]);
+    if (priv->tee[i])
+      gst_bin_remove (bin, priv->tee[i]);
+    if (priv->funnel[i])
+      gst_bin_remove (bin, priv->funnel[i]);
+
+    gst_element_release_request_pad (rtpbin, priv->recv_sink[i]);
+    gst_object_unref (priv->recv_sink[i]);
+    priv->recv_sink[i] = NULL;
+
+    priv->udpsrc_v4[i] = NULL;
+    priv->udpsrc_v6[i] = NULL;
+    priv->udpsink[i] = NULL;
+    priv->appsrc[i] = NULL;
+    priv->appsink[i] = NULL;
+    priv->appqueue[i] = NULL;
+    priv->tee[i] = NULL;
+    priv->funnel[i] = NULL;
+  }
+  gst_object_unref (priv->send_src[0]);
+  priv->send_src[0] = NULL;
+
+  gst_element_release_request_pad (rtpbin, priv->send_src[1]);
+  gst_object_unref (priv->send_src[1]);
+  priv->send_src[1] = NULL;
+
+  GST_DEBUG("Unref rtp session");
+  g_object_unref (priv->session);
+  priv->session = NULL;
+  if (priv->caps)
+    gst_caps_unref (priv->caps);
+  priv->caps = NULL;
+
+  priv->is_joined = FALSE;
+  g_mutex_unlock (&priv->lock);
+
+  if (encoder)
+    rate_control_restore (encoder, prop, bitrate);
+
+  return TRUE;
+
+was_not_joined:
+  {
+    return TRUE;
+  }
+}
+
+/**
+ * gst_rtsp_stream_get_rtpinfo:
+ * @stream: a #GstRTSPStream
+ * @rtptime: (allow-none): result RTP timestamp
+ * @seq: (allow-none): result RTP seqnum
+ * @clock_rate: the clock rate
+ * @running_time: (allow-none): result running-time
+ *
+ * Retrieve the current rtptime, seq and running-time. This is used to
+ * construct a RTPInfo reply header.
+ *
+ * Returns: %TRUE when rtptime, seq and running-time could be determined.
+ */
+gboolean
+gst_rtsp_stream_get_rtpinfo (GstRTSPStream * stream,
+    guint * rtptime, guint * seq, guint * clock_rate,
+    GstClockTime * running_time)
+{
+  GstRTSPStreamPrivate *priv;
+  GstStructure *stats;
+  GObjectClass *payobjclass;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
+
+  priv = stream->priv;
+
+  payobjclass = G_OBJECT_GET_CLASS (priv->payloader);
+
+  g_mutex_lock (&priv->lock);
+
+  if (g_object_class_find_property (payobjclass, "stats")) {
+    g_object_get (priv->payloader, "stats", &stats, NULL);
+    if (stats == NULL)
+      goto no_stats;
+
+    if (seq)
+      gst_structure_get_uint (stats, "seqnum", seq);
+
+    if (rtptime)
+      gst_structure_get_uint (stats, "timestamp", rtptime);
+
+    if (running_time)
+      gst_structure_get_clock_time (stats, "running-time", running_time);
+
+    if (clock_rate) {
+      gst_structure_get_uint (stats, "clock-rate", clock_rate);
+      if (*clock_rate == 0 && running_time)
+        *running_time = GST_CLOCK_TIME_NONE;
+    }
+    gst_structure_free (stats);
+  } else {
+    if (!g_object_class_find_property (payobjclass, "seqnum") ||
+        !g_object_class_find_property (payobjclass, "timestamp"))
+      goto no_stats;
+
+    if (seq)
+      g_object_get (priv->payloader, "seqnum", seq, NULL);
+
+    if (rtptime)
+      g_object_get (priv->payloader, "timestamp", rtptime, NULL);
+
+    if (running_time)
+      *running_time = GST_CLOCK_TIME_NONE;
+  }
+  g_mutex_unlock (&priv->lock);
+
+  return TRUE;
+
+  /* ERRORS */
+no_stats:
+  {
+    GST_WARNING ("Could not get payloader stats");
+    g_mutex_unlock (&priv->lock);
+    return FALSE;
+  }
+}
+
+/**
+ * gst_rtsp_stream_get_caps:
+ * @stream: a #GstRTSPStream
+ *
+ * Retrieve the current caps of @stream.
+ *
+ * Returns: (transfer full): the #GstCaps of @stream. use gst_caps_unref()
+ *    after usage.
+ */
+GstCaps *
+gst_rtsp_stream_get_caps (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv;
+  GstCaps *result;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
+
+  priv = stream->priv;
+
+  g_mutex_lock (&priv->lock);
+  if ((result = priv->caps))
+    gst_caps_ref (result);
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
+
+/**
+ * gst_rtsp_stream_recv_rtp:
+ * @stream: a #GstRTSPStream
+ * @buffer: (transfer full): a #GstBuffer
+ *
+ * Handle an RTP buffer for the stream. This method is usually called when a
+ * message has been received from a client using the TCP transport.
+ *
+ * This function takes ownership of @buffer.
+ *
+ * Returns: a GstFlowReturn.
+ */
+GstFlowReturn
+gst_rtsp_stream_recv_rtp (GstRTSPStream * stream, GstBuffer * buffer)
+{
+  GstRTSPStreamPrivate *priv;
+  GstFlowReturn ret;
+  GstElement *element;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), GST_FLOW_ERROR);
+  priv = stream->priv;
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), GST_FLOW_ERROR);
+  g_return_val_if_fail (priv->is_joined, FALSE);
+
+  g_mutex_lock (&priv->lock);
+  if (priv->appsrc[0])
+    element = gst_object_ref (priv->appsrc[0]);
+  else
+    element = NULL;
+  g_mutex_unlock (&priv->lock);
+
+  if (element) {
+    ret = gst_app_src_push_buffer (GST_APP_SRC_CAST (element), buffer);
+    gst_object_unref (element);
+  } else {
+    ret = GST_FLOW_OK;
+  }
+  return ret;
+}
+
+/**
+ * gst_rtsp_stream_recv_rtcp:
+ * @stream: a #GstRTSPStream
+ * @buffer: (transfer full): a #GstBuffer
+ *
+ * Handle an RTCP buffer for the stream. This method is usually called when a
+ * message has been received from a client using the TCP transport.
+ *
+ * This function takes ownership of @buffer.
+ *
+ * Returns: a GstFlowReturn.
+ */
+GstFlowReturn
+gst_rtsp_stream_recv_rtcp (GstRTSPStream * stream, GstBuffer * buffer)
+{
+  GstRTSPStreamPrivate *priv;
+  GstFlowReturn ret;
+  GstElement *element;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), GST_FLOW_ERROR);
+  priv = stream->priv;
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), GST_FLOW_ERROR);
+  g_return_val_if_fail (priv->is_joined, FALSE);
+
+  g_mutex_lock (&priv->lock);
+  if (priv->appsrc[1])
+    element = gst_object_ref (priv->appsrc[1]);
+  else
+    element = NULL;
+  g_mutex_unlock (&priv->lock);
+
+  if (element) {
+    ret = gst_app_src_push_buffer (GST_APP_SRC_CAST (element), buffer);
+    gst_object_unref (element);
+  } else {
+    ret = GST_FLOW_OK;
+  }
+  return ret;
+}
+
+/* must be called with lock */
+static void
+gop_cache_clear (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GstBuffer *buffer;
+
+  while ((buffer = g_queue_pop_head (&priv->gop_packets)))
+    gst_buffer_unref (buffer);
+  priv->gop_bytes = 0;
+  priv->gop_head = priv->gop_next;
+}
+
+/* must be called with lock */
+static void
+gop_cache_add (GstRTSPStream * stream, GstBuffer * buffer)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+
+  if (priv->gop_key_pending) {
+    /* first packet of a new key unit, the previous GOP is not needed anymore */
+    gop_cache_clear (stream);
+    priv->gop_key_pending = FALSE;
+    priv->gop_valid = TRUE;
+  }
+  if (!priv->gop_valid)
+    return;
+
+  priv->gop_bytes += gst_buffer_get_size (buffer);
+  if (priv->gop_bytes > GOP_CACHE_MAX_BYTES) {
+    GST_DEBUG ("GOP of stream %p too big, waiting for next key unit", stream);
+    gop_cache_clear (stream);
+    priv->gop_valid = FALSE;
+    return;
+  }
+  g_queue_push_tail (&priv->gop_packets, gst_buffer_ref (buffer));
+  priv->gop_next++;
+}
+
+/* the RTP packets don't carry the delta flag, so we look at the input of
+ * the payloader to find the key units */
+static gboolean
+probe_is_key_unit (GstPadProbeInfo * info)
+{
+  GstBuffer *buffer = NULL;
+
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+
+    if (gst_buffer_list_length (list) > 0)
+      buffer = gst_buffer_list_get (list, 0);
+  } else {
+    buffer = GST_PAD_PROBE_INFO_BUFFER (info);
+  }
+  return buffer && !GST_BUFFER_FLAG_IS_SET (buffer,
+      GST_BUFFER_FLAG_DELTA_UNIT);
+}
+
+static GstPadProbeReturn
+gop_key_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstRTSPStream *stream = user_data;
+  GstRTSPStreamPrivate *priv = stream->priv;
+
+  if (probe_is_key_unit (info)) {
+    g_mutex_lock (&priv->lock);
+    priv->gop_key_pending = TRUE;
+    g_mutex_unlock (&priv->lock);
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+static GstPadProbeReturn
+gop_cache_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstRTSPStream *stream = user_data;
+  GstRTSPStreamPrivate *priv = stream->priv;
+
+  g_mutex_lock (&priv->lock);
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint i, len;
+
+    len = gst_buffer_list_length (list);
+    for (i = 0; i < len; i++)
+      gop_cache_add (stream, gst_buffer_list_get (list, i));
+  } else {
+    gop_cache_add (stream, GST_PAD_PROBE_INFO_BUFFER (info));
+  }
+  g_mutex_unlock (&priv->lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* must be called with lock. Get the RTP (@idx 0) or RTCP (@idx 1) socket to
+ * send to the unicast destination of @tr from, the udpsrc shares its socket
+ * with the udpsink */
+static gboolean
+get_udp_destination (GstRTSPStream * stream, const GstRTSPTransport * tr,
+    guint idx, GSocket ** socket, GSocketAddress ** addr)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GInetAddress *inetaddr;
+  const gchar *name;
+
+  *socket = NULL;
+  *addr = NULL;
+
+  inetaddr = g_inet_address_new_from_string (tr->destination);
+  if (inetaddr == NULL)
+    goto no_address;
+
+  /* there is no udpsrc in mux mode, the udpsink always has the socket */
+  if (g_inet_address_get_family (inetaddr) == G_SOCKET_FAMILY_IPV6)
+    name = "socket-v6";
+  else
+    name = "socket";
+  if (priv->udpsink[idx])
+    g_object_get (priv->udpsink[idx], name, socket, NULL);
+  if (*socket == NULL)
+    goto no_socket;
+
+  *addr = g_inet_socket_address_new (inetaddr,
+      idx == 0 ? tr->client_port.min : tr->client_port.max);
+  g_object_unref (inetaddr);
+
+  return TRUE;
+
+  /* ERRORS */
+no_address:
+  {
+    GST_WARNING ("invalid destination %s", tr->destination);
+    return FALSE;
+  }
+no_socket:
+  {
+    GST_WARNING ("no socket %u to send to %s", idx, tr->destination);
+    g_object_unref (inetaddr);
+    return FALSE;
+  }
+}
+
+/* the transports that get the cached packets when they are added, multicast
+ * members already received them */
+static gboolean
+gop_replay_supported (const GstRTSPTransport * tr)
+{
+  return tr->lower_transport == GST_RTSP_LOWER_TRANS_UDP ||
+      tr->lower_transport == GST_RTSP_LOWER_TRANS_TCP;
+}
+
+/* Get the rtptime and seq of the first cached packet when a transport @tr
+ * that is added now starts with the cached packets. Used for the RTP-Info of
+ * the transport. */
+gboolean
+gst_rtsp_stream_get_gop_rtpinfo (GstRTSPStream * stream,
+    const GstRTSPTransport * tr, guint * rtptime, guint * seq)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  gboolean res = FALSE;
+
+  if (!gop_replay_supported (tr))
+    return FALSE;
+
+  g_mutex_lock (&priv->lock);
+  if (!g_queue_is_empty (&priv->gop_packets) &&
+      gst_rtp_buffer_map (g_queue_peek_head (&priv->gop_packets),
+          GST_MAP_READ, &rtp)) {
+    *seq = gst_rtp_buffer_get_seq (&rtp);
+    *rtptime = gst_rtp_buffer_get_timestamp (&rtp);
+    gst_rtp_buffer_unmap (&rtp);
+    res = TRUE;
+  }
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+/* the cached packets for a new transport */
+typedef struct
+{
+  GstRTSPStreamTransport *trans;
+  GSocket *socket;
+  GSocketAddress *addr;
+  guint64 next;                 /* serial after the last packet sent */
+} GopReplay;
+
+static void
+gop_replay_send (GopReplay * replay, GList * packets)
+{
+  GList *walk;
+
+  for (walk = packets; walk; walk = walk->next) {
+    GstBuffer *buffer = walk->data;
+
+    if (replay->socket) {
+      buffer = gst_rtsp_stream_transport_rewrite_rtp (replay->trans, buffer);
+      send_buffer_to (replay->socket, replay->addr, buffer, NULL, 0, NULL);
+      gst_buffer_unref (buffer);
+    } else {
+      gst_rtsp_stream_transport_send_rtp (replay->trans, buffer);
+    }
+  }
+}
+
+/* must be called with lock. Takes the cached GOP for the new transport
+ * @trans in @packets, to be sent with gop_replay_send() without the lock.
+ * For UDP we send directly on the RTP socket so that the other destinations
+ * of the udpsink don't see the packets again, multicast members already
+ * received them. */
+static GopReplay *
+gop_replay_new (GstRTSPStream * stream, GstRTSPStreamTransport * trans,
+    GList ** packets)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  const GstRTSPTransport *tr;
+  GSocket *socket = NULL;
+  GSocketAddress *addr = NULL;
+  GopReplay *replay;
+  GList *walk;
+
+  if (g_queue_is_empty (&priv->gop_packets))
+    return NULL;
+
+  tr = gst_rtsp_stream_transport_get_transport (trans);
+  if (!gop_replay_supported (tr))
+    return NULL;
+
+  if (tr->lower_transport == GST_RTSP_LOWER_TRANS_UDP &&
+      !get_udp_destination (stream, tr, 0, &socket, &addr))
+    return NULL;
+
+  GST_DEBUG ("sending %u cached packets to %s", priv->gop_packets.length,
+      tr->destination);
+
+  replay = g_slice_new (GopReplay);
+  replay->trans = g_object_ref (trans);
+  replay->socket = socket;
+  replay->addr = addr;
+  replay->next = priv->gop_next;
+
+  *packets = NULL;
+  for (walk = priv->gop_packets.tail; walk; walk = walk->prev)
+    *packets = g_list_prepend (*packets, gst_buffer_ref (walk->data));
+
+  return replay;
+}
+
+/* must be called with lock. Sends the packets that were cached while the
+ * replay was sent without the lock, right before @trans gets the live
+ * packets. When a new key unit started in the meantime the client gets the
+ * new GOP from its start. */
+static void
+gop_replay_finish (GstRTSPStream * stream, GopReplay * replay)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GList *walk;
+  guint64 serial;
+
+  serial = priv->gop_head;
+  for (walk = priv->gop_packets.head; walk; walk = walk->next) {
+    if (serial++ >= replay->next)
+      break;
+  }
+  gop_replay_send (replay, walk);
+
+  g_object_unref (replay->trans);
+  if (replay->socket)
+    g_object_unref (replay->socket);
+  if (replay->addr)
+    g_object_unref (replay->addr);
+  g_slice_free (GopReplay, replay);
+}
+
+/* must be called with lock */
+static gboolean
+update_transport (GstRTSPStream * stream, GstRTSPStreamTransport * trans,
+    gboolean add)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  const GstRTSPTransport *tr;
+
+  tr = gst_rtsp_stream_transport_get_transport (trans);
+
+  switch (tr->lower_transport) {
+    case GST_RTSP_LOWER_TRANS_UDP:
+    case GST_RTSP_LOWER_TRANS_UDP_MCAST:
+    {
+      gchar *dest;
+      gint min, max;
+      guint ttl = 0;
+
+      dest = tr->destination;
+      if (tr->lower_transport == GST_RTSP_LOWER_TRANS_UDP_MCAST) {
+        min = tr->port.min;
+        max = tr->port.max;
+        ttl = tr->ttl;
+      } else {
+        min = tr->client_port.min;
+        max = tr->client_port.max;
+      }
+
+      if (add) {
+        if (ttl > 0) {
+          GST_INFO ("setting ttl-mc %d", ttl);
+          g_object_set (G_OBJECT (priv->udpsink[0]), "ttl-mc", ttl, NULL);
+          g_object_set (G_OBJECT (priv->udpsink[1]), "ttl-mc", ttl, NULL);
+        }
+        GST_INFO ("adding %s:%d-%d", dest, min, max);
+        if (priv->mux_pool &&
+            tr->lower_transport == GST_RTSP_LOWER_TRANS_UDP) {
+          gst_rtsp_socket_pool_add_mux_source (priv->mux_pool, dest, min,
+              mux_receive, G_OBJECT (stream));
+          gst_rtsp_socket_pool_add_mux_source (priv->mux_pool, dest, max,
+              mux_receive, G_OBJECT (stream));
+        }
+        /* multicast members all get the first layer from the udpsink */
+        if (tr->lower_transport == GST_RTSP_LOWER_TRANS_UDP_MCAST ||
+            !(priv->layer_clients ? layer_client_add (stream, trans) :
+                (paced_client_add (stream, trans) ||
+                    direct_client_add (stream, trans))))
+          g_signal_emit_by_name (priv->udpsink[0], "add", dest, min, NULL);
+        if (tr->lower_transport == GST_RTSP_LOWER_TRANS_UDP_MCAST ||
+            !rtcp_client_add (stream, trans))
+          g_signal_emit_by_name (priv->udpsink[1], "add", dest, max, NULL);
+        priv->transports = g_list_prepend (priv->transports, trans);
+      } else {
+        GST_INFO ("removing %s:%d-%d", dest, min, max);
+        if (priv->mux_pool &&
+            tr->lower_transport == GST_RTSP_LOWER_TRANS_UDP) {
+          gst_rtsp_socket_pool_remove_mux_source (priv->mux_pool, dest, min);
+          gst_rtsp_socket_pool_remove_mux_source (priv->mux_pool, dest, max);
+        }
+        if (!(priv->layer_clients &&
+                g_hash_table_remove (priv->layer_clients, trans)) &&
+            !paced_client_remove (stream, trans) &&
+            !g_hash_table_remove (priv->direct_clients, trans))
+          g_signal_emit_by_name (priv->udpsink[0], "remove", dest, min, NULL);
+        if (!g_hash_table_remove (priv->rtcp_clients, trans))
+          g_signal_emit_by_name (priv->udpsink[1], "remove", dest, max, NULL);
+        qos_flags_update (stream);
+        priv->transports = g_list_remove (priv->transports, trans);
+      }
+      break;
+    }
+    case GST_RTSP_LOWER_TRANS_TCP:
+      if (add) {
+        GST_INFO ("adding TCP %s", tr->destination);
+        if (priv->layer_clients)
+          layer_client_add (stream, trans);
+        priv->transports = g_list_prepend (priv->transports, trans);
+      } else {
+        GST_INFO ("removing TCP %s", tr->destination);
+        if (priv->layer_clients)
+          g_hash_table_remove (priv->layer_clients, trans);
+        priv->transports = g_list_remove (priv->transports, trans);
+      }
+      break;
+    default:
+      goto unknown_transport;
+  }
+  return TRUE;
+
+  /* ERRORS */
+unknown_transport:
+  {
+    GST_INFO ("Unknown transport %d", tr->lower_transport);
+    return FALSE;
+  }
+}
+
+
+/**
+ * gst_rtsp_stream_add_transport:
+ * @stream: a #GstRTSPStream
+ * @trans: a #GstRTSPStreamTransport
+ *
+ * Add the transport in @trans to @stream. The media of @stream will
+ * then also be send to the values configured in @trans.
+ *
+ * @stream must be joined to a bin.
+ *
+ * @trans must contain a valid #GstRTSPTransport.
+ *
+ * Returns: %TRUE if @trans was added
+ */
+gboolean
+gst_rtsp_stream_add_transport (GstRTSPStream * stream,
+    GstRTSPStreamTransport * trans)
+{
+  GstRTSPStreamPrivate *priv;
+  GopReplay *replay;
+  GList *packets;
+  gboolean res;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
+  priv = stream->priv;
+  g_return_val_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans), FALSE);
+  g_return_val_if_fail (priv->is_joined, FALSE);
+
+  g_mutex_lock (&priv->lock);
+  /* the cached GOP can be big, send it without the lock and only the
+   * packets that arrived meanwhile with the lock */
+  replay = gop_replay_new (stream, trans, &packets);
+  if (replay) {
+    g_mutex_unlock (&priv->lock);
+    gop_replay_send (replay, packets);
+    g_list_free_full (packets, (GDestroyNotify) gst_buffer_unref);
+    g_mutex_lock (&priv->lock);
+    gop_replay_finish (stream, replay);
+  }
+  res = update_transport (stream, trans, TRUE);
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_stream_remove_transport:
+ * @stream: a #GstRTSPStream
+ * @trans: a #GstRTSPStreamTransport
+ *
+ * Remove the transport in @trans from @stream. The media of @stream will
+ * not be sent to the values configured in @trans.
+ *
+ * @stream must be joined to a bin.
+ *
+ * @trans must contain a valid #GstRTSPTransport.
+ *
+ * Returns: %TRUE if @trans was removed
+ */
+gboolean
+gst_rtsp_stream_remove_transport (GstRTSPStream * stream,
+    GstRTSPStreamTransport * trans)
+{
+  GstRTSPStreamPrivate *priv;
+  gboolean res;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
+  priv = stream->priv;
+  g_return_val_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans), FALSE);
+  g_return_val_if_fail (priv->is_joined, FALSE);
+
+  g_mutex_lock (&priv->lock);
+  res = update_transport (stream, trans, FALSE);
+  g_mutex_unlock (&priv->lock);
+
+  return res;
+}
+
+/**
+ * gst_rtsp_stream_get_rtp_socket:
+ * @stream: a #GstRTSPStream
+ * @family: the socket family
+ *
+ * Get the RTP socket from @stream for a @family.
+ *
+ * @stream must be joined to a bin.
+ *
+ * Returns: the RTP socket or %NULL if no socket could be allocated for @family.
+ *     Unref after usage
+ */
+GSocket *
+gst_rtsp_stream_get_rtp_socket (GstRTSPStream * stream, GSocketFamily family)
+{
+  GstRTSPStreamPrivate *priv = GST_RTSP_STREAM_GET_PRIVATE (stream);
+  GSocket *socket;
+  const gchar *name;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
+  g_return_val_if_fail (family == G_SOCKET_FAMILY_IPV4 ||
+      family == G_SOCKET_FAMILY_IPV6, NULL);
+  g_return_val_if_fail (priv->udpsink[0], NULL);
+
+  if (family == G_SOCKET_FAMILY_IPV6)
+    name = "socket-v6";
+  else
+    name = "socket";
+
+  g_object_get (priv->udpsink[0], name, &socket, NULL);
+
+  return socket;
+}
+
+/**
+ * gst_rtsp_stream_get_rtcp_socket:
+ * @stream: a #GstRTSPStream
+ * @family: the socket family
+ *
+ * Get the RTCP socket from @stream for a @family.
+ *
+ * @stream must be joined to a bin.
+ *
+ * Returns: the RTCP socket or %NULL if no socket could be allocated for
+ *     @family. Unref after usage
+ */
+GSocket *
+gst_rtsp_stream_get_rtcp_socket (GstRTSPStream * stream, GSocketFamily family)
+{
+  GstRTSPStreamPrivate *priv = GST_RTSP_STREAM_GET_PRIVATE (stream);
+  GSocket *socket;
+  const gchar *name;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
+  g_return_val_if_fail (family == G_SOCKET_FAMILY_IPV4 ||
+      family == G_SOCKET_FAMILY_IPV6, NULL);
+  g_return_val_if_fail (priv->udpsink[1], NULL);
+
+  if (family == G_SOCKET_FAMILY_IPV6)
+    name = "socket-v6";
+  else
+    name = "socket";
+
+  g_object_get (priv->udpsink[1], name, &socket, NULL);
+
+  return socket;
+}
+
+/**
+ * gst_rtsp_stream_transport_filter:
+ * @stream: a #GstRTSPStream
+ * @func: (scope call) (allow-none): a callback
+ * @user_data: user data passed to @func
+ *
+ * Call @func for each transport managed by @stream. The result value of @func
+ * determines what happens to the transport. @func will be called with @stream
+ * locked so no further actions on @stream can be performed from @func.
+ *
+ * If @func returns #GST_RTSP_FILTER_REMOVE, the transport will be removed from
+ * @stream.
+ *
+ * If @func returns #GST_RTSP_FILTER_KEEP, the transport will remain in @stream.
+ *
+ * If @func returns #GST_RTSP_FILTER_REF, the transport will remain in @stream but
+ * will also be added with an additional ref to the result #GList of this
+ * function..
+ *
+ * When @func is %NULL, #GST_RTSP_FILTER_REF will be assumed for each transport.
+ *
+ * Returns: (element-type GstRTSPStreamTransport) (transfer full): a #GList with all
+ * transports for which @func returned #GST_RTSP_FILTER_REF. After usage, each
+ * element in the #GList should be unreffed before the list is freed.
+ */
+GList *
+gst_rtsp_stream_transport_filter (GstRTSPStream * stream,
+    GstRTSPStreamTransportFilterFunc func, gpointer user_data)
+{
+  GstRTSPStreamPrivate *priv;
+  GList *result, *walk, *next;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
+
+  priv = stream->priv;
+
+  result = NULL;
+
+  g_mutex_lock (&priv->lock);
+  for (walk = priv->transports; walk; walk = next) {
+    GstRTSPStreamTransport *trans = walk->data;
+    GstRTSPFilterResult res;
+
+    next = g_list_next (walk);
+
+    if (func)
+      res = func (stream, trans, user_data);
+    else
+      res = GST_RTSP_FILTER_REF;
+
+    switch (res) {
+      case GST_RTSP_FILTER_REMOVE:
+        update_transport (stream, trans, FALSE);
+        break;
+      case GST_RTSP_FILTER_REF:
+        result = g_list_prepend (result, g_object_ref (trans));
+        break;
+      case GST_RTSP_FILTER_KEEP:
+      default:
+        break;
     }
   }
+  g_mutex_unlock (&priv->lock);
 
-  /* be notified of caps changes */
-  priv->caps_sig = g_signal_connect (priv->send_rtp_sink, "notify::caps",
-      (GCallback) caps_notify, stream);
+  return result;
+}
 
-  priv->is_joined = TRUE;
+static GstPadProbeReturn
+pad_blocking (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstRTSPStreamPrivate *priv;
+  GstRTSPStream *stream;
+
+  stream = user_data;
+  priv = stream->priv;
+
+  GST_DEBUG_OBJECT (pad, "now blocking");
+
+  g_mutex_lock (&priv->lock);
+  priv->blocking = TRUE;
   g_mutex_unlock (&priv->lock);
 
-  return TRUE;
+  gst_element_post_message (priv->payloader,
+      gst_message_new_element (GST_OBJECT_CAST (priv->payloader),
+          gst_structure_new_empty ("GstRTSPStreamBlocking")));
 
-  /* ERRORS */
-was_joined:
-  {
-    g_mutex_unlock (&priv->lock);
-    return TRUE;
-  }
-no_ports:
-  {
-    g_mutex_unlock (&priv->lock);
-    GST_WARNING ("failed to allocate ports %u", idx);
-    return FALSE;
-  }
-link_failed:
-  {
-    GST_WARNING ("failed to link stream %u", idx);
-    gst_object_unref (priv->send_rtp_sink);
-    priv->send_rtp_sink = NULL;
-    g_mutex_unlock (&priv->lock);
-    return FALSE;
-  }
+  return GST_PAD_PROBE_OK;
 }
 
 /**
- * gst_rtsp_stream_leave_bin:
+ * gst_rtsp_stream_set_blocked:
  * @stream: a #GstRTSPStream
- * @bin: a #GstBin
- * @rtpbin: a rtpbin #GstElement
+ * @blocked: boolean indicating we should block or unblock
  *
- * Remove the elements of @stream from @bin.
+ * Blocks or unblocks the dataflow on @stream.
  *
- * Return: %TRUE on success.
+ * Returns: %TRUE on success
  */
 gboolean
-gst_rtsp_stream_leave_bin (GstRTSPStream * stream, GstBin * bin,
-    GstElement * rtpbin)
+gst_rtsp_stream_set_blocked (GstRTSPStream * stream, gboolean blocked)
 {
   GstRTSPStreamPrivate *priv;
-  gint i;
 
   g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
-  g_return_val_if_fail (GST_IS_BIN (bin), FALSE);
-  g_return_val_if_fail (GST_IS_ELEMENT (rtpbin), FALSE);
 
   priv = stream->priv;
 
   g_mutex_lock (&priv->lock);
-  if (!priv->is_joined)
-    goto was_not_joined;
-
-  /* all transports must be removed by now */
-  g_return_val_if_fail (priv->transports == NULL, FALSE);
-
-  GST_INFO ("stream %p leaving bin", stream);
-
-  gst_pad_unlink (priv->srcpad, priv->send_rtp_sink);
-  g_signal_handler_disconnect (priv->send_rtp_sink, priv->caps_sig);
-  gst_element_release_request_pad (rtpbin, priv->send_rtp_sink);
-  gst_object_unref (priv->send_rtp_sink);
-  priv->send_rtp_sink = NULL;
-
-  for (i = 0; i < 2; i++) {
-    if (priv->udpsink[i])
-      gst_element_set_state (priv->udpsink[i], GST_STATE_NULL);
-    if (priv->appsink[i])
-      gst_element_set_state (priv->appsink[i], GST_STATE_NULL);
-    if (priv->appqueue[i])
-      gst_element_set_state (priv->appqueue[i], GST_STATE_NULL);
-    if (priv->tee[i])
-      gst_element_set_state (priv->tee[i], GST_STATE_NULL);
-    if (priv->funnel[i])
-      gst_element_set_state (priv->funnel[i], GST_STATE_NULL);
-    if (priv->appsrc[i])
-      gst_element_set_state (priv->appsrc[i], GST_STATE_NULL);
-    if (priv->udpsrc_v4[i]) {
-      /* and set udpsrc to NULL now before removing */
-      gst_element_set_locked_state (priv->udpsrc_v4[i], FALSE);
-      gst_element_set_state (priv->udpsrc_v4[i], GST_STATE_NULL);
-      /* removing them should also nicely release the request
-       * pads when they finalize */
-      gst_bin_remove (bin, priv->udpsrc_v4[i]);
+  if (blocked) {
+    priv->blocking = FALSE;
+    if (priv->blocked_id == 0) {
+      priv->blocked_id = gst_pad_add_probe (priv->srcpad,
+          GST_PAD_PROBE_TYPE_BLOCK | GST_PAD_PROBE_TYPE_BUFFER |
+          GST_PAD_PROBE_TYPE_BUFFER_LIST, pad_blocking,
+          g_object_ref (stream), g_object_unref);
     }
-    if (priv->udpsrc_v6[i]) {
-      gst_element_set_locked_state (priv->udpsrc_v6[i], FALSE);
-      gst_element_set_state (priv->udpsrc_v6[i], GST_STATE_NULL);
-      gst_bin_remove (bin, priv->udpsrc_v6[i]);
+  } else {
+    if (priv->blocked_id != 0) {
+      gst_pad_remove_probe (priv->srcpad, priv->blocked_id);
+      priv->blocked_id = 0;
+      priv->blocking = FALSE;
     }
-    if (priv->udpsink[i])
-      gst_bin_remove (bin, priv->udpsink[i]);
-    if (priv->appsrc[i])
-      gst_bin_remove (bin, priv->appsrc[i]);
-    if (priv->appsink[i])
-      gst_bin_remove (bin, priv->appsink[i]);
-    if (priv->appqueue[i])
-      gst_bin_remove (bin, priv->appqueue[i]);
-    if (priv->tee[i])
-      gst_bin_remove (bin, priv->tee[i]);
-    if (priv->funnel[i])
-      gst_bin_remove (bin, priv->funnel[i]);
-
-    gst_element_release_request_pad (rtpbin, priv->recv_sink[i]);
-    gst_object_unref (priv->recv_sink[i]);
-    priv->recv_sink[i] = NULL;
-
-    priv->udpsrc_v4[i] = NULL;
-    priv->udpsrc_v6[i] = NULL;
-    priv->udpsink[i] = NULL;
-    priv->appsrc[i] = NULL;
-    priv->appsink[i] = NULL;
-    priv->appqueue[i] = NULL;
-    priv->tee[i] = NULL;
-    priv->funnel[i] = NULL;
   }
-  gst_object_unref (priv->send_src[0]);
-  priv->send_src[0] = NULL;
-
-  gst_element_release_request_pad (rtpbin, priv->send_src[1]);
-  gst_object_unref (priv->send_src[1]);
-  priv->send_src[1] = NULL;
-
-  GST_DEBUG("Unref rtp session");
-  g_object_unref (priv->session);
-  priv->session = NULL;
-  if (priv->caps)
-    gst_caps_unref (priv->caps);
-  priv->caps = NULL;
-
-  priv->is_joined = FALSE;
   g_mutex_unlock (&priv->lock);
 
   return TRUE;
-
-was_not_joined:
-  {
-    return TRUE;
-  }
 }
 
 /**
- * gst_rtsp_stream_get_rtpinfo:
+ * gst_rtsp_stream_is_blocking:
  * @stream: a #GstRTSPStream
- * @rtptime: (allow-none): result RTP timestamp
- * @seq: (allow-none): result RTP seqnum
- * @clock_rate: the clock rate
- * @running_time: (allow-none): result running-time
  *
- * Retrieve the current rtptime, seq and running-time. This is used to
- * construct a RTPInfo reply header.
+ * Check if @stream is blocking on a #GstBuffer.
  *
- * Returns: %TRUE when rtptime, seq and running-time could be determined.
+ * Returns: %TRUE if @stream is blocking
  */
 gboolean
-gst_rtsp_stream_get_rtpinfo (GstRTSPStream * stream,
-    guint * rtptime, guint * seq, guint * clock_rate,
-    GstClockTime * running_time)
+gst_rtsp_stream_is_blocking (GstRTSPStream * stream)
 {
   GstRTSPStreamPrivate *priv;
-  GstStructure *stats;
-  GObjectClass *payobjclass;
+  gboolean result;
 
   g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
 
   priv = stream->priv;
 
-  payobjclass = G_OBJECT_GET_CLASS (priv->payloader);
-
   g_mutex_lock (&priv->lock);
+  result = priv->blocking;
+  g_mutex_unlock (&priv->lock);
 
-  if (g_object_class_find_property (payobjclass, "stats")) {
-    g_object_get (priv->payloader, "stats", &stats, NULL);
-    if (stats == NULL)
-      goto no_stats;
-
-    if (seq)
-      gst_structure_get_uint (stats, "seqnum", seq);
+  return result;
+}
 
-    if (rtptime)
-      gst_structure_get_uint (stats, "timestamp", rtptime);
+static GstPadProbeReturn
+standby_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  return GST_PAD_PROBE_DROP;
+}
 
-    if (running_time)
-      gst_structure_get_clock_time (stats, "running-time", running_time);
+/**
+ * gst_rtsp_stream_set_standby:
+ * @stream: a #GstRTSPStream
+ * @standby: the new value
+ *
+ * Put @stream in standby. In standby, all data produced by the payloader is
+ * dropped before it reaches the session manager, so the pipeline can keep
+ * running without any network or fan-out cost.
+ *
+ * Returns: %TRUE on success
+ */
+gboolean
+gst_rtsp_stream_set_standby (GstRTSPStream * stream, gboolean standby)
+{
+  GstRTSPStreamPrivate *priv;
 
-    if (clock_rate) {
-      gst_structure_get_uint (stats, "clock-rate", clock_rate);
-      if (*clock_rate == 0 && running_time)
-        *running_time = GST_CLOCK_TIME_NONE;
-    }
-    gst_structure_free (stats);
-  } else {
-    if (!g_object_class_find_property (payobjclass, "seqnum") ||
-        !g_object_class_find_property (payobjclass, "timestamp"))
-      goto no_stats;
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
 
-    if (seq)
-      g_object_get (priv->payloader, "seqnum", seq, NULL);
+  priv = stream->priv;
 
-    if (rtptime)
-      g_object_get (priv->payloader, "timestamp", rtptime, NULL);
+  GST_LOG_OBJECT (stream, "set standby %d", standby);
 
-    if (running_time)
-      *running_time = GST_CLOCK_TIME_NONE;
+  g_mutex_lock (&priv->lock);
+  if (standby) {
+    if (priv->standby_id == 0) {
+      priv->standby_id = gst_pad_add_probe (priv->srcpad,
+          GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+          standby_probe, NULL, NULL);
+    }
+  } else {
+    if (priv->standby_id != 0) {
+      gst_pad_remove_probe (priv->srcpad, priv->standby_id);
+      priv->standby_id = 0;
+    }
   }
   g_mutex_unlock (&priv->lock);
 
   return TRUE;
-
-  /* ERRORS */
-no_stats:
-  {
-    GST_WARNING ("Could not get payloader stats");
-    g_mutex_unlock (&priv->lock);
-    return FALSE;
-  }
 }
 
 /**
- * gst_rtsp_stream_get_caps:
+ * gst_rtsp_stream_is_standby:
  * @stream: a #GstRTSPStream
  *
- * Retrieve the current caps of @stream.
+ * Check if @stream is in standby.
  *
- * Returns: (transfer full): the #GstCaps of @stream. use gst_caps_unref()
- *    after usage.
+ * Returns: %TRUE if @stream drops all data from the payloader.
  */
-GstCaps *
-gst_rtsp_stream_get_caps (GstRTSPStream * stream)
+gboolean
+gst_rtsp_stream_is_standby (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv;
+  gboolean result;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
+
+  priv = stream->priv;
+
+  g_mutex_lock (&priv->lock);
+  result = priv->standby_id != 0;
+  g_mutex_unlock (&priv->lock);
+
+  return result;
+}
+
+static GstPadProbeReturn
+key_unit_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
 {
   GstRTSPStreamPrivate *priv;
-  GstCaps *result;
-
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
+  GstRTSPStream *stream;
+  GstPadProbeReturn ret = GST_PAD_PROBE_OK;
 
+  stream = user_data;
   priv = stream->priv;
 
   g_mutex_lock (&priv->lock);
-  if ((result = priv->caps))
-    gst_caps_ref (result);
+  if (info->type & GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM) {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+    const GstStructure *s;
+
+    /* the encoder sends this event right before the forced key unit */
+    if (GST_EVENT_TYPE (event) == GST_EVENT_CUSTOM_DOWNSTREAM &&
+        (s = gst_event_get_structure (event)) &&
+        gst_structure_has_name (s, "GstForceKeyUnit"))
+      priv->key_unit_forced = TRUE;
+  } else if (priv->key_unit_forced) {
+    /* first data after the event is the key unit leaving the payloader */
+    priv->key_unit_latency =
+        (g_get_monotonic_time () - priv->key_unit_start) * GST_USECOND;
+    priv->key_unit_forced = FALSE;
+    priv->key_unit_start = 0;
+    priv->key_unit_id = 0;
+
+    GST_DEBUG_OBJECT (pad, "key unit after %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (priv->key_unit_latency));
+
+    ret = GST_PAD_PROBE_REMOVE;
+  } else if (g_get_monotonic_time () - priv->key_unit_start >
+      KEY_UNIT_TIMEOUT) {
+    /* the encoder ignored the request or did not tell us about the key
+     * unit, there is nothing to measure */
+    GST_DEBUG_OBJECT (pad, "no forced key unit, giving up");
+    priv->key_unit_start = 0;
+    priv->key_unit_id = 0;
+
+    ret = GST_PAD_PROBE_REMOVE;
+  }
   g_mutex_unlock (&priv->lock);
 
-  return result;
+  return ret;
+}
+
+/* an upstream force-key-unit event, this is what
+ * gst_video_event_new_upstream_force_key_unit() makes, we don't want to
+ * depend on libgstvideo for it */
+GstEvent *
+gst_rtsp_force_key_unit_event_new (void)
+{
+  return gst_event_new_custom (GST_EVENT_CUSTOM_UPSTREAM,
+      gst_structure_new ("GstForceKeyUnit",
+          "running-time", GST_TYPE_CLOCK_TIME, GST_CLOCK_TIME_NONE,
+          "all-headers", G_TYPE_BOOLEAN, TRUE,
+          "count", G_TYPE_UINT, 0, NULL));
 }
 
 /**
- * gst_rtsp_stream_recv_rtp:
+ * gst_rtsp_stream_request_key_unit:
  * @stream: a #GstRTSPStream
- * @buffer: (transfer full): a #GstBuffer
  *
- * Handle an RTP buffer for the stream. This method is usually called when a
- * message has been received from a client using the TCP transport.
+ * Send an upstream force-key-unit event from the payloader of @stream so that
+ * the encoder produces a key unit as soon as possible.
  *
- * This function takes ownership of @buffer.
+ * The time until the key unit leaves the payloader is measured and can be
+ * retrieved with gst_rtsp_stream_get_key_unit_latency(). When a previous
+ * request is still pending, the measurement continues from that request.
  *
- * Returns: a GstFlowReturn.
+ * Returns: %TRUE if the event was handled upstream.
  */
-GstFlowReturn
-gst_rtsp_stream_recv_rtp (GstRTSPStream * stream, GstBuffer * buffer)
+gboolean
+gst_rtsp_stream_request_key_unit (GstRTSPStream * stream)
 {
   GstRTSPStreamPrivate *priv;
-  GstFlowReturn ret;
-  GstElement *element;
+  GstEvent *event;
+  gboolean res;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), GST_FLOW_ERROR);
   priv = stream->priv;
-  g_return_val_if_fail (GST_IS_BUFFER (buffer), GST_FLOW_ERROR);
-  g_return_val_if_fail (priv->is_joined, FALSE);
 
   g_mutex_lock (&priv->lock);
-  if (priv->appsrc[0])
-    element = gst_object_ref (priv->appsrc[0]);
-  else
-    element = NULL;
+  if (priv->key_unit_id == 0) {
+    priv->key_unit_start = g_get_monotonic_time ();
+    priv->key_unit_forced = FALSE;
+    priv->key_unit_id = gst_pad_add_probe (priv->srcpad,
+        GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM | GST_PAD_PROBE_TYPE_BUFFER |
+        GST_PAD_PROBE_TYPE_BUFFER_LIST, key_unit_probe,
+        g_object_ref (stream), g_object_unref);
+  }
   g_mutex_unlock (&priv->lock);
 
-  if (element) {
-    ret = gst_app_src_push_buffer (GST_APP_SRC_CAST (element), buffer);
-    gst_object_unref (element);
-  } else {
-    ret = GST_FLOW_OK;
-  }
-  return ret;
+  GST_DEBUG_OBJECT (stream, "requesting key unit");
+
+  event = gst_rtsp_force_key_unit_event_new ();
+  res = gst_pad_send_event (priv->srcpad, event);
+  if (!res)
+    GST_DEBUG_OBJECT (stream, "key unit request was not handled");
+
+  return res;
 }
 
 /**
- * gst_rtsp_stream_recv_rtcp:
+ * gst_rtsp_stream_get_key_unit_latency:
  * @stream: a #GstRTSPStream
- * @buffer: (transfer full): a #GstBuffer
- *
- * Handle an RTCP buffer for the stream. This method is usually called when a
- * message has been received from a client using the TCP transport.
  *
- * This function takes ownership of @buffer.
+ * Get the time it took for the last requested key unit to leave the payloader
+ * of @stream. See gst_rtsp_stream_request_key_unit().
  *
- * Returns: a GstFlowReturn.
+ * Returns: the key unit latency or #GST_CLOCK_TIME_NONE when no key unit
+ * was measured yet.
  */
-GstFlowReturn
-gst_rtsp_stream_recv_rtcp (GstRTSPStream * stream, GstBuffer * buffer)
+GstClockTime
+gst_rtsp_stream_get_key_unit_latency (GstRTSPStream * stream)
 {
   GstRTSPStreamPrivate *priv;
-  GstFlowReturn ret;
-  GstElement *element;
+  GstClockTime result;
+
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), GST_CLOCK_TIME_NONE);
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), GST_FLOW_ERROR);
   priv = stream->priv;
-  g_return_val_if_fail (GST_IS_BUFFER (buffer), GST_FLOW_ERROR);
-  g_return_val_if_fail (priv->is_joined, FALSE);
 
   g_mutex_lock (&priv->lock);
-  if (priv->appsrc[1])
-    element = gst_object_ref (priv->appsrc[1]);
-  else
-    element = NULL;
+  result = priv->key_unit_latency;
   g_mutex_unlock (&priv->lock);
 
-  if (element) {
-    ret = gst_app_src_push_buffer (GST_APP_SRC_CAST (element), buffer);
-    gst_object_unref (element);
-  } else {
-    ret = GST_FLOW_OK;
-  }
-  return ret;
+  return result;
 }
 
-/* must be called with lock */
+static StreamLayer *
+layer_new (GstRTSPStream * stream, guint idx, GstElement * payloader,
+    GstPad * srcpad)
+{
+  StreamLayer *layer;
+
+  layer = g_slice_new0 (StreamLayer);
+  layer->stream = stream;
+  layer->idx = idx;
+  layer->payloader = gst_object_ref (payloader);
+  layer->srcpad = gst_object_ref (srcpad);
+
+  return layer;
+}
+
+static void
+layer_free (StreamLayer * layer)
+{
+  gst_object_unref (layer->payloader);
+  gst_object_unref (layer->srcpad);
+  g_slice_free (StreamLayer, layer);
+}
+
+static void
+layer_client_free (LayerClient * client)
+{
+  if (client->socket)
+    g_object_unref (client->socket);
+  if (client->addr)
+    g_object_unref (client->addr);
+  g_slice_free (LayerClient, client);
+}
+
+/* must be called with lock. New clients start on the first layer with the
+ * sequence numbers of the payloader of @stream. The RTP header rewrite of
+ * the transport is applied after the layer switch, pacing and marking are
+ * not done for layered streams. */
 static gboolean
-update_transport (GstRTSPStream * stream, GstRTSPStreamTransport * trans,
-    gboolean add)
+layer_client_add (GstRTSPStream * stream, GstRTSPStreamTransport * trans)
 {
   GstRTSPStreamPrivate *priv = stream->priv;
   const GstRTSPTransport *tr;
+  LayerClient *client;
 
   tr = gst_rtsp_stream_transport_get_transport (trans);
 
-  switch (tr->lower_transport) {
-    case GST_RTSP_LOWER_TRANS_UDP:
-    case GST_RTSP_LOWER_TRANS_UDP_MCAST:
-    {
-      gchar *dest;
-      gint min, max;
-      guint ttl = 0;
-
-      dest = tr->destination;
-      if (tr->lower_transport == GST_RTSP_LOWER_TRANS_UDP_MCAST) {
-        min = tr->port.min;
-        max = tr->port.max;
-        ttl = tr->ttl;
-      } else {
-        min = tr->client_port.min;
-        max = tr->client_port.max;
-      }
+  if (tr->lower_transport == GST_RTSP_LOWER_TRANS_UDP &&
+      (rtp_is_marked (trans) || priv->pace_thread != NULL))
+    GST_WARNING ("stream %p is layered, RTP of transport %p is not paced "
+        "or marked", stream, trans);
 
-      if (add) {
-        if (ttl > 0) {
-          GST_INFO ("setting ttl-mc %d", ttl);
-          g_object_set (G_OBJECT (priv->udpsink[0]), "ttl-mc", ttl, NULL);
-          g_object_set (G_OBJECT (priv->udpsink[1]), "ttl-mc", ttl, NULL);
-        }
-        GST_INFO ("adding %s:%d-%d", dest, min, max);
-        g_signal_emit_by_name (priv->udpsink[0], "add", dest, min, NULL);
-        g_signal_emit_by_name (priv->udpsink[1], "add", dest, max, NULL);
-        priv->transports = g_list_prepend (priv->transports, trans);
-      } else {
-        GST_INFO ("removing %s:%d-%d", dest, min, max);
-        g_signal_emit_by_name (priv->udpsink[0], "remove", dest, min, NULL);
-        g_signal_emit_by_name (priv->udpsink[1], "remove", dest, max, NULL);
-        priv->transports = g_list_remove (priv->transports, trans);
-      }
-      break;
-    }
-    case GST_RTSP_LOWER_TRANS_TCP:
-      if (add) {
-        GST_INFO ("adding TCP %s", tr->destination);
-        priv->transports = g_list_prepend (priv->transports, trans);
-      } else {
-        GST_INFO ("removing TCP %s", tr->destination);
-        priv->transports = g_list_remove (priv->transports, trans);
-      }
-      break;
-    default:
-      goto unknown_transport;
+  client = g_slice_new0 (LayerClient);
+  client->trans = trans;
+  if (tr->lower_transport == GST_RTSP_LOWER_TRANS_UDP &&
+      !get_udp_destination (stream, tr, 0, &client->socket, &client->addr)) {
+    layer_client_free (client);
+    return FALSE;
   }
+  g_hash_table_insert (priv->layer_clients, trans, client);
+
   return TRUE;
+}
 
-  /* ERRORS */
-unknown_transport:
-  {
-    GST_INFO ("Unknown transport %d", tr->lower_transport);
-    return FALSE;
+/* must be called with lock. TCP clients get the packet right away, the
+ * packets for UDP clients are added to @packets. */
+static void
+layer_client_send (LayerClient * client, guint8 * header, GstBuffer * buffer,
+    GArray ** packets)
+{
+  if (client->socket) {
+    LayerPacket packet;
+    guint32 ssrc, rtptime_offset;
+    guint16 seq_offset;
+
+    packet.socket = g_object_ref (client->socket);
+    packet.addr = g_object_ref (client->addr);
+    memcpy (packet.header, header, 12);
+    /* TCP clients get the rewrite in gst_rtsp_stream_transport_send_rtp() */
+    if (gst_rtsp_stream_transport_get_rtp_rewrite (client->trans, &ssrc,
+            &seq_offset, &rtptime_offset)) {
+      GST_WRITE_UINT16_BE (packet.header + 2,
+          GST_READ_UINT16_BE (header + 2) + seq_offset);
+      GST_WRITE_UINT32_BE (packet.header + 4,
+          GST_READ_UINT32_BE (header + 4) + rtptime_offset);
+      GST_WRITE_UINT32_BE (packet.header + 8, ssrc);
+    }
+    if (*packets == NULL)
+      *packets = g_array_new (FALSE, FALSE, sizeof (LayerPacket));
+    g_array_append_val (*packets, packet);
+  } else {
+    GstBuffer *out;
+
+    out = gst_buffer_new_allocate (NULL, 12, NULL);
+    gst_buffer_fill (out, 0, header, 12);
+    out = gst_buffer_append (out, gst_buffer_copy_region (buffer,
+            GST_BUFFER_COPY_MEMORY, 12, -1));
+    gst_rtsp_stream_transport_send_rtp (client->trans, out);
+    gst_buffer_unref (out);
   }
 }
 
+/* must be called with lock */
+static void
+layer_send (GstRTSPStream * stream, StreamLayer * layer, GstBuffer * buffer,
+    GstMapInfo * map, GArray ** packets)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GHashTableIter iter;
+  LayerClient *client;
+  guint8 header[12];
+  guint16 seq;
+  gboolean key;
+
+  key = layer->key_pending;
+  layer->key_pending = FALSE;
+
+  seq = GST_READ_UINT16_BE (map->data + 2);
+  if (layer->idx == 0) {
+    priv->layer_ssrc = GST_READ_UINT32_BE (map->data + 8);
+    priv->have_layer_ssrc = TRUE;
+  }
 
-/**
- * gst_rtsp_stream_add_transport:
- * @stream: a #GstRTSPStream
- * @trans: a #GstRTSPStreamTransport
- *
- * Add the transport in @trans to @stream. The media of @stream will
- * then also be send to the values configured in @trans.
- *
- * @stream must be joined to a bin.
- *
- * @trans must contain a valid #GstRTSPTransport.
- *
- * Returns: %TRUE if @trans was added
- */
-gboolean
-gst_rtsp_stream_add_transport (GstRTSPStream * stream,
-    GstRTSPStreamTransport * trans)
+  /* all layers are sent with the SSRC of the first layer */
+  memcpy (header, map->data, 12);
+  if (priv->have_layer_ssrc)
+    GST_WRITE_UINT32_BE (header + 8, priv->layer_ssrc);
+
+  g_hash_table_iter_init (&iter, priv->layer_clients);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & client)) {
+    if (client->layer != layer->idx) {
+      /* switch on the first packet of a key unit of the new layer */
+      if (!key || client->target != layer->idx)
+        continue;
+
+      GST_DEBUG ("transport %p switches from layer %u to %u", client->trans,
+          client->layer, layer->idx);
+      client->layer = layer->idx;
+      client->seq_offset = client->have_seq ? client->last_seq + 1 - seq : 0;
+    }
+    client->last_seq = seq + client->seq_offset;
+    client->have_seq = TRUE;
+
+    GST_WRITE_UINT16_BE (header + 2, client->last_seq);
+    layer_client_send (client, header, buffer, packets);
+  }
+}
+
+static void
+layer_send_buffer (GstRTSPStream * stream, StreamLayer * layer,
+    GstBuffer * buffer)
 {
-  GstRTSPStreamPrivate *priv;
-  gboolean res;
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GArray *packets = NULL;
+  GstMapInfo map;
+  guint i;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
-  priv = stream->priv;
-  g_return_val_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans), FALSE);
-  g_return_val_if_fail (priv->is_joined, FALSE);
+  if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+    return;
 
   g_mutex_lock (&priv->lock);
-  res = update_transport (stream, trans, TRUE);
+  if (priv->layer_clients && g_hash_table_size (priv->layer_clients) > 0 &&
+      map.size >= 12)
+    layer_send (stream, layer, buffer, &map, &packets);
+  else
+    layer->key_pending = FALSE;
   g_mutex_unlock (&priv->lock);
 
-  return res;
+  /* the socket sends can block, they are done without the lock. The payload
+   * is sent from the packet of the layer. */
+  for (i = 0; packets && i < packets->len; i++) {
+    LayerPacket *packet = &g_array_index (packets, LayerPacket, i);
+    GOutputVector vec[2];
+
+    vec[0].buffer = packet->header;
+    vec[0].size = 12;
+    vec[1].buffer = map.data + 12;
+    vec[1].size = map.size - 12;
+    g_socket_send_message (packet->socket, packet->addr, vec, 2, NULL, 0, 0,
+        NULL, NULL);
+    g_object_unref (packet->socket);
+    g_object_unref (packet->addr);
+  }
+  if (packets)
+    g_array_free (packets, TRUE);
+
+  gst_buffer_unmap (buffer, &map);
 }
 
-/**
- * gst_rtsp_stream_remove_transport:
- * @stream: a #GstRTSPStream
- * @trans: a #GstRTSPStreamTransport
- *
- * Remove the transport in @trans from @stream. The media of @stream will
- * not be sent to the values configured in @trans.
- *
- * @stream must be joined to a bin.
- *
- * @trans must contain a valid #GstRTSPTransport.
- *
- * Returns: %TRUE if @trans was removed
- */
-gboolean
-gst_rtsp_stream_remove_transport (GstRTSPStream * stream,
-    GstRTSPStreamTransport * trans)
+static GstPadProbeReturn
+layer_key_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
 {
-  GstRTSPStreamPrivate *priv;
-  gboolean res;
+  StreamLayer *layer = user_data;
+  GstRTSPStreamPrivate *priv = layer->stream->priv;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
-  priv = stream->priv;
-  g_return_val_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans), FALSE);
-  g_return_val_if_fail (priv->is_joined, FALSE);
+  if (probe_is_key_unit (info)) {
+    g_mutex_lock (&priv->lock);
+    layer->key_pending = TRUE;
+    g_mutex_unlock (&priv->lock);
+  }
+  return GST_PAD_PROBE_OK;
+}
 
-  g_mutex_lock (&priv->lock);
-  res = update_transport (stream, trans, FALSE);
-  g_mutex_unlock (&priv->lock);
+static GstPadProbeReturn
+layer_send_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  StreamLayer *layer = user_data;
 
-  return res;
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint i, len;
+
+    len = gst_buffer_list_length (list);
+    for (i = 0; i < len; i++)
+      layer_send_buffer (layer->stream, layer, gst_buffer_list_get (list, i));
+  } else {
+    layer_send_buffer (layer->stream, layer, GST_PAD_PROBE_INFO_BUFFER (info));
+  }
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* must be called with lock */
+static void
+layers_join (GstRTSPStream * stream, GstBin * bin, GstState state)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GstPadLinkReturn ret;
+  guint ts_offset, i;
+
+  /* all layers must make the same RTP timestamps */
+  g_object_get (priv->payloader, "timestamp-offset", &ts_offset, NULL);
+  if (ts_offset == G_MAXUINT32) {
+    ts_offset = g_random_int ();
+    g_object_set (priv->payloader, "timestamp-offset", ts_offset, NULL);
+  }
+
+  priv->layer_clients = g_hash_table_new_full (NULL, NULL, NULL,
+      (GDestroyNotify) layer_client_free);
+  priv->have_layer_ssrc = FALSE;
+
+  for (i = 0; i < priv->layers->len; i++) {
+    StreamLayer *layer = g_ptr_array_index (priv->layers, i);
+    GstPad *pad;
+
+    if (i > 0) {
+      g_object_set (layer->payloader, "timestamp-offset", ts_offset, NULL);
+
+      /* the packets are sent to the clients from the probe, the fakesink
+       * only keeps the layer running at the same pace as the udpsink */
+      layer->fakesink = gst_element_factory_make ("fakesink", NULL);
+      g_object_set (layer->fakesink, "async", FALSE, NULL);
+      gst_bin_add (bin, layer->fakesink);
+      pad = gst_element_get_static_pad (layer->fakesink, "sink");
+      ret = gst_pad_link (layer->srcpad, pad);
+      gst_object_unref (pad);
+      if (ret != GST_PAD_LINK_OK) {
+        /* clients are never moved to a layer without key units */
+        GST_WARNING ("can't link layer %u: %d", i, ret);
+        gst_bin_remove (bin, layer->fakesink);
+        layer->fakesink = NULL;
+        continue;
+      }
+      if (state != GST_STATE_NULL)
+        gst_element_set_state (layer->fakesink, state);
+    }
+
+    layer->key_pending = FALSE;
+    if ((pad = gst_element_get_static_pad (layer->payloader, "sink"))) {
+      layer->key_id = gst_pad_add_probe (pad,
+          GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+          layer_key_probe, layer, NULL);
+      gst_object_unref (pad);
+    }
+    layer->send_id = gst_pad_add_probe (layer->srcpad,
+        GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+        layer_send_probe, layer, NULL);
+  }
+}
+
+/* must be called with lock */
+static void
+layers_leave (GstRTSPStream * stream, GstBin * bin)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  guint i;
+
+  for (i = 0; i < priv->layers->len; i++) {
+    StreamLayer *layer = g_ptr_array_index (priv->layers, i);
+    GstPad *pad;
+
+    if (layer->key_id != 0) {
+      pad = gst_element_get_static_pad (layer->payloader, "sink");
+      gst_pad_remove_probe (pad, layer->key_id);
+      gst_object_unref (pad);
+      layer->key_id = 0;
+    }
+    if (layer->send_id != 0) {
+      gst_pad_remove_probe (layer->srcpad, layer->send_id);
+      layer->send_id = 0;
+    }
+
+    if (layer->fakesink) {
+      gst_element_set_state (layer->fakesink, GST_STATE_NULL);
+      gst_bin_remove (bin, layer->fakesink);
+      layer->fakesink = NULL;
+    }
+  }
+  g_hash_table_unref (priv->layer_clients);
+  priv->layer_clients = NULL;
 }
 
-/**
- * gst_rtsp_stream_get_rtp_socket:
- * @stream: a #GstRTSPStream
- * @family: the socket family
- *
- * Get the RTP socket from @stream for a @family.
- *
- * @stream must be joined to a bin.
- *
- * Returns: the RTP socket or %NULL if no socket could be allocated for @family.
- *     Unref after usage
- */
-GSocket *
-gst_rtsp_stream_get_rtp_socket (GstRTSPStream * stream, GSocketFamily family)
+/* must be called with lock, returns the srcpad of the layer that should make
+ * a key unit for the switch */
+static GstPad *
+layer_client_set_target (GstRTSPStream * stream, LayerClient * client,
+    guint target)
 {
-  GstRTSPStreamPrivate *priv = GST_RTSP_STREAM_GET_PRIVATE (stream);
-  GSocket *socket;
-  const gchar *name;
+  GstRTSPStreamPrivate *priv = stream->priv;
+  StreamLayer *layer;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
-  g_return_val_if_fail (family == G_SOCKET_FAMILY_IPV4 ||
-      family == G_SOCKET_FAMILY_IPV6, NULL);
-  g_return_val_if_fail (priv->udpsink[0], NULL);
+  client->target = target;
+  client->good_reports = 0;
 
-  if (family == G_SOCKET_FAMILY_IPV6)
-    name = "socket-v6";
-  else
-    name = "socket";
+  if (client->layer == target)
+    return NULL;
 
-  g_object_get (priv->udpsink[0], name, &socket, NULL);
+  GST_INFO ("transport %p switching from layer %u to %u", client->trans,
+      client->layer, target);
 
-  return socket;
+  layer = g_ptr_array_index (priv->layers, target);
+  return gst_object_ref (layer->srcpad);
 }
 
-/**
- * gst_rtsp_stream_get_rtcp_socket:
- * @stream: a #GstRTSPStream
- * @family: the socket family
- *
- * Get the RTCP socket from @stream for a @family.
- *
- * @stream must be joined to a bin.
- *
- * Returns: the RTCP socket or %NULL if no socket could be allocated for
- *     @family. Unref after usage
- */
-GSocket *
-gst_rtsp_stream_get_rtcp_socket (GstRTSPStream * stream, GSocketFamily family)
+/* look at the last receiver report in @stats of the RTCP sender of @trans and
+ * pick the layer for @trans */
+static void
+layers_check_report (GstRTSPStream * stream, GstRTSPStreamTransport * trans,
+    const GstStructure * stats)
 {
-  GstRTSPStreamPrivate *priv = GST_RTSP_STREAM_GET_PRIVATE (stream);
-  GSocket *socket;
-  const gchar *name;
+  GstRTSPStreamPrivate *priv = stream->priv;
+  LayerClient *client;
+  guint fractionlost = 0, jitter = 0;
+  gint clock_rate = 0;
+  GstClockTime jitter_time;
+  GstPad *pad = NULL;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
-  g_return_val_if_fail (family == G_SOCKET_FAMILY_IPV4 ||
-      family == G_SOCKET_FAMILY_IPV6, NULL);
-  g_return_val_if_fail (priv->udpsink[1], NULL);
+  if (priv->layers == NULL)
+    return;
 
-  if (family == G_SOCKET_FAMILY_IPV6)
-    name = "socket-v6";
-  else
-    name = "socket";
+  gst_structure_get_uint (stats, "rb-fractionlost", &fractionlost);
+  gst_structure_get_uint (stats, "rb-jitter", &jitter);
 
-  g_object_get (priv->udpsink[1], name, &socket, NULL);
+  g_mutex_lock (&priv->lock);
+  if (priv->layer_clients == NULL ||
+      !(client = g_hash_table_lookup (priv->layer_clients, trans)))
+    goto done;
 
-  return socket;
+  if (priv->caps)
+    gst_structure_get_int (gst_caps_get_structure (priv->caps, 0),
+        "clock-rate", &clock_rate);
+  if (clock_rate <= 0)
+    clock_rate = 90000;
+  jitter_time = gst_util_uint64_scale_int (jitter, GST_SECOND, clock_rate);
+
+  GST_LOG ("transport %p on layer %u: fraction lost %u, jitter %"
+      GST_TIME_FORMAT, trans, client->layer, fractionlost,
+      GST_TIME_ARGS (jitter_time));
+
+  /* wait for the pending switch */
+  if (client->layer != client->target)
+    goto done;
+
+  if (fractionlost > LAYER_DOWN_FRACTION_LOST ||
+      jitter_time > LAYER_DOWN_JITTER) {
+    if (client->layer + 1 < priv->layers->len)
+      pad = layer_client_set_target (stream, client, client->layer + 1);
+    client->good_reports = 0;
+  } else if (fractionlost == 0 && jitter_time < LAYER_DOWN_JITTER / 4) {
+    if (++client->good_reports >= LAYER_UP_REPORTS && client->layer > 0)
+      pad = layer_client_set_target (stream, client, client->layer - 1);
+  } else {
+    client->good_reports = 0;
+  }
+
+done:
+  g_mutex_unlock (&priv->lock);
+
+  if (pad) {
+    gst_pad_send_event (pad, gst_rtsp_force_key_unit_event_new ());
+    gst_object_unref (pad);
+  }
 }
 
 /**
- * gst_rtsp_stream_transport_filter:
+ * gst_rtsp_stream_add_layer:
  * @stream: a #GstRTSPStream
- * @func: (scope call) (allow-none): a callback
- * @user_data: user data passed to @func
- *
- * Call @func for each transport managed by @stream. The result value of @func
- * determines what happens to the transport. @func will be called with @stream
- * locked so no further actions on @stream can be performed from @func.
- *
- * If @func returns #GST_RTSP_FILTER_REMOVE, the transport will be removed from
- * @stream.
+ * @payloader: a #GstElement
+ * @srcpad: the source #GstPad of @payloader
  *
- * If @func returns #GST_RTSP_FILTER_KEEP, the transport will remain in @stream.
+ * Add @payloader as another encoding of the media of @stream, for example at
+ * a lower bitrate. All layers must use the same codec, payload type and
+ * clock-rate.
  *
- * If @func returns #GST_RTSP_FILTER_REF, the transport will remain in @stream but
- * will also be added with an additional ref to the result #GList of this
- * function..
+ * Each unicast client receives one of the layers, starting with the payloader
+ * of @stream. A client is moved to the next layer when its RTCP receiver
+ * reports show loss or jitter and back when the reports are clean again.
+ * The switch happens on a key unit of the new layer and the SSRC and sequence
+ * numbers are rewritten so that the client sees one RTP stream. Multicast
+ * clients always receive the first layer.
  *
- * When @func is %NULL, #GST_RTSP_FILTER_REF will be assumed for each transport.
+ * @stream must not be joined to a bin.
  *
- * Returns: (element-type GstRTSPStreamTransport) (transfer full): a #GList with all
- * transports for which @func returned #GST_RTSP_FILTER_REF. After usage, each
- * element in the #GList should be unreffed before the list is freed.
+ * Returns: the index of the new layer or 0 on error.
  */
-GList *
-gst_rtsp_stream_transport_filter (GstRTSPStream * stream,
-    GstRTSPStreamTransportFilterFunc func, gpointer user_data)
+guint
+gst_rtsp_stream_add_layer (GstRTSPStream * stream, GstElement * payloader,
+    GstPad * srcpad)
 {
   GstRTSPStreamPrivate *priv;
-  GList *result, *walk, *next;
+  guint idx;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), NULL);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), 0);
+  g_return_val_if_fail (GST_IS_ELEMENT (payloader), 0);
+  g_return_val_if_fail (GST_IS_PAD (srcpad), 0);
 
   priv = stream->priv;
 
-  result = NULL;
-
   g_mutex_lock (&priv->lock);
-  for (walk = priv->transports; walk; walk = next) {
-    GstRTSPStreamTransport *trans = walk->data;
-    GstRTSPFilterResult res;
-
-    next = g_list_next (walk);
-
-    if (func)
-      res = func (stream, trans, user_data);
-    else
-      res = GST_RTSP_FILTER_REF;
+  if (priv->is_joined)
+    goto was_joined;
 
-    switch (res) {
-      case GST_RTSP_FILTER_REMOVE:
-        update_transport (stream, trans, FALSE);
-        break;
-      case GST_RTSP_FILTER_REF:
-        result = g_list_prepend (result, g_object_ref (trans));
-        break;
-      case GST_RTSP_FILTER_KEEP:
-      default:
-        break;
-    }
+  if (priv->layers == NULL) {
+    priv->layers = g_ptr_array_new_with_free_func ((GDestroyNotify) layer_free);
+    g_ptr_array_add (priv->layers, layer_new (stream, 0, priv->payloader,
+            priv->srcpad));
   }
+  idx = priv->layers->len;
+  g_ptr_array_add (priv->layers, layer_new (stream, idx, payloader, srcpad));
   g_mutex_unlock (&priv->lock);
 
-  return result;
+  GST_INFO ("stream %p has layer %u with payloader %p", stream, idx,
+      payloader);
+
+  return idx;
+
+  /* ERRORS */
+was_joined:
+  {
+    g_mutex_unlock (&priv->lock);
+    GST_WARNING ("stream %p is joined, can't add layers", stream);
+    return 0;
+  }
 }
 
-static GstPadProbeReturn
-pad_blocking (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+/**
+ * gst_rtsp_stream_get_n_layers:
+ * @stream: a #GstRTSPStream
+ *
+ * Get the number of layers of @stream, see gst_rtsp_stream_add_layer().
+ *
+ * Returns: the number of layers, 1 when @stream has no extra layers.
+ */
+guint
+gst_rtsp_stream_get_n_layers (GstRTSPStream * stream)
 {
   GstRTSPStreamPrivate *priv;
-  GstRTSPStream *stream;
+  guint result;
 
-  stream = user_data;
-  priv = stream->priv;
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), 0);
 
-  GST_DEBUG_OBJECT (pad, "now blocking");
+  priv = stream->priv;
 
   g_mutex_lock (&priv->lock);
-  priv->blocking = TRUE;
+  result = priv->layers ? priv->layers->len : 1;
   g_mutex_unlock (&priv->lock);
 
-  gst_element_post_message (priv->payloader,
-      gst_message_new_element (GST_OBJECT_CAST (priv->payloader),
-          gst_structure_new_empty ("GstRTSPStreamBlocking")));
-
-  return GST_PAD_PROBE_OK;
+  return result;
 }
 
 /**
- * gst_rtsp_stream_set_blocked:
+ * gst_rtsp_stream_set_transport_layer:
  * @stream: a #GstRTSPStream
- * @blocked: boolean indicating we should block or unblock
+ * @trans: a #GstRTSPStreamTransport of @stream
+ * @layer: the layer index
  *
- * Blocks or unblocks the dataflow on @stream.
+ * Move the unicast transport @trans to @layer. The switch happens on the next
+ * key unit of @layer, which is requested from the encoder. Later receiver
+ * reports of the client can move it to another layer again.
  *
- * Returns: %TRUE on success
+ * Returns: %TRUE when @trans will be moved to @layer.
  */
 gboolean
-gst_rtsp_stream_set_blocked (GstRTSPStream * stream, gboolean blocked)
+gst_rtsp_stream_set_transport_layer (GstRTSPStream * stream,
+    GstRTSPStreamTransport * trans, guint layer)
 {
   GstRTSPStreamPrivate *priv;
+  LayerClient *client;
+  GstPad *pad;
 
   g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans), FALSE);
 
   priv = stream->priv;
 
   g_mutex_lock (&priv->lock);
-  if (blocked) {
-    priv->blocking = FALSE;
-    if (priv->blocked_id == 0) {
-      priv->blocked_id = gst_pad_add_probe (priv->srcpad,
-          GST_PAD_PROBE_TYPE_BLOCK | GST_PAD_PROBE_TYPE_BUFFER |
-          GST_PAD_PROBE_TYPE_BUFFER_LIST, pad_blocking,
-          g_object_ref (stream), g_object_unref);
-    }
-  } else {
-    if (priv->blocked_id != 0) {
-      gst_pad_remove_probe (priv->srcpad, priv->blocked_id);
-      priv->blocked_id = 0;
-      priv->blocking = FALSE;
-    }
-  }
+  if (priv->layers == NULL || layer >= priv->layers->len)
+    goto no_layer;
+  if (priv->layer_clients == NULL ||
+      !(client = g_hash_table_lookup (priv->layer_clients, trans)))
+    goto no_client;
+
+  pad = layer_client_set_target (stream, client, layer);
   g_mutex_unlock (&priv->lock);
 
+  if (pad) {
+    gst_pad_send_event (pad, gst_rtsp_force_key_unit_event_new ());
+    gst_object_unref (pad);
+  }
   return TRUE;
+
+  /* ERRORS */
+no_layer:
+  {
+    g_mutex_unlock (&priv->lock);
+    GST_WARNING ("stream %p has no layer %u", stream, layer);
+    return FALSE;
+  }
+no_client:
+  {
+    g_mutex_unlock (&priv->lock);
+    GST_WARNING ("transport %p does not receive layers", trans);
+    return FALSE;
+  }
 }
 
 /**
- * gst_rtsp_stream_is_blocking:
+ * gst_rtsp_stream_get_transport_layer:
  * @stream: a #GstRTSPStream
+ * @trans: a #GstRTSPStreamTransport of @stream
  *
- * Check if @stream is blocking on a #GstBuffer.
+ * Get the layer that the transport @trans currently receives.
  *
- * Returns: %TRUE if @stream is blocking
+ * Returns: the layer index of @trans, 0 when @trans doesn't receive layers.
  */
-gboolean
-gst_rtsp_stream_is_blocking (GstRTSPStream * stream)
+guint
+gst_rtsp_stream_get_transport_layer (GstRTSPStream * stream,
+    GstRTSPStreamTransport * trans)
 {
   GstRTSPStreamPrivate *priv;
-  gboolean result;
+  LayerClient *client;
+  guint result = 0;
 
-  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), FALSE);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM (stream), 0);
+  g_return_val_if_fail (GST_IS_RTSP_STREAM_TRANSPORT (trans), 0);
 
   priv = stream->priv;
 
   g_mutex_lock (&priv->lock);
-  result = priv->blocking;
+  if (priv->layer_clients &&
+      (client = g_hash_table_lookup (priv->layer_clients, trans)))
+    result = client->layer;
   g_mutex_unlock (&priv->lock);
 
   return result;
 }
+
+static const gchar *
+find_bitrate_property (GstElement * element)
+{
+  static const gchar *names[] = { "bitrate", "target-bitrate" };
+  GParamSpec *pspec;
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (names); i++) {
+    pspec = g_object_class_find_property (G_OBJECT_GET_CLASS (element),
+        names[i]);
+    if (pspec && (pspec->flags & G_PARAM_WRITABLE) &&
+        (pspec->value_type == G_TYPE_INT || pspec->value_type == G_TYPE_UINT))
+      return names[i];
+  }
+  return NULL;
+}
+
+/* must be called with lock. Find the encoder upstream of the payloader, going
+ * through parsers, queues and capsfilters. */
+static void
+rate_control_join (GstRTSPStream * stream)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GstElement *element, *upstream;
+  GValue value = G_VALUE_INIT;
+  GstPad *pad, *peer;
+  guint i;
+
+  if (priv->encoder)
+    return;
+
+  element = gst_object_ref (priv->payloader);
+  for (i = 0; element && i < RATE_MAX_ENCODER_DEPTH; i++) {
+    upstream = NULL;
+    if ((pad = gst_element_get_static_pad (element, "sink"))) {
+      if ((peer = gst_pad_get_peer (pad))) {
+        upstream = gst_pad_get_parent_element (peer);
+        gst_object_unref (peer);
+      }
+      gst_object_unref (pad);
+    }
+    gst_object_unref (element);
+    element = upstream;
+
+    if (element && (priv->encoder_prop = find_bitrate_property (element)))
+      break;
+  }
+  if (element == NULL || priv->encoder_prop == NULL)
+    goto no_encoder;
+
+  priv->encoder = element;
+
+  g_value_init (&value, G_TYPE_UINT);
+  g_object_get_property (G_OBJECT (element), priv->encoder_prop, &value);
+  priv->max_bitrate = g_value_get_uint (&value);
+  priv->bitrate = priv->max_bitrate;
+  priv->min_rtt = GST_CLOCK_TIME_NONE;
+  g_value_unset (&value);
+
+  GST_INFO ("stream %p controls %s of %s, starting at %u", stream,
+      priv->encoder_prop, GST_ELEMENT_NAME (element), priv->max_bitrate);
+
+  return;
+
+  /* ERRORS */
+no_encoder:
+  {
+    GST_WARNING ("stream %p has no encoder with a bitrate property", stream);
+    if (element)
+      gst_object_unref (element);
+    return;
+  }
+}
+
+/* must be called with lock. Returns the encoder with the property and the
+ * bitrate it had before we took control, to be passed to
+ * rate_control_restore() after releasing the lock. */
+static GstElement *
+rate_control_leave (GstRTSPStream * stream, const gchar ** prop,
+    guint * bitrate)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  GstElement *encoder;
+
+  encoder = priv->encoder;
+  *prop = priv->encoder_prop;
+  *bitrate = priv->max_bitrate;
+
+  priv->encoder = NULL;
+  priv->encoder_prop = NULL;
+
+  return encoder;
+}
+
+/* set the original bitrate back on the encoder and release it. Must be called
+ * without the lock, the encoder can block in set_property until its
+ * streaming thread, which might be waiting for our lock, is done. */
+static void
+rate_control_restore (GstElement * encoder, const gchar * prop,
+    guint bitrate)
+{
+  GValue value = G_VALUE_INIT;
+
+  GST_INFO ("restore %s of %s to %u", prop, GST_ELEMENT_NAME (encoder),
+      bitrate);
+
+  g_value_init (&value, G_TYPE_UINT);
+  g_value_set_uint (&value, bitrate);
+  g_object_set_property (G_OBJECT (encoder), prop, &value);
+  g_value_unset (&value);
+  gst_object_unref (encoder);
+}
+
+/* look at the last receiver report in @stats of the RTCP sender of @trans and
+ * update the encoder bitrate */
+static void
+rate_control_check_report (GstRTSPStream * stream,
+    GstRTSPStreamTransport * trans, const GstStructure * stats)
+{
+  GstRTSPStreamPrivate *priv = stream->priv;
+  const GstRTSPTransport *tr;
+  guint fractionlost = 0, rtt = 0, bitrate;
+  GstClockTime rtt_time, queue_time = 0;
+  gboolean congested = FALSE;
+  GstElement *encoder = NULL;
+  GValue value = G_VALUE_INIT;
+  const gchar *prop = NULL;
+
+  gst_structure_get_uint (stats, "rb-fractionlost", &fractionlost);
+  /* in 1/65536 seconds */
+  gst_structure_get_uint (stats, "rb-round-trip", &rtt);
+  rtt_time = gst_util_uint64_scale_int (rtt, GST_SECOND, 65536);
+
+  tr = gst_rtsp_stream_transport_get_transport (trans);
+
+  g_mutex_lock (&priv->lock);
+  if (!priv->adaptive_bitrate || priv->encoder == NULL)
+    goto done;
+
+  /* queues building up in the network make the round-trip time grow */
+  if (rtt_time > 0) {
+    if (!GST_CLOCK_TIME_IS_VALID (priv->min_rtt) || rtt_time < priv->min_rtt)
+      priv->min_rtt = rtt_time;
+    if (rtt_time > priv->min_rtt + RATE_MAX_QUEUING_DELAY)
+      congested = TRUE;
+  }
+  /* TCP doesn't lose packets, they pile up in our queue instead */
+  if (tr->lower_transport == GST_RTSP_LOWER_TRANS_TCP && priv->appqueue[0]) {
+    g_object_get (priv->appqueue[0], "current-level-time", &queue_time, NULL);
+    if (queue_time > RATE_MAX_TCP_QUEUE)
+      congested = TRUE;
+  }
+
+  bitrate = priv->bitrate;
+  if (fractionlost > RATE_DECREASE_FRACTION_LOST) {
+    /* bitrate * (1 - 0.5 * loss) */
+    bitrate -= gst_util_uint64_scale_int (bitrate, fractionlost, 512);
+  } else if (congested) {
+    bitrate = gst_util_uint64_scale_int (bitrate, 85, 100);
+  } else if (fractionlost < RATE_INCREASE_FRACTION_LOST) {
+    bitrate = gst_util_uint64_scale_int (bitrate, 105, 100) + 1;
+  }
+  bitrate = CLAMP (bitrate, priv->max_bitrate / RATE_MIN_DIVIDER,
+      priv->max_bitrate);
+
+  GST_LOG ("stream %p: fraction lost %u, rtt %" GST_TIME_FORMAT ", queue %"
+      GST_TIME_FORMAT ", %s %u -> %u", stream, fractionlost,
+      GST_TIME_ARGS (rtt_time), GST_TIME_ARGS (queue_time),
+      priv->encoder_prop, priv->bitrate, bitrate);
+
+  if (bitrate != priv->bitrate) {
+    priv->bitrate = bitrate;
+    encoder = gst_object_ref (priv->encoder);
+    prop = priv->encoder_prop;
+  }
+
+done:
+  g_mutex_unlock (&priv->lock);
+
+  if (encoder) {
+    g_value_init (&value, G_TYPE_UINT);
+    g_value_set_uint (&value, bitrate);
+    g_object_set_property (G_OBJECT (encoder), prop, &value);
+    g_value_unset (&value);
+    gst_object_unref (encoder);
+  }
+}
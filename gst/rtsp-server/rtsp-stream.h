@@ -43,6 +43,7 @@ typedef struct _GstRTSPStreamPrivate GstRTSPStreamPrivate;
 
 #include "rtsp-stream-transport.h"
 #include "rtsp-address-pool.h"
+#include "rtsp-socket-pool.h"
 #include "rtsp-session.h"
 
 /**
@@ -79,6 +80,39 @@ gboolean          gst_rtsp_stream_has_control      (GstRTSPStream *stream, const
 void              gst_rtsp_stream_set_mtu          (GstRTSPStream *stream, guint mtu);
 guint             gst_rtsp_stream_get_mtu          (GstRTSPStream *stream);
 
+void              gst_rtsp_stream_set_buffer_size  (GstRTSPStream *stream, guint size);
+guint             gst_rtsp_stream_get_buffer_size  (GstRTSPStream *stream);
+
+void              gst_rtsp_stream_set_low_latency  (GstRTSPStream *stream, gboolean low_latency);
+gboolean          gst_rtsp_stream_is_low_latency   (GstRTSPStream *stream);
+
+void              gst_rtsp_stream_set_gop_cache    (GstRTSPStream *stream, gboolean gop_cache);
+gboolean          gst_rtsp_stream_has_gop_cache    (GstRTSPStream *stream);
+void              gst_rtsp_stream_set_adaptive_bitrate (GstRTSPStream *stream,
+                                                        gboolean adaptive_bitrate);
+gboolean          gst_rtsp_stream_is_adaptive_bitrate  (GstRTSPStream *stream);
+
+void              gst_rtsp_stream_set_retransmission_time (GstRTSPStream *stream,
+                                                           GstClockTime time);
+GstClockTime      gst_rtsp_stream_get_retransmission_time (GstRTSPStream *stream);
+void              gst_rtsp_stream_set_retransmission_pt   (GstRTSPStream *stream,
+                                                           guint rtx_pt);
+guint             gst_rtsp_stream_get_retransmission_pt   (GstRTSPStream *stream);
+GstStructure *    gst_rtsp_stream_get_retransmission_stats (GstRTSPStream *stream);
+
+void              gst_rtsp_stream_set_fec_percentage (GstRTSPStream *stream,
+                                                      guint percentage);
+guint             gst_rtsp_stream_get_fec_percentage (GstRTSPStream *stream);
+void              gst_rtsp_stream_set_fec_pt         (GstRTSPStream *stream,
+                                                      guint fec_pt);
+guint             gst_rtsp_stream_get_fec_pt         (GstRTSPStream *stream);
+GstStructure *    gst_rtsp_stream_get_fec_stats      (GstRTSPStream *stream);
+
+void              gst_rtsp_stream_set_pacing         (GstRTSPStream *stream,
+                                                      gboolean pacing);
+gboolean          gst_rtsp_stream_is_pacing          (GstRTSPStream *stream);
+GstStructure *    gst_rtsp_stream_get_pacing_stats   (GstRTSPStream *stream);
+
 void              gst_rtsp_stream_set_dscp_qos     (GstRTSPStream *stream, gint dscp_qos);
 gint              gst_rtsp_stream_get_dscp_qos     (GstRTSPStream *stream);
 
@@ -95,6 +129,10 @@ void              gst_rtsp_stream_set_address_pool (GstRTSPStream *stream, GstRT
 GstRTSPAddressPool *
                   gst_rtsp_stream_get_address_pool (GstRTSPStream *stream);
 
+void              gst_rtsp_stream_set_socket_pool  (GstRTSPStream *stream, GstRTSPSocketPool *pool);
+GstRTSPSocketPool *
+                  gst_rtsp_stream_get_socket_pool  (GstRTSPStream *stream);
+
 GstRTSPAddress *  gst_rtsp_stream_reserve_address  (GstRTSPStream *stream,
                                                     const gchar * address,
                                                     guint port,
@@ -111,6 +149,23 @@ gboolean          gst_rtsp_stream_set_blocked      (GstRTSPStream * stream,
                                                     gboolean blocked);
 gboolean          gst_rtsp_stream_is_blocking      (GstRTSPStream * stream);
 
+gboolean          gst_rtsp_stream_set_standby      (GstRTSPStream * stream,
+                                                    gboolean standby);
+gboolean          gst_rtsp_stream_is_standby       (GstRTSPStream * stream);
+
+gboolean          gst_rtsp_stream_request_key_unit (GstRTSPStream *stream);
+GstClockTime      gst_rtsp_stream_get_key_unit_latency (GstRTSPStream *stream);
+
+guint             gst_rtsp_stream_add_layer        (GstRTSPStream *stream,
+                                                    GstElement *payloader,
+                                                    GstPad *srcpad);
+guint             gst_rtsp_stream_get_n_layers     (GstRTSPStream *stream);
+gboolean          gst_rtsp_stream_set_transport_layer (GstRTSPStream *stream,
+                                                       GstRTSPStreamTransport *trans,
+                                                       guint layer);
+guint             gst_rtsp_stream_get_transport_layer (GstRTSPStream *stream,
+                                                       GstRTSPStreamTransport *trans);
+
 void              gst_rtsp_stream_get_server_port  (GstRTSPStream *stream,
                                                     GstRTSPRange *server_port,
                                                     GSocketFamily family);
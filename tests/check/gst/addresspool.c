@@ -270,6 +270,94 @@ GST_START_TEST (test_pool)
 
 GST_END_TEST;
 
+GST_START_TEST (test_pool_churn)
+{
+  GstRTSPAddressPool *pool;
+  GstRTSPAddress *addrs[500], *addr;
+  GstRTSPAddressPoolResult res;
+  gint i;
+
+  pool = gst_rtsp_address_pool_new ();
+
+  fail_unless (gst_rtsp_address_pool_add_range (pool,
+          "233.252.0.0", "233.252.0.1", 5000, 5999, 1));
+
+  /* fill the first address completely with port pairs */
+  for (i = 0; i < 500; i++) {
+    addrs[i] = gst_rtsp_address_pool_acquire_address (pool,
+        GST_RTSP_ADDRESS_FLAG_EVEN_PORT | GST_RTSP_ADDRESS_FLAG_MULTICAST, 2);
+    fail_unless (addrs[i] != NULL);
+    fail_unless (addrs[i]->port == 5000 + 2 * i);
+    fail_unless (!strcmp (addrs[i]->address, "233.252.0.0"));
+  }
+
+  /* released pairs are reused before moving to the next address */
+  for (i = 0; i < 500; i += 2) {
+    gst_rtsp_address_free (addrs[i]);
+    addrs[i] = NULL;
+  }
+  for (i = 0; i < 500; i += 2) {
+    addrs[i] = gst_rtsp_address_pool_acquire_address (pool,
+        GST_RTSP_ADDRESS_FLAG_EVEN_PORT | GST_RTSP_ADDRESS_FLAG_MULTICAST, 2);
+    fail_unless (addrs[i] != NULL);
+    fail_unless (addrs[i]->port == 5000 + 2 * i);
+    fail_unless (!strcmp (addrs[i]->address, "233.252.0.0"));
+  }
+
+  /* a released pair can be reserved again but not twice */
+  gst_rtsp_address_free (addrs[10]);
+  res = gst_rtsp_address_pool_reserve_address (pool, "233.252.0.0", 5021, 1,
+      1, &addrs[10]);
+  fail_unless (res == GST_RTSP_ADDRESS_POOL_OK);
+  res = gst_rtsp_address_pool_reserve_address (pool, "233.252.0.0", 5020, 2,
+      1, &addr);
+  fail_unless (res == GST_RTSP_ADDRESS_POOL_ERESERVED);
+  fail_unless (addr == NULL);
+
+  /* the odd port left over is not used for even allocations */
+  addr = gst_rtsp_address_pool_acquire_address (pool,
+      GST_RTSP_ADDRESS_FLAG_EVEN_PORT | GST_RTSP_ADDRESS_FLAG_MULTICAST, 2);
+  fail_unless (addr != NULL);
+  fail_unless (addr->port == 5000);
+  fail_unless (!strcmp (addr->address, "233.252.0.1"));
+  gst_rtsp_address_free (addr);
+
+  for (i = 0; i < 500; i++)
+    gst_rtsp_address_free (addrs[i]);
+
+  gst_rtsp_address_pool_clear (pool);
+
+  /* a failed large request doesn't hide the leftovers from smaller ones */
+  fail_unless (gst_rtsp_address_pool_add_range (pool,
+          "233.252.0.2", "233.252.0.2", 5000, 5002, 1));
+  addrs[0] = gst_rtsp_address_pool_acquire_address (pool,
+      GST_RTSP_ADDRESS_FLAG_MULTICAST, 2);
+  fail_unless (addrs[0] != NULL);
+  fail_unless (addrs[0]->port == 5000);
+  addr = gst_rtsp_address_pool_acquire_address (pool,
+      GST_RTSP_ADDRESS_FLAG_MULTICAST, 2);
+  fail_unless (addr == NULL);
+  addrs[1] = gst_rtsp_address_pool_acquire_address (pool,
+      GST_RTSP_ADDRESS_FLAG_MULTICAST, 1);
+  fail_unless (addrs[1] != NULL);
+  fail_unless (addrs[1]->port == 5002);
+  fail_unless (!strcmp (addrs[1]->address, "233.252.0.2"));
+
+  /* and the released ports are found again */
+  gst_rtsp_address_free (addrs[0]);
+  addrs[0] = gst_rtsp_address_pool_acquire_address (pool,
+      GST_RTSP_ADDRESS_FLAG_MULTICAST, 2);
+  fail_unless (addrs[0] != NULL);
+  fail_unless (addrs[0]->port == 5000);
+
+  gst_rtsp_address_free (addrs[0]);
+  gst_rtsp_address_free (addrs[1]);
+  gst_rtsp_address_pool_clear (pool);
+  g_object_unref (pool);
+}
+
+GST_END_TEST;
+
 static Suite *
 rtspaddresspool_suite (void)
 {
@@ -279,6 +367,7 @@ rtspaddresspool_suite (void)
   suite_add_tcase (s, tc);
   tcase_set_timeout (tc, 20);
   tcase_add_test (tc, test_pool);
+  tcase_add_test (tc, test_pool_churn);
 
   return s;
 }
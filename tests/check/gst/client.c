@@ -18,6 +18,7 @@
  */
 
 #include <gst/check/gstcheck.h>
+#include <gst/rtp/gstrtcpbuffer.h>
 
 #include <rtsp-client.h>
 
@@ -292,6 +293,91 @@ GST_START_TEST (test_options)
 
 GST_END_TEST;
 
+static gboolean
+test_option_record_response_200 (GstRTSPClient * client,
+    GstRTSPMessage * response, gboolean close, gpointer user_data)
+{
+  GstRTSPStatusCode code;
+  const gchar *reason;
+  GstRTSPVersion version;
+  gchar *str;
+  GstRTSPMethod methods;
+
+  fail_unless (gst_rtsp_message_parse_response (response, &code, &reason,
+          &version)
+      == GST_RTSP_OK);
+  fail_unless (code == GST_RTSP_STS_OK);
+
+  fail_unless (gst_rtsp_message_get_header (response, GST_RTSP_HDR_CSEQ, &str,
+          0) == GST_RTSP_OK);
+  fail_unless (atoi (str) == cseq++);
+
+  fail_unless (gst_rtsp_message_get_header (response, GST_RTSP_HDR_PUBLIC, &str,
+          0) == GST_RTSP_OK);
+
+  methods = gst_rtsp_options_from_text (str);
+  fail_unless (methods == (GST_RTSP_DESCRIBE |
+          GST_RTSP_ANNOUNCE |
+          GST_RTSP_OPTIONS |
+          GST_RTSP_PAUSE |
+          GST_RTSP_PLAY |
+          GST_RTSP_RECORD |
+          GST_RTSP_SETUP |
+          GST_RTSP_GET_PARAMETER | GST_RTSP_SET_PARAMETER | GST_RTSP_TEARDOWN));
+
+  return TRUE;
+}
+
+/* ANNOUNCE and RECORD are only offered where clients can publish */
+GST_START_TEST (test_options_record)
+{
+  GstRTSPClient *client;
+  GstRTSPMountPoints *mount_points;
+  GstRTSPMediaFactory *factory;
+  GstRTSPMessage request = { 0, };
+  gchar *str;
+
+  client = gst_rtsp_client_new ();
+
+  mount_points = gst_rtsp_mount_points_new ();
+  factory = gst_rtsp_media_factory_new ();
+  gst_rtsp_media_factory_set_ingest (factory, "camera");
+  gst_rtsp_mount_points_add_factory (mount_points, "/publish", factory);
+  factory = gst_rtsp_media_factory_new ();
+  gst_rtsp_media_factory_set_launch (factory,
+      "videotestsrc ! video/x-raw,width=352,height=288 ! rtpgstpay name=pay0 pt=96");
+  gst_rtsp_mount_points_add_factory (mount_points, "/test", factory);
+  gst_rtsp_client_set_mount_points (client, mount_points);
+  g_object_unref (mount_points);
+
+  fail_unless (gst_rtsp_message_init_request (&request, GST_RTSP_OPTIONS,
+          "rtsp://localhost/publish") == GST_RTSP_OK);
+  str = g_strdup_printf ("%d", cseq);
+  gst_rtsp_message_add_header (&request, GST_RTSP_HDR_CSEQ, str);
+  g_free (str);
+
+  gst_rtsp_client_set_send_func (client, test_option_record_response_200,
+      NULL, NULL);
+  fail_unless (gst_rtsp_client_handle_message (client,
+          &request) == GST_RTSP_OK);
+  gst_rtsp_message_unset (&request);
+
+  fail_unless (gst_rtsp_message_init_request (&request, GST_RTSP_OPTIONS,
+          "rtsp://localhost/test") == GST_RTSP_OK);
+  str = g_strdup_printf ("%d", cseq);
+  gst_rtsp_message_add_header (&request, GST_RTSP_HDR_CSEQ, str);
+  g_free (str);
+
+  gst_rtsp_client_set_send_func (client, test_option_response_200, NULL, NULL);
+  fail_unless (gst_rtsp_client_handle_message (client,
+          &request) == GST_RTSP_OK);
+  gst_rtsp_message_unset (&request);
+
+  g_object_unref (client);
+}
+
+GST_END_TEST;
+
 GST_START_TEST (test_describe)
 {
   GstRTSPClient *client;
@@ -847,6 +933,150 @@ GST_START_TEST (test_client_sdp_with_no_bitrate_tags)
 
 GST_END_TEST;
 
+static GstRTSPSession *data_session;
+
+static void
+data_new_session_cb (GObject * client, GstRTSPSession * session,
+    gpointer user_data)
+{
+  data_session = g_object_ref (session);
+}
+
+/* the responses must be OK, the interleaved data of the media is ignored */
+static gboolean
+test_response_200_or_data (GstRTSPClient * client, GstRTSPMessage * response,
+    gboolean close, gpointer user_data)
+{
+  if (gst_rtsp_message_get_type (response) == GST_RTSP_MESSAGE_DATA)
+    return TRUE;
+
+  return test_response_200 (client, response, close, user_data);
+}
+
+static void
+send_request (GstRTSPClient * client, GstRTSPMethod method, const gchar * url,
+    const gchar * transport)
+{
+  GstRTSPMessage request = { 0, };
+  gchar *str;
+
+  fail_unless (gst_rtsp_message_init_request (&request, method,
+          url) == GST_RTSP_OK);
+  str = g_strdup_printf ("%d", cseq);
+  gst_rtsp_message_take_header (&request, GST_RTSP_HDR_CSEQ, str);
+  if (transport)
+    gst_rtsp_message_add_header (&request, GST_RTSP_HDR_TRANSPORT, transport);
+  if (data_session)
+    gst_rtsp_message_add_header (&request, GST_RTSP_HDR_SESSION,
+        gst_rtsp_session_get_sessionid (data_session));
+
+  fail_unless (gst_rtsp_client_handle_message (client,
+          &request) == GST_RTSP_OK);
+  gst_rtsp_message_unset (&request);
+}
+
+/* send a receiver report of @ssrc as interleaved data on @channel */
+static void
+send_report_data (GstRTSPClient * client, guint8 channel, guint32 ssrc)
+{
+  GstRTSPMessage message = { 0, };
+  GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  GstRTCPPacket packet;
+  GstBuffer *buffer;
+  GstMapInfo map;
+
+  buffer = gst_rtcp_buffer_new (1000);
+  fail_unless (gst_rtcp_buffer_map (buffer, GST_MAP_READWRITE, &rtcp));
+  fail_unless (gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_RR,
+          &packet));
+  gst_rtcp_packet_rr_set_ssrc (&packet, ssrc);
+  gst_rtcp_buffer_unmap (&rtcp);
+
+  fail_unless (gst_rtsp_message_init_data (&message, channel) ==
+      GST_RTSP_OK);
+  fail_unless (gst_buffer_map (buffer, &map, GST_MAP_READ));
+  gst_rtsp_message_set_body (&message, map.data, map.size);
+  gst_buffer_unmap (buffer, &map);
+  gst_buffer_unref (buffer);
+
+  fail_unless (gst_rtsp_client_handle_message (client,
+          &message) == GST_RTSP_OK);
+  gst_rtsp_message_unset (&message);
+}
+
+/* wait until the session of @stream knows the sender @ssrc */
+static gboolean
+stream_has_source (GstRTSPStream * stream, guint32 ssrc, gboolean wait)
+{
+  GObject *session, *source = NULL;
+  gint i;
+
+  session = gst_rtsp_stream_get_rtpsession (stream);
+  for (i = 0; i < (wait ? 100 : 10) && source == NULL; i++) {
+    g_signal_emit_by_name (session, "get-source-by-ssrc", ssrc, &source);
+    if (source == NULL)
+      g_usleep (G_USEC_PER_SEC / 100);
+  }
+  g_object_unref (session);
+
+  if (source == NULL)
+    return FALSE;
+  g_object_unref (source);
+
+  return TRUE;
+}
+
+GST_START_TEST (test_client_interleaved_data)
+{
+  GstRTSPClient *client;
+  GstRTSPSessionMedia *sessmedia;
+  GstRTSPMedia *media;
+  GstRTSPStream *stream0, *stream1;
+  gint matched;
+
+  client = setup_client ("( videotestsrc ! video/x-raw,width=352,height=288 "
+      "! rtpgstpay name=pay0 pt=96 audiotestsrc ! rtpgstpay name=pay1 pt=97 )");
+  g_signal_connect (G_OBJECT (client), "new-session",
+      G_CALLBACK (data_new_session_cb), NULL);
+  gst_rtsp_client_set_send_func (client, test_response_200_or_data, NULL,
+      NULL);
+
+  /* the streams get their channels in the opposite order of the streams */
+  send_request (client, GST_RTSP_SETUP, "rtsp://localhost/test/stream=0",
+      "RTP/AVP/TCP;unicast;interleaved=4-5");
+  fail_unless (data_session != NULL);
+  send_request (client, GST_RTSP_SETUP, "rtsp://localhost/test/stream=1",
+      "RTP/AVP/TCP;unicast;interleaved=0-1");
+  send_request (client, GST_RTSP_PLAY, "rtsp://localhost/test", NULL);
+
+  sessmedia = gst_rtsp_session_get_media (data_session, "/test", &matched);
+  fail_unless (sessmedia != NULL);
+  media = gst_rtsp_session_media_get_media (sessmedia);
+  stream0 = gst_rtsp_media_get_stream (media, 0);
+  stream1 = gst_rtsp_media_get_stream (media, 1);
+
+  /* the RTCP channel of each stream */
+  send_report_data (client, 5, 0x11111111);
+  send_report_data (client, 1, 0x22222222);
+  /* unknown channels are dropped */
+  send_report_data (client, 3, 0x33333333);
+
+  fail_unless (stream_has_source (stream0, 0x11111111, TRUE));
+  fail_unless (stream_has_source (stream1, 0x22222222, TRUE));
+  fail_if (stream_has_source (stream0, 0x22222222, FALSE));
+  fail_if (stream_has_source (stream1, 0x11111111, FALSE));
+  fail_if (stream_has_source (stream0, 0x33333333, FALSE));
+  fail_if (stream_has_source (stream1, 0x33333333, FALSE));
+
+  send_request (client, GST_RTSP_TEARDOWN, "rtsp://localhost/test", NULL);
+  g_object_unref (data_session);
+  data_session = NULL;
+
+  teardown_client (client);
+}
+
+GST_END_TEST;
+
 static Suite *
 rtspclient_suite (void)
 {
@@ -858,6 +1088,8 @@ rtspclient_suite (void)
 //  tcase_add_test (tc, test_request);
 //  tcase_add_test (tc, test_options);
   tcase_add_test (tc, test_describe);
+  tcase_add_test (tc, test_options_record);
+  tcase_add_test (tc, test_client_interleaved_data);
 #if 0
   tcase_add_test (tc, test_client_multicast_transport_404);
   tcase_add_test (tc, test_client_multicast_transport);
@@ -20,6 +20,7 @@
 #include <gst/check/gstcheck.h>
 
 #include <rtsp-media-factory.h>
+#include <rtsp-sdp.h>
 
 GST_START_TEST (test_launch)
 {
@@ -346,6 +347,420 @@ GST_START_TEST (test_media_reset)
 
 GST_END_TEST;
 
+GST_START_TEST (test_media_standby)
+{
+  GstRTSPMediaFactory *factory;
+  GstRTSPMedia *media;
+  GstRTSPUrl *url;
+  GstRTSPThreadPool *pool;
+  GstRTSPThread *thread;
+  GstRTSPStream *stream;
+
+  pool = gst_rtsp_thread_pool_new ();
+
+  factory = gst_rtsp_media_factory_new ();
+  gst_rtsp_url_parse ("rtsp://localhost:8554/test", &url);
+
+  gst_rtsp_media_factory_set_launch (factory,
+      "( videotestsrc is-live=true ! rtpvrawpay pt=96 name=pay0 )");
+
+  media = gst_rtsp_media_factory_construct (factory, url);
+  fail_unless (GST_IS_RTSP_MEDIA (media));
+  gst_rtsp_media_set_suspend_mode (media, GST_RTSP_SUSPEND_MODE_STANDBY);
+  stream = gst_rtsp_media_get_stream (media, 0);
+
+  thread = gst_rtsp_thread_pool_get_thread (pool,
+      GST_RTSP_THREAD_TYPE_MEDIA, NULL);
+  fail_unless (gst_rtsp_media_prepare (media, thread));
+  fail_if (gst_rtsp_stream_is_standby (stream));
+
+  fail_unless (gst_rtsp_media_suspend (media));
+  fail_unless (gst_rtsp_media_get_status (media) ==
+      GST_RTSP_MEDIA_STATUS_SUSPENDED);
+  fail_unless (gst_rtsp_stream_is_standby (stream));
+
+  fail_unless (gst_rtsp_media_unsuspend (media));
+  fail_unless (gst_rtsp_media_get_status (media) ==
+      GST_RTSP_MEDIA_STATUS_PREPARED);
+  fail_if (gst_rtsp_stream_is_standby (stream));
+
+  fail_unless (gst_rtsp_media_unprepare (media));
+  g_object_unref (media);
+
+  gst_rtsp_url_free (url);
+  g_object_unref (factory);
+  g_object_unref (pool);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_media_low_latency)
+{
+  GstRTSPMediaFactory *factory;
+  GstRTSPMedia *media;
+  GstRTSPUrl *url;
+  GstRTSPThreadPool *pool;
+  GstRTSPThread *thread;
+  GstRTSPStream *stream;
+  GstStructure *report;
+  GstClockTime latency;
+  GstRTSPTimeRange *range;
+
+  pool = gst_rtsp_thread_pool_new ();
+
+  factory = gst_rtsp_media_factory_new ();
+  gst_rtsp_url_parse ("rtsp://localhost:8554/test", &url);
+
+  gst_rtsp_media_factory_set_launch (factory,
+      "( videotestsrc ! rtpvrawpay pt=96 name=pay0 )");
+
+  media = gst_rtsp_media_factory_construct (factory, url);
+  fail_unless (GST_IS_RTSP_MEDIA (media));
+  fail_if (gst_rtsp_media_is_low_latency (media));
+
+  /* no report before prepare */
+  fail_unless (gst_rtsp_media_get_latency_report (media) == NULL);
+
+  gst_rtsp_media_set_low_latency (media, TRUE);
+  fail_unless (gst_rtsp_media_is_low_latency (media));
+  stream = gst_rtsp_media_get_stream (media, 0);
+  fail_unless (gst_rtsp_stream_is_low_latency (stream));
+
+  thread = gst_rtsp_thread_pool_get_thread (pool,
+      GST_RTSP_THREAD_TYPE_MEDIA, NULL);
+  fail_unless (gst_rtsp_media_prepare (media, thread));
+
+  report = gst_rtsp_media_get_latency_report (media);
+  fail_unless (report != NULL);
+  fail_unless (gst_structure_get_clock_time (report, "rtpbin", &latency));
+  fail_unless (latency == 0);
+  fail_unless (gst_structure_has_field (report, "budget"));
+  gst_structure_free (report);
+
+  /* the videotestsrc is not live, the media still prerolls and seeks */
+  fail_unless (gst_rtsp_range_parse ("npt=1.0-", &range) == GST_RTSP_OK);
+  fail_unless (gst_rtsp_media_seek (media, range));
+  gst_rtsp_range_free (range);
+
+  fail_unless (gst_rtsp_media_unprepare (media));
+  g_object_unref (media);
+
+  gst_rtsp_url_free (url);
+  g_object_unref (factory);
+  g_object_unref (pool);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_media_gop_cache)
+{
+  GstRTSPMediaFactory *factory;
+  GstRTSPMedia *media;
+  GstRTSPUrl *url;
+  GstRTSPThreadPool *pool;
+  GstRTSPThread *thread;
+  GstRTSPStream *stream;
+
+  pool = gst_rtsp_thread_pool_new ();
+
+  factory = gst_rtsp_media_factory_new ();
+  gst_rtsp_url_parse ("rtsp://localhost:8554/test", &url);
+
+  gst_rtsp_media_factory_set_launch (factory,
+      "( videotestsrc ! rtpvrawpay pt=96 name=pay0 )");
+
+  media = gst_rtsp_media_factory_construct (factory, url);
+  fail_unless (GST_IS_RTSP_MEDIA (media));
+  fail_if (gst_rtsp_media_has_gop_cache (media));
+
+  g_object_set (media, "gop-cache", TRUE, NULL);
+  fail_unless (gst_rtsp_media_has_gop_cache (media));
+  stream = gst_rtsp_media_get_stream (media, 0);
+  fail_unless (gst_rtsp_stream_has_gop_cache (stream));
+
+  thread = gst_rtsp_thread_pool_get_thread (pool,
+      GST_RTSP_THREAD_TYPE_MEDIA, NULL);
+  fail_unless (gst_rtsp_media_prepare (media, thread));
+  fail_unless (gst_rtsp_media_unprepare (media));
+  g_object_unref (media);
+
+  gst_rtsp_url_free (url);
+  g_object_unref (factory);
+  g_object_unref (pool);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_media_layers)
+{
+  GstRTSPMediaFactory *factory;
+  GstRTSPMedia *media;
+  GstRTSPUrl *url;
+  GstRTSPThreadPool *pool;
+  GstRTSPThread *thread;
+  GstRTSPStream *stream;
+
+  pool = gst_rtsp_thread_pool_new ();
+
+  factory = gst_rtsp_media_factory_new ();
+  gst_rtsp_url_parse ("rtsp://localhost:8554/test", &url);
+
+  gst_rtsp_media_factory_set_launch (factory,
+      "( videotestsrc ! tee name=t ! queue ! rtpvrawpay pt=96 name=pay0 "
+      "t. ! queue ! videoscale ! video/x-raw,width=160,height=120 ! "
+      "rtpvrawpay pt=96 name=pay0_1 )");
+
+  media = gst_rtsp_media_factory_construct (factory, url);
+  fail_unless (GST_IS_RTSP_MEDIA (media));
+  fail_unless (gst_rtsp_media_n_streams (media) == 1);
+  stream = gst_rtsp_media_get_stream (media, 0);
+  fail_unless (gst_rtsp_stream_get_n_layers (stream) == 2);
+
+  thread = gst_rtsp_thread_pool_get_thread (pool,
+      GST_RTSP_THREAD_TYPE_MEDIA, NULL);
+  fail_unless (gst_rtsp_media_prepare (media, thread));
+  fail_unless (gst_rtsp_media_unprepare (media));
+  g_object_unref (media);
+
+  gst_rtsp_url_free (url);
+  g_object_unref (factory);
+  g_object_unref (pool);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_media_adaptive_bitrate)
+{
+  GstRTSPMediaFactory *factory;
+  GstRTSPMedia *media;
+  GstRTSPUrl *url;
+  GstRTSPStream *stream;
+
+  factory = gst_rtsp_media_factory_new ();
+  gst_rtsp_url_parse ("rtsp://localhost:8554/test", &url);
+
+  gst_rtsp_media_factory_set_launch (factory,
+      "( videotestsrc ! rtpvrawpay pt=96 name=pay0 )");
+
+  media = gst_rtsp_media_factory_construct (factory, url);
+  fail_unless (GST_IS_RTSP_MEDIA (media));
+  fail_if (gst_rtsp_media_is_adaptive_bitrate (media));
+  stream = gst_rtsp_media_get_stream (media, 0);
+
+  g_object_set (media, "adaptive-bitrate", TRUE, NULL);
+  fail_unless (gst_rtsp_media_is_adaptive_bitrate (media));
+  fail_unless (gst_rtsp_stream_is_adaptive_bitrate (stream));
+
+  /* the encoder of shared media is not controlled by one client */
+  gst_rtsp_media_set_shared (media, TRUE);
+  fail_unless (gst_rtsp_media_is_adaptive_bitrate (media));
+  fail_if (gst_rtsp_stream_is_adaptive_bitrate (stream));
+  g_object_unref (media);
+
+  gst_rtsp_url_free (url);
+  g_object_unref (factory);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_media_retransmission)
+{
+  GstRTSPMedia *media;
+  GstElement *bin, *pipeline;
+  GstRTSPStream *stream;
+  GstRTSPThreadPool *pool;
+  GstRTSPThread *thread;
+
+  bin = gst_parse_launch ("( videotestsrc ! rtpvrawpay pt=96 name=pay0 "
+      "audiotestsrc ! rtpL16pay pt=97 name=pay1 )", NULL);
+  fail_unless (GST_IS_BIN (bin));
+
+  media = gst_rtsp_media_new (bin);
+  fail_unless (GST_IS_RTSP_MEDIA (media));
+  pipeline = gst_pipeline_new ("media-pipeline");
+  gst_rtsp_media_take_pipeline (media, GST_PIPELINE_CAST (pipeline));
+  fail_unless (gst_rtsp_media_get_retransmission_time (media) == 0);
+
+  /* configured before the streams are known */
+  g_object_set (media, "retransmission-time", 500 * GST_MSECOND,
+      "fec-percentage", 20, NULL);
+  fail_unless (gst_rtsp_media_get_retransmission_time (media) ==
+      500 * GST_MSECOND);
+  fail_unless (gst_rtsp_media_get_fec_percentage (media) == 20);
+
+  gst_rtsp_media_collect_streams (media);
+  fail_unless (gst_rtsp_media_n_streams (media) == 2);
+  stream = gst_rtsp_media_get_stream (media, 0);
+  fail_unless (gst_rtsp_stream_get_retransmission_time (stream) ==
+      500 * GST_MSECOND);
+  fail_unless (gst_rtsp_stream_get_fec_percentage (stream) == 20);
+  /* the payload types are assigned when the media is prepared */
+  fail_unless (gst_rtsp_stream_get_retransmission_pt (stream) == 0);
+
+  pool = gst_rtsp_thread_pool_new ();
+  thread = gst_rtsp_thread_pool_get_thread (pool,
+      GST_RTSP_THREAD_TYPE_MEDIA, NULL);
+  fail_unless (gst_rtsp_media_prepare (media, thread));
+
+  /* the streams get different payload types that no stream uses */
+  fail_unless (gst_rtsp_stream_get_retransmission_pt (stream) == 98);
+  fail_unless (gst_rtsp_stream_get_fec_pt (stream) == 99);
+  stream = gst_rtsp_media_get_stream (media, 1);
+  fail_unless (gst_rtsp_stream_get_retransmission_pt (stream) == 100);
+  fail_unless (gst_rtsp_stream_get_fec_pt (stream) == 101);
+
+  fail_unless (gst_rtsp_media_unprepare (media));
+  g_object_unref (media);
+  g_object_unref (pool);
+}
+
+GST_END_TEST;
+
+static gboolean
+has_attribute (const GstSDPMedia * smedia, const gchar * key,
+    const gchar * value)
+{
+  guint i;
+
+  for (i = 0; i < gst_sdp_media_attributes_len (smedia); i++) {
+    const GstSDPAttribute *attr = gst_sdp_media_get_attribute (smedia, i);
+
+    if (g_str_equal (attr->key, key) && attr->value &&
+        g_str_equal (attr->value, value))
+      return TRUE;
+  }
+  return FALSE;
+}
+
+GST_START_TEST (test_media_retransmission_sdp)
+{
+  GstRTSPMediaFactory *factory;
+  GstRTSPMedia *media;
+  GstRTSPUrl *url;
+  GstRTSPStream *stream;
+  GstRTSPThreadPool *pool;
+  GstRTSPThread *thread;
+  GstRTSPTransport *tr;
+  GstSDPMessage *sdp;
+  const GstSDPMedia *smedia;
+  GstSDPInfo info;
+  GstElementFactory *rtxsend;
+
+  factory = gst_rtsp_media_factory_new ();
+  gst_rtsp_url_parse ("rtsp://localhost:8554/test", &url);
+  gst_rtsp_media_factory_set_launch (factory,
+      "( videotestsrc ! rtpvrawpay pt=96 name=pay0 )");
+
+  media = gst_rtsp_media_factory_construct (factory, url);
+  fail_unless (GST_IS_RTSP_MEDIA (media));
+  gst_rtsp_media_set_retransmission_time (media, 500 * GST_MSECOND);
+  stream = gst_rtsp_media_get_stream (media, 0);
+
+  pool = gst_rtsp_thread_pool_new ();
+  thread = gst_rtsp_thread_pool_get_thread (pool,
+      GST_RTSP_THREAD_TYPE_MEDIA, NULL);
+  fail_unless (gst_rtsp_media_prepare (media, thread));
+  fail_unless (gst_rtsp_stream_get_retransmission_pt (stream) == 97);
+
+  gst_sdp_message_new (&sdp);
+  info.is_ipv6 = FALSE;
+  info.server_ip = "127.0.0.1";
+  fail_unless (gst_rtsp_sdp_from_media (sdp, &info, media));
+  fail_unless (gst_sdp_message_medias_len (sdp) == 1);
+  smedia = gst_sdp_message_get_media (sdp, 0);
+
+  fail_unless (gst_rtsp_transport_new (&tr) == GST_RTSP_OK);
+  tr->trans = GST_RTSP_TRANS_RTP;
+  tr->profile = GST_RTSP_PROFILE_AVPF;
+  tr->lower_transport = GST_RTSP_LOWER_TRANS_UDP;
+
+  /* retransmission is switched off when the plugin is missing */
+  rtxsend = gst_element_factory_find ("rtprtxsend");
+  /* the feedback is offered in the AVP profile so that every client can use
+   * the stream */
+  fail_unless_equals_string (gst_sdp_media_get_proto (smedia), "RTP/AVP");
+  if (rtxsend) {
+    fail_unless (gst_sdp_media_formats_len (smedia) == 2);
+    fail_unless_equals_string (gst_sdp_media_get_format (smedia, 0), "96");
+    fail_unless_equals_string (gst_sdp_media_get_format (smedia, 1), "97");
+    fail_unless (has_attribute (smedia, "rtpmap", "97 rtx/90000"));
+    fail_unless (has_attribute (smedia, "fmtp", "97 apt=96;rtx-time=500"));
+    fail_unless (has_attribute (smedia, "rtcp-fb", "96 nack"));
+    fail_unless (gst_rtsp_stream_is_transport_supported (stream, tr));
+    gst_object_unref (rtxsend);
+  } else {
+    fail_unless (gst_sdp_media_formats_len (smedia) == 1);
+    fail_if (has_attribute (smedia, "rtcp-fb", "96 nack"));
+    fail_if (gst_rtsp_stream_is_transport_supported (stream, tr));
+  }
+  /* clients without feedback still get the stream */
+  tr->profile = GST_RTSP_PROFILE_AVP;
+  fail_unless (gst_rtsp_stream_is_transport_supported (stream, tr));
+
+  gst_rtsp_transport_free (tr);
+  gst_sdp_message_free (sdp);
+  fail_unless (gst_rtsp_media_unprepare (media));
+  g_object_unref (media);
+  gst_rtsp_url_free (url);
+  g_object_unref (factory);
+  g_object_unref (pool);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_media_pacing)
+{
+  GstRTSPMediaFactory *factory;
+  GstRTSPMedia *media;
+  GstRTSPUrl *url;
+  GstRTSPThreadPool *pool;
+  GstRTSPThread *thread;
+  GstRTSPStream *stream;
+  GstStructure *stats;
+  guint64 packets;
+
+  pool = gst_rtsp_thread_pool_new ();
+
+  factory = gst_rtsp_media_factory_new ();
+  gst_rtsp_url_parse ("rtsp://localhost:8554/test", &url);
+
+  gst_rtsp_media_factory_set_launch (factory,
+      "( videotestsrc ! rtpvrawpay pt=96 name=pay0 )");
+
+  media = gst_rtsp_media_factory_construct (factory, url);
+  fail_unless (GST_IS_RTSP_MEDIA (media));
+  fail_if (gst_rtsp_media_is_pacing (media));
+
+  stream = gst_rtsp_media_get_stream (media, 0);
+  fail_unless (gst_rtsp_stream_get_pacing_stats (stream) == NULL);
+
+  g_object_set (media, "pacing", TRUE, NULL);
+  fail_unless (gst_rtsp_media_is_pacing (media));
+  fail_unless (gst_rtsp_stream_is_pacing (stream));
+
+  thread = gst_rtsp_thread_pool_get_thread (pool,
+      GST_RTSP_THREAD_TYPE_MEDIA, NULL);
+  fail_unless (gst_rtsp_media_prepare (media, thread));
+
+  /* nothing is paced without unicast clients */
+  stats = gst_rtsp_stream_get_pacing_stats (stream);
+  fail_unless (stats != NULL);
+  fail_unless (gst_structure_get (stats, "packets", G_TYPE_UINT64, &packets,
+          NULL));
+  fail_unless (packets == 0);
+  fail_unless (gst_structure_has_field (stats, "max-delay"));
+  gst_structure_free (stats);
+
+  fail_unless (gst_rtsp_media_unprepare (media));
+  g_object_unref (media);
+
+  gst_rtsp_url_free (url);
+  g_object_unref (factory);
+  g_object_unref (pool);
+}
+
+GST_END_TEST;
+
 static Suite *
 rtspmedia_suite (void)
 {
@@ -360,6 +775,14 @@ rtspmedia_suite (void)
   tcase_add_test (tc, test_media_dyn_prepare);
   tcase_add_test (tc, test_media_take_pipeline);
   tcase_add_test (tc, test_media_reset);
+  tcase_add_test (tc, test_media_standby);
+  tcase_add_test (tc, test_media_low_latency);
+  tcase_add_test (tc, test_media_gop_cache);
+  tcase_add_test (tc, test_media_layers);
+  tcase_add_test (tc, test_media_adaptive_bitrate);
+  tcase_add_test (tc, test_media_retransmission);
+  tcase_add_test (tc, test_media_retransmission_sdp);
+  tcase_add_test (tc, test_media_pacing);
 
   return s;
 }
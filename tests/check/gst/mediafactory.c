@@ -17,9 +17,12 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <string.h>
+
 #include <gst/check/gstcheck.h>
 
 #include <rtsp-media-factory.h>
+#include <rtsp-media-factory-uri.h>
 
 GST_START_TEST (test_parse_error)
 {
@@ -314,6 +317,423 @@ GST_START_TEST (test_reset)
 
 GST_END_TEST;
 
+static GMutex shared_buffers_lock;
+
+static GstPadProbeReturn
+shared_buffer_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GPtrArray *buffers = user_data;
+
+  g_mutex_lock (&shared_buffers_lock);
+  g_ptr_array_add (buffers, gst_buffer_ref (GST_PAD_PROBE_INFO_BUFFER (info)));
+  g_mutex_unlock (&shared_buffers_lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* play the media of @factory and collect the buffers of its shared source */
+static GstElement *
+shared_user_start (GstRTSPMediaFactory * factory, const GstRTSPUrl * url,
+    GPtrArray * buffers)
+{
+  GstElement *pipeline, *element, *pay, *enc, *sink;
+  GstPad *pad;
+
+  element = gst_rtsp_media_factory_create_element (factory, url);
+  fail_unless (GST_IS_BIN (element));
+  pipeline = gst_pipeline_new (NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  gst_bin_add_many (GST_BIN (pipeline), element, sink, NULL);
+
+  pay = gst_bin_get_by_name (GST_BIN (element), "pay0");
+  fail_unless (gst_element_link (pay, sink));
+  gst_object_unref (pay);
+
+  enc = gst_bin_get_by_name (GST_BIN (element), "enc");
+  pad = gst_element_get_static_pad (enc, "src");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, shared_buffer_probe,
+      buffers, NULL);
+  gst_object_unref (pad);
+  gst_object_unref (enc);
+
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  return pipeline;
+}
+
+/* if a buffer of the shared source reached both users */
+static gboolean
+shared_buffer_found (GPtrArray * buffers1, GPtrArray * buffers2)
+{
+  gboolean found = FALSE;
+  guint i, j;
+
+  g_mutex_lock (&shared_buffers_lock);
+  for (i = 0; i < buffers1->len && !found; i++) {
+    for (j = 0; j < buffers2->len && !found; j++)
+      found = g_ptr_array_index (buffers1, i) ==
+          g_ptr_array_index (buffers2, j);
+  }
+  g_mutex_unlock (&shared_buffers_lock);
+
+  return found;
+}
+
+GST_START_TEST (test_shared_source)
+{
+  GstRTSPMediaFactory *factory1, *factory2;
+  GstElement *element1, *element2;
+  GstElement *pipeline1, *pipeline2;
+  GPtrArray *buffers1, *buffers2;
+  GstRTSPUrl *url;
+  gint i;
+
+  factory1 = gst_rtsp_media_factory_new ();
+  factory2 = gst_rtsp_media_factory_new ();
+  gst_rtsp_url_parse ("rtsp://localhost:8554/test", &url);
+
+  gst_rtsp_media_factory_set_launch (factory1,
+      "( appsrc name=enc ! rtpvrawpay pt=96 name=pay0 )");
+  gst_rtsp_media_factory_add_shared_source (factory1, "enc",
+      "videotestsrc is-live=true ! video/x-raw,format=I420,width=64,height=48");
+  gst_rtsp_media_factory_set_launch (factory2,
+      "( appsrc name=enc ! rtpvrawpay pt=97 name=pay0 )");
+  gst_rtsp_media_factory_add_shared_source (factory2, "enc",
+      "videotestsrc is-live=true ! video/x-raw,format=I420,width=64,height=48");
+
+  element1 = gst_rtsp_media_factory_create_element (factory1, url);
+  fail_unless (GST_IS_BIN (element1));
+  element2 = gst_rtsp_media_factory_create_element (factory2, url);
+  fail_unless (GST_IS_BIN (element2));
+
+  /* the shared branch stops with the last user */
+  gst_object_unref (element1);
+  gst_object_unref (element2);
+
+  element1 = gst_rtsp_media_factory_create_element (factory1, url);
+  fail_unless (GST_IS_BIN (element1));
+  gst_object_unref (element1);
+
+  /* both users get the buffers of one capture branch, not copies */
+  buffers1 = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gst_buffer_unref);
+  buffers2 = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gst_buffer_unref);
+  pipeline1 = shared_user_start (factory1, url, buffers1);
+  pipeline2 = shared_user_start (factory2, url, buffers2);
+  for (i = 0; i < 500 && !shared_buffer_found (buffers1, buffers2); i++)
+    g_usleep (10 * 1000);
+  fail_unless (shared_buffer_found (buffers1, buffers2));
+
+  fail_unless (gst_element_set_state (pipeline1, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  fail_unless (gst_element_set_state (pipeline2, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  gst_object_unref (pipeline1);
+  gst_object_unref (pipeline2);
+  g_ptr_array_unref (buffers1);
+  g_ptr_array_unref (buffers2);
+
+  gst_rtsp_url_free (url);
+  g_object_unref (factory1);
+  g_object_unref (factory2);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_relay)
+{
+  GstRTSPMediaFactory *ingest, *relay;
+  GstRTSPMedia *media, *other;
+  GstRTSPStream *stream;
+  GstRTSPThreadPool *pool;
+  GstRTSPThread *thread;
+  GPtrArray *transports;
+  GstElement *element;
+  GstSDPMessage *sdp;
+  GstStructure *s;
+  GstCaps *caps;
+  GstPad *pad;
+  GstRTSPUrl *url;
+  const gchar *text = "v=0\r\n"
+      "o=- 1 1 IN IP4 127.0.0.1\r\n"
+      "s=camera\r\n"
+      "t=0 0\r\n"
+      "m=video 0 RTP/AVP 96\r\n"
+      "a=rtpmap:96 H264/90000\r\n"
+      "a=fmtp:96 packetization-mode=1;profile-level-id=42e01f\r\n"
+      "m=audio 0 RTP/AVP 0\r\n";
+
+  ingest = gst_rtsp_media_factory_new ();
+  relay = gst_rtsp_media_factory_new ();
+  gst_rtsp_url_parse ("rtsp://localhost:8554/test", &url);
+
+  gst_rtsp_media_factory_set_ingest (ingest, "camera");
+  gst_rtsp_media_factory_set_relay (relay, "camera");
+
+  /* nothing to serve before the announcement */
+  element = gst_rtsp_media_factory_create_element (relay, url);
+  fail_unless (element == NULL);
+
+  gst_sdp_message_new (&sdp);
+  fail_unless (gst_sdp_message_parse_buffer ((const guint8 *) text,
+          strlen (text), sdp) == GST_SDP_OK);
+  fail_if (gst_rtsp_media_factory_announce (relay, url, sdp));
+
+  /* the streams of publishers come from the ANNOUNCE */
+  fail_if (gst_rtsp_media_factory_construct (ingest, url));
+
+  media = gst_rtsp_media_factory_announce (ingest, url, sdp);
+  fail_unless (GST_IS_RTSP_MEDIA (media));
+  fail_unless (gst_rtsp_media_is_record (media));
+  fail_if (gst_rtsp_media_is_shared (media));
+  fail_unless (gst_rtsp_media_n_streams (media) == 2);
+
+  /* the announced streams stay with the media until it records */
+  element = gst_rtsp_media_factory_create_element (relay, url);
+  fail_unless (element == NULL);
+
+  stream = gst_rtsp_media_get_stream (media, 0);
+  fail_unless (gst_rtsp_stream_get_pt (stream) == 96);
+  pad = gst_rtsp_stream_get_srcpad (stream);
+  caps = gst_pad_query_caps (pad, NULL);
+  s = gst_caps_get_structure (caps, 0);
+  fail_unless_equals_string (gst_structure_get_string (s, "encoding-name"),
+      "H264");
+  fail_unless_equals_string (gst_structure_get_string (s,
+          "packetization-mode"), "1");
+  gst_caps_unref (caps);
+  gst_object_unref (pad);
+
+  /* static payload types need no rtpmap */
+  stream = gst_rtsp_media_get_stream (media, 1);
+  fail_unless (gst_rtsp_stream_get_pt (stream) == 0);
+
+  pool = gst_rtsp_thread_pool_new ();
+  thread = gst_rtsp_thread_pool_get_thread (pool,
+      GST_RTSP_THREAD_TYPE_MEDIA, NULL);
+  fail_unless (gst_rtsp_media_prepare (media, thread));
+
+  /* like RECORD without transports */
+  transports = g_ptr_array_new ();
+  fail_unless (gst_rtsp_media_set_state (media, GST_STATE_PLAYING,
+          transports));
+
+  element = gst_rtsp_media_factory_create_element (relay, url);
+  fail_unless (GST_IS_BIN (element));
+  gst_object_unref (element);
+
+  /* only one publisher at a time */
+  fail_if (gst_rtsp_media_factory_announce (ingest, url, sdp));
+
+  fail_unless (gst_rtsp_media_set_state (media, GST_STATE_NULL, transports));
+  g_ptr_array_unref (transports);
+
+  other = gst_rtsp_media_factory_announce (ingest, url, sdp);
+  fail_unless (GST_IS_RTSP_MEDIA (other));
+  g_object_unref (other);
+  gst_sdp_message_free (sdp);
+
+  g_object_unref (media);
+  g_object_unref (pool);
+
+  gst_rtsp_url_free (url);
+  g_object_unref (ingest);
+  g_object_unref (relay);
+}
+
+GST_END_TEST;
+
+/* AUTOPLUG_RESULTS_MAX of rtsp-media-factory-uri.c */
+#define AUTOPLUG_RESULTS_MAX 1024
+
+static GstElement *
+create_uri_element (GstRTSPMediaFactoryURI * factory, GstElement ** uribin)
+{
+  GstRTSPUrl *url;
+  GstElement *element;
+
+  gst_rtsp_media_factory_uri_set_uri (factory, "file:///tmp/test.mkv");
+  gst_rtsp_url_parse ("rtsp://localhost:8554/test", &url);
+  element =
+      gst_rtsp_media_factory_create_element (GST_RTSP_MEDIA_FACTORY (factory),
+      url);
+  gst_rtsp_url_free (url);
+  fail_unless (GST_IS_BIN (element));
+
+  *uribin = gst_bin_get_by_name (GST_BIN (element), "uribin");
+  fail_unless (*uribin != NULL);
+
+  return element;
+}
+
+/* ask the URI factory if uridecodebin should continue autoplugging a
+ * stream of A-law audio at @rate */
+static gboolean
+uri_autoplug_continue (GstElement * uribin, gint rate)
+{
+  GstCaps *caps;
+  GstPad *pad;
+  gboolean result = TRUE;
+
+  caps = gst_caps_new_simple ("audio/x-alaw", "rate", G_TYPE_INT, rate,
+      "channels", G_TYPE_INT, 1, NULL);
+  pad = gst_pad_new ("src", GST_PAD_SRC);
+  g_signal_emit_by_name (uribin, "autoplug-continue", pad, caps, &result);
+  gst_object_unref (pad);
+  gst_caps_unref (caps);
+
+  return result;
+}
+
+GST_START_TEST (test_uri_autoplug_cache)
+{
+  GstRTSPMediaFactoryURI *factory;
+  GstElementFactory *pay;
+  GstElement *element, *uribin;
+  gint refs, i;
+
+  factory = gst_rtsp_media_factory_uri_new ();
+  element = create_uri_element (factory, &uribin);
+
+  /* the cached results keep a ref to the payloader they found */
+  pay = gst_element_factory_find ("rtppcmapay");
+  fail_unless (pay != NULL);
+
+  /* there is a payloader, autoplugging stops */
+  fail_if (uri_autoplug_continue (uribin, 8000));
+  refs = GST_OBJECT_REFCOUNT_VALUE (pay);
+
+  /* the same caps are found in the cache */
+  fail_if (uri_autoplug_continue (uribin, 8000));
+  fail_unless (GST_OBJECT_REFCOUNT_VALUE (pay) == refs);
+
+  /* other caps get an entry each until the cache is full */
+  for (i = 1; i < AUTOPLUG_RESULTS_MAX; i++) {
+    fail_if (uri_autoplug_continue (uribin, 8000 + i));
+    fail_unless (GST_OBJECT_REFCOUNT_VALUE (pay) == refs + i);
+  }
+
+  /* then it is emptied before the next entry is added */
+  fail_if (uri_autoplug_continue (uribin, 8000 + i));
+  fail_unless (GST_OBJECT_REFCOUNT_VALUE (pay) == refs);
+
+  /* and the first caps have to be looked up again */
+  fail_if (uri_autoplug_continue (uribin, 8000));
+  fail_unless (GST_OBJECT_REFCOUNT_VALUE (pay) == refs + 1);
+
+  gst_object_unref (pay);
+  gst_object_unref (uribin);
+  gst_object_unref (element);
+  g_object_unref (factory);
+}
+
+GST_END_TEST;
+
+/* ask uridecodebin if it should plug @name for a stream of @caps */
+static gint
+uri_autoplug_select (GstElement * uribin, const gchar * caps_str,
+    const gchar * name)
+{
+  GstElementFactory *factory;
+  GstCaps *caps;
+  GstPad *pad;
+  gint result = -1;
+
+  factory = gst_element_factory_find (name);
+  fail_unless (factory != NULL);
+  caps = gst_caps_from_string (caps_str);
+  pad = gst_pad_new ("src", GST_PAD_SRC);
+  g_signal_emit_by_name (uribin, "autoplug-select", pad, caps, factory,
+      &result);
+  gst_object_unref (pad);
+  gst_caps_unref (caps);
+  gst_object_unref (factory);
+
+  return result;
+}
+
+static gint
+uri_autoplug_select_value (GstElement * uribin, const gchar * nick)
+{
+  GSignalQuery query;
+  GEnumClass *klass;
+  GEnumValue *value;
+
+  g_signal_query (g_signal_lookup ("autoplug-select", G_OBJECT_TYPE (uribin)),
+      &query);
+  klass = g_type_class_ref (query.return_type & ~G_SIGNAL_TYPE_STATIC_SCOPE);
+  value = g_enum_get_value_by_nick (klass, nick);
+  fail_unless (value != NULL);
+  g_type_class_unref (klass);
+
+  return value->value;
+}
+
+GST_START_TEST (test_uri_passthrough)
+{
+  GstRTSPMediaFactoryURI *factory;
+  GstElement *pipeline, *element, *uribin;
+  GstBus *bus;
+  GstMessage *msg;
+  GstCaps *caps;
+  GstPad *pad;
+  GError *err = NULL;
+  gint select_try, select_skip;
+
+  /* without passthrough uridecodebin decides */
+  factory = gst_rtsp_media_factory_uri_new ();
+  element = create_uri_element (factory, &uribin);
+  select_try = uri_autoplug_select_value (uribin, "try");
+  select_skip = uri_autoplug_select_value (uribin, "skip");
+  fail_unless (uri_autoplug_select (uribin, "image/jpeg",
+          "jpegdec") == select_try);
+  gst_object_unref (uribin);
+  gst_object_unref (element);
+  g_object_unref (factory);
+
+  factory = gst_rtsp_media_factory_uri_new ();
+  g_object_set (factory, "passthrough", TRUE, NULL);
+  element = create_uri_element (factory, &uribin);
+  pipeline = gst_pipeline_new (NULL);
+  gst_bin_add (GST_BIN (pipeline), element);
+
+  /* decoders are never plugged */
+  fail_unless (uri_autoplug_select (uribin, "image/jpeg",
+          "jpegdec") == select_skip);
+
+  /* parsers only for streams that were not parsed yet */
+  fail_unless (uri_autoplug_select (uribin,
+          "audio/mpeg, mpegversion=(int)1", "mpegaudioparse") == select_try);
+  fail_unless (uri_autoplug_select (uribin,
+          "audio/mpeg, mpegversion=(int)1, parsed=(boolean)true",
+          "mpegaudioparse") == select_skip);
+
+  /* a stream that needs transcoding is reported on the bus */
+  caps = gst_caps_from_string ("video/x-theora");
+  pad = gst_pad_new ("src", GST_PAD_SRC);
+  g_signal_emit_by_name (uribin, "unknown-type", pad, caps);
+  gst_object_unref (pad);
+  gst_caps_unref (caps);
+
+  bus = gst_element_get_bus (pipeline);
+  msg = gst_bus_pop_filtered (bus, GST_MESSAGE_WARNING);
+  fail_unless (msg != NULL);
+  gst_message_parse_warning (msg, &err, NULL);
+  fail_unless (g_error_matches (err, GST_STREAM_ERROR,
+          GST_STREAM_ERROR_CODEC_NOT_FOUND));
+  g_error_free (err);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  gst_object_unref (uribin);
+  gst_object_unref (pipeline);
+  g_object_unref (factory);
+}
+
+GST_END_TEST;
+
 static Suite *
 rtspmediafactory_suite (void)
 {
@@ -329,6 +749,10 @@ rtspmediafactory_suite (void)
   tcase_add_test (tc, test_addresspool);
   tcase_add_test (tc, test_permissions);
   tcase_add_test (tc, test_reset);
+  tcase_add_test (tc, test_shared_source);
+  tcase_add_test (tc, test_relay);
+  tcase_add_test (tc, test_uri_autoplug_cache);
+  tcase_add_test (tc, test_uri_passthrough);
 
   return s;
 }
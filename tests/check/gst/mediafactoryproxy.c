@@ -0,0 +1,283 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+#include <rtsp-server.h>
+#include <rtsp-media-factory-proxy.h>
+
+/* the upstream server, it runs in its own thread because the proxy factory
+ * blocks until the upstream session is connected */
+static GstRTSPServer *server;
+static GMainLoop *server_loop;
+static GThread *server_thread;
+
+static gint n_connected;
+static gint n_closed;
+
+/* the packets that the downstream appsrc receives */
+static GMutex check_lock;
+static gint n_buffers;
+static gboolean have_ssrc;
+static guint32 first_ssrc;
+static gboolean ssrc_changed;
+static guint32 last_ts;
+static guint32 max_ts_step;
+
+static void
+client_closed (GstRTSPClient * client, gpointer user_data)
+{
+  g_atomic_int_inc (&n_closed);
+}
+
+static void
+client_connected (GstRTSPServer * server, GstRTSPClient * client,
+    gpointer user_data)
+{
+  g_atomic_int_inc (&n_connected);
+  g_signal_connect (client, "closed", (GCallback) client_closed, NULL);
+}
+
+static gpointer
+server_thread_func (gpointer user_data)
+{
+  g_main_loop_run (server_loop);
+
+  return NULL;
+}
+
+/* returns the url of the upstream stream */
+static gchar *
+start_upstream (void)
+{
+  GstRTSPMountPoints *mounts;
+  GstRTSPMediaFactory *factory;
+  GMainContext *context;
+  gchar *service, *url;
+
+  server = gst_rtsp_server_new ();
+  gst_rtsp_server_set_address (server, "127.0.0.1");
+  gst_rtsp_server_set_service (server, "0");
+  g_signal_connect (server, "client-connected", (GCallback) client_connected,
+      NULL);
+
+  factory = gst_rtsp_media_factory_new ();
+  gst_rtsp_media_factory_set_launch (factory,
+      "( videotestsrc is-live=true ! "
+      "video/x-raw,width=64,height=48,framerate=30/1 ! "
+      "rtpvrawpay name=pay0 pt=96 )");
+  /* the packets stop with the connection when they are interleaved */
+  gst_rtsp_media_factory_set_protocols (factory, GST_RTSP_LOWER_TRANS_TCP);
+
+  mounts = gst_rtsp_server_get_mount_points (server);
+  gst_rtsp_mount_points_add_factory (mounts, "/test", factory);
+  g_object_unref (mounts);
+
+  context = g_main_context_new ();
+  fail_if (gst_rtsp_server_attach (server, context) == 0);
+  server_loop = g_main_loop_new (context, FALSE);
+  g_main_context_unref (context);
+  server_thread = g_thread_new ("upstream", server_thread_func, NULL);
+
+  service = gst_rtsp_server_get_service (server);
+  url = g_strdup_printf ("rtsp://127.0.0.1:%s/test", service);
+  g_free (service);
+
+  return url;
+}
+
+static void
+stop_upstream (void)
+{
+  g_main_loop_quit (server_loop);
+  g_thread_join (server_thread);
+  g_main_loop_unref (server_loop);
+  g_object_unref (server);
+}
+
+/* closes the connections of the upstream clients */
+static void
+drop_upstream_clients (void)
+{
+  GList *clients, *walk;
+
+  clients = gst_rtsp_server_client_filter (server, NULL, NULL);
+  for (walk = clients; walk; walk = g_list_next (walk))
+    gst_rtsp_client_close (walk->data);
+  g_list_free_full (clients, g_object_unref);
+}
+
+/* wait up to 10 seconds until @value is at least @min */
+static gboolean
+wait_for (gint * value, gint min)
+{
+  gint i;
+
+  for (i = 0; i < 1000; i++) {
+    if (g_atomic_int_get (value) >= min)
+      return TRUE;
+    g_usleep (G_USEC_PER_SEC / 100);
+  }
+  return FALSE;
+}
+
+static GstPadProbeReturn
+count_buffer (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint32 ssrc, ts;
+
+  if (!gst_rtp_buffer_map (GST_PAD_PROBE_INFO_BUFFER (info), GST_MAP_READ,
+          &rtp))
+    return GST_PAD_PROBE_OK;
+  ssrc = gst_rtp_buffer_get_ssrc (&rtp);
+  ts = gst_rtp_buffer_get_timestamp (&rtp);
+  gst_rtp_buffer_unmap (&rtp);
+
+  g_mutex_lock (&check_lock);
+  if (!have_ssrc) {
+    first_ssrc = ssrc;
+    have_ssrc = TRUE;
+  } else {
+    if (ssrc != first_ssrc)
+      ssrc_changed = TRUE;
+    max_ts_step = MAX (max_ts_step, ts - last_ts);
+  }
+  last_ts = ts;
+  g_mutex_unlock (&check_lock);
+
+  g_atomic_int_inc (&n_buffers);
+
+  return GST_PAD_PROBE_OK;
+}
+
+/* a pipeline that plays the appsrc pay0 of @element */
+static GstElement *
+play_element (GstElement * element)
+{
+  GstElement *pipeline, *appsrc, *sink;
+  GstPad *pad;
+
+  pipeline = gst_pipeline_new (NULL);
+  gst_bin_add (GST_BIN (pipeline), element);
+
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (sink, "sync", FALSE, NULL);
+  gst_bin_add (GST_BIN (element), sink);
+
+  appsrc = gst_bin_get_by_name (GST_BIN (element), "pay0");
+  fail_unless (appsrc != NULL);
+  fail_unless (gst_element_link (appsrc, sink));
+
+  pad = gst_element_get_static_pad (appsrc, "src");
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER, count_buffer, NULL,
+      NULL);
+  gst_object_unref (pad);
+  gst_object_unref (appsrc);
+
+  fail_if (gst_element_set_state (pipeline, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE);
+
+  return pipeline;
+}
+
+GST_START_TEST (test_proxy_upstream)
+{
+  GstRTSPMediaFactoryProxy *factory1, *factory2;
+  GstElement *element1, *element2, *pipeline;
+  GstRTSPUrl *url;
+  gchar *location;
+
+  location = start_upstream ();
+  gst_rtsp_url_parse ("rtsp://localhost:8554/proxy", &url);
+
+  factory1 = gst_rtsp_media_factory_proxy_new ();
+  gst_rtsp_media_factory_proxy_set_url (factory1, location);
+  gst_rtsp_media_factory_proxy_set_idle_timeout (factory1, 1);
+  factory2 = gst_rtsp_media_factory_proxy_new ();
+  gst_rtsp_media_factory_proxy_set_url (factory2, location);
+  gst_rtsp_media_factory_proxy_set_idle_timeout (factory2, 1);
+
+  /* both factories are served by one upstream session */
+  element1 =
+      gst_rtsp_media_factory_create_element (GST_RTSP_MEDIA_FACTORY
+      (factory1), url);
+  fail_unless (GST_IS_BIN (element1));
+  element2 =
+      gst_rtsp_media_factory_create_element (GST_RTSP_MEDIA_FACTORY
+      (factory2), url);
+  fail_unless (GST_IS_BIN (element2));
+  fail_unless (g_atomic_int_get (&n_connected) == 1);
+
+  pipeline = play_element (element1);
+  fail_unless (wait_for (&n_buffers, 10));
+
+  /* the upstream session is opened again, the downstream appsrc keeps its
+   * SSRC and the timestamps continue */
+  drop_upstream_clients ();
+  fail_unless (wait_for (&n_connected, 2));
+  g_atomic_int_set (&n_buffers, 1);
+  fail_unless (wait_for (&n_buffers, 20));
+
+  g_mutex_lock (&check_lock);
+  fail_if (ssrc_changed);
+  fail_unless (max_ts_step < 10 * 90000);
+  g_mutex_unlock (&check_lock);
+
+  /* without clients the upstream session is closed after the idle timeout */
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+  gst_object_unref (element2);
+  fail_unless (wait_for (&n_closed, 2));
+  fail_unless (g_atomic_int_get (&n_connected) == 2);
+
+  /* and opened again for the next client */
+  element1 =
+      gst_rtsp_media_factory_create_element (GST_RTSP_MEDIA_FACTORY
+      (factory1), url);
+  fail_unless (GST_IS_BIN (element1));
+  fail_unless (g_atomic_int_get (&n_connected) == 3);
+  gst_object_unref (element1);
+  fail_unless (wait_for (&n_closed, 3));
+
+  g_object_unref (factory1);
+  g_object_unref (factory2);
+  gst_rtsp_url_free (url);
+  g_free (location);
+
+  stop_upstream ();
+}
+
+GST_END_TEST;
+
+static Suite *
+rtspmediafactoryproxy_suite (void)
+{
+  Suite *s = suite_create ("rtspmediafactoryproxy");
+  TCase *tc = tcase_create ("general");
+
+  suite_add_tcase (s, tc);
+  tcase_set_timeout (tc, 60);
+  tcase_add_test (tc, test_proxy_upstream);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtspmediafactoryproxy);
@@ -0,0 +1,547 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <unistd.h>
+
+#include <glib/gstdio.h>
+
+#include <gst/check/gstcheck.h>
+
+#include <rtsp-media-factory-vod.h>
+
+/* the samples of the test file, 1/30 s each */
+#define N_SAMPLES       6
+#define TIMESCALE       90000
+#define SAMPLE_DELTA    3000
+
+static const gint32 sample_cts[N_SAMPLES] = { 3000, 6000, 0, 3000, 6000, 0 };
+
+static const gboolean sample_key[N_SAMPLES] =
+    { TRUE, FALSE, FALSE, TRUE, FALSE, FALSE };
+
+/* avcC with one SPS and one PPS */
+static const guint8 avcc[] = {
+  0x01, 0x42, 0xc0, 0x1e, 0xff, 0xe1, 0x00, 0x06,
+  0x67, 0x42, 0xc0, 0x1e, 0xd9, 0x00, 0x01, 0x00,
+  0x04, 0x68, 0xce, 0x3c, 0x80
+};
+
+enum
+{
+  MP4_CO64 = (1 << 0),
+  MP4_NO_STSS = (1 << 1),
+  MP4_BAD_STSZ = (1 << 2),      /* more samples than sizes */
+  MP4_BAD_STCO = (1 << 3),      /* a chunk after the end of the file */
+  MP4_BAD_STTS = (1 << 4)       /* more entries than data */
+};
+
+typedef struct
+{
+  GByteArray *data;
+  guint64 offsets[N_SAMPLES];
+  gchar *path;
+} MP4File;
+
+static void
+put_u16 (GByteArray * data, guint16 val)
+{
+  guint8 bytes[2];
+
+  GST_WRITE_UINT16_BE (bytes, val);
+  g_byte_array_append (data, bytes, 2);
+}
+
+static void
+put_u32 (GByteArray * data, guint32 val)
+{
+  guint8 bytes[4];
+
+  GST_WRITE_UINT32_BE (bytes, val);
+  g_byte_array_append (data, bytes, 4);
+}
+
+static void
+put_u64 (GByteArray * data, guint64 val)
+{
+  guint8 bytes[8];
+
+  GST_WRITE_UINT64_BE (bytes, val);
+  g_byte_array_append (data, bytes, 8);
+}
+
+static void
+put_fill (GByteArray * data, guint8 val, guint len)
+{
+  while (len--)
+    g_byte_array_append (data, &val, 1);
+}
+
+static guint
+box_open (GByteArray * data, const gchar * type)
+{
+  guint start = data->len;
+
+  put_u32 (data, 0);
+  g_byte_array_append (data, (const guint8 *) type, 4);
+
+  return start;
+}
+
+static guint
+full_box_open (GByteArray * data, const gchar * type)
+{
+  guint start = box_open (data, type);
+
+  put_u32 (data, 0);
+
+  return start;
+}
+
+static void
+box_close (GByteArray * data, guint start)
+{
+  GST_WRITE_UINT32_BE (data->data + start, data->len - start);
+}
+
+static guint
+sample_size (guint i)
+{
+  return 8 + i;
+}
+
+/* an mdat with the samples in 4 chunks followed by the moov of one H.264
+ * track, the chunks have gaps between them */
+static MP4File *
+mp4_file_new (guint flags)
+{
+  static const guint chunk_first[] = { 0, 3, 4, 5 };
+  MP4File *mp4;
+  GByteArray *data;
+  guint mdat, moov, trak, mdia, minf, stbl, box, entry, i;
+
+  mp4 = g_slice_new0 (MP4File);
+  mp4->data = data = g_byte_array_new ();
+
+  mdat = box_open (data, "mdat");
+  for (i = 0; i < N_SAMPLES; i++) {
+    if (i >= 3)
+      put_fill (data, 0xee, 4);
+    mp4->offsets[i] = data->len;
+    put_u32 (data, sample_size (i) - 4);
+    put_fill (data, sample_key[i] ? 0x65 : 0x41, 1);
+    put_fill (data, i, sample_size (i) - 5);
+  }
+  box_close (data, mdat);
+
+  moov = box_open (data, "moov");
+  trak = box_open (data, "trak");
+
+  box = full_box_open (data, "tkhd");
+  put_u32 (data, 0);
+  put_u32 (data, 0);
+  put_u32 (data, 1);
+  put_u32 (data, 0);
+  put_u32 (data, N_SAMPLES * SAMPLE_DELTA);
+  box_close (data, box);
+
+  mdia = box_open (data, "mdia");
+  box = full_box_open (data, "mdhd");
+  put_u32 (data, 0);
+  put_u32 (data, 0);
+  put_u32 (data, TIMESCALE);
+  put_u32 (data, N_SAMPLES * SAMPLE_DELTA);
+  put_u32 (data, 0);
+  box_close (data, box);
+
+  minf = box_open (data, "minf");
+  stbl = box_open (data, "stbl");
+
+  box = full_box_open (data, "stsd");
+  put_u32 (data, 1);
+  entry = box_open (data, "avc1");
+  put_fill (data, 0, 6);
+  put_u16 (data, 1);
+  put_fill (data, 0, 16);
+  put_u16 (data, 320);
+  put_u16 (data, 240);
+  put_fill (data, 0, 50);
+  i = box_open (data, "avcC");
+  g_byte_array_append (data, avcc, sizeof (avcc));
+  box_close (data, i);
+  box_close (data, entry);
+  box_close (data, box);
+
+  box = full_box_open (data, "stts");
+  put_u32 (data, flags & MP4_BAD_STTS ? 5 : 1);
+  put_u32 (data, N_SAMPLES);
+  put_u32 (data, SAMPLE_DELTA);
+  box_close (data, box);
+
+  box = full_box_open (data, "ctts");
+  put_u32 (data, N_SAMPLES);
+  for (i = 0; i < N_SAMPLES; i++) {
+    put_u32 (data, 1);
+    put_u32 (data, sample_cts[i]);
+  }
+  box_close (data, box);
+
+  if (!(flags & MP4_NO_STSS)) {
+    box = full_box_open (data, "stss");
+    put_u32 (data, 2);
+    put_u32 (data, 1);
+    put_u32 (data, 4);
+    box_close (data, box);
+  }
+
+  /* 3 samples in the first chunk and 1 in the others */
+  box = full_box_open (data, "stsc");
+  put_u32 (data, 2);
+  put_u32 (data, 1);
+  put_u32 (data, 3);
+  put_u32 (data, 1);
+  put_u32 (data, 2);
+  put_u32 (data, 1);
+  put_u32 (data, 1);
+  box_close (data, box);
+
+  box = full_box_open (data, "stsz");
+  put_u32 (data, 0);
+  put_u32 (data, flags & MP4_BAD_STSZ ? 1000 : N_SAMPLES);
+  for (i = 0; i < N_SAMPLES; i++)
+    put_u32 (data, sample_size (i));
+  box_close (data, box);
+
+  box = full_box_open (data, flags & MP4_CO64 ? "co64" : "stco");
+  put_u32 (data, G_N_ELEMENTS (chunk_first));
+  for (i = 0; i < G_N_ELEMENTS (chunk_first); i++) {
+    guint64 offset = mp4->offsets[chunk_first[i]];
+
+    if ((flags & MP4_BAD_STCO) && i == G_N_ELEMENTS (chunk_first) - 1)
+      offset = 0x7fffffff;
+    if (flags & MP4_CO64)
+      put_u64 (data, offset);
+    else
+      put_u32 (data, offset);
+  }
+  box_close (data, box);
+
+  box_close (data, stbl);
+  box_close (data, minf);
+  box_close (data, mdia);
+  box_close (data, trak);
+  box_close (data, moov);
+
+  return mp4;
+}
+
+/* write the first @len bytes of @mp4 to a new file */
+static GstRTSPMediaFactoryVOD *
+mp4_file_write (MP4File * mp4, gsize len)
+{
+  GstRTSPMediaFactoryVOD *factory;
+  gint fd;
+
+  fd = g_file_open_tmp ("vodXXXXXX.mp4", &mp4->path, NULL);
+  fail_unless (fd >= 0);
+  close (fd);
+  fail_unless (g_file_set_contents (mp4->path, (const gchar *) mp4->data->data,
+          MIN (len, mp4->data->len), NULL));
+
+  factory = gst_rtsp_media_factory_vod_new ();
+  gst_rtsp_media_factory_vod_set_location (factory, mp4->path);
+
+  return factory;
+}
+
+static void
+mp4_file_free (MP4File * mp4)
+{
+  if (mp4->path) {
+    g_unlink (mp4->path);
+    g_free (mp4->path);
+  }
+  g_byte_array_unref (mp4->data);
+  g_slice_free (MP4File, mp4);
+}
+
+static GMutex vod_lock;
+/* the buffers that reached the payloader since the last segment */
+static GPtrArray *vod_buffers;
+
+static GstPadProbeReturn
+vod_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  g_mutex_lock (&vod_lock);
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER) {
+    g_ptr_array_add (vod_buffers,
+        gst_buffer_ref (GST_PAD_PROBE_INFO_BUFFER (info)));
+  } else if (GST_EVENT_TYPE (GST_PAD_PROBE_INFO_EVENT (info)) ==
+      GST_EVENT_SEGMENT) {
+    g_ptr_array_set_size (vod_buffers, 0);
+  }
+  g_mutex_unlock (&vod_lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static GstElement *
+vod_pipeline_new (GstRTSPMediaFactoryVOD * factory)
+{
+  GstRTSPUrl *url;
+  GstElement *pipeline, *bin, *pay, *sink;
+  GstPad *pad;
+
+  fail_unless (gst_rtsp_url_parse ("rtsp://localhost:8554/test",
+          &url) == GST_RTSP_OK);
+  bin = gst_rtsp_media_factory_create_element (GST_RTSP_MEDIA_FACTORY
+      (factory), url);
+  gst_rtsp_url_free (url);
+  fail_unless (bin != NULL);
+
+  pipeline = gst_pipeline_new (NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  g_object_set (sink, "sync", FALSE, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), bin, sink, NULL);
+
+  pay = gst_bin_get_by_name (GST_BIN (bin), "pay0");
+  fail_unless (pay != NULL);
+  fail_unless (gst_element_link (pay, sink));
+
+  vod_buffers = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gst_buffer_unref);
+  pad = gst_element_get_static_pad (pay, "sink");
+  gst_pad_add_probe (pad,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM,
+      vod_probe, NULL, NULL);
+  gst_object_unref (pad);
+  gst_object_unref (pay);
+
+  return pipeline;
+}
+
+static void
+vod_pipeline_free (GstElement * pipeline)
+{
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  gst_object_unref (pipeline);
+  g_ptr_array_unref (vod_buffers);
+  vod_buffers = NULL;
+}
+
+static GstClockTime
+sample_time (gint64 ts)
+{
+  return gst_util_uint64_scale (ts, GST_SECOND, TIMESCALE);
+}
+
+static void
+check_sample (MP4File * mp4, GstBuffer * buffer, guint i, gboolean all_key)
+{
+  fail_unless_equals_int (gst_buffer_get_size (buffer), sample_size (i));
+  fail_unless (gst_buffer_memcmp (buffer, 0,
+          mp4->data->data + mp4->offsets[i], sample_size (i)) == 0);
+  fail_unless_equals_uint64 (GST_BUFFER_DTS (buffer),
+      sample_time (i * SAMPLE_DELTA));
+  fail_unless_equals_uint64 (GST_BUFFER_PTS (buffer),
+      sample_time (i * SAMPLE_DELTA + sample_cts[i]));
+  fail_unless_equals_uint64 (GST_BUFFER_DURATION (buffer),
+      sample_time (SAMPLE_DELTA));
+  fail_unless (GST_BUFFER_FLAG_IS_SET (buffer,
+          GST_BUFFER_FLAG_DELTA_UNIT) == !(all_key || sample_key[i]));
+}
+
+/* play the whole file and check every sample */
+static void
+check_play (MP4File * mp4, GstRTSPMediaFactoryVOD * factory,
+    gboolean all_key)
+{
+  GstElement *pipeline;
+  GstMessage *msg;
+  GstBus *bus;
+  guint i;
+
+  pipeline = vod_pipeline_new (factory);
+  bus = gst_element_get_bus (pipeline);
+
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+
+  g_mutex_lock (&vod_lock);
+  fail_unless_equals_int (vod_buffers->len, N_SAMPLES);
+  for (i = 0; i < N_SAMPLES; i++)
+    check_sample (mp4, g_ptr_array_index (vod_buffers, i), i, all_key);
+  g_mutex_unlock (&vod_lock);
+
+  gst_object_unref (bus);
+  vod_pipeline_free (pipeline);
+}
+
+GST_START_TEST (test_vod_index)
+{
+  MP4File *mp4;
+  GstRTSPMediaFactoryVOD *factory;
+  gchar *location;
+
+  mp4 = mp4_file_new (0);
+  factory = mp4_file_write (mp4, mp4->data->len);
+
+  location = gst_rtsp_media_factory_vod_get_location (factory);
+  fail_unless_equals_string (location, mp4->path);
+  g_free (location);
+
+  fail_unless (gst_rtsp_media_factory_vod_preload (factory));
+  check_play (mp4, factory, FALSE);
+
+  g_object_unref (factory);
+  mp4_file_free (mp4);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_vod_co64)
+{
+  MP4File *mp4;
+  GstRTSPMediaFactoryVOD *factory;
+
+  /* without stss all samples are keyframes */
+  mp4 = mp4_file_new (MP4_CO64 | MP4_NO_STSS);
+  factory = mp4_file_write (mp4, mp4->data->len);
+
+  fail_unless (gst_rtsp_media_factory_vod_preload (factory));
+  check_play (mp4, factory, TRUE);
+
+  g_object_unref (factory);
+  mp4_file_free (mp4);
+}
+
+GST_END_TEST;
+
+/* seek to @ts and check that the first sample is @expected */
+static void
+check_seek (MP4File * mp4, GstElement * pipeline, gint64 ts, guint expected)
+{
+  fail_unless (gst_element_seek_simple (pipeline, GST_FORMAT_TIME,
+          GST_SEEK_FLAG_FLUSH, sample_time (ts)));
+  fail_unless (gst_element_get_state (pipeline, NULL, NULL,
+          GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_SUCCESS);
+
+  g_mutex_lock (&vod_lock);
+  fail_unless (vod_buffers->len > 0);
+  check_sample (mp4, g_ptr_array_index (vod_buffers, 0), expected, FALSE);
+  g_mutex_unlock (&vod_lock);
+}
+
+GST_START_TEST (test_vod_seek)
+{
+  MP4File *mp4;
+  GstRTSPMediaFactoryVOD *factory;
+  GstElement *pipeline;
+
+  mp4 = mp4_file_new (0);
+  factory = mp4_file_write (mp4, mp4->data->len);
+  pipeline = vod_pipeline_new (factory);
+
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PAUSED) !=
+      GST_STATE_CHANGE_FAILURE);
+  fail_unless (gst_element_get_state (pipeline, NULL, NULL,
+          GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_SUCCESS);
+  g_mutex_lock (&vod_lock);
+  fail_unless (vod_buffers->len > 0);
+  check_sample (mp4, g_ptr_array_index (vod_buffers, 0), 0, FALSE);
+  g_mutex_unlock (&vod_lock);
+
+  /* a seek starts at the last keyframe at or before the position */
+  check_seek (mp4, pipeline, 5 * SAMPLE_DELTA, 3);
+  check_seek (mp4, pipeline, 2 * SAMPLE_DELTA + 100, 0);
+  check_seek (mp4, pipeline, 3 * SAMPLE_DELTA, 3);
+  check_seek (mp4, pipeline, 3 * SAMPLE_DELTA - 1, 0);
+  check_seek (mp4, pipeline, 0, 0);
+
+  vod_pipeline_free (pipeline);
+  g_object_unref (factory);
+  mp4_file_free (mp4);
+}
+
+GST_END_TEST;
+
+static void
+check_invalid (MP4File * mp4, gsize len)
+{
+  GstRTSPMediaFactoryVOD *factory;
+  GstRTSPUrl *url;
+
+  factory = mp4_file_write (mp4, len);
+  fail_if (gst_rtsp_media_factory_vod_preload (factory));
+
+  fail_unless (gst_rtsp_url_parse ("rtsp://localhost:8554/test",
+          &url) == GST_RTSP_OK);
+  fail_unless (gst_rtsp_media_factory_create_element (GST_RTSP_MEDIA_FACTORY
+          (factory), url) == NULL);
+  gst_rtsp_url_free (url);
+
+  g_object_unref (factory);
+  mp4_file_free (mp4);
+}
+
+GST_START_TEST (test_vod_corrupt)
+{
+  GstRTSPMediaFactoryVOD *factory;
+  MP4File *mp4;
+
+  /* broken tables */
+  check_invalid (mp4_file_new (MP4_BAD_STSZ), G_MAXSIZE);
+  check_invalid (mp4_file_new (MP4_BAD_STCO), G_MAXSIZE);
+  check_invalid (mp4_file_new (MP4_BAD_STTS), G_MAXSIZE);
+
+  /* truncated in the moov and in the mdat */
+  mp4 = mp4_file_new (0);
+  check_invalid (mp4, mp4->data->len - 20);
+  check_invalid (mp4_file_new (0), 40);
+
+  /* and no file at all */
+  factory = gst_rtsp_media_factory_vod_new ();
+  fail_if (gst_rtsp_media_factory_vod_preload (factory));
+  gst_rtsp_media_factory_vod_set_location (factory, "/nonexistent.mp4");
+  fail_if (gst_rtsp_media_factory_vod_preload (factory));
+  g_object_unref (factory);
+}
+
+GST_END_TEST;
+
+static Suite *
+rtspmediafactoryvod_suite (void)
+{
+  Suite *s = suite_create ("rtspmediafactoryvod");
+  TCase *tc = tcase_create ("general");
+
+  suite_add_tcase (s, tc);
+  tcase_add_test (tc, test_vod_index);
+  tcase_add_test (tc, test_vod_co64);
+  tcase_add_test (tc, test_vod_seek);
+  tcase_add_test (tc, test_vod_corrupt);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtspmediafactoryvod);
@@ -0,0 +1,283 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include <rtsp-socket-pool.h>
+
+static void
+wait_for_idle (GstRTSPSocketPool * pool, guint n_idle)
+{
+  gint i;
+
+  /* the pool is filled from another thread */
+  for (i = 0; i < 500; i++) {
+    if (gst_rtsp_socket_pool_get_n_idle (pool,
+            G_SOCKET_FAMILY_IPV4) >= n_idle)
+      return;
+    g_usleep (10 * G_TIME_SPAN_MILLISECOND);
+  }
+  fail ("socket pool was not filled");
+}
+
+static guint16
+get_port (GSocket * socket)
+{
+  GSocketAddress *sockaddr;
+  guint16 port;
+
+  sockaddr = g_socket_get_local_address (socket, NULL);
+  fail_unless (G_IS_INET_SOCKET_ADDRESS (sockaddr));
+  port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (sockaddr));
+  g_object_unref (sockaddr);
+
+  return port;
+}
+
+GST_START_TEST (test_pool_acquire)
+{
+  GstRTSPSocketPool *pool;
+  GSocket *rtp_socket, *rtcp_socket;
+  GstRTSPAddress *addr;
+  guint16 rtp_port;
+
+  pool = gst_rtsp_socket_pool_new ();
+  fail_unless (gst_rtsp_socket_pool_get_size (pool) > 0);
+
+  gst_rtsp_socket_pool_set_size (pool, 2);
+  fail_unless (gst_rtsp_socket_pool_get_size (pool) == 2);
+  wait_for_idle (pool, 2);
+
+  fail_unless (gst_rtsp_socket_pool_acquire (pool, G_SOCKET_FAMILY_IPV4,
+          &rtp_socket, &rtcp_socket, &addr));
+  fail_unless (addr == NULL);
+
+  /* away from the ports that the streams bind themselves */
+  rtp_port = get_port (rtp_socket);
+  fail_unless (rtp_port >= 29000);
+  fail_unless ((rtp_port & 1) == 0);
+  fail_unless (get_port (rtcp_socket) == rtp_port + 1);
+
+  g_object_unref (rtp_socket);
+  g_object_unref (rtcp_socket);
+
+  /* and it is filled up again */
+  wait_for_idle (pool, 2);
+
+  g_object_unref (pool);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_pool_address_pool)
+{
+  GstRTSPSocketPool *pool;
+  GstRTSPAddressPool *address_pool;
+  GSocket *rtp_socket, *rtcp_socket;
+  GstRTSPAddress *addr;
+
+  address_pool = gst_rtsp_address_pool_new ();
+  fail_unless (gst_rtsp_address_pool_add_range (address_pool,
+          "127.0.0.1", "127.0.0.1", 23000, 23003, 0));
+
+  pool = gst_rtsp_socket_pool_new ();
+  gst_rtsp_socket_pool_set_address_pool (pool, address_pool);
+  gst_rtsp_socket_pool_set_size (pool, 1);
+  wait_for_idle (pool, 1);
+
+  fail_unless (gst_rtsp_socket_pool_acquire (pool, G_SOCKET_FAMILY_IPV4,
+          &rtp_socket, &rtcp_socket, &addr));
+  fail_unless (addr != NULL);
+  fail_unless_equals_string (addr->address, "127.0.0.1");
+  fail_unless (get_port (rtp_socket) == addr->port);
+  fail_unless (get_port (rtcp_socket) == addr->port + 1);
+
+  /* the pool refills with the remaining ports */
+  wait_for_idle (pool, 1);
+
+  gst_rtsp_address_free (addr);
+  g_object_unref (rtp_socket);
+  g_object_unref (rtcp_socket);
+
+  g_object_unref (pool);
+  g_object_unref (address_pool);
+}
+
+GST_END_TEST;
+
+typedef struct
+{
+  GMutex lock;
+  GCond cond;
+  guint n_received;
+  gboolean rtcp;
+} MuxData;
+
+static MuxData mux_data;
+
+static void
+mux_receive (GObject * object, GstBuffer * buffer, gboolean rtcp)
+{
+  g_mutex_lock (&mux_data.lock);
+  mux_data.n_received++;
+  mux_data.rtcp = rtcp;
+  g_cond_signal (&mux_data.cond);
+  g_mutex_unlock (&mux_data.lock);
+
+  gst_buffer_unref (buffer);
+}
+
+static void
+send_to (GSocket * socket, guint16 port, const gchar * data, gsize size)
+{
+  GInetAddress *inetaddr;
+  GSocketAddress *sockaddr;
+
+  inetaddr = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  sockaddr = g_inet_socket_address_new (inetaddr, port);
+  fail_unless (g_socket_send_to (socket, sockaddr, data, size, NULL,
+          NULL) == size);
+  g_object_unref (sockaddr);
+  g_object_unref (inetaddr);
+}
+
+static void
+wait_for_received (guint n_received)
+{
+  gint64 end_time;
+
+  end_time = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+
+  g_mutex_lock (&mux_data.lock);
+  while (mux_data.n_received < n_received) {
+    if (!g_cond_wait_until (&mux_data.cond, &mux_data.lock, end_time))
+      break;
+  }
+  fail_unless (mux_data.n_received == n_received);
+  g_mutex_unlock (&mux_data.lock);
+}
+
+GST_START_TEST (test_pool_mux)
+{
+  GstRTSPSocketPool *pool;
+  GSocket *rtp_socket, *rtcp_socket, *rtp_socket2, *rtcp_socket2;
+  GSocket *client;
+  GstRTSPAddress *addr;
+  GInetAddress *inetaddr;
+  GSocketAddress *sockaddr;
+  GObject *object;
+  guint16 rtp_port, client_port;
+  /* RR with one report block about SSRC 0x11223344 */
+  const guint8 rr[] = {
+    0x81, 0xc9, 0x00, 0x07, 0xaa, 0xbb, 0xcc, 0xdd,
+    0x11, 0x22, 0x33, 0x44, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+  };
+
+  g_mutex_init (&mux_data.lock);
+  g_cond_init (&mux_data.cond);
+  mux_data.n_received = 0;
+
+  pool = gst_rtsp_socket_pool_new ();
+  gst_rtsp_socket_pool_set_size (pool, 0);
+  fail_if (gst_rtsp_socket_pool_acquire_mux (pool, G_SOCKET_FAMILY_IPV4,
+          &rtp_socket, &rtcp_socket, &addr));
+
+  gst_rtsp_socket_pool_set_mux (pool, TRUE);
+  fail_unless (gst_rtsp_socket_pool_get_mux (pool));
+
+  /* all streams get the same sockets */
+  fail_unless (gst_rtsp_socket_pool_acquire_mux (pool, G_SOCKET_FAMILY_IPV4,
+          &rtp_socket, &rtcp_socket, &addr));
+  fail_unless (addr == NULL);
+  fail_unless (gst_rtsp_socket_pool_acquire_mux (pool, G_SOCKET_FAMILY_IPV4,
+          &rtp_socket2, &rtcp_socket2, &addr));
+  fail_unless (rtp_socket == rtp_socket2);
+  fail_unless (rtcp_socket == rtcp_socket2);
+  g_object_unref (rtp_socket2);
+  g_object_unref (rtcp_socket2);
+
+  rtp_port = get_port (rtp_socket);
+  fail_unless (get_port (rtcp_socket) == rtp_port + 1);
+
+  client = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  fail_unless (client != NULL);
+  inetaddr = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  sockaddr = g_inet_socket_address_new (inetaddr, 0);
+  fail_unless (g_socket_bind (client, sockaddr, FALSE, NULL));
+  g_object_unref (sockaddr);
+  g_object_unref (inetaddr);
+  client_port = get_port (client);
+
+  object = g_object_new (G_TYPE_OBJECT, NULL);
+
+  /* packets are routed by their source address */
+  gst_rtsp_socket_pool_add_mux_source (pool, "127.0.0.1", client_port,
+      mux_receive, object);
+  send_to (client, rtp_port, "rtp", 3);
+  wait_for_received (1);
+  fail_if (mux_data.rtcp);
+  send_to (client, rtp_port + 1, "rtcp", 4);
+  wait_for_received (2);
+  fail_unless (mux_data.rtcp);
+
+  /* and RTCP from unknown addresses by the SSRC in the report */
+  gst_rtsp_socket_pool_remove_mux_source (pool, "127.0.0.1", client_port);
+  gst_rtsp_socket_pool_add_mux_ssrc (pool, 0x11223344, mux_receive, object);
+  send_to (client, rtp_port, (const gchar *) rr, sizeof (rr));
+  send_to (client, rtp_port + 1, (const gchar *) rr, sizeof (rr));
+  wait_for_received (3);
+  fail_unless (mux_data.rtcp);
+
+  /* nothing is delivered after the object is gone */
+  g_object_unref (object);
+  send_to (client, rtp_port + 1, (const gchar *) rr, sizeof (rr));
+  gst_rtsp_socket_pool_remove_mux_ssrc (pool, 0x11223344);
+  g_usleep (100 * G_TIME_SPAN_MILLISECOND);
+  wait_for_received (3);
+
+  g_object_unref (client);
+  g_object_unref (rtp_socket);
+  g_object_unref (rtcp_socket);
+  g_object_unref (pool);
+
+  g_cond_clear (&mux_data.cond);
+  g_mutex_clear (&mux_data.lock);
+}
+
+GST_END_TEST;
+
+static Suite *
+rtspsocketpool_suite (void)
+{
+  Suite *s = suite_create ("rtspsocketpool");
+  TCase *tc = tcase_create ("general");
+
+  suite_add_tcase (s, tc);
+  tcase_set_timeout (tc, 20);
+  tcase_add_test (tc, test_pool_acquire);
+  tcase_add_test (tc, test_pool_address_pool);
+  tcase_add_test (tc, test_pool_mux);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtspsocketpool);
@@ -18,6 +18,15 @@
  */
 
 #include <gst/check/gstcheck.h>
+#include <gst/base/gstbasetransform.h>
+#include <gst/net/gstnetaddressmeta.h>
+#include <gst/rtp/gstrtcpbuffer.h>
+#include <gst/rtp/gstrtpbuffer.h>
+
+#ifndef G_OS_WIN32
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
 
 #include <rtsp-stream.h>
 
@@ -92,6 +101,1448 @@ GST_START_TEST (test_get_sockets)
 
 GST_END_TEST;
 
+GST_START_TEST (test_rtp_rewrite)
+{
+  GstPad *srcpad;
+  GstElement *pay;
+  GstRTSPStream *stream;
+  GstRTSPTransport *tr;
+  GstRTSPStreamTransport *trans;
+  GstBuffer *buffer, *out;
+  GstMemory *payload;
+  GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  GstRTCPPacket p;
+  guint8 header[12];
+  guint32 ssrc;
+  guint16 seq_offset;
+  guint32 rtptime_offset;
+  const guint8 packet[] = {
+    0x80, 0x60, 0x00, 0x10, 0x00, 0x00, 0x10, 0x00,
+    0x11, 0x22, 0x33, 0x44, 0xaa, 0xbb, 0xcc, 0xdd
+  };
+
+  srcpad = gst_pad_new ("testsrcpad", GST_PAD_SRC);
+  pay = gst_element_factory_make ("rtpgstpay", "testpayloader");
+  fail_unless (pay != NULL);
+  stream = gst_rtsp_stream_new (0, pay, srcpad);
+  gst_object_unref (pay);
+  gst_object_unref (srcpad);
+
+  fail_unless (gst_rtsp_transport_new (&tr) == GST_RTSP_OK);
+  trans = gst_rtsp_stream_transport_new (stream, tr);
+
+  buffer = gst_buffer_new_allocate (NULL, sizeof (packet), NULL);
+  gst_buffer_fill (buffer, 0, packet, sizeof (packet));
+  GST_BUFFER_PTS (buffer) = GST_SECOND;
+
+  /* nothing to rewrite */
+  fail_if (gst_rtsp_stream_transport_get_rtp_rewrite (trans, NULL, NULL,
+          NULL));
+  out = gst_rtsp_stream_transport_rewrite_rtp (trans, buffer);
+  fail_unless (out == buffer);
+  gst_buffer_unref (out);
+
+  gst_rtsp_stream_transport_set_rtp_rewrite (trans, TRUE, 0x55667788, 0xfff0,
+      0x100);
+  fail_unless (gst_rtsp_stream_transport_get_rtp_rewrite (trans, &ssrc,
+          &seq_offset, &rtptime_offset));
+  fail_unless (ssrc == 0x55667788);
+  fail_unless (seq_offset == 0xfff0);
+  fail_unless (rtptime_offset == 0x100);
+
+  out = gst_rtsp_stream_transport_rewrite_rtp (trans, buffer);
+  fail_unless (gst_buffer_get_size (out) == sizeof (packet));
+  fail_unless (GST_BUFFER_PTS (out) == GST_SECOND);
+  gst_buffer_extract (out, 0, header, 12);
+  fail_unless (GST_READ_UINT16_BE (header + 2) == 0x0000);
+  fail_unless (GST_READ_UINT32_BE (header + 4) == 0x1100);
+  fail_unless (GST_READ_UINT32_BE (header + 8) == 0x55667788);
+  fail_unless (gst_buffer_memcmp (out, 12, packet + 12, 4) == 0);
+
+  /* the header is a new memory, the payload is shared */
+  fail_unless (gst_buffer_n_memory (out) == 2);
+  payload = gst_buffer_peek_memory (out, 1);
+  fail_unless (payload->parent == gst_buffer_peek_memory (buffer, 0));
+
+  /* the original packet is not touched */
+  fail_unless (gst_buffer_memcmp (buffer, 0, packet, sizeof (packet)) == 0);
+
+  gst_buffer_unref (out);
+  gst_buffer_unref (buffer);
+
+  /* the RTCP of the sender gets the SSRC and RTP time of the rewrite */
+  buffer = gst_rtcp_buffer_new (1000);
+  fail_unless (gst_rtcp_buffer_map (buffer, GST_MAP_READWRITE, &rtcp));
+  fail_unless (gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_SR, &p));
+  gst_rtcp_packet_sr_set_sender_info (&p, 0x11223344, 0, 0x1000, 1, 4);
+  fail_unless (gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_SDES, &p));
+  fail_unless (gst_rtcp_packet_sdes_add_item (&p, 0x99999999));
+  fail_unless (gst_rtcp_packet_sdes_add_entry (&p, GST_RTCP_SDES_CNAME, 5,
+          (const guint8 *) "other"));
+  fail_unless (gst_rtcp_packet_sdes_add_item (&p, 0x11223344));
+  fail_unless (gst_rtcp_packet_sdes_add_entry (&p, GST_RTCP_SDES_CNAME, 4,
+          (const guint8 *) "test"));
+  fail_unless (gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_BYE, &p));
+  fail_unless (gst_rtcp_packet_bye_add_ssrc (&p, 0x11223344));
+  gst_rtcp_buffer_unmap (&rtcp);
+
+  out = gst_rtsp_stream_transport_rewrite_rtcp (trans, buffer);
+  fail_unless (out != buffer);
+  fail_unless (gst_rtcp_buffer_map (out, GST_MAP_READ, &rtcp));
+  fail_unless (gst_rtcp_buffer_get_first_packet (&rtcp, &p));
+  gst_rtcp_packet_sr_get_sender_info (&p, &ssrc, NULL, &rtptime_offset, NULL,
+      NULL);
+  fail_unless (ssrc == 0x55667788);
+  fail_unless (rtptime_offset == 0x1100);
+  fail_unless (gst_rtcp_packet_move_to_next (&p));
+  fail_unless (gst_rtcp_packet_sdes_first_item (&p));
+  fail_unless (gst_rtcp_packet_sdes_get_ssrc (&p) == 0x99999999);
+  fail_unless (gst_rtcp_packet_sdes_next_item (&p));
+  fail_unless (gst_rtcp_packet_sdes_get_ssrc (&p) == 0x55667788);
+  fail_unless (gst_rtcp_packet_move_to_next (&p));
+  fail_unless (gst_rtcp_packet_bye_get_nth_ssrc (&p, 0) == 0x55667788);
+  gst_rtcp_buffer_unmap (&rtcp);
+
+  /* the original packet is not touched */
+  fail_unless (gst_rtcp_buffer_map (buffer, GST_MAP_READ, &rtcp));
+  fail_unless (gst_rtcp_buffer_get_first_packet (&rtcp, &p));
+  gst_rtcp_packet_sr_get_sender_info (&p, &ssrc, NULL, &rtptime_offset, NULL,
+      NULL);
+  fail_unless (ssrc == 0x11223344);
+  fail_unless (rtptime_offset == 0x1000);
+  gst_rtcp_buffer_unmap (&rtcp);
+
+  gst_buffer_unref (out);
+  gst_buffer_unref (buffer);
+  g_object_unref (trans);
+  gst_object_unref (stream);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_qos_policy)
+{
+  GstPad *srcpad;
+  GstElement *pay;
+  GstRTSPStream *stream;
+  GstRTSPTransport *tr;
+  GstRTSPStreamTransport *trans;
+  GstStructure *policy, *copy;
+  gint dscp, priority;
+
+  srcpad = gst_pad_new ("testsrcpad", GST_PAD_SRC);
+  pay = gst_element_factory_make ("rtpgstpay", "testpayloader");
+  fail_unless (pay != NULL);
+  stream = gst_rtsp_stream_new (0, pay, srcpad);
+  gst_object_unref (pay);
+  gst_object_unref (srcpad);
+
+  fail_unless (gst_rtsp_transport_new (&tr) == GST_RTSP_OK);
+  trans = gst_rtsp_stream_transport_new (stream, tr);
+
+  /* nothing is marked without a policy */
+  fail_unless (gst_rtsp_stream_transport_get_qos_policy (trans) == NULL);
+  fail_if (gst_rtsp_stream_transport_get_qos_marking (trans,
+          GST_RTSP_PACKET_CLASS_KEY_FRAME, &dscp, &priority));
+  fail_unless (dscp == -1);
+  fail_unless (priority == -1);
+  fail_unless (gst_rtsp_stream_transport_get_qos_pacing (trans));
+
+  /* the policy can be the role of the permissions */
+  policy = gst_structure_new ("vip",
+      "media.factory.access", G_TYPE_BOOLEAN, TRUE,
+      "qos.key-frame-dscp", G_TYPE_INT, 46,
+      "qos.key-frame-priority", G_TYPE_INT, 6,
+      "qos.delta-frame-dscp", G_TYPE_INT, 34,
+      "qos.audio-dscp", G_TYPE_INT, 64,
+      "qos.rtcp-priority", G_TYPE_INT, 4,
+      "qos.pacing", G_TYPE_BOOLEAN, FALSE, NULL);
+  gst_rtsp_stream_transport_set_qos_policy (trans, policy);
+
+  copy = gst_rtsp_stream_transport_get_qos_policy (trans);
+  fail_unless (gst_structure_is_equal (copy, policy));
+  gst_structure_free (copy);
+  gst_structure_free (policy);
+
+  fail_unless (gst_rtsp_stream_transport_get_qos_marking (trans,
+          GST_RTSP_PACKET_CLASS_KEY_FRAME, &dscp, &priority));
+  fail_unless (dscp == 46);
+  fail_unless (priority == 6);
+  fail_unless (gst_rtsp_stream_transport_get_qos_marking (trans,
+          GST_RTSP_PACKET_CLASS_DELTA_FRAME, &dscp, &priority));
+  fail_unless (dscp == 34);
+  fail_unless (priority == -1);
+  /* an illegal DSCP is not used */
+  fail_if (gst_rtsp_stream_transport_get_qos_marking (trans,
+          GST_RTSP_PACKET_CLASS_AUDIO, &dscp, NULL));
+  fail_unless (dscp == -1);
+  fail_unless (gst_rtsp_stream_transport_get_qos_marking (trans,
+          GST_RTSP_PACKET_CLASS_RTCP, &dscp, &priority));
+  fail_unless (dscp == -1);
+  fail_unless (priority == 4);
+  fail_if (gst_rtsp_stream_transport_get_qos_pacing (trans));
+
+  /* and it can be removed again */
+  gst_rtsp_stream_transport_set_qos_policy (trans, NULL);
+  fail_if (gst_rtsp_stream_transport_get_qos_marking (trans,
+          GST_RTSP_PACKET_CLASS_KEY_FRAME, NULL, NULL));
+  fail_unless (gst_rtsp_stream_transport_get_qos_pacing (trans));
+
+  g_object_unref (trans);
+  gst_object_unref (stream);
+}
+
+GST_END_TEST;
+
+static gboolean key_unit_requested;
+
+static gboolean
+key_unit_event (GstPad * pad, GstObject * parent, GstEvent * event)
+{
+  const GstStructure *s = gst_event_get_structure (event);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CUSTOM_UPSTREAM && s &&
+      gst_structure_has_name (s, "GstForceKeyUnit"))
+    key_unit_requested = TRUE;
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+GST_START_TEST (test_request_key_unit)
+{
+  GstPad *srcpad, *paysrc, *paysink;
+  GstElement *pay;
+  GstRTSPStream *stream;
+
+  /* the pad of the encoder in front of the payloader */
+  srcpad = gst_pad_new ("testsrcpad", GST_PAD_SRC);
+  gst_pad_set_event_function (srcpad, key_unit_event);
+  gst_pad_set_active (srcpad, TRUE);
+
+  pay = gst_element_factory_make ("rtpgstpay", "testpayloader");
+  fail_unless (pay != NULL);
+  paysink = gst_element_get_static_pad (pay, "sink");
+  fail_unless (gst_pad_link (srcpad, paysink) == GST_PAD_LINK_OK);
+  gst_object_unref (paysink);
+  fail_unless (gst_element_set_state (pay, GST_STATE_PAUSED) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  paysrc = gst_element_get_static_pad (pay, "src");
+  stream = gst_rtsp_stream_new (0, pay, paysrc);
+  gst_object_unref (paysrc);
+
+  key_unit_requested = FALSE;
+  fail_unless (gst_rtsp_stream_request_key_unit (stream));
+  fail_unless (key_unit_requested);
+
+  fail_unless (gst_element_set_state (pay, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  gst_object_unref (stream);
+  gst_object_unref (pay);
+  gst_object_unref (srcpad);
+}
+
+GST_END_TEST;
+
+/* all RTP packets of the payloader, in order */
+static GPtrArray *pay_packets;
+
+static GstPadProbeReturn
+pay_packets_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  if (info->type & GST_PAD_PROBE_TYPE_BUFFER_LIST) {
+    GstBufferList *list = GST_PAD_PROBE_INFO_BUFFER_LIST (info);
+    guint i;
+
+    for (i = 0; i < gst_buffer_list_length (list); i++)
+      g_ptr_array_add (pay_packets,
+          gst_buffer_ref (gst_buffer_list_get (list, i)));
+  } else {
+    g_ptr_array_add (pay_packets,
+        gst_buffer_ref (GST_PAD_PROBE_INFO_BUFFER (info)));
+  }
+  return GST_PAD_PROBE_OK;
+}
+
+static gboolean
+collect_rtp (GstBuffer * buffer, guint8 channel, gpointer user_data)
+{
+  g_ptr_array_add (user_data, gst_buffer_ref (buffer));
+
+  return TRUE;
+}
+
+static gboolean
+collect_rtcp (GstBuffer * buffer, guint8 channel, gpointer user_data)
+{
+  return TRUE;
+}
+
+static void
+push_frame (GstPad * srcpad, gboolean key)
+{
+  GstBuffer *buffer;
+
+  buffer = gst_buffer_new_allocate (NULL, 100, NULL);
+  gst_buffer_memset (buffer, 0, key ? 0xff : 0x00, 100);
+  if (!key)
+    GST_BUFFER_FLAG_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+  fail_unless (gst_pad_push (srcpad, buffer) == GST_FLOW_OK);
+}
+
+GST_START_TEST (test_gop_cache)
+{
+  GstPad *srcpad, *paysrc, *paysink;
+  GstElement *pay;
+  GstRTSPStream *stream;
+  GstBin *bin;
+  GstElement *rtpbin;
+  GstRTSPTransport *tr, *mtr;
+  GstRTSPStreamTransport *trans, *mtrans;
+  GstRTSPUrl *url;
+  GstSegment segment;
+  GPtrArray *received;
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint key, i;
+  gchar *rtpinfo, *expected;
+
+  /* the pad of the encoder in front of the payloader */
+  srcpad = gst_pad_new ("testsrcpad", GST_PAD_SRC);
+  gst_pad_set_active (srcpad, TRUE);
+
+  pay = gst_element_factory_make ("rtpgstpay", "testpayloader");
+  fail_unless (pay != NULL);
+  paysink = gst_element_get_static_pad (pay, "sink");
+  fail_unless (gst_pad_link (srcpad, paysink) == GST_PAD_LINK_OK);
+  gst_object_unref (paysink);
+
+  paysrc = gst_element_get_static_pad (pay, "src");
+  stream = gst_rtsp_stream_new (0, pay, paysrc);
+  gst_rtsp_stream_set_gop_cache (stream, TRUE);
+  fail_unless (gst_rtsp_stream_has_gop_cache (stream));
+
+  rtpbin = gst_element_factory_make ("rtpbin", "testrtpbin");
+  fail_unless (rtpbin != NULL);
+  bin = GST_BIN (gst_bin_new ("testbin"));
+  fail_unless (gst_bin_add (bin, rtpbin));
+  fail_unless (gst_rtsp_stream_join_bin (stream, bin, rtpbin,
+          GST_STATE_PLAYING));
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  pay_packets = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gst_buffer_unref);
+  gst_pad_add_probe (paysrc,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      pay_packets_probe, NULL, NULL);
+  gst_object_unref (paysrc);
+
+  fail_unless (gst_element_set_state (pay, GST_STATE_PAUSED) !=
+      GST_STATE_CHANGE_FAILURE);
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_pad_push_event (srcpad,
+      gst_event_new_caps (gst_caps_from_string ("video/x-test")));
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  /* nothing is cached before the first key unit */
+  push_frame (srcpad, FALSE);
+  push_frame (srcpad, TRUE);
+  push_frame (srcpad, FALSE);
+  key = pay_packets->len;
+  push_frame (srcpad, TRUE);
+  push_frame (srcpad, FALSE);
+  push_frame (srcpad, FALSE);
+  fail_unless (pay_packets->len > key);
+
+  fail_unless (gst_rtp_buffer_map (g_ptr_array_index (pay_packets, key),
+          GST_MAP_READ, &rtp));
+  expected = g_strdup_printf ("seq=%u;", gst_rtp_buffer_get_seq (&rtp));
+  gst_rtp_buffer_unmap (&rtp);
+  fail_unless (gst_rtsp_url_parse ("rtsp://localhost:8554/test/stream=0",
+          &url) == GST_RTSP_OK);
+
+  /* RTP-Info points at the first cached packet for a transport that gets
+   * them */
+  fail_unless (gst_rtsp_transport_new (&tr) == GST_RTSP_OK);
+  tr->lower_transport = GST_RTSP_LOWER_TRANS_TCP;
+  trans = gst_rtsp_stream_transport_new (stream, tr);
+  gst_rtsp_stream_transport_set_url (trans, url);
+  rtpinfo = gst_rtsp_stream_transport_get_rtpinfo (trans,
+      GST_CLOCK_TIME_NONE);
+  fail_unless (rtpinfo != NULL);
+  fail_unless (strstr (rtpinfo, expected) != NULL);
+  g_free (rtpinfo);
+
+  /* multicast members don't get the cached packets, they continue with the
+   * live packets */
+  fail_unless (gst_rtsp_transport_new (&mtr) == GST_RTSP_OK);
+  mtr->lower_transport = GST_RTSP_LOWER_TRANS_UDP_MCAST;
+  mtrans = gst_rtsp_stream_transport_new (stream, mtr);
+  gst_rtsp_stream_transport_set_url (mtrans, url);
+  rtpinfo = gst_rtsp_stream_transport_get_rtpinfo (mtrans,
+      GST_CLOCK_TIME_NONE);
+  fail_unless (rtpinfo != NULL);
+  fail_if (strstr (rtpinfo, expected) != NULL);
+  g_free (rtpinfo);
+  g_object_unref (mtrans);
+  g_free (expected);
+  gst_rtsp_url_free (url);
+
+  /* a late joiner gets the packets from the last key unit on */
+  received = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gst_buffer_unref);
+  gst_rtsp_stream_transport_set_callbacks (trans, collect_rtp, collect_rtcp,
+      received, NULL);
+  fail_unless (gst_rtsp_stream_add_transport (stream, trans));
+  fail_unless (gst_rtsp_stream_remove_transport (stream, trans));
+
+  /* live packets that were still queued for the appsink can follow */
+  fail_unless (received->len >= pay_packets->len - key);
+  for (i = 0; i < pay_packets->len - key; i++)
+    fail_unless (g_ptr_array_index (received, i) ==
+        g_ptr_array_index (pay_packets, key + i));
+
+  fail_unless (gst_rtsp_stream_leave_bin (stream, bin, rtpbin));
+  fail_unless (gst_element_set_state (pay, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  g_ptr_array_unref (received);
+  g_ptr_array_unref (pay_packets);
+  g_object_unref (trans);
+  gst_object_unref (bin);
+  gst_object_unref (stream);
+  gst_object_unref (pay);
+  gst_object_unref (srcpad);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_rtp_rewrite_udp)
+{
+  GstPad *srcpad, *paysrc, *paysink;
+  GstElement *pay;
+  GstRTSPStream *stream;
+  GstBin *bin;
+  GstElement *rtpbin;
+  GstRTSPTransport *tr;
+  GstRTSPStreamTransport *trans;
+  GstSegment segment;
+  GSocket *socket;
+  GInetAddress *inet;
+  GSocketAddress *addr;
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint8 data[1500];
+  gssize size;
+  guint i;
+
+  srcpad = gst_pad_new ("testsrcpad", GST_PAD_SRC);
+  gst_pad_set_active (srcpad, TRUE);
+
+  pay = gst_element_factory_make ("rtpgstpay", "testpayloader");
+  fail_unless (pay != NULL);
+  paysink = gst_element_get_static_pad (pay, "sink");
+  fail_unless (gst_pad_link (srcpad, paysink) == GST_PAD_LINK_OK);
+  gst_object_unref (paysink);
+
+  paysrc = gst_element_get_static_pad (pay, "src");
+  stream = gst_rtsp_stream_new (0, pay, paysrc);
+
+  rtpbin = gst_element_factory_make ("rtpbin", "testrtpbin");
+  fail_unless (rtpbin != NULL);
+  bin = GST_BIN (gst_bin_new ("testbin"));
+  fail_unless (gst_bin_add (bin, rtpbin));
+  fail_unless (gst_rtsp_stream_join_bin (stream, bin, rtpbin,
+          GST_STATE_PLAYING));
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  pay_packets = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gst_buffer_unref);
+  gst_pad_add_probe (paysrc,
+      GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST,
+      pay_packets_probe, NULL, NULL);
+  gst_object_unref (paysrc);
+
+  /* the receiver of the transport */
+  socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  fail_unless (socket != NULL);
+  inet = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  addr = g_inet_socket_address_new (inet, 0);
+  g_object_unref (inet);
+  fail_unless (g_socket_bind (socket, addr, FALSE, NULL));
+  g_object_unref (addr);
+  addr = g_socket_get_local_address (socket, NULL);
+  fail_unless (addr != NULL);
+  g_socket_set_timeout (socket, 5);
+
+  /* the rewritten packets are sent from the appsink, not the udpsink */
+  fail_unless (gst_rtsp_transport_new (&tr) == GST_RTSP_OK);
+  tr->lower_transport = GST_RTSP_LOWER_TRANS_UDP;
+  tr->destination = g_strdup ("127.0.0.1");
+  tr->client_port.min =
+      g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (addr));
+  tr->client_port.max = tr->client_port.min + 1;
+  g_object_unref (addr);
+  trans = gst_rtsp_stream_transport_new (stream, tr);
+  gst_rtsp_stream_transport_set_rtp_rewrite (trans, TRUE, 0x55667788, 0x100,
+      0x1000);
+  fail_unless (gst_rtsp_stream_add_transport (stream, trans));
+
+  fail_unless (gst_element_set_state (pay, GST_STATE_PAUSED) !=
+      GST_STATE_CHANGE_FAILURE);
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_pad_push_event (srcpad,
+      gst_event_new_caps (gst_caps_from_string ("video/x-test")));
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  push_frame (srcpad, TRUE);
+  push_frame (srcpad, FALSE);
+  fail_unless (pay_packets->len > 0);
+
+  for (i = 0; i < pay_packets->len; i++) {
+    GstBuffer *buffer = g_ptr_array_index (pay_packets, i);
+
+    size = g_socket_receive (socket, (gchar *) data, sizeof (data), NULL,
+        NULL);
+    fail_unless (size == gst_buffer_get_size (buffer));
+
+    fail_unless (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp));
+    fail_unless_equals_int (GST_READ_UINT16_BE (data + 2),
+        (guint16) (gst_rtp_buffer_get_seq (&rtp) + 0x100));
+    fail_unless (GST_READ_UINT32_BE (data + 4) ==
+        gst_rtp_buffer_get_timestamp (&rtp) + 0x1000);
+    fail_unless (GST_READ_UINT32_BE (data + 8) == 0x55667788);
+    gst_rtp_buffer_unmap (&rtp);
+    fail_unless (gst_buffer_memcmp (buffer, 12, data + 12, size - 12) == 0);
+  }
+
+  /* the udpsink does not send the original packets as well */
+  fail_if (g_socket_condition_timed_wait (socket, G_IO_IN,
+          G_USEC_PER_SEC / 5, NULL, NULL));
+
+  fail_unless (gst_rtsp_stream_remove_transport (stream, trans));
+  fail_unless (gst_rtsp_stream_leave_bin (stream, bin, rtpbin));
+  fail_unless (gst_element_set_state (pay, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  g_object_unref (socket);
+  g_ptr_array_unref (pay_packets);
+  g_object_unref (trans);
+  gst_object_unref (bin);
+  gst_object_unref (stream);
+  gst_object_unref (pay);
+  gst_object_unref (srcpad);
+}
+
+GST_END_TEST;
+
+#ifdef IP_RECVTOS
+/* the TOS byte of the next packet on @socket, -1 when it has none */
+static gint
+receive_tos (GSocket * socket)
+{
+  guint8 data[1500];
+  union
+  {
+    struct cmsghdr hdr;
+    guint8 buf[CMSG_SPACE (sizeof (gint))];
+  } control;
+  struct iovec iov = { data, sizeof (data) };
+  struct msghdr msg = { 0, };
+  struct cmsghdr *cmsg;
+  gint tos = -1;
+
+  fail_unless (g_socket_condition_timed_wait (socket, G_IO_IN,
+          5 * G_USEC_PER_SEC, NULL, NULL));
+
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = &control;
+  msg.msg_controllen = sizeof (control);
+  fail_unless (recvmsg (g_socket_get_fd (socket), &msg, 0) > 12);
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+    if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_TOS)
+      tos = *(guint8 *) CMSG_DATA (cmsg);
+  }
+  return tos;
+}
+
+/* check the TOS byte of the packets of a frame */
+static void
+check_tos (GSocket * socket, gint tos)
+{
+  fail_unless_equals_int (receive_tos (socket), tos);
+  while (g_socket_condition_timed_wait (socket, G_IO_IN,
+          G_USEC_PER_SEC / 10, NULL, NULL))
+    fail_unless_equals_int (receive_tos (socket), tos);
+}
+
+GST_START_TEST (test_qos_marking)
+{
+  GstPad *srcpad, *paysrc, *paysink;
+  GstElement *pay;
+  GstRTSPStream *stream;
+  GstBin *bin;
+  GstElement *rtpbin;
+  GstRTSPTransport *tr;
+  GstRTSPStreamTransport *trans;
+  GstStructure *policy;
+  GstSegment segment;
+  GSocket *socket;
+  GInetAddress *inet;
+  GSocketAddress *addr;
+  gint on = 1;
+
+  srcpad = gst_pad_new ("testsrcpad", GST_PAD_SRC);
+  gst_pad_set_active (srcpad, TRUE);
+
+  pay = gst_element_factory_make ("rtpgstpay", "testpayloader");
+  fail_unless (pay != NULL);
+  paysink = gst_element_get_static_pad (pay, "sink");
+  fail_unless (gst_pad_link (srcpad, paysink) == GST_PAD_LINK_OK);
+  gst_object_unref (paysink);
+
+  paysrc = gst_element_get_static_pad (pay, "src");
+  stream = gst_rtsp_stream_new (0, pay, paysrc);
+  gst_object_unref (paysrc);
+
+  rtpbin = gst_element_factory_make ("rtpbin", "testrtpbin");
+  fail_unless (rtpbin != NULL);
+  bin = GST_BIN (gst_bin_new ("testbin"));
+  fail_unless (gst_bin_add (bin, rtpbin));
+  fail_unless (gst_rtsp_stream_join_bin (stream, bin, rtpbin,
+          GST_STATE_PLAYING));
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  /* the receiver gets the TOS byte of each packet */
+  socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  fail_unless (socket != NULL);
+  fail_unless (setsockopt (g_socket_get_fd (socket), IPPROTO_IP, IP_RECVTOS,
+          &on, sizeof (on)) == 0);
+  inet = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  addr = g_inet_socket_address_new (inet, 0);
+  g_object_unref (inet);
+  fail_unless (g_socket_bind (socket, addr, FALSE, NULL));
+  g_object_unref (addr);
+  addr = g_socket_get_local_address (socket, NULL);
+  fail_unless (addr != NULL);
+
+  fail_unless (gst_rtsp_transport_new (&tr) == GST_RTSP_OK);
+  tr->lower_transport = GST_RTSP_LOWER_TRANS_UDP;
+  tr->destination = g_strdup ("127.0.0.1");
+  tr->client_port.min =
+      g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (addr));
+  tr->client_port.max = tr->client_port.min + 1;
+  g_object_unref (addr);
+  trans = gst_rtsp_stream_transport_new (stream, tr);
+
+  /* kernels without SO_PRIORITY control messages refuse the first send of a
+   * key frame packet with EINVAL, it is then sent with the DSCP alone */
+  policy = gst_structure_new ("vip",
+      "qos.key-frame-dscp", G_TYPE_INT, 46,
+      "qos.key-frame-priority", G_TYPE_INT, 6,
+      "qos.delta-frame-dscp", G_TYPE_INT, 10, NULL);
+  gst_rtsp_stream_transport_set_qos_policy (trans, policy);
+  gst_structure_free (policy);
+  fail_unless (gst_rtsp_stream_add_transport (stream, trans));
+
+  fail_unless (gst_element_set_state (pay, GST_STATE_PAUSED) !=
+      GST_STATE_CHANGE_FAILURE);
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_pad_push_event (srcpad,
+      gst_event_new_caps (gst_caps_from_string ("video/x-test")));
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  /* the RTP packets get the flags of their frame and the DSCP of it in the
+   * upper 6 bits of the TOS byte */
+  push_frame (srcpad, TRUE);
+  check_tos (socket, 46 << 2);
+  push_frame (srcpad, FALSE);
+  check_tos (socket, 10 << 2);
+  push_frame (srcpad, TRUE);
+  check_tos (socket, 46 << 2);
+
+  fail_unless (gst_rtsp_stream_remove_transport (stream, trans));
+  fail_unless (gst_rtsp_stream_leave_bin (stream, bin, rtpbin));
+  fail_unless (gst_element_set_state (pay, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  g_object_unref (socket);
+  g_object_unref (trans);
+  gst_object_unref (bin);
+  gst_object_unref (stream);
+  gst_object_unref (pay);
+  gst_object_unref (srcpad);
+}
+
+GST_END_TEST;
+#endif
+
+static void
+push_rtp (GstPad * pad, guint8 pt, guint16 seq, guint32 rtptime,
+    gboolean marker)
+{
+  GstBuffer *buffer;
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  buffer = gst_rtp_buffer_new_allocate (100, 0, 0);
+  fail_unless (gst_rtp_buffer_map (buffer, GST_MAP_WRITE, &rtp));
+  gst_rtp_buffer_set_payload_type (&rtp, pt);
+  gst_rtp_buffer_set_seq (&rtp, seq);
+  gst_rtp_buffer_set_timestamp (&rtp, rtptime);
+  gst_rtp_buffer_set_ssrc (&rtp, pt == 96 ? 0x11111111 : 0x22222222);
+  gst_rtp_buffer_set_marker (&rtp, marker);
+  gst_rtp_buffer_unmap (&rtp);
+  fail_unless (gst_pad_push (pad, buffer) == GST_FLOW_OK);
+}
+
+GST_START_TEST (test_pacing)
+{
+  GstPad *paysrc;
+  GstElement *pay;
+  GstRTSPStream *stream;
+  GstBin *bin;
+  GstElement *rtpbin;
+  GstRTSPTransport *tr;
+  GstRTSPStreamTransport *trans;
+  GstSegment segment;
+  GSocket *socket;
+  GInetAddress *inet;
+  GSocketAddress *addr;
+  guint8 data[1500];
+  gint64 frame0[8], frame1[8], rtx = 0;
+  gint i, n0 = 0, n1 = 0, rtx_pos = -1;
+
+  pay = gst_element_factory_make ("rtpgstpay", "testpayloader");
+  fail_unless (pay != NULL);
+  paysrc = gst_element_get_static_pad (pay, "src");
+  stream = gst_rtsp_stream_new (0, pay, paysrc);
+  gst_rtsp_stream_set_pacing (stream, TRUE);
+
+  rtpbin = gst_element_factory_make ("rtpbin", "testrtpbin");
+  fail_unless (rtpbin != NULL);
+  bin = GST_BIN (gst_bin_new ("testbin"));
+  fail_unless (gst_bin_add (bin, rtpbin));
+  fail_unless (gst_rtsp_stream_join_bin (stream, bin, rtpbin,
+          GST_STATE_PLAYING));
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  /* the packets are pushed from the payloader pad, only video is paced */
+  fail_unless (gst_element_set_state (pay, GST_STATE_PAUSED) !=
+      GST_STATE_CHANGE_FAILURE);
+  gst_pad_push_event (paysrc, gst_event_new_stream_start ("test"));
+  gst_pad_push_event (paysrc, gst_event_new_caps (gst_caps_from_string
+          ("application/x-rtp, media=video, clock-rate=90000, payload=96, "
+              "encoding-name=RAW")));
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (paysrc, gst_event_new_segment (&segment));
+
+  socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  fail_unless (socket != NULL);
+  inet = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  addr = g_inet_socket_address_new (inet, 0);
+  g_object_unref (inet);
+  fail_unless (g_socket_bind (socket, addr, FALSE, NULL));
+  g_object_unref (addr);
+  addr = g_socket_get_local_address (socket, NULL);
+  fail_unless (addr != NULL);
+  g_socket_set_timeout (socket, 5);
+
+  fail_unless (gst_rtsp_transport_new (&tr) == GST_RTSP_OK);
+  tr->lower_transport = GST_RTSP_LOWER_TRANS_UDP;
+  tr->destination = g_strdup ("127.0.0.1");
+  tr->client_port.min =
+      g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (addr));
+  tr->client_port.max = tr->client_port.min + 1;
+  g_object_unref (addr);
+  trans = gst_rtsp_stream_transport_new (stream, tr);
+  fail_unless (gst_rtsp_stream_add_transport (stream, trans));
+
+  /* two frames of 8 packets in one burst, with a retransmission of the
+   * first frame in the middle of it */
+  for (i = 0; i < 8; i++) {
+    push_rtp (paysrc, 96, i, 0, i == 7);
+    if (i == 3)
+      push_rtp (paysrc, 97, 0, 123456, FALSE);
+  }
+  for (i = 0; i < 8; i++)
+    push_rtp (paysrc, 96, 8 + i, 3600, i == 7);
+
+  for (i = 0; i < 17; i++) {
+    fail_unless (g_socket_receive (socket, (gchar *) data, sizeof (data),
+            NULL, NULL) > 12);
+    if ((data[1] & 0x7f) == 97) {
+      rtx = g_get_monotonic_time ();
+      rtx_pos = i;
+    } else if (GST_READ_UINT16_BE (data + 2) < 8) {
+      frame0[n0++] = g_get_monotonic_time ();
+    } else {
+      frame1[n1++] = g_get_monotonic_time ();
+    }
+  }
+  fail_unless (n0 == 8 && n1 == 8);
+
+  /* the retransmission is sent right away and does not split the frame */
+  fail_unless (rtx_pos >= 0 && rtx_pos < 7);
+  fail_unless (rtx < frame0[7]);
+
+  /* the frames are spread over the 40ms frame interval, one after the
+   * other */
+  for (i = 1; i < 8; i++) {
+    fail_unless (frame0[i] >= frame0[i - 1]);
+    fail_unless (frame1[i] >= frame1[i - 1]);
+  }
+  fail_unless (frame0[7] - frame0[0] >= 20 * G_TIME_SPAN_MILLISECOND);
+  fail_unless (frame1[0] - frame0[0] >= 30 * G_TIME_SPAN_MILLISECOND);
+  fail_unless (frame1[7] - frame1[0] >= 20 * G_TIME_SPAN_MILLISECOND);
+
+  fail_unless (gst_rtsp_stream_remove_transport (stream, trans));
+  fail_unless (gst_rtsp_stream_leave_bin (stream, bin, rtpbin));
+  fail_unless (gst_element_set_state (pay, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  g_object_unref (socket);
+  g_object_unref (trans);
+  gst_object_unref (bin);
+  gst_object_unref (stream);
+  gst_object_unref (paysrc);
+  gst_object_unref (pay);
+}
+
+GST_END_TEST;
+
+/* a payloader fed from @srcpad, in PAUSED and ready for data */
+static GstElement *
+payloader_new (GstPad ** srcpad, guint32 ssrc, guint seqnum_offset)
+{
+  GstElement *pay;
+  GstPad *paysink;
+  GstSegment segment;
+
+  *srcpad = gst_pad_new (NULL, GST_PAD_SRC);
+  gst_pad_set_active (*srcpad, TRUE);
+
+  pay = gst_element_factory_make ("rtpgstpay", NULL);
+  fail_unless (pay != NULL);
+  g_object_set (pay, "ssrc", ssrc, "seqnum-offset", seqnum_offset, NULL);
+  paysink = gst_element_get_static_pad (pay, "sink");
+  fail_unless (gst_pad_link (*srcpad, paysink) == GST_PAD_LINK_OK);
+  gst_object_unref (paysink);
+
+  fail_unless (gst_element_set_state (pay, GST_STATE_PAUSED) !=
+      GST_STATE_CHANGE_FAILURE);
+  gst_pad_push_event (*srcpad, gst_event_new_stream_start ("test"));
+  gst_pad_push_event (*srcpad,
+      gst_event_new_caps (gst_caps_from_string ("video/x-test")));
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  gst_pad_push_event (*srcpad, gst_event_new_segment (&segment));
+
+  return pay;
+}
+
+/* check that the packets in @received are one RTP stream */
+static void
+check_layer_packets (GPtrArray * received)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  guint i;
+
+  for (i = 0; i < received->len; i++) {
+    fail_unless (gst_rtp_buffer_map (g_ptr_array_index (received, i),
+            GST_MAP_READ, &rtp));
+    fail_unless_equals_int (gst_rtp_buffer_get_ssrc (&rtp), 0x11111111);
+    fail_unless_equals_int (gst_rtp_buffer_get_seq (&rtp), 100 + i);
+    gst_rtp_buffer_unmap (&rtp);
+  }
+}
+
+GST_START_TEST (test_layer_switch)
+{
+  GstPad *srcpad0, *srcpad1, *paysrc;
+  GstElement *pay0, *pay1;
+  GstRTSPStream *stream;
+  GstBin *bin;
+  GstElement *rtpbin;
+  GstRTSPTransport *tr;
+  GstRTSPStreamTransport *trans;
+  GPtrArray *received;
+  guint before;
+
+  pay0 = payloader_new (&srcpad0, 0x11111111, 100);
+  pay1 = payloader_new (&srcpad1, 0x22222222, 5000);
+
+  paysrc = gst_element_get_static_pad (pay0, "src");
+  stream = gst_rtsp_stream_new (0, pay0, paysrc);
+  gst_object_unref (paysrc);
+  paysrc = gst_element_get_static_pad (pay1, "src");
+  fail_unless (gst_rtsp_stream_add_layer (stream, pay1, paysrc) == 1);
+  gst_object_unref (paysrc);
+  fail_unless (gst_rtsp_stream_get_n_layers (stream) == 2);
+
+  rtpbin = gst_element_factory_make ("rtpbin", "testrtpbin");
+  fail_unless (rtpbin != NULL);
+  bin = GST_BIN (gst_bin_new ("testbin"));
+  fail_unless (gst_bin_add (bin, rtpbin));
+  fail_unless (gst_rtsp_stream_join_bin (stream, bin, rtpbin,
+          GST_STATE_PLAYING));
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  fail_unless (gst_rtsp_transport_new (&tr) == GST_RTSP_OK);
+  tr->lower_transport = GST_RTSP_LOWER_TRANS_TCP;
+  trans = gst_rtsp_stream_transport_new (stream, tr);
+  received = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gst_buffer_unref);
+  gst_rtsp_stream_transport_set_callbacks (trans, collect_rtp, collect_rtcp,
+      received, NULL);
+  fail_unless (gst_rtsp_stream_add_transport (stream, trans));
+
+  /* the client starts on the first layer */
+  push_frame (srcpad0, TRUE);
+  push_frame (srcpad0, FALSE);
+  push_frame (srcpad1, TRUE);
+  fail_unless (received->len > 0);
+  check_layer_packets (received);
+  fail_unless_equals_int (gst_rtsp_stream_get_transport_layer (stream,
+          trans), 0);
+
+  /* and switches on the next key unit of the second layer */
+  fail_if (gst_rtsp_stream_set_transport_layer (stream, trans, 2));
+  fail_unless (gst_rtsp_stream_set_transport_layer (stream, trans, 1));
+  push_frame (srcpad1, FALSE);
+  push_frame (srcpad0, FALSE);
+  fail_unless_equals_int (gst_rtsp_stream_get_transport_layer (stream,
+          trans), 0);
+  before = received->len;
+  check_layer_packets (received);
+
+  push_frame (srcpad1, TRUE);
+  fail_unless_equals_int (gst_rtsp_stream_get_transport_layer (stream,
+          trans), 1);
+  push_frame (srcpad0, FALSE);
+  push_frame (srcpad1, FALSE);
+
+  /* with the SSRC and the sequence numbers of the first layer */
+  fail_unless (received->len > before);
+  check_layer_packets (received);
+
+  fail_unless (gst_rtsp_stream_remove_transport (stream, trans));
+  fail_unless (gst_rtsp_stream_leave_bin (stream, bin, rtpbin));
+  fail_unless (gst_element_set_state (pay0, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  fail_unless (gst_element_set_state (pay1, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  g_ptr_array_unref (received);
+  g_object_unref (trans);
+  gst_object_unref (bin);
+  gst_object_unref (stream);
+  gst_object_unref (pay0);
+  gst_object_unref (pay1);
+  gst_object_unref (srcpad0);
+  gst_object_unref (srcpad1);
+}
+
+GST_END_TEST;
+
+/* a passthrough element with the bitrate property of an encoder */
+typedef struct
+{
+  GstBaseTransform parent;
+  guint bitrate;
+} TestEncoder;
+
+typedef GstBaseTransformClass TestEncoderClass;
+
+static GType test_encoder_get_type (void);
+
+G_DEFINE_TYPE (TestEncoder, test_encoder, GST_TYPE_BASE_TRANSFORM);
+
+static GstStaticPadTemplate test_encoder_sink_template =
+GST_STATIC_PAD_TEMPLATE ("sink", GST_PAD_SINK, GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+static GstStaticPadTemplate test_encoder_src_template =
+GST_STATIC_PAD_TEMPLATE ("src", GST_PAD_SRC, GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+static void
+test_encoder_set_property (GObject * object, guint propid,
+    const GValue * value, GParamSpec * pspec)
+{
+  ((TestEncoder *) object)->bitrate = g_value_get_uint (value);
+}
+
+static void
+test_encoder_get_property (GObject * object, guint propid, GValue * value,
+    GParamSpec * pspec)
+{
+  g_value_set_uint (value, ((TestEncoder *) object)->bitrate);
+}
+
+static void
+test_encoder_class_init (TestEncoderClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->set_property = test_encoder_set_property;
+  gobject_class->get_property = test_encoder_get_property;
+
+  g_object_class_install_property (gobject_class, 1,
+      g_param_spec_uint ("bitrate", "Bitrate", "Bitrate", 0, G_MAXUINT, 0,
+          G_PARAM_READWRITE));
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&test_encoder_sink_template));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&test_encoder_src_template));
+}
+
+static void
+test_encoder_init (TestEncoder * encoder)
+{
+  gst_base_transform_set_passthrough (GST_BASE_TRANSFORM (encoder), TRUE);
+}
+
+/* the bitrates set by the rate control, in order */
+static GAsyncQueue *bitrates;
+
+static void
+bitrate_notify (GObject * encoder, GParamSpec * pspec, gpointer user_data)
+{
+  guint bitrate;
+
+  g_object_get (encoder, "bitrate", &bitrate, NULL);
+  g_async_queue_push (bitrates, GUINT_TO_POINTER (bitrate));
+}
+
+static guint
+pop_bitrate (void)
+{
+  gpointer bitrate;
+
+  bitrate = g_async_queue_timeout_pop (bitrates, 5 * G_USEC_PER_SEC);
+  fail_unless (bitrate != NULL);
+
+  return GPOINTER_TO_UINT (bitrate);
+}
+
+/* send a receiver report of the client at 127.0.0.1:5001 about @ssrc */
+static void
+send_report (GstRTSPStream * stream, guint32 ssrc, guint8 fractionlost,
+    guint32 jitter)
+{
+  GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  GstRTCPPacket packet;
+  GstBuffer *buffer;
+  GInetAddress *inet;
+  GSocketAddress *addr;
+
+  buffer = gst_rtcp_buffer_new (1000);
+  fail_unless (gst_rtcp_buffer_map (buffer, GST_MAP_READWRITE, &rtcp));
+  fail_unless (gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_RR,
+          &packet));
+  gst_rtcp_packet_rr_set_ssrc (&packet, 0xabcdef01);
+  fail_unless (gst_rtcp_packet_add_rb (&packet, ssrc, fractionlost, 0, 0,
+          jitter, 0, 0));
+  gst_rtcp_buffer_unmap (&rtcp);
+
+  inet = g_inet_address_new_from_string ("127.0.0.1");
+  addr = g_inet_socket_address_new (inet, 5001);
+  gst_buffer_add_net_address_meta (buffer, addr);
+  g_object_unref (addr);
+  g_object_unref (inet);
+
+  fail_unless (gst_rtsp_stream_recv_rtcp (stream, buffer) == GST_FLOW_OK);
+}
+
+GST_START_TEST (test_adaptive_bitrate)
+{
+  GstPad *srcpad, *pad, *paysrc, *paysink;
+  GstElement *encoder, *pay;
+  GstRTSPStream *stream;
+  GstBin *bin;
+  GstElement *rtpbin;
+  GObject *session;
+  GstRTSPTransport *tr;
+  GstRTSPStreamTransport *trans;
+  guint ssrc, bitrate;
+
+  encoder = g_object_new (test_encoder_get_type (), "bitrate", 1000, NULL);
+  gst_object_ref_sink (encoder);
+  pay = gst_element_factory_make ("rtpgstpay", "testpayloader");
+  fail_unless (pay != NULL);
+  pad = gst_element_get_static_pad (encoder, "src");
+  paysink = gst_element_get_static_pad (pay, "sink");
+  fail_unless (gst_pad_link (pad, paysink) == GST_PAD_LINK_OK);
+  gst_object_unref (paysink);
+  gst_object_unref (pad);
+
+  /* the encoder is found upstream of the payloader */
+  srcpad = gst_pad_new ("testsrcpad", GST_PAD_SRC);
+  pad = gst_element_get_static_pad (encoder, "sink");
+  fail_unless (gst_pad_link (srcpad, pad) == GST_PAD_LINK_OK);
+  gst_object_unref (pad);
+
+  paysrc = gst_element_get_static_pad (pay, "src");
+  stream = gst_rtsp_stream_new (0, pay, paysrc);
+  gst_object_unref (paysrc);
+  gst_rtsp_stream_set_adaptive_bitrate (stream, TRUE);
+  fail_unless (gst_rtsp_stream_is_adaptive_bitrate (stream));
+
+  rtpbin = gst_element_factory_make ("rtpbin", "testrtpbin");
+  fail_unless (rtpbin != NULL);
+  bin = GST_BIN (gst_bin_new ("testbin"));
+  fail_unless (gst_bin_add (bin, rtpbin));
+  fail_unless (gst_rtsp_stream_join_bin (stream, bin, rtpbin,
+          GST_STATE_PLAYING));
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  session = gst_rtsp_stream_get_rtpsession (stream);
+  g_object_get (session, "internal-ssrc", &ssrc, NULL);
+  g_object_unref (session);
+
+  /* the reports of this client are matched on its RTCP port */
+  fail_unless (gst_rtsp_transport_new (&tr) == GST_RTSP_OK);
+  tr->lower_transport = GST_RTSP_LOWER_TRANS_UDP;
+  tr->destination = g_strdup ("127.0.0.1");
+  tr->client_port.min = 5000;
+  tr->client_port.max = 5001;
+  trans = gst_rtsp_stream_transport_new (stream, tr);
+  fail_unless (gst_rtsp_stream_add_transport (stream, trans));
+
+  bitrates = g_async_queue_new ();
+  g_signal_connect (encoder, "notify::bitrate", (GCallback) bitrate_notify,
+      NULL);
+
+  /* half of the packets lost, the bitrate goes down by a quarter */
+  send_report (stream, ssrc, 128, 3000);
+  fail_unless_equals_int (pop_bitrate (), 750);
+  send_report (stream, ssrc, 128, 3000);
+  fail_unless_equals_int (pop_bitrate (), 563);
+  /* some loss keeps the bitrate, jitter alone doesn't lower it and a clean
+   * report raises it by 5% */
+  send_report (stream, ssrc, 10, 3000);
+  send_report (stream, ssrc, 0, 10000);
+  fail_unless_equals_int (pop_bitrate (), 592);
+
+  /* never below a tenth of the configured bitrate */
+  send_report (stream, ssrc, 255, 3000);
+  fail_unless_equals_int (pop_bitrate (), 298);
+  send_report (stream, ssrc, 255, 3000);
+  fail_unless_equals_int (pop_bitrate (), 150);
+  send_report (stream, ssrc, 255, 3000);
+  fail_unless_equals_int (pop_bitrate (), 100);
+  send_report (stream, ssrc, 255, 3000);
+  send_report (stream, ssrc, 0, 3000);
+  fail_unless_equals_int (pop_bitrate (), 106);
+
+  /* disabling gives the encoder its configured bitrate back */
+  gst_rtsp_stream_set_adaptive_bitrate (stream, FALSE);
+  fail_unless_equals_int (pop_bitrate (), 1000);
+
+  /* and so does leaving the bin */
+  gst_rtsp_stream_set_adaptive_bitrate (stream, TRUE);
+  send_report (stream, ssrc, 128, 3000);
+  fail_unless_equals_int (pop_bitrate (), 750);
+
+  fail_unless (gst_rtsp_stream_remove_transport (stream, trans));
+  fail_unless (gst_rtsp_stream_leave_bin (stream, bin, rtpbin));
+  fail_unless_equals_int (pop_bitrate (), 1000);
+  fail_unless (g_async_queue_try_pop (bitrates) == NULL);
+  g_object_get (encoder, "bitrate", &bitrate, NULL);
+  fail_unless_equals_int (bitrate, 1000);
+
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  g_async_queue_unref (bitrates);
+  g_object_unref (trans);
+  gst_object_unref (bin);
+  gst_object_unref (stream);
+  gst_object_unref (pay);
+  gst_object_unref (encoder);
+  gst_object_unref (srcpad);
+}
+
+GST_END_TEST;
+
+/* the retransmitted packets that reach the client */
+static GMutex rtx_lock;
+static GCond rtx_cond;
+static GPtrArray *rtx_packets;
+
+static gboolean
+collect_rtx (GstBuffer * buffer, guint8 channel, gpointer user_data)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  if (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp)) {
+    if (gst_rtp_buffer_get_payload_type (&rtp) ==
+        GPOINTER_TO_UINT (user_data)) {
+      g_mutex_lock (&rtx_lock);
+      g_ptr_array_add (rtx_packets, gst_buffer_ref (buffer));
+      g_cond_signal (&rtx_cond);
+      g_mutex_unlock (&rtx_lock);
+    }
+    gst_rtp_buffer_unmap (&rtp);
+  }
+  return TRUE;
+}
+
+/* send a NACK of the client for packet @seq of @ssrc */
+static void
+send_nack (GstRTSPStream * stream, guint32 ssrc, guint16 seq)
+{
+  GstRTCPBuffer rtcp = GST_RTCP_BUFFER_INIT;
+  GstRTCPPacket packet;
+  GstBuffer *buffer;
+  guint8 *fci;
+
+  buffer = gst_rtcp_buffer_new (1000);
+  fail_unless (gst_rtcp_buffer_map (buffer, GST_MAP_READWRITE, &rtcp));
+  fail_unless (gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_RR,
+          &packet));
+  gst_rtcp_packet_rr_set_ssrc (&packet, 0xabcdef01);
+  fail_unless (gst_rtcp_buffer_add_packet (&rtcp, GST_RTCP_TYPE_RTPFB,
+          &packet));
+  gst_rtcp_packet_fb_set_type (&packet, GST_RTCP_RTPFB_TYPE_NACK);
+  gst_rtcp_packet_fb_set_sender_ssrc (&packet, 0xabcdef01);
+  gst_rtcp_packet_fb_set_media_ssrc (&packet, ssrc);
+  fail_unless (gst_rtcp_packet_fb_set_fci_length (&packet, 1));
+  /* the packet id and an empty bitmask of following lost packets */
+  fci = gst_rtcp_packet_fb_get_fci (&packet);
+  GST_WRITE_UINT16_BE (fci, seq);
+  GST_WRITE_UINT16_BE (fci + 2, 0);
+  gst_rtcp_buffer_unmap (&rtcp);
+
+  fail_unless (gst_rtsp_stream_recv_rtcp (stream, buffer) == GST_FLOW_OK);
+}
+
+GST_START_TEST (test_retransmission)
+{
+  GstElementFactory *factory;
+  GstPad *srcpad, *paysrc;
+  GstElement *pay;
+  GstRTSPStream *stream;
+  GstBin *bin;
+  GstElement *rtpbin;
+  GstRTSPTransport *tr;
+  GstRTSPStreamTransport *trans;
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+  GstStructure *stats;
+  guint8 *payload;
+  guint requests, packets;
+  gint64 end_time;
+
+  /* the stream doesn't retransmit without the plugin */
+  factory = gst_element_factory_find ("rtprtxsend");
+  if (factory == NULL)
+    return;
+  gst_object_unref (factory);
+
+  pay = payloader_new (&srcpad, 0x11111111, 100);
+  paysrc = gst_element_get_static_pad (pay, "src");
+  stream = gst_rtsp_stream_new (0, pay, paysrc);
+  gst_object_unref (paysrc);
+  gst_rtsp_stream_set_retransmission_time (stream, GST_SECOND);
+  gst_rtsp_stream_set_retransmission_pt (stream, 97);
+
+  rtpbin = gst_element_factory_make ("rtpbin", "testrtpbin");
+  fail_unless (rtpbin != NULL);
+  bin = GST_BIN (gst_bin_new ("testbin"));
+  fail_unless (gst_bin_add (bin, rtpbin));
+  fail_unless (gst_rtsp_stream_join_bin (stream, bin, rtpbin,
+          GST_STATE_PLAYING));
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  fail_unless (gst_rtsp_transport_new (&tr) == GST_RTSP_OK);
+  tr->lower_transport = GST_RTSP_LOWER_TRANS_TCP;
+  trans = gst_rtsp_stream_transport_new (stream, tr);
+  rtx_packets = g_ptr_array_new_with_free_func (
+      (GDestroyNotify) gst_buffer_unref);
+  gst_rtsp_stream_transport_set_callbacks (trans, collect_rtx, collect_rtcp,
+      GUINT_TO_POINTER (97), NULL);
+  fail_unless (gst_rtsp_stream_add_transport (stream, trans));
+
+  push_frame (srcpad, TRUE);
+  push_frame (srcpad, FALSE);
+  push_frame (srcpad, FALSE);
+
+  /* the client lost the second packet */
+  send_nack (stream, 0x11111111, 101);
+
+  end_time = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+  g_mutex_lock (&rtx_lock);
+  while (rtx_packets->len == 0)
+    if (!g_cond_wait_until (&rtx_cond, &rtx_lock, end_time))
+      break;
+  fail_unless_equals_int (rtx_packets->len, 1);
+  g_mutex_unlock (&rtx_lock);
+
+  /* it comes back in the retransmission stream with its original sequence
+   * number in front of the payload, RFC 4588 */
+  fail_unless (gst_rtp_buffer_map (g_ptr_array_index (rtx_packets, 0),
+          GST_MAP_READ, &rtp));
+  fail_if (gst_rtp_buffer_get_ssrc (&rtp) == 0x11111111);
+  fail_unless (gst_rtp_buffer_get_payload_len (&rtp) > 2);
+  payload = gst_rtp_buffer_get_payload (&rtp);
+  fail_unless_equals_int (GST_READ_UINT16_BE (payload), 101);
+  gst_rtp_buffer_unmap (&rtp);
+
+  stats = gst_rtsp_stream_get_retransmission_stats (stream);
+  fail_unless (stats != NULL);
+  fail_unless (gst_structure_get_uint (stats, "rtx-requests", &requests));
+  fail_unless (gst_structure_get_uint (stats, "rtx-packets", &packets));
+  fail_unless_equals_int (requests, 1);
+  fail_unless_equals_int (packets, 1);
+  gst_structure_free (stats);
+
+  fail_unless (gst_rtsp_stream_remove_transport (stream, trans));
+  fail_unless (gst_rtsp_stream_leave_bin (stream, bin, rtpbin));
+  fail_unless (gst_element_set_state (pay, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  g_ptr_array_unref (rtx_packets);
+  g_object_unref (trans);
+  gst_object_unref (bin);
+  gst_object_unref (stream);
+  gst_object_unref (pay);
+  gst_object_unref (srcpad);
+}
+
+GST_END_TEST;
+
+/* the media and FEC packets that reach the client */
+static GMutex fec_lock;
+static GCond fec_cond;
+static guint wire_media_packets, wire_fec_packets;
+
+static gboolean
+count_fec (GstBuffer * buffer, guint8 channel, gpointer user_data)
+{
+  GstRTPBuffer rtp = GST_RTP_BUFFER_INIT;
+
+  if (gst_rtp_buffer_map (buffer, GST_MAP_READ, &rtp)) {
+    g_mutex_lock (&fec_lock);
+    if (gst_rtp_buffer_get_payload_type (&rtp) ==
+        GPOINTER_TO_UINT (user_data))
+      wire_fec_packets++;
+    else
+      wire_media_packets++;
+    g_cond_signal (&fec_cond);
+    g_mutex_unlock (&fec_lock);
+    gst_rtp_buffer_unmap (&rtp);
+  }
+  return TRUE;
+}
+
+GST_START_TEST (test_fec)
+{
+  GstElementFactory *factory;
+  GstPad *srcpad, *paysrc;
+  GstElement *pay;
+  GstRTSPStream *stream;
+  GstBin *bin;
+  GstElement *rtpbin;
+  GstRTSPTransport *tr;
+  GstRTSPStreamTransport *trans;
+  GstStructure *stats;
+  gdouble overhead;
+  gint64 end_time;
+  guint i;
+
+  /* the stream doesn't send FEC without the plugin */
+  factory = gst_element_factory_find ("rtpulpfecenc");
+  if (factory == NULL)
+    return;
+  gst_object_unref (factory);
+
+  pay = payloader_new (&srcpad, 0x11111111, 100);
+  paysrc = gst_element_get_static_pad (pay, "src");
+  stream = gst_rtsp_stream_new (0, pay, paysrc);
+  gst_object_unref (paysrc);
+  gst_rtsp_stream_set_fec_percentage (stream, 20);
+  gst_rtsp_stream_set_fec_pt (stream, 98);
+
+  rtpbin = gst_element_factory_make ("rtpbin", "testrtpbin");
+  fail_unless (rtpbin != NULL);
+  bin = GST_BIN (gst_bin_new ("testbin"));
+  fail_unless (gst_bin_add (bin, rtpbin));
+  fail_unless (gst_rtsp_stream_join_bin (stream, bin, rtpbin,
+          GST_STATE_PLAYING));
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+
+  fail_unless (gst_rtsp_transport_new (&tr) == GST_RTSP_OK);
+  tr->lower_transport = GST_RTSP_LOWER_TRANS_TCP;
+  trans = gst_rtsp_stream_transport_new (stream, tr);
+  wire_media_packets = wire_fec_packets = 0;
+  gst_rtsp_stream_transport_set_callbacks (trans, count_fec, collect_rtcp,
+      GUINT_TO_POINTER (98), NULL);
+  fail_unless (gst_rtsp_stream_add_transport (stream, trans));
+
+  for (i = 0; i < 100; i++)
+    push_frame (srcpad, i % 10 == 0);
+
+  end_time = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+  g_mutex_lock (&fec_lock);
+  while (wire_media_packets < 100)
+    if (!g_cond_wait_until (&fec_cond, &fec_lock, end_time))
+      break;
+  g_mutex_unlock (&fec_lock);
+  fail_unless (gst_rtsp_stream_remove_transport (stream, trans));
+
+  /* one FEC packet for every 5 media packets, the last one can still be on
+   * its way */
+  fail_unless_equals_int (wire_media_packets, 100);
+  fail_unless (wire_fec_packets >= 19 && wire_fec_packets <= 20);
+
+  stats = gst_rtsp_stream_get_fec_stats (stream);
+  fail_unless (stats != NULL);
+  fail_unless (gst_structure_get_double (stats, "overhead", &overhead));
+  fail_unless (overhead >= 19.0 && overhead <= 21.0);
+  gst_structure_free (stats);
+
+  fail_unless (gst_rtsp_stream_leave_bin (stream, bin, rtpbin));
+  fail_unless (gst_element_set_state (pay, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+  fail_unless (gst_element_set_state (rtpbin, GST_STATE_NULL) ==
+      GST_STATE_CHANGE_SUCCESS);
+
+  g_object_unref (trans);
+  gst_object_unref (bin);
+  gst_object_unref (stream);
+  gst_object_unref (pay);
+  gst_object_unref (srcpad);
+}
+
+GST_END_TEST;
+
 static Suite *
 rtspstream_suite (void)
 {
@@ -100,6 +1551,19 @@ rtspstream_suite (void)
 
   suite_add_tcase (s, tc);
   tcase_add_test (tc, test_get_sockets);
+  tcase_add_test (tc, test_rtp_rewrite);
+  tcase_add_test (tc, test_qos_policy);
+  tcase_add_test (tc, test_request_key_unit);
+  tcase_add_test (tc, test_gop_cache);
+  tcase_add_test (tc, test_rtp_rewrite_udp);
+  tcase_add_test (tc, test_pacing);
+#ifdef IP_RECVTOS
+  tcase_add_test (tc, test_qos_marking);
+#endif
+  tcase_add_test (tc, test_layer_switch);
+  tcase_add_test (tc, test_adaptive_bitrate);
+  tcase_add_test (tc, test_retransmission);
+  tcase_add_test (tc, test_fec);
 
   return s;
 }
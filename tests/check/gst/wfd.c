@@ -0,0 +1,570 @@
+/* GStreamer
+ * Copyright (C) 2026 agent <agent@local>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include <string.h>
+
+#include <rtsp-client-wfd.h>
+#include <rtsp-media-factory-wfd.h>
+#include <rtsp-server-wfd.h>
+
+#define WFD_LAUNCH "( videotestsrc ! capsfilter name=wfdvideocaps ! " \
+  "rtpgstpay name=pay0 pt=96 )"
+#define WFD_URL "rtsp://localhost/wfd1.0/streamid=0"
+
+#define LPCM_AUDIO "LPCM 00000002 00"
+#define AAC_AUDIO  "AAC 00000001 00"
+
+/* a message that the client sent to the sink */
+typedef struct
+{
+  GstRTSPMethod method;         /* GST_RTSP_INVALID for responses */
+  gint cseq;
+  gchar *body;
+} SentMessage;
+
+static GQueue sent = G_QUEUE_INIT;
+static gint sink_cseq;
+
+static void
+sent_message_free (SentMessage * sent_msg)
+{
+  g_free (sent_msg->body);
+  g_slice_free (SentMessage, sent_msg);
+}
+
+static gboolean
+collect_message (GstRTSPClient * client, GstRTSPMessage * message,
+    gboolean close, gpointer user_data)
+{
+  SentMessage *sent_msg;
+  const gchar *uri;
+  GstRTSPVersion version;
+  gchar *str;
+  guint8 *data;
+  guint size;
+
+  sent_msg = g_slice_new0 (SentMessage);
+  sent_msg->method = GST_RTSP_INVALID;
+  if (gst_rtsp_message_get_type (message) == GST_RTSP_MESSAGE_REQUEST)
+    gst_rtsp_message_parse_request (message, &sent_msg->method, &uri,
+        &version);
+
+  if (gst_rtsp_message_get_header (message, GST_RTSP_HDR_CSEQ, &str,
+          0) == GST_RTSP_OK)
+    sent_msg->cseq = atoi (str);
+
+  if (gst_rtsp_message_get_body (message, &data, &size) == GST_RTSP_OK
+      && size > 0)
+    sent_msg->body = g_strndup ((gchar *) data, size);
+
+  g_queue_push_tail (&sent, sent_msg);
+
+  return TRUE;
+}
+
+/* get the next request that the client sent, skipping the responses */
+static SentMessage *
+pop_request (GstRTSPMethod method)
+{
+  SentMessage *sent_msg;
+
+  while ((sent_msg = g_queue_pop_head (&sent))) {
+    if (sent_msg->method != GST_RTSP_INVALID)
+      break;
+    sent_message_free (sent_msg);
+  }
+  fail_unless (sent_msg != NULL);
+  fail_unless (sent_msg->method == method);
+
+  return sent_msg;
+}
+
+static void
+clear_sent (void)
+{
+  SentMessage *sent_msg;
+
+  while ((sent_msg = g_queue_pop_head (&sent)))
+    sent_message_free (sent_msg);
+}
+
+static GstRTSPWFDClient *
+setup_wfd_client (const gchar * sink_ip)
+{
+  GstRTSPWFDClient *client;
+  GstRTSPConnection *conn;
+  GSocket *sock;
+  GError *error = NULL;
+
+  client = gst_rtsp_wfd_client_new ();
+
+  sock = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_STREAM,
+      G_SOCKET_PROTOCOL_TCP, &error);
+  g_assert_no_error (error);
+  fail_unless (gst_rtsp_connection_create_from_socket (sock, sink_ip, 7236,
+          NULL, &conn) == GST_RTSP_OK);
+  fail_unless (gst_rtsp_client_set_connection (GST_RTSP_CLIENT (client),
+          conn));
+  g_object_unref (sock);
+
+  gst_rtsp_client_set_send_func (GST_RTSP_CLIENT (client), collect_message,
+      NULL, NULL);
+
+  return client;
+}
+
+/* answer request @cseq of the server as the sink */
+static void
+sink_respond (GstRTSPWFDClient * client, gint cseq, const gchar * body)
+{
+  GstRTSPMessage response = { 0 };
+  gchar *str;
+
+  fail_unless (gst_rtsp_message_init_response (&response, GST_RTSP_STS_OK,
+          "OK", NULL) == GST_RTSP_OK);
+  str = g_strdup_printf ("%d", cseq);
+  gst_rtsp_message_take_header (&response, GST_RTSP_HDR_CSEQ, str);
+  if (body) {
+    gst_rtsp_message_add_header (&response, GST_RTSP_HDR_CONTENT_TYPE,
+        "text/parameters");
+    gst_rtsp_message_set_body (&response, (guint8 *) body, strlen (body));
+  }
+
+  fail_unless (gst_rtsp_client_handle_message (GST_RTSP_CLIENT (client),
+          &response) == GST_RTSP_OK);
+  gst_rtsp_message_unset (&response);
+}
+
+/* send the M2 OPTIONS request of the sink */
+static void
+sink_send_options (GstRTSPWFDClient * client)
+{
+  GstRTSPMessage request = { 0 };
+  gchar *str;
+
+  fail_unless (gst_rtsp_message_init_request (&request, GST_RTSP_OPTIONS,
+          "*") == GST_RTSP_OK);
+  str = g_strdup_printf ("%d", ++sink_cseq);
+  gst_rtsp_message_take_header (&request, GST_RTSP_HDR_CSEQ, str);
+  gst_rtsp_message_add_header (&request, GST_RTSP_HDR_REQUIRE,
+      "org.wfa.wfd1.0");
+  gst_rtsp_message_add_header (&request, GST_RTSP_HDR_USER_AGENT,
+      "check-sink");
+
+  fail_unless (gst_rtsp_client_handle_message (GST_RTSP_CLIENT (client),
+          &request) == GST_RTSP_OK);
+  gst_rtsp_message_unset (&request);
+}
+
+/* the EDID of a 1920x1080 display with @serial */
+static gchar *
+make_edid (guint8 serial)
+{
+  guint8 edid[128] = { 0, };
+  GString *str;
+  guint i;
+
+  edid[12] = serial;
+  edid[56] = 0x80;
+  edid[58] = 0x70;
+  edid[59] = 0x38;
+  edid[61] = 0x40;
+
+  str = g_string_new ("0001 ");
+  for (i = 0; i < sizeof (edid); i++)
+    g_string_append_printf (str, "%02x", edid[i]);
+
+  return g_string_free (str, FALSE);
+}
+
+/* the M3 answer of a sink that only supports 640x480p60 video */
+static gchar *
+make_m3_body (const gchar * audio, const gchar * edid)
+{
+  return g_strdup_printf ("wfd_audio_codecs: %s\r\n"
+      "wfd_video_formats: 00 00 01 01 00000001 00000000 00000000 00 "
+      "0000 0000 00 none none\r\n"
+      "wfd_display_edid: %s\r\n"
+      "wfd_client_rtp_ports: RTP/AVP/UDP;unicast 19000 0 mode=play\r\n",
+      audio, edid);
+}
+
+/* the answer of a known sink to the minimal M3 */
+static gchar *
+make_confirm_body (const gchar * edid)
+{
+  return g_strdup_printf ("wfd_display_edid: %s\r\n"
+      "wfd_client_rtp_ports: RTP/AVP/UDP;unicast 19000 0 mode=play\r\n",
+      edid);
+}
+
+/* do M1 and M2 with the sink and return the M3 request of the server */
+static SentMessage *
+start_negotiation (GstRTSPWFDClient * client)
+{
+  SentMessage *req;
+
+  gst_rtsp_wfd_client_start_wfd (client);
+  req = pop_request (GST_RTSP_OPTIONS);
+  sink_respond (client, req->cseq, NULL);
+  sent_message_free (req);
+
+  sink_send_options (client);
+
+  return pop_request (GST_RTSP_GET_PARAMETER);
+}
+
+/* answer the M3 request and the M4 request that follows it and return
+ * the body of M4 */
+static gchar *
+finish_negotiation (GstRTSPWFDClient * client, SentMessage * m3,
+    const gchar * m3_body)
+{
+  SentMessage *req;
+  gchar *m4_body;
+
+  sink_respond (client, m3->cseq, m3_body);
+  sent_message_free (m3);
+
+  req = pop_request (GST_RTSP_SET_PARAMETER);
+  fail_unless (req->body != NULL);
+  m4_body = req->body;
+  req->body = NULL;
+  sink_respond (client, req->cseq, NULL);
+  sent_message_free (req);
+
+  /* M4 is done, the server triggers the SETUP of the sink */
+  req = pop_request (GST_RTSP_SET_PARAMETER);
+  fail_unless (req->body != NULL);
+  fail_unless (strstr (req->body, "wfd_trigger_method: SETUP") != NULL);
+  sent_message_free (req);
+
+  return m4_body;
+}
+
+static void
+negotiate (GstRTSPWFDClient * client, const gchar * audio)
+{
+  gchar *m3_body;
+
+  m3_body = make_m3_body (audio, "none");
+  g_free (finish_negotiation (client, start_negotiation (client), m3_body));
+  g_free (m3_body);
+}
+
+static GstRTSPMedia *
+construct_for_client (GstRTSPMediaFactory * factory,
+    GstRTSPWFDClient * client, const GstRTSPUrl * url)
+{
+  GstRTSPContext ctx = { NULL };
+  GstRTSPMedia *media;
+
+  ctx.client = GST_RTSP_CLIENT (client);
+  gst_rtsp_context_push_current (&ctx);
+  media = gst_rtsp_media_factory_construct (factory, url);
+  gst_rtsp_context_pop_current (&ctx);
+
+  return media;
+}
+
+GST_START_TEST (test_shared_media_per_format)
+{
+  GstRTSPWFDClient *client1, *client2, *client3;
+  GstRTSPMediaFactory *factory;
+  GstRTSPMedia *media1, *media2, *media3;
+  GstRTSPUrl *url;
+  GstElement *element, *capsfilter;
+  GstCaps *caps;
+  GstStructure *s;
+  gchar *format1, *format2, *format3;
+  gint width, height;
+
+  client1 = setup_wfd_client ("10.28.0.1");
+  client2 = setup_wfd_client ("10.28.0.2");
+  client3 = setup_wfd_client ("10.28.0.3");
+
+  negotiate (client1, LPCM_AUDIO);
+  negotiate (client2, LPCM_AUDIO);
+  negotiate (client3, AAC_AUDIO);
+
+  format1 = gst_rtsp_wfd_client_get_negotiated_format (client1);
+  format2 = gst_rtsp_wfd_client_get_negotiated_format (client2);
+  format3 = gst_rtsp_wfd_client_get_negotiated_format (client3);
+  fail_unless (format1 != NULL);
+  fail_unless_equals_string (format1, format2);
+  fail_if (g_str_equal (format1, format3));
+  g_free (format1);
+  g_free (format2);
+  g_free (format3);
+
+  factory = GST_RTSP_MEDIA_FACTORY (gst_rtsp_media_factory_wfd_new ());
+  gst_rtsp_media_factory_set_launch (factory, WFD_LAUNCH);
+  fail_unless (gst_rtsp_url_parse (WFD_URL, &url) == GST_RTSP_OK);
+
+  /* the sinks with the same format get the same media */
+  media1 = construct_for_client (factory, client1, url);
+  media2 = construct_for_client (factory, client2, url);
+  media3 = construct_for_client (factory, client3, url);
+  fail_unless (GST_IS_RTSP_MEDIA (media1));
+  fail_unless (media1 == media2);
+  fail_unless (media1 != media3);
+
+  /* and the media encodes the negotiated resolution */
+  element = gst_rtsp_media_get_element (media1);
+  capsfilter = gst_bin_get_by_name (GST_BIN (element), "wfdvideocaps");
+  fail_unless (capsfilter != NULL);
+  g_object_get (capsfilter, "caps", &caps, NULL);
+  s = gst_caps_get_structure (caps, 0);
+  fail_unless (gst_structure_get_int (s, "width", &width));
+  fail_unless (gst_structure_get_int (s, "height", &height));
+  fail_unless (width == 640 && height == 480);
+  gst_caps_unref (caps);
+  gst_object_unref (capsfilter);
+  gst_object_unref (element);
+
+  g_object_unref (media1);
+  g_object_unref (media2);
+  g_object_unref (media3);
+  gst_rtsp_url_free (url);
+  g_object_unref (factory);
+
+  clear_sent ();
+  g_object_unref (client1);
+  g_object_unref (client2);
+  g_object_unref (client3);
+}
+
+GST_END_TEST;
+
+static void
+client_closed (GstRTSPClient * client, gboolean * closed)
+{
+  *closed = TRUE;
+}
+
+static void
+client_connected (GstRTSPServer * server, GstRTSPClient * client,
+    gboolean * closed)
+{
+  g_signal_connect (client, "closed", G_CALLBACK (client_closed), closed);
+}
+
+GST_START_TEST (test_keepalive_timeout)
+{
+  GstRTSPWFDServer *server;
+  GSocketClient *socket_client;
+  GSocketConnection *connection;
+  gchar *service;
+  guint source_id;
+  gboolean closed = FALSE;
+  gint64 deadline;
+
+  server = gst_rtsp_wfd_server_new ();
+  gst_rtsp_server_set_service (GST_RTSP_SERVER (server), "0");
+  gst_rtsp_wfd_server_set_keepalive_interval (server, 1);
+  gst_rtsp_wfd_server_set_keepalive_timeout (server, 200);
+  g_signal_connect (server, "client-connected",
+      G_CALLBACK (client_connected), &closed);
+
+  source_id = gst_rtsp_server_attach (GST_RTSP_SERVER (server), NULL);
+  fail_if (source_id == 0);
+  service = gst_rtsp_server_get_service (GST_RTSP_SERVER (server));
+
+  socket_client = g_socket_client_new ();
+  connection = g_socket_client_connect_to_host (socket_client, "127.0.0.1",
+      atoi (service), NULL, NULL);
+  fail_unless (connection != NULL);
+  g_free (service);
+
+  /* the sink never answers M1, the negotiation is timed like a keepalive
+   * and the server drops the sink when its first keepalive is due */
+  deadline = g_get_monotonic_time () + 5 * G_USEC_PER_SEC;
+  while (!closed && g_get_monotonic_time () < deadline)
+    g_main_context_iteration (NULL, TRUE);
+  fail_unless (closed);
+
+  g_source_remove (source_id);
+  g_object_unref (connection);
+  g_object_unref (socket_client);
+  g_object_unref (server);
+}
+
+GST_END_TEST;
+
+/* a sink that comes back with the same display skips the capability
+ * exchange and gets a presentation url for its new connection */
+GST_START_TEST (test_sink_cache_hit)
+{
+  GstRTSPWFDClient *client1, *client2;
+  GstRTSPUrl *url;
+  SentMessage *m3;
+  gchar *edid, *body, *m4_body, *format1, *format2;
+
+  edid = make_edid (1);
+
+  client1 = setup_wfd_client ("10.30.0.1");
+  m3 = start_negotiation (client1);
+  fail_unless (strstr (m3->body, "wfd_video_formats") != NULL);
+  body = make_m3_body (LPCM_AUDIO, edid);
+  m4_body = finish_negotiation (client1, m3, body);
+  fail_unless (strstr (m4_body, "rtsp://10.30.0.1/wfd1.0/streamid=0"));
+  g_free (m4_body);
+  g_free (body);
+
+  /* the same sink, now reached on another address of the server */
+  client2 = setup_wfd_client ("10.30.0.1");
+  url = gst_rtsp_connection_get_url (gst_rtsp_client_get_connection
+      (GST_RTSP_CLIENT (client2)));
+  g_free (url->host);
+  url->host = g_strdup ("10.30.0.100");
+
+  m3 = start_negotiation (client2);
+  fail_unless (strstr (m3->body, "wfd_display_edid") != NULL);
+  fail_if (strstr (m3->body, "wfd_video_formats") != NULL);
+  fail_if (strstr (m3->body, "wfd_audio_codecs") != NULL);
+  body = make_confirm_body (edid);
+  m4_body = finish_negotiation (client2, m3, body);
+  fail_unless (strstr (m4_body, "rtsp://10.30.0.100/wfd1.0/streamid=0"));
+  fail_if (strstr (m4_body, "rtsp://10.30.0.1/") != NULL);
+  g_free (m4_body);
+  g_free (body);
+
+  format1 = gst_rtsp_wfd_client_get_negotiated_format (client1);
+  format2 = gst_rtsp_wfd_client_get_negotiated_format (client2);
+  fail_unless (format1 != NULL);
+  fail_unless_equals_string (format1, format2);
+  g_free (format1);
+  g_free (format2);
+
+  g_free (edid);
+  clear_sent ();
+  g_object_unref (client1);
+  g_object_unref (client2);
+}
+
+GST_END_TEST;
+
+/* unknown sinks and sinks without EDID do the full capability exchange */
+GST_START_TEST (test_sink_cache_miss)
+{
+  GstRTSPWFDClient *client1, *client2;
+  SentMessage *m3;
+  gchar *body;
+
+  client1 = setup_wfd_client ("10.30.1.1");
+  m3 = start_negotiation (client1);
+  fail_unless (strstr (m3->body, "wfd_video_formats") != NULL);
+  body = make_m3_body (LPCM_AUDIO, "none");
+  g_free (finish_negotiation (client1, m3, body));
+
+  /* a sink without EDID can't be confirmed and is negotiated again */
+  client2 = setup_wfd_client ("10.30.1.1");
+  m3 = start_negotiation (client2);
+  fail_unless (strstr (m3->body, "wfd_video_formats") != NULL);
+  fail_unless (strstr (m3->body, "wfd_audio_codecs") != NULL);
+  g_free (finish_negotiation (client2, m3, body));
+  g_free (body);
+
+  clear_sent ();
+  g_object_unref (client1);
+  g_object_unref (client2);
+}
+
+GST_END_TEST;
+
+/* another display behind the address of a known sink is negotiated again
+ * and replaces the cached sink */
+GST_START_TEST (test_sink_cache_edid_change)
+{
+  GstRTSPWFDClient *client1, *client2, *client3;
+  SentMessage *m3;
+  gchar *edid1, *edid2, *body, *format1, *format2;
+
+  edid1 = make_edid (1);
+  edid2 = make_edid (2);
+
+  client1 = setup_wfd_client ("10.30.2.1");
+  body = make_m3_body (LPCM_AUDIO, edid1);
+  g_free (finish_negotiation (client1, start_negotiation (client1), body));
+  g_free (body);
+
+  client2 = setup_wfd_client ("10.30.2.1");
+  m3 = start_negotiation (client2);
+  fail_if (strstr (m3->body, "wfd_video_formats") != NULL);
+
+  /* the EDID doesn't match, the server asks for all capabilities */
+  body = make_confirm_body (edid2);
+  sink_respond (client2, m3->cseq, body);
+  sent_message_free (m3);
+  g_free (body);
+
+  m3 = pop_request (GST_RTSP_GET_PARAMETER);
+  fail_unless (strstr (m3->body, "wfd_video_formats") != NULL);
+  body = make_m3_body (AAC_AUDIO, edid2);
+  g_free (finish_negotiation (client2, m3, body));
+  g_free (body);
+
+  format1 = gst_rtsp_wfd_client_get_negotiated_format (client1);
+  format2 = gst_rtsp_wfd_client_get_negotiated_format (client2);
+  fail_if (g_str_equal (format1, format2));
+  g_free (format1);
+
+  /* the new display is in the cache now */
+  client3 = setup_wfd_client ("10.30.2.1");
+  m3 = start_negotiation (client3);
+  fail_if (strstr (m3->body, "wfd_video_formats") != NULL);
+  body = make_confirm_body (edid2);
+  g_free (finish_negotiation (client3, m3, body));
+  g_free (body);
+
+  format1 = gst_rtsp_wfd_client_get_negotiated_format (client3);
+  fail_unless_equals_string (format1, format2);
+  g_free (format1);
+  g_free (format2);
+
+  g_free (edid1);
+  g_free (edid2);
+  clear_sent ();
+  g_object_unref (client1);
+  g_object_unref (client2);
+  g_object_unref (client3);
+}
+
+GST_END_TEST;
+
+static Suite *
+rtspwfd_suite (void)
+{
+  Suite *s = suite_create ("rtspwfd");
+  TCase *tc = tcase_create ("general");
+
+  suite_add_tcase (s, tc);
+  tcase_set_timeout (tc, 20);
+  tcase_add_test (tc, test_shared_media_per_format);
+  tcase_add_test (tc, test_keepalive_timeout);
+  tcase_add_test (tc, test_sink_cache_hit);
+  tcase_add_test (tc, test_sink_cache_miss);
+  tcase_add_test (tc, test_sink_cache_edid_change);
+
+  return s;
+}
+
+GST_CHECK_MAIN (rtspwfd);